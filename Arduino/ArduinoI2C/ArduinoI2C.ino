@@ -193,5 +193,19 @@ void loop() {
     return;
   }
   Serial.println(vbus);
+
+  // read the feedback of the axis in one transaction
+  float pos, vel, current;
+  success = odrive::read_axis_properties<odrive::AXIS__ENCODER__POS_ESTIMATE,
+      odrive::AXIS__ENCODER__PLL_VEL, odrive::AXIS__MOTOR__CURRENT_CONTROL__IQ_MEASURED>(odrive_num, axis_num, &pos, &vel, &current);
+  if (!success) {
+    Serial.println("error");
+    return;
+  }
+  Serial.print(pos);
+  Serial.print('\t');
+  Serial.print(vel);
+  Serial.print('\t');
+  Serial.println(current);
 }
 
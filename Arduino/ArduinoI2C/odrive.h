@@ -6,6 +6,8 @@
 *   - Use read_property<PropertyId>() to read properties from the ODrive.
 *   - Use write_property<PropertyId>() to modify properties on the ODrive.
 *   - Use trigger<PropertyId>() to trigger a function (such as reboot or save_configuration)
+*   - Use read_properties<PropertyId...>() to read several properties in one
+*     I2C transaction.
 *   - Use endpoint_type_t<PropertyId> to retrieve the underlying type
 *     of a given property.
 *   - Refer to PropertyId for a list of available properties.
@@ -57,6 +59,11 @@ bool I2C_transaction(uint8_t slave_addr, const uint8_t * tx_buffer, size_t tx_le
 namespace odrive {
     static constexpr const uint8_t i2c_addr = (0xD << 3); // write: 1101xxx0, read: 1101xxx1
 
+    // Reserved endpoint ID of a batch request, see docs/protocol.md
+    static constexpr const uint16_t batch_endpoint_id = 0x7fff;
+    // The response of an I2C request can't be larger than this
+    static constexpr const size_t max_response_size = 30;
+
     template<typename T>
     using bit_width = std::integral_constant<unsigned int, CHAR_BIT * sizeof(T)>;
 
@@ -175,6 +182,94 @@ namespace odrive {
     }
 
 
+    // Encodes the read operations of a batch request and decodes their results,
+    // one property per level of the recursion
+    template<int... IPropertyIds>
+    struct batch_read;
+
+    template<>
+    struct batch_read<> {
+        static constexpr size_t count = 0;
+        static constexpr size_t request_size = 0;
+        static constexpr size_t response_size = 0;
+        static void write_request(uint8_t buffer[], uint16_t address_offset) {}
+        static void read_response(const uint8_t buffer[]) {}
+    };
+
+    template<int IPropertyId, int... IRest>
+    struct batch_read<IPropertyId, IRest...> {
+        using T = endpoint_type_t<IPropertyId>;
+        using rest = batch_read<IRest...>;
+        static constexpr size_t count = 1 + rest::count;
+        static constexpr size_t request_size = 4 + rest::request_size;
+        static constexpr size_t response_size = byte_width<T>::value + rest::response_size;
+
+        static void write_request(uint8_t buffer[], uint16_t address_offset) {
+            write_le<uint16_t>(buffer, IPropertyId + address_offset);
+            buffer[2] = 0; // no input
+            buffer[3] = byte_width<T>::value;
+            rest::write_request(buffer + 4, address_offset);
+        }
+
+        template<typename... TRest>
+        static void read_response(const uint8_t buffer[], T* value, TRest*... values) {
+            if (value)
+                *value = read_le<T>(buffer);
+            rest::read_response(buffer + byte_width<T>::value, values...);
+        }
+    };
+
+    /* @brief Read several endpoints on the ODrive in one I2C transaction.
+    * To read axis specific endpoints use read_axis_properties() instead.
+    * This needs a firmware that supports batch requests.
+    *
+    * Usage example:
+    *   float vbus;
+    *   uint64_t serial_number;
+    *   success = odrive::read_properties<odrive::VBUS_VOLTAGE, odrive::SERIAL_NUMBER>(0, &vbus, &serial_number);
+    *
+    * @param num Selects the ODrive. For instance the value 4 selects
+    * the ODrive that has [A2, A1, A0] connected to [VCC, GND, GND].
+    * @return true if the I2C transaction succeeded and the ODrive read all
+    * endpoints, false otherwise
+    */
+    template<int... IPropertyIds>
+    bool read_properties_at(uint8_t num, uint16_t address_offset, endpoint_type_t<IPropertyIds>*... values) {
+        using batch = batch_read<IPropertyIds...>;
+        static_assert(1 + batch::response_size <= max_response_size, "the values don't fit into one I2C response");
+        uint8_t i2c_tx_buffer[2 + batch::request_size + 2];
+        write_le<uint16_t>(i2c_tx_buffer, batch_endpoint_id);
+        batch::write_request(i2c_tx_buffer + 2, address_offset);
+        write_le<uint16_t>(i2c_tx_buffer + sizeof(i2c_tx_buffer) - 2, json_crc);
+        uint8_t i2c_rx_buffer[1 + batch::response_size];
+        if (!I2C_transaction(i2c_addr + num,
+            i2c_tx_buffer, sizeof(i2c_tx_buffer),
+            i2c_rx_buffer, sizeof(i2c_rx_buffer)))
+            return false;
+        if (i2c_rx_buffer[0] != batch::count) // number of operations carried out
+            return false;
+        batch::read_response(i2c_rx_buffer + 1, values...);
+        return true;
+    }
+
+    template<int... IPropertyIds>
+    bool read_properties(uint8_t num, endpoint_type_t<IPropertyIds>*... values) {
+        return read_properties_at<IPropertyIds...>(num, 0, values...);
+    }
+
+    /* @brief Same as read_properties() for endpoints of one axis
+    *
+    * Usage example (position, velocity and current in one transaction):
+    *   float pos, vel, current;
+    *   success = odrive::read_axis_properties<odrive::AXIS__ENCODER__POS_ESTIMATE,
+    *       odrive::AXIS__ENCODER__PLL_VEL, odrive::AXIS__MOTOR__CURRENT_CONTROL__IQ_MEASURED>(0, 0, &pos, &vel, &current);
+    */
+    template<int... IPropertyIds>
+    bool read_axis_properties(uint8_t num, uint8_t axis, endpoint_type_t<IPropertyIds>*... values) {
+        return read_properties_at<IPropertyIds...>(num, axis * per_axis_offset, values...);
+    }
+
+
     /* @brief Checks if the axis is in the requested state and the error register is clear */
     bool check_axis_state(uint8_t num, uint8_t axis, uint8_t state) {
         endpoint_type_t<odrive::AXIS__CURRENT_STATE> observed_state = 0;
@@ -11,6 +11,9 @@ static const int kMotorStrideBool = 4;
 static const int kMotorOffsetUint16 = 0;
 static const int kMotorStrideUint16 = 2;
 
+static const uint8_t kBinaryFramePrefix = 0xF5;
+static const int kBinaryFrameSize = 15;
+
 // Print with stream operator
 template<class T> inline Print& operator <<(Print &obj,     T arg) { obj.print(arg);    return obj; }
 template<>        inline Print& operator <<(Print &obj, float arg) { obj.print(arg, 4); return obj; }
@@ -27,6 +30,8 @@ void ODriveArduino::SetPosition(int motor_number, float position, float velocity
 }
 
 void ODriveArduino::SetPosition(int motor_number, float position, float velocity_feedforward, float current_feedforward) {
+    if (binary_mode_)
+        return SendBinary(motor_number, BINARY_OP_POSITION, position, velocity_feedforward, current_feedforward);
     serial_ << "p " << motor_number  << " " << position << " " << velocity_feedforward << " " << current_feedforward << "\n";
 }
 
@@ -35,10 +40,14 @@ void ODriveArduino::SetVelocity(int motor_number, float velocity) {
 }
 
 void ODriveArduino::SetVelocity(int motor_number, float velocity, float current_feedforward) {
+    if (binary_mode_)
+        return SendBinary(motor_number, BINARY_OP_VELOCITY, velocity, current_feedforward, NAN);
     serial_ << "v " << motor_number  << " " << velocity << " " << current_feedforward << "\n";
 }
 
 void ODriveArduino::SetCurrent(int motor_number, float current) {
+    if (binary_mode_)
+        return SendBinary(motor_number, BINARY_OP_TORQUE, current, NAN, NAN);
     serial_ << "c " << motor_number << " " << current << "\n";
 }
 
@@ -46,11 +55,70 @@ void ODriveArduino::TrapezoidalMove(int motor_number, float position){
     serial_ << "t " << motor_number << " " << position << "\n";
 }
 
+// CRC8 with the polynomial and init value of the native protocol
+static uint8_t crc8(const uint8_t* buffer, int length) {
+    uint8_t crc = 0x42;
+    while (length--) {
+        crc ^= *(buffer++);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x37) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+bool ODriveArduino::BinaryCommand(int motor_number, BinaryOp_t op, float setpoint, float feedforward1, float feedforward2, Feedback_t& feedback) {
+    // The floats are little endian on the ODrive and on all Arduino boards
+    uint8_t frame[kBinaryFrameSize] = {kBinaryFramePrefix, (uint8_t)((motor_number << 4) | op)};
+    memcpy(frame + 2, &setpoint, 4);
+    memcpy(frame + 6, &feedforward1, 4);
+    memcpy(frame + 10, &feedforward2, 4);
+    frame[kBinaryFrameSize - 1] = crc8(frame, kBinaryFrameSize - 1);
+    serial_.write(frame, kBinaryFrameSize);
+
+    // Skip anything else (e.g. ASCII responses) until the response frame starts
+    int c;
+    unsigned long timeout_start = millis();
+    do {
+        if (millis() - timeout_start >= 1000)
+            return false;
+        c = serial_.read();
+    } while (c != kBinaryFramePrefix);
+    frame[0] = kBinaryFramePrefix;
+    if (serial_.readBytes(frame + 1, kBinaryFrameSize - 1) != kBinaryFrameSize - 1
+            || crc8(frame, kBinaryFrameSize - 1) != frame[kBinaryFrameSize - 1]
+            || (frame[1] & 0x0f) != 0)
+        return false;
+    memcpy(&feedback.position, frame + 2, 4);
+    memcpy(&feedback.velocity, frame + 6, 4);
+    memcpy(&feedback.current, frame + 10, 4);
+    last_feedback_[motor_number & 1] = feedback;
+    return true;
+}
+
+bool ODriveArduino::BinaryCommand(int motor_number, BinaryOp_t op, const Setpoint_t& setpoint, Feedback_t& feedback) {
+    return BinaryCommand(motor_number, op, setpoint.setpoint, setpoint.feedforward1, setpoint.feedforward2, feedback);
+}
+
+bool ODriveArduino::GetFeedback(int motor_number, Feedback_t& feedback) {
+    return BinaryCommand(motor_number, BINARY_OP_FEEDBACK, NAN, NAN, NAN, feedback);
+}
+
+// The response has to be read even if the caller doesn't need it, otherwise it
+// would end up in front of the next ASCII response
+void ODriveArduino::SendBinary(int motor_number, BinaryOp_t op, float setpoint, float feedforward1, float feedforward2) {
+    Feedback_t feedback;
+    BinaryCommand(motor_number, op, setpoint, feedforward1, feedforward2, feedback);
+}
+
 float ODriveArduino::readFloat() {
     return readString().toFloat();
 }
 
 float ODriveArduino::GetVelocity(int motor_number){
+    if (binary_mode_) {
+        Feedback_t feedback;
+        return GetFeedback(motor_number, feedback) ? feedback.velocity : 0.0f;
+    }
 	serial_<< "r axis" << motor_number << ".encoder.vel_estimate\n";
 	return ODriveArduino::readFloat();
 }
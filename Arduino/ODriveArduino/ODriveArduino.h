@@ -18,8 +18,34 @@ public:
         AXIS_STATE_CLOSED_LOOP_CONTROL = 8  //<! run closed loop control
     };
 
+    // Operations of the binary command frame
+    enum BinaryOp_t {
+        BINARY_OP_FEEDBACK = 0,             //<! only read the feedback
+        BINARY_OP_POSITION = 1,             //<! setpoint, velocity feedforward, current feedforward
+        BINARY_OP_VELOCITY = 2,             //<! setpoint, current feedforward
+        BINARY_OP_TORQUE = 3                //<! setpoint
+    };
+
+    struct Setpoint_t {
+        float setpoint;
+        float feedforward1;                 //<! NAN leaves it unchanged
+        float feedforward2;                 //<! NAN leaves it unchanged
+    };
+
+    struct Feedback_t {
+        float position;
+        float velocity;
+        float current;                      //<! Iq_measured
+    };
+
     ODriveArduino(Stream& serial);
 
+    // In binary mode the commands below and GetVelocity() exchange binary
+    // frames instead of ASCII lines, which saves formatting and parsing floats.
+    // Every command then also reads back the feedback of the axis, see
+    // GetLastFeedback(). TrapezoidalMove() and the ASCII helpers are unchanged.
+    void SetBinaryMode(bool binary_mode) { binary_mode_ = binary_mode; }
+
     // Commands
     void SetPosition(int motor_number, float position);
     void SetPosition(int motor_number, float position, float velocity_feedforward);
@@ -28,6 +54,15 @@ public:
     void SetVelocity(int motor_number, float velocity, float current_feedforward);
     void SetCurrent(int motor_number, float current);
     void TrapezoidalMove(int motor_number, float position);
+    // Sends a setpoint in a binary frame and reads back the feedback of the
+    // axis. NAN for a feedforward leaves it unchanged. Returns false on timeout
+    // or a corrupted response.
+    bool BinaryCommand(int motor_number, BinaryOp_t op, float setpoint, float feedforward1, float feedforward2, Feedback_t& feedback);
+    bool BinaryCommand(int motor_number, BinaryOp_t op, const Setpoint_t& setpoint, Feedback_t& feedback);
+    // Reads the feedback of the axis in a binary frame, in either mode
+    bool GetFeedback(int motor_number, Feedback_t& feedback);
+    // The feedback of the last successful binary frame of the axis
+    const Feedback_t& GetLastFeedback(int motor_number) const { return last_feedback_[motor_number & 1]; }
     // Getters
     float GetVelocity(int motor_number);
     // General params
@@ -38,8 +73,11 @@ public:
     bool run_state(int axis, int requested_state, bool wait_for_idle, float timeout = 10.0f);
 private:
     String readString();
+    void SendBinary(int motor_number, BinaryOp_t op, float setpoint, float feedforward1, float feedforward2);
 
     Stream& serial_;
+    bool binary_mode_ = false;
+    Feedback_t last_feedback_[2] = {};
 };
 
 #endif //ODriveArduino_h
@@ -63,6 +63,7 @@ void setup() {
   Serial.println("Send the character 's' to exectue test move");
   Serial.println("Send the character 'b' to read bus voltage");
   Serial.println("Send the character 'p' to read motor positions in a 10s loop");
+  Serial.println("Send the character 'f' to toggle binary mode for the test move and the feedback");
 }
 
 void loop() {
@@ -106,14 +107,27 @@ void loop() {
       Serial << "Vbus voltage: " << odrive.readFloat() << '\n';
     }
 
+    // Toggle binary mode. The test move then streams binary frames, which is
+    // faster, especially on AVR boards and with software serial.
+    if (c == 'f') {
+      static bool binary_mode = false;
+      binary_mode = !binary_mode;
+      odrive.SetBinaryMode(binary_mode);
+      Serial << "Binary mode " << (binary_mode ? "on" : "off") << '\n';
+    }
+
     // print motor positions in a 10s loop
     if (c == 'p') {
       static const unsigned long duration = 10000;
       unsigned long start = millis();
       while(millis() - start < duration) {
         for (int motor = 0; motor < 2; ++motor) {
-          odrive_serial << "r axis" << motor << ".encoder.pos_estimate\n";
-          Serial << odrive.readFloat() << '\t';
+          ODriveArduino::Feedback_t feedback;
+          if (odrive.GetFeedback(motor, feedback)) {
+            Serial << feedback.position << '\t';
+          } else {
+            Serial << "timeout\t";
+          }
         }
         Serial << '\n';
       }
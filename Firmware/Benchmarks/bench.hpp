@@ -0,0 +1,49 @@
+#ifndef __BENCH_HPP
+#define __BENCH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A host micro-benchmark of one kernel.
+ *
+ * The function runs the kernel `iterations` times. The runner picks the
+ * number of iterations and reports the time per iteration (see
+ * bench_runner.cpp). Benchmarks register themselves with BENCHMARK().
+ */
+struct Benchmark {
+    typedef void (*Fn)(size_t iterations);
+
+    Benchmark(const char* name, Fn fn) : name(name), fn(fn), next(list) {
+        list = this;
+    }
+
+    const char* name;
+    Fn fn;
+    Benchmark* next;
+
+    static inline Benchmark* list = nullptr;
+};
+
+#define BENCHMARK(name) \
+    static void bench_##name(size_t iterations); \
+    static Benchmark bench_##name##_registration(#name, bench_##name); \
+    static void bench_##name(size_t iterations)
+
+// Keeps the compiler from optimizing away the computation of a value
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Deterministic pseudo random inputs in [min, max), so that the kernels
+// can't be constant folded and the runs are comparable.
+inline void fill_inputs(float* values, size_t count, float min, float max) {
+    uint32_t state = 1;
+    for (size_t i = 0; i < count; ++i) {
+        state = state * 1664525u + 1013904223u;
+        values[i] = min + (max - min) * (float)(state >> 8) * (1.0f / 16777216.0f);
+    }
+}
+
+#endif // __BENCH_HPP
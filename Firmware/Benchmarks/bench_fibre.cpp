@@ -0,0 +1,59 @@
+#include "bench.hpp"
+#include <fibre/protocol.hpp>
+#include <vector>
+
+// protocol.cpp refers to the autogenerated endpoint table, which the segmenter
+// doesn't use.
+namespace fibre {
+const unsigned char embedded_json[] = {0};
+const size_t embedded_json_length = 0;
+const JsonPage embedded_json_pages[] = {{"", 0, 0}};
+const size_t embedded_json_page_count = 0;
+const uint16_t json_crc_ = 0;
+const uint32_t json_version_id_ = 0;
+bool endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer) { return false; }
+bool get_endpoint_property(endpoint_ref_t endpoint_ref, Introspectable* property) { return false; }
+}
+
+class VectorStreamSink : public StreamSink {
+public:
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) final {
+        bytes_.insert(bytes_.end(), buffer, buffer + length);
+        if (processed_bytes)
+            *processed_bytes += length;
+        return 0;
+    }
+    size_t get_free_space() final { return SIZE_MAX; }
+
+    std::vector<uint8_t> bytes_;
+};
+
+class CountingPacketSink : public PacketSink {
+public:
+    int process_packet(const uint8_t* buffer, size_t length) final {
+        bytes_ += length;
+        return 0;
+    }
+
+    size_t bytes_ = 0;
+};
+
+// One iteration is one packet with a 64 byte payload, the typical size of
+// a USB transfer
+BENCHMARK(stream_to_packet_segmenter_64B) {
+    VectorStreamSink stream;
+    StreamBasedPacketSink encoder(stream);
+    uint8_t payload[64];
+    for (size_t i = 0; i < sizeof(payload); ++i) {
+        payload[i] = (uint8_t)(i * 37);
+    }
+    encoder.process_packet(payload, sizeof(payload));
+    const std::vector<uint8_t>& packet = stream.bytes_;
+
+    CountingPacketSink output;
+    StreamToPacketSegmenter segmenter(output);
+    for (size_t i = 0; i < iterations; ++i) {
+        segmenter.process_bytes(packet.data(), packet.size(), nullptr);
+    }
+    do_not_optimize(output.bytes_);
+}
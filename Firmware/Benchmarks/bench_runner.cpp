@@ -0,0 +1,49 @@
+#include "bench.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+// Runs every benchmark for long enough to get a stable result and prints the
+// results as JSON on stdout. An optional argument only runs the benchmarks
+// whose name contains it.
+//
+// Usage: bench_runner.exe [filter] > benchmarks.json
+
+static constexpr double kMinRunTime = 0.02; // [s] per measurement
+static constexpr int kRuns = 5; // the fastest run is reported
+
+static double run(Benchmark* bench, size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    bench->fn(iterations);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    printf("{\n  \"unit\": \"ns_per_op\",\n  \"benchmarks\": [");
+    const char* separator = "\n";
+    for (Benchmark* bench = Benchmark::list; bench; bench = bench->next) {
+        if (!strstr(bench->name, filter)) {
+            continue;
+        }
+
+        size_t iterations = 1;
+        while (run(bench, iterations) < kMinRunTime && iterations < ((size_t)1 << 40)) {
+            iterations *= 2;
+        }
+
+        double best = run(bench, iterations);
+        for (int i = 1; i < kRuns; ++i) {
+            double t = run(bench, iterations);
+            best = t < best ? t : best;
+        }
+
+        printf("%s    {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.3f}",
+               separator, bench->name, iterations, best * 1e9 / (double)iterations);
+        separator = ",\n";
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
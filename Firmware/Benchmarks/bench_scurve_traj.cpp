@@ -0,0 +1,30 @@
+#include "bench.hpp"
+#include "MotorControl/scurve_traj.hpp"
+#include "MotorControl/scurve_traj.cpp" // not part of the benchmark build otherwise
+
+BENCHMARK(scurve_traj_plan) {
+    SCurveTrajectory traj;
+    bool ok = true;
+    for (size_t i = 0; i < iterations; ++i) {
+        ok &= traj.plan(10.0f + (float)(i & 7), 0.0f, 0.5f, 2.0f, 0.5f, 0.5f, 10.0f);
+    }
+    do_not_optimize(ok);
+}
+
+BENCHMARK(scurve_traj_eval) {
+    SCurveTrajectory traj;
+    traj.plan(10.0f, 0.0f, 0.5f, 2.0f, 0.5f, 0.5f, 10.0f);
+    // Steps through the whole trajectory like the controller does
+    const float dt = traj.Tf_ / 4096.0f;
+    float t = 0.0f;
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        SCurveTrajectory::Step_t step = traj.eval(t);
+        sum += step.Y + step.Yd + step.Ydd;
+        t += dt;
+        if (t > traj.Tf_) {
+            t = 0.0f;
+        }
+    }
+    do_not_optimize(sum);
+}
@@ -0,0 +1,84 @@
+#include "bench.hpp"
+#include <cmath>
+#include "MotorControl/utils.hpp"
+#include "MotorControl/poly_table.hpp"
+
+static constexpr size_t kNumInputs = 1024; // power of 2
+
+BENCHMARK(fast_atan2) {
+    static float x[kNumInputs], y[kNumInputs];
+    fill_inputs(x, kNumInputs, -1.0f, 1.0f);
+    fill_inputs(y, kNumInputs, -2.0f, 1.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += fast_atan2(y[i & (kNumInputs - 1)], x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
+
+BENCHMARK(lut_atan2) {
+    static float x[kNumInputs], y[kNumInputs];
+    fill_inputs(x, kNumInputs, -1.0f, 1.0f);
+    fill_inputs(y, kNumInputs, -2.0f, 1.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += lut_atan2(y[i & (kNumInputs - 1)], x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
+
+BENCHMARK(precise_atan2) {
+    static float x[kNumInputs], y[kNumInputs];
+    fill_inputs(x, kNumInputs, -1.0f, 1.0f);
+    fill_inputs(y, kNumInputs, -2.0f, 1.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += precise_atan2(y[i & (kNumInputs - 1)], x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
+
+BENCHMARK(fast_rsqrt) {
+    static float x[kNumInputs];
+    fill_inputs(x, kNumInputs, 0.01f, 2.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += fast_rsqrt(x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
+
+// What fast_rsqrt() replaces
+BENCHMARK(div_sqrt) {
+    static float x[kNumInputs];
+    fill_inputs(x, kNumInputs, 0.01f, 2.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += 1.0f / std::sqrt(x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
+
+// A 6th order polynomial like the thermistor conversion
+static const float poly_coeffs[] = {1.1f, -2.3f, 0.7f, 4.2f, -1.5f, 0.3f, 25.0f};
+
+BENCHMARK(horner_poly_eval) {
+    static float x[kNumInputs];
+    fill_inputs(x, kNumInputs, 0.0f, 1.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += horner_poly_eval(x[i & (kNumInputs - 1)], poly_coeffs, sizeof(poly_coeffs) / sizeof(poly_coeffs[0]));
+    }
+    do_not_optimize(sum);
+}
+
+BENCHMARK(poly_table_eval) {
+    static float x[kNumInputs];
+    static PolyTable table;
+    fill_inputs(x, kNumInputs, 0.0f, 1.0f);
+    float sum = 0.0f;
+    for (size_t i = 0; i < iterations; ++i) {
+        sum += table.eval(poly_coeffs, sizeof(poly_coeffs) / sizeof(poly_coeffs[0]), x[i & (kNumInputs - 1)]);
+    }
+    do_not_optimize(sum);
+}
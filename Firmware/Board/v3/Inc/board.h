@@ -30,6 +30,18 @@
 
 #define AXIS_COUNT (2)
 
+#if defined(FAST_RAM)
+// Places data in the zero wait state core coupled memory. CCM RAM is not
+// accessible by DMA and is not initialized except for being zero-filled.
+#define CCM_DATA __attribute__((section(".ccmram")))
+// Places a function in SRAM. long_call is needed because SRAM is out of range
+// for a direct branch from flash.
+#define RAMFUNC __attribute__((section(".ramfunc"), long_call, noinline))
+#else
+#define CCM_DATA
+#define RAMFUNC
+#endif
+
 // Total count of GPIOs, including encoder pins, CAN pins and a dummy GPIO0.
 // ODrive v3.4 and earlier don't have GPIOs 6, 7 and 8 but to keep the numbering
 // consistent we just leave a gap in the counting scheme.
@@ -65,19 +77,37 @@
 
 #define TIM_TIME_BASE TIM14
 
+// The PWM frequency is configurable (see BoardConfig_t::pwm_frequency).
+// TIM_1_8_PERIOD_CLOCKS is only the default, the period that is actually used
+// is pwm_period_clocks.
+#define DEFAULT_PWM_FREQUENCY ((float)TIM_1_8_CLOCK_HZ / (float)(2 * TIM_1_8_PERIOD_CLOCKS)) // [Hz]
+#define MIN_PWM_FREQUENCY 8000.0f // [Hz]
+#define MAX_PWM_FREQUENCY 40000.0f // [Hz] leaves ~25us less for the control loop than the default
+// Compile time value of current_meas_period at DEFAULT_PWM_FREQUENCY, for
+// initializers that can run before current_meas_period is initialized.
+#define DEFAULT_CURRENT_MEAS_PERIOD ((float)(2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1)) / (float)TIM_1_8_CLOCK_HZ) // [s]
+
 // Run control loop at the same frequency as the current measurements.
-#define CONTROL_TIMER_PERIOD_TICKS  (2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1))
+#define CONTROL_TIMER_PERIOD_TICKS  (2 * pwm_period_clocks * (TIM_1_8_RCR + 1))
 
-#define TIM1_INIT_COUNT (TIM_1_8_PERIOD_CLOCKS / 2 - 1 * 128) // TODO: explain why this offset
+// TIM1 (M0) leads TIM8 (M1) by a configurable number of ticks
+// (see BoardConfig_t::pwm_phase_offset). The lower bound leaves room for the
+// M0 injected ADC conversions to finish before the M1 regular conversions are
+// triggered on the same ADCs. The upper bound leaves margin for the M0 PWM
+// update deadline, which is that many ticks before the M1 deadline.
+#define MIN_TIM1_INIT_COUNT (2 * 128)
+#define MAX_TIM1_INIT_COUNT (pwm_period_clocks / 2 - 1 * 128)
+#define DEFAULT_PWM_PHASE_OFFSET ((float)(TIM_1_8_PERIOD_CLOCKS / 2 - 1 * 128) / (float)(2 * TIM_1_8_PERIOD_CLOCKS))
 
 // The delta from the control loop timestamp to the current sense timestamp is
-// exactly 0 for M0 and TIM1_INIT_COUNT for M1.
-#define MAX_CONTROL_LOOP_UPDATE_TO_CURRENT_UPDATE_DELTA (TIM_1_8_PERIOD_CLOCKS / 2 + 1 * 128)
+// exactly 0 for M1 and the TIM1 init count for M0.
+#define MAX_CONTROL_LOOP_UPDATE_TO_CURRENT_UPDATE_DELTA ((int32_t)(pwm_period_clocks / 2 + 1 * 128))
 
 #ifdef __cplusplus
 #include <Drivers/DRV8301/drv8301.hpp>
 #include <Drivers/STM32/stm32_gpio.hpp>
 #include <Drivers/STM32/stm32_spi_arbiter.hpp>
+#include <Drivers/STM32/stm32_step_counter.hpp>
 #include <MotorControl/pwm_input.hpp>
 #include <MotorControl/thermistor.hpp>
 
@@ -96,6 +126,10 @@ extern Stm32Gpio gpios[GPIO_COUNT];
 struct GpioFunction { int mode = 0; uint8_t alternate_function = 0xff; };
 extern std::array<GpioFunction, 3> alternate_functions[GPIO_COUNT];
 
+// Timer input of each GPIO in GPIO_MODE_STEP_COUNTER, counter is null if unsupported
+struct StepCounterPin { Stm32StepCounter* counter = nullptr; uint32_t channel = 0; };
+extern StepCounterPin step_counter_pins[GPIO_COUNT];
+
 extern USBD_HandleTypeDef& usb_dev_handle;
 
 extern Stm32SpiArbiter& ext_spi_arbiter;
@@ -107,13 +141,27 @@ extern UART_HandleTypeDef* uart_c;
 extern PwmInput pwm0_input;
 #endif
 
-// Period in [s]
-#define CURRENT_MEAS_PERIOD ( (float)2*TIM_1_8_PERIOD_CLOCKS*(TIM_1_8_RCR+1) / (float)TIM_1_8_CLOCK_HZ )
-static const float current_meas_period = CURRENT_MEAS_PERIOD;
+// PWM and current measurement timing. These are set by set_pwm_frequency()
+// during startup and are constant afterwards.
+extern uint32_t pwm_period_clocks; // TIM1/TIM8 auto-reload value
+extern float current_meas_period; // [s]
+extern int current_meas_hz; // [Hz]
+
+// Phase lock of the control loop to the CAN time sync (see TimeSync). The
+// trim is added to the auto-reload value of TIM1 and TIM8 for the next
+// control loop period.
+extern volatile int32_t pwm_period_trim; // [timer ticks] -1, 0 or 1
+extern volatile uint32_t control_tick_cyccnt; // DWT cycle count at the last control loop timer update
+
+// Worst case entry latencies of the interrupts whose trigger time is known
+// [CPU cycles]. Each one can be reset by writing 0.
+typedef struct {
+    uint32_t tim8_update; // since the TIM8 update event
+    uint32_t control_loop; // since the TIM8 handler pended it
+    uint32_t housekeeping; // since the control loop pended it
+} IrqLatencyStats_t;
 
-// Frequency in [Hz]
-#define CURRENT_MEAS_HZ ( (float)(TIM_1_8_CLOCK_HZ) / (float)(2*TIM_1_8_PERIOD_CLOCKS*(TIM_1_8_RCR+1)) )
-static const int current_meas_hz = CURRENT_MEAS_HZ;
+extern IrqLatencyStats_t irq_latency_stats_;
 
 #if HW_VERSION_VOLTAGE >= 48
 #define VBUS_S_DIVIDER_RATIO 19.0f
@@ -135,7 +183,10 @@ static inline void board_clear_config() { }
 static inline bool board_apply_config() { return true; }
 
 void system_init();
+void set_pwm_frequency(float frequency);
 bool board_init();
+void apply_irq_priorities();
+void wait_for_gate_drivers();
 void start_timers();
 
 #endif // __BOARD_CONFIG_H
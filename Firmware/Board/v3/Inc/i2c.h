@@ -56,6 +56,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
 #include "main.h"
+#include <stdbool.h>
 
 /* USER CODE BEGIN Includes */
 
@@ -69,7 +70,7 @@ extern I2C_HandleTypeDef hi2c1;
 
 extern void _Error_Handler(char *, int);
 
-void MX_I2C1_Init(uint8_t addr);
+void MX_I2C1_Init(uint8_t addr, bool use_dma);
 
 /* USER CODE BEGIN Prototypes */
 
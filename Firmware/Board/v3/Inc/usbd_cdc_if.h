@@ -82,6 +82,7 @@
 #define USB_TX_DATA_SIZE  64
 #define APP_RX_DATA_SIZE  USB_RX_DATA_SIZE
 #define APP_TX_DATA_SIZE  USB_TX_DATA_SIZE
+#define USB_TX_BUFFER_COUNT 2 // per IN endpoint
 /* USER CODE END EXPORTED_DEFINES */
 
 /**
@@ -39,6 +39,9 @@
 
 /* USER CODE BEGIN 0 */
 #include <Drivers/STM32/stm32_system.h>
+#include <communication/interface_uart.h>
+
+void can_tx_irq_handler(CAN_HandleTypeDef *hcan); // interface_can.cpp
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
@@ -304,6 +307,7 @@ void CAN1_TX_IRQHandler(void)
 {
   /* USER CODE BEGIN CAN1_TX_IRQn 0 */
   COUNT_IRQ(CAN1_TX_IRQn);
+  can_tx_irq_handler(&hcan1);
   /* USER CODE END CAN1_TX_IRQn 0 */
   HAL_CAN_IRQHandler(&hcan1);
   /* USER CODE BEGIN CAN1_TX_IRQn 1 */
@@ -359,7 +363,7 @@ void CAN1_SCE_IRQHandler(void)
 void USART2_IRQHandler(void)
 {
   /* USER CODE BEGIN USART2_IRQn 0 */
-
+  uart_irq_handler(&huart2);
   /* USER CODE END USART2_IRQn 0 */
   HAL_UART_IRQHandler(&huart2);
   /* USER CODE BEGIN USART2_IRQn 1 */
@@ -403,6 +407,7 @@ void UART4_IRQHandler(void)
 {
   /* USER CODE BEGIN UART4_IRQn 0 */
   COUNT_IRQ(UART4_IRQn);
+  uart_irq_handler(&huart4);
   /* USER CODE END UART4_IRQn 0 */
   HAL_UART_IRQHandler(&huart4);
   /* USER CODE BEGIN UART4_IRQn 1 */
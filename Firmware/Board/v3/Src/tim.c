@@ -63,6 +63,7 @@ TIM_HandleTypeDef htim4;
 TIM_HandleTypeDef htim5;
 TIM_HandleTypeDef htim8;
 TIM_HandleTypeDef htim13;
+DMA_HandleTypeDef hdma_tim5_ch4;
 
 /* TIM1 init function */
 void MX_TIM1_Init(void)
@@ -467,6 +468,27 @@ void HAL_TIM_IC_MspInit(TIM_HandleTypeDef* tim_icHandle)
     /* TIM5 clock enable */
     __HAL_RCC_TIM5_CLK_ENABLE();
 
+    /* TIM5 DMA Init */
+    /* TIM5_CH4 Init */
+    // The other channels map to DMA streams that are in use by SPI3 and
+    // UART4, so they are handled by the capture interrupt.
+    hdma_tim5_ch4.Instance = DMA1_Stream1;
+    hdma_tim5_ch4.Init.Channel = DMA_CHANNEL_6;
+    hdma_tim5_ch4.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_tim5_ch4.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_tim5_ch4.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_tim5_ch4.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_tim5_ch4.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_tim5_ch4.Init.Mode = DMA_CIRCULAR;
+    hdma_tim5_ch4.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_tim5_ch4.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_tim5_ch4) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(tim_icHandle,hdma[TIM_DMA_ID_CC4],hdma_tim5_ch4);
+
     /* TIM5 interrupt Init */
     HAL_NVIC_SetPriority(TIM5_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(TIM5_IRQn);
@@ -706,6 +728,9 @@ void HAL_TIM_IC_MspDeInit(TIM_HandleTypeDef* tim_icHandle)
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_3_Pin|GPIO_4_Pin);
 
+    /* TIM5 DMA DeInit */
+    HAL_DMA_DeInit(tim_icHandle->hdma[TIM_DMA_ID_CC4]);
+
     /* TIM5 interrupt Deinit */
     HAL_NVIC_DisableIRQ(TIM5_IRQn);
   /* USER CODE BEGIN TIM5_MspDeInit 1 */
@@ -54,6 +54,7 @@
 #include "cmsis_os.h"
 #include <communication/interface_usb.h>
 #include <freertos_vars.h>
+#include <Drivers/STM32/stm32_system.h>
 /* USER CODE END INCLUDE */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -80,6 +81,14 @@
   */
 
 /* USER CODE BEGIN PRIVATE_TYPES */
+// Ping-pong buffers of one IN endpoint: a packet can be copied into one of
+// them while the other one is being transmitted.
+typedef struct {
+  uint8_t buffers[USB_TX_BUFFER_COUNT][APP_TX_DATA_SIZE];
+  uint16_t lengths[USB_TX_BUFFER_COUNT];
+  uint8_t head; // next buffer to fill
+  volatile uint8_t count; // buffers that are filled, including the one in flight
+} CDC_TxQueueTypeDef;
 /* USER CODE END PRIVATE_TYPES */
 
 /**
@@ -120,9 +129,9 @@
 uint8_t CDCRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t ODRIVERxBufferFS[APP_RX_DATA_SIZE];
 
-/** Data to send over USB CDC are stored in this buffer   */
-uint8_t CDCTxBufferFS[APP_TX_DATA_SIZE];
-uint8_t ODRIVETxBufferFS[APP_TX_DATA_SIZE];
+/** Data to send over USB CDC are stored in these buffers */
+static CDC_TxQueueTypeDef CDCTxQueueFS;
+static CDC_TxQueueTypeDef ODRIVETxQueueFS;
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
 /* USER CODE END PRIVATE_VARIABLES */
@@ -154,6 +163,7 @@ static int8_t CDC_Init_FS(void);
 static int8_t CDC_DeInit_FS(void);
 static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length);
 static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len, uint8_t endpoint_pair);
+static int8_t CDC_TransmitCplt_FS(uint8_t endpoint_pair);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
@@ -167,7 +177,8 @@ USBD_CDC_ItfTypeDef USBD_Interface_fops_FS =
   CDC_Init_FS,
   CDC_DeInit_FS,
   CDC_Control_FS,
-  CDC_Receive_FS
+  CDC_Receive_FS,
+  CDC_TransmitCplt_FS
 };
 
 /* Private functions ---------------------------------------------------------*/
@@ -179,9 +190,12 @@ static int8_t CDC_Init_FS(void)
 {
   /* USER CODE BEGIN 3 */
   /* Set Application Buffers */
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, CDCTxBufferFS, 0, CDC_OUT_EP);
+  // Packets that were queued before a reset of the USB device are dropped
+  CDCTxQueueFS.head = CDCTxQueueFS.count = 0;
+  ODRIVETxQueueFS.head = ODRIVETxQueueFS.count = 0;
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, CDCTxQueueFS.buffers[0], 0, CDC_OUT_EP);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, CDCRxBufferFS, CDC_OUT_EP);
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, ODRIVETxBufferFS, 0, ODRIVE_OUT_EP);
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, ODRIVETxQueueFS.buffers[0], 0, ODRIVE_OUT_EP);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, ODRIVERxBufferFS, ODRIVE_OUT_EP);
   return (USBD_OK);
   /* USER CODE END 3 */
@@ -307,6 +321,11 @@ static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len, uint8_t endpoint_pair)
   *         @note
   *
   *
+  *         The data is copied into one of USB_TX_BUFFER_COUNT buffers of the
+  *         endpoint, so the caller may reuse Buf right away. If another
+  *         packet is still being transmitted, this one is sent from
+  *         CDC_TransmitCplt_FS() afterwards.
+  *
   * @param  Buf: Buffer of data to be sent
   * @param  Len: Number of data to be sent (in bytes)
   * @retval USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
@@ -319,34 +338,73 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len, uint8_t endpoint_pair)
   if (Len > USB_TX_DATA_SIZE)
     return USBD_FAIL;
 
-  USBD_CDC_HandleTypeDef* hcdc = (USBD_CDC_HandleTypeDef*) hUsbDeviceFS.pClassData;
-
   // Select EP
-  USBD_CDC_EP_HandleTypeDef* hEP_Tx;
-  uint8_t* TxBuff;
+  CDC_TxQueueTypeDef* queue;
   if (endpoint_pair == CDC_OUT_EP) {
-    hEP_Tx = &hcdc->CDC_Tx;
-    TxBuff = CDCTxBufferFS;
+    queue = &CDCTxQueueFS;
   } else if (endpoint_pair == ODRIVE_OUT_EP) {
-    hEP_Tx = &hcdc->ODRIVE_Tx;
-    TxBuff = ODRIVETxBufferFS;
+    queue = &ODRIVETxQueueFS;
   } else {
     return USBD_FAIL;
   }
 
-  // Check for ongoing transmission
-  if (hEP_Tx->State != 0)
+  // Check for a free buffer. Only the thread of the endpoint fills buffers,
+  // so the one at head stays free while we copy into it.
+  if (queue->count >= USB_TX_BUFFER_COUNT)
       return USBD_BUSY;
-  // memcpy Buf into UserTxBufferFS
-  memcpy(TxBuff, Buf, Len);
-  // Update Len
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, TxBuff, Len, endpoint_pair);
-  result = USBD_CDC_TransmitPacket(&hUsbDeviceFS, endpoint_pair);
+  uint8_t index = queue->head;
+  memcpy(queue->buffers[index], Buf, Len);
+  queue->lengths[index] = Len;
+
+  uint32_t mask = cpu_enter_critical();
+  queue->head = (index + 1) % USB_TX_BUFFER_COUNT;
+  if (queue->count++ == 0) {
+    // The endpoint is idle, otherwise the transfer is started when the
+    // previous one completes
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, queue->buffers[index], Len, endpoint_pair);
+    result = USBD_CDC_TransmitPacket(&hUsbDeviceFS, endpoint_pair);
+    if (result != USBD_OK) {
+      queue->head = index;
+      queue->count = 0;
+    }
+  }
+  cpu_exit_critical(mask);
   /* USER CODE END 7 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+/**
+  * @brief  CDC_TransmitCplt_FS
+  *         Called from the USB interrupt when a packet was transmitted.
+  *         Starts the transfer of the next queued packet of the endpoint.
+  */
+static int8_t CDC_TransmitCplt_FS(uint8_t endpoint_pair)
+{
+  CDC_TxQueueTypeDef* queue;
+  osSemaphoreId sem;
+  if (endpoint_pair == CDC_OUT_EP) {
+    queue = &CDCTxQueueFS;
+    sem = sem_usb_tx_cdc;
+  } else if (endpoint_pair == ODRIVE_OUT_EP) {
+    queue = &ODRIVETxQueueFS;
+    sem = sem_usb_tx_native;
+  } else {
+    return USBD_FAIL;
+  }
+
+  if (queue->count > 0)
+    queue->count--;
+  if (queue->count > 0) {
+    uint8_t index = (queue->head + USB_TX_BUFFER_COUNT - queue->count) % USB_TX_BUFFER_COUNT;
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, queue->buffers[index], queue->lengths[index], endpoint_pair);
+    USBD_CDC_TransmitPacket(&hUsbDeviceFS, endpoint_pair);
+  }
+
+  // One buffer of this endpoint is free again
+  osSemaphoreRelease(sem);
+  return USBD_OK;
+}
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -22,6 +22,8 @@ extern "C" void SystemClock_Config(void); // defined in main.c generated by Cube
 
 #define ControlLoop_IRQHandler OTG_HS_IRQHandler
 #define ControlLoop_IRQn OTG_HS_IRQn
+#define Housekeeping_IRQHandler OTG_HS_EP1_OUT_IRQHandler
+#define Housekeeping_IRQn OTG_HS_EP1_OUT_IRQn
 
 Stm32SpiArbiter spi3_arbiter{&hspi3};
 Stm32SpiArbiter& ext_spi_arbiter = spi3_arbiter;
@@ -66,7 +68,8 @@ OnboardThermistorCurrentLimiter fet_thermistors[AXIS_COUNT] = {
 
 OffboardThermistorCurrentLimiter motor_thermistors[AXIS_COUNT];
 
-Motor motors[AXIS_COUNT] = {
+// The encoders can't be placed in CCM RAM because they contain SPI DMA buffers.
+CCM_DATA Motor motors[AXIS_COUNT] = {
     {
         &htim1, // timer
         0b110, // current_sensor_mask
@@ -110,11 +113,11 @@ Encoder encoders[AXIS_COUNT] = {
 Endstop endstops[2 * AXIS_COUNT];
 MechanicalBrake mechanical_brakes[AXIS_COUNT];
 
-SensorlessEstimator sensorless_estimators[AXIS_COUNT];
-Controller controllers[AXIS_COUNT];
+CCM_DATA SensorlessEstimator sensorless_estimators[AXIS_COUNT];
+CCM_DATA Controller controllers[AXIS_COUNT];
 TrapezoidalTrajectory trap[AXIS_COUNT];
 
-std::array<Axis, AXIS_COUNT> axes{{
+CCM_DATA std::array<Axis, AXIS_COUNT> axes{{
     {
         0, // axis_num
         1, // step_gpio_pin
@@ -226,14 +229,14 @@ std::array<GpioFunction, 3> alternate_functions[GPIO_COUNT] = {
 #if HW_VERSION_MINOR >= 3
     /* GPIO1: */ {{{ODrive::GPIO_MODE_UART_A, GPIO_AF8_UART4}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}}},
     /* GPIO2: */ {{{ODrive::GPIO_MODE_UART_A, GPIO_AF8_UART4}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}}},
-    /* GPIO3: */ {{{ODrive::GPIO_MODE_UART_B, GPIO_AF7_USART2}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}}},
+    /* GPIO3: */ {{{ODrive::GPIO_MODE_UART_B, GPIO_AF7_USART2}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}, {ODrive::GPIO_MODE_STEP_COUNTER, GPIO_AF3_TIM9}}},
 #else
     /* GPIO1: */ {{}},
     /* GPIO2: */ {{}},
     /* GPIO3: */ {{}},
 #endif
 
-    /* GPIO4: */ {{{ODrive::GPIO_MODE_UART_B, GPIO_AF7_USART2}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}}},
+    /* GPIO4: */ {{{ODrive::GPIO_MODE_UART_B, GPIO_AF7_USART2}, {ODrive::GPIO_MODE_PWM, GPIO_AF2_TIM5}, {ODrive::GPIO_MODE_STEP_COUNTER, GPIO_AF3_TIM9}}},
     /* GPIO5: */ {{}},
     /* GPIO6: */ {{}},
     /* GPIO7: */ {{}},
@@ -248,6 +251,22 @@ std::array<GpioFunction, 3> alternate_functions[GPIO_COUNT] = {
     /* CAN_D: */ {{{ODrive::GPIO_MODE_CAN_A, GPIO_AF9_CAN1}, {ODrive::GPIO_MODE_I2C_A, GPIO_AF4_I2C1}}},
 };
 
+// TIM9 is the only timer that is not otherwise in use and has inputs on the
+// GPIOs (PA2 and PA3), so only one axis can count steps in hardware.
+static Stm32StepCounter step_counter{TIM9, []() { __HAL_RCC_TIM9_CLK_ENABLE(); }};
+
+StepCounterPin step_counter_pins[GPIO_COUNT] = {
+    /* GPIO0 (inexistent): */ {},
+    /* GPIO1: */ {},
+    /* GPIO2: */ {},
+#if HW_VERSION_MINOR >= 3
+    /* GPIO3: */ {&step_counter, 1}, // TIM9_CH1
+#else
+    /* GPIO3: */ {},
+#endif
+    /* GPIO4: */ {&step_counter, 2}, // TIM9_CH2
+};
+
 #if HW_VERSION_MINOR <= 2
 PwmInput pwm0_input{&htim5, {0, 0, 0, 4}}; // 0 means not in use
 #else
@@ -257,6 +276,10 @@ PwmInput pwm0_input{&htim5, {1, 2, 3, 4}};
 extern USBD_HandleTypeDef hUsbDeviceFS;
 USBD_HandleTypeDef& usb_dev_handle = hUsbDeviceFS;
 
+uint32_t pwm_period_clocks = TIM_1_8_PERIOD_CLOCKS;
+float current_meas_period = DEFAULT_CURRENT_MEAS_PERIOD;
+int current_meas_hz = (float)TIM_1_8_CLOCK_HZ / (float)(2 * pwm_period_clocks * (TIM_1_8_RCR + 1));
+
 void system_init() {
     // Reset of all peripherals, Initializes the Flash interface and the Systick.
     HAL_Init();
@@ -265,7 +288,112 @@ void system_init() {
     SystemClock_Config();
 }
 
+/**
+ * @brief Sets the PWM frequency and all timing constants derived from it.
+ *
+ * Must be called before the configuration of the other components is applied
+ * (they may precompute gains from current_meas_period) and before
+ * board_init(). The frequency is clamped to [MIN_PWM_FREQUENCY, MAX_PWM_FREQUENCY].
+ */
+void set_pwm_frequency(float frequency) {
+    if (is_nan(frequency)) {
+        frequency = DEFAULT_PWM_FREQUENCY;
+    }
+    frequency = std::clamp(frequency, MIN_PWM_FREQUENCY, MAX_PWM_FREQUENCY);
+    pwm_period_clocks = (uint32_t)((float)TIM_1_8_CLOCK_HZ / (2.0f * frequency));
+    uint32_t control_period_clocks = 2 * pwm_period_clocks * (TIM_1_8_RCR + 1);
+    current_meas_period = (float)control_period_clocks / (float)TIM_1_8_CLOCK_HZ;
+    current_meas_hz = (int)((float)TIM_1_8_CLOCK_HZ / (float)control_period_clocks);
+}
+
+static uint32_t gate_driver_enable_time_ = 0; // [us]
+
+/**
+ * @brief Preemption priorities of all interrupts that the firmware enables,
+ * for each ODriveIntf::IrqPriorityProfile (0 is the highest priority).
+ *
+ * HAL_MspInit() selects NVIC_PRIORITYGROUP_4, so all four priority bits are
+ * preemption levels and there are no subpriorities. Interrupts of the same
+ * level don't preempt each other. Interrupts above the RTOS level
+ * (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY = 5) are never masked by the
+ * RTOS and must not call RTOS functions. The kernel interrupts (SVCall,
+ * PendSV and SysTick) are set up by HAL_MspInit() and the RTOS port.
+ *
+ * The RTOS port enables FPU lazy stacking when the scheduler starts: an
+ * interrupt always reserves stack space for the FPU registers of a thread
+ * that used the FPU, but only its first floating point instruction stores
+ * them.
+ *
+ * The CubeMX init functions set their own priorities, so this table is
+ * applied after them (see apply_irq_priorities()).
+ */
+struct IrqPriority {
+    IRQn_Type irqn;
+    uint8_t priority[2]; // control latency, comms throughput
+};
+
+static const IrqPriority irq_priorities[] = {
+    {TIM8_UP_TIM13_IRQn, {0, 0}}, // current sampling and PWM timing
+    {EXTI0_IRQn, {1, 1}}, // step/dir, sync input and other GPIO edges
+    {EXTI1_IRQn, {1, 1}},
+    {EXTI2_IRQn, {1, 1}},
+    {EXTI3_IRQn, {1, 1}},
+    {EXTI4_IRQn, {1, 1}},
+    {EXTI9_5_IRQn, {1, 1}},
+    {EXTI15_10_IRQn, {1, 1}},
+    {TIM5_IRQn, {1, 1}}, // PWM input capture
+    {DMA1_Stream7_IRQn, {3, 3}}, // SPI TX, higher than SPI RX and the control loop
+    {DMA1_Stream0_IRQn, {4, 4}}, // SPI RX, higher than the control loop
+    // The time sync takes the time of its frames in the TX complete and the
+    // RX FIFO 1 interrupts, so they must not wait for the control loop. They
+    // don't use any RTOS functions.
+    {CAN1_TX_IRQn, {4, 4}},
+    {CAN1_RX1_IRQn, {4, 4}},
+    {ControlLoop_IRQn, {5, 5}},
+    // Lower priority than the control loop so that it can't add jitter to
+    // it. Comms preempt it in the throughput profile.
+    {Housekeeping_IRQn, {6, 8}},
+    {OTG_FS_IRQn, {6, 6}},
+    {TIM8_TRG_COM_TIM14_IRQn, {TICK_INT_PRIORITY, TICK_INT_PRIORITY}}, // HAL time base
+    {CAN1_RX0_IRQn, {9, 7}},
+    {CAN1_SCE_IRQn, {9, 7}},
+    {I2C1_EV_IRQn, {9, 7}},
+    {I2C1_ER_IRQn, {9, 7}},
+    {DMA1_Stream5_IRQn, {10, 7}}, // I2C1 or USART2 RX
+    {DMA1_Stream6_IRQn, {10, 7}}, // I2C1 or USART2 TX
+    {UART4_IRQn, {10, 7}},
+    {DMA1_Stream2_IRQn, {10, 7}}, // UART4 RX
+    {DMA1_Stream4_IRQn, {10, 7}}, // UART4 TX
+    {USART2_IRQn, {10, 7}},
+};
+
+IrqLatencyStats_t irq_latency_stats_ = {};
+static uint32_t control_loop_trigger_cyccnt_ = 0;
+static uint32_t housekeeping_trigger_cyccnt_ = 0;
+
+static inline void update_max(uint32_t* max, uint32_t value) {
+    if (value > *max) {
+        *max = value;
+    }
+}
+
+void apply_irq_priorities() {
+    size_t profile = odrv.config_.irq_priority_profile;
+    if (profile >= sizeof(irq_priorities[0].priority)) {
+        profile = ODriveIntf::IRQ_PRIORITY_PROFILE_CONTROL_LATENCY;
+    }
+    for (const IrqPriority& irq: irq_priorities) {
+        HAL_NVIC_SetPriority(irq.irqn, irq.priority[profile], 0);
+    }
+}
+
 bool board_init() {
+    // Enable the cycle counter. It is the clock of the CAN time sync and of
+    // the task timers and the trace buffer.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     // Initialize all configured peripherals
     MX_GPIO_Init();
     MX_DMA_Init();
@@ -281,26 +409,29 @@ bool board_init() {
     MX_TIM5_Init();
     MX_TIM13_Init();
 
+    // The CubeMX init functions configure the default PWM period. The update
+    // event loads the new period into the shadow registers.
+    htim1.Init.Period = pwm_period_clocks;
+    htim8.Init.Period = pwm_period_clocks;
+    htim13.Init.Period = CONTROL_TIMER_PERIOD_TICKS * ((float)TIM_APB1_CLOCK_HZ / (float)TIM_1_8_CLOCK_HZ) - 1;
+    for (TIM_HandleTypeDef* htim: {&htim1, &htim8, &htim13}) {
+        htim->Instance->ARR = htim->Init.Period;
+        htim->Instance->EGR = TIM_EGR_UG;
+    }
+
+    // See irq_priorities for the priorities
+    apply_irq_priorities();
+
     // External interrupt lines are individually enabled in stm32_gpio.cpp
-    HAL_NVIC_SetPriority(EXTI0_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI0_IRQn);
-    HAL_NVIC_SetPriority(EXTI1_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI1_IRQn);
-    HAL_NVIC_SetPriority(EXTI2_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI2_IRQn);
-    HAL_NVIC_SetPriority(EXTI3_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI3_IRQn);
-    HAL_NVIC_SetPriority(EXTI4_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI4_IRQn);
-    HAL_NVIC_SetPriority(EXTI9_5_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
-    HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
     HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
-
-    HAL_NVIC_SetPriority(ControlLoop_IRQn, 5, 0);
     HAL_NVIC_EnableIRQ(ControlLoop_IRQn);
-
-    HAL_NVIC_SetPriority(TIM8_UP_TIM13_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(Housekeeping_IRQn);
     HAL_NVIC_EnableIRQ(TIM8_UP_TIM13_IRQn);
 
     if (odrv.config_.enable_uart_a) {
@@ -324,7 +455,9 @@ bool board_init() {
         i2c_stats_.addr |= get_gpio(3).read() ? 0x1 : 0;
         i2c_stats_.addr |= get_gpio(4).read() ? 0x2 : 0;
         i2c_stats_.addr |= get_gpio(5).read() ? 0x4 : 0;
-        MX_I2C1_Init(i2c_stats_.addr);
+        // UART B needs the DMA streams of I2C, so it runs without DMA then
+        i2c_stats_.dma = !odrv.config_.enable_uart_b;
+        MX_I2C1_Init(i2c_stats_.addr, i2c_stats_.dma);
     }
 
     if (odrv.config_.enable_can_a) {
@@ -350,12 +483,28 @@ bool board_init() {
     drv_enable_gpio.write(false);
     delay_us(40); // mimumum pull-down time for full reset: 20us
     drv_enable_gpio.write(true);
-    delay_us(20000); // mimumum pull-down time for full reset: 20us
+    gate_driver_enable_time_ = micros(); // the rest of the startup runs while they power up
 
     return true;
 }
 
+// @brief Blocks until the SPI interface of the gate drivers is ready after
+// the reset in board_init().
+void wait_for_gate_drivers() {
+    constexpr uint32_t t_spi_ready = 20000; // [us] max = 10ms
+    while (micros() - gate_driver_enable_time_ < t_spi_ready) {
+        osDelay(1);
+    }
+}
+
+// Phase lead of TIM1 over TIM8 in timer ticks. Set in start_timers().
+static uint32_t tim1_init_count_ = MAX_TIM1_INIT_COUNT;
+
 void start_timers() {
+    float offset = odrv.config_.pwm_phase_offset * (float)(2 * pwm_period_clocks);
+    tim1_init_count_ = is_nan(offset) ? MAX_TIM1_INIT_COUNT
+                     : (uint32_t)std::clamp(offset, (float)MIN_TIM1_INIT_COUNT, (float)MAX_TIM1_INIT_COUNT);
+
     CRITICAL_SECTION() {
         // Temporarily disable ADC triggers so they don't trigger as a side
         // effect of starting the timers.
@@ -365,13 +514,14 @@ void start_timers() {
 
         /*
         * Synchronize TIM1, TIM8 and TIM13 such that:
-        *  1. The triangle waveform of TIM1 leads the triangle waveform of TIM8 by a
-        *     90° phase shift.
+        *  1. The triangle waveform of TIM1 leads the triangle waveform of TIM8 by
+        *     tim1_init_count_ ticks. Shifting the two inverters against each
+        *     other reduces the ripple current in the DC bus capacitors.
         *  2. Each TIM13 reload coincides with a TIM1 lower update event.
         */
         Stm32Timer::start_synchronously<3>(
             {&htim1, &htim8, &htim13},
-            {TIM1_INIT_COUNT, 0, TIM1_INIT_COUNT / 2 /* TIM13 is on a clock that's only have as fast as TIM1 */}
+            {tim1_init_count_, 0, tim1_init_count_ / 2 /* TIM13 is on a clock that's only have as fast as TIM1 */}
         );
 
         hadc1.Instance->CR2 |= (ADC_EXTERNALTRIGINJECCONVEDGE_RISING);
@@ -393,9 +543,9 @@ void start_timers() {
     }
 }
 
-static bool fetch_and_reset_adcs(
-        std::optional<Iph_ABC_t>* current0,
-        std::optional<Iph_ABC_t>* current1) {
+RAMFUNC static bool fetch_and_reset_adcs(
+        Measurement<Iph_ABC_t>* current0,
+        Measurement<Iph_ABC_t>* current1) {
     bool all_adcs_done = (ADC1->SR & ADC_SR_JEOC) == ADC_SR_JEOC
         && (ADC2->SR & (ADC_SR_EOC | ADC_SR_JEOC)) == (ADC_SR_EOC | ADC_SR_JEOC)
         && (ADC3->SR & (ADC_SR_EOC | ADC_SR_JEOC)) == (ADC_SR_EOC | ADC_SR_JEOC);
@@ -406,18 +556,20 @@ static bool fetch_and_reset_adcs(
     vbus_sense_adc_cb(ADC1->JDR1);
 
     if (m0_gate_driver.is_ready()) {
-        std::optional<float> phB = motors[0].phase_current_from_adcval(ADC2->JDR1);
-        std::optional<float> phC = motors[0].phase_current_from_adcval(ADC3->JDR1);
+        std::optional<float> phB = motors[0].phase_current_from_adcval(ADC2->JDR1, 1);
+        std::optional<float> phC = motors[0].phase_current_from_adcval(ADC3->JDR1, 2);
         if (phB.has_value() && phC.has_value()) {
-            *current0 = {-*phB - *phC, *phB, *phC};
+            current0->currents = {-*phB - *phC, *phB, *phC};
+            current0->valid = Measurement<Iph_ABC_t>::kCurrentsValid;
         }
     }
 
     if (m1_gate_driver.is_ready()) {
-        std::optional<float> phB = motors[1].phase_current_from_adcval(ADC2->DR);
-        std::optional<float> phC = motors[1].phase_current_from_adcval(ADC3->DR);
+        std::optional<float> phB = motors[1].phase_current_from_adcval(ADC2->DR, 1);
+        std::optional<float> phC = motors[1].phase_current_from_adcval(ADC3->DR, 2);
         if (phB.has_value() && phC.has_value()) {
-            *current1 = {-*phB - *phC, *phB, *phC};
+            current1->currents = {-*phB - *phC, *phB, *phC};
+            current1->valid = Measurement<Iph_ABC_t>::kCurrentsValid;
         }
     }
     
@@ -446,22 +598,33 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
 
 void TIM5_IRQHandler(void) {
     COUNT_IRQ(TIM5_IRQn);
+    TRACE_IRQ(TIM5_IRQn);
     pwm0_input.on_capture();
 }
 
 volatile uint32_t timestamp_ = 0;
 volatile bool counting_down_ = false;
+volatile int32_t pwm_period_trim = 0;
+volatile uint32_t control_tick_cyccnt = 0;
+static int32_t pwm_period_trim_applied_ = 0;
 
 void TIM8_UP_TIM13_IRQHandler(void) {
     COUNT_IRQ(TIM8_UP_TIM13_IRQn);
+    TRACE_IRQ(TIM8_UP_TIM13_IRQn);
     
     // Entry into this function happens at 21-23 clock cycles after the timer
-    // update event.
+    // update event. TIM8 runs at the CPU clock, so the distance of the counter
+    // from the extreme is the entry latency in CPU cycles.
+    bool counting_down = TIM8->CR1 & TIM_CR1_DIR;
+    update_max(&irq_latency_stats_.tim8_update, counting_down ? TIM8->ARR - TIM8->CNT : TIM8->CNT);
     __HAL_TIM_CLEAR_IT(&htim8, TIM_IT_UPDATE);
 
     // If the corresponding timer is counting up, we just sampled in SVM vector 0, i.e. real current
     // If we are counting down, we just sampled in SVM vector 7, with zero current
-    bool counting_down = TIM8->CR1 & TIM_CR1_DIR;
+    // The shunts are on the low side, so vector 7 never carries phase current
+    // and the current loop can't run on both timer extremes; the down-count
+    // sample is only good for DC calibration.
+    odrv.pwm_sync_.on_timer_update(counting_down); // early for a constant latency
 
     bool timer_update_missed = (counting_down_ == counting_down);
     if (timer_update_missed) {
@@ -471,13 +634,28 @@ void TIM8_UP_TIM13_IRQHandler(void) {
     }
     counting_down_ = counting_down;
 
-    timestamp_ += TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1);
+    timestamp_ += pwm_period_clocks * (TIM_1_8_RCR + 1);
 
     if (!counting_down) {
+        control_tick_cyccnt = DWT->CYCCNT;
+
+        // Apply the trim of the time sync phase lock to the next control loop
+        // period. All three timers are at the start of their period here, far
+        // away from the reload. The timestamp keeps counting nominal periods
+        // so the deadline checks are unaffected.
+        int32_t trim = pwm_period_trim;
+        if (trim != pwm_period_trim_applied_) {
+            TIM1->ARR = pwm_period_clocks + trim;
+            TIM8->ARR = pwm_period_clocks + trim;
+            TIM13->ARR = htim13.Init.Period + trim * (TIM_1_8_RCR + 1); // half the clock, one period per control loop period
+            pwm_period_trim_applied_ = trim;
+        }
+
         TaskTimer::enabled = odrv.task_timers_armed_;
         // Run sampling handlers and kick off control tasks when TIM8 is
         // counting up.
         odrv.sampling_cb();
+        control_loop_trigger_cyccnt_ = DWT->CYCCNT;
         NVIC->STIR = ControlLoop_IRQn;
     } else {
         // Tentatively reset all PWM outputs to 50% duty cycles. If the control
@@ -489,17 +667,21 @@ void TIM8_UP_TIM13_IRQHandler(void) {
         TIM8->CCR1 =
         TIM8->CCR2 =
         TIM8->CCR3 =
-            TIM_1_8_PERIOD_CLOCKS / 2;
+            pwm_period_clocks / 2;
     }
 }
 
 void ControlLoop_IRQHandler(void) {
     COUNT_IRQ(ControlLoop_IRQn);
+    TRACE_IRQ(ControlLoop_IRQn);
+    uint32_t start_cycles = DWT->CYCCNT;
+    update_max(&irq_latency_stats_.control_loop, start_cycles - control_loop_trigger_cyccnt_);
+    uint32_t control_loop_start = odrv.task_times_.control_loop.start();
     uint32_t timestamp = timestamp_;
 
     // Ensure that all the ADCs are done
-    std::optional<Iph_ABC_t> current0;
-    std::optional<Iph_ABC_t> current1;
+    Measurement<Iph_ABC_t> current0;
+    Measurement<Iph_ABC_t> current1;
 
     if (!fetch_and_reset_adcs(&current0, &current1)) {
         motors[0].disarm_with_error(Motor::ERROR_BAD_TIMING);
@@ -512,14 +694,22 @@ void ControlLoop_IRQHandler(void) {
     // disarming and when the motor spins fast in idle). Passing an invalid
     // current reading would create problems with starting FOC.
     if (!(TIM1->BDTR & TIM_BDTR_MOE_Msk)) {
-        current0 = {0.0f, 0.0f};
+        current0.currents = {0.0f, 0.0f, 0.0f};
+        current0.valid = Measurement<Iph_ABC_t>::kCurrentsValid;
     }
     if (!(TIM8->BDTR & TIM_BDTR_MOE_Msk)) {
-        current1 = {0.0f, 0.0f};
+        current1.currents = {0.0f, 0.0f, 0.0f};
+        current1.valid = Measurement<Iph_ABC_t>::kCurrentsValid;
     }
 
-    motors[0].current_meas_cb(timestamp - TIM1_INIT_COUNT, current0);
-    motors[1].current_meas_cb(timestamp, current1);
+    current0.timestamp = timestamp - tim1_init_count_;
+    current1.timestamp = timestamp;
+    motors[0].current_meas_cb(current0);
+    motors[1].current_meas_cb(current1);
+
+    MEASURE_TIME(odrv.task_times_.fast_checks) {
+        odrv.do_fast_checks();
+    }
 
     odrv.control_loop_cb(timestamp);
 
@@ -534,37 +724,75 @@ void ControlLoop_IRQHandler(void) {
         motors[1].disarm_with_error(Motor::ERROR_BAD_TIMING);
     }
 
-    motors[0].dc_calib_cb(timestamp + TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1) - TIM1_INIT_COUNT, current0);
-    motors[1].dc_calib_cb(timestamp + TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1), current1);
-
-    motors[0].pwm_update_cb(timestamp + 3 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1) - TIM1_INIT_COUNT);
-    motors[1].pwm_update_cb(timestamp + 3 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1));
+    current0.timestamp = timestamp + pwm_period_clocks * (TIM_1_8_RCR + 1) - tim1_init_count_;
+    current1.timestamp = timestamp + pwm_period_clocks * (TIM_1_8_RCR + 1);
+    motors[0].dc_calib_cb(current0);
+    motors[1].dc_calib_cb(current1);
 
     // If we did everything right, the TIM8 update handler should have been
-    // called exactly once between the start of this function and now.
+    // called exactly once between the start of this function and the end of
+    // each pwm_update_cb().
+    // TIM1 latches the new timings tim1_init_count_ ticks before TIM8 does.
+    // TIM13 reloads on exactly that TIM1 update event so a TIM13 count below
+    // tim1_init_count_ means that the TIM1 deadline has passed.
+
+    motors[0].pwm_update_cb(timestamp + 3 * pwm_period_clocks * (TIM_1_8_RCR + 1) - tim1_init_count_);
+    if (timestamp_ != timestamp + pwm_period_clocks * (TIM_1_8_RCR + 1)
+            || sample_TIM13() < tim1_init_count_) {
+        motors[0].on_deadline_miss(timestamp);
+    }
 
-    if (timestamp_ != timestamp + TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1)) {
-        motors[0].disarm_with_error(Motor::ERROR_CONTROL_DEADLINE_MISSED);
-        motors[1].disarm_with_error(Motor::ERROR_CONTROL_DEADLINE_MISSED);
+    motors[1].pwm_update_cb(timestamp + 3 * pwm_period_clocks * (TIM_1_8_RCR + 1));
+    if (timestamp_ != timestamp + pwm_period_clocks * (TIM_1_8_RCR + 1)) {
+        motors[1].on_deadline_miss(timestamp);
     }
 
+    // Checks the bus current of both motors and updates the brake resistor
+    update_brake_current();
+
+    odrv.task_times_.control_loop.stop(control_loop_start);
+
     odrv.task_timers_armed_ = odrv.task_timers_armed_ && !TaskTimer::enabled;
     TaskTimer::enabled = false;
+
+    // Runs as soon as this interrupt returns
+    housekeeping_trigger_cyccnt_ = DWT->CYCCNT;
+    NVIC->STIR = Housekeeping_IRQn;
+
+    odrv.isr_cycles_ += DWT->CYCCNT - start_cycles;
+}
+
+void Housekeeping_IRQHandler(void) {
+    COUNT_IRQ(Housekeeping_IRQn);
+    TRACE_IRQ(Housekeeping_IRQn);
+    uint32_t start_cycles = DWT->CYCCNT;
+    update_max(&irq_latency_stats_.housekeeping, start_cycles - housekeeping_trigger_cyccnt_);
+    uint32_t isr_cycles = odrv.isr_cycles_;
+    odrv.housekeeping_cb();
+
+    // The control loop may have preempted us and counted its own cycles,
+    // so the total since the start is our share plus its share.
+    CRITICAL_SECTION() {
+        odrv.isr_cycles_ = isr_cycles + (DWT->CYCCNT - start_cycles);
+    }
 }
 
 void I2C1_EV_IRQHandler(void) {
     COUNT_IRQ(I2C1_EV_IRQn);
-    HAL_I2C_EV_IRQHandler(&hi2c1);
+    TRACE_IRQ(I2C1_EV_IRQn);
+    i2c_ev_irq_handler(&hi2c1);
 }
 
 void I2C1_ER_IRQHandler(void) {
     COUNT_IRQ(I2C1_ER_IRQn);
-    HAL_I2C_ER_IRQHandler(&hi2c1);
+    TRACE_IRQ(I2C1_ER_IRQn);
+    i2c_er_irq_handler(&hi2c1);
 }
 
 extern PCD_HandleTypeDef hpcd_USB_OTG_FS; // defined in usbd_conf.c
 void OTG_FS_IRQHandler(void) {
     COUNT_IRQ(OTG_FS_IRQn);
+    TRACE_IRQ(OTG_FS_IRQn);
     HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
 }
 
@@ -105,6 +105,18 @@ LoopFillZerobss:
   cmp  r2, r3
   bcc  FillZerobss
 
+/* Zero fill the CCM RAM segment. */
+  ldr  r2, =_sccmram
+  b  LoopFillZeroccmram
+FillZeroccmram:
+  movs  r3, #0
+  str  r3, [r2], #4
+
+LoopFillZeroccmram:
+  ldr  r3, = _eccmram
+  cmp  r2, r3
+  bcc  FillZeroccmram
+
 /* Call the clock system intitialization function.*/
   bl  SystemInit   
   bl  early_start_checks
@@ -73,12 +73,22 @@ bool Drv8301::init() {
     }
 
     // Reset DRV chip. The enable pin also controls the SPI interface, not only
-    // the driver stages.
-    enable_gpio_.write(false);
-    delay_us(40); // mimumum pull-down time for full reset: 20us
+    // the driver stages. A shared enable pin is actuated by the board, which
+    // resets all drivers at once.
     state_ = kStateUninitialized; // make is_ready() ignore transient errors before registers are set up
-    enable_gpio_.write(true);
-    osDelay(20); // t_spi_ready, max = 10ms
+
+    // A status readout in flight would interleave its frames with ours and
+    // answer our reads. No new readout is started while we're not ready.
+    while (readout_tasks_[0].is_in_use) {
+        osDelay(1);
+    }
+
+    if (enable_gpio_) {
+        enable_gpio_.write(false);
+        delay_us(40); // mimumum pull-down time for full reset: 20us
+        enable_gpio_.write(true);
+        osDelay(20); // t_spi_ready, max = 10ms
+    }
 
     // Write current configuration
     bool wrote_regs = write_reg(kRegNameControl1, regs_.control_register_1)
@@ -126,6 +136,79 @@ bool Drv8301::is_ready() {
     return state_ == kStateReady;
 }
 
+bool Drv8301::start_status_readout() {
+    if (state_ != kStateReady || !Stm32SpiArbiter::acquire_task(&readout_tasks_[0])) {
+        return false;
+    }
+
+    const RegName_e regs[kReadoutFrames] = {
+        kRegNameStatus1, kRegNameStatus2, kRegNameControl1, kRegNameControl2,
+        kRegNameStatus1 // only clocks out the answer of the previous read
+    };
+
+    readout_frames_done_ = 0;
+    readout_ok_ = true;
+
+    for (size_t i = 0; i < kReadoutFrames; ++i) {
+        readout_tx_buf_[i] = build_ctrl_word(DRV8301_CtrlMode_Read, regs[i], 0);
+        readout_rx_buf_[i] = 0xffff;
+        Stm32SpiArbiter::SpiTask& task = readout_tasks_[i];
+        task.config = spi_config_;
+        task.ncs_gpio = ncs_gpio_;
+        task.tx_buf = (uint8_t*)&readout_tx_buf_[i];
+        task.rx_buf = (uint8_t*)&readout_rx_buf_[i];
+        task.length = 1;
+        task.on_complete = [](void* ctx, bool success) { ((Drv8301*)ctx)->on_readout_frame(success); };
+        task.on_complete_ctx = this;
+        task.next = nullptr;
+        task.priority = Stm32SpiArbiter::PRIORITY_NORMAL;
+    }
+
+    // Tasks of equal priority run in order of submission. Encoder transfers
+    // may run in between, which doesn't matter because they use another nCS.
+    for (size_t i = 0; i < kReadoutFrames; ++i) {
+        spi_arbiter_->transfer_async(&readout_tasks_[i]);
+    }
+
+    return true;
+}
+
+void Drv8301::on_readout_frame(bool success) {
+    readout_ok_ = readout_ok_ && success;
+    if (++readout_frames_done_ < kReadoutFrames) {
+        return;
+    }
+
+    for (size_t i = 1; i < kReadoutFrames; ++i) {
+        if (readout_rx_buf_[i] == 0xbeef) {
+            readout_ok_ = false;
+        }
+    }
+
+    if (readout_ok_) {
+        uint16_t fault1 = readout_rx_buf_[1] & 0x07FF;
+        uint16_t fault2 = readout_rx_buf_[2] & 0x07FF;
+        uint16_t ctrl1 = readout_rx_buf_[3] & 0x07FF;
+        uint16_t ctrl2 = readout_rx_buf_[4] & 0x07FF;
+
+        status_.status_reg_1 = fault1;
+        status_.status_reg_2 = fault2;
+        status_.ctrl_reg_1 = ctrl1;
+        status_.ctrl_reg_2 = ctrl2;
+        status_.drv_fault = (fault1 & 0x03FF) | ((fault2 & 0x0080) ? (1 << 10) : 0);
+        status_.n_readouts++;
+
+        bool regs_ok = (ctrl1 == regs_.control_register_1) && (ctrl2 == regs_.control_register_2);
+        if ((fault1 & FaultType_FAULT) || !regs_ok) {
+            state_ = kStateUninitialized;
+        }
+    } else {
+        status_.n_failed_readouts++;
+    }
+
+    Stm32SpiArbiter::release_task(&readout_tasks_[0]);
+}
+
 Drv8301::FaultType_e Drv8301::get_error() {
     uint16_t fault1, fault2;
 
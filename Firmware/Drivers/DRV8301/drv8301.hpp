@@ -72,6 +72,18 @@ public:
      */
     bool is_ready() final;
 
+    /**
+     * @brief Starts a non-blocking readout of all status and control registers.
+     *
+     * The result is latched into status_ once all frames completed. The
+     * driver exits ready state if the readout shows a fault or if the control
+     * registers lost their configuration (e.g. after an unnoticed reset).
+     *
+     * Returns false if the driver is not ready or if the previous readout is
+     * still in progress. Can be called from interrupt context.
+     */
+    bool start_status_readout();
+
     /**
      * @brief This has no effect on this driver chip because the drive stages are
      * always enabled while the chip is initialized
@@ -80,6 +92,19 @@ public:
 
     FaultType_e get_error();
 
+    // Register contents as of the last completed start_status_readout()
+    struct Status_t {
+        uint32_t drv_fault = 0; // status register 1 plus GVDD_OV as bit 10
+        uint32_t status_reg_1 = 0;
+        uint32_t status_reg_2 = 0;
+        uint32_t ctrl_reg_1 = 0;
+        uint32_t ctrl_reg_2 = 0;
+        uint32_t n_readouts = 0;
+        uint32_t n_failed_readouts = 0; // SPI failures, the registers keep their last value
+    };
+
+    Status_t status_;
+
     float get_midpoint() final {
         return 0.5f; // [V]
     }
@@ -118,6 +143,9 @@ private:
     /** @brief Writes data to a DRV8301 register. There is no check if the write succeeded. */
     bool write_reg(const RegName_e regName, const uint16_t data);
 
+    /** @brief Called from the SPI arbiter for each frame of the status readout. */
+    void on_readout_frame(bool success);
+
     static const SPI_InitTypeDef spi_config_;
 
     // Configuration
@@ -134,6 +162,15 @@ private:
     // a RAM section which cannot be used by DMA.
     uint16_t tx_buf_, rx_buf_;
 
+    // A register read is answered in the following frame, so the readout
+    // sends one more frame than it reads registers.
+    static constexpr size_t kReadoutFrames = 5;
+    Stm32SpiArbiter::SpiTask readout_tasks_[kReadoutFrames];
+    uint16_t readout_tx_buf_[kReadoutFrames];
+    uint16_t readout_rx_buf_[kReadoutFrames];
+    size_t readout_frames_done_ = 0;
+    bool readout_ok_ = true;
+
     enum {
         kStateUninitialized,
         kStateStartupChecks,
@@ -32,6 +32,9 @@ bool Stm32SpiArbiter::start() {
     }
 
     SpiTask& task = *task_list_;
+    task.last_wait_cycles = DWT->CYCCNT - task.enqueue_time;
+    task.max_wait_cycles = std::max(task.max_wait_cycles, task.last_wait_cycles);
+
     if (!equals(task.config, hspi_->Init)) {
         HAL_SPI_DeInit(hspi_);
         hspi_->Init = task.config;
@@ -59,25 +62,45 @@ bool Stm32SpiArbiter::start() {
     return status == HAL_OK;
 }
 
+// Starts the first task in the queue. If a task fails to start it is completed
+// with an error and the next one is tried so that the queue can't get stuck.
+void Stm32SpiArbiter::start_queue() {
+    while (task_list_) {
+        if (start()) {
+            return;
+        }
+
+        SpiTask* task = task_list_;
+        CRITICAL_SECTION() {
+            task_list_ = task->next;
+        }
+        if (task->on_complete) {
+            (*task->on_complete)(task->on_complete_ctx, false);
+        }
+    }
+}
+
 void Stm32SpiArbiter::transfer_async(SpiTask* task) {
-    task->next = nullptr;
-    
-    // Append new task to task list.
+    task->enqueue_time = DWT->CYCCNT;
+    bool was_empty;
+
+    // Insert the new task behind all tasks of the same or higher priority.
     // We could try to do this lock free but we could also use our time for useful things.
-    SpiTask** ptr = &task_list_;
     CRITICAL_SECTION() {
-        while (*ptr)
+        SpiTask** ptr = &task_list_;
+        // The first task is in progress and can't be preempted
+        if (*ptr)
             ptr = &(*ptr)->next;
+        while (*ptr && (*ptr)->priority <= task->priority)
+            ptr = &(*ptr)->next;
+        task->next = *ptr;
         *ptr = task;
+        was_empty = (ptr == &task_list_);
     }
 
     // If the list was empty before, kick off the SPI arbiter now
-    if (ptr == &task_list_) {
-        if (!start()) {
-            if (task->on_complete) {
-                (*task->on_complete)(task->on_complete_ctx, false);
-            }
-        }
+    if (was_empty) {
+        start_queue();
     }
 }
 
@@ -94,7 +117,8 @@ bool Stm32SpiArbiter::transfer(SPI_InitTypeDef config, Stm32Gpio ncs_gpio, const
         .on_complete = [](void* ctx, bool success) { *(volatile uint8_t*)ctx = success ? 1 : 0; },
         .on_complete_ctx = (void*)&result,
         .is_in_use = false,
-        .next = nullptr
+        .next = nullptr,
+        .priority = PRIORITY_NORMAL,
     };
 
     transfer_async(&task);
@@ -117,12 +141,9 @@ void Stm32SpiArbiter::on_complete() {
         (*task_list_->on_complete)(task_list_->on_complete_ctx, true);
     }
 
-    // Start next task if any
-    SpiTask* next = nullptr;
+    // Start the next task if any
     CRITICAL_SECTION() {
-        next = task_list_ = task_list_->next;
-    }
-    if (next) {
-        start();
+        task_list_ = task_list_->next;
     }
+    start_queue();
 }
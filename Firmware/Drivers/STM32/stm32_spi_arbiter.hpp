@@ -7,6 +7,15 @@
 
 class Stm32SpiArbiter {
 public:
+    /**
+     * Queued tasks are executed in order of priority and then in order of
+     * submission. A transfer that is already in progress is never aborted.
+     */
+    enum Priority {
+        PRIORITY_HIGH = 0,   // control loop critical transfers, e.g. encoder reads
+        PRIORITY_NORMAL = 1, // everything else, e.g. gate driver diagnostics
+    };
+
     struct SpiTask {
         SPI_InitTypeDef config;
         Stm32Gpio ncs_gpio;
@@ -17,6 +26,12 @@ public:
         void* on_complete_ctx;
         bool is_in_use = false;
         struct SpiTask* next;
+        Priority priority = PRIORITY_NORMAL;
+
+        // Diagnostics: CPU cycles from transfer_async() until the transfer started
+        uint32_t enqueue_time = 0;
+        uint32_t last_wait_cycles = 0;
+        uint32_t max_wait_cycles = 0;
     };
 
     Stm32SpiArbiter(SPI_HandleTypeDef* hspi): hspi_(hspi) {}
@@ -49,6 +64,9 @@ public:
      * 
      * Once the transfer completes, fails or is aborted, the callback is invoked.
      * 
+     * Queued transfers are started back to back from the completion interrupt
+     * of the previous transfer.
+     * 
      * This function is thread-safe with respect to all other public functions
      * of this class.
      * 
@@ -86,6 +104,7 @@ public:
 
 private:
     bool start();
+    void start_queue();
     
     SPI_HandleTypeDef* hspi_;
     SpiTask* task_list_ = nullptr;
@@ -0,0 +1,75 @@
+#ifndef __STM32_STEP_COUNTER_HPP
+#define __STM32_STEP_COUNTER_HPP
+
+#include "stm32_system.h"
+#include <tim.h>
+
+/**
+ * @brief Counts the rising edges of a timer input in hardware.
+ *
+ * The timer runs in external clock mode 1, clocked by one of its first two
+ * inputs. This doesn't need an interrupt per edge, so the maximum rate is
+ * only limited by the input filter (a few MHz).
+ *
+ * Only the low 16 bits of the counter are used so that 16-bit and 32-bit
+ * timers behave the same. The user must read the counter more often than
+ * every 65536 edges.
+ */
+class Stm32StepCounter {
+public:
+    Stm32StepCounter(TIM_TypeDef* timer, void (*enable_clock)())
+        : timer_(timer), enable_clock_(enable_clock) {}
+
+    /**
+     * @brief Starts counting from zero.
+     * @param channel: The timer input, 1 or 2.
+     * Returns false if the channel is invalid or the counter is in use.
+     */
+    bool start(uint32_t channel) {
+        if (channel != 1 && channel != 2) {
+            return false;
+        }
+        bool expected = false;
+        if (!__atomic_compare_exchange_n(&in_use_, &expected, true, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return false;
+        }
+
+        (*enable_clock_)();
+        timer_->CR1 = 0;
+        timer_->SMCR = 0;
+        timer_->CCER = 0; // rising edges
+        timer_->PSC = 0;
+        timer_->ARR = 0xffff;
+
+        // The input filter requires the level to be stable for 8 timer clock
+        // cycles, which rejects glitches but allows steps of well over 1MHz.
+        if (channel == 1) {
+            timer_->CCMR1 = TIM_CCMR1_CC1S_0 | (0x3 << TIM_CCMR1_IC1F_Pos);
+            timer_->SMCR = TIM_TS_TI1FP1 | TIM_SLAVEMODE_EXTERNAL1;
+        } else {
+            timer_->CCMR1 = TIM_CCMR1_CC2S_0 | (0x3 << TIM_CCMR1_IC2F_Pos);
+            timer_->SMCR = TIM_TS_TI2FP2 | TIM_SLAVEMODE_EXTERNAL1;
+        }
+
+        timer_->EGR = TIM_EGR_UG; // load the prescaler
+        timer_->CNT = 0;
+        timer_->CR1 = TIM_CR1_CEN;
+        return true;
+    }
+
+    void stop() {
+        timer_->CR1 = 0;
+        in_use_ = false;
+    }
+
+    uint16_t get_count() {
+        return (uint16_t)timer_->CNT;
+    }
+
+private:
+    TIM_TypeDef* timer_;
+    void (*enable_clock_)();
+    bool in_use_ = false;
+};
+
+#endif // __STM32_STEP_COUNTER_HPP
@@ -2,3 +2,9 @@
 #include "stm32_system.h"
 
 uint32_t irq_counters[254]; // 14 core interrupts, 240 NVIC interrupts
+
+#ifdef ENABLE_IRQ_CYCLES
+uint32_t irq_cycles[254];
+uint32_t irq_max_cycles[254];
+volatile uint32_t irq_cycles_total = 0;
+#endif
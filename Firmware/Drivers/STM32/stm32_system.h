@@ -17,13 +17,14 @@ extern "C" {
 // monitor the number of times each interrupt fires.
 //#define ENABLE_IRQ_COUNTER
 
-#ifdef ENABLE_IRQ_COUNTER
-extern uint32_t irq_counters[];
-#define COUNT_IRQ(irqn) (++irq_counters[irqn + 14])
-#define GET_IRQ_COUNTER(irqn) irq_counters[irqn + 14]
-#else
-#define COUNT_IRQ(irqn) ((void)0)
-#define GET_IRQ_COUNTER(irqn) 0
+// Uncomment the following line (or set CONFIG_IRQ_CYCLES=true) to sacrifice
+// another 2kB of RAM and a few dozen cycles per interrupt to also accumulate
+// the DWT cycles spent in each interrupt that uses COUNT_IRQ and the most
+// cycles of a single run. Implies ENABLE_IRQ_COUNTER.
+//#define ENABLE_IRQ_CYCLES
+
+#if defined(ENABLE_IRQ_CYCLES) && !defined(ENABLE_IRQ_COUNTER)
+#define ENABLE_IRQ_COUNTER
 #endif
 
 static inline uint32_t cpu_enter_critical() {
@@ -36,6 +37,53 @@ static inline void cpu_exit_critical(uint32_t priority_mask) {
     __set_PRIMASK(priority_mask);
 }
 
+#ifdef ENABLE_IRQ_CYCLES
+extern uint32_t irq_cycles[];
+extern uint32_t irq_max_cycles[];
+extern volatile uint32_t irq_cycles_total;
+
+typedef struct {
+    int32_t irqn;
+    uint32_t start; // DWT->CYCCNT on entry
+    uint32_t total_at_start; // irq_cycles_total on entry
+} IrqCyclesScope;
+
+// Runs when the handler returns. The cycles of interrupts that preempted this
+// one are taken out by way of irq_cycles_total, so the cycles of
+// all interrupts add up to the time spent in interrupts.
+static inline void irq_cycles_exit(IrqCyclesScope* scope) {
+    uint32_t mask = cpu_enter_critical();
+    uint32_t nested = irq_cycles_total - scope->total_at_start;
+    uint32_t cycles = DWT->CYCCNT - scope->start - nested;
+    irq_cycles_total += cycles;
+    irq_cycles[scope->irqn + 14] += cycles;
+    if (cycles > irq_max_cycles[scope->irqn + 14]) {
+        irq_max_cycles[scope->irqn + 14] = cycles;
+    }
+    cpu_exit_critical(mask);
+}
+
+// Must be the first statement of the handler. The cycles are accounted when
+// the enclosing block is left, including by an early return.
+#define IRQ_CYCLES_SCOPE(irqn) \
+    IrqCyclesScope irq_cycles_scope_ __attribute__((cleanup(irq_cycles_exit))) = {irqn, DWT->CYCCNT, irq_cycles_total}
+#define GET_IRQ_CYCLES(irqn) irq_cycles[irqn + 14]
+#define GET_IRQ_MAX_CYCLES(irqn) irq_max_cycles[irqn + 14]
+#else
+#define IRQ_CYCLES_SCOPE(irqn) ((void)0)
+#define GET_IRQ_CYCLES(irqn) 0
+#define GET_IRQ_MAX_CYCLES(irqn) 0
+#endif
+
+#ifdef ENABLE_IRQ_COUNTER
+extern uint32_t irq_counters[];
+#define COUNT_IRQ(irqn) IRQ_CYCLES_SCOPE(irqn); (++irq_counters[irqn + 14])
+#define GET_IRQ_COUNTER(irqn) irq_counters[irqn + 14]
+#else
+#define COUNT_IRQ(irqn) ((void)0)
+#define GET_IRQ_COUNTER(irqn) 0
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,60 @@
+#ifndef __ACIM_FLUX_OPTIMIZER_HPP
+#define __ACIM_FLUX_OPTIMIZER_HPP
+
+#include <cmath>
+
+/**
+ * @brief Loss model of an induction motor in steady state, with the rotor
+ * flux normalized to [A] like in AcimEstimator (flux = Id).
+ *
+ *   torque = torque_constant * Id * Iq
+ *   P_stator = 1.5 * R * (Id^2 + Iq^2)
+ *   P_rotor = torque * slip_vel / pole_pairs
+ *           = torque_constant * slip_velocity / pole_pairs * Iq^2
+ *   P_core = core_loss_coeff * |phase_vel| * Id^2
+ *
+ * where slip_vel = slip_velocity * Iq / Id is the slip of the AcimEstimator
+ * model. The rotor copper loss is the torque times the slip, so it follows
+ * from the slip model without knowing the rotor resistance.
+ */
+struct AcimLossModel {
+    float torque_constant; // [Nm/A^2]
+    float pole_pairs;
+    float phase_resistance; // [Ohm] stator
+    float slip_velocity; // [rad/s electrical] 1 / rotor time constant
+    float core_loss_coeff; // [W/(A^2*rad/s)] per unit of electrical velocity
+
+    // [W/A^2] coefficients of Id^2 and Iq^2 in the total loss
+    float id_coeff(float phase_vel) const {
+        return 1.5f * phase_resistance + core_loss_coeff * std::abs(phase_vel);
+    }
+    float iq_coeff() const {
+        return 1.5f * phase_resistance + torque_constant * slip_velocity / pole_pairs;
+    }
+
+    // @brief Total loss [W] at the specified torque [Nm] and Id [A]
+    float get_loss(float torque, float id, float phase_vel) const {
+        float iq = torque / (torque_constant * id);
+        return id_coeff(phase_vel) * id * id + iq_coeff() * iq * iq;
+    }
+
+    /**
+     * @brief Returns the Id [A] that minimizes the loss at the specified
+     * torque [Nm] and electrical velocity [rad/s].
+     *
+     * With Iq = torque / (torque_constant * Id) the loss is
+     * a * Id^2 + b * torque^2 / (torque_constant^2 * Id^2), which is minimal
+     * at Id^4 = b / a * (torque / torque_constant)^2, where both parts of the
+     * loss are equal.
+     */
+    float get_min_loss_id(float torque, float phase_vel) const {
+        float a = id_coeff(phase_vel);
+        float b = iq_coeff();
+        if (!(a > 0.0f) || !(b > 0.0f) || !(torque_constant > 0.0f)) {
+            return 0.0f;
+        }
+        return std::sqrt(std::abs(torque) / torque_constant * std::sqrt(b / a));
+    }
+};
+
+#endif // __ACIM_FLUX_OPTIMIZER_HPP
@@ -0,0 +1,58 @@
+#ifndef __ARENA_HPP
+#define __ARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+
+#define ARENA_SIZE 20480 // [bytes] shared by the oscilloscope and the PVT buffers
+
+/**
+ * @brief Hands out the storage of the optional runtime buffers from one
+ * static block of memory, so that the configuration can decide which feature
+ * gets how much of it.
+ *
+ * All allocations are made during startup, after the configuration was
+ * loaded and before the threads and the control loop start. There is no way
+ * to free them. An allocation that doesn't fit fails as a whole and is
+ * counted in failed_allocations_, the feature then runs without a buffer.
+ */
+class Arena {
+public:
+    Arena(void* buffer, size_t size) : size_(size), buffer_((uint8_t*)buffer) {}
+
+    /**
+     * @brief Returns `count` value-initialized objects, or nullptr if they
+     * don't fit or `count` is 0.
+     */
+    template<typename T>
+    T* allocate(size_t count) {
+        if (count == 0) {
+            return nullptr;
+        }
+        uintptr_t begin = (uintptr_t)buffer_ + used_;
+        size_t padding = (alignof(T) - begin % alignof(T)) % alignof(T);
+        size_t available = size_ - used_;
+        if (padding > available || count > (available - padding) / sizeof(T)) {
+            failed_allocations_++;
+            return nullptr;
+        }
+        T* objects = (T*)(begin + padding);
+        for (size_t i = 0; i < count; ++i) {
+            new (&objects[i]) T();
+        }
+        used_ += padding + count * sizeof(T);
+        return objects;
+    }
+
+    uint32_t size_ = 0; // [bytes]
+    uint32_t used_ = 0; // [bytes] including the alignment padding
+    uint32_t failed_allocations_ = 0;
+
+private:
+    uint8_t* buffer_;
+};
+
+extern Arena arena;
+
+#endif // __ARENA_HPP
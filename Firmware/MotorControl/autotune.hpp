@@ -0,0 +1,115 @@
+#ifndef __AUTOTUNE_HPP
+#define __AUTOTUNE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stddef.h>
+
+/**
+ * @brief Model of the mechanics as seen from the torque command:
+ *   vel / torque = exp(-s * delay) / (inertia * s + friction)
+ *
+ * The delay lumps together the control loop latency, the velocity estimator
+ * and any filters.
+ */
+struct PlantModel {
+    float inertia; // [Nm/(turn/s^2)]
+    float friction; // [Nm/(turn/s)] viscous
+    float delay; // [s]
+};
+
+struct ControllerGains {
+    float pos_gain; // [(turn/s) / turn]
+    float vel_gain; // [Nm/(turn/s)]
+    float vel_integrator_gain; // [Nm/(turn/s * s)]
+};
+
+/**
+ * @brief Fits a PlantModel to a measured frequency response (velocity per
+ * torque).
+ *
+ * Inertia and friction are fitted to the magnitude only
+ *   |torque / vel|^2 = friction^2 + inertia^2 * w^2
+ * so that the unknown delay doesn't bias them. The delay is then the mean
+ * phase that is missing compared to the delay free model.
+ *
+ * @returns false if there are not enough points or the fit is not physical.
+ */
+inline bool fit_plant_model(const float* freq, const float* gain, const float* phase, size_t n, PlantModel* model) {
+    // Linear regression of y = |1/H|^2 over x = w^2
+    float sx = 0.0f, sy = 0.0f, sxx = 0.0f, sxy = 0.0f;
+    size_t m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!(gain[i] > 0.0f) || !(freq[i] > 0.0f)) {
+            continue;
+        }
+        float w = 2.0f * (float)M_PI * freq[i];
+        float x = w * w;
+        float y = 1.0f / (gain[i] * gain[i]);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+        m++;
+    }
+    float det = (float)m * sxx - sx * sx;
+    if (m < 2 || !(det > 0.0f)) {
+        return false;
+    }
+    float slope = ((float)m * sxy - sx * sy) / det;
+    float intercept = (sy - slope * sx) / (float)m;
+    if (!(slope > 0.0f)) {
+        return false;
+    }
+    model->inertia = std::sqrt(slope);
+    model->friction = std::sqrt(std::max(intercept, 0.0f));
+
+    // Least squares fit of the missing phase -w * delay
+    float swp = 0.0f, sww = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        if (!(gain[i] > 0.0f) || !(freq[i] > 0.0f)) {
+            continue;
+        }
+        float w = 2.0f * (float)M_PI * freq[i];
+        float missing = phase[i] + std::atan2(model->inertia * w, model->friction);
+        missing = std::remainder(missing, 2.0f * (float)M_PI);
+        swp += w * missing;
+        sww += w * w;
+    }
+    model->delay = std::max(-swp / sww, 0.0f);
+    return true;
+}
+
+/**
+ * @brief Designs the PI velocity loop for the crossover frequency `bandwidth`
+ * and the phase margin `phase_margin` of the PlantModel. The phase margin
+ * is a lower bound. The position loop gets a quarter of the velocity loop
+ * bandwidth.
+ *
+ * @param bandwidth: Velocity loop crossover frequency [Hz]
+ * @param phase_margin: [rad]
+ * @returns false if the phase margin can't be reached at this bandwidth.
+ */
+inline bool design_gains(const PlantModel& model, float bandwidth, float phase_margin, ControllerGains* gains) {
+    if (!(bandwidth > 0.0f) || !(phase_margin > 0.0f) || !(model.inertia > 0.0f)) {
+        return false;
+    }
+    float w = 2.0f * (float)M_PI * bandwidth;
+
+    // Phase of the open loop at w: -pi + phase_margin
+    //   = atan(w / ki) - pi/2 - atan2(J w, b) - w * delay
+    float lead = phase_margin - (float)M_PI / 2.0f + std::atan2(model.inertia * w, model.friction) + w * model.delay;
+    if (!(lead < (float)M_PI / 2.0f)) {
+        return false;
+    }
+    // The integrator corner provides the missing phase. It is kept at least
+    // two octaves below the crossover even if less phase would suffice.
+    float ki = lead > 0.0f ? std::min(w / std::tan(lead), 0.25f * w) : 0.25f * w;
+
+    // |L(jw)| = 1
+    float plant_mag = 1.0f / std::sqrt(model.inertia * model.inertia * w * w + model.friction * model.friction);
+    float pi_mag = std::sqrt(1.0f + (ki / w) * (ki / w));
+    gains->vel_gain = 1.0f / (plant_mag * pi_mag);
+    gains->vel_integrator_gain = gains->vel_gain * ki;
+    gains->pos_gain = w / 4.0f;
+    return true;
+}
+
+#endif // __AUTOTUNE_HPP
@@ -40,6 +40,14 @@ Axis::Axis(int axis_num,
     min_endstop_.axis_ = this;
     max_endstop_.axis_ = this;
     mechanical_brake_.axis_ = this;
+    encoder_fusion_.axis_ = this;
+    frequency_response_.axis_ = this;
+
+    encoder_fusion_.motor_pos_src_.connect_to(&encoder_.pos_estimate_);
+    encoder_fusion_.motor_vel_src_.connect_to(&encoder_.vel_estimate_);
+    encoder_fusion_.motor_accel_src_.connect_to(&encoder_.accel_estimate_);
+    encoder_fusion_.torque_src_.connect_to(&controller_.torque_output_);
+    torque_filter_.input_src_.connect_to(&controller_.torque_output_);
 }
 
 Axis::LockinConfig_t Axis::default_calibration() {
@@ -74,13 +82,169 @@ static void step_cb_wrapper(void* ctx) {
     reinterpret_cast<Axis*>(ctx)->step_cb();
 }
 
+static void dir_cb_wrapper(void* ctx) {
+    reinterpret_cast<Axis*>(ctx)->dir_cb();
+}
+
 bool Axis::apply_config() {
     config_.parent = this;
     decode_step_dir_pins();
-    watchdog_feed();
+    watchdog_reset();
+    update_control_pipeline();
     return true;
 }
 
+/**
+ * @brief Recomputes the derived quantities of the components for which config
+ * values were written since the last control loop iteration.
+ *
+ * The property setters only mark what is out of date. This runs once per
+ * iteration before any stage, so a sequence of writes is applied together
+ * and each quantity is recomputed only once.
+ */
+void Axis::apply_dirty_config() {
+    motor_.apply_dirty_config();
+    encoder_.apply_dirty_config();
+    sensorless_estimator_.apply_dirty_config();
+    controller_.apply_dirty_config();
+}
+
+/**
+ * @brief Rebuilds the list of components that are updated by
+ * ODrive::control_loop_cb() for this axis.
+ *
+ * Must be called whenever a config value changes that affects which stages
+ * apply. Safe to call while the control loop is running.
+ */
+void Axis::update_control_pipeline() {
+    std::array<ControlStage, 2> sensor_stages;
+    size_t n_sensor_stages = 0;
+    std::array<ControlStage, 8> control_stages;
+    size_t n_control_stages = 0;
+
+    // Sub-components should use set_error which will propegate to this error_
+    // Temperatures change slowly, so the thermistors are decimated
+    sensor_stages[n_sensor_stages++] = {[](Axis& axis, uint32_t) {
+        if (axis.thermistor_countdown_) {
+            axis.thermistor_countdown_--;
+            return;
+        }
+        axis.thermistor_countdown_ = std::max<uint32_t>(axis.config_.thermistor_decimation, 1) - 1;
+        axis.motor_.fet_thermistor_.update();
+        axis.motor_.motor_thermistor_.update();
+    }, &task_times_.thermistor_update};
+
+    // V/f control doesn't use the estimates of this axis. The encoder still
+    // runs if another axis uses it as its load encoder.
+    bool encoder_needed = true;
+    if (vf_control_active_) {
+        encoder_needed = false;
+        for (Axis& axis: axes) {
+            encoder_needed |= &axis != this && axis.controller_.config_.load_encoder_axis == axis_num_;
+        }
+    }
+    if (encoder_needed) {
+        sensor_stages[n_sensor_stages++] = {[](Axis& axis, uint32_t) {
+            axis.encoder_.update();
+        }, &task_times_.encoder_update};
+    }
+
+    // Runs as a control stage because the load encoder can belong to the
+    // other axis.
+    if (encoder_fusion_.config_.enable && !vf_control_active_) {
+        control_stages[n_control_stages++] = {[](Axis& axis, uint32_t timestamp) {
+            axis.encoder_fusion_.update(timestamp);
+        }, &task_times_.encoder_fusion_update};
+    }
+
+    if (min_endstop_.config_.enabled || max_endstop_.config_.enabled) {
+        control_stages[n_control_stages++] = {[](Axis& axis, uint32_t) {
+            axis.min_endstop_.update();
+            axis.max_endstop_.update();
+        }, &task_times_.endstop_update};
+    }
+
+    control_stages[n_control_stages++] = {[](Axis& axis, uint32_t) {
+        odCAN->send_cyclic(axis);
+    }, &task_times_.can_heartbeat};
+
+    // The controller may run at a lower rate than the current controller. In
+    // the iterations in between the last torque output is held.
+    if (!vf_control_active_) {
+        control_stages[n_control_stages++] = {[](Axis& axis, uint32_t timestamp) {
+            if (axis.controller_countdown_) {
+                axis.controller_countdown_--;
+                if (std::optional<float> torque = axis.controller_.torque_output_.previous()) {
+                    axis.controller_.torque_output_ = *torque;
+                }
+            } else {
+                axis.controller_countdown_ = axis.controller_decimation_ - 1;
+                MEASURE_TIME(axis.task_times_.vel_filter_update)
+                    axis.vel_filter_.update(timestamp);
+                MEASURE_TIME(axis.task_times_.controller_update)
+                    axis.controller_.update(); // uses position and velocity from encoder
+            }
+            MEASURE_TIME(axis.task_times_.torque_filter_update)
+                axis.torque_filter_.update(timestamp);
+        }, nullptr};
+    }
+
+    control_stages[n_control_stages++] = {[](Axis& axis, uint32_t timestamp) {
+        axis.open_loop_controller_.update(timestamp);
+    }, &task_times_.open_loop_controller_update};
+
+    // V/f control doesn't use the current setpoint from the torque
+    if (!vf_control_active_) {
+        control_stages[n_control_stages++] = {[](Axis& axis, uint32_t timestamp) {
+            axis.motor_.update(timestamp); // uses torque from controller and phase_vel from encoder
+        }, &task_times_.motor_update};
+    }
+
+    control_stages[n_control_stages++] = {[](Axis& axis, uint32_t timestamp) {
+        axis.motor_.current_control_.update(timestamp); // uses the output of controller_ or open_loop_contoller_ and encoder_ or sensorless_estimator_ or acim_estimator_
+    }, nullptr}; // current_controller_update measures the FOC output computation in Motor::pwm_update_cb()
+
+    uint32_t decimation = std::max<uint32_t>(config_.controller_decimation, 1);
+
+    CRITICAL_SECTION() {
+        // Stagger the decimated iterations of the axes to even out the load
+        if (decimation != controller_decimation_) {
+            controller_decimation_ = decimation;
+            controller_countdown_ = (axis_num_ * decimation) / AXIS_COUNT;
+        }
+        // Also after a change of the PWM frequency by set_pwm_frequency()
+        controller_.update_period_ = decimation * current_meas_period;
+        controller_.update_filter_gains();
+        sensor_stages_ = sensor_stages;
+        n_sensor_stages_ = n_sensor_stages;
+        control_stages_ = control_stages;
+        n_control_stages_ = n_control_stages;
+    }
+
+    // The velocity filter runs at the controller rate, the torque filter at
+    // the full control loop rate.
+    vel_filter_.set_sample_period(controller_.update_period_);
+    torque_filter_.set_sample_period(current_meas_period);
+}
+
+void Axis::run_sensor_stages(uint32_t timestamp) {
+    for (size_t i = 0; i < n_sensor_stages_; ++i) {
+        MEASURE_TIME(*sensor_stages_[i].timer)
+            sensor_stages_[i].update(*this, timestamp);
+    }
+}
+
+void Axis::run_control_stages(uint32_t timestamp) {
+    for (size_t i = 0; i < n_control_stages_; ++i) {
+        if (control_stages_[i].timer) {
+            MEASURE_TIME(*control_stages_[i].timer)
+                control_stages_[i].update(*this, timestamp);
+        } else {
+            control_stages_[i].update(*this, timestamp);
+        }
+    }
+}
+
 void Axis::clear_config() {
     config_ = {};
     config_.step_gpio_pin = default_step_gpio_pin_;
@@ -104,15 +268,36 @@ void Axis::start_thread() {
  * @brief Blocks until at least one complete control loop has been executed.
  */
 bool Axis::wait_for_control_iteration() {
-    osSignalWait(0x0001, osWaitForever); // this might return instantly
-    osSignalWait(0x0001, osWaitForever); // this might be triggered at the
-                                         // end of a control loop iteration
-                                         // which was started before we entered
-                                         // this function
-    osSignalWait(0x0001, osWaitForever);
+    control_iteration_subscribed_ = true;
+    osSignalWait(AXIS_SIGNAL_CONTROL_ITERATION, osWaitForever); // this might return instantly
+    osSignalWait(AXIS_SIGNAL_CONTROL_ITERATION, osWaitForever); // this might be triggered at the
+                                                                // end of a control loop iteration
+                                                                // which was started before we entered
+                                                                // this function
+    osSignalWait(AXIS_SIGNAL_CONTROL_ITERATION, osWaitForever);
+    control_iteration_subscribed_ = false;
     return true;
 }
 
+/**
+ * @brief Blocks until notify_event() is called or the timeout expires.
+ *
+ * Used by states that only wait for a state request or a disarm instead of
+ * polling these conditions. An event that occurred before the call makes
+ * it return instantly, so the caller must check its conditions in a loop.
+ */
+void Axis::wait_for_event(uint32_t timeout_ms) {
+    osSignalWait(AXIS_SIGNAL_EVENT, timeout_ms);
+}
+
+// @brief Wakes up the axis thread if it's in wait_for_event(). Can be called
+// from interrupt context.
+void Axis::notify_event() {
+    if (thread_id_valid_) {
+        osSignalSet(thread_id_, AXIS_SIGNAL_EVENT);
+    }
+}
+
 // step/direction interface
 void Axis::step_cb() {
     if (step_dir_active_) {
@@ -120,6 +305,66 @@ void Axis::step_cb() {
         const float dir = dir_pin ? 1.0f : -1.0f;
         controller_.input_pos_ += dir * config_.turns_per_step;
         controller_.input_pos_updated();
+        CRITICAL_SECTION() {
+            pending_steps_ += dir_pin ? 1 : -1; // for the velocity estimate
+        }
+    }
+}
+
+// @brief Books the steps that the hardware counted since the last call with
+// the direction that was valid meanwhile. Must be called with interrupts
+// disabled.
+void Axis::accumulate_steps() {
+    uint16_t count = step_counter_->get_count();
+    int32_t steps = (uint16_t)(count - step_count_);
+    step_count_ = count;
+    pending_steps_ += step_dir_ ? steps : -steps;
+}
+
+// Steps that the counter sees between the dir edge and this interrupt are
+// booked in the old direction. Step/dir sources keep a setup time between
+// a dir change and the next step, which covers the interrupt latency.
+void Axis::dir_cb() {
+    CRITICAL_SECTION() {
+        if (step_counter_) {
+            accumulate_steps();
+            step_dir_ = dir_gpio_.read();
+        }
+    }
+}
+
+// @brief Takes the steps since the last control loop iteration. Steps from
+// the hardware counter are turned into an input position here, steps from
+// the interrupt were already applied by step_cb().
+// If enabled, the step rate is low pass filtered into a velocity
+// feedforward, which removes the following error that a position-only
+// setpoint causes at speed.
+void Axis::update_step_dir() {
+    if (!step_dir_active_) {
+        return;
+    }
+
+    int32_t steps;
+    bool counted;
+    CRITICAL_SECTION() {
+        counted = step_counter_;
+        if (counted) {
+            accumulate_steps();
+        }
+        steps = pending_steps_;
+        pending_steps_ = 0;
+    }
+
+    float delta = (float)steps * config_.turns_per_step;
+    if (counted && steps) {
+        controller_.input_pos_ += delta;
+        controller_.input_pos_updated();
+    }
+
+    if (config_.step_vel_ff_bandwidth > 0.0f) {
+        float k = std::min(config_.step_vel_ff_bandwidth * current_meas_period, 1.0f);
+        step_vel_ += k * (delta / current_meas_period - step_vel_);
+        controller_.input_vel_ = step_vel_;
     }
 }
 
@@ -130,7 +375,38 @@ void Axis::decode_step_dir_pins() {
 
 // @brief (de)activates step/dir input
 void Axis::set_step_dir_active(bool active) {
-    if (active) {
+    bool use_counter = config_.step_gpio_pin < GPIO_COUNT
+            && odrv.config_.gpio_modes[config_.step_gpio_pin] == ODriveIntf::GPIO_MODE_STEP_COUNTER;
+
+    if (active && use_counter) {
+        if (step_counter_) {
+            return; // already counting
+        }
+
+        // Count the steps in hardware and only interrupt on dir changes
+        const StepCounterPin& pin = step_counter_pins[config_.step_gpio_pin];
+        if (!pin.counter || !pin.counter->start(pin.channel)) {
+            odrv.misconfigured_ = true;
+            return;
+        }
+        CRITICAL_SECTION() {
+            step_count_ = pin.counter->get_count();
+            pending_steps_ = 0;
+            step_dir_ = dir_gpio_.read();
+            step_vel_ = 0.0f;
+            step_counter_ = pin.counter;
+        }
+        if (!dir_gpio_.subscribe(true, true, dir_cb_wrapper, this)) {
+            odrv.misconfigured_ = true;
+        }
+
+        step_dir_active_ = true;
+    } else if (active) {
+        CRITICAL_SECTION() {
+            pending_steps_ = 0;
+            step_vel_ = 0.0f;
+        }
+
         // Subscribe to rising edges of the step GPIO
         if (!step_gpio_.subscribe(true, false, step_cb_wrapper, this)) {
             odrv.misconfigured_ = true;
@@ -138,8 +414,20 @@ void Axis::set_step_dir_active(bool active) {
 
         step_dir_active_ = true;
     } else {
+        if (step_dir_active_ && config_.step_vel_ff_bandwidth > 0.0f) {
+            controller_.input_vel_ = 0.0f; // don't leave a stale feedforward behind
+        }
         step_dir_active_ = false;
 
+        if (Stm32StepCounter* counter = step_counter_) {
+            dir_gpio_.unsubscribe();
+            CRITICAL_SECTION() {
+                step_counter_ = nullptr;
+            }
+            counter->stop();
+            return;
+        }
+
         // Unsubscribe from step GPIO
         // TODO: if we change the GPIO while the subscription is active and then
         // unsubscribe then the unsubscribe is for the wrong pin.
@@ -151,6 +439,7 @@ void Axis::set_step_dir_active(bool active) {
 // Returns true if everything is ok.
 bool Axis::do_checks(uint32_t timestamp) {
     // Sub-components should use set_error which will propegate to this error_
+    motor_.update_thermal_models();
     motor_.effective_current_lim();
     motor_.do_checks(timestamp);
 
@@ -169,18 +458,66 @@ void Axis::watchdog_feed() {
     watchdog_current_value_ = get_watchdog_reset();
 }
 
-// @brief Check the watchdog timer for expiration. Also sets the watchdog error bit if expired.
+// @brief Feeds the watchdog of a command channel and the common watchdog.
+void Axis::watchdog_feed(WatchdogChannel channel) {
+    if (channel < WATCHDOG_CHANNEL_COUNT) {
+        channel_watchdog_[channel] = get_watchdog_reset(get_watchdog_timeout(channel));
+    }
+    watchdog_current_value_ = get_watchdog_reset();
+}
+
+// @brief Feeds all watchdogs, e.g. when closed loop control starts.
+void Axis::watchdog_reset() {
+    for (size_t i = 0; i < WATCHDOG_CHANNEL_COUNT; ++i) {
+        channel_watchdog_[i] = get_watchdog_reset(get_watchdog_timeout((WatchdogChannel)i));
+    }
+    watchdog_expired_channels_ = 0;
+    watchdog_feed();
+}
+
+/**
+ * @brief Check the watchdog timers for expiration. Also sets the watchdog error
+ * bit if expired.
+ *
+ * With config_.watchdog_decel_stop the controller first decelerates to
+ * standstill at the decel limit of the trajectory planner. The error is set
+ * once it stands still, feeding the watchdog during the stop doesn't cancel it.
+ */
 bool Axis::watchdog_check() {
-    if (!config_.enable_watchdog) return true;
+    bool expired = controller_.fast_stop_active_ && motor_.is_armed_;
 
-    // explicit check here to ensure that we don't underflow back to UINT32_MAX
-    if (watchdog_current_value_ > 0) {
-        watchdog_current_value_--;
+    // explicit checks here to ensure that we don't underflow back to UINT32_MAX
+    if (config_.enable_watchdog) {
+        if (watchdog_current_value_ > 0) {
+            watchdog_current_value_--;
+        } else {
+            expired = true;
+        }
+    }
+    for (size_t i = 0; i < WATCHDOG_CHANNEL_COUNT; ++i) {
+        if (!(get_watchdog_timeout((WatchdogChannel)i) > 0.0f)) {
+            continue;
+        }
+        if (channel_watchdog_[i] > 0) {
+            channel_watchdog_[i]--;
+        } else {
+            watchdog_expired_channels_ |= 1 << i;
+            expired = true;
+        }
+    }
+    if (!expired) {
         return true;
-    } else {
-        error_ |= ERROR_WATCHDOG_TIMER_EXPIRED;
-        return false;
     }
+
+    if (config_.watchdog_decel_stop && motor_.is_armed_ && trap_traj_.config_.decel_limit > 0.0f) {
+        controller_.start_fast_stop(trap_traj_.config_.decel_limit);
+        if (!controller_.fast_stop_done()) {
+            return true;
+        }
+    }
+    controller_.fast_stop_active_ = false;
+    error_ |= ERROR_WATCHDOG_TIMER_EXPIRED;
+    return false;
 }
 
 bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config, bool remain_armed) {
@@ -248,13 +585,172 @@ bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config, bool remain_arme
     return success;
 }
 
+/**
+ * @brief Runs open loop V/f control until another state is requested: the
+ * electrical frequency follows `controller.input_vel` (in turn/s of the rotor
+ * field over the pole pairs) with the configured ramps, the voltage follows
+ * the frequency. Neither the encoder nor the controller of this axis run in
+ * this state, which leaves the CPU time to the other axis.
+ */
+bool Axis::run_vf_control() {
+    const VfConfig_t& vf = config_.vf;
+    float pole_pairs = (float)motor_.config_.pole_pairs;
+    float rated_vel = 2.0f * M_PI * vf.rated_freq; // [rad/s]
+
+    CRITICAL_SECTION() {
+        open_loop_controller_.Idq_setpoint_ = {0.0f, 0.0f};
+        open_loop_controller_.Vdq_setpoint_ = {0.0f, 0.0f};
+        open_loop_controller_.phase_ = 0.0f;
+        open_loop_controller_.phase_vel_ = 0.0f;
+        open_loop_controller_.total_distance_ = 0.0f;
+        open_loop_controller_.vf_ramp_vel_ = 0.0f;
+        open_loop_controller_.vf_torque_current_ = 0.0f;
+
+        open_loop_controller_.vf_mode_ = true;
+        open_loop_controller_.max_phase_vel_ramp_ = 2.0f * M_PI * vf.accel;
+        open_loop_controller_.max_phase_vel_decel_ = 2.0f * M_PI * vf.decel;
+        open_loop_controller_.vf_boost_voltage_ = vf.boost_voltage;
+        open_loop_controller_.vf_slope_ = rated_vel > 0.0f ? (vf.rated_voltage - vf.boost_voltage) / rated_vel : 0.0f;
+        open_loop_controller_.vf_max_voltage_ = vf.rated_voltage;
+        open_loop_controller_.vf_slip_gain_ = 2.0f * M_PI * vf.slip_comp;
+        open_loop_controller_.vf_slip_filter_k_ = current_meas_period / std::max(vf.slip_comp_time_constant, current_meas_period);
+        open_loop_controller_.vf_current_lim_ = motor_.effective_current_lim();
+        open_loop_controller_.phase_resistance_ = motor_.config_.phase_resistance;
+        open_loop_controller_.Idq_measured_src_ = &motor_.current_control_.Idq_last_;
+        open_loop_controller_.target_vel_ = 0.0f;
+
+        motor_.current_control_.enable_current_control_src_ = false;
+        motor_.current_control_.Idq_setpoint_src_.connect_to(&open_loop_controller_.Idq_setpoint_);
+        motor_.current_control_.Vdq_setpoint_src_.connect_to(&open_loop_controller_.Vdq_setpoint_);
+        motor_.current_control_.phase_src_.connect_to(&open_loop_controller_.phase_);
+        motor_.current_control_.phase_vel_src_.connect_to(&open_loop_controller_.phase_vel_);
+
+        vf_control_active_ = true;
+    }
+    update_control_pipeline();
+    wait_for_control_iteration();
+
+    motor_.arm(&motor_.current_control_);
+
+    while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_) {
+        // The ramps run in the control loop, so this rate is enough
+        open_loop_controller_.target_vel_ = 2.0f * M_PI * pole_pairs * controller_.input_vel_;
+        open_loop_controller_.vf_current_lim_ = motor_.effective_current_lim();
+        osDelay(1);
+    }
+
+    motor_.disarm();
+    CRITICAL_SECTION() {
+        open_loop_controller_.vf_mode_ = false;
+        open_loop_controller_.max_phase_vel_decel_ = INFINITY;
+        vf_control_active_ = false;
+    }
+    update_control_pipeline();
+    return check_for_errors();
+}
+
+
+/**
+ * @brief Finds the rotor angle by high frequency injection at standstill.
+ * Leaves the motor armed on success.
+ */
+bool Axis::run_hfi_startup() {
+    CRITICAL_SECTION() {
+        sensorless_estimator_.reset();
+        sensorless_estimator_.hfi_.start();
+        sensorless_estimator_.hfi_Idq_setpoint_ = {0.0f, 0.0f};
+
+        motor_.current_control_.enable_current_control_src_ = motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL;
+        motor_.current_control_.Idq_setpoint_src_.connect_to(&sensorless_estimator_.hfi_Idq_setpoint_);
+        motor_.current_control_.Vdq_setpoint_src_.connect_to(&sensorless_estimator_.hfi_Vdq_setpoint_);
+        motor_.current_control_.hfi_voltage_src_.connect_to(&sensorless_estimator_.hfi_voltage_);
+
+        motor_.current_control_.phase_src_.connect_to(&sensorless_estimator_.phase_);
+        acim_estimator_.rotor_phase_src_.connect_to(&sensorless_estimator_.phase_);
+
+        motor_.phase_vel_src_.connect_to(&sensorless_estimator_.phase_vel_);
+        motor_.current_control_.phase_vel_src_.connect_to(&sensorless_estimator_.phase_vel_);
+        acim_estimator_.rotor_phase_vel_src_.connect_to(&sensorless_estimator_.phase_vel_);
+    }
+    wait_for_control_iteration();
+
+    motor_.arm(&motor_.current_control_);
+
+    while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_) {
+        if (sensorless_estimator_.hfi_.state() == HfiObserver::STATE_TRACK) {
+            return true;
+        } else if (sensorless_estimator_.hfi_.state() != HfiObserver::STATE_SCAN
+                && sensorless_estimator_.hfi_.state() != HfiObserver::STATE_POLARITY) {
+            break;
+        }
+        osDelay(1);
+    }
+
+    motor_.disarm();
+    return false;
+}
+
+/**
+ * @brief Keeps the lock-in spin running until the sensorless estimator, which
+ * runs in the background, follows the rotor: its phase must be within
+ * handoff_max_phase_error of the open loop phase (the difference is the load
+ * angle) and its velocity within handoff_max_vel_error of the open loop
+ * velocity for handoff_hold_time.
+ */
+bool Axis::wait_for_sensorless_sync() {
+    const SensorlessEstimator::Config_t& config = sensorless_estimator_.config_;
+    uint32_t hold_ms = (uint32_t)(config.handoff_hold_time * 1000.0f);
+    uint32_t timeout_ms = (uint32_t)(config.handoff_timeout * 1000.0f);
+    uint32_t in_bounds_ms = 0;
+
+    for (uint32_t t = 0; (requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_; ++t) {
+        std::optional<float> ol_phase = open_loop_controller_.phase_.any();
+        std::optional<float> ol_vel = open_loop_controller_.phase_vel_.any();
+        std::optional<float> phase = sensorless_estimator_.phase_.any();
+        std::optional<float> vel = sensorless_estimator_.phase_vel_.any();
+
+        bool in_bounds = ol_phase && ol_vel && phase && vel
+                && std::abs(wrap_pm_pi(*ol_phase - *phase)) <= config.handoff_max_phase_error
+                && std::abs(*vel - *ol_vel) <= config.handoff_max_vel_error * std::abs(*ol_vel);
+        in_bounds_ms = in_bounds ? in_bounds_ms + 1 : 0;
+        if (in_bounds_ms > hold_ms) {
+            return true;
+        }
+
+        if (t >= timeout_ms) {
+            sensorless_estimator_.error_ |= SensorlessEstimator::ERROR_HANDOFF_TIMEOUT;
+            break;
+        }
+        osDelay(1);
+    }
+
+    motor_.disarm();
+    return false;
+}
 
 bool Axis::start_closed_loop_control() {
+    // The cogging map and the learning table are only read from NVM when
+    // they are first needed
+    if ((controller_.config_.anticogging.pre_calibrated && !controller_.cogging_map_loaded_)
+        || (controller_.config_.learning.enable && !controller_.learning_table_loaded_)) {
+        odrv.load_calibration_data();
+    }
+
     bool sensorless_mode = config_.enable_sensorless_mode;
+    bool hfi_mode = sensorless_mode && sensorless_estimator_.config_.enable_hfi;
 
-    if (sensorless_mode) {
+    if (hfi_mode) {
+        if (!run_hfi_startup()) {
+            return false;
+        }
+    } else if (sensorless_mode) {
+        // Start the observer from a clean state so that it converges during
+        // the ramp.
+        CRITICAL_SECTION() {
+            sensorless_estimator_.reset();
+        }
         // TODO: restart if desired
-        if (!run_lockin_spin(config_.sensorless_ramp, true)) {
+        if (!run_lockin_spin(config_.sensorless_ramp, true) || !wait_for_sensorless_sync()) {
             return false;
         }
     }
@@ -263,27 +759,61 @@ bool Axis::start_closed_loop_control() {
     CRITICAL_SECTION() {
         if (sensorless_mode) {
             controller_.pos_estimate_linear_src_.disconnect();
+            controller_.pos_estimate_linear_turns_src_.disconnect();
             controller_.pos_estimate_circular_src_.disconnect();
             controller_.pos_wrap_src_.disconnect();
             controller_.vel_estimate_src_.connect_to(&sensorless_estimator_.vel_estimate_);
+            controller_.accel_estimate_src_.disconnect();
+            controller_.twist_src_.disconnect();
+            controller_.twist_vel_src_.disconnect();
         } else if (controller_.config_.load_encoder_axis < AXIS_COUNT) {
             Axis* ax = &axes[controller_.config_.load_encoder_axis];
             controller_.pos_estimate_circular_src_.connect_to(&ax->encoder_.pos_circular_);
             controller_.pos_wrap_src_.connect_to(&controller_.config_.circular_setpoint_range);
-            controller_.pos_estimate_linear_src_.connect_to(&ax->encoder_.pos_estimate_);
-            controller_.vel_estimate_src_.connect_to(&ax->encoder_.vel_estimate_);
+            if (encoder_fusion_.config_.enable && ax != this) {
+                encoder_fusion_.load_pos_src_.connect_to(&ax->encoder_.pos_estimate_);
+                encoder_fusion_.load_vel_src_.connect_to(&ax->encoder_.vel_estimate_);
+                controller_.pos_estimate_linear_src_.connect_to(&encoder_fusion_.pos_estimate_);
+                controller_.pos_estimate_linear_turns_src_.disconnect();
+                controller_.vel_estimate_src_.connect_to(&encoder_fusion_.vel_estimate_);
+                controller_.accel_estimate_src_.connect_to(&encoder_fusion_.accel_estimate_);
+                controller_.twist_src_.connect_to(&encoder_fusion_.twist_);
+                controller_.twist_vel_src_.connect_to(&encoder_fusion_.twist_vel_);
+            } else {
+                encoder_fusion_.load_pos_src_.disconnect();
+                encoder_fusion_.load_vel_src_.disconnect();
+                controller_.pos_estimate_linear_src_.connect_to(&ax->encoder_.pos_estimate_);
+                controller_.pos_estimate_linear_turns_src_.connect_to(&ax->encoder_.pos_estimate_turns_);
+                controller_.vel_estimate_src_.connect_to(&ax->encoder_.vel_estimate_);
+                controller_.accel_estimate_src_.connect_to(&ax->encoder_.accel_estimate_);
+                controller_.twist_src_.disconnect();
+                controller_.twist_vel_src_.disconnect();
+            }
+            ax->encoder_.accel_ff_src_.connect_to(&controller_.accel_setpoint_);
         } else {
             controller_.pos_estimate_circular_src_.disconnect();
             controller_.pos_estimate_linear_src_.disconnect();
+            controller_.pos_estimate_linear_turns_src_.disconnect();
             controller_.pos_wrap_src_.disconnect();
             controller_.vel_estimate_src_.disconnect();
+            controller_.accel_estimate_src_.disconnect();
+            controller_.twist_src_.disconnect();
+            controller_.twist_vel_src_.disconnect();
             controller_.set_error(Controller::ERROR_INVALID_LOAD_ENCODER);
             return false;
         }
 
+        vel_filter_.input_src_ = controller_.vel_estimate_src_;
+        vel_filter_.reset();
+        torque_filter_.reset();
+        controller_.vel_estimate_src_.connect_to(&vel_filter_.output_);
+
         // To avoid any transient on startup, we intialize the setpoint to be the current position
         // note - input_pos_ is not set here. It is set to 0 earlier in this method and velocity control is used.
         if (controller_.config_.control_mode >= Controller::CONTROL_MODE_POSITION_CONTROL) {
+            // Apply any queued command first so that it can't override the
+            // initial position later.
+            controller_.apply_input_command();
             std::optional<float> pos_init = (controller_.config_.circular_setpoints ?
                                     controller_.pos_estimate_circular_src_ :
                                     controller_.pos_estimate_linear_src_).any();
@@ -298,8 +828,17 @@ bool Axis::start_closed_loop_control() {
 
         // Avoid integrator windup issues
         controller_.vel_integrator_torque_ = 0.0f;
+        if (sensorless_mode && !hfi_mode && motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL) {
+            // Take over the torque of the lock-in spin: its current leads the
+            // rotor by the load angle, so only the q part produced torque.
+            float current = open_loop_controller_.Idq_setpoint_.any().value_or(float2D{0.0f, 0.0f}).first;
+            float load_angle = wrap_pm_pi(open_loop_controller_.phase_.any().value_or(0.0f)
+                                        - sensorless_estimator_.phase_.any().value_or(0.0f));
+            controller_.vel_integrator_torque_ = motor_.torque_from_current(current * std::sin(load_angle));
+        }
+        controller_.disturbance_observer_.reset();
 
-        motor_.torque_setpoint_src_.connect_to(&controller_.torque_output_);
+        motor_.torque_setpoint_src_.connect_to(&torque_filter_.output_);
         motor_.direction_ = sensorless_mode ? 1.0f : encoder_.config_.direction;
 
         motor_.current_control_.enable_current_control_src_ = motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL;
@@ -315,7 +854,7 @@ bool Axis::start_closed_loop_control() {
         motor_.current_control_.phase_vel_src_.connect_to(phase_vel_src);
         acim_estimator_.rotor_phase_vel_src_.connect_to(phase_vel_src);
         
-        if (sensorless_mode) {
+        if (sensorless_mode && !hfi_mode) {
             // Make the final velocity of the loĉk-in spin the setpoint of the
             // closed loop controller to allow for smooth transition.
             float vel = config_.sensorless_ramp.vel / (2.0f * M_PI * motor_.config_.pole_pairs);
@@ -327,14 +866,40 @@ bool Axis::start_closed_loop_control() {
     // In sensorless mode the motor is already armed.
     if (!motor_.is_armed_) {
         wait_for_control_iteration();
+        controller_.hold_inputs_ = true;
         motor_.arm(&motor_.current_control_);
     }
 
-    return true;
+    // The controller holds the initial setpoints against the load while the
+    // brake opens. Commands that arrive in the meantime wait in the mailbox.
+    while (!mechanical_brake_.is_open() && motor_.is_armed_ && requested_state_ == AXIS_STATE_UNDEFINED) {
+        osDelay(1);
+    }
+    controller_.hold_inputs_ = false;
+
+    return mechanical_brake_.is_open() && motor_.is_armed_;
 }
 
 bool Axis::stop_closed_loop_control() {
+    // With a slow brake the motor stops the axis and holds it until the
+    // brake has closed, instead of letting the load drop.
+    if (motor_.is_armed_ && mechanical_brake_.is_present() && mechanical_brake_.config_.engage_delay > 0) {
+        if (trap_traj_.config_.decel_limit > 0.0f) {
+            controller_.start_fast_stop(trap_traj_.config_.decel_limit);
+            while (motor_.is_armed_ && !controller_.fast_stop_done()) {
+                osDelay(1);
+            }
+        }
+        mechanical_brake_.engage();
+        uint32_t engage_time = HAL_GetTick();
+        while (motor_.is_armed_ && HAL_GetTick() - engage_time < mechanical_brake_.config_.engage_delay) {
+            osDelay(1);
+        }
+    }
     motor_.disarm();
+    if (controller_.config_.load_encoder_axis < AXIS_COUNT) {
+        axes[controller_.config_.load_encoder_axis].encoder_.accel_ff_src_.disconnect();
+    }
     return check_for_errors();
 }
 
@@ -342,8 +907,9 @@ bool Axis::run_closed_loop_control_loop() {
     start_closed_loop_control();
     set_step_dir_active(config_.enable_step_dir);
 
+    // Motor::disarm() and state requests notify us, the timeout is only a fallback
     while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_) {
-        osDelay(1);
+        wait_for_event(100);
     }
 
     set_step_dir_active(config_.enable_step_dir && config_.step_dir_always_on);
@@ -352,9 +918,49 @@ bool Axis::run_closed_loop_control_loop() {
     return check_for_errors();
 }
 
+bool Axis::run_frequency_response() {
+    if (!start_closed_loop_control()) {
+        stop_closed_loop_control();
+        return false;
+    }
+
+    bool success = frequency_response_.run();
+
+    stop_closed_loop_control();
+    return success && check_for_errors();
+}
+
 
-// Slowly drive in the negative direction at homing_speed until the min endstop is pressed
-// When pressed, set the linear count to the offset (default 0), and then go to position 0
+// @brief Switches the running controller to a velocity ramp towards vel.
+void Axis::homing_drive(float vel) {
+    CRITICAL_SECTION() {
+        controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
+        controller_.config_.input_mode = Controller::INPUT_MODE_VEL_RAMP;
+        controller_.input_vel_ = vel;
+    }
+}
+
+// @brief Switches the running controller to a trapezoidal move to pos. The
+// move starts from the current velocity, so it also decelerates the axis.
+void Axis::homing_move_to(float pos) {
+    CRITICAL_SECTION() {
+        controller_.pos_setpoint_ = controller_.pos_estimate_linear_src_.any().value_or(controller_.pos_setpoint_);
+        controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
+        controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
+        controller_.input_pos_ = pos;
+        controller_.input_pos_updated();
+        controller_.trajectory_done_ = false;
+    }
+}
+
+// Drive in the negative direction until the min endstop is pressed.
+// If homing_fast_speed is faster than homing_speed, the endstop is first
+// approached at homing_fast_speed, then the axis backs off by
+// homing_backoff_distance and approaches again at homing_speed.
+// With homing_use_index the axis then moves back out at homing_speed, and the
+// first index pulse is the reference instead of the endstop edge.
+// The reference is set to the min endstop offset (default 0), and then the
+// axis goes to position 0.
 bool Axis::run_homing() {
     Controller::ControlMode stored_control_mode = controller_.config_.control_mode;
     Controller::InputMode stored_input_mode = controller_.config_.input_mode;
@@ -365,53 +971,112 @@ bool Axis::run_homing() {
         return error_ |= ERROR_HOMING_WITHOUT_ENDSTOP, false;
     }
 
+    float dir = controller_.config_.homing_speed < 0.0f ? 1.0f : -1.0f; // towards the endstop
+    float slow_speed = std::abs(controller_.config_.homing_speed);
+    float fast_speed = std::abs(controller_.config_.homing_fast_speed);
+    bool two_stage = fast_speed > slow_speed;
+
     controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
     controller_.config_.input_mode = Controller::INPUT_MODE_VEL_RAMP;
 
+    controller_.input_mailbox_.clear(); // drop commands that were queued before homing
     controller_.input_pos_ = 0.0f;
     controller_.input_pos_updated();
-    controller_.input_vel_ = -controller_.config_.homing_speed;
+    controller_.input_vel_ = dir * (two_stage ? fast_speed : slow_speed);
     controller_.input_torque_ = 0.0f;
 
     homing_.is_homed = false;
 
     start_closed_loop_control();
 
+    auto running = [this]() {
+        return (requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_ && !(error_ & ERROR_HOMING_FAILED);
+    };
+    auto counts_to_turns = [this](int64_t counts) {
+        return (float)counts / (float)encoder_.config_.cpr;
+    };
+
     // Driving toward the endstop
-    while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_ && !min_endstop_.get_state()) {
+    while (running() && !min_endstop_.get_state()) {
         osDelay(1);
     }
 
+    if (two_stage && running()) {
+        // Back off to a point before the press
+        float overshoot = counts_to_turns(encoder_.shadow_count_ - min_endstop_.get_count_when_pressed());
+        float pos = controller_.pos_estimate_linear_src_.any().value_or(0.0f);
+        homing_move_to(pos - overshoot - dir * controller_.config_.homing_backoff_distance);
+        while (running() && !controller_.trajectory_done_) {
+            osDelay(1);
+        }
+        if (min_endstop_.get_state()) {
+            error_ |= ERROR_HOMING_FAILED; // the backoff distance is too short
+        }
+
+        homing_drive(dir * slow_speed);
+        while (running() && !min_endstop_.get_state()) {
+            osDelay(1);
+        }
+    }
+
+    int64_t reference_count = min_endstop_.get_count_when_pressed();
+
+    if (controller_.config_.homing_use_index && running()) {
+        if (!encoder_.arm_index_latch()) {
+            error_ |= ERROR_HOMING_FAILED;
+        }
+        homing_drive(-dir * slow_speed);
+        std::optional<int64_t> index_count;
+        while (running() && !(index_count = encoder_.get_index_latch())) {
+            // An index pulse is expected within one turn after leaving the endstop
+            if (std::abs(counts_to_turns(encoder_.shadow_count_ - reference_count)) > 1.5f) {
+                error_ |= ERROR_HOMING_FAILED;
+            }
+            osDelay(1);
+        }
+        encoder_.disarm_index_latch();
+        reference_count = index_count.value_or(reference_count);
+    }
+
+    bool found = running();
+
     stop_closed_loop_control();
 
-    error_ &= ~ERROR_MIN_ENDSTOP_PRESSED; // clear this error since we deliberately drove into the endstop
+    if (found) {
+        error_ &= ~ERROR_MIN_ENDSTOP_PRESSED; // clear this error since we deliberately drove into the endstop
 
-    // pos_setpoint is the starting position for the trap_traj so we need to set it.
-    controller_.pos_setpoint_ = min_endstop_.config_.offset;
-    controller_.vel_setpoint_ = 0.0f;  // Change directions without decelerating
+        // Everything since the latched reference is overshoot.
+        int64_t overshoot = encoder_.shadow_count_ - reference_count;
+        int32_t offset_count = (int32_t)(min_endstop_.config_.offset * encoder_.config_.cpr);
 
-    // Set our current position in encoder counts to make control more logical
-    encoder_.set_linear_count((int32_t)(controller_.pos_setpoint_ * encoder_.config_.cpr));
+        // pos_setpoint is the starting position for the trap_traj so we need to set it.
+        controller_.pos_setpoint_ = counts_to_turns(offset_count + overshoot);
+        controller_.vel_setpoint_ = 0.0f;  // Change directions without decelerating
 
-    controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
-    controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
+        // Set our current position in encoder counts to make control more logical
+        encoder_.set_linear_count(offset_count + (int32_t)overshoot);
 
-    controller_.input_pos_ = 0.0f;
-    controller_.input_pos_updated();
-    controller_.input_vel_ = 0.0f;
-    controller_.input_torque_ = 0.0f;
+        controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
+        controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
 
-    start_closed_loop_control();
+        controller_.input_mailbox_.clear();
+        controller_.input_pos_ = 0.0f;
+        controller_.input_pos_updated();
+        controller_.input_vel_ = 0.0f;
+        controller_.input_torque_ = 0.0f;
 
-    while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_ && !controller_.trajectory_done_) {
-        osDelay(1);
-    }
+        start_closed_loop_control();
 
-    stop_closed_loop_control();
+        while ((requested_state_ == AXIS_STATE_UNDEFINED) && motor_.is_armed_ && !controller_.trajectory_done_) {
+            osDelay(1);
+        }
+
+        stop_closed_loop_control();
+    }
 
     controller_.config_.control_mode = stored_control_mode;
     controller_.config_.input_mode = stored_input_mode;
-    homing_.is_homed = true;
+    homing_.is_homed = found;
 
     return check_for_errors();
 }
@@ -421,11 +1086,77 @@ bool Axis::run_idle_loop() {
     set_step_dir_active(config_.enable_step_dir && config_.step_dir_always_on);
     while (requested_state_ == AXIS_STATE_UNDEFINED) {
         motor_.setup();
-        osDelay(1);
+        wait_for_event(10); // the timeout retries the gate driver setup if it failed
     }
     return check_for_errors();
 }
 
+// @brief Estimates the DC bus current that a calibration step of this axis
+// draws [A]. The calibrations drive up to calibration_current with at most
+// resistance_calib_max_voltage.
+float Axis::get_calibration_bus_current() {
+    float vbus = std::max(vbus_voltage, 1.0f);
+    return motor_.config_.calibration_current * motor_.config_.resistance_calib_max_voltage / vbus;
+}
+
+// @brief Runs a calibration step once the board's bus current budget allows
+// it and records its duration in calibration_times_.
+template<typename T>
+bool Axis::run_calibration_step(uint32_t& duration, T&& step) {
+    if (calibration_times_reset_) {
+        calibration_times_ = {};
+        calibration_start_ = HAL_GetTick();
+        calibration_times_reset_ = false;
+    }
+
+    uint32_t wait_start = HAL_GetTick();
+    float bus_current = get_calibration_bus_current();
+    while (!odrv.reserve_calibration_current(bus_current)) {
+        if (requested_state_ != AXIS_STATE_UNDEFINED) {
+            return false;
+        }
+        wait_for_event(100); // release_calibration_current() notifies us
+    }
+    uint32_t start = HAL_GetTick();
+    calibration_times_.budget_wait += start - wait_start;
+
+    bool status = step();
+
+    odrv.release_calibration_current(bus_current);
+    uint32_t end = HAL_GetTick();
+    duration = end - start;
+    calibration_times_.total = end - calibration_start_;
+    return status;
+}
+
+/**
+ * @brief Requests a state like `requested_state` and returns the handle of an
+ * operation in `odrv.operations` that completes when the task chain of the
+ * request ends, i.e. when the axis is back in idle. It fails if a state of the
+ * chain failed or another request superseded it. The result is the axis error.
+ * Meant for calibrations, homing and the sequences: a state that runs until
+ * the next request, like closed loop control, only ends by being superseded.
+ * Returns 0 if no operation could be started, in which case nothing is
+ * requested.
+ */
+uint32_t Axis::request_state_async(AxisState state) {
+    uint32_t handle = odrv.operations_.start();
+    if (!handle) {
+        return 0;
+    }
+    uint32_t superseded = 0;
+    CRITICAL_SECTION() {
+        superseded = pending_operation_;
+        pending_operation_ = handle;
+        requested_state_ = state;
+    }
+    if (superseded) {
+        odrv.operations_.finish(superseded, false, error_);
+    }
+    notify_event();
+    return handle;
+}
+
 // Infinite loop that does calibration and enters main control loop as appropriate
 void Axis::run_state_machine_loop() {
     for (;;) {
@@ -435,9 +1166,12 @@ void Axis::run_state_machine_loop() {
             if (requested_state_ == AXIS_STATE_STARTUP_SEQUENCE) {
                 if (config_.startup_motor_calibration)
                     task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
-                if (config_.startup_encoder_index_search && encoder_.config_.use_index)
+                bool startup_index_search = config_.startup_encoder_index_search && encoder_.config_.use_index;
+                if (startup_index_search && config_.startup_encoder_offset_calibration)
+                    task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_AND_OFFSET_CALIBRATION;
+                else if (startup_index_search)
                     task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
-                if (config_.startup_encoder_offset_calibration)
+                else if (config_.startup_encoder_offset_calibration)
                     task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
                 if (config_.startup_homing)
                     task_chain_[pos++] = AXIS_STATE_HOMING;
@@ -456,8 +1190,21 @@ void Axis::run_state_machine_loop() {
             }
             task_chain_[pos++] = AXIS_STATE_UNDEFINED;  // TODO: bounds checking
             requested_state_ = AXIS_STATE_UNDEFINED;
+            calibration_times_reset_ = true;
             // Auto-clear any invalid state error
             error_ &= ~ERROR_INVALID_STATE;
+
+            if (running_operation_) {
+                odrv.operations_.finish(running_operation_, false, error_); // superseded
+            }
+            CRITICAL_SECTION() {
+                running_operation_ = pending_operation_;
+                pending_operation_ = 0;
+            }
+            if (running_operation_ && current_state_ == AXIS_STATE_IDLE) {
+                odrv.operations_.finish(running_operation_, true, error_);
+                running_operation_ = 0;
+            }
         }
 
         // Note that current_state is a reference to task_chain_[0]
@@ -473,7 +1220,8 @@ void Axis::run_state_machine_loop() {
                 // (https://github.com/madcowswe/ODrive/issues/526).
                 if (odrv.any_error())
                     goto invalid_state_label;
-                status = motor_.run_calibration();
+                status = run_calibration_step(calibration_times_.motor_calibration,
+                        [this]() { return motor_.run_calibration(); });
             } break;
 
             case AXIS_STATE_ENCODER_INDEX_SEARCH: {
@@ -482,7 +1230,8 @@ void Axis::run_state_machine_loop() {
                 if (!motor_.is_calibrated_)
                     goto invalid_state_label;
 
-                status = encoder_.run_index_search();
+                status = run_calibration_step(calibration_times_.encoder_index_search,
+                        [this]() { return encoder_.run_index_search(); });
             } break;
 
             case AXIS_STATE_ENCODER_DIR_FIND: {
@@ -491,7 +1240,8 @@ void Axis::run_state_machine_loop() {
                 if (!motor_.is_calibrated_)
                     goto invalid_state_label;
 
-                status = encoder_.run_direction_find();
+                status = run_calibration_step(calibration_times_.encoder_dir_find,
+                        [this]() { return encoder_.run_direction_find(); });
             } break;
 
             case AXIS_STATE_HOMING: {
@@ -505,7 +1255,35 @@ void Axis::run_state_machine_loop() {
                     goto invalid_state_label;
                 if (!motor_.is_calibrated_)
                     goto invalid_state_label;
-                status = encoder_.run_offset_calibration();
+                status = run_calibration_step(calibration_times_.encoder_offset_calibration,
+                        [this]() { return encoder_.config_.calib_fit_enable ? encoder_.run_offset_fit() : encoder_.run_offset_calibration(); });
+            } break;
+
+            case AXIS_STATE_ENCODER_INDEX_AND_OFFSET_CALIBRATION: {
+                if (odrv.any_error())
+                    goto invalid_state_label;
+                if (!motor_.is_calibrated_)
+                    goto invalid_state_label;
+                status = run_calibration_step(calibration_times_.encoder_offset_calibration,
+                        [this]() { return encoder_.run_index_search_and_offset_calibration(); });
+            } break;
+
+            case AXIS_STATE_ENCODER_ECCENTRICITY_CALIBRATION: {
+                if (odrv.any_error())
+                    goto invalid_state_label;
+                if (!motor_.is_calibrated_ || encoder_.config_.direction == 0)
+                    goto invalid_state_label;
+                status = run_calibration_step(calibration_times_.encoder_eccentricity_calibration,
+                        [this]() { return encoder_.run_eccentricity_calibration(); });
+            } break;
+
+            case AXIS_STATE_ENCODER_HALL_EDGE_CALIBRATION: {
+                if (odrv.any_error())
+                    goto invalid_state_label;
+                if (!motor_.is_calibrated_ || encoder_.config_.direction == 0)
+                    goto invalid_state_label;
+                status = run_calibration_step(calibration_times_.encoder_hall_edge_calibration,
+                        [this]() { return encoder_.run_hall_edge_calibration(); });
             } break;
 
             case AXIS_STATE_LOCKIN_SPIN: {
@@ -516,15 +1294,31 @@ void Axis::run_state_machine_loop() {
                 status = run_lockin_spin(config_.general_lockin, false);
             } break;
 
+            case AXIS_STATE_VF_CONTROL: {
+                if (odrv.any_error())
+                    goto invalid_state_label;
+                if (!motor_.is_calibrated_)
+                    goto invalid_state_label;
+                status = run_vf_control();
+            } break;
+
             case AXIS_STATE_CLOSED_LOOP_CONTROL: {
                 if (odrv.any_error())
                     goto invalid_state_label;
                 if (!motor_.is_calibrated_ || (encoder_.config_.direction==0 && !config_.enable_sensorless_mode))
                     goto invalid_state_label;
-                watchdog_feed();
+                watchdog_reset();
                 status = run_closed_loop_control_loop();
             } break;
 
+            case AXIS_STATE_FREQUENCY_RESPONSE: {
+                if (odrv.any_error())
+                    goto invalid_state_label;
+                if (!motor_.is_calibrated_ || (encoder_.config_.direction==0 && !config_.enable_sensorless_mode))
+                    goto invalid_state_label;
+                status = run_frequency_response();
+            } break;
+
             case AXIS_STATE_IDLE: {
                 run_idle_loop();
                 status = true;
@@ -545,5 +1339,11 @@ void Axis::run_state_machine_loop() {
             std::rotate(task_chain_.begin(), task_chain_.begin() + 1, task_chain_.end());
             task_chain_.back() = AXIS_STATE_UNDEFINED;
         }
+        if (running_operation_ && (!status || current_state_ == AXIS_STATE_IDLE)) {
+            // A state that was left for a new request doesn't count as done
+            bool success = status && requested_state_ == AXIS_STATE_UNDEFINED;
+            odrv.operations_.finish(running_operation_, success, error_);
+            running_operation_ = 0;
+        }
     }
 }
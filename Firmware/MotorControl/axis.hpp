@@ -2,9 +2,13 @@
 #define __AXIS_HPP
 
 class Axis;
+class Stm32StepCounter;
 
 #include "encoder.hpp"
 #include "acim_estimator.hpp"
+#include "encoder_fusion.hpp"
+#include "filter_bank.hpp"
+#include "frequency_response.hpp"
 #include "sensorless_estimator.hpp"
 #include "controller.hpp"
 #include "open_loop_controller.hpp"
@@ -14,11 +18,27 @@ class Axis;
 #include "low_level.h"
 #include "utils.hpp"
 #include "task_timer.hpp"
+#include "endpoint_source.hpp"
 
 #include <array>
 
+// Signals of the axis thread
+#define AXIS_SIGNAL_CONTROL_ITERATION 0x0001 // only sent while the thread is in wait_for_control_iteration()
+#define AXIS_SIGNAL_EVENT 0x0002 // state request, disarm or released calibration budget
+
+#define CAN_CYCLIC_FRAME_COUNT 2
+#define CAN_CYCLIC_FRAME_MAX_SIGNALS 4
+
 class Axis : public ODriveIntf::AxisIntf {
 public:
+    // Command channels with a watchdog of their own, see Config_t::watchdog_can_timeout
+    enum WatchdogChannel {
+        WATCHDOG_CHANNEL_CAN,
+        WATCHDOG_CHANNEL_UART,
+        WATCHDOG_CHANNEL_USB,
+        WATCHDOG_CHANNEL_COUNT
+    };
+
     struct LockinConfig_t {
         float current = 10.0f;           // [A]
         float ramp_time = 0.4f;          // [s]
@@ -31,13 +51,26 @@ public:
         bool finish_on_enc_idx = false;
     };
 
+    // Open loop V/f control, see run_vf_control()
+    struct VfConfig_t {
+        float boost_voltage = 0.5f; // [V] at standstill, for the voltage drop of the stator resistance
+        float rated_voltage = 12.0f; // [V] at the rated frequency and above
+        float rated_freq = 50.0f; // [Hz] electrical
+        float accel = 10.0f; // [Hz/s] electrical
+        float decel = 10.0f; // [Hz/s] electrical
+        float slip_comp = 0.0f; // [Hz/A] electrical slip per A of torque producing current, 0 to disable
+        float slip_comp_time_constant = 0.1f; // [s]
+    };
+
     struct TaskTimes {
         TaskTimer thermistor_update;
         TaskTimer encoder_update;
-        TaskTimer sensorless_estimator_update;
+        TaskTimer encoder_fusion_update;
         TaskTimer endstop_update;
         TaskTimer can_heartbeat;
+        TaskTimer vel_filter_update;
         TaskTimer controller_update;
+        TaskTimer torque_filter_update;
         TaskTimer open_loop_controller_update;
         TaskTimer acim_estimator_update;
         TaskTimer motor_update;
@@ -47,15 +80,55 @@ public:
         TaskTimer pwm_update;
     };
 
+    // Durations of the calibration steps since the last request [ms]
+    struct CalibrationTimes {
+        uint32_t motor_calibration;
+        uint32_t encoder_index_search;
+        uint32_t encoder_dir_find;
+        uint32_t encoder_offset_calibration;
+        uint32_t encoder_eccentricity_calibration;
+        uint32_t encoder_hall_edge_calibration;
+        uint32_t budget_wait; // waiting for other axes to leave enough of the bus current budget
+        uint32_t total; // from the start of the first step until the end of the last one
+    };
+
+    /**
+     * @brief One stage of the per-axis control loop pipeline.
+     *
+     * The pipeline is rebuilt by update_control_pipeline() whenever the
+     * configuration changes so that stages which don't apply to the current
+     * configuration are not run at all.
+     */
+    struct ControlStage {
+        void (*update)(Axis& axis, uint32_t timestamp);
+        TaskTimer* timer; // can be nullptr if the stage measures itself
+    };
+
     static LockinConfig_t default_calibration();
     static LockinConfig_t default_sensorless();
     static LockinConfig_t default_lockin();
 
+    // A frame that is sent every rate_ms with the values of up to
+    // CAN_CYCLIC_FRAME_MAX_SIGNALS properties, packed in order. A signal with
+    // a scale of 0 takes 4 bytes as float, any other takes 2 bytes as int16
+    // multiple of the scale. Signals that don't fit into 8 bytes are left out.
+    struct CANCyclicFrame_t {
+        uint32_t cmd_id = 0;
+        uint32_t rate_ms = 0; // 0 to disable
+        uint32_t num_signals = 0;
+        endpoint_ref_t signals[CAN_CYCLIC_FRAME_MAX_SIGNALS];
+        float scales[CAN_CYCLIC_FRAME_MAX_SIGNALS] = {};
+    };
+
     struct CANConfig_t {
         uint32_t node_id = 0;
         bool is_extended = false;
         uint32_t heartbeat_rate_ms = 100;
         uint32_t encoder_rate_ms = 10;
+        bool sync_mode = false; // hold inputs back until SYNC, send the estimates after SYNC
+        CANCyclicFrame_t cyclic_frames[CAN_CYCLIC_FRAME_COUNT] = {
+            {0x01A}, {0x01B}
+        };
     };
 
     struct Config_t {
@@ -73,12 +146,20 @@ public:
                                          //<! This setting only takes effect on a state transition
                                          //<! into idle or out of closed loop control.
 
-        bool enable_sensorless_mode = false;
+        bool enable_sensorless_mode = false; //<! Changing this rebuilds the control pipeline
 
         float turns_per_step = 1.0f / 1024.0f;
+        float step_vel_ff_bandwidth = 0.0f; //<! [rad/s] filter of the velocity feedforward from the step rate, 0 to disable
 
         float watchdog_timeout = 0.0f; // [s]
         bool enable_watchdog = false;
+        float watchdog_can_timeout = 0.0f; // [s] 0 to disable
+        float watchdog_uart_timeout = 0.0f; // [s] 0 to disable
+        float watchdog_usb_timeout = 0.0f; // [s] 0 to disable (ASCII protocol only)
+        bool watchdog_decel_stop = false; //<! Decelerate at trap_traj.config.decel_limit on expiry instead of disarming immediately
+
+        uint32_t controller_decimation = 1; //<! run the controller every n-th control loop iteration
+        uint32_t thermistor_decimation = 80; //<! update the thermistors every n-th control loop iteration
 
         // Defaults loaded from hw_config in load_configuration in main.cpp
         uint16_t step_gpio_pin = 0;
@@ -87,6 +168,7 @@ public:
         LockinConfig_t calibration_lockin = default_calibration();
         LockinConfig_t sensorless_ramp = default_sensorless();
         LockinConfig_t general_lockin;
+        VfConfig_t vf;
 
         CANConfig_t can;
 
@@ -94,6 +176,8 @@ public:
         Axis* parent = nullptr;
         void set_step_gpio_pin(uint16_t value) { step_gpio_pin = value; parent->decode_step_dir_pins(); }
         void set_dir_gpio_pin(uint16_t value) { dir_gpio_pin = value; parent->decode_step_dir_pins(); }
+        void set_enable_sensorless_mode(bool value) { enable_sensorless_mode = value; parent->update_control_pipeline(); }
+        void set_controller_decimation(uint32_t value) { controller_decimation = value; parent->update_control_pipeline(); }
     };
 
     struct Homing_t {
@@ -103,6 +187,17 @@ public:
     struct CAN_t {
         uint32_t last_heartbeat = 0;
         uint32_t last_encoder = 0;
+        // Inputs that are held back until the next SYNC message in sync mode
+        std::optional<float> sync_input_pos;
+        std::optional<float> sync_input_vel;
+        std::optional<float> sync_input_torque;
+        volatile bool sync_pending = false; // send the estimates on the next control tick
+        // Signals of the cyclic frames, resolved when their endpoint changes
+        struct {
+            uint32_t last_sent = 0;
+            endpoint_ref_t endpoints[CAN_CYCLIC_FRAME_MAX_SIGNALS];
+            EndpointSource sources[CAN_CYCLIC_FRAME_MAX_SIGNALS];
+        } cyclic_frames[CAN_CYCLIC_FRAME_COUNT];
     };
 
     Axis(int axis_num,
@@ -120,11 +215,23 @@ public:
 
     bool apply_config();
     void clear_config();
+    void apply_dirty_config();
+
+    void update_control_pipeline();
+    void run_sensor_stages(uint32_t timestamp);
+    void run_control_stages(uint32_t timestamp);
 
     void start_thread();
     bool wait_for_control_iteration();
+    void wait_for_event(uint32_t timeout_ms);
+    void notify_event();
+    void request_state(AxisState state) { requested_state_ = state; notify_event(); }
+    uint32_t request_state_async(AxisState state);
 
     void step_cb();
+    void dir_cb();
+    void accumulate_steps();
+    void update_step_dir();
     void set_step_dir_active(bool enable);
     void decode_step_dir_pins();
 
@@ -133,6 +240,8 @@ public:
     bool do_checks(uint32_t timestamp);
 
     void watchdog_feed();
+    void watchdog_feed(WatchdogChannel channel);
+    void watchdog_reset();
     bool watchdog_check();
 
     // True if there are no errors
@@ -143,12 +252,31 @@ public:
     bool start_closed_loop_control();
     bool stop_closed_loop_control();
     bool run_lockin_spin(const LockinConfig_t &lockin_config, bool remain_armed);
+    bool run_vf_control();
+    bool run_hfi_startup();
+    bool wait_for_sensorless_sync();
     bool run_closed_loop_control_loop();
     bool run_homing();
+    void homing_drive(float vel);
+    void homing_move_to(float pos);
+    bool run_frequency_response();
     bool run_idle_loop();
+    float get_calibration_bus_current();
+    template<typename T> bool run_calibration_step(uint32_t& duration, T&& step);
 
+    static constexpr uint32_t get_watchdog_reset(float timeout) {
+        return static_cast<uint32_t>(std::clamp<float>(timeout, 0, UINT32_MAX / (current_meas_hz + 1)) * current_meas_hz);
+    }
     constexpr uint32_t get_watchdog_reset() {
-        return static_cast<uint32_t>(std::clamp<float>(config_.watchdog_timeout, 0, UINT32_MAX / (current_meas_hz + 1)) * current_meas_hz);
+        return get_watchdog_reset(config_.watchdog_timeout);
+    }
+    float get_watchdog_timeout(WatchdogChannel channel) {
+        switch (channel) {
+            case WATCHDOG_CHANNEL_CAN: return config_.watchdog_can_timeout;
+            case WATCHDOG_CHANNEL_UART: return config_.watchdog_uart_timeout;
+            case WATCHDOG_CHANNEL_USB: return config_.watchdog_usb_timeout;
+            default: return 0.0f;
+        }
     }
 
     void run_state_machine_loop();
@@ -162,6 +290,10 @@ public:
 
     Encoder& encoder_;
     AcimEstimator acim_estimator_;
+    EncoderFusion encoder_fusion_;
+    FilterBank vel_filter_; // between the velocity estimate and the controller
+    FilterBank torque_filter_; // between the controller and the motor
+    FrequencyResponse frequency_response_;
     SensorlessEstimator& sensorless_estimator_;
     Controller& controller_;
     OpenLoopController open_loop_controller_;
@@ -171,20 +303,44 @@ public:
     Endstop& max_endstop_;
     MechanicalBrake& mechanical_brake_;
     TaskTimes task_times_;
+    CalibrationTimes calibration_times_ = {};
+    uint32_t calibration_start_ = 0; // [ms] HAL tick at the start of the first calibration step
+    bool calibration_times_reset_ = false; // set by a new request, clears the times on the next step
+
+    // Sensor stages of all axes run before the control stages of any axis
+    // because a controller might use the encoder estimate of the other axis.
+    std::array<ControlStage, 2> sensor_stages_;
+    size_t n_sensor_stages_ = 0;
+    std::array<ControlStage, 8> control_stages_;
+    size_t n_control_stages_ = 0;
+    uint32_t controller_decimation_ = 1;
+    uint32_t controller_countdown_ = 0; // number of iterations until the controller runs next
+    uint32_t thermistor_countdown_ = 0; // number of iterations until the thermistors are updated next
+    bool vf_control_active_ = false; // the control pipeline skips the closed loop stages
 
     osThreadId thread_id_ = 0;
     const uint32_t stack_size_ = 2048; // Bytes
     volatile bool thread_id_valid_ = false;
+    volatile bool control_iteration_subscribed_ = false;
 
     // variables exposed on protocol
     Error error_ = ERROR_NONE;
     bool step_dir_active_ = false; // auto enabled after calibration, based on config.enable_step_dir
 
+    // Hardware step counting, used if the step GPIO is in GPIO_MODE_STEP_COUNTER
+    Stm32StepCounter* step_counter_ = nullptr; // set while active
+    uint16_t step_count_ = 0; // step counter value at the last accumulate_steps()
+    int32_t pending_steps_ = 0; // signed steps (of either step source) that the control loop didn't take yet
+    bool step_dir_ = true; // level of the dir GPIO
+    float step_vel_ = 0.0f; // [turn/s] filtered step rate
+
     // updated from config in constructor, and on protocol hook
     Stm32Gpio step_gpio_;
     Stm32Gpio dir_gpio_;
 
     AxisState requested_state_ = AXIS_STATE_STARTUP_SEQUENCE;
+    volatile uint32_t pending_operation_ = 0; // handle for the next requested_state_, see request_state_async()
+    uint32_t running_operation_ = 0; // handle of the task chain that is running
     std::array<AxisState, 10> task_chain_ = { AXIS_STATE_UNDEFINED };
     AxisState& current_state_ = task_chain_.front();
     uint32_t loop_counter_ = 0;
@@ -194,6 +350,8 @@ public:
 
     // watchdog
     uint32_t watchdog_current_value_= 0;
+    uint32_t channel_watchdog_[WATCHDOG_CHANNEL_COUNT] = {}; // [control loop iterations] left until expiry
+    uint8_t watchdog_expired_channels_ = 0; // bit i is set if channel i expired since the last watchdog_reset()
 };
 
 
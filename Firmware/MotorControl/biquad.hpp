@@ -0,0 +1,91 @@
+#ifndef __BIQUAD_HPP
+#define __BIQUAD_HPP
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Coefficients of a second order IIR filter section
+ *   H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+ *
+ * The designers use the bilinear transform with frequency prewarping (see the
+ * "Audio EQ Cookbook" by R. Bristow-Johnson). Frequencies are limited to just
+ * below the Nyquist frequency so that the result is always stable.
+ */
+struct Biquad {
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+
+    static Biquad low_pass(float freq, float q, float sample_rate) {
+        float w0 = omega(freq, sample_rate);
+        float cos_w0 = std::cos(w0);
+        float alpha = std::sin(w0) / (2.0f * q);
+        float a0 = 1.0f + alpha;
+        float b = (1.0f - cos_w0) / (2.0f * a0);
+        return {b, 2.0f * b, b, -2.0f * cos_w0 / a0, (1.0f - alpha) / a0};
+    }
+
+    static Biquad notch(float freq, float q, float sample_rate) {
+        float w0 = omega(freq, sample_rate);
+        float cos_w0 = std::cos(w0);
+        float alpha = std::sin(w0) / (2.0f * q);
+        float a0 = 1.0f + alpha;
+        return {1.0f / a0, -2.0f * cos_w0 / a0, 1.0f / a0, -2.0f * cos_w0 / a0, (1.0f - alpha) / a0};
+    }
+
+    /**
+     * @brief First order lead-lag H(s) = (1 + s/wz) / (1 + s/wp) with unity
+     * gain at DC. It is a lead compensator if the zero is below the pole and
+     * a lag compensator otherwise.
+     */
+    static Biquad lead_lag(float zero_freq, float pole_freq, float sample_rate) {
+        // Each corner frequency is prewarped so that it ends up at the
+        // requested frequency after the bilinear transform.
+        float k = 1.0f / std::tan(omega(zero_freq, sample_rate) / 2.0f);
+        float l = 1.0f / std::tan(omega(pole_freq, sample_rate) / 2.0f);
+        float a0 = 1.0f + l;
+        return {(1.0f + k) / a0, (1.0f - k) / a0, 0.0f, (1.0f - l) / a0, 0.0f};
+    }
+
+    // DC gain (b0 + b1 + b2) / (1 + a1 + a2)
+    float dc_gain() const {
+        return (b0 + b1 + b2) / (1.0f + a1 + a2);
+    }
+
+private:
+    static float omega(float freq, float sample_rate) {
+        return 2.0f * (float)M_PI * std::clamp(freq / sample_rate, 1e-6f, 0.49f);
+    }
+};
+
+/**
+ * @brief State of one Biquad section (direct form II transposed).
+ */
+struct BiquadState {
+    float z1 = 0.0f;
+    float z2 = 0.0f;
+
+    float update(const Biquad& c, float x) {
+        float y = c.b0 * x + z1;
+        z1 = c.b1 * x - c.a1 * y + z2;
+        z2 = c.b2 * x - c.a2 * y;
+        return y;
+    }
+
+    /**
+     * @brief Sets the state that the section has after a constant input x
+     * for a long time, so that starting the filter causes no transient.
+     * Returns the output for that input.
+     */
+    float settle(const Biquad& c, float x) {
+        float y = c.dc_gain() * x;
+        z1 = y - c.b0 * x;
+        z2 = c.b2 * x - c.a2 * y;
+        return y;
+    }
+};
+
+#endif // __BIQUAD_HPP
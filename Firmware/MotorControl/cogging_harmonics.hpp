@@ -0,0 +1,121 @@
+#ifndef __COGGING_HARMONICS_HPP
+#define __COGGING_HARMONICS_HPP
+
+#include <cmath>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief One term of a Fourier series over one mechanical turn:
+ *   torque(pos) = cos_coeff * cos(2pi * order * pos) + sin_coeff * sin(2pi * order * pos)
+ */
+struct CoggingHarmonic {
+    uint32_t order; // [1/turn]
+    float cos_coeff; // [Nm]
+    float sin_coeff; // [Nm]
+};
+
+/**
+ * @brief Evaluates a lookup table that holds one period of a function with
+ * linear interpolation.
+ *
+ * @param sample_offset: Position of the first sample [fraction of a LUT bin].
+ * @param pos: Position [fraction of the period] in [0, 1)
+ */
+inline float lut_interpolate(const float* lut, size_t size, float sample_offset, float pos) {
+    float x = pos * (float)size - sample_offset;
+    float x_floor = std::floor(x);
+    float frac = x - x_floor;
+    int i = (int)x_floor;
+    size_t i0 = (size_t)((i % (int)size + (int)size) % (int)size);
+    size_t i1 = (i0 + 1 == size) ? 0 : (i0 + 1);
+    return lut[i0] + frac * (lut[i1] - lut[i0]);
+}
+
+/**
+ * @brief Finds the strongest harmonics of a cogging map with a DFT.
+ *
+ * The DFT is computed one order per call to step() so that it can run in a
+ * low priority context without blocking it for long. The result is kept
+ * sorted by decreasing magnitude and only becomes valid once step() returned
+ * true.
+ */
+class CoggingHarmonicFit {
+public:
+    /**
+     * @param map: Samples of one turn. Must stay valid until the fit is done.
+     * @param sample_offset: Position of the first sample [fraction of one
+     *        sample spacing].
+     * @param out: Storage for up to max_count harmonics.
+     */
+    void start(const float* map, size_t size, float sample_offset, CoggingHarmonic* out, size_t max_count) {
+        map_ = map;
+        size_ = size;
+        sample_offset_ = sample_offset;
+        out_ = out;
+        max_count_ = max_count;
+        count_ = 0;
+        order_ = 0;
+    }
+
+    /**
+     * @brief Fits the next order. Returns true when all orders below the
+     * Nyquist frequency were fitted (or no fit was started).
+     */
+    bool step() {
+        if (!map_ || order_ >= size_ / 2) {
+            return true;
+        }
+
+        // Rotating phasor: exp(j * 2pi * order * (n + sample_offset) / size)
+        float step_angle = 2.0f * (float)M_PI * (float)order_ / (float)size_;
+        float step_c = std::cos(step_angle);
+        float step_s = std::sin(step_angle);
+        float c = std::cos(step_angle * sample_offset_);
+        float s = std::sin(step_angle * sample_offset_);
+        float sum_c = 0.0f;
+        float sum_s = 0.0f;
+        for (size_t n = 0; n < size_; ++n) {
+            sum_c += map_[n] * c;
+            sum_s += map_[n] * s;
+            float c_next = c * step_c - s * step_s;
+            s = s * step_c + c * step_s;
+            c = c_next;
+        }
+
+        float scale = (order_ == 0 ? 1.0f : 2.0f) / (float)size_;
+        insert({(uint32_t)order_, sum_c * scale, sum_s * scale});
+
+        return ++order_ >= size_ / 2;
+    }
+
+    size_t count() const { return count_; }
+
+private:
+    static float magnitude(const CoggingHarmonic& h) {
+        return h.cos_coeff * h.cos_coeff + h.sin_coeff * h.sin_coeff;
+    }
+
+    void insert(CoggingHarmonic h) {
+        size_t i = count_ < max_count_ ? count_++ : max_count_;
+        while (i > 0 && magnitude(out_[i - 1]) < magnitude(h)) {
+            if (i < max_count_) {
+                out_[i] = out_[i - 1];
+            }
+            --i;
+        }
+        if (i < max_count_) {
+            out_[i] = h;
+        }
+    }
+
+    const float* map_ = nullptr;
+    size_t size_ = 0;
+    float sample_offset_ = 0.0f;
+    CoggingHarmonic* out_ = nullptr;
+    size_t max_count_ = 0;
+    size_t count_ = 0;
+    size_t order_ = 0;
+};
+
+#endif // __COGGING_HARMONICS_HPP
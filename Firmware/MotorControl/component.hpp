@@ -3,7 +3,6 @@
 
 #include <stdint.h>
 #include <optional>
-#include <variant>
 
 class ComponentBase {
 public:
@@ -20,6 +19,18 @@ public:
 };
 
 
+/**
+ * @brief Number of the current control loop iteration.
+ * 
+ * Incremented once at the beginning of every control loop iteration. Output
+ * ports compare against this to determine the freshness of their values so
+ * there is no need to reset them individually.
+ * This will eventually overflow so present() could theoretically return a very
+ * old value however it is very likely that the motor will be long disarmed by
+ * then.
+ */
+inline uint32_t control_loop_epoch = 0;
+
 template<typename T>
 class InputPort;
 
@@ -27,10 +38,11 @@ class InputPort;
  * @brief An output port stores a value for consumption by a connecting input
  * port.
  * 
- * Output ports are supposed to be reset at the beginning of a control loop
- * iteration. This ensures that connecting input ports don't use an outdated
- * value and, more importantly, ensures proper handling if the producer of the
- * value is incapable of producing the value for any reason.
+ * Each value is tagged with the control loop iteration (see
+ * control_loop_epoch) during which it was set. This ensures that connecting
+ * input ports don't use an outdated value and, more importantly, ensures proper
+ * handling if the producer of the value is incapable of producing the value for
+ * any reason.
  * 
  * Member functions of this class are not thread-safe unless noted otherwise.
  */
@@ -51,19 +63,7 @@ public:
      */
     void operator=(T value) {
         content_ = value;
-        age_ = 0;
-    }
-
-    /**
-     * @brief Marks the contained value as outdated. The value is not actually
-     * deleted and can still be accessed through some of the member functions
-     * of this class.
-     */
-    void reset() {
-        // This will eventually overflow to 0 so present() could
-        // theoretically return a very old value however it is very likely that
-        // the motor will be long disarmed by then.
-        age_++;
+        epoch_ = control_loop_epoch;
     }
 
     /**
@@ -71,7 +71,7 @@ public:
      * if the value was not yet set during this control loop iteration.
      */
     std::optional<T> present() {
-        if (age_ == 0) {
+        if (epoch_ == control_loop_epoch) {
             return content_;
         } else {
             return std::nullopt;
@@ -86,7 +86,7 @@ public:
      * std::nullopt.
      */
     std::optional<T> previous() {
-        if (age_ == 1) {
+        if (epoch_ + 1 == control_loop_epoch) {
             return content_;
         } else {
             return std::nullopt;
@@ -104,7 +104,9 @@ public:
     }
     
 private:
-    uint32_t age_ = 2; // Age in number of control loop iterations
+    friend class InputPort<T>;
+
+    uint32_t epoch_ = control_loop_epoch - 2; // Control loop iteration during which the value was set
     T content_;
 };
 
@@ -112,38 +114,40 @@ private:
  * @brief An input port provides a value from the source to which it's configured.
  * 
  * The source can be one of:
- *  - an internally stored value
+ *  - the default value T{} (before the first connect_to())
  *  - an externally stored value (referenced by a pointer)
  *  - an external OutputPort (referenced by a pointer)
  *  - none (all queries will return std::nullopt)
  * 
+ * The source is resolved when it is connected, to a pointer to its value and,
+ * for OutputPorts, a pointer to its epoch. So reading the port doesn't need
+ * to dispatch on the kind of the source.
+ * 
  * Member functions of this class are not thread-safe unless otherwise noted.
  */
 template<typename T>
 class InputPort {
 public:
     void connect_to(OutputPort<T>* input_port) {
-        content_ = input_port;
+        value_ = input_port ? &input_port->content_ : nullptr;
+        epoch_ = input_port ? &input_port->epoch_ : nullptr;
     }
 
     void connect_to(T* input_ptr) {
-        content_ = input_ptr;
+        value_ = input_ptr;
+        epoch_ = nullptr;
     }
 
     void disconnect() {
-        content_ = (OutputPort<T>*)nullptr;
+        value_ = nullptr;
+        epoch_ = nullptr;
     }
 
     std::optional<T> present() {
-        if (content_.index() == 2) {
-            OutputPort<T>* ptr = std::get<2>(content_);
-            return ptr ? ptr->present() : std::nullopt;
-        } else if (content_.index() == 1) {
-            T* ptr = std::get<1>(content_);
-            return ptr ? std::make_optional(*ptr) : std::nullopt;
-        } else {
-            return std::get<0>(content_);
+        if (!value_ || (epoch_ && *epoch_ != control_loop_epoch)) {
+            return std::nullopt;
         }
+        return *value_;
     }
 
     // TODO: probably it makes sense to let the application define that it's
@@ -151,31 +155,21 @@ public:
     // This would provide a general way to resolve same-iteration data path cycles.
 
     //std::optional<T> previous() {
-    //    if (content_.index() == 2) {
-    //        OutputPort<T>* ptr = std::get<2>(content_);
-    //        return ptr ? ptr->previous() : std::nullopt;
-    //    } else if (content_.index() == 1) {
-    //        T* ptr = std::get<1>(content_);
-    //        return ptr ? std::make_optional(*ptr) : std::nullopt;
-    //    } else {
-    //        return std::get<0>(content_);
+    //    if (!value_ || (epoch_ && *epoch_ + 1 != control_loop_epoch)) {
+    //        return std::nullopt;
     //    }
+    //    return *value_;
     //}
 
     std::optional<T> any() {
-        if (content_.index() == 2) {
-            OutputPort<T>* ptr = std::get<2>(content_);
-            return ptr ? ptr->any() : std::nullopt;
-        } else if (content_.index() == 1) {
-            T* ptr = std::get<1>(content_);
-            return ptr ? std::make_optional(*ptr) : std::nullopt;
-        } else {
-            return std::get<0>(content_);
-        }
+        return value_ ? std::make_optional(*value_) : std::nullopt;
     }
     
 private:
-    std::variant<T, T*, OutputPort<T>*> content_;
+    static inline const T default_value_{};
+
+    const T* value_ = &default_value_; // nullptr if disconnected
+    const uint32_t* epoch_ = nullptr; // nullptr if the value is always present
 };
 
 
@@ -1,21 +1,55 @@
 
-#include "odrive_main.h"
+#include <odrive_main.h>
 #include <algorithm>
+#include <atomic>
 
 bool Controller::apply_config() {
     config_.parent = this;
     update_filter_gains();
+    update_gain_schedule();
     return true;
 }
 
+/**
+ * @brief Recomputes the derived quantities that the config setters marked as
+ * out of date. Called by the control loop before the sensor stages.
+ */
+void Controller::apply_dirty_config() {
+    uint32_t dirty = dirty_.take();
+    if (dirty & DIRTY_FILTER_GAINS) {
+        update_filter_gains();
+    }
+    if (dirty & DIRTY_GAIN_SCHEDULE) {
+        update_gain_schedule();
+    }
+}
+
 void Controller::reset() {
     pos_setpoint_ = 0.0f;
     vel_setpoint_ = 0.0f;
     vel_integrator_torque_ = 0.0f;
     torque_setpoint_ = 0.0f;
+    fast_stop_active_ = false;
+    state_feedback_.reset();
+}
+
+void Controller::start_fast_stop(float decel) {
+    if (fast_stop_active_) {
+        return;
+    }
+    // In torque control the velocity setpoint doesn't follow the motion
+    std::optional<float> vel_estimate = vel_estimate_src_.present();
+    fast_stop_vel_ = config_.control_mode >= CONTROL_MODE_VELOCITY_CONTROL
+            ? vel_setpoint_ : vel_estimate.value_or(0.0f);
+    fast_stop_pos_ = pos_setpoint_;
+    fast_stop_decel_ = decel;
+    fast_stop_active_ = true;
 }
 
 void Controller::set_error(Error error) {
+    if (Error new_errors = error & ~error_) {
+        event_log.record(EventLog::SOURCE_CONTROLLER, axis_->axis_num_, new_errors);
+    }
     error_ |= error;
 }
 
@@ -23,8 +57,58 @@ void Controller::set_error(Error error) {
 // Command Handling
 //--------------------------------
 
+/**
+ * @brief Queues a setpoint update for the next controller iteration.
+ *
+ * This must be called from thread context, not from an interrupt. Partial
+ * updates that are posted before the controller picks them up are combined.
+ */
+void Controller::set_input(std::optional<float> pos, std::optional<float> vel, std::optional<float> torque) {
+    // The scheduler is suspended to serialize concurrent writers (USB, UART,
+    // CAN). Interrupts stay enabled so the control loop is never delayed.
+    osThreadSuspendAll();
+    input_mailbox_.post([&](InputCommand& cmd) {
+        if (pos.has_value()) {
+            cmd.pos = pos;
+            cmd.pos_increment.reset();
+        }
+        if (vel.has_value())
+            cmd.vel = vel;
+        if (torque.has_value())
+            cmd.torque = torque;
+    });
+    osThreadResumeAll();
+}
+
+void Controller::apply_input_command() {
+    std::optional<InputCommand> cmd = input_mailbox_.fetch();
+    if (!cmd.has_value()) {
+        return;
+    }
+    if (cmd->pos.has_value()) {
+        input_pos_ = *cmd->pos;
+        input_pos_updated();
+    } else if (cmd->pos_increment.has_value()) {
+        input_pos_ = (cmd->increment_from_setpoint ? pos_setpoint_ : input_pos_) + *cmd->pos_increment;
+        input_pos_updated();
+    }
+    if (cmd->vel.has_value())
+        input_vel_ = *cmd->vel;
+    if (cmd->torque.has_value())
+        input_torque_ = *cmd->torque;
+}
+
 
 void Controller::move_to_pos(float goal_point) {
+    if (config_.input_mode == INPUT_MODE_SCURVE_TRAJ) {
+        trajectory_done_ = !scurve_traj_.plan(goal_point, pos_setpoint_, vel_setpoint_,
+                                              axis_->trap_traj_.config_.vel_limit,
+                                              axis_->trap_traj_.config_.accel_limit,
+                                              axis_->trap_traj_.config_.decel_limit,
+                                              axis_->trap_traj_.config_.jerk_limit);
+        scurve_traj_.t_ = 0.0f;
+        return;
+    }
     axis_->trap_traj_.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_,
                                  axis_->trap_traj_.config_.vel_limit,
                                  axis_->trap_traj_.config_.accel_limit,
@@ -33,38 +117,222 @@ void Controller::move_to_pos(float goal_point) {
     trajectory_done_ = false;
 }
 
-void Controller::move_incremental(float displacement, bool from_input_pos = true){
-    if(from_input_pos){
-        input_pos_ += displacement;
-    } else{
-        input_pos_ = pos_setpoint_ + displacement;
+/**
+ * @brief Starts a trapezoidal move with the given limits instead of the
+ * ones in trap_traj.config. Called by the control loop for all axes of a
+ * coordinated move (see ODrive::move_coordinated()).
+ */
+void Controller::start_coordinated_move(float goal_point, float vel_limit, float accel_limit, float decel_limit) {
+    config_.input_mode = INPUT_MODE_TRAP_TRAJ;
+    config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+    input_pos_ = goal_point;
+    input_pos_updated_ = false;
+    axis_->trap_traj_.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_,
+                                      vel_limit, accel_limit, decel_limit);
+    axis_->trap_traj_.t_ = 0.0f;
+    trajectory_done_ = false;
+}
+
+/**
+ * @brief Appends a point to the trajectory that INPUT_MODE_PVT plays back.
+ * Returns false if the buffer is full or in use by queued moves.
+ */
+bool Controller::push_pvt_point(float duration, float pos, float vel, float torque) {
+    if (moves_planned_ || move_queue_.level() > 0) {
+        return false;
+    }
+    return pvt_buffer_.push({duration, pos, vel, torque});
+}
+
+/**
+ * @brief Plans the moves of queue_move() into the INPUT_MODE_PVT buffer.
+ *
+ * Runs in the move planner thread. Only the next two moves or so are planned
+ * ahead, so that waypoints which are queued while the axis moves can still
+ * raise the velocity at the waypoints in front of them.
+ */
+void Controller::plan_moves() {
+    if (config_.input_mode != INPUT_MODE_PVT) {
+        return;
     }
 
-    input_pos_updated();
+    if (move_queue_.handle_clear_request()) {
+        pvt_buffer_.request_clear();
+        return; // the buffer is empty by the next call
+    }
+
+    if (pvt_buffer_.level() == 0) {
+        // Continue from where the playback stopped
+        planned_pos_ = pos_setpoint_;
+        planned_vel_ = 0.0f;
+        moves_planned_ = false;
+    }
+
+    constexpr size_t kMaxPoints = MoveQueue<MOVE_QUEUE_SIZE>::kMaxPoints;
+    size_t horizon = std::min(pvt_buffer_.capacity(), 2 * kMaxPoints);
+    MoveQueue<MOVE_QUEUE_SIZE>::Limits limits = {
+        axis_->trap_traj_.config_.vel_limit,
+        axis_->trap_traj_.config_.accel_limit,
+        axis_->trap_traj_.config_.decel_limit
+    };
+    while (pvt_buffer_.level() + kMaxPoints <= horizon) {
+        PvtPoint points[kMaxPoints];
+        size_t n = move_queue_.plan_next(&planned_pos_, &planned_vel_, limits, points);
+        if (n == 0) {
+            break;
+        }
+        moves_planned_ = true;
+        for (size_t i = 0; i < n; ++i) {
+            pvt_buffer_.push(points[i]);
+        }
+    }
+}
+
+/**
+ * @brief Sets the slave position of point `index` of the INPUT_MODE_CAM table.
+ * The table can be changed while the cam runs.
+ */
+bool Controller::set_cam_point(uint32_t index, float pos) {
+    if (index >= CAM_TABLE_SIZE) {
+        return false;
+    }
+    config_.cam_table[index] = pos;
+    return true;
+}
+
+bool Controller::autotune(float bandwidth, float phase_margin) {
+    FrequencyResponse& fr = axis_->frequency_response_;
+    if (fr.result_target_ != FrequencyResponse::EXCITATION_TARGET_TORQUE) {
+        return false;
+    }
+
+    float freq[FREQUENCY_RESPONSE_MAX_POINTS];
+    float gain[FREQUENCY_RESPONSE_MAX_POINTS];
+    float phase[FREQUENCY_RESPONSE_MAX_POINTS];
+    size_t n = std::min<size_t>(fr.num_results_, FREQUENCY_RESPONSE_MAX_POINTS);
+    for (size_t i = 0; i < n; ++i) {
+        freq[i] = fr.get_freq(i);
+        gain[i] = fr.get_gain(i);
+        phase[i] = fr.get_phase(i);
+    }
+
+    PlantModel model;
+    ControllerGains gains;
+    if (!fit_plant_model(freq, gain, phase, n, &model)
+            || !design_gains(model, bandwidth, phase_margin * (float)M_PI / 180.0f, &gains)) {
+        return false;
+    }
+
+    config_.pos_gain = gains.pos_gain;
+    config_.vel_gain = gains.vel_gain;
+    config_.vel_integrator_gain = gains.vel_integrator_gain;
+    config_.inertia = model.inertia;
+    autotune_friction_ = model.friction;
+    autotune_delay_ = model.delay;
+    return true;
+}
+
+/**
+ * @brief Moves the input position by displacement relative to input_pos_ or
+ * pos_setpoint_.
+ *
+ * The base position is only read when the control loop takes the command, so
+ * increments posted before that add up. An increment that follows a pending
+ * absolute position is added to it.
+ */
+void Controller::move_incremental(float displacement, bool from_input_pos = true){
+    osThreadSuspendAll(); // see set_input()
+    input_mailbox_.post([&](InputCommand& cmd) {
+        if (cmd.pos.has_value()) {
+            cmd.pos = *cmd.pos + displacement;
+        } else if (cmd.pos_increment.has_value()) {
+            cmd.pos_increment = *cmd.pos_increment + displacement;
+        } else {
+            cmd.pos_increment = displacement;
+            cmd.increment_from_setpoint = !from_input_pos;
+        }
+    });
+    osThreadResumeAll();
 }
 
+// Mean position of the calibration steps in a bin of the cogging map [fraction of a bin]
+static constexpr float anticogging_sample_offset = 0.5f - 0.5f * (float)ANTICOGGING_MAP_SIZE / (float)ANTICOGGING_CALIB_STEPS;
+
 void Controller::start_anticogging_calibration() {
     // Ensure the cogging map was correctly allocated earlier and that the motor is capable of calibrating
-    if (axis_->error_ == Axis::ERROR_NONE) {
+    if (axis_->error_ == Axis::ERROR_NONE && !config_.friction.calib_friction) {
+        anticogging_valid_ = false;
+        cogging_map_loaded_ = true; // a pending load must not overwrite the calibration
+        cogging_map_.calibrated = false;
+        std::fill(std::begin(cogging_map_.values), std::end(cogging_map_.values), 0.0f);
+        config_.anticogging.index = 0;
+        sweep_pass_ = 0;
         config_.anticogging.calib_anticogging = true;
     }
 }
 
+/**
+ * @brief Starts the anticogging calibration like start_anticogging_calibration()
+ * and returns the handle of an operation in `odrv.operations` that completes
+ * when `calib_anticogging` is cleared. It succeeds if the cogging map was
+ * calibrated and fails if the calibration was aborted by clearing
+ * `calib_anticogging`. The result is the controller error. Returns 0 if no
+ * operation could be started.
+ */
+uint32_t Controller::start_anticogging_calibration_async() {
+    uint32_t handle = odrv.operations_.start();
+    if (!handle) {
+        return 0;
+    }
+    start_anticogging_calibration();
+    if (!config_.anticogging.calib_anticogging) {
+        odrv.operations_.finish(handle, false, error_); // the axis has an error
+        return handle;
+    }
+    uint32_t superseded = 0;
+    CRITICAL_SECTION() {
+        superseded = anticogging_operation_;
+        anticogging_operation_ = handle;
+    }
+    if (superseded) {
+        odrv.operations_.finish(superseded, false, error_);
+    }
+    return handle;
+}
+
+// Completes the operation of start_anticogging_calibration_async() once the
+// calibration is no longer running. Called from the housekeeping interrupt.
+void Controller::update_anticogging_operation() {
+    if (anticogging_operation_ && !config_.anticogging.calib_anticogging) {
+        odrv.operations_.finish(anticogging_operation_, anticogging_valid_, error_);
+        anticogging_operation_ = 0;
+    }
+}
 
 /*
  * This anti-cogging implementation iterates through each encoder position,
  * waits for zero velocity & position error,
  * then samples the current required to maintain that position.
  * 
+ * The samples are averaged into ANTICOGGING_MAP_SIZE bins. After the
+ * calibration the strongest harmonics of the map are fitted in the
+ * background (see anticogging_fit_step()).
+ *
  * This holding current is added as a feedforward term in the control loop.
  */
 bool Controller::anticogging_calibration(float pos_estimate, float vel_estimate) {
+    if (config_.anticogging.calib_sweep) {
+        return anticogging_sweep_calibration(pos_estimate);
+    }
+
+    constexpr uint32_t steps_per_bin = ANTICOGGING_CALIB_STEPS / ANTICOGGING_MAP_SIZE;
     float pos_err = input_pos_ - pos_estimate;
     if (std::abs(pos_err) <= config_.anticogging.calib_pos_threshold / (float)axis_->encoder_.config_.cpr &&
         std::abs(vel_estimate) < config_.anticogging.calib_vel_threshold / (float)axis_->encoder_.config_.cpr) {
-        config_.anticogging.cogging_map[std::clamp<uint32_t>(config_.anticogging.index++, 0, 3600)] = vel_integrator_torque_;
+        uint32_t bin = std::clamp<uint32_t>(config_.anticogging.index++ / steps_per_bin, 0, ANTICOGGING_MAP_SIZE - 1);
+        cogging_map_.values[bin] += vel_integrator_torque_ / (float)steps_per_bin;
     }
-    if (config_.anticogging.index < 3600) {
+    if (config_.anticogging.index < ANTICOGGING_CALIB_STEPS) {
         config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
         input_pos_ = config_.anticogging.index * axis_->encoder_.getCoggingRatio();
         input_vel_ = 0.0f;
@@ -78,16 +346,339 @@ bool Controller::anticogging_calibration(float pos_estimate, float vel_estimate)
         input_vel_ = 0.0f;
         input_torque_ = 0.0f;
         input_pos_updated();
+        config_.anticogging.harmonic_count = 0; // use the LUT until the fit is done
+        cogging_map_.calibrated = true;
+        anticogging_fit_pending_ = true;
         anticogging_valid_ = true;
         config_.anticogging.calib_anticogging = false;
         return true;
     }
 }
 
+/*
+ * Alternative to the stepped calibration: The axis moves one turn forward
+ * and one turn backward at a constant velocity while the torque is binned by
+ * position. Friction adds to the torque in one direction and subtracts from
+ * it in the other one, so the mean of both passes is the cogging torque and
+ * half their difference is the friction.
+ */
+bool Controller::anticogging_sweep_calibration(float pos_estimate) {
+    constexpr float run_in = 0.05f; // [turn] travel before the first sample of a pass
+
+    if (sweep_pass_ == 0) {
+        sweep_pass_ = 1;
+        sweep_start_ = pos_estimate;
+        input_pos_ = pos_estimate;
+        std::fill(std::begin(anticogging_sweep_count_), std::end(anticogging_sweep_count_), 0);
+    }
+
+    float dir = (sweep_pass_ == 1) ? 1.0f : -1.0f;
+    float travel = dir * (input_pos_ - sweep_start_);
+
+    std::optional<float> torque = torque_output_.any();
+    if (travel >= run_in && torque.has_value()) {
+        float* mean = (sweep_pass_ == 1) ? cogging_map_.values : anticogging_sweep_bwd_;
+        size_t bin = std::min<size_t>((size_t)(fmodf_pos(pos_estimate, 1.0f) * ANTICOGGING_MAP_SIZE), ANTICOGGING_MAP_SIZE - 1);
+        uint16_t& n = anticogging_sweep_count_[bin];
+        if (n < UINT16_MAX) {
+            ++n;
+            mean[bin] += (*torque - mean[bin]) / (float)n;
+        }
+    }
+
+    if (sweep_step(dir, config_.anticogging.calib_sweep_vel, 1.0f + run_in)) {
+        return false;
+    }
+
+    if (sweep_pass_ == 1) {
+        sweep_pass_ = 2;
+        sweep_start_ = input_pos_;
+        std::fill(std::begin(anticogging_sweep_count_), std::end(anticogging_sweep_count_), 0);
+        std::fill(std::begin(anticogging_sweep_bwd_), std::end(anticogging_sweep_bwd_), 0.0f);
+        return false;
+    }
+
+    float friction = 0.0f;
+    for (size_t i = 0; i < ANTICOGGING_MAP_SIZE; ++i) {
+        float fwd = cogging_map_.values[i];
+        float bwd = anticogging_sweep_bwd_[i];
+        cogging_map_.values[i] = 0.5f * (fwd + bwd);
+        friction += 0.5f * (fwd - bwd);
+    }
+    config_.anticogging.friction_torque = friction / (float)ANTICOGGING_MAP_SIZE;
+
+    sweep_pass_ = 0;
+    input_vel_ = 0.0f; // Stop where the sweep ended
+    input_pos_updated();
+    config_.anticogging.harmonic_count = 0; // use the LUT until the fit is done
+    cogging_map_.calibrated = true;
+    anticogging_fit_pending_ = true;
+    anticogging_valid_ = true;
+    config_.anticogging.calib_anticogging = false;
+    return true;
+}
+
+// Advances the position setpoint of a sweep pass at the velocity dir * vel.
+// Returns false once the setpoint travelled `length` from sweep_start_.
+bool Controller::sweep_step(float dir, float vel, float length) {
+    if (dir * (input_pos_ - sweep_start_) >= length) {
+        return false;
+    }
+    config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+    input_pos_ += dir * vel * update_period_;
+    input_vel_ = dir * vel;
+    input_torque_ = 0.0f;
+    input_pos_updated();
+    return true;
+}
+
+void Controller::start_friction_calibration() {
+    const Friction_t& friction = config_.friction;
+    if (axis_->error_ == Axis::ERROR_NONE && !config_.anticogging.calib_anticogging
+        && friction.calib_vel_min > 0.0f && friction.calib_vel_max >= friction.calib_vel_min
+        && friction.calib_travel > 0.0f && friction.calib_reversal_travel > 0.0f) {
+        friction_calib_step_ = 0;
+        sweep_pass_ = 0;
+        backlash_offset_ = 0.0f;
+        config_.friction.calib_friction = true;
+    }
+}
+
+/*
+ * Measures the friction with the same constant velocity sweeps as the
+ * anticogging calibration, at FRICTION_CALIB_VELOCITIES velocities from
+ * calib_vel_min to calib_vel_max in geometric steps. At each velocity the
+ * axis moves calib_reversal_travel + calib_travel forward and back. Cogging
+ * and gravity torques depend on the position only and are the same in both
+ * passes, so half the difference of their mean torques is the friction.
+ * The model of friction_torque() is fitted to the friction at all
+ * velocities.
+ *
+ * The first calib_reversal_travel of each pass is not sampled. After the
+ * slowest reversal the torque over it is binned to estimate the backlash
+ * (see backlash_from_reversal()).
+ */
+bool Controller::friction_calibration(float pos_estimate) {
+    Friction_t& friction = config_.friction;
+
+    if (sweep_pass_ == 0) {
+        float t = (float)friction_calib_step_ / (float)std::max(FRICTION_CALIB_VELOCITIES - 1, 1);
+        friction_calib_vel_[friction_calib_step_] = friction.calib_vel_min
+                * std::pow(friction.calib_vel_max / friction.calib_vel_min, t);
+        sweep_pass_ = 1;
+        sweep_start_ = pos_estimate;
+        input_pos_ = pos_estimate;
+        friction_calib_mean_ = 0.0f;
+        friction_calib_count_ = 0;
+    }
+
+    float vel = friction_calib_vel_[friction_calib_step_];
+    float dir = (sweep_pass_ == 1) ? 1.0f : -1.0f;
+    float travel = dir * (input_pos_ - sweep_start_);
+
+    std::optional<float> torque = torque_output_.any();
+    if (torque.has_value()) {
+        if (travel >= friction.calib_reversal_travel) {
+            ++friction_calib_count_;
+            friction_calib_mean_ += (*torque - friction_calib_mean_) / (float)friction_calib_count_;
+        } else if (sweep_pass_ == 2 && friction_calib_step_ == 0) {
+            size_t bin = std::min<size_t>((size_t)(travel / friction.calib_reversal_travel * FRICTION_REVERSAL_BINS),
+                                          FRICTION_REVERSAL_BINS - 1);
+            uint16_t& n = friction_calib_reversal_count_[bin];
+            if (n < UINT16_MAX) {
+                ++n;
+                friction_calib_reversal_[bin] += (*torque - friction_calib_reversal_[bin]) / (float)n;
+            }
+        }
+    }
+
+    if (sweep_step(dir, vel, friction.calib_reversal_travel + friction.calib_travel)) {
+        return false;
+    }
+
+    if (sweep_pass_ == 1) {
+        friction_calib_fwd_ = friction_calib_mean_;
+        friction_calib_mean_ = 0.0f;
+        friction_calib_count_ = 0;
+        std::fill(std::begin(friction_calib_reversal_), std::end(friction_calib_reversal_), 0.0f);
+        std::fill(std::begin(friction_calib_reversal_count_), std::end(friction_calib_reversal_count_), 0);
+        sweep_pass_ = 2;
+        sweep_start_ = input_pos_;
+        return false;
+    }
+
+    friction_calib_torque_[friction_calib_step_] = 0.5f * (friction_calib_fwd_ - friction_calib_mean_);
+    if (friction_calib_step_ == 0) {
+        friction_calib_backlash_ = backlash_from_reversal(friction_calib_reversal_, FRICTION_REVERSAL_BINS,
+                friction.calib_reversal_travel / (float)FRICTION_REVERSAL_BINS,
+                friction_calib_fwd_, friction_calib_mean_);
+    }
+    sweep_pass_ = 0;
+    if (++friction_calib_step_ < FRICTION_CALIB_VELOCITIES) {
+        return false;
+    }
+
+    input_vel_ = 0.0f; // Stop where the sweep ended
+    input_pos_updated();
+    float coulomb, viscous, stribeck;
+    bool success = fit_friction(friction_calib_vel_, friction_calib_torque_, FRICTION_CALIB_VELOCITIES,
+                                friction.stribeck_vel, &coulomb, &viscous, &stribeck);
+    if (success) {
+        friction.coulomb = coulomb;
+        friction.viscous = viscous;
+        friction.stribeck = stribeck;
+        if (friction.calib_backlash) {
+            friction.backlash = friction_calib_backlash_;
+        }
+    }
+    friction.calib_friction = false;
+    return success;
+}
+
+/**
+ * @brief Fits one harmonic of the cogging map per call. Called from the
+ * housekeeping interrupt so that the DFT doesn't delay the control loop.
+ */
+void Controller::anticogging_fit_step() {
+    if (anticogging_fit_pending_) {
+        anticogging_fit_pending_ = false;
+        anticogging_fit_.start(cogging_map_.values, ANTICOGGING_MAP_SIZE, anticogging_sample_offset,
+                config_.anticogging.harmonics,
+                std::min<uint32_t>(config_.anticogging.num_harmonics, ANTICOGGING_MAX_HARMONICS));
+        anticogging_fitting_ = true;
+    }
+    if (anticogging_fitting_ && anticogging_fit_.step()) {
+        anticogging_fitting_ = false;
+        // The control loop reads the harmonics as soon as the count is set
+        std::atomic_signal_fence(std::memory_order_release);
+        config_.anticogging.harmonic_count = anticogging_fit_.count();
+    }
+}
+
+/**
+ * @brief Resets the iterative learning feedforward to 0.
+ */
+void Controller::clear_learning_table() {
+    CRITICAL_SECTION() {
+        learning_table_loaded_ = true; // a pending load must not overwrite the table
+        learning_table_ = {};
+        learning_started_ = false;
+    }
+}
+
+/**
+ * @brief Learns the last cycle of the iterative learning control. Called
+ * from the housekeeping interrupt like anticogging_fit_step().
+ */
+void Controller::learning_step() {
+    const Learning_t& learning = config_.learning;
+    learning_.update(&learning_table_, {learning.learn, learning.gain, learning.lead,
+                                        learning.filter, learning.torque_lim});
+}
+
+/**
+ * @brief Advances the cycle phase of the iterative learning control and
+ * hands the errors over at the end of each cycle. Sets learning_active_ if
+ * the feedforward applies in this iteration.
+ */
+bool Controller::update_learning_phase() {
+    const Learning_t& learning = config_.learning;
+    learning_active_ = false;
+    if (!learning.enable || !learning_table_loaded_ || config_.control_mode != CONTROL_MODE_POSITION_CONTROL) {
+        learning_started_ = false;
+        return true;
+    }
+    if (!(learning.period > 0.0f)) {
+        set_error(ERROR_INVALID_INPUT_MODE);
+        return false;
+    }
+
+    bool cycle_ended = false;
+    if (learning.phase_source == LEARNING_PHASE_SOURCE_MASTER_POSITION) {
+        if (config_.axis_to_mirror >= AXIS_COUNT) {
+            set_error(ERROR_INVALID_MIRROR_AXIS);
+            return false;
+        }
+        std::optional<TurnPosition> master_pos = axes[config_.axis_to_mirror].encoder_.pos_estimate_turns_.present();
+        if (!master_pos.has_value()) {
+            set_error(ERROR_INVALID_ESTIMATE);
+            return false;
+        }
+        if (!learning_started_) {
+            learning_cycle_.start(*master_pos, learning.period, learning.master_offset);
+        }
+        int32_t cycle = learning_cycle_.cycle();
+        learning_phase_ = learning_cycle_.advance(*master_pos, learning.period) / learning.period;
+        cycle_ended = learning_cycle_.cycle() != cycle;
+    } else {
+        if (!learning_started_) {
+            learning_time_ = 0.0f;
+        }
+        learning_time_ += update_period_;
+        if (learning_time_ >= learning.period) {
+            learning_time_ = fmodf_pos(learning_time_, learning.period);
+            cycle_ended = true;
+        }
+        learning_phase_ = learning_time_ / learning.period;
+    }
+
+    if (!learning_started_) {
+        learning_.reset(); // drop what an earlier run left
+        learning_started_ = true;
+    } else if (cycle_ended) {
+        learning_.end_cycle();
+    }
+    learning_active_ = true;
+    return true;
+}
+
+/**
+ * @brief Returns the cogging torque feedforward [Nm] for a position [turn].
+ */
+float Controller::anticogging_torque(float pos) {
+    const Anticogging_t& anticogging = config_.anticogging;
+    float pos_frac = fmodf_pos(pos, 1.0f);
+    uint32_t harmonic_count = std::min<uint32_t>(anticogging.harmonic_count, ANTICOGGING_MAX_HARMONICS);
+
+    if (anticogging.mode == ANTICOGGING_MODE_HARMONICS && harmonic_count > 0) {
+        float torque = 0.0f;
+        for (uint32_t i = 0; i < harmonic_count; ++i) {
+            const CoggingHarmonic& h = anticogging.harmonics[i];
+            auto [s, c] = fast_sincos(2.0f * M_PI * (float)h.order * pos_frac);
+            torque += h.cos_coeff * c + h.sin_coeff * s;
+        }
+        return torque;
+    }
+
+    // The map may not be loaded from NVM yet
+    if (!cogging_map_.calibrated) {
+        return 0.0f;
+    }
+    return lut_interpolate(cogging_map_.values, ANTICOGGING_MAP_SIZE, anticogging_sample_offset, pos_frac);
+}
+
 void Controller::update_filter_gains() {
-    float bandwidth = std::min(config_.input_filter_bandwidth, 0.25f * current_meas_hz);
+    float bandwidth = std::min(config_.input_filter_bandwidth, 0.25f / update_period_);
     input_filter_ki_ = 2.0f * bandwidth;  // basic conversion to discrete time
     input_filter_kp_ = 0.25f * (input_filter_ki_ * input_filter_ki_); // Critically damped
+
+    size_t n_impulses = config_.input_shaper_type == INPUT_SHAPER_TYPE_ZVD ? 3
+                      : config_.input_shaper_type == INPUT_SHAPER_TYPE_ZV ? 2 : 0;
+    InputShaper<INPUT_SHAPER_BUFFER_SIZE>::Params params = InputShaper<INPUT_SHAPER_BUFFER_SIZE>::design(
+            n_impulses, config_.input_shaper_freq, config_.input_shaper_damping, update_period_);
+    CRITICAL_SECTION() {
+        input_shaper_.set_params(params);
+    }
+}
+
+void Controller::update_gain_schedule() {
+    GainSchedule<GAIN_SCHEDULE_SIZE> schedule;
+    bool active = config_.gain_schedule_input != GAIN_SCHEDULE_INPUT_NONE
+               && schedule.set(config_.gain_schedule);
+    CRITICAL_SECTION() {
+        gain_schedule_ = schedule;
+        gain_schedule_active_ = active;
+    }
 }
 
 static float limitVel(const float vel_limit, const float vel_estimate, const float vel_gain, const float torque) {
@@ -97,14 +688,13 @@ static float limitVel(const float vel_limit, const float vel_estimate, const flo
 }
 
 bool Controller::update() {
-    std::optional<float> pos_estimate_linear = pos_estimate_linear_src_.present();
-    std::optional<float> pos_estimate_circular = pos_estimate_circular_src_.present();
-    std::optional<float> pos_wrap = pos_wrap_src_.present();
-    std::optional<float> vel_estimate = vel_estimate_src_.present();
-
     std::optional<float> anticogging_pos_estimate = axis_->encoder_.pos_estimate_.present();
     std::optional<float> anticogging_vel_estimate = axis_->encoder_.vel_estimate_.present();
 
+    if (!hold_inputs_) {
+        apply_input_command();
+    }
+
     if (config_.anticogging.calib_anticogging) {
         if (!anticogging_pos_estimate.has_value() || !anticogging_vel_estimate.has_value()) {
             set_error(ERROR_INVALID_ESTIMATE);
@@ -114,6 +704,14 @@ bool Controller::update() {
         anticogging_calibration(*anticogging_pos_estimate, *anticogging_vel_estimate);
     }
 
+    if (config_.friction.calib_friction) {
+        if (!anticogging_pos_estimate.has_value()) {
+            set_error(ERROR_INVALID_ESTIMATE);
+            return false;
+        }
+        friction_calibration(*anticogging_pos_estimate);
+    }
+
     // TODO also enable circular deltas for 2nd order filter, etc.
     if (config_.circular_setpoints) {
         // Keep pos setpoint from drifting
@@ -121,6 +719,13 @@ bool Controller::update() {
     }
 
     // Update inputs
+    accel_setpoint_ = 0.0f; // only known in some input modes
+    if (config_.input_mode != INPUT_MODE_PVT) {
+        pvt_started_ = false;
+    }
+    if (config_.input_mode != INPUT_MODE_CAM) {
+        cam_started_ = false;
+    }
     switch (config_.input_mode) {
         case INPUT_MODE_INACTIVE: {
             // do nothing
@@ -131,15 +736,16 @@ bool Controller::update() {
             torque_setpoint_ = input_torque_; 
         } break;
         case INPUT_MODE_VEL_RAMP: {
-            float max_step_size = std::abs(current_meas_period * config_.vel_ramp_rate);
+            float max_step_size = std::abs(update_period_ * config_.vel_ramp_rate);
             float full_step = input_vel_ - vel_setpoint_;
             float step = std::clamp(full_step, -max_step_size, max_step_size);
 
             vel_setpoint_ += step;
-            torque_setpoint_ = (step / current_meas_period) * config_.inertia;
+            accel_setpoint_ = step / update_period_;
+            torque_setpoint_ = accel_setpoint_ * config_.inertia;
         } break;
         case INPUT_MODE_TORQUE_RAMP: {
-            float max_step_size = std::abs(current_meas_period * config_.torque_ramp_rate);
+            float max_step_size = std::abs(update_period_ * config_.torque_ramp_rate);
             float full_step = input_torque_ - torque_setpoint_;
             float step = std::clamp(full_step, -max_step_size, max_step_size);
 
@@ -150,13 +756,14 @@ bool Controller::update() {
             float delta_pos = input_pos_ - pos_setpoint_; // Pos error
             float delta_vel = input_vel_ - vel_setpoint_; // Vel error
             float accel = input_filter_kp_*delta_pos + input_filter_ki_*delta_vel; // Feedback
+            accel_setpoint_ = accel;
             torque_setpoint_ = accel * config_.inertia; // Accel
-            vel_setpoint_ += current_meas_period * accel; // delta vel
-            pos_setpoint_ += current_meas_period * vel_setpoint_; // Delta pos
+            vel_setpoint_ += update_period_ * accel; // delta vel
+            pos_setpoint_ += update_period_ * vel_setpoint_; // Delta pos
         } break;
         case INPUT_MODE_MIRROR: {
             if (config_.axis_to_mirror < AXIS_COUNT) {
-                std::optional<float> other_pos = axes[config_.axis_to_mirror].encoder_.pos_estimate_.present();
+                std::optional<TurnPosition> other_pos = axes[config_.axis_to_mirror].encoder_.pos_estimate_turns_.present();
                 std::optional<float> other_vel = axes[config_.axis_to_mirror].encoder_.vel_estimate_.present();
 
                 if (!other_pos.has_value() || !other_vel.has_value()) {
@@ -164,13 +771,44 @@ bool Controller::update() {
                     return false;
                 }
 
-                pos_setpoint_ = *other_pos * config_.mirror_ratio;
-                vel_setpoint_ = *other_vel * config_.mirror_ratio;
+                if (config_.mirror_ratio_den) {
+                    float ratio = (float)config_.mirror_ratio_num / (float)config_.mirror_ratio_den;
+                    pos_setpoint_ = gear_rational(*other_pos, config_.mirror_ratio_num, config_.mirror_ratio_den).to_float() + config_.mirror_offset;
+                    vel_setpoint_ = *other_vel * ratio;
+                } else {
+                    pos_setpoint_ = other_pos->to_float() * config_.mirror_ratio + config_.mirror_offset;
+                    vel_setpoint_ = *other_vel * config_.mirror_ratio;
+                }
             } else {
                 set_error(ERROR_INVALID_MIRROR_AXIS);
                 return false;
             }
         } break;
+        case INPUT_MODE_CAM: {
+            if (config_.axis_to_mirror >= AXIS_COUNT) {
+                set_error(ERROR_INVALID_MIRROR_AXIS);
+                return false;
+            }
+            if (!(config_.cam_master_period > 0.0f) || config_.cam_num_points == 0 || config_.cam_num_points > CAM_TABLE_SIZE) {
+                set_error(ERROR_INVALID_INPUT_MODE);
+                return false;
+            }
+            std::optional<TurnPosition> master_pos = axes[config_.axis_to_mirror].encoder_.pos_estimate_turns_.present();
+            std::optional<float> master_vel = axes[config_.axis_to_mirror].encoder_.vel_estimate_.present();
+            if (!master_pos.has_value() || !master_vel.has_value()) {
+                set_error(ERROR_INVALID_ESTIMATE);
+                return false;
+            }
+
+            if (!cam_started_) {
+                cam_follower_.start(*master_pos, config_.cam_master_period, config_.cam_master_offset);
+                cam_started_ = true;
+            }
+            CamFollower::Output out = cam_follower_.update(*master_pos, *master_vel, config_.cam_table,
+                    config_.cam_num_points, config_.cam_master_period, config_.cam_rise);
+            pos_setpoint_ = out.pos + config_.mirror_offset;
+            vel_setpoint_ = out.vel;
+        } break;
         // case INPUT_MODE_MIX_CHANNELS: {
         //     // NOT YET IMPLEMENTED
         // } break;
@@ -194,11 +832,49 @@ bool Controller::update() {
                 TrapezoidalTrajectory::Step_t traj_step = axis_->trap_traj_.eval(axis_->trap_traj_.t_);
                 pos_setpoint_ = traj_step.Y;
                 vel_setpoint_ = traj_step.Yd;
+                accel_setpoint_ = traj_step.Ydd;
+                torque_setpoint_ = traj_step.Ydd * config_.inertia;
+                axis_->trap_traj_.t_ += update_period_;
+            }
+            anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+        } break;
+        case INPUT_MODE_SCURVE_TRAJ: {
+            if (input_pos_updated_) {
+                move_to_pos(input_pos_);
+                input_pos_updated_ = false;
+            }
+            if (trajectory_done_)
+                break;
+
+            if (scurve_traj_.t_ > scurve_traj_.Tf_) {
+                config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+                pos_setpoint_ = input_pos_;
+                vel_setpoint_ = 0.0f;
+                torque_setpoint_ = 0.0f;
+                trajectory_done_ = true;
+            } else {
+                SCurveTrajectory::Step_t traj_step = scurve_traj_.eval(scurve_traj_.t_);
+                pos_setpoint_ = traj_step.Y;
+                vel_setpoint_ = traj_step.Yd;
+                accel_setpoint_ = traj_step.Ydd;
                 torque_setpoint_ = traj_step.Ydd * config_.inertia;
-                axis_->trap_traj_.t_ += current_meas_period;
+                scurve_traj_.t_ += update_period_;
             }
             anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
         } break;
+        case INPUT_MODE_PVT: {
+            if (!pvt_started_) {
+                // The first point is approached from the current setpoint
+                pvt_buffer_.start(pos_setpoint_, vel_setpoint_, 0.0f);
+                pvt_started_ = true;
+            }
+            PvtBuffer::Step_t step = pvt_buffer_.update(update_period_);
+            pos_setpoint_ = step.pos;
+            vel_setpoint_ = step.vel;
+            accel_setpoint_ = step.accel;
+            torque_setpoint_ = step.torque + step.accel * config_.inertia;
+            anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+        } break;
         default: {
             set_error(ERROR_INVALID_INPUT_MODE);
             return false;
@@ -206,14 +882,126 @@ bool Controller::update() {
         
     }
 
+    if (!update_learning_phase()) {
+        return false;
+    }
+
+    // The fast stop overrides the setpoints of the input mode. It keeps its
+    // own state because some input modes overwrite the setpoints each time.
+    if (fast_stop_active_) {
+        float max_step_size = std::abs(update_period_ * fast_stop_decel_);
+        float step = std::clamp(-fast_stop_vel_, -max_step_size, max_step_size);
+
+        fast_stop_vel_ += step;
+        fast_stop_pos_ += update_period_ * fast_stop_vel_;
+        pos_setpoint_ = fast_stop_pos_;
+        vel_setpoint_ = fast_stop_vel_;
+        accel_setpoint_ = step / update_period_;
+        torque_setpoint_ = accel_setpoint_ * config_.inertia;
+    }
+
+    // Input shaping. The members keep the unshaped setpoints because the
+    // input modes continue from them in the next iteration.
+    float pos_setpoint = pos_setpoint_;
+    float vel_setpoint = vel_setpoint_;
+    float torque_setpoint = torque_setpoint_;
+    bool is_trajectory = config_.input_mode == INPUT_MODE_TRAP_TRAJ || config_.input_mode == INPUT_MODE_SCURVE_TRAJ;
+    bool is_filtered = config_.input_mode == INPUT_MODE_POS_FILTER || config_.input_mode == INPUT_MODE_VEL_RAMP;
+    if (input_shaper_.enabled() && (is_trajectory || is_filtered) && !config_.circular_setpoints && !fast_stop_active_) {
+        InputShaper<INPUT_SHAPER_BUFFER_SIZE>::Sample shaped = input_shaper_.update(
+                {pos_setpoint_, vel_setpoint_, accel_setpoint_, torque_setpoint_});
+        pos_setpoint = shaped.pos;
+        vel_setpoint = shaped.vel;
+        accel_setpoint_ = shaped.accel;
+        torque_setpoint = shaped.torque;
+        if (is_trajectory) {
+            anticogging_pos_estimate = pos_setpoint;
+        }
+    } else {
+        input_shaper_.reset();
+    }
+
+    // Dispatch to the control law that only contains the enabled features.
+    // This happens after the input modes because they can switch the control
+    // mode.
+    using ControlLaw = bool (Controller::*)(const Setpoints&, std::optional<float>);
+    static constexpr ControlLaw control_laws[] = {
+        &Controller::update_control_law<CONTROL_MODE_TORQUE_CONTROL, false, false>,
+        &Controller::update_control_law<CONTROL_MODE_TORQUE_CONTROL, false, true>,
+        &Controller::update_control_law<CONTROL_MODE_VELOCITY_CONTROL, false, false>,
+        &Controller::update_control_law<CONTROL_MODE_VELOCITY_CONTROL, false, true>,
+        &Controller::update_control_law<CONTROL_MODE_POSITION_CONTROL, false, false>,
+        &Controller::update_control_law<CONTROL_MODE_POSITION_CONTROL, false, true>,
+        &Controller::update_control_law<CONTROL_MODE_POSITION_CONTROL, true, false>,
+        &Controller::update_control_law<CONTROL_MODE_POSITION_CONTROL, true, true>,
+    };
+    // The fast stop needs at least velocity control.
+    ControlMode control_mode = config_.control_mode;
+    if (fast_stop_active_ && control_mode < CONTROL_MODE_VELOCITY_CONTROL) {
+        control_mode = CONTROL_MODE_VELOCITY_CONTROL;
+    }
+    Setpoints setpoints = {pos_setpoint, vel_setpoint, torque_setpoint};
+    if (control_mode >= CONTROL_MODE_POSITION_CONTROL && config_.state_feedback.enable && !config_.circular_setpoints) {
+        return update_state_feedback(setpoints, anticogging_pos_estimate);
+    }
+    state_feedback_.reset();
+
+    size_t idx;
+    if (control_mode >= CONTROL_MODE_POSITION_CONTROL) {
+        idx = 4 + (config_.circular_setpoints ? 2 : 0)
+            + ((gain_schedule_active_ || config_.enable_gain_scheduling) ? 1 : 0);
+    } else {
+        idx = (control_mode >= CONTROL_MODE_VELOCITY_CONTROL ? 2 : 0)
+            + (gain_schedule_active_ ? 1 : 0);
+    }
+
+    return (this->*control_laws[idx])(setpoints, anticogging_pos_estimate);
+}
+
+/**
+ * @brief Runs the position, velocity and torque control for the setpoints of
+ * the input mode.
+ *
+ * @tparam kMode: CONTROL_MODE_TORQUE_CONTROL for all modes below velocity
+ *         control, otherwise the control mode.
+ * @tparam kCircular: Wraps the position error (position control only).
+ * @tparam kGainSchedule: Includes the gain schedule table and the V-shaped
+ *         gain scheduling.
+ */
+template<Controller::ControlMode kMode, bool kCircular, bool kGainSchedule>
+bool Controller::update_control_law(const Setpoints& setpoints, std::optional<float> anticogging_pos_estimate) {
+    std::optional<float> vel_estimate = vel_estimate_src_.present();
+
+    // Gain schedule table
+    float pos_gain = config_.pos_gain;
+    float vel_gain = config_.vel_gain;
+    float vel_integrator_gain = config_.vel_integrator_gain;
+    auto apply_gain_schedule = [&](float x) {
+        GainSchedule<GAIN_SCHEDULE_SIZE>::Point gains = gain_schedule_.eval(x);
+        pos_gain = gains.pos_gain;
+        vel_gain = gains.vel_gain;
+        vel_integrator_gain = gains.vel_integrator_gain;
+    };
+    if constexpr (kGainSchedule) {
+        if (gain_schedule_active_) {
+            if (config_.gain_schedule_input == GAIN_SCHEDULE_INPUT_VELOCITY) {
+                apply_gain_schedule(std::abs(setpoints.vel));
+            } else if (config_.gain_schedule_input == GAIN_SCHEDULE_INPUT_POSITION) {
+                apply_gain_schedule(setpoints.pos);
+            }
+        }
+    }
+
     // Position control
     // TODO Decide if we want to use encoder or pll position here
     float gain_scheduling_multiplier = 1.0f;
-    float vel_des = vel_setpoint_;
-    if (config_.control_mode >= CONTROL_MODE_POSITION_CONTROL) {
+    float vel_des = setpoints.vel;
+    if constexpr (kMode == CONTROL_MODE_POSITION_CONTROL) {
         float pos_err;
 
-        if (config_.circular_setpoints) {
+        if constexpr (kCircular) {
+            std::optional<float> pos_estimate_circular = pos_estimate_circular_src_.present();
+            std::optional<float> pos_wrap = pos_wrap_src_.present();
             if (!pos_estimate_circular.has_value() || !pos_wrap.has_value()) {
                 set_error(ERROR_INVALID_ESTIMATE);
                 return false;
@@ -224,21 +1012,50 @@ bool Controller::update() {
             pos_err = pos_setpoint_ - *pos_estimate_circular;
             pos_err = wrap_pm(pos_err, *pos_wrap);
         } else {
+            std::optional<float> pos_estimate_linear = pos_estimate_linear_src_.present();
+            std::optional<TurnPosition> pos_estimate_linear_turns = pos_estimate_linear_turns_src_.present();
             if (!pos_estimate_linear.has_value()) {
                 set_error(ERROR_INVALID_ESTIMATE);
                 return false;
             }
-            pos_err = pos_setpoint_ - *pos_estimate_linear;
+            pos_err = pos_estimate_linear_turns.has_value()
+                    ? sub_turns(setpoints.pos, *pos_estimate_linear_turns)
+                    : setpoints.pos - *pos_estimate_linear;
         }
 
-        vel_des += config_.pos_gain * pos_err;
-        // V-shaped gain shedule based on position error
-        float abs_pos_err = std::abs(pos_err);
-        if (config_.enable_gain_scheduling && abs_pos_err <= config_.gain_scheduling_width) {
-            gain_scheduling_multiplier = abs_pos_err / config_.gain_scheduling_width;
+        if (learning_active_) {
+            learning_.record(learning_phase_, pos_err);
+        }
+
+        if constexpr (kGainSchedule) {
+            if (gain_schedule_active_ && config_.gain_schedule_input == GAIN_SCHEDULE_INPUT_POSITION_ERROR) {
+                apply_gain_schedule(std::abs(pos_err));
+            }
+        }
+
+        // Backlash compensation. The calibration measures without it.
+        const Friction_t& friction = config_.friction;
+        if (friction.backlash_enable && !friction.calib_friction) {
+            backlash_offset_ = update_backlash_offset(backlash_offset_, setpoints.vel, friction.backlash,
+                                                      friction.zero_vel, friction.backlash_slew_rate, update_period_);
+        } else {
+            backlash_offset_ = 0.0f;
+        }
+        pos_err += backlash_offset_;
+
+        vel_des += pos_gain * pos_err;
+
+        if constexpr (kGainSchedule) {
+            // V-shaped gain shedule based on position error
+            float abs_pos_err = std::abs(pos_err);
+            if (config_.enable_gain_scheduling && abs_pos_err <= config_.gain_scheduling_width) {
+                gain_scheduling_multiplier = abs_pos_err / config_.gain_scheduling_width;
+            }
         }
     }
 
+    vel_des += axis_->frequency_response_.excitation(FrequencyResponse::EXCITATION_TARGET_VELOCITY);
+
     // Velocity limiting
     float vel_lim = config_.vel_limit;
     if (config_.enable_vel_limit) {
@@ -259,8 +1076,6 @@ bool Controller::update() {
 
     // TODO: Change to controller working in torque units
     // Torque per amp gain scheduling (ACIM)
-    float vel_gain = config_.vel_gain;
-    float vel_integrator_gain = config_.vel_integrator_gain;
     if (axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_ACIM) {
         float effective_flux = axis_->acim_estimator_.rotor_flux_;
         float minflux = axis_->motor_.config_.acim_gain_min_flux;
@@ -273,7 +1088,7 @@ bool Controller::update() {
     }
 
     // Velocity control
-    float torque = torque_setpoint_;
+    float torque = setpoints.torque;
 
     // Anti-cogging is enabled after calibration
     // We get the current position and apply a current feed-forward
@@ -283,12 +1098,26 @@ bool Controller::update() {
             set_error(ERROR_INVALID_ESTIMATE);
             return false;
         }
-        float anticogging_pos = *anticogging_pos_estimate / axis_->encoder_.getCoggingRatio();
-        torque += config_.anticogging.cogging_map[std::clamp(mod((int)anticogging_pos, 3600), 0, 3600)];
+        torque += anticogging_torque(*anticogging_pos_estimate);
+    }
+
+    // Iterative learning feedforward, only active in position control
+    if (learning_active_) {
+        torque += IterativeLearning<LEARNING_TABLE_SIZE>::feedforward(learning_table_, learning_phase_);
+    }
+
+    // Friction feedforward from the velocity setpoint rather than the
+    // estimate, so that it doesn't react to the noise at standstill
+    if constexpr (kMode >= CONTROL_MODE_VELOCITY_CONTROL) {
+        const Friction_t& friction = config_.friction;
+        if (friction.enable) {
+            torque += friction_torque(setpoints.vel, friction.coulomb, friction.viscous, friction.stribeck,
+                                      friction.stribeck_vel, friction.zero_vel);
+        }
     }
 
     float v_err = 0.0f;
-    if (config_.control_mode >= CONTROL_MODE_VELOCITY_CONTROL) {
+    if constexpr (kMode >= CONTROL_MODE_VELOCITY_CONTROL) {
         if (!vel_estimate.has_value()) {
             set_error(ERROR_INVALID_ESTIMATE);
             return false;
@@ -299,17 +1128,32 @@ bool Controller::update() {
 
         // Velocity integral action before limiting
         torque += vel_integrator_torque_;
+
+        // Load torque feedforward. Only while armed, otherwise the estimate
+        // would integrate the torque commands that are not applied.
+        if (config_.enable_disturbance_observer && config_.inertia > 0.0f && axis_->motor_.is_armed_) {
+            torque -= disturbance_observer_.update(*vel_estimate, last_torque_, config_.inertia,
+                                                   config_.disturbance_observer_bandwidth, update_period_);
+        } else {
+            disturbance_observer_.reset();
+        }
+    } else {
+        disturbance_observer_.reset();
     }
 
     // Velocity limiting in current mode
-    if (config_.control_mode < CONTROL_MODE_VELOCITY_CONTROL && config_.enable_current_mode_vel_limit) {
-        if (!vel_estimate.has_value()) {
-            set_error(ERROR_INVALID_ESTIMATE);
-            return false;
+    if constexpr (kMode < CONTROL_MODE_VELOCITY_CONTROL) {
+        if (config_.enable_current_mode_vel_limit) {
+            if (!vel_estimate.has_value()) {
+                set_error(ERROR_INVALID_ESTIMATE);
+                return false;
+            }
+            torque = limitVel(config_.vel_limit, *vel_estimate, vel_gain, torque);
         }
-        torque = limitVel(config_.vel_limit, *vel_estimate, vel_gain, torque);
     }
 
+    torque += axis_->frequency_response_.excitation(FrequencyResponse::EXCITATION_TARGET_TORQUE);
+
     // Torque limiting
     bool limited = false;
     float Tlim = axis_->motor_.max_available_torque();
@@ -323,7 +1167,7 @@ bool Controller::update() {
     }
 
     // Velocity integrator (behaviour dependent on limiting)
-    if (config_.control_mode < CONTROL_MODE_VELOCITY_CONTROL) {
+    if constexpr (kMode < CONTROL_MODE_VELOCITY_CONTROL) {
         // reset integral if not in use
         vel_integrator_torque_ = 0.0f;
     } else {
@@ -331,11 +1175,18 @@ bool Controller::update() {
             // TODO make decayfactor configurable
             vel_integrator_torque_ *= 0.99f;
         } else {
-            vel_integrator_torque_ += ((vel_integrator_gain * gain_scheduling_multiplier) * current_meas_period) * v_err;
+            vel_integrator_torque_ += ((vel_integrator_gain * gain_scheduling_multiplier) * update_period_) * v_err;
         }
     }
 
+    if (axis_->frequency_response_.config_.target == FrequencyResponse::EXCITATION_TARGET_VELOCITY) {
+        axis_->frequency_response_.update(vel_des, vel_estimate.value_or(0.0f));
+    } else {
+        axis_->frequency_response_.update(torque, vel_estimate.value_or(0.0f));
+    }
+
     torque_output_ = torque;
+    last_torque_ = torque;
 
     // TODO: this is inconsistent with the other errors which are sticky.
     // However if we make ERROR_INVALID_ESTIMATE sticky then it will be
@@ -344,3 +1195,102 @@ bool Controller::update() {
     error_ &= ~ERROR_INVALID_ESTIMATE;
     return true;
 }
+
+/**
+ * @brief Position control with the full state feedback
+ *   torque = torque setpoint + K * (reference - state)
+ * instead of the cascaded position and velocity loop. The state is the
+ * position, velocity and acceleration estimate of the load encoder (or of the
+ * encoder fusion), the integral of the position error and, with the encoder
+ * fusion, the twist of the transmission and its rate. The reference of the
+ * twist is 0, the others follow the setpoints of the input mode. The gains K
+ * (config_.state_feedback.gains) come from an offline design such as LQR.
+ *
+ * The feedforward terms and the limits are the same as in update_control_law(),
+ * except for the backlash compensation, the gain scheduling, the disturbance
+ * observer and the ACIM gain correction, which are not applied.
+ */
+bool Controller::update_state_feedback(const Setpoints& setpoints, std::optional<float> anticogging_pos_estimate) {
+    const StateFeedback::Vector& gains = config_.state_feedback.gains;
+    std::optional<float> pos_estimate_linear = pos_estimate_linear_src_.present();
+    std::optional<TurnPosition> pos_estimate_linear_turns = pos_estimate_linear_turns_src_.present();
+    std::optional<float> vel_estimate = vel_estimate_src_.present();
+    std::optional<float> accel_estimate = accel_estimate_src_.present();
+    std::optional<float> twist = twist_src_.present();
+    std::optional<float> twist_vel = twist_vel_src_.present();
+    if (!pos_estimate_linear.has_value() || !vel_estimate.has_value() || !accel_estimate.has_value()
+            || (gains[StateFeedback::kTwist] != 0.0f && !twist.has_value())
+            || (gains[StateFeedback::kTwistVel] != 0.0f && !twist_vel.has_value())) {
+        set_error(ERROR_INVALID_ESTIMATE);
+        return false;
+    }
+
+    float pos_err = pos_estimate_linear_turns.has_value()
+            ? sub_turns(setpoints.pos, *pos_estimate_linear_turns)
+            : setpoints.pos - *pos_estimate_linear;
+    if (learning_active_) {
+        learning_.record(learning_phase_, pos_err);
+    }
+    backlash_offset_ = 0.0f;
+
+    if (config_.enable_overspeed_error && std::abs(*vel_estimate) > config_.vel_limit_tolerance * config_.vel_limit) {
+        set_error(ERROR_OVERSPEED);
+        return false;
+    }
+
+    float vel_ref = setpoints.vel + axis_->frequency_response_.excitation(FrequencyResponse::EXCITATION_TARGET_VELOCITY);
+    StateFeedback::Vector error = {
+        pos_err,
+        vel_ref - *vel_estimate,
+        accel_setpoint_ - *accel_estimate,
+        0.0f, // set by StateFeedback::update()
+        -twist.value_or(0.0f),
+        -twist_vel.value_or(0.0f),
+    };
+    float torque = setpoints.torque + state_feedback_.update(gains, error);
+
+    if (anticogging_valid_ && config_.anticogging.anticogging_enabled) {
+        if (!anticogging_pos_estimate.has_value()) {
+            set_error(ERROR_INVALID_ESTIMATE);
+            return false;
+        }
+        torque += anticogging_torque(*anticogging_pos_estimate);
+    }
+    if (learning_active_) {
+        torque += IterativeLearning<LEARNING_TABLE_SIZE>::feedforward(learning_table_, learning_phase_);
+    }
+    const Friction_t& friction = config_.friction;
+    if (friction.enable) {
+        torque += friction_torque(setpoints.vel, friction.coulomb, friction.viscous, friction.stribeck,
+                                  friction.stribeck_vel, friction.zero_vel);
+    }
+
+    // The velocity gain of the state feedback limits the velocity like in
+    // torque control
+    if (config_.enable_vel_limit) {
+        torque = limitVel(config_.vel_limit, *vel_estimate, gains[StateFeedback::kVel], torque);
+    }
+
+    torque += axis_->frequency_response_.excitation(FrequencyResponse::EXCITATION_TARGET_TORQUE);
+
+    float Tlim = axis_->motor_.max_available_torque();
+    bool limited = std::abs(torque) > Tlim;
+    torque = std::clamp(torque, -Tlim, Tlim);
+    state_feedback_.integrate(pos_err, limited, update_period_);
+
+    // The cascaded loop starts from scratch when the state feedback is disabled
+    vel_integrator_torque_ = 0.0f;
+    disturbance_observer_.reset();
+
+    if (axis_->frequency_response_.config_.target == FrequencyResponse::EXCITATION_TARGET_VELOCITY) {
+        axis_->frequency_response_.update(vel_ref, *vel_estimate);
+    } else {
+        axis_->frequency_response_.update(torque, *vel_estimate);
+    }
+
+    torque_output_ = torque;
+    last_torque_ = torque;
+
+    error_ &= ~ERROR_INVALID_ESTIMATE;
+    return true;
+}
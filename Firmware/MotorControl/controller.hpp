@@ -1,19 +1,107 @@
 #ifndef __CONTROLLER_HPP
 #define __CONTROLLER_HPP
 
+#include "mailbox.hpp"
+#include "dirty_flags.hpp"
+#include "cogging_harmonics.hpp"
+#include "scurve_traj.hpp"
+#include "pvt_buffer.hpp"
+#include "move_queue.hpp"
+#include "input_shaper.hpp"
+#include "autotune.hpp"
+#include "disturbance_observer.hpp"
+#include "gain_schedule.hpp"
+#include "electronic_gearing.hpp"
+#include "friction_model.hpp"
+#include "iterative_learning.hpp"
+#include "state_feedback.hpp"
+
+#define ANTICOGGING_CALIB_STEPS 3600 // number of positions per turn at which the holding torque is measured
+#define ANTICOGGING_MAP_SIZE 360 // must divide ANTICOGGING_CALIB_STEPS
+#define ANTICOGGING_MAX_HARMONICS 16
+#define ANTICOGGING_MAP_VERSION 1 // increment when CoggingMap_t changes
+#define PVT_BUFFER_SIZE 64 // default number of trajectory points for INPUT_MODE_PVT
+#define MOVE_QUEUE_SIZE 16 // number of waypoints that queue_move() buffers
+#define INPUT_SHAPER_BUFFER_SIZE 128 // number of setpoint samples kept by the input shaper
+#define GAIN_SCHEDULE_SIZE 4 // number of breakpoints of the gain schedule table
+#define CAM_TABLE_SIZE 64 // maximum number of points of the INPUT_MODE_CAM table
+#define FRICTION_CALIB_VELOCITIES 4 // number of velocities at which the friction calibration measures
+#define FRICTION_REVERSAL_BINS 16 // resolution of the torque after the reversal for the backlash estimate
+#define LEARNING_TABLE_SIZE 128 // number of phase bins of the iterative learning feedforward
+#define LEARNING_TABLE_VERSION 1 // increment when IterativeLearning::Table changes
+
 class Controller : public ODriveIntf::ControllerIntf {
 public:
+    // Derived quantities that the setters leave to apply_dirty_config()
+    enum DirtyFlag : uint32_t {
+        DIRTY_FILTER_GAINS = 1 << 0,
+        DIRTY_GAIN_SCHEDULE = 1 << 1,
+    };
+
     typedef struct {
         uint32_t index = 0;
-        float cogging_map[3600];
+        AnticoggingMode mode = ANTICOGGING_MODE_LUT;
+        CoggingHarmonic harmonics[ANTICOGGING_MAX_HARMONICS]; // sorted by decreasing magnitude
+        uint32_t num_harmonics = 8; // number of harmonics to fit (at most ANTICOGGING_MAX_HARMONICS)
+        uint32_t harmonic_count = 0; // number of valid entries in harmonics
         bool pre_calibrated = false;
         bool calib_anticogging = false;
         float calib_pos_threshold = 1.0f;
         float calib_vel_threshold = 1.0f;
+        bool calib_sweep = false; // calibrate with slow sweeps in both directions instead of steps
+        float calib_sweep_vel = 0.05f; // [turn/s]
+        float friction_torque = 0.0f; // [Nm] Coulomb friction measured by the sweep calibration
         float cogging_ratio = 1.0f;
         bool anticogging_enabled = true;
     } Anticogging_t;
 
+    // See friction_torque() and update_backlash_offset()
+    typedef struct {
+        bool enable = false; // friction feedforward from the velocity setpoint
+        float coulomb = 0.0f; // [Nm]
+        float viscous = 0.0f; // [Nm/(turn/s)]
+        float stribeck = 0.0f; // [Nm] breakaway torque in excess of the Coulomb friction
+        float stribeck_vel = 0.02f; // [turn/s]
+        float zero_vel = 0.002f; // [turn/s]
+        bool backlash_enable = false;
+        float backlash = 0.0f; // [turn]
+        float backlash_slew_rate = 1.0f; // [turn/s]
+        bool calib_friction = false;
+        bool calib_backlash = true; // the calibration also sets backlash
+        float calib_vel_min = 0.01f; // [turn/s]
+        float calib_vel_max = 0.5f; // [turn/s]
+        float calib_travel = 0.2f; // [turn] of each pass, after calib_reversal_travel
+        float calib_reversal_travel = 0.05f; // [turn] not sampled after each reversal, must exceed the backlash
+    } Friction_t;
+
+    // Iterative learning control, see IterativeLearning
+    typedef struct {
+        bool enable = false; // apply the feedforward table in position control
+        bool learn = true; // update the table after each cycle
+        LearningPhaseSource phase_source = LEARNING_PHASE_SOURCE_TIME;
+        float period = 1.0f; // [s] or [turn] of the master axis (axis_to_mirror)
+        float master_offset = 0.0f; // [turn] master position at the start of a cycle
+        float gain = 0.0f; // [Nm/turn]
+        uint32_t lead = 1; // [bins] of LEARNING_TABLE_SIZE per cycle
+        float filter = 0.5f; // pole of the zero phase low pass, 0 to disable
+        float torque_lim = 1.0f; // [Nm]
+    } Learning_t;
+
+    typedef IterativeLearning<LEARNING_TABLE_SIZE>::Table LearningTable_t;
+
+    // Full state feedback, see update_state_feedback()
+    typedef struct {
+        bool enable = false; // replaces the position and velocity loop in position control
+        StateFeedback::Vector gains = {}; // K in the order of StateFeedback::State
+    } StateFeedback_t;
+
+    // Stored in NVM separately from the configuration and only loaded when
+    // it is needed (see ODrive::load_calibration_data())
+    struct CoggingMap_t {
+        bool calibrated = false; // set when a calibration finished
+        float values[ANTICOGGING_MAP_SIZE] = {}; // [Nm] mean holding torque of each bin of the calibration
+    };
+
     struct Config_t {
         ControlMode control_mode = CONTROL_MODE_POSITION_CONTROL;  //see: ControlMode_t
         InputMode input_mode = INPUT_MODE_PASSTHROUGH;             //see: InputMode_t
@@ -30,7 +118,13 @@ public:
         float inertia = 0.0f;                 // [Nm/(turn/s^2)]
         float input_filter_bandwidth = 2.0f;  // [1/s]
         float homing_speed = 0.25f;           // [turn/s]
+        float homing_fast_speed = 0.0f;       // [turn/s] first approach, only used if faster than homing_speed
+        float homing_backoff_distance = 0.1f; // [turn] back off after the fast approach
+        bool homing_use_index = false;        // the first index pulse after leaving the endstop is the reference
         Anticogging_t anticogging;
+        Friction_t friction;
+        Learning_t learning;
+        StateFeedback_t state_feedback;
         float gain_scheduling_width = 10.0f;
         bool enable_gain_scheduling = false;
         bool enable_vel_limit = true;
@@ -38,50 +132,147 @@ public:
         bool enable_current_mode_vel_limit = true;  // enable velocity limit in current control mode (requires a valid velocity estimator)
         uint8_t axis_to_mirror = -1;
         float mirror_ratio = 1.0f;
+        int32_t mirror_ratio_num = 0;
+        uint32_t mirror_ratio_den = 0; // if not 0, mirror_ratio_num / mirror_ratio_den is used instead of mirror_ratio
+        float mirror_offset = 0.0f; // [turn] added to the position setpoint of INPUT_MODE_MIRROR and INPUT_MODE_CAM
         uint8_t load_encoder_axis = -1;  // default depends on Axis number and is set in load_configuration(). Set to -1 to select sensorless estimator.
+        uint32_t pvt_buffer_size = PVT_BUFFER_SIZE; // [points] taken from the arena on startup
+        uint32_t pvt_low_watermark = 16; // pvt_buffer_low is reported at or below this number of points
+        InputShaperType input_shaper_type = INPUT_SHAPER_TYPE_NONE;
+        float input_shaper_freq = 10.0f; // [Hz] natural frequency of the suppressed mode
+        float input_shaper_damping = 0.0f; // damping ratio of the suppressed mode
+        bool enable_disturbance_observer = false; // requires inertia
+        float disturbance_observer_bandwidth = 200.0f; // [rad/s]
+        GainScheduleInput gain_schedule_input = GAIN_SCHEDULE_INPUT_NONE;
+        GainSchedule<GAIN_SCHEDULE_SIZE>::Point gain_schedule[GAIN_SCHEDULE_SIZE] = {
+            {0.0f, 20.0f, 1.0f / 6.0f, 2.0f / 6.0f},
+            {1.0f, 20.0f, 1.0f / 6.0f, 2.0f / 6.0f},
+            {2.0f, 20.0f, 1.0f / 6.0f, 2.0f / 6.0f},
+            {3.0f, 20.0f, 1.0f / 6.0f, 2.0f / 6.0f},
+        }; // breakpoints in increasing order of x, applied by set_gain_schedule_input()
+        float cam_master_period = 1.0f; // [turn] of the master axis per cam cycle
+        float cam_master_offset = 0.0f; // [turn] master position at the start of a cam cycle
+        float cam_rise = 0.0f; // [turn] slave travel per cam cycle
+        uint32_t cam_num_points = 0; // at most CAM_TABLE_SIZE
+        float cam_table[CAM_TABLE_SIZE] = {}; // [turn] slave position at the master phase cam_master_period * i / cam_num_points
 
         // custom setters
         Controller* parent;
-        void set_input_filter_bandwidth(float value) { input_filter_bandwidth = value; parent->update_filter_gains(); }
+        void set_input_filter_bandwidth(float value) { input_filter_bandwidth = value; parent->dirty_.mark(DIRTY_FILTER_GAINS); }
+        void set_input_shaper_type(InputShaperType value) { input_shaper_type = value; parent->dirty_.mark(DIRTY_FILTER_GAINS); }
+        void set_input_shaper_freq(float value) { input_shaper_freq = value; parent->dirty_.mark(DIRTY_FILTER_GAINS); }
+        void set_input_shaper_damping(float value) { input_shaper_damping = value; parent->dirty_.mark(DIRTY_FILTER_GAINS); }
+        void set_gain_schedule_input(GainScheduleInput value) { gain_schedule_input = value; parent->dirty_.mark(DIRTY_GAIN_SCHEDULE); }
+    };
+
+    // Setpoint update from a communication thread. Fields that are not set
+    // keep their current value.
+    struct InputCommand {
+        std::optional<float> pos;
+        std::optional<float> pos_increment; // added to the base position when the command is taken, unless pos is set
+        bool increment_from_setpoint = false; // base position is pos_setpoint_ instead of input_pos_
+        std::optional<float> vel;
+        std::optional<float> torque;
     };
 
     Controller() {}
     
     bool apply_config();
+    void apply_dirty_config();
 
     void reset();
     void set_error(Error error);
 
+    // Ramps the velocity to 0 at decel [turn/s^2], overriding the input mode
+    // until reset()
+    void start_fast_stop(float decel);
+    bool fast_stop_done() { return fast_stop_active_ && fast_stop_vel_ == 0.0f; }
+
     constexpr void input_pos_updated() {
         input_pos_updated_ = true;
     }
 
+    void set_input(std::optional<float> pos, std::optional<float> vel, std::optional<float> torque);
+    void apply_input_command();
+
     bool select_encoder(size_t encoder_num);
 
     // Trajectory-Planned control
     void move_to_pos(float goal_point);
+    void start_coordinated_move(float goal_point, float vel_limit, float accel_limit, float decel_limit);
     void move_incremental(float displacement, bool from_goal_point);
+
+    // Streamed trajectory (INPUT_MODE_PVT)
+    bool push_pvt_point(float duration, float pos, float vel, float torque);
+    void clear_pvt_buffer() { pvt_buffer_.request_clear(); }
+    bool pvt_buffer_low() { return pvt_buffer_.level() <= config_.pvt_low_watermark; }
+
+    // Blended moves, planned into the INPUT_MODE_PVT buffer
+    bool queue_move(float pos) { return move_queue_.push(pos); }
+    void clear_move_queue() { move_queue_.request_clear(); }
+    void plan_moves();
+
+    // Cam table (INPUT_MODE_CAM)
+    bool set_cam_point(uint32_t index, float pos);
+    float get_cam_point(uint32_t index) { return index < CAM_TABLE_SIZE ? config_.cam_table[index] : 0.0f; }
+
+    // Iterative learning control
+    void clear_learning_table();
+    float get_learning_point(uint32_t index) { return index < LEARNING_TABLE_SIZE ? learning_table_.values[index] : 0.0f; }
+    void learning_step();
+    bool update_learning_phase();
+
+    // Gain tuning from the last frequency response measurement
+    bool autotune(float bandwidth, float phase_margin);
     
     // TODO: make this more similar to other calibration loops
     void start_anticogging_calibration();
+    uint32_t start_anticogging_calibration_async();
+    void update_anticogging_operation();
     bool anticogging_calibration(float pos_estimate, float vel_estimate);
+    bool anticogging_sweep_calibration(float pos_estimate);
+    bool sweep_step(float dir, float vel, float length);
+    void start_friction_calibration();
+    bool friction_calibration(float pos_estimate);
+    void anticogging_fit_step();
+    float anticogging_torque(float pos);
 
     void update_filter_gains();
+    void update_gain_schedule();
     bool update();
 
+    // Output of the input mode, the input of the control law
+    struct Setpoints {
+        float pos; // [turn]
+        float vel; // [turn/s]
+        float torque; // [Nm]
+    };
+
+    template<ControlMode kMode, bool kCircular, bool kGainSchedule>
+    bool update_control_law(const Setpoints& setpoints, std::optional<float> anticogging_pos_estimate);
+    bool update_state_feedback(const Setpoints& setpoints, std::optional<float> anticogging_pos_estimate);
+
     Config_t config_;
+    DirtyFlags dirty_; // see DirtyFlag
     Axis* axis_ = nullptr; // set by Axis constructor
 
     Error error_ = ERROR_NONE;
 
+    float update_period_ = DEFAULT_CURRENT_MEAS_PERIOD; // [s] set by Axis::update_control_pipeline()
+
     // Inputs
     InputPort<float> pos_estimate_linear_src_;
+    InputPort<TurnPosition> pos_estimate_linear_turns_src_; // optional, used instead of pos_estimate_linear_src_ in the position error
     InputPort<float> pos_estimate_circular_src_;
     InputPort<float> vel_estimate_src_;
+    InputPort<float> accel_estimate_src_; // [turn/s^2] only used by the state feedback
+    InputPort<float> twist_src_; // [turn] of the transmission, only connected with the encoder fusion
+    InputPort<float> twist_vel_src_; // [turn/s] of the transmission, only connected with the encoder fusion
     InputPort<float> pos_wrap_src_; 
 
     float pos_setpoint_ = 0.0f; // [turns]
     float vel_setpoint_ = 0.0f; // [turn/s]
+    float accel_setpoint_ = 0.0f; // [turn/s^2] feedforward for the encoder PLL
     // float vel_setpoint = 800.0f; <sensorless example>
     float vel_integrator_torque_ = 0.0f;    // [Nm]
     float torque_setpoint_ = 0.0f;  // [Nm]
@@ -93,16 +284,82 @@ public:
     float input_filter_ki_ = 0.0f;
 
     bool input_pos_updated_ = false;
+
+    bool fast_stop_active_ = false;
+    float fast_stop_decel_ = 0.0f; // [turn/s^2]
+    float fast_stop_pos_ = 0.0f; // [turn]
+    float fast_stop_vel_ = 0.0f; // [turn/s]
+
+    // Written by the communication threads, applied at the start of update().
+    Mailbox<InputCommand> input_mailbox_;
+    bool hold_inputs_ = false; // keeps the commands in input_mailbox_ while the mechanical brake opens
     
     bool trajectory_done_ = true;
+    SCurveTrajectory scurve_traj_; // planned with the limits in axis_->trap_traj_.config_
+    PvtBuffer pvt_buffer_;
+    bool pvt_started_ = false; // false until INPUT_MODE_PVT ran once since it was selected
+    MoveQueue<MOVE_QUEUE_SIZE> move_queue_;
+    float planned_pos_ = 0.0f; // [turn] end of the moves in pvt_buffer_
+    float planned_vel_ = 0.0f; // [turn/s] velocity at planned_pos_
+    bool moves_planned_ = false; // true while pvt_buffer_ holds points of plan_moves(), which is its only writer then
+    CamFollower cam_follower_;
+    bool cam_started_ = false; // false until INPUT_MODE_CAM ran once since it was selected
+    InputShaper<INPUT_SHAPER_BUFFER_SIZE> input_shaper_; // shapes the setpoints of the trajectory and filter input modes
+
+    DisturbanceObserver disturbance_observer_;
+    float last_torque_ = 0.0f; // [Nm] torque_output_ of the previous update, input of the disturbance observer
+
+    StateFeedback state_feedback_;
+
+    GainSchedule<GAIN_SCHEDULE_SIZE> gain_schedule_; // copy of config_.gain_schedule with precomputed slopes
+    bool gain_schedule_active_ = false; // false if disabled or if the breakpoints are not sorted
+
+    float autotune_friction_ = 0.0f; // [Nm/(turn/s)]
+    float autotune_delay_ = 0.0f; // [s]
 
     bool anticogging_valid_ = false;
+    CoggingMap_t cogging_map_;
+    bool cogging_map_loaded_ = false; // set once the map was loaded from NVM or a calibration started
+
+    IterativeLearning<LEARNING_TABLE_SIZE> learning_;
+    LearningTable_t learning_table_; // stored in NVM like cogging_map_
+    bool learning_table_loaded_ = false; // set once the table was loaded from NVM or cleared
+    bool learning_started_ = false; // false until the learning ran once since it was enabled
+    bool learning_active_ = false; // true if learning_phase_ is valid in this control loop iteration
+    float learning_phase_ = 0.0f; // [0, 1) of the cycle
+    float learning_time_ = 0.0f; // [s] since the start of the cycle (LEARNING_PHASE_SOURCE_TIME)
+    CamFollower learning_cycle_; // cycle of the master axis (LEARNING_PHASE_SOURCE_MASTER_POSITION)
+    bool anticogging_fit_pending_ = false; // set when the calibration finished, cleared by anticogging_fit_step()
+    uint32_t anticogging_operation_ = 0; // see start_anticogging_calibration_async()
+    bool anticogging_fitting_ = false;
+    CoggingHarmonicFit anticogging_fit_;
+
+    // Sweep calibration state, shared by the anticogging and the friction calibration
+    uint32_t sweep_pass_ = 0; // 0: not started, 1: forward, 2: backward
+    float sweep_start_ = 0.0f; // [turn] start of the current pass
+    float anticogging_sweep_bwd_[ANTICOGGING_MAP_SIZE]; // [Nm] mean torque of the backward pass
+    uint16_t anticogging_sweep_count_[ANTICOGGING_MAP_SIZE]; // samples per bin in the current pass
+
+    // Friction calibration state
+    uint32_t friction_calib_step_ = 0; // index of the velocity
+    uint32_t friction_calib_count_ = 0; // samples of the current pass
+    float friction_calib_mean_ = 0.0f; // [Nm] mean torque of the current pass
+    float friction_calib_fwd_ = 0.0f; // [Nm] mean torque of the forward pass
+    float friction_calib_vel_[FRICTION_CALIB_VELOCITIES]; // [turn/s]
+    float friction_calib_torque_[FRICTION_CALIB_VELOCITIES]; // [Nm] friction at friction_calib_vel_
+    float friction_calib_reversal_[FRICTION_REVERSAL_BINS]; // [Nm] mean torque after the slowest reversal
+    uint16_t friction_calib_reversal_count_[FRICTION_REVERSAL_BINS];
+    float friction_calib_backlash_ = 0.0f; // [turn]
+
+    float backlash_offset_ = 0.0f; // [turn] added to the position error, see update_backlash_offset()
 
     // Outputs
     OutputPort<float> torque_output_ = 0.0f;
 
     // custom setters
-    void set_input_pos(float value) { input_pos_ = value; input_pos_updated(); }
+    void set_input_pos(float value) { set_input(value, std::nullopt, std::nullopt); }
+    void set_input_vel(float value) { set_input(std::nullopt, value, std::nullopt); }
+    void set_input_torque(float value) { set_input(std::nullopt, std::nullopt, value); }
 };
 
 #endif // __CONTROLLER_HPP
@@ -0,0 +1,44 @@
+#ifndef __DIRTY_FLAGS_HPP
+#define __DIRTY_FLAGS_HPP
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Set of derived quantities (gains, precomputed constants) that are out
+ * of date because a config value they depend on was written.
+ *
+ * Property setters mark the quantities that depend on the written value from
+ * any thread. The control loop takes all marks at its start and recomputes
+ * each marked quantity once, so a burst of writes by a tuning tool costs one
+ * recomputation and the control stages never run with gains that were
+ * computed from a half written set of config values.
+ *
+ * Marking is a single atomic OR, so marks from different threads are never
+ * lost. A mark that races with take() is either taken in this iteration or in
+ * the next one.
+ */
+class DirtyFlags {
+public:
+    void mark(uint32_t flags) {
+        flags_.fetch_or(flags, std::memory_order_relaxed);
+    }
+
+    // @brief Returns the marked flags and clears them
+    uint32_t take() {
+        // Cheaper than the exchange in the common case of nothing to do
+        if (!flags_.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        return flags_.exchange(0, std::memory_order_relaxed);
+    }
+
+    bool any() const {
+        return flags_.load(std::memory_order_relaxed) != 0;
+    }
+
+private:
+    std::atomic<uint32_t> flags_{0};
+};
+
+#endif // __DIRTY_FLAGS_HPP
@@ -0,0 +1,51 @@
+#ifndef __DISTURBANCE_OBSERVER_HPP
+#define __DISTURBANCE_OBSERVER_HPP
+
+#include <cmath>
+
+/**
+ * @brief Estimates the load torque from the torque command and the measured
+ * acceleration of a rigid inertia:
+ *   inertia * accel = torque + disturbance
+ *
+ * The raw estimate inertia * accel - torque is low pass filtered with the
+ * observer bandwidth. Subtracting the estimate from the next torque command
+ * cancels load changes below the bandwidth without relying on the velocity
+ * integrator.
+ */
+class DisturbanceObserver {
+public:
+    void reset() {
+        valid_ = false;
+        estimate_ = 0.0f;
+    }
+
+    /**
+     * @param vel: Velocity estimate [turn/s]
+     * @param prev_torque: Torque command of the previous update, i.e. the one
+     *        that caused the change in velocity [Nm]
+     * @param inertia: [Nm/(turn/s^2)]
+     * @param bandwidth: [rad/s]
+     * @param dt: Time since the previous update [s]
+     * @returns the estimated disturbance torque [Nm]
+     */
+    float update(float vel, float prev_torque, float inertia, float bandwidth, float dt) {
+        if (valid_) {
+            float raw = inertia * (vel - prev_vel_) / dt - prev_torque;
+            float k = 1.0f - std::exp(-bandwidth * dt);
+            estimate_ += k * (raw - estimate_);
+        }
+        prev_vel_ = vel;
+        valid_ = true;
+        return estimate_;
+    }
+
+    float estimate() const { return estimate_; }
+
+private:
+    bool valid_ = false;
+    float prev_vel_ = 0.0f;
+    float estimate_ = 0.0f; // [Nm]
+};
+
+#endif // __DISTURBANCE_OBSERVER_HPP
@@ -0,0 +1,113 @@
+#ifndef __EDGE_VELOCITY_ESTIMATOR_HPP
+#define __EDGE_VELOCITY_ESTIMATOR_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <optional>
+
+/**
+ * @brief Velocity estimator for low resolution encoders (e.g. hall sensors)
+ * based on the time between encoder edges (M/T method).
+ *
+ * The edges are timestamped with the sample on which they were first seen.
+ * The velocity is the number of counts between the oldest and the newest
+ * edge in the window divided by the time between the two. With hall sensors
+ * a window of 6 edges spans exactly one electrical revolution, so that
+ * placement errors of the individual sensors cancel out.
+ *
+ * While no new edge arrives the estimate is limited to one count per time
+ * since the last edge, so it decays towards zero when the motor stops.
+ */
+class EdgeVelocityEstimator {
+public:
+    static constexpr size_t MAX_WINDOW = 8;
+
+    struct Config_t {
+        uint32_t window = 6; // number of edges to average over, in [1, MAX_WINDOW]
+        uint32_t timeout = 8000; // [samples] the motor is considered stopped after this long without an edge
+    };
+
+    void reset() {
+        n_edges_ = 0;
+        direction_ = 0;
+        stopped_ = false;
+    }
+
+    /**
+     * @brief Must be called once per sample with the number of counts that
+     * the encoder moved since the last sample.
+     */
+    void update(int32_t delta_counts) {
+        ticks_++;
+
+        if (delta_counts != 0) {
+            int32_t direction = delta_counts > 0 ? 1 : -1;
+            if (direction != direction_) {
+                // Intervals across a reversal are meaningless
+                n_edges_ = 0;
+                direction_ = direction;
+            }
+
+            size_t window = window_size();
+            if (n_edges_ == window + 1) {
+                for (size_t i = 0; i < window; ++i) {
+                    edges_[i] = edges_[i + 1];
+                }
+                n_edges_--;
+            }
+            counts_ += delta_counts;
+            edges_[n_edges_++] = {ticks_, counts_};
+            stopped_ = false;
+        } else if (n_edges_ > 0 && (ticks_ - edges_[n_edges_ - 1].tick) >= config_.timeout) {
+            n_edges_ = 0;
+            direction_ = 0;
+            stopped_ = true;
+        }
+    }
+
+    /**
+     * @brief Returns the velocity in counts per sample or std::nullopt if not
+     * enough edges were seen yet.
+     */
+    std::optional<float> get_velocity() {
+        if (stopped_) {
+            return 0.0f;
+        }
+        if (n_edges_ < 2) {
+            return std::nullopt;
+        }
+
+        const Edge& first = edges_[0];
+        const Edge& last = edges_[n_edges_ - 1];
+        float vel = (float)(last.counts - first.counts) / (float)(last.tick - first.tick);
+
+        // The motor can't be faster than one count since the last edge,
+        // otherwise we would have seen the next edge already.
+        uint32_t ticks_since_edge = ticks_ - last.tick;
+        if (ticks_since_edge > 0 && std::abs(vel) * (float)ticks_since_edge > 1.0f) {
+            vel = (float)direction_ / (float)ticks_since_edge;
+        }
+        return vel;
+    }
+
+    Config_t config_;
+
+private:
+    struct Edge {
+        uint32_t tick;
+        int32_t counts;
+    };
+
+    size_t window_size() {
+        return config_.window < 1 ? 1 : config_.window > MAX_WINDOW ? MAX_WINDOW : config_.window;
+    }
+
+    Edge edges_[MAX_WINDOW + 1];
+    size_t n_edges_ = 0;
+    int32_t direction_ = 0;
+    bool stopped_ = false;
+    uint32_t ticks_ = 0; // wraps around, only differences are used
+    int32_t counts_ = 0; // wraps around, only differences are used
+};
+
+#endif // __EDGE_VELOCITY_ESTIMATOR_HPP
@@ -0,0 +1,117 @@
+#ifndef __ELECTRONIC_GEARING_HPP
+#define __ELECTRONIC_GEARING_HPP
+
+#include <cmath>
+#include "utils.hpp"
+
+/**
+ * @brief Returns master * num / den.
+ *
+ * The whole turns are multiplied in integer arithmetic, so unlike a float
+ * ratio the result does not drift away from the exact ratio as the master
+ * position grows.
+ */
+inline TurnPosition gear_rational(TurnPosition master, int32_t num, uint32_t den) {
+    int64_t t = (int64_t)master.turns * num;
+    int64_t q = t / (int64_t)den;
+    int64_t r = t - q * (int64_t)den;
+    if (r < 0) { // floor division
+        q -= 1;
+        r += den;
+    }
+    float f = ((float)r + master.fraction * (float)num) / (float)den;
+    float whole = std::floor(f);
+    return {(int32_t)(q + (int64_t)whole), f - whole};
+}
+
+/**
+ * @brief Follows a cam table that maps the phase of a master axis to a slave
+ * position.
+ *
+ * One cam cycle spans `period` turns of the master. The table holds the slave
+ * positions at `n` equally spaced master phases of the cycle. At the end of a
+ * cycle the slave has moved by `rise` (0 for a reciprocating cam), so point
+ * `n` of the table is implicitly point 0 plus `rise`. Between points the
+ * position follows a Catmull-Rom spline so that the velocity feedforward,
+ * which is the derivative of the spline, is continuous.
+ *
+ * The start of the current cycle is kept as a TurnPosition and only moves by
+ * whole periods, so the phase is computed from a small difference and keeps
+ * its resolution on long runs. It is exact if `period` is a whole number of
+ * turns or a binary fraction of a turn.
+ */
+class CamFollower {
+public:
+    struct Output {
+        float pos; // [turn]
+        float vel; // [turn/s]
+    };
+
+    // Sets the cycle counter such that the cycle starting at `offset` [turn]
+    // of the master position is number 0.
+    void start(TurnPosition master, float period, float offset) {
+        float rel = master.to_float() - offset;
+        int32_t k = (int32_t)std::floor(rel / period);
+        float origin = offset + (float)k * period;
+        float whole = std::floor(origin);
+        origin_ = {(int32_t)whole, origin - whole};
+        cycle_ = k;
+    }
+
+    // Moves the cycle to the one that contains the master position and
+    // returns the phase within it [0, period)
+    float advance(TurnPosition master, float period) {
+        float phase = (float)(master.turns - origin_.turns) + (master.fraction - origin_.fraction);
+        float k = std::floor(phase / period);
+        if (k != 0.0f) {
+            float f = origin_.fraction + k * period;
+            float whole = std::floor(f);
+            origin_.turns += (int32_t)whole;
+            origin_.fraction = f - whole;
+            cycle_ += (int32_t)k;
+            phase -= k * period;
+        }
+        return phase;
+    }
+
+    Output update(TurnPosition master, float master_vel, const float* table, size_t n, float period, float rise) {
+        float phase = advance(master, period);
+
+        float u = std::clamp(phase / period, 0.0f, 1.0f) * (float)n;
+        size_t i = std::min((size_t)u, n - 1);
+        float t = u - (float)i;
+
+        float p0 = point(table, n, rise, (int32_t)i - 1);
+        float p1 = point(table, n, rise, (int32_t)i);
+        float p2 = point(table, n, rise, (int32_t)i + 1);
+        float p3 = point(table, n, rise, (int32_t)i + 2);
+        float m1 = 0.5f * (p2 - p0);
+        float m2 = 0.5f * (p3 - p1);
+
+        float t2 = t * t;
+        float t3 = t2 * t;
+        float pos = (2.0f * t3 - 3.0f * t2 + 1.0f) * p1 + (t3 - 2.0f * t2 + t) * m1
+                  + (-2.0f * t3 + 3.0f * t2) * p2 + (t3 - t2) * m2;
+        float dpos_du = (6.0f * t2 - 6.0f * t) * p1 + (3.0f * t2 - 4.0f * t + 1.0f) * m1
+                      + (-6.0f * t2 + 6.0f * t) * p2 + (3.0f * t2 - 2.0f * t) * m2;
+
+        return {
+            (float)cycle_ * rise + pos,
+            dpos_du * (float)n / period * master_vel
+        };
+    }
+
+    int32_t cycle() const { return cycle_; }
+
+private:
+    // Point j of the periodic extension of the table
+    static float point(const float* table, size_t n, float rise, int32_t j) {
+        int32_t wraps = j < 0 ? -1 : j / (int32_t)n;
+        return table[j - wraps * (int32_t)n] + (float)wraps * rise;
+    }
+
+    TurnPosition origin_ = {0, 0.0f}; // master position at the start of the current cycle
+    int32_t cycle_ = 0;
+};
+
+#endif // __ELECTRONIC_GEARING_HPP
@@ -16,10 +16,16 @@ static void enc_index_cb_wrapper(void* ctx) {
     reinterpret_cast<Encoder*>(ctx)->enc_index_cb();
 }
 
+static void index_latch_cb_wrapper(void* ctx) {
+    reinterpret_cast<Encoder*>(ctx)->index_latch_cb();
+}
+
 bool Encoder::apply_config(ODriveIntf::MotorIntf::MotorType motor_type) {
     config_.parent = this;
 
     update_pll_gains();
+    update_cpr_constants();
+    update_edge_vel_config();
 
     if (config_.pre_calibrated) {
         if (config_.mode == Encoder::MODE_HALL || config_.mode == Encoder::MODE_SINCOS)
@@ -31,6 +37,24 @@ bool Encoder::apply_config(ODriveIntf::MotorIntf::MotorType motor_type) {
     return true;
 }
 
+/**
+ * @brief Recomputes the derived quantities that the config setters marked as
+ * out of date. Called by the control loop before the sensor stages, so that
+ * they don't change in the middle of an update().
+ */
+void Encoder::apply_dirty_config() {
+    uint32_t dirty = dirty_.take();
+    if (dirty & DIRTY_PLL_GAINS) {
+        update_pll_gains();
+    }
+    if (dirty & DIRTY_CPR_CONSTANTS) {
+        update_cpr_constants();
+    }
+    if (dirty & DIRTY_EDGE_VEL_CONFIG) {
+        update_edge_vel_config();
+    }
+}
+
 void Encoder::setup() {
     HAL_TIM_Encoder_Start(timer_, TIM_CHANNEL_ALL);
     set_idx_subscribe();
@@ -41,18 +65,33 @@ void Encoder::setup() {
         .Mode = SPI_MODE_MASTER,
         .Direction = SPI_DIRECTION_2LINES,
         .DataSize = SPI_DATASIZE_16BIT,
-        .CLKPolarity = mode_ == MODE_SPI_ABS_AEAT ? SPI_POLARITY_HIGH : SPI_POLARITY_LOW,
+        .CLKPolarity = (mode_ == MODE_SPI_ABS_AEAT || mode_ == MODE_SPI_ABS_SSI || mode_ == MODE_SPI_ABS_BISSC) ? SPI_POLARITY_HIGH : SPI_POLARITY_LOW,
         .CLKPhase = SPI_PHASE_2EDGE,
         .NSS = SPI_NSS_SOFT,
-        .BaudRatePrescaler = SPI_BAUDRATEPRESCALER_32,
+        // The SSI and BiSS-C frames are longer, use a faster clock for them
+        .BaudRatePrescaler = (mode_ == MODE_SPI_ABS_SSI || mode_ == MODE_SPI_ABS_BISSC) ? SPI_BAUDRATEPRESCALER_16 : SPI_BAUDRATEPRESCALER_32,
         .FirstBit = SPI_FIRSTBIT_MSB,
         .TIMode = SPI_TIMODE_DISABLE,
         .CRCCalculation = SPI_CRCCALCULATION_DISABLE,
         .CRCPolynomial = 10,
     };
 
+    // Number of 16-bit words to clock in per sample
+    if (mode_ == MODE_SPI_ABS_SSI) {
+        abs_spi_words_ = (1 + config_.abs_spi_pos_bits + 15) / 16;
+    } else if (mode_ == MODE_SPI_ABS_BISSC) {
+        // Leaves up to 6 bits for the ack period
+        abs_spi_words_ = (config_.abs_spi_pos_bits + 16 + 15) / 16;
+    } else {
+        abs_spi_words_ = 1;
+    }
+    if (abs_spi_words_ > ABS_SPI_MAX_WORDS) {
+        abs_spi_words_ = ABS_SPI_MAX_WORDS;
+    }
+
     if(mode_ & MODE_FLAG_ABS){
         abs_spi_cs_pin_init();
+        setup_abs_spi_chain();
 
         if (axis_->controller_.config_.anticogging.pre_calibrated) {
             axis_->controller_.anticogging_valid_ = true;
@@ -61,6 +100,9 @@ void Encoder::setup() {
 }
 
 void Encoder::set_error(Error error) {
+    if (Error new_errors = error & ~error_) {
+        event_log.record(EventLog::SOURCE_ENCODER, axis_->axis_num_, new_errors);
+    }
     vel_estimate_valid_ = false;
     pos_estimate_valid_ = false;
     error_ |= error;
@@ -79,9 +121,12 @@ bool Encoder::do_checks(){
 // (maybe by attaching the interrupt on start search, synergistic with following)
 void Encoder::enc_index_cb() {
     if (config_.use_index) {
+        int64_t shadow_count = shadow_count_;
+        index_phase_shift_ = count_in_cpr_;
         set_circular_count(0, false);
         if (config_.zero_count_on_find_idx)
             set_linear_count(0); // Avoid position control transient after search
+        index_count_shift_ = shadow_count - shadow_count_;
         if (config_.pre_calibrated) {
             is_ready_ = true;
             if(axis_->controller_.config_.anticogging.pre_calibrated){
@@ -100,6 +145,40 @@ void Encoder::enc_index_cb() {
     index_gpio_.unsubscribe();
 }
 
+// @brief Latches the count at the next index pulse without touching the
+// encoder state (used by homing). Fails if the encoder has no hardware
+// counter or the index search is still pending.
+bool Encoder::arm_index_latch() {
+    index_latched_ = false;
+    index_latch_armed_ = (mode_ == MODE_INCREMENTAL)
+            && index_gpio_.subscribe(true, false, index_latch_cb_wrapper, this);
+    return index_latch_armed_;
+}
+
+void Encoder::index_latch_cb() {
+    int16_t cnt;
+    if (!index_latched_ && sample_hw_count(&cnt)) {
+        index_latched_cnt_ = cnt;
+        index_latched_ = true;
+    }
+}
+
+void Encoder::disarm_index_latch() {
+    if (index_latch_armed_) {
+        index_gpio_.unsubscribe();
+        index_latch_armed_ = false;
+    }
+}
+
+// @brief Returns the linear count of the latched index pulse. Must be polled
+// while the index is less than half a counter period behind.
+std::optional<int64_t> Encoder::get_index_latch() {
+    if (!index_latched_) {
+        return std::nullopt;
+    }
+    return get_linear_count_at(index_latched_cnt_);
+}
+
 void Encoder::set_idx_subscribe(bool override_enable) {
     if (config_.use_index && (override_enable || !config_.find_idx_on_lockin_only)) {
         if (!index_gpio_.subscribe(true, false, enc_index_cb_wrapper, this)) {
@@ -111,8 +190,18 @@ void Encoder::set_idx_subscribe(bool override_enable) {
 }
 
 void Encoder::update_pll_gains() {
-    pll_kp_ = 2.0f * config_.bandwidth;  // basic conversion to discrete time
-    pll_ki_ = 0.25f * (pll_kp_ * pll_kp_); // Critically damped
+    if (config_.pll_accel_enable) {
+        // Triple pole at -bandwidth: (s + w)^3 = s^3 + 3w s^2 + 3w^2 s + w^3
+        float w = config_.bandwidth;
+        pll_kp_ = 3.0f * w;
+        pll_ki_ = 3.0f * w * w;
+        pll_ka_ = w * w * w;
+    } else {
+        pll_kp_ = 2.0f * config_.bandwidth;  // basic conversion to discrete time
+        pll_ki_ = 0.25f * (pll_kp_ * pll_kp_); // Critically damped
+        pll_ka_ = 0.0f;
+        accel_estimate_counts_ = 0.0f;
+    }
 
     // Check that we don't get problems with discrete time approximation
     if (!(current_meas_period * pll_kp_ < 1.0f)) {
@@ -120,6 +209,24 @@ void Encoder::update_pll_gains() {
     }
 }
 
+void Encoder::update_edge_vel_config() {
+    edge_vel_estimator_.config_.window = config_.edge_vel_window;
+    // Below 1% of the blend speed the motor is considered stopped
+    float timeout = 100.0f / (config_.edge_vel_blend_speed * current_meas_period);
+    edge_vel_estimator_.config_.timeout = (timeout > 0.0f && timeout < (float)INT32_MAX) ? (uint32_t)timeout : INT32_MAX;
+    edge_vel_estimator_.reset();
+}
+
+// @brief Precomputes the constants that the update() function needs so that it
+// doesn't have to divide by the CPR on every iteration.
+void Encoder::update_cpr_constants() {
+    int32_t cpr = config_.cpr;
+    bool is_pow2 = (cpr > 0) && ((cpr & (cpr - 1)) == 0);
+    inv_cpr_ = 1.0f / (float)cpr;
+    two_pi_by_cpr_ = (2.0f * M_PI) * inv_cpr_;
+    cpr_mask_ = is_pow2 ? (cpr - 1) : 0;
+}
+
 void Encoder::check_pre_calibrated() {
     // TODO: restoring config from python backup is fragile here (ACIM motor type must be set first)
     if (!is_ready_ && axis_->motor_.config_.motor_type != Motor::MOTOR_TYPE_ACIM)
@@ -128,6 +235,56 @@ void Encoder::check_pre_calibrated() {
         config_.pre_calibrated = false;
 }
 
+/**
+ * @brief Returns the current position for the NVM backup. Only valid for
+ * absolute encoders that have a position and don't wait for a restore.
+ */
+Encoder::PositionBackup_t Encoder::get_position_backup() {
+    PositionBackup_t backup;
+    CRITICAL_SECTION() {
+        backup = {
+            .valid = (mode_ & MODE_FLAG_ABS) != 0 && is_ready_ && !position_restore_pending_,
+            .homed = axis_->homing_.is_homed,
+            .count_in_cpr = count_in_cpr_,
+            .shadow_count = shadow_count_,
+        };
+    }
+    return backup;
+}
+
+/**
+ * @brief Continues from the position in position_backup_ if the first
+ * single-turn reading after boot is close enough to the saved one.
+ * Otherwise the axis keeps the single-turn position and must be homed.
+ * Called from update() with the first sample of the absolute encoder.
+ */
+void Encoder::restore_position(int32_t count_in_cpr) {
+    position_restore_pending_ = false;
+    int32_t delta = wrap_cpr(count_in_cpr - position_backup_.count_in_cpr);
+    if (delta > config_.cpr / 2) {
+        delta -= config_.cpr;
+    }
+    if ((float)std::abs(delta) > config_.persist_position_tolerance * (float)config_.cpr) {
+        return;
+    }
+
+    int64_t count = position_backup_.shadow_count + delta;
+    int64_t turns = count / config_.cpr;
+    int32_t count_in_turn = (int32_t)(count - turns * config_.cpr);
+    if (count_in_turn < 0) {
+        count_in_turn += config_.cpr;
+        turns--;
+    }
+    shadow_count_ = count;
+    count_in_cpr_ = count_in_cpr;
+    pll_turns_ = (int32_t)turns;
+    pll_count_in_turn_ = count_in_turn;
+    pll_count_fraction_ = 0.0f;
+    pos_cpr_counts_ = (float)count_in_cpr;
+    axis_->homing_.is_homed = position_backup_.homed;
+    position_restored_ = true;
+}
+
 // Function that sets the current encoder count to a desired 32-bit value.
 void Encoder::set_linear_count(int32_t count) {
     // Disable interrupts to make a critical section to avoid race condition
@@ -135,7 +292,9 @@ void Encoder::set_linear_count(int32_t count) {
 
     // Update states
     shadow_count_ = count;
-    pos_estimate_counts_ = (float)count;
+    pll_count_in_turn_ = wrap_cpr(count);
+    pll_turns_ = (count - pll_count_in_turn_) / config_.cpr;
+    pll_count_fraction_ = 0.0f;
     tim_cnt_sample_ = count;
 
     //Write hardware last
@@ -172,7 +331,7 @@ bool Encoder::run_index_search() {
 }
 
 bool Encoder::run_direction_find() {
-    int32_t init_enc_val = shadow_count_;
+    int64_t init_enc_val = shadow_count_;
 
     Axis::LockinConfig_t lockin_config = axis_->config_.calibration_lockin;
     lockin_config.finish_distance = lockin_config.vel * 3.0f; // run for 3 seconds
@@ -197,22 +356,10 @@ bool Encoder::run_direction_find() {
     return success;
 }
 
-// @brief Turns the motor in one direction for a bit and then in the other
-// direction in order to find the offset between the electrical phase 0
-// and the encoder state 0.
-bool Encoder::run_offset_calibration() {
-    const float start_lock_duration = 1.0f;
-
-    // Require index found if enabled
-    if (config_.use_index && !index_found_) {
-        set_error(ERROR_INDEX_NOT_FOUND_YET);
-        return false;
-    }
-
-    // We use shadow_count_ to do the calibration, but the offset is used by count_in_cpr_
-    // Therefore we have to sync them for calibration
-    shadow_count_ = count_in_cpr_;
-
+// @brief Locks the rotor to the specified electrical phase using the open loop
+// controller with the calibration current. On success the motor is left
+// armed so that the caller can start a scan by setting the target velocity.
+bool Encoder::start_open_loop_scan(float initial_phase, float start_lock_duration) {
     CRITICAL_SECTION() {
         // Reset state variables
         axis_->open_loop_controller_.Idq_setpoint_ = {0.0f, 0.0f};
@@ -228,7 +375,7 @@ bool Encoder::run_offset_calibration() {
         axis_->open_loop_controller_.target_voltage_ = axis_->motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL ? 0.0f : axis_->motor_.config_.calibration_current;
         axis_->open_loop_controller_.target_vel_ = 0.0f;
         axis_->open_loop_controller_.total_distance_ = 0.0f;
-        axis_->open_loop_controller_.phase_ = axis_->open_loop_controller_.initial_phase_ = wrap_pm_pi(0 - config_.calib_scan_distance / 2.0f);
+        axis_->open_loop_controller_.phase_ = axis_->open_loop_controller_.initial_phase_ = initial_phase;
 
         axis_->motor_.current_control_.enable_current_control_src_ = (axis_->motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL);
         axis_->motor_.current_control_.Idq_setpoint_src_.connect_to(&axis_->open_loop_controller_.Idq_setpoint_);
@@ -245,7 +392,7 @@ bool Encoder::run_offset_calibration() {
 
     axis_->motor_.arm(&axis_->motor_.current_control_);
 
-    // go to start position of forward scan for start_lock_duration to get ready to scan
+    // go to the start position and hold it for start_lock_duration
     for (size_t i = 0; i < (size_t)(start_lock_duration * 1000.0f); ++i) {
         if (!axis_->motor_.is_armed_) {
             return false; // TODO: return "disarmed" error code
@@ -257,8 +404,41 @@ bool Encoder::run_offset_calibration() {
         osDelay(1);
     }
 
+    return true;
+}
+
+// @brief Returns shadow_count_ in the frame of the start of the offset
+// calibration, also if the index was found meanwhile and reset the count.
+int64_t Encoder::get_calib_count() {
+    int64_t count;
+    CRITICAL_SECTION() {
+        count = shadow_count_ + index_count_shift_;
+    }
+    return count;
+}
+
+// @brief Turns the motor in one direction for a bit and then in the other
+// direction in order to find the offset between the electrical phase 0
+// and the encoder state 0.
+bool Encoder::run_offset_calibration() {
+    const float start_lock_duration = 1.0f;
+
+    // Require index found if enabled
+    if (config_.use_index && !index_found_ && !find_idx_during_calib_) {
+        set_error(ERROR_INDEX_NOT_FOUND_YET);
+        return false;
+    }
+
+    // We use shadow_count_ to do the calibration, but the offset is used by count_in_cpr_
+    // Therefore we have to sync them for calibration
+    shadow_count_ = count_in_cpr_;
+    index_count_shift_ = 0;
+
+    if (!start_open_loop_scan(wrap_pm_pi(0 - config_.calib_scan_distance / 2.0f), start_lock_duration)) {
+        return false;
+    }
 
-    int32_t init_enc_val = shadow_count_;
+    int64_t init_enc_val = get_calib_count();
     uint32_t num_steps = 0;
     int64_t encvaluesum = 0;
 
@@ -273,16 +453,17 @@ bool Encoder::run_offset_calibration() {
         if (reached_target_dist) {
             break;
         }
-        encvaluesum += shadow_count_;
+        encvaluesum += get_calib_count();
         num_steps++;
         osDelay(1);
     }
 
     // Check response and direction
-    if (shadow_count_ > init_enc_val + 8) {
+    int64_t scan_end_count = get_calib_count();
+    if (scan_end_count > init_enc_val + 8) {
         // motor same dir as encoder
         config_.direction = 1;
-    } else if (shadow_count_ < init_enc_val - 8) {
+    } else if (scan_end_count < init_enc_val - 8) {
         // motor opposite dir as encoder
         config_.direction = -1;
     } else {
@@ -295,7 +476,7 @@ bool Encoder::run_offset_calibration() {
     // Check CPR
     float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
     float expected_encoder_delta = config_.calib_scan_distance / elec_rad_per_enc;
-    calib_scan_response_ = std::abs(shadow_count_ - init_enc_val);
+    calib_scan_response_ = std::abs(scan_end_count - init_enc_val);
     if (std::abs(calib_scan_response_ - expected_encoder_delta) / expected_encoder_delta > config_.calib_range) {
         set_error(ERROR_CPR_POLEPAIRS_MISMATCH);
         axis_->motor_.disarm();
@@ -312,7 +493,7 @@ bool Encoder::run_offset_calibration() {
         if (reached_target_dist) {
             break;
         }
-        encvaluesum += shadow_count_;
+        encvaluesum += get_calib_count();
         num_steps++;
         osDelay(1);
     }
@@ -332,6 +513,298 @@ bool Encoder::run_offset_calibration() {
     return true;
 }
 
+// @brief Alternative to run_offset_calibration() for axes with limited
+// travel. Sweeps back and forth over the short distance
+// config_.calib_fit_distance around phase 0 and fits a straight line to the
+// encoder count against the commanded phase. The slope gives the direction
+// and checks the CPR, the count at phase 0 is the phase offset. The rotor
+// lag cancels out because both directions cover the same angles. The scan
+// stops as soon as the standard error of the offset is below
+// config_.calib_fit_tolerance.
+bool Encoder::run_offset_fit() {
+    const float start_lock_duration = 1.0f;
+    const size_t max_passes = 8;
+
+    // Require index found if enabled
+    if (config_.use_index && !index_found_ && !find_idx_during_calib_) {
+        set_error(ERROR_INDEX_NOT_FOUND_YET);
+        return false;
+    }
+
+    // Same as in run_offset_calibration()
+    shadow_count_ = count_in_cpr_;
+    index_count_shift_ = 0;
+
+    const float distance = config_.calib_fit_distance;
+    const float start_phase = -distance / 2.0f;
+    if (!start_open_loop_scan(wrap_pm_pi(start_phase), start_lock_duration)) {
+        return false;
+    }
+
+    int64_t init_enc_val = get_calib_count();
+    PhaseOffsetFit fit;
+    fit.reset();
+
+    CRITICAL_SECTION() {
+        axis_->open_loop_controller_.total_distance_ = 0.0f;
+    }
+
+    for (size_t pass = 0; pass < max_passes; ++pass) {
+        for (float vel: {config_.calib_scan_omega, -config_.calib_scan_omega}) {
+            CRITICAL_SECTION() {
+                axis_->open_loop_controller_.target_vel_ = vel;
+            }
+
+            while ((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_) {
+                float total_distance = axis_->open_loop_controller_.total_distance_.any().value_or(NAN);
+                if (vel > 0.0f ? !(total_distance < distance) : !(total_distance > 0.0f)) {
+                    break;
+                }
+                fit.update(start_phase + total_distance, (float)(get_calib_count() - init_enc_val));
+                osDelay(1);
+            }
+        }
+
+        if (!axis_->motor_.is_armed_ || axis_->requested_state_ != Axis::AXIS_STATE_UNDEFINED) {
+            axis_->motor_.disarm();
+            return false;
+        }
+
+        if (fit.is_valid() && fit.get_count_uncertainty(0.0f) < config_.calib_fit_tolerance) {
+            break;
+        }
+    }
+
+    axis_->motor_.disarm();
+
+    if (!fit.is_valid()) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+
+    // Check response and direction
+    float slope = fit.get_slope();
+    calib_scan_response_ = std::abs(slope * distance);
+    if (!(calib_scan_response_ > 8.0f)) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+    config_.direction = slope > 0.0f ? 1 : -1;
+
+    // Check CPR
+    float expected_slope = (float)config_.cpr / (2.0f * M_PI * (float)axis_->motor_.config_.pole_pairs);
+    if (std::abs(std::abs(slope) - expected_slope) / expected_slope > config_.calib_range) {
+        set_error(ERROR_CPR_POLEPAIRS_MISMATCH);
+        return false;
+    }
+
+    float offset = (float)init_enc_val + fit.get_count(0.0f);
+    config_.phase_offset = (int32_t)std::floor(offset);
+    config_.phase_offset_float = offset - (float)config_.phase_offset + 0.5f; // add 0.5 to center-align state to phase
+
+    is_ready_ = true;
+    return true;
+}
+
+// @brief Finds the index during the offset calibration sweep instead of in
+// a separate motion. The counts of the samples taken before the index are
+// corrected by the shift that the index applied (see get_calib_count())
+// and the resulting offset is moved into the frame of the index. If the
+// sweep doesn't pass the index, an index search follows.
+// If the encoder is pre-calibrated, the offset is already known relative to
+// the index so only the index search is run.
+bool Encoder::run_index_search_and_offset_calibration() {
+    if (config_.pre_calibrated) {
+        return run_index_search();
+    }
+
+    config_.use_index = true;
+    index_found_ = false;
+    set_idx_subscribe(true);
+
+    find_idx_during_calib_ = true;
+    bool success = config_.calib_fit_enable ? run_offset_fit() : run_offset_calibration();
+    find_idx_during_calib_ = false;
+    if (!success) {
+        set_idx_subscribe();
+        return false;
+    }
+
+    if (!index_found_ && !run_index_search()) {
+        return false;
+    }
+    if (!index_found_) {
+        set_error(ERROR_INDEX_NOT_FOUND_YET);
+        return false;
+    }
+
+    // The index invalidated the offset (see enc_index_cb()), restore it in
+    // the new frame.
+    config_.phase_offset = mod(config_.phase_offset - index_phase_shift_, config_.cpr);
+    is_ready_ = true;
+    return true;
+}
+
+// @brief Turns the motor by a whole number of mechanical turns in open loop and
+// fits the first two harmonics of the difference between the absolute encoder
+// reading and the commanded rotor position. This is mainly the result of an
+// off-axis or eccentric magnet mount.
+// The fitted error has no constant part so the phase offset stays valid.
+bool Encoder::run_eccentricity_calibration() {
+    const float start_lock_duration = 1.0f;
+    const int num_turns = 2; // [turn] mechanical
+
+    if (!(mode_ & MODE_FLAG_ABS)) {
+        set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
+        return false;
+    }
+
+    // Start at the present rotor position to avoid a jump
+    if (!start_open_loop_scan(phase_.any().value_or(0.0f), start_lock_duration)) {
+        return false;
+    }
+
+    float counts_per_rad = (float)config_.cpr / (2.0f * M_PI * (float)axis_->motor_.config_.pole_pairs);
+    float scan_distance = (float)num_turns * 2.0f * M_PI * (float)axis_->motor_.config_.pole_pairs; // [rad] electrical
+    int32_t start_count = pos_abs_;
+
+    // At constant velocity the 1ms samples are evenly spaced in angle so the
+    // harmonics can be fitted by correlation without a matrix solve.
+    uint32_t n = 0;
+    float sum_err = 0.0f;
+    float sum_basis[4] = {0.0f};
+    float sum_err_basis[4] = {0.0f};
+
+    CRITICAL_SECTION() {
+        axis_->open_loop_controller_.target_vel_ = config_.calib_scan_omega;
+        axis_->open_loop_controller_.total_distance_ = 0.0f;
+    }
+
+    while ((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_) {
+        float distance = axis_->open_loop_controller_.total_distance_.any().value_or(INFINITY);
+        if (distance >= scan_distance) {
+            break;
+        }
+        int32_t count = pos_abs_;
+        float expected = distance * counts_per_rad * (float)config_.direction;
+        float err = wrap_pm((float)(count - start_count) - expected, (float)config_.cpr);
+
+        auto [s, c] = fast_sincos((float)count * two_pi_by_cpr_);
+        float basis[4] = {c, s, c * c - s * s, 2.0f * s * c};
+        sum_err += err;
+        for (size_t i = 0; i < 4; ++i) {
+            sum_basis[i] += basis[i];
+            sum_err_basis[i] += err * basis[i];
+        }
+        n++;
+        osDelay(1);
+    }
+
+    // Motor disarmed because of an error or aborted
+    if (!axis_->motor_.is_armed_ || axis_->requested_state_ != Axis::AXIS_STATE_UNDEFINED) {
+        axis_->motor_.disarm();
+        return false;
+    }
+
+    axis_->motor_.disarm();
+
+    if (n < 100) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+
+    float mean_err = sum_err / (float)n;
+    for (size_t i = 0; i < 4; ++i) {
+        config_.eccentricity_comp[i] = 2.0f * (sum_err_basis[i] - mean_err * sum_basis[i]) / (float)n;
+    }
+    config_.eccentricity_comp_enable = true;
+    return true;
+}
+
+// @brief Returns the position error [count] of the absolute encoder at the
+// specified raw reading, according to config_.eccentricity_comp.
+float Encoder::eccentricity_error(int32_t count) {
+    auto [s, c] = fast_sincos((float)count * two_pi_by_cpr_);
+    const float* k = config_.eccentricity_comp;
+    return k[0] * c + k[1] * s + k[2] * (c * c - s * s) + k[3] * (2.0f * s * c);
+}
+
+// @brief Turns the motor in open loop forwards and back over
+// config_.calib_scan_distance and records the commanded position at each hall
+// edge, see HallEdgeCalibration. The mean of the offsets is removed so the
+// phase offset stays valid.
+bool Encoder::run_hall_edge_calibration() {
+    const float start_lock_duration = 1.0f;
+
+    if (mode_ != MODE_HALL) {
+        set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
+        return false;
+    }
+
+    // Start at the present rotor position to avoid a jump
+    if (!start_open_loop_scan(phase_.any().value_or(0.0f), start_lock_duration)) {
+        return false;
+    }
+
+    float counts_per_rad = (float)config_.cpr / (2.0f * M_PI * (float)axis_->motor_.config_.pole_pairs);
+    int64_t start_count;
+    CRITICAL_SECTION() {
+        start_count = shadow_count_;
+    }
+    int64_t last_count = start_count;
+    HallEdgeCalibration calibration;
+
+    // Scans until the distance reaches the end, records the edges that
+    // the counts passed one at a time
+    auto scan = [&](float vel, float end) {
+        CRITICAL_SECTION() {
+            axis_->open_loop_controller_.target_vel_ = vel;
+        }
+        while ((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_) {
+            float distance = axis_->open_loop_controller_.total_distance_.any().value_or(end);
+            if (vel > 0.0f ? distance >= end : distance <= end) {
+                break;
+            }
+            int64_t count;
+            int32_t state;
+            CRITICAL_SECTION() {
+                count = shadow_count_;
+                state = hall_cnt_;
+            }
+            int64_t step = count - last_count;
+            last_count = count;
+            if (step == 1 || step == -1) {
+                float expected = distance * counts_per_rad * (float)config_.direction;
+                int64_t edge_count = step > 0 ? count : count + 1;
+                calibration.add((size_t)mod(step > 0 ? state : state + 1, (int)kHallEdges), step > 0,
+                                expected - (float)(edge_count - start_count));
+            }
+            osDelay(1);
+        }
+    };
+
+    CRITICAL_SECTION() {
+        axis_->open_loop_controller_.total_distance_ = 0.0f;
+    }
+    scan(config_.calib_scan_omega, config_.calib_scan_distance);
+    scan(-config_.calib_scan_omega, 0.0f);
+
+    // Motor disarmed because of an error or aborted
+    if (!axis_->motor_.is_armed_ || axis_->requested_state_ != Axis::AXIS_STATE_UNDEFINED) {
+        axis_->motor_.disarm();
+        return false;
+    }
+
+    axis_->motor_.disarm();
+
+    if (!calibration.get_offsets(config_.hall_edge_offsets)) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+    config_.hall_edge_comp_enable = true;
+    return true;
+}
+
 static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
     switch (hall_state) {
         case 0b001: *hall_cnt = 0; return true;
@@ -344,6 +817,24 @@ static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
     }
 }
 
+// @brief Samples the hardware counter of an incremental encoder. Safe to call
+// from any interrupt.
+// @returns false if the encoder has no hardware counter
+bool Encoder::sample_hw_count(int16_t* cnt) {
+    if (mode_ != MODE_INCREMENTAL) {
+        return false;
+    }
+    *cnt = (int16_t)timer_->Instance->CNT;
+    return true;
+}
+
+// @brief Converts a count from sample_hw_count() to the frame of shadow_count_.
+// The sample must be less than half a counter period away from the last
+// update().
+int64_t Encoder::get_linear_count_at(int16_t tim_cnt) {
+    return shadow_count_ + (int16_t)(tim_cnt - (int16_t)shadow_count_);
+}
+
 void Encoder::sample_now() {
     switch (mode_) {
         case MODE_INCREMENTAL: {
@@ -363,9 +854,13 @@ void Encoder::sample_now() {
         case MODE_SPI_ABS_CUI:
         case MODE_SPI_ABS_AEAT:
         case MODE_SPI_ABS_RLS:
+        case MODE_SPI_ABS_SSI:
+        case MODE_SPI_ABS_BISSC:
         {
-            abs_spi_start_transaction();
-            // Do nothing
+            // The other encoders of a daisy chain are read by its head
+            if (!abs_spi_chain_head_ || abs_spi_chain_head_ == this) {
+                abs_spi_start_transaction();
+            }
         } break;
 
         default: {
@@ -400,11 +895,16 @@ bool Encoder::abs_spi_start_transaction() {
             spi_task_.ncs_gpio = abs_spi_cs_gpio_;
             spi_task_.tx_buf = (uint8_t*)abs_spi_dma_tx_;
             spi_task_.rx_buf = (uint8_t*)abs_spi_dma_rx_;
-            spi_task_.length = 1;
+            spi_task_.length = abs_spi_words_;
             spi_task_.on_complete = [](void* ctx, bool success) { ((Encoder*)ctx)->abs_spi_cb(success); };
             spi_task_.on_complete_ctx = this;
             spi_task_.next = nullptr;
+            spi_task_.priority = Stm32SpiArbiter::PRIORITY_HIGH;
             
+            abs_spi_pending_ = true;
+            for (size_t i = 0; i < abs_spi_chain_length_; ++i) {
+                abs_spi_chain_[i]->abs_spi_pending_ = true;
+            }
             spi_arbiter_->transfer_async(&spi_task_);
         } else {
             return false;
@@ -429,7 +929,19 @@ uint8_t cui_parity(uint16_t v) {
 }
 
 void Encoder::abs_spi_cb(bool success) {
-    uint16_t pos;
+    if (abs_spi_chain_length_) {
+        // AMS encoders in a daisy chain answer with one word each
+        for (size_t i = 0; i < abs_spi_chain_length_; ++i) {
+            abs_spi_chain_[i]->abs_spi_decode(success, &abs_spi_dma_rx_[i]);
+        }
+    } else {
+        abs_spi_decode(success, abs_spi_dma_rx_);
+    }
+    Stm32SpiArbiter::release_task(&spi_task_);
+}
+
+void Encoder::abs_spi_decode(bool success, const uint16_t* rx) {
+    uint32_t pos;
 
     if (!success) {
         goto done;
@@ -437,7 +949,7 @@ void Encoder::abs_spi_cb(bool success) {
 
     switch (mode_) {
         case MODE_SPI_ABS_AMS: {
-            uint16_t rawVal = abs_spi_dma_rx_[0];
+            uint16_t rawVal = rx[0];
             // check if parity is correct (even) and error flag clear
             if (ams_parity(rawVal) || ((rawVal >> 14) & 1)) {
                 goto done;
@@ -446,7 +958,7 @@ void Encoder::abs_spi_cb(bool success) {
         } break;
 
         case MODE_SPI_ABS_CUI: {
-            uint16_t rawVal = abs_spi_dma_rx_[0];
+            uint16_t rawVal = rx[0];
             // check if parity is correct
             if (cui_parity(rawVal)) {
                 goto done;
@@ -455,10 +967,22 @@ void Encoder::abs_spi_cb(bool success) {
         } break;
 
         case MODE_SPI_ABS_RLS: {
-            uint16_t rawVal = abs_spi_dma_rx_[0];
+            uint16_t rawVal = rx[0];
             pos = (rawVal >> 2) & 0x3fff;
         } break;
 
+        case MODE_SPI_ABS_SSI: {
+            if (!decode_ssi(rx, abs_spi_words_, config_.abs_spi_pos_bits, &pos)) {
+                goto done;
+            }
+        } break;
+
+        case MODE_SPI_ABS_BISSC: {
+            if (!decode_biss_c(rx, abs_spi_words_, config_.abs_spi_pos_bits, &pos)) {
+                goto done;
+            }
+        } break;
+
         default: {
            set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
            goto done;
@@ -472,7 +996,7 @@ void Encoder::abs_spi_cb(bool success) {
     }
 
 done:
-    Stm32SpiArbiter::release_task(&spi_task_);
+    abs_spi_pending_ = false;
 }
 
 void Encoder::abs_spi_cs_pin_init(){
@@ -484,15 +1008,38 @@ void Encoder::abs_spi_cs_pin_init(){
     abs_spi_cs_gpio_.write(true);
 }
 
-bool Encoder::update() {
+// Joins the daisy chain of the AMS encoders that share this chip select. The
+// encoders are set up in the order of the axes, so the first one becomes the
+// head and word i of the transfer goes to the i-th chained axis. With the
+// usual wiring the first word comes from the encoder whose MISO connects to
+// the ODrive. Takes effect after a reboot, like the mode.
+void Encoder::setup_abs_spi_chain() {
+    abs_spi_chain_head_ = nullptr;
+    abs_spi_chain_length_ = 0;
+    if (mode_ != MODE_SPI_ABS_AMS || !config_.abs_spi_daisy_chain) {
+        return;
+    }
+    Encoder* head = this;
+    for (Encoder& other: encoders) {
+        if (&other != this && other.abs_spi_chain_head_ == &other
+            && other.config_.abs_spi_cs_gpio_pin == config_.abs_spi_cs_gpio_pin) {
+            head = &other;
+            break;
+        }
+    }
+    static_assert(AXIS_COUNT <= ABS_SPI_MAX_WORDS, "one word per chained encoder");
+    abs_spi_chain_head_ = head;
+    head->abs_spi_chain_[head->abs_spi_chain_length_++] = this;
+    head->abs_spi_words_ = head->abs_spi_chain_length_;
+}
+
+RAMFUNC bool Encoder::update() {
     // update internal encoder state.
     int32_t delta_enc = 0;
     int32_t pos_abs_latched = pos_abs_; //LATCH
 
     switch (mode_) {
         case MODE_INCREMENTAL: {
-            //TODO: use count_in_cpr_ instead as shadow_count_ can overflow
-            //or use 64 bit
             int16_t delta_enc_16 = (int16_t)tim_cnt_sample_ - (int16_t)shadow_count_;
             delta_enc = (int32_t)delta_enc_16; //sign extend
         } break;
@@ -501,6 +1048,7 @@ bool Encoder::update() {
             decode_hall_samples();
             int32_t hall_cnt;
             if (decode_hall(hall_state_, &hall_cnt)) {
+                hall_cnt_ = hall_cnt;
                 delta_enc = hall_cnt - count_in_cpr_;
                 delta_enc = mod(delta_enc, 6);
                 if (delta_enc > 3)
@@ -514,8 +1062,32 @@ bool Encoder::update() {
         } break;
 
         case MODE_SINCOS: {
-            float phase = fast_atan2(sincos_sample_s_, sincos_sample_c_);
-            int fake_count = (int)(1000.0f * phase);
+            SincosCalibration::Result cal = {
+                .offset_s = config_.sincos_offset_s,
+                .offset_c = config_.sincos_offset_c,
+                .gain_s = config_.sincos_gain_s,
+                .skew = config_.sincos_skew,
+            };
+            float y, x;
+            SincosCalibration::correct(cal, sincos_sample_s_, sincos_sample_c_, &y, &x);
+            float phase = fast_atan2(y, x);
+
+            if (config_.sincos_calib_enable) {
+                sincos_calibration_.update(sincos_sample_s_, sincos_sample_c_,
+                        wrap_pm_pi(phase - sincos_phase_), config_.sincos_calib_periods);
+                if (sincos_calibration_.get(&cal)) {
+                    config_.sincos_offset_s = cal.offset_s;
+                    config_.sincos_offset_c = cal.offset_c;
+                    config_.sincos_gain_s = cal.gain_s;
+                    config_.sincos_skew = cal.skew;
+                }
+            }
+            sincos_phase_ = phase;
+
+            // The PLL gets the sub-count part too, see sincos_fraction_
+            float fake_counts = 1000.0f * phase;
+            int fake_count = (int)std::floor(fake_counts);
+            sincos_fraction_ = fake_counts - (float)fake_count;
             //CPR = 6283 = 2pi * 1k
 
             delta_enc = fake_count - count_in_cpr_;
@@ -527,7 +1099,18 @@ bool Encoder::update() {
         case MODE_SPI_ABS_RLS:
         case MODE_SPI_ABS_AMS:
         case MODE_SPI_ABS_CUI: 
-        case MODE_SPI_ABS_AEAT: {
+        case MODE_SPI_ABS_AEAT:
+        case MODE_SPI_ABS_SSI:
+        case MODE_SPI_ABS_BISSC: {
+            if (config_.abs_spi_wait_for_sample) {
+                // The transfer was started in sample_now() of this iteration.
+                // Its completion interrupt has a higher priority than the
+                // control loop so we can wait for it here, but at most 40us.
+                uint32_t start = DWT->CYCCNT;
+                while (abs_spi_pending_ && (DWT->CYCCNT - start) < SystemCoreClock / 25000) {
+                }
+                pos_abs_latched = pos_abs_;
+            }
             if (abs_spi_pos_updated_ == false) {
                 // Low pass filter the error
                 spi_error_rate_ += current_meas_period * (1.0f - spi_error_rate_);
@@ -540,9 +1123,16 @@ bool Encoder::update() {
                 spi_error_rate_ += current_meas_period * (0.0f - spi_error_rate_);
             }
 
+            bool fresh_sample = abs_spi_pos_updated_;
             abs_spi_pos_updated_ = false;
+            if (config_.eccentricity_comp_enable) {
+                pos_abs_latched = wrap_cpr(pos_abs_latched - (int32_t)std::round(eccentricity_error(pos_abs_latched)));
+            }
+            if (position_restore_pending_ && fresh_sample) {
+                restore_position(pos_abs_latched);
+            }
             delta_enc = pos_abs_latched - count_in_cpr_; //LATCH
-            delta_enc = mod(delta_enc, config_.cpr);
+            delta_enc = wrap_cpr(delta_enc);
             if (delta_enc > config_.cpr/2) {
                 delta_enc -= config_.cpr;
             }
@@ -556,7 +1146,7 @@ bool Encoder::update() {
 
     shadow_count_ += delta_enc;
     count_in_cpr_ += delta_enc;
-    count_in_cpr_ = mod(count_in_cpr_, config_.cpr);
+    count_in_cpr_ = wrap_cpr(count_in_cpr_);
 
     if(mode_ & MODE_FLAG_ABS)
         count_in_cpr_ = pos_abs_latched;
@@ -565,40 +1155,89 @@ bool Encoder::update() {
     float pos_cpr_counts_last = pos_cpr_counts_;
 
     //// run pll (for now pll is in units of encoder counts)
+    // Predict current vel. The acceleration setpoint of the controller is
+    // known ahead of time so we don't have to wait for the PLL to pick it up.
+    float accel_ff = 0.0f; // [count/s^2]
+    if (config_.pll_accel_enable) {
+        accel_ff = accel_ff_src_.any().value_or(0.0f) * (float)config_.cpr;
+        vel_estimate_counts_ += current_meas_period * (accel_estimate_counts_ + accel_ff);
+    }
     // Predict current pos
-    pos_estimate_counts_ += current_meas_period * vel_estimate_counts_;
+    pll_count_fraction_  += current_meas_period * vel_estimate_counts_;
     pos_cpr_counts_      += current_meas_period * vel_estimate_counts_;
     // discrete phase detector
-    float delta_pos_counts = (float)(shadow_count_ - (int32_t)std::floor(pos_estimate_counts_));
-    float delta_pos_cpr_counts = (float)(count_in_cpr_ - (int32_t)std::floor(pos_cpr_counts_));
+    int64_t pll_counts = (int64_t)pll_turns_ * config_.cpr + pll_count_in_turn_;
+    float delta_pos_counts;
+    float delta_pos_cpr_counts;
+    bool hall_edge_comp = mode_ == MODE_HALL && config_.hall_edge_comp_enable;
+    if (mode_ == MODE_SINCOS) {
+        // The measurement has sub-count resolution so it is compared without
+        // quantization.
+        delta_pos_counts = (float)(int32_t)(shadow_count_ - pll_counts) + sincos_fraction_ - pll_count_fraction_;
+        delta_pos_cpr_counts = (float)count_in_cpr_ + sincos_fraction_ - pos_cpr_counts_;
+    } else if (hall_edge_comp) {
+        // The hall states have the measured widths instead of one count each
+        const float (&offsets)[kHallEdges] = config_.hall_edge_offsets;
+        delta_pos_counts = hall_edge_phase_error(offsets, hall_cnt_,
+                (float)(int32_t)(pll_counts - shadow_count_) + pll_count_fraction_);
+        delta_pos_cpr_counts = hall_edge_phase_error(offsets, hall_cnt_,
+                wrap_pm(pos_cpr_counts_ - (float)count_in_cpr_, (float)(config_.cpr)));
+    } else {
+        delta_pos_counts = (float)(int32_t)(shadow_count_ - pll_counts - (int32_t)std::floor(pll_count_fraction_));
+        delta_pos_cpr_counts = (float)(count_in_cpr_ - (int32_t)std::floor(pos_cpr_counts_));
+    }
     delta_pos_cpr_counts = wrap_pm(delta_pos_cpr_counts, (float)(config_.cpr));
     // pll feedback
-    pos_estimate_counts_ += current_meas_period * pll_kp_ * delta_pos_counts;
+    pll_count_fraction_ += current_meas_period * pll_kp_ * delta_pos_counts;
+    // Move the whole counts out of the fraction
+    int32_t whole_counts = (int32_t)std::floor(pll_count_fraction_);
+    pll_count_fraction_ -= (float)whole_counts;
+    int32_t pll_count = pll_count_in_turn_ + whole_counts;
+    pll_count_in_turn_ = wrap_cpr(pll_count);
+    pll_turns_ += (pll_count - pll_count_in_turn_) / config_.cpr;
     pos_cpr_counts_ += current_meas_period * pll_kp_ * delta_pos_cpr_counts;
     pos_cpr_counts_ = fmodf_pos(pos_cpr_counts_, (float)(config_.cpr));
     vel_estimate_counts_ += current_meas_period * pll_ki_ * delta_pos_cpr_counts;
+    if (config_.edge_vel_enable && config_.edge_vel_blend_speed > 0.0f) {
+        // At low speed the edge timing is more accurate than the PLL
+        edge_vel_estimator_.update(delta_enc);
+        std::optional<float> edge_vel = edge_vel_estimator_.get_velocity();
+        if (edge_vel.has_value()) {
+            edge_vel_estimate_counts_ = *edge_vel * current_meas_hz;
+            float blend = std::clamp(1.0f - std::abs(vel_estimate_counts_) / config_.edge_vel_blend_speed, 0.0f, 1.0f);
+            vel_estimate_counts_ += blend * (edge_vel_estimate_counts_ - vel_estimate_counts_);
+        }
+    }
+    accel_estimate_counts_ += current_meas_period * pll_ka_ * delta_pos_cpr_counts;
     bool snap_to_zero_vel = false;
-    if (std::abs(vel_estimate_counts_) < 0.5f * current_meas_period * pll_ki_) {
+    if (std::abs(vel_estimate_counts_) < 0.5f * current_meas_period * pll_ki_
+            && std::abs(accel_estimate_counts_) <= 0.5f * current_meas_period * pll_ka_) {
         vel_estimate_counts_ = 0.0f;  //align delta-sigma on zero to prevent jitter
+        accel_estimate_counts_ = 0.0f;
         snap_to_zero_vel = true;
     }
 
     // Outputs from Encoder for Controller
-    pos_estimate_ = pos_estimate_counts_ / (float)config_.cpr;
-    vel_estimate_ = vel_estimate_counts_ / (float)config_.cpr;
+    TurnPosition pos_estimate = {pll_turns_, ((float)pll_count_in_turn_ + pll_count_fraction_) * inv_cpr_};
+    pos_estimate_turns_ = pos_estimate;
+    pos_estimate_ = pos_estimate.to_float();
+    vel_estimate_ = vel_estimate_counts_ * inv_cpr_;
+    accel_estimate_ = (accel_estimate_counts_ + accel_ff) * inv_cpr_;
     
     // TODO: we should strictly require that this value is from the previous iteration
     // to avoid spinout scenarios. However that requires a proper way to reset
     // the encoder from error states.
     float pos_circular = pos_circular_.any().value_or(0.0f);
-    pos_circular +=  wrap_pm((pos_cpr_counts_ - pos_cpr_counts_last) / (float)config_.cpr, 1.0f);
+    pos_circular +=  wrap_pm((pos_cpr_counts_ - pos_cpr_counts_last) * inv_cpr_, 1.0f);
     pos_circular = fmodf_pos(pos_circular, axis_->controller_.config_.circular_setpoint_range);
     pos_circular_ = pos_circular;
 
     //// run encoder count interpolation
     int32_t corrected_enc = count_in_cpr_ - config_.phase_offset;
+    if (mode_ == MODE_SINCOS) {
+        interpolation_ = sincos_fraction_; // measured, no need to interpolate
     // if we are stopped, make sure we don't randomly drift
-    if (snap_to_zero_vel || !config_.enable_phase_interpolation) {
+    } else if (snap_to_zero_vel || !config_.enable_phase_interpolation) {
         interpolation_ = 0.5f;
     // reset interpolation if encoder edge comes
     // TODO: This isn't correct. At high velocities the first phase in this count may very well not be at the edge.
@@ -608,21 +1247,24 @@ bool Encoder::update() {
         interpolation_ = 1.0f;
     } else {
         // Interpolate (predict) between encoder counts using vel_estimate,
-        interpolation_ += current_meas_period * vel_estimate_counts_;
+        float count_width = hall_edge_comp ? hall_edge_width(config_.hall_edge_offsets, hall_cnt_) : 1.0f;
+        interpolation_ += current_meas_period * vel_estimate_counts_ / count_width;
         // don't allow interpolation indicated position outside of [enc, enc+1)
         if (interpolation_ > 1.0f) interpolation_ = 1.0f;
         if (interpolation_ < 0.0f) interpolation_ = 0.0f;
     }
-    float interpolated_enc = corrected_enc + interpolation_;
+    float interpolated_enc = hall_edge_comp
+            ? corrected_enc + hall_edge_position(config_.hall_edge_offsets, hall_cnt_, interpolation_)
+            : corrected_enc + interpolation_;
 
     //// compute electrical phase
-    //TODO avoid recomputing elec_rad_per_enc every time
-    float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
+    float pole_pairs = (float)axis_->motor_.config_.pole_pairs;
+    float elec_rad_per_enc = pole_pairs * two_pi_by_cpr_;
     float ph = elec_rad_per_enc * (interpolated_enc - config_.phase_offset_float);
     
     if (is_ready_) {
         phase_ = wrap_pm_pi(ph) * config_.direction;
-        phase_vel_ = (2*M_PI) * *vel_estimate_.present() * axis_->motor_.config_.pole_pairs * config_.direction;
+        phase_vel_ = elec_rad_per_enc * vel_estimate_counts_ * config_.direction;
     }
 
     return true;
@@ -6,12 +6,27 @@
 #include "utils.hpp"
 #include <autogen/interfaces.hpp>
 #include "component.hpp"
+#include "dirty_flags.hpp"
+#include "edge_velocity_estimator.hpp"
+#include "ssi_biss.hpp"
+#include "sincos_calibration.hpp"
+#include "phase_offset_fit.hpp"
+#include "hall_edges.hpp"
+
+#define POSITION_BACKUP_VERSION 1 // increment when PositionBackup_t changes
 
 
 class Encoder : public ODriveIntf::EncoderIntf {
 public:
     static constexpr uint32_t MODE_FLAG_ABS = 0x100;
 
+    // Derived quantities that the setters leave to apply_dirty_config()
+    enum DirtyFlag : uint32_t {
+        DIRTY_PLL_GAINS = 1 << 0,
+        DIRTY_CPR_CONSTANTS = 1 << 1,
+        DIRTY_EDGE_VEL_CONFIG = 1 << 2,
+    };
+
     struct Config_t {
         Mode mode = MODE_INCREMENTAL;
         bool use_index = false;
@@ -29,12 +44,40 @@ public:
         float calib_range = 0.02f; // Accuracy required to pass encoder cpr check
         float calib_scan_distance = 16.0f * M_PI; // rad electrical
         float calib_scan_omega = 4.0f * M_PI; // rad/s electrical
+        bool calib_fit_enable = false; // use run_offset_fit() instead of run_offset_calibration()
+        float calib_fit_distance = 2.0f * M_PI; // rad electrical, see run_offset_fit()
+        float calib_fit_tolerance = 0.5f; // [count] standard error of the fitted phase offset at which the scan stops
         float bandwidth = 1000.0f;
+        bool pll_accel_enable = false; // third order PLL that also tracks the acceleration
+        // Velocity from the time between encoder edges, see EdgeVelocityEstimator
+        bool edge_vel_enable = false;
+        float edge_vel_blend_speed = 30.0f; // [count/s] the edge velocity is blended in below this speed
+        uint32_t edge_vel_window = 6; // [count] e.g. one electrical revolution of hall sensors
         bool find_idx_on_lockin_only = false; // Only be sensitive during lockin scan constant vel state
         bool ignore_illegal_hall_state = false; // dont error on bad states like 000 or 111
+        // Placement errors of the hall edges, see run_hall_edge_calibration()
+        bool hall_edge_comp_enable = false;
+        float hall_edge_offsets[kHallEdges] = {0.0f}; // [count] edge k is between hall state k - 1 and k
         uint16_t abs_spi_cs_gpio_pin = 1;
+        uint32_t abs_spi_pos_bits = 23; // position resolution of SSI and BiSS-C encoders
+        bool abs_spi_wait_for_sample = false; // wait for the transfer of the current iteration instead of using the previous sample
+        bool abs_spi_daisy_chain = false; // read all AMS encoders with this chip select in one transfer, see setup_abs_spi_chain()
+        // Multi-turn position of absolute encoders kept across power cycles, see PositionBackup_t
+        bool persist_position = false;
+        float persist_position_tolerance = 0.01f; // [turn] motion while powered off up to which the position is restored
         uint16_t sincos_gpio_pin_sin = 3;
         uint16_t sincos_gpio_pin_cos = 4;
+        // Channel errors of sin/cos encoders, see SincosCalibration
+        bool sincos_calib_enable = false; // learn the values below online
+        float sincos_calib_periods = 100.0f; // number of signal periods to average over
+        float sincos_offset_s = 0.0f; // [relative ADC voltage]
+        float sincos_offset_c = 0.0f; // [relative ADC voltage]
+        float sincos_gain_s = 1.0f; // amplitude of cos / amplitude of sin
+        float sincos_skew = 0.0f; // sine of the phase error between the channels
+        // Position error of absolute encoders as harmonics of the mechanical
+        // angle, see run_eccentricity_calibration()
+        bool eccentricity_comp_enable = false;
+        float eccentricity_comp[4] = {0.0f}; // [count] cos(x), sin(x), cos(2x), sin(2x)
 
         // custom setters
         Encoder* parent = nullptr;
@@ -42,7 +85,23 @@ public:
         void set_find_idx_on_lockin_only(bool value) { find_idx_on_lockin_only = value; parent->set_idx_subscribe(); }
         void set_abs_spi_cs_gpio_pin(uint16_t value) { abs_spi_cs_gpio_pin = value; parent->abs_spi_cs_pin_init(); }
         void set_pre_calibrated(bool value) { pre_calibrated = value; parent->check_pre_calibrated(); }
-        void set_bandwidth(float value) { bandwidth = value; parent->update_pll_gains(); }
+        void set_bandwidth(float value) { bandwidth = value; parent->dirty_.mark(DIRTY_PLL_GAINS); }
+        void set_pll_accel_enable(bool value) { pll_accel_enable = value; parent->dirty_.mark(DIRTY_PLL_GAINS); }
+        void set_cpr(int32_t value) { cpr = value; parent->dirty_.mark(DIRTY_CPR_CONSTANTS); }
+        void set_sincos_calib_enable(bool value) { sincos_calib_enable = value; parent->sincos_calibration_.reset(); }
+        void set_edge_vel_blend_speed(float value) { edge_vel_blend_speed = value; parent->dirty_.mark(DIRTY_EDGE_VEL_CONFIG); }
+        void set_edge_vel_window(uint32_t value) { edge_vel_window = value; parent->dirty_.mark(DIRTY_EDGE_VEL_CONFIG); }
+    };
+
+    // Saved to NVM on a brownout (see ODrive::do_fast_checks()) and read
+    // back at boot. The first reading of the absolute encoder then restores
+    // the turn count if it is within persist_position_tolerance of the
+    // saved single-turn position.
+    struct PositionBackup_t {
+        bool valid = false;
+        bool homed = false; // axis.is_homed at the time of the backup
+        int32_t count_in_cpr = 0; // [count] single-turn position
+        int64_t shadow_count = 0; // [count] multi-turn position
     };
 
     Encoder(TIM_HandleTypeDef* timer, Stm32Gpio index_gpio,
@@ -50,23 +109,47 @@ public:
             Stm32SpiArbiter* spi_arbiter);
     
     bool apply_config(ODriveIntf::MotorIntf::MotorType motor_type);
+    void apply_dirty_config();
     void setup();
     void set_error(Error error);
     bool do_checks();
 
     void enc_index_cb();
+    bool arm_index_latch();
+    void index_latch_cb();
+    void disarm_index_latch();
+    std::optional<int64_t> get_index_latch();
     void set_idx_subscribe(bool override_enable = false);
     void update_pll_gains();
+    void update_cpr_constants();
+    void update_edge_vel_config();
+    float get_pos_estimate_counts() {
+        return (float)pll_turns_ * (float)config_.cpr + (float)pll_count_in_turn_ + pll_count_fraction_;
+    }
+    int32_t wrap_cpr(int32_t count) {
+        return cpr_mask_ ? (count & cpr_mask_) : mod(count, config_.cpr);
+    }
     void check_pre_calibrated();
 
     void set_linear_count(int32_t count);
+    PositionBackup_t get_position_backup();
+    void restore_position(int32_t count_in_cpr);
     void set_circular_count(int32_t count, bool update_offset);
     bool calib_enc_offset(float voltage_magnitude);
+    bool start_open_loop_scan(float initial_phase, float start_lock_duration);
 
     bool run_index_search();
     bool run_direction_find();
     bool run_offset_calibration();
+    bool run_offset_fit();
+    bool run_index_search_and_offset_calibration();
+    int64_t get_calib_count();
+    bool run_eccentricity_calibration();
+    bool run_hall_edge_calibration();
+    float eccentricity_error(int32_t count);
     void sample_now();
+    bool sample_hw_count(int16_t* cnt);
+    int64_t get_linear_count_at(int16_t tim_cnt);
     bool read_sampled_gpio(Stm32Gpio gpio);
     void decode_hall_samples();
     bool update();
@@ -80,28 +163,55 @@ public:
     Axis* axis_ = nullptr; // set by Axis constructor
 
     Config_t config_;
+    DirtyFlags dirty_; // see DirtyFlag
 
     Error error_ = ERROR_NONE;
     bool index_found_ = false;
+    bool index_latch_armed_ = false;
+    volatile bool index_latched_ = false;
+    volatile int16_t index_latched_cnt_ = 0; // timer count at the index pulse, see arm_index_latch()
     bool is_ready_ = false;
-    int32_t shadow_count_ = 0;
+    int64_t shadow_count_ = 0;
     int32_t count_in_cpr_ = 0;
     float interpolation_ = 0.0f;
     OutputPort<float> phase_ = 0.0f;     // [rad]
     OutputPort<float> phase_vel_ = 0.0f; // [rad/s]
-    float pos_estimate_counts_ = 0.0f;  // [count]
+    // The linear position estimate is pll_turns_ * cpr + pll_count_in_turn_
+    // + pll_count_fraction_ so that the PLL resolution doesn't depend on the
+    // distance travelled.
+    int32_t pll_turns_ = 0; // [turn]
+    int32_t pll_count_in_turn_ = 0; // [count] in [0, cpr)
+    float pll_count_fraction_ = 0.0f; // [count] in [0, 1)
     float pos_cpr_counts_ = 0.0f;  // [count]
     float vel_estimate_counts_ = 0.0f;  // [count/s]
     float pll_kp_ = 0.0f;   // [count/s / count]
     float pll_ki_ = 0.0f;   // [(count/s^2) / count]
+    float pll_ka_ = 0.0f;   // [(count/s^3) / count] only used with config_.pll_accel_enable
+    float accel_estimate_counts_ = 0.0f; // [count/s^2]
+    // Derived from config_.cpr by update_cpr_constants()
+    float inv_cpr_ = 0.0f; // [turn/count]
+    float two_pi_by_cpr_ = 0.0f; // [rad/count] per pole pair
+    int32_t cpr_mask_ = 0; // cpr - 1 if cpr is a power of two, otherwise 0
+    EdgeVelocityEstimator edge_vel_estimator_;
+    float edge_vel_estimate_counts_ = 0.0f; // [count/s] only updated if config_.edge_vel_enable
     float calib_scan_response_ = 0.0f; // debug report from offset calib
+    int64_t index_count_shift_ = 0; // [count] amount by which the last index reduced shadow_count_ (reset by the offset calibration)
+    int32_t index_phase_shift_ = 0; // [count] count_in_cpr_ just before the last index reset it
+    bool find_idx_during_calib_ = false; // the offset calibration runs before the index is found
     int32_t pos_abs_ = 0;
     float spi_error_rate_ = 0.0f;
+    PositionBackup_t position_backup_; // loaded at boot if config_.persist_position is set
+    bool position_restore_pending_ = false; // set at boot if position_backup_ is valid
+    bool position_restored_ = false;
 
     OutputPort<float> pos_estimate_ = 0.0f; // [turn]
+    OutputPort<TurnPosition> pos_estimate_turns_ = TurnPosition{0, 0.0f}; // same as pos_estimate_ but with full resolution
     OutputPort<float> vel_estimate_ = 0.0f; // [turn/s]
+    OutputPort<float> accel_estimate_ = 0.0f; // [turn/s^2] including the feedforward, 0 unless config_.pll_accel_enable
     OutputPort<float> pos_circular_ = 0.0f; // [turn]
 
+    InputPort<float> accel_ff_src_; // [turn/s^2] Usually points to the acceleration setpoint of the Controller that uses this encoder
+
     bool pos_estimate_valid_ = false;
     bool vel_estimate_valid_ = false;
 
@@ -110,20 +220,34 @@ public:
     uint16_t port_samples_[sizeof(ports_to_sample) / sizeof(ports_to_sample[0])];
     // Updated by low_level pwm_adc_cb
     uint8_t hall_state_ = 0x0; // bit[0] = HallA, .., bit[2] = HallC
+    int32_t hall_cnt_ = 0; // last valid hall state decoded to 0..5
     float sincos_sample_s_ = 0.0f;
     float sincos_sample_c_ = 0.0f;
+    float sincos_phase_ = 0.0f; // [rad] corrected angle of the last sample
+    float sincos_fraction_ = 0.0f; // [count] sub-count part of the sincos position
+    SincosCalibration sincos_calibration_;
 
     bool abs_spi_start_transaction();
     void abs_spi_cb(bool success);
+    void abs_spi_decode(bool success, const uint16_t* rx);
+    void setup_abs_spi_chain();
     void abs_spi_cs_pin_init();
     bool abs_spi_pos_updated_ = false;
+    volatile bool abs_spi_pending_ = false; // a transfer was started and has not completed yet
     Mode mode_ = MODE_INCREMENTAL;
     Stm32Gpio abs_spi_cs_gpio_;
     uint32_t abs_spi_cr1;
     uint32_t abs_spi_cr2;
-    uint16_t abs_spi_dma_tx_[1] = {0xFFFF};
-    uint16_t abs_spi_dma_rx_[1];
+    static constexpr size_t ABS_SPI_MAX_WORDS = 3; // long enough for a 32-bit BiSS-C frame
+    size_t abs_spi_words_ = 1;
+    uint16_t abs_spi_dma_tx_[ABS_SPI_MAX_WORDS] = {0xFFFF, 0xFFFF, 0xFFFF};
+    uint16_t abs_spi_dma_rx_[ABS_SPI_MAX_WORDS];
     Stm32SpiArbiter::SpiTask spi_task_;
+    // Daisy chain: the head is the first chained encoder, it runs the
+    // transfer for all of them and hands word i to abs_spi_chain_[i]
+    Encoder* abs_spi_chain_head_ = nullptr;
+    Encoder* abs_spi_chain_[AXIS_COUNT] = {};
+    size_t abs_spi_chain_length_ = 0;
 
     constexpr float getCoggingRatio(){
         return 1.0f / 3600.0f;
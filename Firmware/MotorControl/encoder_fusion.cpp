@@ -0,0 +1,104 @@
+#include "encoder_fusion.hpp"
+#include "odrive_main.h"
+
+bool EncoderFusion::apply_config() {
+    config_.parent = this;
+    reset();
+    if (axis_) {
+        axis_->update_control_pipeline(); // a disabled fusion stage is not updated
+    }
+    return true;
+}
+
+void EncoderFusion::reset() {
+    active_ = false;
+    regression_ = {};
+    compliance_ = 0.0f;
+    backlash_ = 0.0f;
+}
+
+void EncoderFusion::Regression::update(float k, float torque, float deflection) {
+    float sign = torque > 0.0f ? 1.0f : -1.0f;
+    w += k * (1.0f - w);
+    t += k * (torque - t);
+    s += k * (sign - s);
+    tt += k * (torque * torque - tt);
+    ts += k * (torque * sign - ts);
+    d += k * (deflection - d);
+    td += k * (torque * deflection - td);
+    sd += k * (sign * deflection - sd);
+}
+
+// Solves the normal equations with Cramer's rule. Returns false if the torque
+// samples don't allow to tell compliance and backlash apart, e.g. if only one
+// direction or only one torque magnitude was seen.
+bool EncoderFusion::Regression::solve(float* c, float* b) {
+    float det = w * (tt * w - ts * ts) - t * (t * w - ts * s) + s * (t * ts - tt * s);
+    if (!(std::abs(det) > 1e-3f * w * w * tt)) {
+        return false;
+    }
+    *c = (w * (td * w - ts * sd) - d * (t * w - ts * s) + s * (t * sd - td * s)) / det;
+    *b = (w * (tt * sd - td * ts) - t * (t * sd - td * s) + d * (t * ts - tt * s)) / det;
+    return true;
+}
+
+void EncoderFusion::update(uint32_t timestamp) {
+    std::optional<float> motor_pos = motor_pos_src_.present();
+    std::optional<float> motor_vel = motor_vel_src_.present();
+    std::optional<float> load_pos = load_pos_src_.present();
+
+    if (!motor_pos.has_value() || !motor_vel.has_value() || !load_pos.has_value()) {
+        active_ = false;
+        return;
+    }
+
+    float dt = (float)(timestamp - last_timestamp_) / (float)TIM_1_8_CLOCK_HZ;
+    last_timestamp_ = timestamp;
+
+    deflection_ = *load_pos - config_.ratio * *motor_pos;
+
+    if (!active_) {
+        // Start out on the load encoder
+        offset_ = deflection_;
+        deflection_ref_ = deflection_;
+        regression_ = {};
+        pos_estimate_ = *load_pos;
+        vel_estimate_ = config_.ratio * *motor_vel;
+        accel_estimate_ = config_.ratio * motor_accel_src_.present().value_or(0.0f);
+        twist_ = 0.0f;
+        twist_vel_ = 0.0f;
+        active_ = true;
+        return;
+    }
+
+    // Complementary filter: the offset between the two encoders is low pass
+    // filtered, so the load encoder only contributes below the bandwidth.
+    float offset_vel = config_.bandwidth * (deflection_ - offset_);
+    offset_ += dt * offset_vel;
+    pos_estimate_ = config_.ratio * *motor_pos + offset_;
+    vel_estimate_ = config_.ratio * *motor_vel + offset_vel;
+    accel_estimate_ = config_.ratio * motor_accel_src_.present().value_or(0.0f);
+
+    // The high frequency part of the deflection is the state of the
+    // transmission for the state feedback of the controller.
+    twist_ = deflection_ - offset_;
+    std::optional<float> load_vel = load_vel_src_.present();
+    if (load_vel.has_value()) {
+        twist_vel_ = *load_vel - config_.ratio * *motor_vel - offset_vel;
+    }
+
+    // The torque of the previous iteration is the one that caused the
+    // deflection that we see now.
+    std::optional<float> torque = torque_src_.any();
+    if (torque.has_value() && std::abs(*torque) >= config_.min_torque
+            && config_.estimator_time_constant > 0.0f) {
+        float k = std::min(dt / config_.estimator_time_constant, 1.0f);
+        regression_.update(k, *torque, deflection_ - deflection_ref_);
+
+        float c, b;
+        if (regression_.solve(&c, &b)) {
+            compliance_ = -c;
+            backlash_ = -2.0f * b;
+        }
+    }
+}
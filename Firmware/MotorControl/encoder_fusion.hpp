@@ -0,0 +1,90 @@
+#ifndef __ENCODER_FUSION_HPP
+#define __ENCODER_FUSION_HPP
+
+class Axis; // declared in axis.hpp
+
+#include "component.hpp"
+#include <cmath>
+
+/**
+ * @brief Combines the motor encoder and the load encoder of an axis with a
+ * compliant transmission (e.g. a belt) into one position estimate.
+ *
+ * Below the crossover frequency `config_.bandwidth` the estimate follows the
+ * load encoder, above it follows the motor encoder (scaled by the
+ * transmission ratio). The velocity estimate is the exact derivative of the
+ * position estimate, so position and velocity loops see the same signal and
+ * the resonance of the transmission stays out of the velocity feedback.
+ * Commutation always uses the motor encoder directly.
+ *
+ * Additionally the deflection of the transmission is modelled as
+ *   load_pos - ratio * motor_pos = offset - compliance * torque - backlash / 2 * sign(torque)
+ * and the compliance and backlash are estimated with a least squares fit of
+ * the deflection against the torque.
+ */
+class EncoderFusion : public ComponentBase {
+public:
+    struct Config_t {
+        bool enable = false;
+        float ratio = 1.0f; // [load turn / motor turn]
+        float bandwidth = 20.0f; // [rad/s] crossover frequency between load and motor encoder
+        float min_torque = 0.1f; // [Nm] samples with less torque don't update the compliance and backlash estimate
+        float estimator_time_constant = 5.0f; // [s] memory of the compliance and backlash estimate
+
+        // custom setters
+        EncoderFusion* parent = nullptr;
+        void set_enable(bool value) { enable = value; parent->apply_config(); }
+    };
+
+    bool apply_config();
+    void reset();
+    void update(uint32_t timestamp) final;
+
+    Config_t config_;
+    Axis* axis_ = nullptr; // set by Axis constructor
+
+    // Inputs
+    InputPort<float> motor_pos_src_; // [motor turn]
+    InputPort<float> motor_vel_src_; // [motor turn/s]
+    InputPort<float> motor_accel_src_; // [motor turn/s^2]
+    InputPort<float> load_pos_src_; // [load turn]
+    InputPort<float> load_vel_src_; // [load turn/s]
+    InputPort<float> torque_src_; // [Nm]
+
+    // State variables
+    bool active_ = false;
+    uint32_t last_timestamp_ = 0;
+    float offset_ = 0.0f; // [load turn] low frequency part of the deflection
+    float deflection_ = 0.0f; // [load turn] load_pos - ratio * motor_pos
+    float compliance_ = 0.0f; // [load turn / Nm]
+    float backlash_ = 0.0f; // [load turn]
+
+    // Outputs
+    OutputPort<float> pos_estimate_ = 0.0f; // [load turn]
+    OutputPort<float> vel_estimate_ = 0.0f; // [load turn/s]
+    OutputPort<float> accel_estimate_ = 0.0f; // [load turn/s^2] from the motor encoder
+    OutputPort<float> twist_ = 0.0f; // [load turn] deflection_ - offset_, the oscillation of the transmission
+    OutputPort<float> twist_vel_ = 0.0f; // [load turn/s] rate of twist_, only if load_vel_src_ is connected
+
+private:
+    // Exponentially weighted means for the least squares fit of
+    //   deflection = a + c * torque + b * sign(torque)
+    struct Regression {
+        float w = 0.0f; // mean of the weight, approaches 1
+        float t = 0.0f;
+        float s = 0.0f;
+        float tt = 0.0f;
+        float ts = 0.0f;
+        float d = 0.0f;
+        float td = 0.0f;
+        float sd = 0.0f;
+
+        void update(float k, float torque, float deflection);
+        bool solve(float* c, float* b);
+    };
+
+    Regression regression_;
+    float deflection_ref_ = 0.0f; // [load turn] subtracted before the regression to keep the float resolution
+};
+
+#endif // __ENCODER_FUSION_HPP
@@ -0,0 +1,32 @@
+#ifndef __ENDPOINT_SOURCE_HPP
+#define __ENDPOINT_SOURCE_HPP
+
+#include <cmath>
+#include <fibre/protocol.hpp>
+#include <fibre/introspection.hpp>
+
+/**
+ * @brief A property that is looked up once by its endpoint and can then be
+ * read as float with one getter call.
+ *
+ * Reads as NaN if the endpoint is invalid or not convertible to float.
+ */
+class EndpointSource {
+public:
+    void resolve(endpoint_ref_t endpoint) {
+        type_info_ = fibre::get_endpoint_property(endpoint, &property_)
+                   ? dynamic_cast<const FloatGettableTypeInfo*>(property_.get_type_info())
+                   : nullptr;
+    }
+
+    float read() const {
+        float value;
+        return (type_info_ && type_info_->get_float(property_, &value)) ? value : NAN;
+    }
+
+private:
+    Introspectable property_;
+    const FloatGettableTypeInfo* type_info_ = nullptr;
+};
+
+#endif // __ENDPOINT_SOURCE_HPP
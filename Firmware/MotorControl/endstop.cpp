@@ -1,5 +1,19 @@
 #include <odrive_main.h>
 
+static void on_edge_wrapper(void* ctx) {
+    reinterpret_cast<Endstop*>(ctx)->on_edge();
+}
+
+// @brief Latches the encoder count at the first active edge. Runs at a higher
+// priority than the control loop, so only the hardware counter is sampled
+// here and converted to a linear count in update().
+void Endstop::on_edge() {
+    int16_t cnt;
+    if (!edge_latched_ && axis_ && axis_->encoder_.sample_hw_count(&cnt)) {
+        latched_cnt_ = cnt;
+        edge_latched_ = true;
+    }
+}
 
 void Endstop::update() {
     debounceTimer_.update();
@@ -8,25 +22,65 @@ void Endstop::update() {
         bool last_pin_state = pin_state_;
 
         pin_state_ = get_gpio(config_.gpio_num).read();
+        bool active = config_.is_active_high ? pin_state_ : !pin_state_;
 
         // If the pin state has changed, reset the timer
         if (pin_state_ != last_pin_state)
             debounceTimer_.reset();
 
-        if (debounceTimer_.expired())
-            endstop_state_ = config_.is_active_high ? pin_state_ : !pin_state_;  // endstop_state is the logical state
+        if (!press_started_ && (active || edge_latched_)) {
+            press_started_ = true;
+            count_when_pressed_ = edge_latched_
+                    ? axis_->encoder_.get_linear_count_at(latched_cnt_)
+                    : axis_->encoder_.shadow_count_;
+            debounceTimer_.reset(); // the edge counts as a pin change even if it bounced back already
+        }
+
+        if (debounceTimer_.expired()) {
+            endstop_state_ = active;  // endstop_state is the logical state
+
+            // Released for debounce_ms (or a glitch): capture the next press.
+            // The pin is read again because an edge may have been latched
+            // since the read above.
+            if (!active && press_started_) {
+                CRITICAL_SECTION() {
+                    if (get_gpio(config_.gpio_num).read() == pin_state_) {
+                        edge_latched_ = false;
+                        press_started_ = false;
+                    }
+                }
+            }
+        }
     } else {
         endstop_state_ = false;
     }
 }
 
 bool Endstop::apply_config() {
+    if (subscribed_gpio_) {
+        subscribed_gpio_.unsubscribe();
+        subscribed_gpio_ = Stm32Gpio::none;
+    }
+    edge_latched_ = false;
+    press_started_ = false;
+
     debounceTimer_.reset();
     if (config_.enabled) {
+        // If the EXTI line is taken, the press is captured at control loop
+        // resolution.
+        Stm32Gpio gpio = get_gpio(config_.gpio_num);
+        if (gpio.subscribe(config_.is_active_high, !config_.is_active_high, on_edge_wrapper, this)) {
+            subscribed_gpio_ = gpio;
+        }
         debounceTimer_.start();
     } else {
         debounceTimer_.stop();
+        endstop_state_ = false;
+        last_state_ = false;
     }
     debounceTimer_.setIncrement(config_.debounce_ms * 0.001f);
+    if (axis_) {
+        axis_->update_control_pipeline(); // a disabled endstop is not updated
+    }
     return true;
 }
@@ -2,6 +2,17 @@
 #define __ENDSTOP_HPP
 
 #include "timer.hpp"
+
+/**
+ * @brief Debounced endstop switch.
+ *
+ * The first active edge after the endstop was released is captured by an
+ * external interrupt, which latches the encoder count (incremental encoders
+ * only, other encoders use the control loop tick at which the pin was first
+ * seen active). The debounced state then only validates the press, so the
+ * position of the press doesn't depend on the speed, the tick rate or
+ * debounce_ms.
+ */
 class Endstop {
    public:
     struct Config_t {
@@ -16,6 +27,7 @@ class Endstop {
         void set_gpio_num(uint16_t value) { gpio_num = value; parent->apply_config(); }
         void set_enabled(uint32_t value) { enabled = value; parent->apply_config(); }
         void set_debounce_ms(uint32_t value) { debounce_ms = value; parent->apply_config(); }
+        void set_is_active_high(bool value) { is_active_high = value; parent->apply_config(); }
     };
 
     Endstop() {}
@@ -26,6 +38,7 @@ class Endstop {
     bool apply_config();
 
     void update();
+    void on_edge();
     constexpr bool get_state(){
         return endstop_state_;
     }
@@ -38,12 +51,23 @@ class Endstop {
         return (endstop_state_ != last_state_) && !endstop_state_;
     }
 
+    // Linear encoder count at the start of the press. Only valid while
+    // get_state() is true.
+    int64_t get_count_when_pressed() {
+        return count_when_pressed_;
+    }
+
     bool endstop_state_ = false;
 
    private:
     bool last_state_ = false;
     bool pin_state_ = false;
-    float pos_when_pressed_ = 0.0f;
+    bool press_started_ = false; // count_when_pressed_ is latched for the current press
+    int64_t count_when_pressed_ = 0;
     Timer<float> debounceTimer_;
+
+    Stm32Gpio subscribed_gpio_; // the GPIO that on_edge() is subscribed to, if any
+    volatile bool edge_latched_ = false;
+    volatile int16_t latched_cnt_ = 0; // encoder timer count of the first active edge
 };
 #endif
\ No newline at end of file
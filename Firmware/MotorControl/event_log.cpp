@@ -0,0 +1,87 @@
+#include "event_log.hpp"
+#include <odrive_main.h>
+
+#include <algorithm>
+#include <atomic>
+
+#define EVENT_LOG_MAGIC 0x4576744C
+
+// Not touched by the startup code, so the log outlives a soft reset. The
+// magic number tells a log that was written before the reset from random
+// RAM contents after power-up.
+static struct {
+    uint32_t magic;
+    uint32_t boot_count;
+    std::atomic<uint32_t> write_index;
+    EventLog::Entry entries[EVENT_LOG_SIZE];
+} storage __attribute__ ((section (".noinit")));
+
+/**
+ * @brief Takes over the log of the previous boot or starts a new one. Must be
+ * called before any error can be recorded.
+ */
+void EventLog::init() {
+    if (storage.magic != EVENT_LOG_MAGIC) {
+        storage.boot_count = 0;
+        storage.write_index = 0;
+        storage.magic = EVENT_LOG_MAGIC;
+    } else {
+        storage.boot_count++;
+    }
+}
+
+void EventLog::record(Source source, uint8_t axis, uint64_t error) {
+    Entry entry = {
+        .error = error,
+        .loop_count = odrv.n_evt_control_loop_,
+        .boot_count = (uint16_t)storage.boot_count,
+        .source = (uint8_t)source,
+        .axis = axis,
+        .vbus_voltage = vbus_voltage,
+        .ibus = ibus_,
+        .Iq_measured = NAN,
+        .vel_estimate = NAN,
+    };
+    if (axis < AXIS_COUNT) {
+        entry.Iq_measured = axes[axis].motor_.current_control_.Iq_measured_;
+        entry.vel_estimate = axes[axis].encoder_.vel_estimate_.any().value_or(NAN);
+    }
+
+    uint32_t index = storage.write_index.fetch_add(1, std::memory_order_relaxed);
+    storage.entries[index & (EVENT_LOG_SIZE - 1)] = entry;
+}
+
+uint32_t EventLog::get_write_index() {
+    return storage.write_index.load(std::memory_order_relaxed);
+}
+
+uint32_t EventLog::get_boot_count() {
+    return storage.boot_count;
+}
+
+void EventLog::clear() {
+    storage.write_index = 0;
+}
+
+/**
+ * @brief Returns as many bytes of the entries as fit into the response,
+ * starting with the oldest entry that is still in the buffer.
+ *
+ * The request contains the offset in bytes, the same as for
+ * Oscilloscope::read_raw(). The response is empty past the newest entry.
+ */
+bool EventLog::read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    uint32_t write_index = get_write_index();
+    uint32_t count = std::min<uint32_t>(write_index, EVENT_LOG_SIZE);
+    for (uint32_t pos = offset.value(); pos < count * sizeof(Entry) && !output_buffer->empty(); ++pos) {
+        const Entry& entry = storage.entries[(write_index - count + pos / sizeof(Entry)) & (EVENT_LOG_SIZE - 1)];
+        *output_buffer->begin() = reinterpret_cast<const uint8_t*>(&entry)[pos % sizeof(Entry)];
+        *output_buffer += 1;
+    }
+    return true;
+}
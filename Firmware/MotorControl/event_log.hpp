@@ -0,0 +1,50 @@
+#ifndef __EVENT_LOG_HPP
+#define __EVENT_LOG_HPP
+
+#include <stdint.h>
+#include <autogen/interfaces.hpp>
+
+#define EVENT_LOG_SIZE 64 // entries, must be a power of two
+#define EVENT_LOG_AXIS_NONE 0xff
+
+/**
+ * @brief Ring buffer of the errors in the order they occurred, together with
+ * the state of the system at that moment.
+ *
+ * An entry is recorded whenever one of the error setters sets a bit that was
+ * not set before, so an error that stays active does not flood the log. The
+ * entries live in .noinit RAM and survive a soft reset (e.g. reboot()) but
+ * not a power cycle. After a reset the log is continued with an incremented
+ * boot count.
+ *
+ * record() is lock-free and can be called from any interrupt priority. The
+ * oldest entries are overwritten when the buffer is full.
+ */
+class EventLog : public ODriveIntf::EventLogIntf {
+public:
+    struct Entry {
+        uint64_t error; // the new error bits
+        uint32_t loop_count; // control loop iteration, see odrv.n_evt_control_loop
+        uint16_t boot_count;
+        uint8_t source; // EventLog::Source
+        uint8_t axis; // EVENT_LOG_AXIS_NONE for errors of the ODrive itself
+        float vbus_voltage; // [V]
+        float ibus; // [A]
+        float Iq_measured; // [A] NaN for errors of the ODrive itself
+        float vel_estimate; // [turn/s] NaN for errors of the ODrive itself
+    };
+
+    void init();
+    void record(Source source, uint8_t axis, uint64_t error);
+
+    uint32_t get_write_index();
+    uint32_t get_boot_count();
+    void clear() override;
+    bool read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+
+    const uint32_t size_ = EVENT_LOG_SIZE;
+};
+
+extern EventLog event_log;
+
+#endif // __EVENT_LOG_HPP
@@ -0,0 +1,66 @@
+#include "filter_bank.hpp"
+#include "odrive_main.h"
+
+bool FilterBank::apply_config() {
+    Biquad sections[kNumStages];
+    size_t n_sections = 0;
+
+    for (Stage_t& stage : config_.stages) {
+        stage.parent = this;
+        if (!(sample_period_ > 0.0f) || !(stage.frequency > 0.0f)) {
+            continue;
+        }
+        float sample_rate = 1.0f / sample_period_;
+        float q = std::max(stage.q, 0.1f);
+        switch (stage.type) {
+            case FILTER_TYPE_LOW_PASS: sections[n_sections++] = Biquad::low_pass(stage.frequency, q, sample_rate); break;
+            case FILTER_TYPE_NOTCH: sections[n_sections++] = Biquad::notch(stage.frequency, q, sample_rate); break;
+            case FILTER_TYPE_LEAD_LAG:
+                if (stage.pole_frequency > 0.0f) {
+                    sections[n_sections++] = Biquad::lead_lag(stage.frequency, stage.pole_frequency, sample_rate);
+                }
+                break;
+            default: break;
+        }
+    }
+
+    // The control loop must never see a half written set of coefficients
+    CRITICAL_SECTION() {
+        std::copy(sections, sections + n_sections, sections_);
+        n_sections_ = n_sections;
+        settled_ = false;
+    }
+    return true;
+}
+
+void FilterBank::set_sample_period(float sample_period) {
+    if (sample_period != sample_period_) {
+        sample_period_ = sample_period;
+        apply_config();
+    }
+}
+
+void FilterBank::reset() {
+    settled_ = false;
+}
+
+void FilterBank::update(uint32_t timestamp) {
+    std::optional<float> input = input_src_.present();
+    if (!input.has_value()) {
+        settled_ = false;
+        return;
+    }
+
+    float x = *input;
+    if (!settled_) {
+        for (size_t i = 0; i < n_sections_; ++i) {
+            x = states_[i].settle(sections_[i], x);
+        }
+        settled_ = true;
+    } else {
+        for (size_t i = 0; i < n_sections_; ++i) {
+            x = states_[i].update(sections_[i], x);
+        }
+    }
+    output_ = x;
+}
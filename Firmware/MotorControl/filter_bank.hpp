@@ -0,0 +1,59 @@
+#ifndef __FILTER_BANK_HPP
+#define __FILTER_BANK_HPP
+
+#include "component.hpp"
+#include "biquad.hpp"
+#include <autogen/interfaces.hpp>
+
+/**
+ * @brief A cascade of configurable second order filters on one signal, e.g.
+ * notch filters to suppress mechanical resonances in the torque setpoint.
+ *
+ * The coefficients are computed whenever the configuration or the sample
+ * period changes, so update() only runs the sections that are enabled. With
+ * all stages set to FILTER_TYPE_NONE the input is passed through unchanged.
+ */
+class FilterBank : public ODriveIntf::FilterBankIntf, public ComponentBase {
+public:
+    static constexpr size_t kNumStages = 3;
+
+    struct Stage_t {
+        FilterType type = FILTER_TYPE_NONE;
+        float frequency = 100.0f; // [Hz] cutoff, notch or zero frequency
+        float q = 0.707f; // quality factor of low pass and notch
+        float pole_frequency = 200.0f; // [Hz] only used by FILTER_TYPE_LEAD_LAG
+
+        // custom setters
+        FilterBank* parent = nullptr;
+        void set_type(FilterType value) { type = value; parent->apply_config(); }
+        void set_frequency(float value) { frequency = value; parent->apply_config(); }
+        void set_q(float value) { q = value; parent->apply_config(); }
+        void set_pole_frequency(float value) { pole_frequency = value; parent->apply_config(); }
+    };
+
+    struct Config_t {
+        Stage_t stages[kNumStages];
+    };
+
+    bool apply_config();
+    void set_sample_period(float sample_period);
+    void reset();
+    void update(uint32_t timestamp) final;
+
+    Config_t config_;
+
+    // Inputs
+    InputPort<float> input_src_;
+
+    // Outputs
+    OutputPort<float> output_ = 0.0f;
+
+private:
+    float sample_period_ = 0.0f; // [s] 0 until set by the owner
+    Biquad sections_[kNumStages];
+    BiquadState states_[kNumStages];
+    size_t n_sections_ = 0;
+    bool settled_ = false;
+};
+
+#endif // __FILTER_BANK_HPP
@@ -3,38 +3,49 @@
 #include <board.h>
 
 Motor::Error AlphaBetaFrameController::on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<std::array<float, 3>> currents,
-            uint32_t input_timestamp) {
-
-    std::optional<float2D> Ialpha_beta;
-    
-    if (currents.has_value()) {
-        // Clarke transform
-        Ialpha_beta = {
-            (*currents)[0],
-            one_by_sqrt3 * ((*currents)[1] - (*currents)[2])
-        };
-    }
-    
-    return on_measurement(vbus_voltage, Ialpha_beta, input_timestamp);
+            const Measurement<std::array<float, 3>>& meas) {
+    AlphaBetaMeasurement ab_meas;
+    ab_meas.vbus_voltage = meas.vbus_voltage;
+    ab_meas.timestamp = meas.timestamp;
+    ab_meas.valid = meas.valid;
+
+    // Clarke transform (garbage in, garbage out if the currents are invalid)
+    ab_meas.currents = {
+        meas.currents[0],
+        one_by_sqrt3 * (meas.currents[1] - meas.currents[2])
+    };
+
+    return on_measurement(ab_meas);
 }
 
 Motor::Error AlphaBetaFrameController::get_output(
             uint32_t output_timestamp, float (&pwm_timings)[3],
-            std::optional<float>* ibus) {
-    std::optional<float2D> mod_alpha_beta;
+            float* ibus) {
+    float2D mod_alpha_beta = {NAN, NAN};
     Motor::Error status = get_alpha_beta_output(output_timestamp, &mod_alpha_beta, ibus);
     
     if (status != Motor::ERROR_NONE) {
         return status;
-    } else if (!mod_alpha_beta.has_value() || is_nan(mod_alpha_beta->first) || is_nan(mod_alpha_beta->second)) {
+    } else if (is_nan(mod_alpha_beta.first) || is_nan(mod_alpha_beta.second)) {
         return Motor::ERROR_MODULATION_IS_NAN;
     }
 
-    auto [tA, tB, tC, success] = SVM(mod_alpha_beta->first, mod_alpha_beta->second);
+    auto [tA, tB, tC, success] = SVM(mod_alpha_beta.first, mod_alpha_beta.second);
     if (!success) {
-        return Motor::ERROR_MODULATION_MAGNITUDE;
+        if (modulation_mode_ == Motor::MODULATION_MODE_HEXAGON) {
+            // The timings are centered around 0.5 so scaling them by the
+            // inverse of their span puts the vector on the hexagon edge.
+            float k = 1.0f / (std::max(tA, std::max(tB, tC)) - std::min(tA, std::min(tB, tC)));
+            tA = 0.5f + (tA - 0.5f) * k;
+            tB = 0.5f + (tB - 0.5f) * k;
+            tC = 0.5f + (tC - 0.5f) * k;
+        } else if (modulation_mode_ == Motor::MODULATION_MODE_SIX_STEP) {
+            tA = std::clamp(tA, 0.0f, 1.0f);
+            tB = std::clamp(tB, 0.0f, 1.0f);
+            tC = std::clamp(tC, 0.0f, 1.0f);
+        } else {
+            return Motor::ERROR_MODULATION_MAGNITUDE;
+        }
     }
 
     pwm_timings[0] = tA;
@@ -44,32 +55,42 @@ Motor::Error AlphaBetaFrameController::get_output(
     return Motor::ERROR_NONE;
 }
 
+// Maximum modulation magnitude that the current controller may request
+static float max_modulation(Motor::ModulationMode mode) {
+    switch (mode) {
+        // Vertices of the hexagon. Anything beyond the edge gets scaled back in get_output().
+        case Motor::MODULATION_MODE_HEXAGON: return 1.0f;
+        // Far enough beyond the hexagon that the clamped output is close to six-step.
+        case Motor::MODULATION_MODE_SIX_STEP: return 2.0f;
+        // 80% of the inscribed circle of the hexagon
+        default: return 0.80f * sqrt3_by_2;
+    }
+}
+
 void FieldOrientedController::reset() {
     v_current_control_integral_d_ = 0.0f;
     v_current_control_integral_q_ = 0.0f;
-    vbus_voltage_measured_ = std::nullopt;
-    Ialpha_beta_measured_ = std::nullopt;
+    Vdq_last_ = {0.0f, 0.0f};
+    meas_.valid = 0;
+    Ialpha_beta_prev_ = std::nullopt;
 }
 
 Motor::Error FieldOrientedController::on_measurement(
-        std::optional<float> vbus_voltage, std::optional<float2D> Ialpha_beta,
-        uint32_t input_timestamp) {
+        const AlphaBetaMeasurement& meas) {
     // Store the measurements for later processing.
-    i_timestamp_ = input_timestamp;
-    vbus_voltage_measured_ = vbus_voltage;
-    Ialpha_beta_measured_ = Ialpha_beta;
+    meas_ = meas;
 
     return Motor::ERROR_NONE;
 }
 
-ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
-        uint32_t output_timestamp, std::optional<float2D>* mod_alpha_beta,
-        std::optional<float>* ibus) {
+RAMFUNC ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
+        uint32_t output_timestamp, float2D* mod_alpha_beta,
+        float* ibus) {
 
-    if (!vbus_voltage_measured_.has_value() || !Ialpha_beta_measured_.has_value()) {
+    if (!meas_.has(AlphaBetaMeasurement::kVbusValid | AlphaBetaMeasurement::kCurrentsValid)) {
         // FOC didn't receive a current measurement yet.
         return Motor::ERROR_CONTROLLER_INITIALIZING;
-    } else if (abs((int32_t)(i_timestamp_ - ctrl_timestamp_)) > MAX_CONTROL_LOOP_UPDATE_TO_CURRENT_UPDATE_DELTA) {
+    } else if (abs((int32_t)(meas_.timestamp - ctrl_timestamp_)) > MAX_CONTROL_LOOP_UPDATE_TO_CURRENT_UPDATE_DELTA) {
         // Data from control loop and current measurement are too far apart.
         return Motor::ERROR_BAD_TIMING;
     }
@@ -82,33 +103,34 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
         return Motor::ERROR_UNKNOWN_VOLTAGE_COMMAND;
     } else if (!phase_.has_value() || !phase_vel_.has_value()) {
         return Motor::ERROR_UNKNOWN_PHASE_ESTIMATE;
-    } else if (!vbus_voltage_measured_.has_value()) {
-        return Motor::ERROR_UNKNOWN_VBUS_VOLTAGE;
     }
 
     auto [Vd, Vq] = *Vdq_setpoint_;
     float phase = *phase_;
     float phase_vel = *phase_vel_;
-    float vbus_voltage = *vbus_voltage_measured_;
+    float vbus_voltage = meas_.vbus_voltage;
 
-    std::optional<float2D> Idq;
+    // Multiplying by the reciprocal avoids a VDIV per timestamp conversion
+    constexpr float s_per_tick = 1.0f / (float)TIM_1_8_CLOCK_HZ;
 
     // Park transform
-    if (Ialpha_beta_measured_.has_value()) {
-        auto [Ialpha, Ibeta] = *Ialpha_beta_measured_;
-        float I_phase = phase + phase_vel * ((float)(int32_t)(i_timestamp_ - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
-        float c_I = our_arm_cos_f32(I_phase);
-        float s_I = our_arm_sin_f32(I_phase);
-        Idq = {
-            c_I * Ialpha + s_I * Ibeta,
-            c_I * Ibeta - s_I * Ialpha
-        };
-        Id_measured_ += I_measured_report_filter_k_ * (Idq->first - Id_measured_);
-        Iq_measured_ += I_measured_report_filter_k_ * (Idq->second - Iq_measured_);
-    } else {
-        Id_measured_ = 0.0f;
-        Iq_measured_ = 0.0f;
+    auto [Ialpha, Ibeta] = meas_.currents;
+    if (hfi_voltage_ != 0.0f && Ialpha_beta_prev_.has_value()) {
+        // The injected square wave alternates every period, so the mean
+        // of two consecutive measurements contains no ripple.
+        Ialpha = 0.5f * (Ialpha + Ialpha_beta_prev_->first);
+        Ibeta = 0.5f * (Ibeta + Ialpha_beta_prev_->second);
     }
+    Ialpha_beta_prev_ = meas_.currents;
+    float I_phase = phase + phase_vel * ((float)(int32_t)(meas_.timestamp - ctrl_timestamp_) * s_per_tick);
+    auto [s_I, c_I] = fast_sincos(I_phase);
+    float2D Idq = {
+        c_I * Ialpha + s_I * Ibeta,
+        c_I * Ibeta - s_I * Ialpha
+    };
+    Idq_last_ = Idq;
+    Id_measured_ += I_measured_report_filter_k_ * (Idq.first - Id_measured_);
+    Iq_measured_ += I_measured_report_filter_k_ * (Idq.second - Iq_measured_);
 
 
     float mod_to_V = (2.0f / 3.0f) * vbus_voltage;
@@ -121,26 +143,57 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
 
         if (!pi_gains_.has_value()) {
             return Motor::ERROR_UNKNOWN_GAINS;
-        } else if (!Idq.has_value()) {
-            return Motor::ERROR_UNKNOWN_CURRENT_MEASUREMENT;
         } else if (!Idq_setpoint_.has_value()) {
             return Motor::ERROR_UNKNOWN_CURRENT_COMMAND;
         }
 
         auto [p_gain, i_gain] = *pi_gains_;
-        auto [Id, Iq] = *Idq;
+        auto [Id, Iq] = Idq;
         auto [Id_setpoint, Iq_setpoint] = *Idq_setpoint_;
 
+        if (p_gain_schedule_inv_step_ > 0.0f) {
+            // Interpolate the proportional gain for saturating motors
+            float x = std::min(std::abs(Iq_setpoint) * p_gain_schedule_inv_step_, (float)(p_gain_schedule_.size() - 1));
+            size_t idx = std::min((size_t)x, p_gain_schedule_.size() - 2);
+            float fract = x - (float)idx;
+            p_gain = p_gain_schedule_[idx] + fract * (p_gain_schedule_[idx + 1] - p_gain_schedule_[idx]);
+        }
+
         float Ierr_d = Id_setpoint - Id;
         float Ierr_q = Iq_setpoint - Iq;
 
-        // Apply PI control (V{d,q}_setpoint act as feed-forward terms in this mode)
-        mod_d = V_to_mod * (Vd + v_current_control_integral_d_ + Ierr_d * p_gain);
-        mod_q = V_to_mod * (Vq + v_current_control_integral_q_ + Ierr_q * p_gain);
+        if (current_controller_type_ == Motor::CURRENT_CONTROLLER_TYPE_DEADBEAT
+                && current_control_bandwidth_ > 0.0f && p_gain > 0.0f) {
+            // The PI gains are bandwidth * {L, R}
+            float inv_bandwidth = 1.0f / current_control_bandwidth_;
+            float R = i_gain * inv_bandwidth;
+            float T_by_L = current_meas_period * current_control_bandwidth_ / p_gain;
+            float L_by_T = 1.0f / T_by_L;
+
+            // The disturbance voltage (bEMF, cross coupling) is estimated by
+            // the feedforward plus the integrator.
+            float Ed = Vd + v_current_control_integral_d_;
+            float Eq = Vq + v_current_control_integral_q_;
+
+            // The new voltage only takes effect after one control period.
+            // Predict the current at that time from the voltage that is
+            // applied until then.
+            float Id_pred = Id + T_by_L * (Vdq_last_.first - Ed - R * Id);
+            float Iq_pred = Iq + T_by_L * (Vdq_last_.second - Eq - R * Iq);
+
+            // Choose the voltage that brings the predicted current to the
+            // setpoint within one control period.
+            mod_d = V_to_mod * (Ed + R * Id_pred + L_by_T * (Id_setpoint - Id_pred));
+            mod_q = V_to_mod * (Eq + R * Iq_pred + L_by_T * (Iq_setpoint - Iq_pred));
+        } else {
+            // Apply PI control (V{d,q}_setpoint act as feed-forward terms in this mode)
+            mod_d = V_to_mod * (Vd + v_current_control_integral_d_ + Ierr_d * p_gain);
+            mod_q = V_to_mod * (Vq + v_current_control_integral_q_ + Ierr_q * p_gain);
+        }
 
         // Vector modulation saturation, lock integrator if saturated
-        // TODO make maximum modulation configurable
-        float mod_scalefactor = 0.80f * sqrt3_by_2 * 1.0f / std::sqrt(mod_d * mod_d + mod_q * mod_q);
+        float mod_scalefactor = max_modulation(modulation_mode_) * fast_rsqrt(mod_d * mod_d + mod_q * mod_q);
+        modulation_utilization_ = 1.0f / mod_scalefactor;
         if (mod_scalefactor < 1.0f) {
             mod_d *= mod_scalefactor;
             mod_q *= mod_scalefactor;
@@ -156,12 +209,20 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
         // Voltage control mode
         mod_d = V_to_mod * Vd;
         mod_q = V_to_mod * Vq;
+        modulation_utilization_ = std::sqrt(mod_d * mod_d + mod_q * mod_q) / max_modulation(modulation_mode_);
     }
 
+    Vdq_last_ = {mod_to_V * mod_d, mod_to_V * mod_q};
+
+    // Added after Vdq_last_ because the current controller doesn't see the
+    // ripple that it causes.
+    mod_d += V_to_mod * hfi_voltage_;
+
     // Inverse park transform
-    float pwm_phase = phase + phase_vel * ((float)(int32_t)(output_timestamp - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
-    float c_p = our_arm_cos_f32(pwm_phase);
-    float s_p = our_arm_sin_f32(pwm_phase);
+    // The output only becomes active around output_timestamp so the phase is
+    // advanced accordingly to avoid d/q cross coupling at high speeds.
+    float pwm_phase = phase + phase_vel * ((float)(int32_t)(output_timestamp - ctrl_timestamp_) * (s_per_tick * pwm_delay_compensation_));
+    auto [s_p, c_p] = fast_sincos(pwm_phase);
     float mod_alpha = c_p * mod_d - s_p * mod_q;
     float mod_beta = c_p * mod_q + s_p * mod_d;
 
@@ -170,11 +231,7 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
     final_v_beta_ = mod_to_V * mod_beta;
 
     *mod_alpha_beta = {mod_alpha, mod_beta};
-
-    if (Idq.has_value()) {
-        auto [Id, Iq] = *Idq;
-        *ibus = mod_d * Id + mod_q * Iq;
-    }
+    *ibus = mod_d * Idq.first + mod_q * Idq.second;
     
     return Motor::ERROR_NONE;
 }
@@ -187,5 +244,6 @@ void FieldOrientedController::update(uint32_t timestamp) {
         Vdq_setpoint_ = Vdq_setpoint_src_.present();
         phase_ = phase_src_.present();
         phase_vel_ = phase_vel_src_.present();
+        hfi_voltage_ = hfi_voltage_src_.present().value_or(0.0f);
     }
 }
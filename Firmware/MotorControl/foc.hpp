@@ -8,7 +8,8 @@
  * @brief Field oriented controller.
  * 
  * This controller can run in either current control mode or voltage control
- * mode.
+ * mode. In current control mode either a PI controller or a deadbeat
+ * predictive controller is used (see current_controller_type_).
  */
 class FieldOrientedController : public AlphaBetaFrameController, public ComponentBase {
 public:
@@ -17,18 +18,25 @@ public:
     void reset() final;
     
     ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<float2D> Ialpha_beta,
-            uint32_t input_timestamp) final;
+            const AlphaBetaMeasurement& meas) final;
 
     ODriveIntf::MotorIntf::Error get_alpha_beta_output(
             uint32_t output_timestamp,
-            std::optional<float2D>* mod_alpha_beta,
-            std::optional<float>* ibus) final;
+            float2D* mod_alpha_beta,
+            float* ibus) final;
+
+    float2D get_Ialpha_beta_measured() {
+        return meas_.has(AlphaBetaMeasurement::kCurrentsValid) ? meas_.currents : float2D{0.0f, 0.0f};
+    }
 
     // Config - these values are set while this controller is inactive
     std::optional<float2D> pi_gains_; // [V/A, V/As] should be auto set after resistance and inductance measurement
+    std::array<float, 5> p_gain_schedule_ = {}; // [V/A] proportional gain at |Iq| = i / p_gain_schedule_inv_step_
+    float p_gain_schedule_inv_step_ = 0.0f; // [1/A] 0 disables gain scheduling
     float I_measured_report_filter_k_ = 1.0f;
+    float pwm_delay_compensation_ = 1.0f; // scales the phase extrapolation to the output timestamp
+    ODriveIntf::MotorIntf::CurrentControllerType current_controller_type_ = ODriveIntf::MotorIntf::CURRENT_CONTROLLER_TYPE_PI;
+    float current_control_bandwidth_ = 0.0f; // [rad/s] relates pi_gains_ to the plant R and L for the deadbeat controller
 
     // Inputs
     bool enable_current_control_src_ = false;
@@ -36,6 +44,7 @@ public:
     InputPort<float2D> Vdq_setpoint_src_;
     InputPort<float> phase_src_;
     InputPort<float> phase_vel_src_;
+    InputPort<float> hfi_voltage_src_; // optional
 
     // These values are set atomically by the update() function and read by the
     // calculate() function in an interrupt context.
@@ -45,11 +54,11 @@ public:
     std::optional<float2D> Vdq_setpoint_; // [V] feed-forward voltage term (or standalone setpoint if enable_current_control_ == false)
     std::optional<float> phase_; // [rad]
     std::optional<float> phase_vel_; // [rad/s]
+    float hfi_voltage_ = 0.0f; // [V] injected on the d axis
 
     // These values (or some of them) are updated inside on_measurement() and get_alpha_beta_output()
-    uint32_t i_timestamp_;
-    std::optional<float> vbus_voltage_measured_; // [V]
-    std::optional<float2D> Ialpha_beta_measured_; // [A, A]
+    AlphaBetaMeasurement meas_; // [V], [A, A]
+    std::optional<float2D> Ialpha_beta_prev_; // [A, A] previous measurement, to average out the HFI ripple
     float Id_measured_; // [A]
     float Iq_measured_; // [A]
     float v_current_control_integral_d_ = 0.0f; // [V]
@@ -58,6 +67,9 @@ public:
     //float mod_d_ = 0.0f;
     //float mod_q_ = 0.0f;
     //float ibus_ = 0.0f;
+    float2D Idq_last_ = {0.0f, 0.0f}; // [A] unfiltered, for the RL estimator
+    float2D Vdq_last_ = {0.0f, 0.0f}; // [V] voltage after modulation saturation, for the RL estimator
+    float modulation_utilization_ = 0.0f; // requested modulation magnitude relative to the maximum. Above 1.0 the output is saturated.
     float final_v_alpha_ = 0.0f; // [V]
     float final_v_beta_ = 0.0f; // [V]
 };
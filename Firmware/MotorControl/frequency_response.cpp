@@ -0,0 +1,37 @@
+#include "frequency_response.hpp"
+#include <odrive_main.h>
+
+bool FrequencyResponse::run() {
+    num_results_ = 0;
+    result_target_ = config_.target;
+    if (!(config_.min_freq > 0.0f) || !(config_.max_freq >= config_.min_freq) || !(config_.amplitude > 0.0f)) {
+        return false;
+    }
+
+    uint32_t n = std::clamp<uint32_t>(config_.num_points, 1, FREQUENCY_RESPONSE_MAX_POINTS);
+    float sample_period = axis_->controller_.update_period_; // the excitation is added by the controller
+    for (uint32_t i = 0; i < n; ++i) {
+        float freq = n > 1 ? config_.min_freq * std::pow(config_.max_freq / config_.min_freq, (float)i / (float)(n - 1)) : config_.min_freq;
+        uint32_t settle_cycles = std::max(config_.settle_cycles, (uint32_t)std::ceil(config_.settle_time * freq));
+
+        CRITICAL_SECTION() {
+            analyzer_.start(freq, settle_cycles, config_.measure_cycles, sample_period);
+            active_ = true;
+        }
+
+        while (!analyzer_.done()) {
+            if (axis_->requested_state_ != Axis::AXIS_STATE_UNDEFINED || !axis_->motor_.is_armed_) {
+                active_ = false;
+                return true; // the points measured so far stay valid
+            }
+            osDelay(1);
+        }
+        active_ = false;
+
+        freq_[i] = analyzer_.freq();
+        gain_[i] = analyzer_.gain();
+        phase_[i] = analyzer_.phase();
+        num_results_ = i + 1;
+    }
+    return true;
+}
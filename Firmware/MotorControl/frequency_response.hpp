@@ -0,0 +1,65 @@
+#ifndef __FREQUENCY_RESPONSE_HPP
+#define __FREQUENCY_RESPONSE_HPP
+
+class Axis; // declared in axis.hpp
+
+#include "sine_analyzer.hpp"
+#include <autogen/interfaces.hpp>
+
+#define FREQUENCY_RESPONSE_MAX_POINTS 32
+
+/**
+ * @brief Stepped sine frequency response measurement of the control loop
+ * (AXIS_STATE_FREQUENCY_RESPONSE).
+ *
+ * For each of the logarithmically spaced frequencies the controller adds a
+ * sine to the torque or velocity command. The command and the velocity
+ * estimate are correlated with the sine on the device, so only one gain and
+ * phase per frequency have to be read out afterwards.
+ */
+class FrequencyResponse : public ODriveIntf::FrequencyResponseIntf {
+public:
+    struct Config_t {
+        ExcitationTarget target = EXCITATION_TARGET_TORQUE;
+        float amplitude = 0.1f; // [Nm] or [turn/s] depending on target
+        float min_freq = 1.0f; // [Hz]
+        float max_freq = 200.0f; // [Hz]
+        uint32_t num_points = 20; // at most FREQUENCY_RESPONSE_MAX_POINTS
+        uint32_t settle_cycles = 3;
+        float settle_time = 0.2f; // [s] minimum settle time at each frequency
+        uint32_t measure_cycles = 10;
+    };
+
+    // Called by the axis thread. Blocks until the sweep is done or aborted.
+    bool run();
+
+    // Called by the controller in the control loop
+    float excitation(ExcitationTarget target) {
+        return (active_ && config_.target == target) ? config_.amplitude * analyzer_.excitation() : 0.0f;
+    }
+    void update(float command, float vel_estimate) {
+        if (active_) {
+            analyzer_.update(command, vel_estimate);
+        }
+    }
+
+    float get_freq(uint32_t index) { return index < num_results_ ? freq_[index] : 0.0f; }
+    float get_gain(uint32_t index) { return index < num_results_ ? gain_[index] : 0.0f; }
+    float get_phase(uint32_t index) { return index < num_results_ ? phase_[index] : 0.0f; }
+
+    Config_t config_;
+    Axis* axis_ = nullptr; // set by Axis constructor
+
+    uint32_t num_results_ = 0;
+    ExcitationTarget result_target_ = EXCITATION_TARGET_TORQUE; // target of the last sweep
+
+private:
+    SineAnalyzer analyzer_;
+    volatile bool active_ = false;
+
+    float freq_[FREQUENCY_RESPONSE_MAX_POINTS]; // [Hz]
+    float gain_[FREQUENCY_RESPONSE_MAX_POINTS]; // [(turn/s) / Nm] or [(turn/s) / (turn/s)]
+    float phase_[FREQUENCY_RESPONSE_MAX_POINTS]; // [rad]
+};
+
+#endif // __FREQUENCY_RESPONSE_HPP
@@ -0,0 +1,149 @@
+#ifndef __FRICTION_MODEL_HPP
+#define __FRICTION_MODEL_HPP
+
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Coulomb, viscous and Stribeck friction torque [Nm] at the velocity
+ * vel [turn/s]:
+ *   sign(vel) * (coulomb + stribeck / (1 + (vel / stribeck_vel)^2)) + viscous * vel
+ *
+ * The Stribeck term is the breakaway torque in excess of the Coulomb friction
+ * that fades out above stribeck_vel. It is the rational form of the usual
+ * exponential curve, which saves an exp() per control loop iteration. Within
+ * +-zero_vel the sign is replaced by a linear ramp so that the feedforward
+ * doesn't chatter around standstill.
+ */
+inline float friction_torque(float vel, float coulomb, float viscous, float stribeck,
+                             float stribeck_vel, float zero_vel) {
+    float sign = zero_vel > 0.0f ? std::clamp(vel / zero_vel, -1.0f, 1.0f)
+                                 : (float)((vel > 0.0f) - (vel < 0.0f));
+    float breakaway = 0.0f;
+    if (stribeck_vel > 0.0f) {
+        float x = vel / stribeck_vel;
+        breakaway = stribeck / (1.0f + x * x);
+    }
+    return sign * (coulomb + breakaway) + viscous * vel;
+}
+
+/**
+ * @brief Least squares fit of friction_torque() to the friction measured at
+ * n velocities (all > 0) for a given stribeck_vel.
+ *
+ * If the fit gives a negative term (usually because the velocities don't
+ * reach down to stribeck_vel) the Stribeck term is dropped and the Coulomb
+ * and viscous friction are fitted alone. Returns false if the velocities
+ * don't determine the parameters.
+ */
+inline bool fit_friction(const float* vel, const float* friction, size_t n, float stribeck_vel,
+                         float* coulomb, float* viscous, float* stribeck) {
+    // Normal equations of friction = c * 1 + b * vel + s * S(vel)
+    float A[3][3] = {};
+    float y[3] = {};
+    for (size_t i = 0; i < n; ++i) {
+        float x = stribeck_vel > 0.0f ? vel[i] / stribeck_vel : INFINITY;
+        float basis[3] = {1.0f, vel[i], 1.0f / (1.0f + x * x)};
+        for (size_t j = 0; j < 3; ++j) {
+            for (size_t k = 0; k < 3; ++k) {
+                A[j][k] += basis[j] * basis[k];
+            }
+            y[j] += basis[j] * friction[i];
+        }
+    }
+
+    auto det3 = [](const float (&m)[3][3]) {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+             - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+             + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    };
+    float det = det3(A);
+    if (std::abs(det) > 1e-6f * A[0][0] * A[1][1] * A[2][2]) {
+        float p[3];
+        for (size_t j = 0; j < 3; ++j) {
+            float M[3][3];
+            for (size_t r = 0; r < 3; ++r) {
+                for (size_t c = 0; c < 3; ++c) {
+                    M[r][c] = c == j ? y[r] : A[r][c];
+                }
+            }
+            p[j] = det3(M) / det; // Cramer's rule
+        }
+        if (p[0] >= 0.0f && p[1] >= 0.0f && p[2] >= 0.0f) {
+            *coulomb = p[0];
+            *viscous = p[1];
+            *stribeck = p[2];
+            return true;
+        }
+    }
+
+    // Coulomb and viscous friction only
+    float det2 = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+    if (!(std::abs(det2) > 1e-6f * A[0][0] * A[1][1])) {
+        return false;
+    }
+    float c = (y[0] * A[1][1] - A[0][1] * y[1]) / det2;
+    float b = (A[0][0] * y[1] - A[1][0] * y[0]) / det2;
+    if (c < 0.0f) {
+        c = 0.0f;
+        b = y[1] / A[1][1];
+    } else if (b < 0.0f) {
+        b = 0.0f;
+        c = y[0] / A[0][0];
+    }
+    *coulomb = std::max(c, 0.0f);
+    *viscous = std::max(b, 0.0f);
+    *stribeck = 0.0f;
+    return true;
+}
+
+/**
+ * @brief Estimates the backlash from the torque over the travel after a
+ * reversal of a slow constant velocity motion.
+ *
+ * While the motor crosses the gap it only turns its own friction, so the
+ * torque takes longer to go from the level before the reversal to the level
+ * after it. The backlash is taken as the travel between 10% and 90% of that
+ * transition, which also contains the (usually much smaller) compliance of
+ * the drive train.
+ *
+ * @param torque: Mean torque of n bins of bin_width travel after the reversal [Nm]
+ * @param before: Torque level before the reversal [Nm]
+ * @param after: Torque level after the reversal [Nm]
+ * @returns the backlash in the units of bin_width. If the transition does
+ *          not complete within the bins, their total travel is returned.
+ */
+inline float backlash_from_reversal(const float* torque, size_t n, float bin_width, float before, float after) {
+    float step = after - before;
+    size_t start = n;
+    for (size_t i = 0; i < n; ++i) {
+        float progress = (torque[i] - before) / step;
+        if (start == n && progress >= 0.1f) {
+            start = i;
+        }
+        if (progress >= 0.9f) {
+            return (float)(i - std::min(start, i)) * bin_width;
+        }
+    }
+    return (float)n * bin_width;
+}
+
+/**
+ * @brief Moves the position offset that makes up for the backlash towards
+ * +-backlash / 2 in the direction of the velocity setpoint, at most by
+ * slew_rate * dt. The offset is kept while the velocity is within +-zero_vel.
+ */
+inline float update_backlash_offset(float offset, float vel, float backlash, float zero_vel,
+                                    float slew_rate, float dt) {
+    float target = offset;
+    if (vel > zero_vel) {
+        target = 0.5f * backlash;
+    } else if (vel < -zero_vel) {
+        target = -0.5f * backlash;
+    }
+    float max_step = slew_rate * dt;
+    return offset + std::clamp(target - offset, -max_step, max_step);
+}
+
+#endif // __FRICTION_MODEL_HPP
@@ -0,0 +1,130 @@
+#ifndef __GAIN_SCHEDULE_HPP
+#define __GAIN_SCHEDULE_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Piecewise linear interpolation of the controller gains over a
+ * scheduling variable (e.g. velocity or position).
+ *
+ * The slopes of all segments are computed by set(), so eval() only has to
+ * find the segment and do one multiply-add per gain. Outside of the
+ * breakpoints the gains of the first or last breakpoint apply.
+ */
+template<size_t N>
+class GainSchedule {
+public:
+    static_assert(N >= 2, "at least two breakpoints required");
+
+    struct Point {
+        float x; // value of the scheduling variable
+        float pos_gain; // [(turn/s) / turn]
+        float vel_gain; // [Nm/(turn/s)]
+        float vel_integrator_gain; // [Nm/(turn/s * s)]
+    };
+
+    /**
+     * @brief Precomputes the segments. Returns false and leaves the schedule
+     * unchanged if the breakpoints are not in increasing order.
+     */
+    bool set(const Point (&points)[N]) {
+        for (size_t i = 0; i + 1 < N; ++i) {
+            if (!(points[i + 1].x >= points[i].x)) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i + 1 < N; ++i) {
+            const Point& a = points[i];
+            const Point& b = points[i + 1];
+            float inv_dx = b.x > a.x ? 1.0f / (b.x - a.x) : 0.0f;
+            segments_[i] = {
+                a, b.x,
+                (b.pos_gain - a.pos_gain) * inv_dx,
+                (b.vel_gain - a.vel_gain) * inv_dx,
+                (b.vel_integrator_gain - a.vel_integrator_gain) * inv_dx
+            };
+        }
+        last_ = points[N - 1];
+        return true;
+    }
+
+    Point eval(float x) const {
+        if (!(x > segments_[0].start.x)) {
+            return segments_[0].start;
+        }
+        for (size_t i = 0; i + 1 < N; ++i) {
+            const Segment& s = segments_[i];
+            if (x < s.end) {
+                float dx = x - s.start.x;
+                return {x, s.start.pos_gain + dx * s.d_pos_gain, s.start.vel_gain + dx * s.d_vel_gain,
+                        s.start.vel_integrator_gain + dx * s.d_vel_integrator_gain};
+            }
+        }
+        return last_;
+    }
+
+private:
+    struct Segment {
+        Point start;
+        float end; // x of the next breakpoint
+        // gains per unit of x
+        float d_pos_gain;
+        float d_vel_gain;
+        float d_vel_integrator_gain;
+    };
+
+    Segment segments_[N - 1] = {};
+    Point last_ = {};
+};
+
+/**
+ * @brief Same interpolation as GainSchedule for K arbitrary values per
+ * breakpoint.
+ */
+template<size_t N, size_t K>
+class LinearSchedule {
+public:
+    static_assert(N >= 2, "at least two breakpoints required");
+
+    /**
+     * @brief Precomputes the slopes. Returns false and leaves the schedule
+     * unchanged if the breakpoints are not in increasing order.
+     */
+    bool set(const float (&x)[N], const float (&y)[N][K]) {
+        for (size_t i = 0; i + 1 < N; ++i) {
+            if (!(x[i + 1] >= x[i])) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < N; ++i) {
+            x_[i] = x[i];
+            float inv_dx = (i + 1 < N && x[i + 1] > x[i]) ? 1.0f / (x[i + 1] - x[i]) : 0.0f;
+            for (size_t k = 0; k < K; ++k) {
+                y_[i][k] = y[i][k];
+                slope_[i][k] = i + 1 < N ? (y[i + 1][k] - y[i][k]) * inv_dx : 0.0f;
+            }
+        }
+        return true;
+    }
+
+    void eval(float x, float (&y)[K]) const {
+        size_t i = 0;
+        float dx = 0.0f;
+        if (x > x_[0]) {
+            while (i + 1 < N && !(x < x_[i + 1])) {
+                i++;
+            }
+            dx = i + 1 < N ? x - x_[i] : 0.0f;
+        }
+        for (size_t k = 0; k < K; ++k) {
+            y[k] = y_[i][k] + dx * slope_[i][k];
+        }
+    }
+
+private:
+    float x_[N] = {};
+    float y_[N][K] = {};
+    float slope_[N][K] = {}; // per unit of x towards the next breakpoint
+};
+
+#endif // __GAIN_SCHEDULE_HPP
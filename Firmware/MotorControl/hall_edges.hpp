@@ -0,0 +1,114 @@
+#ifndef __HALL_EDGES_HPP
+#define __HALL_EDGES_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+
+/**
+ * @brief Placement errors of the six hall sensor edges of one electrical
+ * revolution.
+ *
+ * Edge k is the transition between hall state k - 1 and hall state k. Its
+ * nominal position is the count k of the state, offsets[k] [count] is the
+ * measured deviation from it. State k therefore covers the counts
+ * [k + offsets[k], k + 1 + offsets[k + 1]).
+ */
+static constexpr size_t kHallEdges = 6;
+
+// @brief Returns the width [count] of hall state k
+inline float hall_edge_width(const float (&offsets)[kHallEdges], int32_t k) {
+    return 1.0f + offsets[(k + 1) % kHallEdges] - offsets[k];
+}
+
+/**
+ * @brief Returns the position [count] within hall state k relative to the
+ * count of the state, for the fraction [0, 1] of the state.
+ */
+inline float hall_edge_position(const float (&offsets)[kHallEdges], int32_t k, float fraction) {
+    return offsets[k] + fraction * hall_edge_width(offsets, k);
+}
+
+/**
+ * @brief Discrete phase detector of the PLL for a measured hall state.
+ *
+ * @param k: Measured hall state
+ * @param d: [count] estimated position relative to the count of the state
+ * @returns the number of whole states that the estimate is behind the
+ * measured state, 0 if the estimate is within the state. With all offsets
+ * 0 this is -floor(d), like for evenly spaced counts.
+ */
+inline float hall_edge_phase_error(const float (&offsets)[kHallEdges], int32_t k, float d) {
+    float lo = offsets[k];
+    float hi = 1.0f + offsets[(k + 1) % kHallEdges];
+    if (d < lo) {
+        return -std::floor(d - lo);
+    } else if (d >= hi) {
+        return -std::floor(d - hi) - 1.0f;
+    }
+    return 0.0f;
+}
+
+/**
+ * @brief Averages the measured edge positions of an open loop scan in both
+ * directions.
+ *
+ * The lag of the rotor behind the commanded position and the hysteresis of
+ * the sensors have opposite signs in the two directions, so they cancel in
+ * the mean of both directions. The mean over all edges is removed, it
+ * belongs to the phase offset.
+ */
+class HallEdgeCalibration {
+public:
+    void reset() {
+        *this = {};
+    }
+
+    /**
+     * @param edge: Edge index k, 0 to 5
+     * @param up: true if the count increased at the edge
+     * @param error: [count] commanded position minus nominal edge position
+     */
+    void add(size_t edge, bool up, float error) {
+        if (edge >= kHallEdges) {
+            return;
+        }
+        sum_[edge][up] += error;
+        count_[edge][up]++;
+    }
+
+    /**
+     * @brief Returns false if an edge wasn't passed in both directions or if
+     * the offsets would give a hall state a width of less than
+     * min_width [count].
+     */
+    bool get_offsets(float (&offsets)[kHallEdges], float min_width = 0.25f) {
+        float result[kHallEdges];
+        float mean = 0.0f;
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            if (!count_[k][0] || !count_[k][1]) {
+                return false;
+            }
+            result[k] = 0.5f * (sum_[k][0] / (float)count_[k][0] + sum_[k][1] / (float)count_[k][1]);
+            mean += result[k] / (float)kHallEdges;
+        }
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            result[k] -= mean;
+        }
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            if (hall_edge_width(result, k) < min_width) {
+                return false;
+            }
+        }
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            offsets[k] = result[k];
+        }
+        return true;
+    }
+
+private:
+    float sum_[kHallEdges][2] = {}; // [count] by edge and direction (down, up)
+    uint32_t count_[kHallEdges][2] = {};
+};
+
+#endif // __HALL_EDGES_HPP
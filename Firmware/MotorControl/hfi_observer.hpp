@@ -0,0 +1,202 @@
+#ifndef __HFI_OBSERVER_HPP
+#define __HFI_OBSERVER_HPP
+
+#include <cmath>
+#include "utils.hpp"
+
+/**
+ * @brief Rotor angle estimation of salient motors (Ld < Lq) by high frequency
+ * injection. Works at zero speed.
+ *
+ * A square wave voltage of alternating sign is injected on the estimated
+ * d axis, one sign per current measurement. Over one period the current
+ * changes by
+ *   dI_dq = v * dt * (a + b * exp(j * 2 * err))
+ * in the injection frame, where a = (1/Ld + 1/Lq) / 2, b = (1/Ld - 1/Lq) / 2
+ * and err is the angle of the rotor relative to the injection. So demodulating
+ * the current differences only costs one rotation per update.
+ *
+ * Start-up is done in three steps:
+ *  - STATE_SCAN: The injection turns once through all angles. The 2nd harmonic
+ *    of the response gives the rotor angle modulo pi and the saliency b.
+ *  - STATE_POLARITY: A positive and then a negative d axis current are applied.
+ *    The polarity that saturates the iron (larger response) is the magnet's
+ *    north pole.
+ *  - STATE_TRACK: A PLL follows the rotor with the error b * sin(2 * err).
+ */
+class HfiObserver {
+public:
+    enum State {
+        STATE_IDLE,
+        STATE_SCAN,
+        STATE_POLARITY,
+        STATE_TRACK,
+        STATE_FAILED, // the motor is not salient enough
+    };
+
+    static constexpr size_t kScanSamples = 1024;
+    static constexpr size_t kPolaritySamples = 512; // per sign, the second half of each is evaluated
+    static constexpr float kMinSaliency = 0.02f; // minimum b / a
+
+    void start() {
+        state_ = STATE_SCAN;
+        count_ = 0;
+        outputs_ = 0;
+        scan_sum_ = {0.0f, 0.0f};
+        scan_sum_a_ = 0.0f;
+        polarity_sum_[0] = polarity_sum_[1] = 0.0f;
+        history_[0] = history_[1] = {0.0f, 0.0f, 1.0f, 0.0f};
+        prev_valid_ = false;
+        phase_ = 0.0f;
+        phase_vel_ = 0.0f;
+        id_bias_ = 0.0f;
+    }
+
+    /**
+     * @brief Demodulates the current that was measured in response to the
+     * injection of two updates ago (the voltage applied right before a current
+     * measurement is the one computed two updates earlier).
+     * @param I_alpha, I_beta: Measured current [A]
+     * @param bandwidth: Tracking PLL bandwidth [rad/s]
+     * @param polarity_current: d axis current for the polarity test [A]
+     * @param dt: Time between updates [s]
+     */
+    void update(float I_alpha, float I_beta, float bandwidth, float polarity_current, float dt) {
+        if (state_ == STATE_IDLE || state_ == STATE_FAILED) {
+            return;
+        }
+
+        const Injection& h = history_[1];
+        bool valid = prev_valid_ && h.voltage != 0.0f;
+        float z_d = 0.0f;
+        float z_q = 0.0f;
+        if (valid) {
+            float dI_alpha = I_alpha - prev_I_[0];
+            float dI_beta = I_beta - prev_I_[1];
+            float k = 1.0f / (h.voltage * dt);
+            z_d = k * (h.c * dI_alpha + h.s * dI_beta);
+            z_q = k * (h.c * dI_beta - h.s * dI_alpha);
+        }
+        prev_I_[0] = I_alpha;
+        prev_I_[1] = I_beta;
+        prev_valid_ = true;
+
+        switch (state_) {
+            case STATE_SCAN: {
+                if (valid) {
+                    // z * exp(j * 2 * angle) = a * exp(j * 2 * angle) + b * exp(j * 2 * theta)
+                    float c2 = h.c * h.c - h.s * h.s;
+                    float s2 = 2.0f * h.c * h.s;
+                    scan_sum_.first += z_d * c2 - z_q * s2;
+                    scan_sum_.second += z_d * s2 + z_q * c2;
+                    scan_sum_a_ += z_d;
+                    if (++count_ == kScanSamples) {
+                        a_ = scan_sum_a_ / (float)kScanSamples;
+                        b_ = std::sqrt(scan_sum_.first * scan_sum_.first + scan_sum_.second * scan_sum_.second) / (float)kScanSamples;
+                        if (!(a_ > 0.0f) || !(b_ > kMinSaliency * a_)) {
+                            state_ = STATE_FAILED;
+                            return;
+                        }
+                        phase_ = 0.5f * std::atan2(scan_sum_.second, scan_sum_.first);
+                        state_ = STATE_POLARITY;
+                        count_ = 0;
+                        break;
+                    }
+                }
+                // The injection angle of the next output
+                phase_ = wrap_pm_pi(2.0f * (float)M_PI * (float)outputs_ / (float)kScanSamples);
+            } break;
+
+            case STATE_POLARITY: {
+                id_bias_ = count_ < kPolaritySamples ? polarity_current : -polarity_current;
+                if (valid) {
+                    size_t i = count_ % kPolaritySamples;
+                    if (i >= kPolaritySamples / 2) {
+                        polarity_sum_[count_ / kPolaritySamples] += z_d;
+                    }
+                    if (++count_ == 2 * kPolaritySamples) {
+                        if (polarity_sum_[1] > polarity_sum_[0]) {
+                            phase_ = wrap_pm_pi(phase_ + (float)M_PI);
+                        }
+                        id_bias_ = 0.0f;
+                        phase_vel_ = 0.0f;
+                        state_ = STATE_TRACK;
+                    }
+                }
+            } break;
+
+            case STATE_TRACK: {
+                float kp = 2.0f * bandwidth;
+                float ki = 0.25f * (kp * kp);
+                phase_ = wrap_pm_pi(phase_ + dt * phase_vel_);
+                if (valid) {
+                    // b * sin(2 * err) ~= 2 * b * err
+                    float err = z_q / (2.0f * b_);
+                    float delta_phase = wrap_pm_pi(h.angle + err + 2.0f * dt * phase_vel_ - phase_);
+                    phase_ = wrap_pm_pi(phase_ + dt * kp * delta_phase);
+                    phase_vel_ += dt * ki * delta_phase;
+                }
+            } break;
+
+            default: break;
+        }
+    }
+
+    /**
+     * @brief Records the injection for the next output period and returns the
+     * signed injection voltage [V] to add to the d axis.
+     * @param amplitude: [V] 0 to stop the injection
+     * @param angle: d axis angle used by the current controller [rad]
+     * @param c, s: cos(angle), sin(angle)
+     */
+    float inject(float amplitude, float angle, float c, float s) {
+        sign_ = -sign_;
+        float voltage = (state_ == STATE_IDLE || state_ == STATE_FAILED) ? 0.0f : sign_ * amplitude;
+        history_[1] = history_[0];
+        history_[0] = {voltage, angle, c, s};
+        outputs_++;
+        return voltage;
+    }
+
+    // Slaves the tracking PLL to another estimator while the injection is off
+    void follow(float phase, float phase_vel) {
+        if (state_ == STATE_TRACK) {
+            phase_ = phase;
+            phase_vel_ = phase_vel;
+        }
+    }
+
+    State state() const { return state_; }
+    float phase() const { return phase_; } // [rad]
+    float phase_vel() const { return phase_vel_; } // [rad/s]
+    float id_bias() const { return id_bias_; } // [A] d axis current requested for the polarity test
+    float saliency() const { return a_ > 0.0f ? b_ / a_ : 0.0f; } // (Lq - Ld) / (Lq + Ld)
+
+private:
+    struct Injection {
+        float voltage; // [V]
+        float angle; // [rad]
+        float c;
+        float s;
+    };
+
+    State state_ = STATE_IDLE;
+    size_t count_ = 0;
+    uint32_t outputs_ = 0;
+    float sign_ = 1.0f;
+    Injection history_[2] = {};
+    float prev_I_[2] = {0.0f, 0.0f};
+    bool prev_valid_ = false;
+
+    std::pair<float, float> scan_sum_ = {0.0f, 0.0f};
+    float scan_sum_a_ = 0.0f;
+    float polarity_sum_[2] = {0.0f, 0.0f};
+    float a_ = 0.0f; // [1/H]
+    float b_ = 0.0f; // [1/H]
+
+    float phase_ = 0.0f;
+    float phase_vel_ = 0.0f;
+    float id_bias_ = 0.0f;
+};
+
+#endif // __HFI_OBSERVER_HPP
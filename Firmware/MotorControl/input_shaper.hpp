@@ -0,0 +1,146 @@
+#ifndef __INPUT_SHAPER_HPP
+#define __INPUT_SHAPER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Convolves a reference signal with a short sequence of impulses that
+ * cancel the residual vibration of one lightly damped mode (ZV and ZVD
+ * shapers after Singer and Seering).
+ *
+ * The shaped signal lags the input by half (ZV) or one (ZVD) damped period of
+ * the mode. The history is kept in a ring buffer of N samples. If the delay
+ * is longer than N - 2 updates, only every `stride`-th input is stored and
+ * the delayed values are interpolated linearly.
+ *
+ * All four channels of a sample are shaped with the same impulses, so the
+ * shaped velocity, acceleration and torque stay consistent with the shaped
+ * position.
+ */
+template<size_t N>
+class InputShaper {
+public:
+    struct Sample {
+        float pos;
+        float vel;
+        float accel;
+        float torque;
+    };
+
+    struct Params {
+        size_t n_impulses = 0; // 0: pass through
+        float amplitude[3] = {1.0f, 0.0f, 0.0f};
+        float delay[3] = {0.0f, 0.0f, 0.0f}; // [updates]
+        uint32_t stride = 1;
+    };
+
+    /**
+     * @param n_impulses: 2 for ZV, 3 for ZVD. Anything else disables shaping.
+     * @param freq: Undamped natural frequency of the mode [Hz]
+     * @param damping: Damping ratio of the mode in [0, 1)
+     * @param update_period: Time between calls to update() [s]
+     */
+    static Params design(size_t n_impulses, float freq, float damping, float update_period) {
+        Params params;
+        if ((n_impulses != 2 && n_impulses != 3) || !(freq > 0.0f) || !(update_period > 0.0f)
+                || !(damping >= 0.0f) || !(damping < 1.0f)) {
+            return params;
+        }
+
+        float root = std::sqrt(1.0f - damping * damping);
+        float k = std::exp(-damping * (float)M_PI / root);
+        float half_period = 0.5f / (freq * root) / update_period; // [updates]
+
+        if (n_impulses == 2) {
+            params.amplitude[0] = 1.0f / (1.0f + k);
+            params.amplitude[1] = k / (1.0f + k);
+        } else {
+            float norm = (1.0f + k) * (1.0f + k);
+            params.amplitude[0] = 1.0f / norm;
+            params.amplitude[1] = 2.0f * k / norm;
+            params.amplitude[2] = k * k / norm;
+        }
+        for (size_t i = 0; i < n_impulses; ++i) {
+            params.delay[i] = (float)i * half_period;
+        }
+        float max_delay = params.delay[n_impulses - 1];
+        params.stride = std::max<uint32_t>(1, (uint32_t)std::ceil(max_delay / (float)(N - 2)));
+        params.n_impulses = n_impulses;
+        return params;
+    }
+
+    void set_params(const Params& params) {
+        params_ = params;
+        reset();
+    }
+
+    bool enabled() const {
+        return params_.n_impulses > 0;
+    }
+
+    // The next update() restarts from a steady input
+    void reset() {
+        filled_ = false;
+    }
+
+    Sample update(const Sample& input) {
+        if (!enabled()) {
+            return input;
+        }
+
+        if (!filled_) {
+            std::fill(history_, history_ + N, input);
+            head_ = 0;
+            age_ = 0;
+            filled_ = true;
+        } else if (++age_ >= params_.stride) {
+            head_ = (head_ + 1) % N;
+            history_[head_] = input;
+            age_ = 0;
+        }
+
+        Sample output = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (size_t i = 0; i < params_.n_impulses; ++i) {
+            Sample delayed = at(params_.delay[i], input);
+            float a = params_.amplitude[i];
+            output.pos += a * delayed.pos;
+            output.vel += a * delayed.vel;
+            output.accel += a * delayed.accel;
+            output.torque += a * delayed.torque;
+        }
+        return output;
+    }
+
+private:
+    static Sample lerp(const Sample& a, const Sample& b, float t) {
+        return {
+            a.pos + t * (b.pos - a.pos),
+            a.vel + t * (b.vel - a.vel),
+            a.accel + t * (b.accel - a.accel),
+            a.torque + t * (b.torque - a.torque)
+        };
+    }
+
+    // Input from `delay` updates ago
+    Sample at(float delay, const Sample& input) const {
+        if (delay <= (float)age_) {
+            // Between the current input and the newest stored one
+            return age_ ? lerp(input, history_[head_], delay / (float)age_) : input;
+        }
+        float pos = (delay - (float)age_) / (float)params_.stride; // [stored samples] before head_
+        size_t k = std::min((size_t)pos, N - 2);
+        float t = pos - (float)k;
+        return lerp(history_[(head_ + N - k) % N], history_[(head_ + 2 * N - k - 1) % N], t);
+    }
+
+    Params params_;
+    Sample history_[N];
+    size_t head_ = 0; // index of the newest stored sample
+    uint32_t age_ = 0; // updates since history_[head_] was stored
+    bool filled_ = false;
+};
+
+#endif // __INPUT_SHAPER_HPP
@@ -0,0 +1,168 @@
+#ifndef __ITERATIVE_LEARNING_HPP
+#define __ITERATIVE_LEARNING_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Iterative learning control of a torque feedforward for a motion that
+ * repeats with a fixed cycle.
+ *
+ * The control loop records the position error in N bins of the cycle phase.
+ * After each cycle the feedforward table is updated from the mean error of
+ * each bin:
+ *
+ *   u[i] <- Q(u[i] + gain * e[i + lead])
+ *
+ * The lead compensates the delay of the closed loop between the torque and
+ * the position error. Q is a zero phase low pass (a first order filter run
+ * forwards and backwards around the cycle) which keeps the learning from
+ * amplifying the noise and the dynamics above the tracking bandwidth.
+ *
+ * record() and end_cycle() run in the control loop, update() in a context
+ * with a lower priority that the control loop may preempt. The error of a
+ * cycle is double buffered so that the update has until the end of the next
+ * cycle to run. If it doesn't finish in time the next cycle is skipped.
+ */
+template<size_t N>
+class IterativeLearning {
+public:
+    // Feedforward table, stored in NVM separately from the configuration
+    struct Table {
+        bool learned = false; // set after the first learned cycle
+        float values[N] = {}; // [Nm] feedforward at the phases i / N
+    };
+
+    struct Params {
+        bool learn; // if false only rms_error_ is updated
+        float gain; // [Nm/turn]
+        uint32_t lead; // [bins] the error of bin i + lead updates bin i
+        float filter; // [0, 1) pole of the low pass, 0 to disable
+        float torque_lim; // [Nm] limit of the table values
+    };
+
+    /**
+     * @brief Feedforward [Nm] at the phase [0, 1), interpolated linearly
+     * around the cycle.
+     */
+    static float feedforward(const Table& table, float phase) {
+        float u = phase * (float)N;
+        size_t i = std::min((size_t)std::max(u, 0.0f), N - 1);
+        float t = u - (float)i;
+        return table.values[i] + t * (table.values[(i + 1) % N] - table.values[i]);
+    }
+
+    // @brief Adds a position error [turn] at the phase [0, 1)
+    void record(float phase, float error) {
+        size_t i = std::min((size_t)std::max(phase * (float)N, 0.0f), N - 1);
+        Accumulator& acc = acc_[active_];
+        acc.sum[i] += error;
+        acc.count[i]++;
+    }
+
+    /**
+     * @brief Hands the errors of the cycle over to update(). Returns false if
+     * the previous cycle is not processed yet, in which case the errors are
+     * dropped.
+     */
+    bool end_cycle() {
+        if (pending_.load()) {
+            clear(acc_[active_]);
+            skipped_count_++;
+            return false;
+        }
+        active_ ^= 1;
+        pending_.store(true);
+        return true;
+    }
+
+    // @brief Drops the errors of the current cycle, e.g. when a partial cycle ends
+    void reset() {
+        clear(acc_[active_]);
+    }
+
+    /**
+     * @brief Updates the table from the cycle that end_cycle() handed over.
+     * Returns false if there is none.
+     */
+    bool update(Table* table, const Params& params) {
+        if (!pending_.load()) {
+            return false;
+        }
+        Accumulator& acc = acc_[active_ ^ 1];
+
+        // Mean error per bin, 0 for bins that the cycle didn't pass
+        float sum_sq = 0.0f;
+        size_t n = 0;
+        for (size_t i = 0; i < N; ++i) {
+            acc.sum[i] = acc.count[i] ? acc.sum[i] / (float)acc.count[i] : 0.0f;
+            if (acc.count[i]) {
+                sum_sq += acc.sum[i] * acc.sum[i];
+                n++;
+            }
+        }
+        rms_error_ = n ? std::sqrt(sum_sq / (float)n) : 0.0f;
+
+        if (params.learn) {
+            for (size_t i = 0; i < N; ++i) {
+                scratch_[i] = table->values[i] + params.gain * acc.sum[(i + params.lead) % N];
+            }
+            low_pass(scratch_, std::clamp(params.filter, 0.0f, 0.99f));
+            for (size_t i = 0; i < N; ++i) {
+                table->values[i] = std::clamp(scratch_[i], -params.torque_lim, params.torque_lim);
+            }
+            table->learned = true;
+            cycle_count_++;
+        }
+
+        clear(acc);
+        pending_.store(false);
+        return true;
+    }
+
+    uint32_t cycle_count_ = 0; // number of learned cycles
+    uint32_t skipped_count_ = 0; // number of cycles that ended before the previous one was learned
+    float rms_error_ = 0.0f; // [turn] of the mean errors of the last cycle
+
+private:
+    struct Accumulator {
+        float sum[N] = {}; // [turn]
+        uint16_t count[N] = {};
+    };
+
+    static void clear(Accumulator& acc) {
+        acc = {};
+    }
+
+    // Zero phase first order low pass of one cycle of a periodic signal. Each
+    // direction first runs once around the cycle to settle the filter state.
+    static void low_pass(float (&x)[N], float a) {
+        if (a <= 0.0f) {
+            return;
+        }
+        float y = x[N - 1];
+        for (size_t i = 0; i < N; ++i) {
+            y = a * y + (1.0f - a) * x[i];
+        }
+        for (size_t i = 0; i < N; ++i) {
+            x[i] = y = a * y + (1.0f - a) * x[i];
+        }
+        y = x[0];
+        for (size_t i = N; i > 0; --i) {
+            y = a * y + (1.0f - a) * x[i - 1];
+        }
+        for (size_t i = N; i > 0; --i) {
+            x[i - 1] = y = a * y + (1.0f - a) * x[i - 1];
+        }
+    }
+
+    Accumulator acc_[2];
+    size_t active_ = 0; // accumulator of the current cycle
+    std::atomic<bool> pending_ = false; // the other accumulator holds a cycle for update()
+    float scratch_[N];
+};
+
+#endif // __ITERATIVE_LEARNING_HPP
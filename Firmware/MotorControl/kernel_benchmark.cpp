@@ -0,0 +1,154 @@
+#include "kernel_benchmark.hpp"
+#include "odrive_main.h"
+
+#include <fibre/crc.hpp>
+#include <algorithm>
+
+// The results are written here so that the compiler can't drop the kernels
+static volatile float float_sink;
+static volatile uint16_t crc_sink;
+
+template<typename TSetup, typename TKernel>
+void KernelBenchmark::measure(uint32_t iterations, TSetup&& setup, TKernel&& kernel) {
+    // Cost of an empty measurement
+    uint32_t overhead = UINT32_MAX;
+    for (size_t i = 0; i < 16; ++i) {
+        uint32_t mask = cpu_enter_critical();
+        uint32_t start = DWT->CYCCNT;
+        uint32_t cycles = DWT->CYCCNT - start;
+        cpu_exit_critical(mask);
+        overhead = std::min(overhead, cycles);
+    }
+
+    uint64_t sum = 0;
+    uint32_t min_cycles = UINT32_MAX;
+    uint32_t max_cycles = 0;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        setup(i);
+        uint32_t mask = cpu_enter_critical();
+        uint32_t start = DWT->CYCCNT;
+        kernel(i);
+        uint32_t cycles = DWT->CYCCNT - start;
+        cpu_exit_critical(mask);
+
+        cycles = cycles > overhead ? cycles - overhead : 0;
+        sum += cycles;
+        min_cycles = std::min(min_cycles, cycles);
+        max_cycles = std::max(max_cycles, cycles);
+    }
+
+    iterations_ = iterations;
+    min_cycles_ = min_cycles;
+    max_cycles_ = max_cycles;
+    mean_cycles_ = (float)sum / (float)iterations;
+}
+
+/**
+ * @brief Runs the kernel for the given number of iterations and stores the
+ * statistics.
+ *
+ * Interrupts are only disabled for one kernel invocation at a time which
+ * delays the control loop by at most a few microseconds. Nevertheless this
+ * is refused unless all motors are disarmed and all axes idle.
+ */
+bool KernelBenchmark::run(Kernel kernel, uint32_t iterations) {
+    if (iterations == 0 || iterations > KERNEL_BENCHMARK_MAX_ITERATIONS) {
+        return false;
+    }
+    for (auto& axis: axes) {
+        if (axis.motor_.is_armed_ || axis.current_state_ != Axis::AXIS_STATE_IDLE) {
+            return false;
+        }
+    }
+
+    // Linear congruential generator, uniform in [-1, 1)
+    uint32_t seed = 12345;
+    for (float& x: inputs_) {
+        seed = seed * 1664525UL + 1013904223UL;
+        x = (float)(int32_t)seed * (1.0f / 2147483648.0f);
+    }
+    auto input = [this](uint32_t i) {
+        return inputs_[i & (KERNEL_BENCHMARK_INPUT_COUNT - 1)];
+    };
+
+    switch (kernel) {
+        case KERNEL_FOC: {
+            // Current control with a PI controller, as in closed loop control
+            foc_.reset();
+            foc_.pi_gains_ = float2D{0.1f, 200.0f};
+            foc_.ctrl_timestamp_ = 0;
+            foc_.enable_current_control_ = true;
+            foc_.Vdq_setpoint_ = float2D{0.0f, 0.0f};
+            foc_.phase_vel_ = 100.0f;
+            AlphaBetaMeasurement meas;
+            meas.vbus_voltage = 24.0f;
+            meas.timestamp = 0;
+            meas.valid = AlphaBetaMeasurement::kVbusValid | AlphaBetaMeasurement::kCurrentsValid;
+
+            measure(iterations, [&](uint32_t i) {
+                meas.currents = {5.0f * input(i), 5.0f * input(i + 1)};
+                foc_.on_measurement(meas);
+                foc_.Idq_setpoint_ = float2D{0.0f, 5.0f * input(i + 2)};
+                foc_.phase_ = 3.2f * input(i + 3);
+            }, [&](uint32_t i) {
+                float2D mod = {NAN, NAN};
+                float ibus = NAN;
+                foc_.get_alpha_beta_output(i, &mod, &ibus);
+                float_sink = mod.first + mod.second + ibus;
+            });
+        } break;
+
+        case KERNEL_SVM: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                auto [tA, tB, tC, success] = SVM(0.5f * input(i), 0.5f * input(i + 1));
+                float_sink = success ? tA + tB + tC : 0.0f;
+            });
+        } break;
+
+        case KERNEL_SINCOS: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                auto [s, c] = fast_sincos(3.2f * input(i));
+                float_sink = s + c;
+            });
+        } break;
+
+        case KERNEL_ATAN2: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                float_sink = fast_atan2(input(i), input(i + 1));
+            });
+        } break;
+
+        case KERNEL_ATAN2_LUT: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                float_sink = lut_atan2(input(i), input(i + 1));
+            });
+        } break;
+
+        case KERNEL_ATAN2_PRECISE: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                float_sink = precise_atan2(input(i), input(i + 1));
+            });
+        } break;
+
+        case KERNEL_RSQRT: {
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                float_sink = fast_rsqrt(2.0f + input(i));
+            });
+        } break;
+
+        case KERNEL_CRC16: {
+            // A full USB packet
+            const uint8_t* data = (const uint8_t*)inputs_;
+            static_assert(sizeof(inputs_) >= 64, "input buffer too small");
+            measure(iterations, [](uint32_t) {}, [&](uint32_t i) {
+                crc_sink = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>((uint16_t)i, data, 64);
+            });
+        } break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef __KERNEL_BENCHMARK_HPP
+#define __KERNEL_BENCHMARK_HPP
+
+#include <stdint.h>
+#include <autogen/interfaces.hpp>
+#include "foc.hpp"
+
+#define KERNEL_BENCHMARK_MAX_ITERATIONS 100000
+#define KERNEL_BENCHMARK_INPUT_COUNT 64 // must be a power of two
+
+/**
+ * @brief Measures the execution time of the hot kernels on the target.
+ *
+ * Each iteration runs the kernel once on pseudo-random inputs with interrupts
+ * disabled and is timed with the DWT cycle counter. The cost of reading the
+ * counter is subtracted. This shows the effect of compiler flags and of the
+ * code and data placement (flash, RAMFUNC, CCM) in isolation.
+ *
+ * The FOC runs on a private FieldOrientedController instance so the axes are
+ * not affected. Encoder::update() and Controller::update() depend on the
+ * state of their axis and can't run on synthetic inputs. They are measured
+ * in place by the `task_times` of each axis.
+ */
+class KernelBenchmark : public ODriveIntf::KernelBenchmarkIntf {
+public:
+    bool run(Kernel kernel, uint32_t iterations) override;
+
+    uint32_t iterations_ = 0;
+    uint32_t min_cycles_ = 0;
+    uint32_t max_cycles_ = 0;
+    float mean_cycles_ = 0.0f;
+
+private:
+    template<typename TSetup, typename TKernel>
+    void measure(uint32_t iterations, TSetup&& setup, TKernel&& kernel);
+
+    float inputs_[KERNEL_BENCHMARK_INPUT_COUNT];
+    FieldOrientedController foc_;
+};
+
+#endif // __KERNEL_BENCHMARK_HPP
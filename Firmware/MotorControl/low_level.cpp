@@ -30,6 +30,7 @@ constexpr float adc_ref_voltage = 3.3f;
 // This value is updated by the DC-bus reading ADC.
 // Arbitrary non-zero inital value to avoid division by zero if ADC reading is late
 float vbus_voltage = 12.0f;
+float vbus_voltage_filtered = 12.0f; // used for the modulation, see odrv.config_.vbus_filter_bandwidth
 float ibus_ = 0.0f; // exposed for monitoring only
 bool brake_resistor_armed = false;
 bool brake_resistor_saturated = false;
@@ -70,6 +71,9 @@ bool brake_resistor_saturated = false;
 *     safety_critical_disarm_motor_pwm the motor's Ibus current is
 *     set to the correct value and update_brake_resistor is called
 *     at a high rate.
+*   - The compare registers of TIM2 are preloaded (OC3PE and OC4PE, set by
+*     HAL_TIM_PWM_ConfigChannel()) and nothing but the functions in this
+*     section write CR1 of TIM2 after startup.
 */
 
 
@@ -108,22 +112,34 @@ void safety_critical_disarm_brake_resistor() {
 
 // @brief Updates the brake resistor PWM timings unless
 // the brake resistor is disarmed.
+//
+// The compare registers of TIM2 are preloaded, so the timer only takes new
+// timings on an update event. UDIS holds back the update event while both
+// channels are written, so that the timer always takes them as a pair and
+// no period runs with the low side of one update and the high side of
+// another. This doesn't need interrupts disabled: a disarm that preempts
+// this function writes the safe timings, and the armed flag is checked
+// again after the writes so that the safe timings always win.
 void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t high_on) {
     if (high_on - low_off < TIM_APB1_DEADTIME_CLOCKS) {
         odrv.disarm_with_error(ODrive::ERROR_BRAKE_DEADTIME_VIOLATION);
     }
 
-    CRITICAL_SECTION() {
-        if (brake_resistor_armed) {
-            // Safe update of low and high side timings
-            // To avoid race condition, first reset timings to safe state
-            // ch3 is low side, ch4 is high side
-            htim2.Instance->CCR3 = 0;
-            htim2.Instance->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
-            htim2.Instance->CCR3 = low_off;
-            htim2.Instance->CCR4 = high_on;
-        }
+    const volatile bool& armed = brake_resistor_armed;
+    if (!armed) {
+        return;
     }
+
+    // ch3 is low side, ch4 is high side
+    TIM_TypeDef* tim = htim2.Instance;
+    tim->CR1 |= TIM_CR1_UDIS;
+    tim->CCR3 = low_off;
+    tim->CCR4 = high_on;
+    if (!armed) {
+        tim->CCR3 = 0;
+        tim->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
+    }
+    tim->CR1 &= ~TIM_CR1_UDIS;
 }
 
 /* Function implementations --------------------------------------------------*/
@@ -136,7 +152,7 @@ void start_adc_pwm() {
 
     for (Motor& motor: motors) {
         // Init PWM
-        int half_load = TIM_1_8_PERIOD_CLOCKS / 2;
+        int half_load = pwm_period_clocks / 2;
         motor.timer_->Instance->CCR1 = half_load;
         motor.timer_->Instance->CCR2 = half_load;
         motor.timer_->Instance->CCR3 = half_load;
@@ -172,15 +188,20 @@ void start_adc_pwm() {
     }
 }
 
-// @brief ADC1 measurements are written to this buffer by DMA
-uint16_t adc_measurements_[ADC_CHANNEL_COUNT] = { 0 };
+// @brief ADC1 measurements are written to this circular buffer by DMA
+static uint16_t adc_dma_buffer_[ADC_OVERSAMPLING][ADC_CHANNEL_COUNT] = { 0 };
+
+// @brief Averages of adc_dma_buffer_ relative to adc_ref_voltage, updated by
+// update_adc_measurements()
+float adc_measurements_[ADC_CHANNEL_COUNT] = { 0 };
 
 // @brief Starts the general purpose ADC on the ADC1 peripheral.
 // The measured ADC voltages can be read with get_adc_voltage().
 //
 // ADC1 is set up to continuously sample all channels 0 to 15 in a
 // round-robin fashion.
-// DMA is used to copy the measured 12-bit values to adc_measurements_.
+// DMA is used to copy the measured 12-bit values to adc_dma_buffer_, which
+// holds the last ADC_OVERSAMPLING scans.
 //
 // The injected (high priority) channel of ADC1 is used to sample vbus_voltage.
 // This conversion is triggered by TIM1 at the frequency of the motor control loop.
@@ -216,7 +237,21 @@ void start_general_purpose_adc() {
         }
     }
 
-    HAL_ADC_Start_DMA(&hadc1, reinterpret_cast<uint32_t*>(adc_measurements_), ADC_CHANNEL_COUNT);
+    HAL_ADC_Start_DMA(&hadc1, reinterpret_cast<uint32_t*>(adc_dma_buffer_), ADC_OVERSAMPLING * ADC_CHANNEL_COUNT);
+}
+
+// @brief Averages the scans in the DMA buffer into adc_measurements_.
+// Called once per control loop iteration so that the readers don't pay for
+// the averaging. The buffer covers about 125us, which is one control period
+// at the default 8kHz, so ripple at the PWM frequency averages out.
+void update_adc_measurements() {
+    for (size_t channel = 0; channel < ADC_CHANNEL_COUNT; ++channel) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < ADC_OVERSAMPLING; ++i) {
+            sum += adc_dma_buffer_[i][channel];
+        }
+        adc_measurements_[channel] = (float)sum * (1.0f / (ADC_OVERSAMPLING * adc_full_scale));
+    }
 }
 
 // @brief Returns the ADC voltage associated with the specified pin.
@@ -229,7 +264,7 @@ void start_general_purpose_adc() {
 //  on-board sensors (M0_TEMP, M1_TEMP, AUX_TEMP)
 //
 // The ADC values are sampled in background at ~30kHz without
-// any CPU involvement.
+// any CPU involvement and averaged over ADC_OVERSAMPLING samples.
 //
 // Details: each of the 16 conversion takes (15+26) ADC clock
 // cycles and the ADC, so the update rate of the entire sequence is:
@@ -292,7 +327,7 @@ uint16_t channel_from_gpio(Stm32Gpio gpio) {
 // returns -1.0f if the channel is not valid.
 float get_adc_relative_voltage_ch(uint16_t channel) {
     if (channel < ADC_CHANNEL_COUNT)
-        return (float)adc_measurements_[channel] / adc_full_scale;
+        return adc_measurements_[channel];
     else
         return -1.0f;
 }
@@ -303,7 +338,81 @@ float get_adc_relative_voltage_ch(uint16_t channel) {
 
 void vbus_sense_adc_cb(uint32_t adc_value) {
     constexpr float voltage_scale = adc_ref_voltage * VBUS_S_DIVIDER_RATIO / adc_full_scale;
-    vbus_voltage = adc_value * voltage_scale;
+    float vbus = adc_value * voltage_scale;
+    vbus_voltage = vbus;
+
+    // The protection uses the raw value, the modulation optionally a
+    // filtered one so that measurement noise doesn't enter the current loop.
+    float bandwidth = odrv.config_.vbus_filter_bandwidth;
+    if (bandwidth > 0.0f) {
+        vbus_voltage_filtered += std::min(bandwidth * current_meas_period, 1.0f) * (vbus - vbus_voltage_filtered);
+    } else {
+        vbus_voltage_filtered = vbus;
+    }
+
+    // Ripple statistics
+    static float ripple_var = 0.0f; // [V^2]
+    VbusStats_t& stats = odrv.vbus_stats_;
+    if (!(stats.max >= stats.min)) {
+        stats.mean = vbus; // first sample since reset
+        ripple_var = 0.0f;
+    }
+    float k = std::min(current_meas_period / 0.1f, 1.0f);
+    stats.mean += k * (vbus - stats.mean);
+    ripple_var += k * (SQ(vbus - stats.mean) - ripple_var);
+    stats.ripple_rms = std::sqrt(ripple_var);
+    stats.min = std::min(stats.min, vbus);
+    stats.max = std::max(stats.max, vbus);
+}
+
+/**
+ * @brief Distributes the DC bus current that the power supply and the brake
+ * resistor can take among the armed motors.
+ *
+ * Each motor may change its bus current by an equal share of the remaining
+ * headroom (which may be negative). The sum of the limits is the total limit
+ * so the motors can't take the same headroom twice, and the limits of the
+ * motors that move the other way change the headroom on the next iteration.
+ * Close to the trip levels of the bus voltage the regen (or motoring)
+ * current is ramped down to zero.
+ * The limits are enforced by Motor::update() which reduces the torque.
+ */
+static void update_bus_current_limits(float Ibus_sum) {
+    size_t n_armed = 0;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        n_armed += axes[i].motor_.is_armed_ ? 1 : 0;
+    }
+
+    if (!odrv.config_.enable_bus_current_limiter || !n_armed) {
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            axes[i].motor_.I_bus_limit_ = {-INFINITY, INFINITY};
+        }
+        return;
+    }
+
+    float I_max = odrv.config_.dc_max_positive_current;
+    float I_min = odrv.config_.dc_max_negative_current;
+    if (odrv.config_.enable_brake_resistor && odrv.config_.brake_resistance > 0.0f) {
+        // The brake resistor takes everything beyond max_regen_current up to its maximum duty
+        I_min = std::min(I_min, -odrv.config_.max_regen_current) - 0.95f * vbus_voltage / odrv.config_.brake_resistance;
+    }
+    I_max *= odrv.config_.bus_current_limiter_margin;
+    I_min *= odrv.config_.bus_current_limiter_margin;
+
+    float range = odrv.config_.bus_current_limiter_voltage_range;
+    if (range > 0.0f) {
+        I_max *= std::clamp((vbus_voltage - odrv.config_.dc_bus_undervoltage_trip_level) / range, 0.0f, 1.0f);
+        I_min *= std::clamp((odrv.config_.dc_bus_overvoltage_trip_level - vbus_voltage) / range, 0.0f, 1.0f);
+    }
+
+    float share_max = (I_max - Ibus_sum) / (float)n_armed;
+    float share_min = (I_min - Ibus_sum) / (float)n_armed;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Motor& motor = axes[i].motor_;
+        motor.I_bus_limit_ = motor.is_armed_
+                ? float2D{motor.I_bus_ + share_min, motor.I_bus_ + share_max}
+                : float2D{-INFINITY, INFINITY};
+    }
 }
 
 // @brief Sums up the Ibus contribution of each motor and updates the
@@ -316,6 +425,8 @@ void update_brake_current() {
         }
     }
 
+    update_bus_current_limits(Ibus_sum);
+
     float brake_duty;
 
     if (odrv.config_.enable_brake_resistor) {
@@ -379,20 +490,12 @@ static void update_analog_endpoint(const struct PWMMapping_t *map, int gpio)
     fibre::set_endpoint_from_float(map->endpoint, value);
 }
 
-static void analog_polling_thread(void *)
-{
-    while (true) {
-        for (int i = 0; i < GPIO_COUNT; i++) {
-            struct PWMMapping_t *map = &odrv.config_.analog_mappings[i];
+// @brief Applies the analog mappings. Called from ODrive::housekeeping_cb().
+void update_analog_endpoints() {
+    for (int i = 0; i < GPIO_COUNT; i++) {
+        struct PWMMapping_t *map = &odrv.config_.analog_mappings[i];
 
-            if (fibre::is_endpoint_ref_valid(map->endpoint))
-                update_analog_endpoint(map, i);
-        }
-        osDelay(10);
+        if (fibre::is_endpoint_ref_valid(map->endpoint))
+            update_analog_endpoint(map, i);
     }
 }
-
-void start_analog_thread() {
-    osThreadDef(thread_def, analog_polling_thread, osPriorityLow, 0, 512 / sizeof(StackType_t));
-    osThreadCreate(osThread(thread_def), NULL);
-}
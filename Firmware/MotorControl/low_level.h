@@ -14,14 +14,16 @@ extern "C" {
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
 #define ADC_CHANNEL_COUNT 16
+#define ADC_OVERSAMPLING 4 // number of scans of all channels that are averaged
 extern const float adc_full_scale;
 extern const float adc_ref_voltage;
 /* Exported variables --------------------------------------------------------*/
 extern float vbus_voltage;
+extern float vbus_voltage_filtered;
 extern float ibus_;
 extern bool brake_resistor_armed;
 extern bool brake_resistor_saturated;
-extern uint16_t adc_measurements_[ADC_CHANNEL_COUNT];
+extern float adc_measurements_[ADC_CHANNEL_COUNT];
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
 
@@ -43,13 +45,15 @@ void sync_timers(TIM_HandleTypeDef* htim_a, TIM_HandleTypeDef* htim_b,
                  TIM_HandleTypeDef* htim_refbase = nullptr);
 void start_general_purpose_adc();
 void pwm_in_init();
-void start_analog_thread();
 
 // ADC getters
 uint16_t channel_from_gpio(Stm32Gpio gpio);
 float get_adc_voltage(Stm32Gpio gpio);
 float get_adc_relative_voltage(Stm32Gpio gpio);
 float get_adc_relative_voltage_ch(uint16_t channel);
+void update_adc_measurements();
+
+void update_analog_endpoints();
 
 void update_brake_current();
 
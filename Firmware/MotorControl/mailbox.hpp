@@ -0,0 +1,69 @@
+#ifndef __MAILBOX_HPP
+#define __MAILBOX_HPP
+
+#include <atomic>
+#include <optional>
+
+/**
+ * @brief Single-slot mailbox that hands a value from a low priority context
+ * (e.g. a communication thread) to a high priority context (e.g. the control
+ * loop interrupt) without disabling interrupts.
+ *
+ * The value is double buffered: the writer always assembles the new value in
+ * the buffer that is not currently published and then publishes it with a
+ * single atomic store. Since the reader runs at higher priority it can never
+ * be preempted by the writer, so it either sees the old or the new value but
+ * never a half written one. The reader never blocks.
+ *
+ * Only one writer may be active at a time. Writers running in different
+ * threads must serialize their post() calls (e.g. by suspending the
+ * scheduler).
+ */
+template<typename T>
+class Mailbox {
+public:
+    /**
+     * @brief Modifies the pending value and publishes it.
+     *
+     * If the previously posted value was not fetched yet, `func` receives a
+     * copy of it so that partial updates from consecutive posts combine.
+     * Otherwise `func` receives a default-constructed T.
+     */
+    template<typename TFunc>
+    void post(TFunc&& func) {
+        // Taking back the pending buffer is atomic with respect to the reader,
+        // so each posted value is delivered exactly once.
+        int pending = ready_.exchange(-1);
+        int idx = next_;
+        buffers_[idx] = (pending >= 0) ? buffers_[pending] : T{};
+        func(buffers_[idx]);
+        ready_.store(idx);
+        next_ = idx ^ 1;
+    }
+
+    /**
+     * @brief Returns the pending value if there is one and marks it as
+     * consumed.
+     */
+    std::optional<T> fetch() {
+        int idx = ready_.exchange(-1);
+        if (idx < 0) {
+            return std::nullopt;
+        }
+        return buffers_[idx];
+    }
+
+    /**
+     * @brief Drops the pending value, if any.
+     */
+    void clear() {
+        ready_.store(-1);
+    }
+
+private:
+    T buffers_[2];
+    std::atomic<int> ready_ = -1; // index of the unconsumed buffer or -1
+    int next_ = 0; // only accessed by the writer
+};
+
+#endif // __MAILBOX_HPP
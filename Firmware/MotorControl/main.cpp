@@ -6,6 +6,7 @@
 #include "usart.h"
 #include "freertos_vars.h"
 #include "usb_device.h"
+#include <usbd_cdc_if.h>
 #include <communication/interface_usb.h>
 #include <communication/interface_uart.h>
 #include <communication/interface_i2c.h>
@@ -14,11 +15,13 @@
 osSemaphoreId sem_usb_irq;
 osSemaphoreId sem_uart_dma;
 osSemaphoreId sem_usb_rx;
-osSemaphoreId sem_usb_tx;
+osSemaphoreId sem_usb_tx_cdc;
+osSemaphoreId sem_usb_tx_native;
 osSemaphoreId sem_can;
 
-#if defined(STM32F405xx)
+#if defined(STM32F405xx) && !defined(FAST_RAM)
 // Place FreeRTOS heap in core coupled memory for better performance
+// With FAST_RAM the CCM RAM is used for the control loop state instead.
 __attribute__((section(".ccmram")))
 #endif
 uint8_t ucHeap[configTOTAL_HEAP_SIZE];
@@ -27,56 +30,265 @@ uint32_t _reboot_cookie __attribute__ ((section (".noinit")));
 extern char _estack; // provided by the linker script
 
 
+TraceBuffer trace_buffer;
+EventLog event_log;
+ProtocolStats protocol_stats;
+
+alignas(8) static uint8_t arena_buffer[ARENA_SIZE];
+Arena arena{arena_buffer, sizeof(arena_buffer)};
+
 ODriveCAN::Config_t can_config;
 ODriveCAN *odCAN = nullptr;
 ODrive odrv{};
 
 
 ConfigManager config_manager;
-
-static bool config_read_all() {
-    bool success = board_read_config() &&
-           config_manager.read(&odrv.config_) &&
-           config_manager.read(&can_config);
+static uint8_t* config_staging_buffer = nullptr;
+static size_t config_staging_size = 0;
+
+static osThreadId config_thread = 0;
+static const uint32_t stack_size_config_thread = 1024; // Bytes
+static osSemaphoreId sem_config_saved;
+static volatile bool config_save_result = false;
+static volatile uint32_t config_save_operation = 0; // of save_configuration_async(), 0 for save_configuration()
+#define CONFIG_SIGNAL_SAVE 0x0001
+#define CONFIG_SIGNAL_LOAD 0x0002
+#define CONFIG_SIGNAL_BROWNOUT 0x0004
+#define CONFIG_ERASE_CHECK_INTERVAL 1000 // [ms]
+static volatile bool vbus_seen_ok = false; // the bus voltage was above the undervoltage trip level since boot
+static volatile bool position_backup_requested = false; // set by the brownout check, cleared when the supply recovered
+static bool position_backup_stored = false;
+
+#define CONFIG_BLOB_COGGING_MAP 0 // one per axis
+#define CONFIG_BLOB_LEARNING_TABLE (CONFIG_BLOB_COGGING_MAP + AXIS_COUNT) // one per axis
+#define CONFIG_BLOB_POSITION_BACKUP (CONFIG_BLOB_LEARNING_TABLE + AXIS_COUNT) // one per axis, not staged
+
+// Calls func for each object that is stored in NVM, in the order of its records
+template<typename TFunc>
+static bool config_for_each(TFunc&& func) {
+    bool success = func(&odrv.config_) &&
+           func(&can_config) &&
+           func(&odrv.telemetry_.config_);
     for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
-        success = config_manager.read(&encoders[i].config_) &&
-                  config_manager.read(&axes[i].sensorless_estimator_.config_) &&
-                  config_manager.read(&axes[i].controller_.config_) &&
-                  config_manager.read(&axes[i].trap_traj_.config_) &&
-                  config_manager.read(&axes[i].min_endstop_.config_) &&
-                  config_manager.read(&axes[i].max_endstop_.config_) &&
-                  config_manager.read(&axes[i].mechanical_brake_.config_) &&
-                  config_manager.read(&motors[i].config_) &&
-                  config_manager.read(&motors[i].fet_thermistor_.config_) &&
-                  config_manager.read(&motors[i].motor_thermistor_.config_) &&
-                  config_manager.read(&axes[i].config_);
+        success = func(&encoders[i].config_) &&
+                  func(&axes[i].sensorless_estimator_.config_) &&
+                  func(&axes[i].controller_.config_) &&
+                  func(&axes[i].trap_traj_.config_) &&
+                  func(&axes[i].min_endstop_.config_) &&
+                  func(&axes[i].max_endstop_.config_) &&
+                  func(&axes[i].mechanical_brake_.config_) &&
+                  func(&axes[i].encoder_fusion_.config_) &&
+                  func(&axes[i].vel_filter_.config_) &&
+                  func(&axes[i].torque_filter_.config_) &&
+                  func(&axes[i].frequency_response_.config_) &&
+                  func(&motors[i].config_) &&
+                  func(&motors[i].fet_thermistor_.config_) &&
+                  func(&motors[i].motor_thermistor_.config_) &&
+                  func(&motors[i].rl_estimator_.config_) &&
+                  func(&motors[i].ripple_canceller_.config_) &&
+                  func(&motors[i].motor_thermal_model_.config_) &&
+                  func(&motors[i].fet_thermal_model_.config_) &&
+                  func(&axes[i].config_);
     }
     return success;
 }
 
-static bool config_write_all() {
-    bool success = board_write_config() &&
-           config_manager.write(&odrv.config_) &&
-           config_manager.write(&can_config);
+// Calls func for each calibration blob with its blob number, version and
+// the flag that tells whether it was loaded
+template<typename TFunc>
+static bool config_for_each_blob(TFunc&& func) {
+    bool success = true;
     for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
-        success = config_manager.write(&encoders[i].config_) &&
-                  config_manager.write(&axes[i].sensorless_estimator_.config_) &&
-                  config_manager.write(&axes[i].controller_.config_) &&
-                  config_manager.write(&axes[i].trap_traj_.config_) &&
-                  config_manager.write(&axes[i].min_endstop_.config_) &&
-                  config_manager.write(&axes[i].max_endstop_.config_) &&
-                  config_manager.write(&axes[i].mechanical_brake_.config_) &&
-                  config_manager.write(&motors[i].config_) &&
-                  config_manager.write(&motors[i].fet_thermistor_.config_) &&
-                  config_manager.write(&motors[i].motor_thermistor_.config_) &&
-                  config_manager.write(&axes[i].config_);
+        Controller& controller = axes[i].controller_;
+        success = func(CONFIG_BLOB_COGGING_MAP + i, ANTICOGGING_MAP_VERSION,
+                       &controller.cogging_map_, controller.cogging_map_loaded_)
+               && func(CONFIG_BLOB_LEARNING_TABLE + i, LEARNING_TABLE_VERSION,
+                       &controller.learning_table_, controller.learning_table_loaded_);
     }
     return success;
 }
 
+static bool config_read_all() {
+    return board_read_config()
+        && config_for_each([](auto* obj) { return config_manager.read(obj); });
+}
+
+static bool config_stage_all() {
+    return board_write_config()
+        && config_for_each([](auto* obj) { return config_manager.stage(obj); })
+        && config_for_each_blob([](size_t blob, uint16_t version, auto* obj, bool& loaded) {
+            // A blob that was never loaded keeps its record in NVM
+            return !loaded || config_manager.stage_blob(blob, version, obj);
+        });
+}
+
+// Header of the config blob that read_config_raw() returns and
+// write_config_raw() takes. The data after the header holds the objects of
+// config_for_each() like the staging buffer, each padded to 4 bytes. The
+// blob can only be restored on a firmware with the same interface.
+struct ConfigBlobHeader {
+    uint32_t json_version_id;
+    uint16_t config_version;
+    uint16_t crc16; // of the data
+    uint32_t length; // of the data
+};
+
+static size_t config_get_blob_size() {
+    size_t size = sizeof(ConfigBlobHeader);
+    config_for_each([&](auto* obj) { size += ConfigManager::get_staged_size(sizeof(*obj)); return true; });
+    return size;
+}
+
+static size_t config_get_staging_size() {
+    size_t size = 0;
+    config_for_each([&](auto* obj) { size += ConfigManager::get_staged_size(sizeof(*obj)); return true; });
+    config_for_each_blob([&](size_t, uint16_t, auto* obj, bool&) {
+        size += ConfigManager::get_staged_size(sizeof(*obj));
+        return true;
+    });
+    return size;
+}
+
+// Copies the blobs that were not loaded yet from NVM. A blob without a
+// valid record keeps its defaults, which mark it as not calibrated.
+static void config_load_blobs() {
+    config_for_each_blob([](size_t blob, uint16_t version, auto* obj, bool& loaded) {
+        // The control loop may use the blob as soon as it is complete
+        CRITICAL_SECTION() {
+            if (!loaded) {
+                config_manager.read_blob(blob, version, obj);
+                loaded = true;
+            }
+        }
+        return true;
+    });
+}
+
+static bool any_motor_armed() {
+    return std::any_of(axes.begin(), axes.end(),
+        [](auto& axis){ return axis.motor_.is_armed_; });
+}
+
+// Erasing a flash sector stalls every flash access for about a second, so
+// it only happens while no motor is armed.
+static void config_erase_spare_if_disarmed() {
+    CRITICAL_SECTION() {
+        if (!any_motor_armed()) {
+            config_manager.erase_spare();
+        }
+    }
+}
+
+// True if the startup finished and all axes are idle, so that erasing ahead
+// doesn't hold up a calibration or closed loop request
+static bool config_system_idle() {
+    return odrv.system_stats_.fully_booted && std::all_of(axes.begin(), axes.end(), [](auto& axis) {
+        return axis.current_state_ == Axis::AXIS_STATE_IDLE
+            && axis.requested_state_ == Axis::AXIS_STATE_UNDEFINED;
+    });
+}
+
+// Plans the queued blended moves of all axes into their PVT buffers. The
+// priority is below the communication threads because the PVT buffers hold
+// the next few milliseconds of the trajectory.
+static void move_planner_thread_fn(void*) {
+    for (;;) {
+        for (auto& axis: axes) {
+            axis.controller_.plan_moves();
+        }
+        osDelay(1);
+    }
+}
+
+// Reads the position backups at boot. A backup is only used once: it is
+// invalidated in NVM right away, so that a later power loss without a
+// backup (e.g. too fast for the brownout check) can't restore a stale
+// position.
+static void config_load_position_backups() {
+    for (Encoder& encoder: encoders) {
+        size_t blob = CONFIG_BLOB_POSITION_BACKUP + (&encoder - &encoders[0]);
+        if (encoder.config_.persist_position
+            && config_manager.read_blob(blob, POSITION_BACKUP_VERSION, &encoder.position_backup_)
+            && encoder.position_backup_.valid) {
+            encoder.position_restore_pending_ = true;
+            Encoder::PositionBackup_t invalid;
+            config_manager.store_blob(blob, POSITION_BACKUP_VERSION, &invalid);
+        }
+    }
+}
+
+// Saves the positions on a brownout. Each backup is one record of about 40
+// bytes that is programmed right away, which takes well below a millisecond.
+static void config_store_position_backups(bool valid) {
+    for (Encoder& encoder: encoders) {
+        size_t blob = CONFIG_BLOB_POSITION_BACKUP + (&encoder - &encoders[0]);
+        if (encoder.config_.persist_position) {
+            Encoder::PositionBackup_t backup = valid ? encoder.get_position_backup() : Encoder::PositionBackup_t{};
+            config_manager.store_blob(blob, POSITION_BACKUP_VERSION, &backup);
+        }
+    }
+}
+
+// Programs the staged configuration with interrupts enabled. The control
+// loop keeps running and is delayed by at most one flash word write.
+// This thread is also the only one that reads blobs after boot, so a
+// compaction can't move them while they are copied. It also writes the
+// position backups on a brownout.
+static void config_thread_fn(void*) {
+    for (;;) {
+        osEvent event = osSignalWait(CONFIG_SIGNAL_SAVE | CONFIG_SIGNAL_LOAD | CONFIG_SIGNAL_BROWNOUT,
+                                     CONFIG_ERASE_CHECK_INTERVAL);
+        if (event.status == osEventTimeout) {
+            // The supply recovered from a brownout, so the backup would be
+            // stale at the next boot
+            if (position_backup_stored && vbus_voltage >= odrv.config_.dc_bus_undervoltage_trip_level) {
+                config_store_position_backups(false);
+                position_backup_stored = false;
+                position_backup_requested = false;
+            }
+            // A spare sector that wasn't erased after boot or after a
+            // compaction while armed is erased once the axes are idle
+            if (config_system_idle()) {
+                config_erase_spare_if_disarmed();
+            }
+            continue;
+        }
+        if (event.value.signals & CONFIG_SIGNAL_BROWNOUT) {
+            config_store_position_backups(true);
+            position_backup_stored = true;
+        }
+        if (event.value.signals & CONFIG_SIGNAL_LOAD) {
+            config_load_blobs();
+        }
+        if (!(event.value.signals & CONFIG_SIGNAL_SAVE)) {
+            continue;
+        }
+
+        // Taken before the store because another save can be staged as
+        // soon as this one is stored
+        uint32_t operation = config_save_operation;
+        config_save_operation = 0;
+
+        if (config_manager.needs_erase()) {
+            config_erase_spare_if_disarmed();
+        }
+        config_save_result = config_manager.store_staged();
+
+        // Erase ahead so that the next compaction doesn't need to wait for
+        // the motors to be disarmed
+        config_erase_spare_if_disarmed();
+        if (operation) {
+            odrv.operations_.finish(operation, config_save_result, 0);
+        } else {
+            osSemaphoreRelease(sem_config_saved);
+        }
+    }
+}
+
 static void config_clear_all() {
     odrv.config_ = {};
     can_config = {};
+    odrv.telemetry_.config_ = {};
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         encoders[i].config_ = {};
         axes[i].sensorless_estimator_.config_ = {};
@@ -86,20 +298,36 @@ static void config_clear_all() {
         axes[i].min_endstop_.config_ = {};
         axes[i].max_endstop_.config_ = {};
         axes[i].mechanical_brake_.config_ = {};
+        axes[i].encoder_fusion_.config_ = {};
+        axes[i].vel_filter_.config_ = {};
+        axes[i].torque_filter_.config_ = {};
+        axes[i].frequency_response_.config_ = {};
         motors[i].config_ = {};
         motors[i].fet_thermistor_.config_ = {};
         motors[i].motor_thermistor_.config_ = {};
+        motors[i].rl_estimator_.config_ = {};
+        motors[i].ripple_canceller_.config_ = {};
+        motors[i].motor_thermal_model_.config_ = {};
+        motors[i].fet_thermal_model_.config_ = {};
         axes[i].clear_config();
     }
 }
 
 static bool config_apply_all() {
-    bool success = true;
+    // Must come first since the other components derive gains from the
+    // control loop period.
+    set_pwm_frequency(odrv.config_.pwm_frequency);
+
+    bool success = odrv.telemetry_.apply_config();
     for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
         success = encoders[i].apply_config(motors[i].config_.motor_type)
                && axes[i].controller_.apply_config()
+               && axes[i].sensorless_estimator_.apply_config()
                && axes[i].min_endstop_.apply_config()
                && axes[i].max_endstop_.apply_config()
+               && axes[i].encoder_fusion_.apply_config()
+               && axes[i].vel_filter_.apply_config()
+               && axes[i].torque_filter_.apply_config()
                && motors[i].apply_config()
                && motors[i].motor_thermistor_.apply_config()
                && axes[i].apply_config();
@@ -110,24 +338,83 @@ static bool config_apply_all() {
 bool ODrive::save_configuration(void) {
     bool success;
 
+    // Take a snapshot that the config thread writes to flash
     CRITICAL_SECTION() {
-        bool any_armed = std::any_of(axes.begin(), axes.end(),
-            [](auto& axis){ return axis.motor_.is_armed_; });
-        if (any_armed) {
-            return false;
-        }
+        success = config_manager.start_staging(config_staging_buffer, config_staging_size)
+               && config_stage_all()
+               && config_manager.finish_staging();
+    }
+    if (!success) {
+        return false;
+    }
 
-        size_t config_size = 0;
-        success = config_manager.prepare_store()
-               && config_write_all()
-               && config_manager.start_store(&config_size)
-               && config_write_all()
-               && config_manager.finish_store();
+    osSignalSet(config_thread, CONFIG_SIGNAL_SAVE);
+    osSemaphoreWait(sem_config_saved, osWaitForever);
+    return config_save_result;
+}
+
+// Like save_configuration() but returns right after taking the snapshot with
+// the handle of an operation in `operations` that completes when the flash
+// write is done. The protocol thread is not blocked meanwhile.
+uint32_t ODrive::save_configuration_async() {
+    uint32_t handle = operations_.start();
+    if (!handle) {
+        return 0;
     }
 
+    bool success;
+    CRITICAL_SECTION() {
+        success = config_manager.start_staging(config_staging_buffer, config_staging_size)
+               && config_stage_all()
+               && config_manager.finish_staging();
+    }
+    if (!success) {
+        operations_.finish(handle, false, 0);
+        return handle;
+    }
+
+    config_save_operation = handle;
+    osSignalSet(config_thread, CONFIG_SIGNAL_SAVE);
+    return handle;
+}
+
+// Loads the calibration data that is too large to be loaded at boot. This
+// returns immediately, the data becomes valid a few milliseconds later.
+void ODrive::load_calibration_data() {
+    osSignalSet(config_thread, CONFIG_SIGNAL_LOAD);
+}
+
+// Reserves part of the bus current budget for a calibration. A calibration
+// can always start if no other one is running, so a budget that is smaller
+// than the demand of one axis makes the axes calibrate one after another.
+bool ODrive::reserve_calibration_current(float current) {
+    bool success = false;
+    CRITICAL_SECTION() {
+        if (!n_calibrations_running_
+            || calibration_bus_current_ + current <= config_.calibration_bus_current_budget) {
+            n_calibrations_running_++;
+            calibration_bus_current_ += current;
+            success = true;
+        }
+    }
     return success;
 }
 
+void ODrive::release_calibration_current(float current) {
+    CRITICAL_SECTION() {
+        if (n_calibrations_running_ && --n_calibrations_running_) {
+            calibration_bus_current_ -= current;
+        } else {
+            calibration_bus_current_ = 0.0f;
+        }
+    }
+
+    // Wake up axes that wait for the budget
+    for (auto& axis: axes) {
+        axis.notify_event();
+    }
+}
+
 void ODrive::erase_configuration(void) {
     NVM_erase();
 
@@ -139,6 +426,115 @@ void ODrive::erase_configuration(void) {
     NVIC_SystemReset();
 }
 
+/**
+ * @brief Returns as many bytes of the config blob as fit into the response.
+ *
+ * The request contains the offset in bytes, the same as for
+ * Oscilloscope::read_raw(). A request at offset 0 takes a snapshot of the
+ * configuration into the staging buffer, so all parts of one read belong
+ * together. The response is empty past the end of the blob or while the
+ * configuration is being saved.
+ */
+bool ODrive::read_config_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    bool idle = false;
+    size_t size = config_get_blob_size();
+    CRITICAL_SECTION() {
+        idle = config_manager.store_state == ConfigManager::kStoreStateIdle;
+        if (idle && !*offset) {
+            memset(config_staging_buffer, 0, size);
+            size_t pos = sizeof(ConfigBlobHeader);
+            config_for_each([&](auto* obj) {
+                memcpy(config_staging_buffer + pos, obj, sizeof(*obj));
+                pos += ConfigManager::get_staged_size(sizeof(*obj));
+                return true;
+            });
+        }
+    }
+    if (!idle) {
+        return true;
+    }
+
+    if (!*offset) {
+        // The CRC takes too long to compute with interrupts disabled
+        ConfigBlobHeader header = {fibre::json_version_id_, config_version, 0, (uint32_t)(size - sizeof(ConfigBlobHeader))};
+        header.crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT,
+                config_staging_buffer + sizeof(ConfigBlobHeader), header.length);
+        memcpy(config_staging_buffer, &header, sizeof(header));
+    }
+
+    if (*offset < size) {
+        size_t length = std::min(size - *offset, output_buffer->size());
+        memcpy(output_buffer->begin(), config_staging_buffer + *offset, length);
+        *output_buffer += length;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes part of a config blob into the staging buffer. The request
+ * contains the offset in bytes followed by the data. Returns the number of
+ * bytes that were taken, which is 0 while the configuration is being saved.
+ *
+ * Call apply_config_raw() after the whole blob was written.
+ */
+bool ODrive::write_config_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    uint32_t length = 0;
+    if (*offset + input_buffer->size() <= config_get_blob_size()) {
+        CRITICAL_SECTION() {
+            if (config_manager.store_state == ConfigManager::kStoreStateIdle) {
+                memcpy(config_staging_buffer + *offset, input_buffer->begin(), input_buffer->size());
+                length = input_buffer->size();
+            }
+        }
+    }
+    *input_buffer += input_buffer->size();
+    return fibre::Codec<uint32_t>::encode(length, output_buffer);
+}
+
+/**
+ * @brief Copies the config blob that was written with write_config_raw()
+ * into the configuration. Fails if the blob is incomplete, comes from a
+ * firmware with a different interface or if a motor is armed.
+ *
+ * Like for writes to the individual properties, some of the settings only
+ * take effect after save_configuration() and a reboot.
+ */
+bool ODrive::apply_config_raw() {
+    ConfigBlobHeader header;
+    size_t size = config_get_blob_size();
+    memcpy(&header, config_staging_buffer, sizeof(header));
+    if (header.json_version_id != fibre::json_version_id_ || header.config_version != config_version
+        || header.length != size - sizeof(ConfigBlobHeader)
+        || header.crc16 != calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT,
+                config_staging_buffer + sizeof(ConfigBlobHeader), header.length)) {
+        return false;
+    }
+
+    bool success = false;
+    CRITICAL_SECTION() {
+        if (!any_motor_armed() && config_manager.store_state == ConfigManager::kStoreStateIdle) {
+            size_t pos = sizeof(ConfigBlobHeader);
+            config_for_each([&](auto* obj) {
+                memcpy(obj, config_staging_buffer + pos, sizeof(*obj));
+                pos += ConfigManager::get_staged_size(sizeof(*obj));
+                return true;
+            });
+            success = true;
+        }
+    }
+    return success;
+}
+
 void ODrive::enter_dfu_mode() {
     if ((hw_version_major_ == 3) && (hw_version_minor_ >= 5)) {
         __asm volatile ("CPSID I\n\t":::"memory"); // disable interrupts
@@ -168,6 +564,68 @@ bool ODrive::any_error() {
         });
 }
 
+// Layout of the response of read_errors_raw(), little endian without padding
+// so that it fits into one 64 byte USB packet with two axes. Each axis takes
+// ERROR_SNAPSHOT_AXIS_SIZE bytes: motor.error (8), error, encoder.error,
+// controller.error, sensorless_estimator.error (4 each), current_state (1).
+#define ERROR_SNAPSHOT_HEADER_SIZE 12 // change_count, error, can.error
+#define ERROR_SNAPSHOT_AXIS_SIZE 25
+#define ERROR_SNAPSHOT_SIZE (ERROR_SNAPSHOT_HEADER_SIZE + AXIS_COUNT * ERROR_SNAPSHOT_AXIS_SIZE)
+
+/**
+ * @brief Returns the error words of the ODrive, of CAN and of each axis and
+ * its components together with the axis states, as one packed struct.
+ *
+ * The first word counts how often the snapshot differed from the one that
+ * the previous request returned, so a host can skip decoding it if the count
+ * didn't change since it last looked. Changes that were undone between two
+ * requests are not counted (the event log has those).
+ *
+ * The request contains the offset in bytes, like for read_config_raw(), in
+ * case the snapshot doesn't fit into one response.
+ */
+bool ODrive::read_errors_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    static uint8_t last[ERROR_SNAPSHOT_SIZE] = {};
+    static uint32_t change_count = 0;
+    uint8_t snapshot[ERROR_SNAPSHOT_SIZE];
+    uint8_t* pos = snapshot + 4; // after change_count
+    pos += write_le<uint32_t>(error_, pos);
+    pos += write_le<uint32_t>(odCAN ? odCAN->error_ : 0, pos);
+    for (Axis& axis: axes) {
+        pos += write_le<uint64_t>(axis.motor_.error_, pos);
+        pos += write_le<uint32_t>(axis.error_, pos);
+        pos += write_le<uint32_t>(axis.encoder_.error_, pos);
+        pos += write_le<uint32_t>(axis.controller_.error_, pos);
+        pos += write_le<uint32_t>(axis.sensorless_estimator_.error_, pos);
+        pos += write_le<uint8_t>(axis.current_state_, pos);
+    }
+
+    CRITICAL_SECTION() {
+        if (memcmp(snapshot + 4, last + 4, sizeof(snapshot) - 4)) {
+            memcpy(last, snapshot, sizeof(snapshot));
+            change_count++;
+        }
+        write_le<uint32_t>(change_count, snapshot);
+    }
+
+    for (size_t i = *offset; i < sizeof(snapshot) && !output_buffer->empty(); ++i) {
+        *output_buffer->begin() = snapshot[i];
+        *output_buffer += 1;
+    }
+    return true;
+}
+
+void ODrive::reset_vbus_stats() {
+    CRITICAL_SECTION() {
+        vbus_stats_ = {};
+    }
+}
+
 void ODrive::clear_errors() {
     for (auto& axis: axes) {
         axis.motor_.error_ = Motor::ERROR_NONE;
@@ -183,6 +641,60 @@ void ODrive::clear_errors() {
     }
 }
 
+/**
+ * @brief Moves the axes along a straight line so that they start in the same
+ * control loop iteration and arrive at the same time.
+ *
+ * All axes follow the same trapezoidal profile, scaled by their distance.
+ * The common profile is the fastest one that respects trap_traj.config of
+ * every axis. The axes should be at rest when this is called. Axes whose
+ * goal is NaN don't take part.
+ *
+ * @param min_duration: Stretches the move to at least this duration [s],
+ *        e.g. to synchronize with axes on another ODrive.
+ * @returns The duration of the move [s] or NaN if the limits are invalid.
+ */
+float ODrive::move_coordinated(float pos0, float pos1, float min_duration) {
+    float goals[2] = {pos0, pos1};
+    static_assert(AXIS_COUNT <= 2, "extend the goals of move_coordinated()");
+
+    // Limits of the unit move
+    float vel = INFINITY;
+    float accel = INFINITY;
+    float decel = INFINITY;
+    float dist[AXIS_COUNT];
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        dist[i] = std::isnan(goals[i]) ? 0.0f : std::abs(goals[i] - axes[i].controller_.pos_setpoint_);
+        if (dist[i] > 0.0f) {
+            const TrapezoidalTrajectory::Config_t& limits = axes[i].trap_traj_.config_;
+            vel = std::min(vel, limits.vel_limit / dist[i]);
+            accel = std::min(accel, limits.accel_limit / dist[i]);
+            decel = std::min(decel, limits.decel_limit / dist[i]);
+        }
+    }
+    if (vel == INFINITY) {
+        vel = accel = decel = 1.0f; // nothing moves
+    }
+    if (!(vel > 0.0f) || !(accel > 0.0f) || !(decel > 0.0f)) {
+        return NAN;
+    }
+
+    float duration = TrapezoidalTrajectory::planUnitMove(&vel, accel, decel, min_duration);
+
+    coordinated_move_.post([&](CoordinatedMove& move) {
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            move.active[i] = !std::isnan(goals[i]);
+            move.goal[i] = goals[i];
+            // Axes that stay in place use their own limits for the (empty) move
+            bool moving = dist[i] > 0.0f;
+            move.vel_limit[i] = moving ? vel * dist[i] : axes[i].trap_traj_.config_.vel_limit;
+            move.accel_limit[i] = moving ? accel * dist[i] : axes[i].trap_traj_.config_.accel_limit;
+            move.decel_limit[i] = moving ? decel * dist[i] : axes[i].trap_traj_.config_.decel_limit;
+        }
+    });
+    return duration;
+}
+
 extern "C" {
 
 void vApplicationStackOverflowHook(xTaskHandle *pxTask, signed portCHAR *pcTaskName) {
@@ -193,8 +705,56 @@ void vApplicationStackOverflowHook(xTaskHandle *pxTask, signed portCHAR *pcTaskN
     for (;;); // TODO: safe action
 }
 
+// @brief Returns the run time counter of a thread [CPU cycles modulo 2^32]
+static uint32_t get_run_time(osThreadId thread) {
+    TaskStatus_t status;
+    vTaskGetInfo(thread, &status, pdFALSE, eRunning); // eRunning skips the state query
+    return status.ulRunTimeCounter;
+}
+
+// @brief Updates the CPU load statistics about once per second. The run time
+// counters wrap after 2^32 cycles (about 25s), so this must run more often.
+static void update_cpu_load() {
+    struct RunTimes {
+        uint32_t timestamp, isr, idle, axis, usb, uart, startup, can;
+    };
+    static RunTimes last = {};
+
+    RunTimes now = {
+        .timestamp = portGET_RUN_TIME_COUNTER_VALUE(),
+        .isr = odrv.isr_cycles_,
+        .idle = ulTaskGetIdleRunTimeCounter(),
+        .axis = get_run_time(axes[0].thread_id_) + get_run_time(axes[1].thread_id_),
+        .usb = get_run_time(usb_thread),
+        .uart = get_run_time(uart_thread),
+        .startup = get_run_time(defaultTaskHandle),
+        .can = get_run_time(odCAN->thread_id_),
+    };
+    uint32_t window = now.timestamp - last.timestamp;
+    if (window < SystemCoreClock) {
+        return;
+    }
+
+    float k = 1.0f / (float)window;
+    SystemStats_t& stats = odrv.system_stats_;
+    stats.isr_load = (float)(now.isr - last.isr) * k;
+    // The interrupts preempt the idle task as well. Assuming that they hit
+    // all threads alike, the idle task ran for only (1 - isr_load) of the
+    // time that it was accounted.
+    stats.cpu_load = 1.0f - (float)(now.idle - last.idle) * k * (1.0f - stats.isr_load);
+    stats.cpu_usage_axis = (float)(now.axis - last.axis) * k;
+    stats.cpu_usage_usb = (float)(now.usb - last.usb) * k;
+    stats.cpu_usage_uart = (float)(now.uart - last.uart) * k;
+    stats.cpu_usage_startup = (float)(now.startup - last.startup) * k;
+    stats.cpu_usage_can = (float)(now.can - last.can) * k;
+    last = now;
+}
+
 void vApplicationIdleHook(void) {
     if (odrv.system_stats_.fully_booted) {
+        update_cpu_load();
+        protocol_stats.update_rates();
+
         odrv.system_stats_.uptime = xTaskGetTickCount();
         odrv.system_stats_.min_heap_space = xPortGetMinimumEverFreeHeapSize();
 
@@ -223,16 +783,34 @@ void vApplicationIdleHook(void) {
 }
 
 /**
- * @brief Runs system-level checks that need to be as real-time as possible.
+ * @brief Runs the checks that need to be as real-time as possible, for the
+ * whole board at once.
  * 
- * This function is called after every current measurement of every motor.
+ * This function is called once per cycle after the current measurements of
+ * both motors. It evaluates the bus voltage first and then the fault bits of
+ * each motor (see Motor::fast_check()), which the motor applies before its
+ * control law sees the measurement. The bus current depends on the new
+ * outputs and is checked by update_brake_current() after the PWM updates.
  * It should finish as quickly as possible.
  */
 void ODrive::do_fast_checks() {
-    if (!(vbus_voltage >= config_.dc_bus_undervoltage_trip_level))
+    if (!(vbus_voltage >= config_.dc_bus_undervoltage_trip_level)) {
         disarm_with_error(ERROR_DC_BUS_UNDER_VOLTAGE);
+        // Brownout: the bus capacitors supply the logic for a while after
+        // the motors are disarmed, which is enough to save the positions
+        if (vbus_seen_ok && !position_backup_requested && config_thread) {
+            position_backup_requested = true;
+            osSignalSet(config_thread, CONFIG_SIGNAL_BROWNOUT);
+        }
+    } else {
+        vbus_seen_ok = true;
+    }
     if (!(vbus_voltage <= config_.dc_bus_overvoltage_trip_level))
         disarm_with_error(ERROR_DC_BUS_OVER_VOLTAGE);
+
+    for (auto& axis: axes) {
+        axis.motor_.fast_checks_cb(axis.motor_.fast_check());
+    }
 }
 
 /**
@@ -243,6 +821,9 @@ void ODrive::do_fast_checks() {
  */
 void ODrive::disarm_with_error(Error error) {
     CRITICAL_SECTION() {
+        if (Error new_errors = error & ~error_) {
+            event_log.record(EventLog::SOURCE_SYSTEM, EVENT_LOG_AXIS_NONE, new_errors);
+        }
         for (auto& axis: axes) {
             axis.motor_.disarm_with_error(Motor::ERROR_SYSTEM_LEVEL);
         }
@@ -296,39 +877,16 @@ void ODrive::control_loop_cb(uint32_t timestamp) {
     last_update_timestamp_ = timestamp;
     n_evt_control_loop_++;
 
-    // TODO: use a configurable component list for most of the following things
-
     MEASURE_TIME(task_times_.control_loop_misc) {
-        // Reset all output ports so that we are certain about the freshness of
-        // all values that we use.
-        // If we forget to reset a value here the worst that can happen is that
-        // this safety check doesn't work.
-        // TODO: maybe we should add a check to output ports that prevents
-        // double-setting the value.
+        // Invalidates the values of all output ports from the previous iteration
+        control_loop_epoch++;
+
+        update_adc_measurements();
+
+        // Config writes since the last iteration take effect here
         for (auto& axis: axes) {
-            axis.acim_estimator_.slip_vel_.reset();
-            axis.acim_estimator_.stator_phase_vel_.reset();
-            axis.acim_estimator_.stator_phase_.reset();
-            axis.controller_.torque_output_.reset();
-            axis.encoder_.phase_.reset();
-            axis.encoder_.phase_vel_.reset();
-            axis.encoder_.pos_estimate_.reset();
-            axis.encoder_.vel_estimate_.reset();
-            axis.encoder_.pos_circular_.reset();
-            axis.motor_.Vdq_setpoint_.reset();
-            axis.motor_.Idq_setpoint_.reset();
-            axis.open_loop_controller_.Idq_setpoint_.reset();
-            axis.open_loop_controller_.Vdq_setpoint_.reset();
-            axis.open_loop_controller_.phase_.reset();
-            axis.open_loop_controller_.phase_vel_.reset();
-            axis.open_loop_controller_.total_distance_.reset();
-            axis.sensorless_estimator_.phase_.reset();
-            axis.sensorless_estimator_.phase_vel_.reset();
-            axis.sensorless_estimator_.vel_estimate_.reset();
-        }
-
-        uart_poll();
-        odrv.oscilloscope_.update();
+            axis.apply_dirty_config();
+        }
     }
 
     MEASURE_TIME(task_times_.control_loop_checks) {
@@ -346,48 +904,36 @@ void ODrive::control_loop_cb(uint32_t timestamp) {
     }
 
     for (auto& axis: axes) {
-        // Sub-components should use set_error which will propegate to this error_
-        MEASURE_TIME(axis.task_times_.thermistor_update) {
-            axis.motor_.fet_thermistor_.update();
-            axis.motor_.motor_thermistor_.update();
-        }
+        axis.update_step_dir();
+        axis.run_sensor_stages(timestamp);
+    }
 
-        MEASURE_TIME(axis.task_times_.encoder_update)
-            axis.encoder_.update();
+    // The sensorless estimators of both axes are updated together, which is
+    // cheaper than updating them one by one in the control stages.
+    MEASURE_TIME(task_times_.sensorless_estimator_update) {
+        SensorlessEstimator::update_all();
     }
 
     // Controller of either axis might use the encoder estimate of the other
     // axis so we process both encoders before we continue.
 
-    for (auto& axis: axes) {
-        MEASURE_TIME(axis.task_times_.sensorless_estimator_update)
-            axis.sensorless_estimator_.update();
-
-        MEASURE_TIME(axis.task_times_.endstop_update) {
-            axis.min_endstop_.update();
-            axis.max_endstop_.update();
+    if (std::optional<CoordinatedMove> move = coordinated_move_.fetch()) {
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            if (move->active[i]) {
+                axes[i].controller_.start_coordinated_move(move->goal[i],
+                        move->vel_limit[i], move->accel_limit[i], move->decel_limit[i]);
+            }
         }
+    }
 
-        MEASURE_TIME(axis.task_times_.can_heartbeat)
-            odCAN->send_cyclic(axis);
-
-        MEASURE_TIME(axis.task_times_.controller_update)
-            axis.controller_.update(); // uses position and velocity from encoder
-
-        MEASURE_TIME(axis.task_times_.open_loop_controller_update)
-            axis.open_loop_controller_.update(timestamp);
-
-        MEASURE_TIME(axis.task_times_.motor_update)
-            axis.motor_.update(timestamp); // uses torque from controller and phase_vel from encoder
-
-        MEASURE_TIME(axis.task_times_.current_controller_update)
-            axis.motor_.current_control_.update(timestamp); // uses the output of controller_ or open_loop_contoller_ and encoder_ or sensorless_estimator_ or acim_estimator_
+    for (auto& axis: axes) {
+        axis.run_control_stages(timestamp);
     }
 
-    // Tell the axis threads that the control loop has finished
+    // Tell the axis threads that wait for it that the control loop has finished
     for (auto& axis: axes) {
-        if (axis.thread_id_) {
-            osSignalSet(axis.thread_id_, 0x0001);
+        if (axis.thread_id_ && axis.control_iteration_subscribed_) {
+            osSignalSet(axis.thread_id_, AXIS_SIGNAL_CONTROL_ITERATION);
         }
     }
 
@@ -395,6 +941,33 @@ void ODrive::control_loop_cb(uint32_t timestamp) {
 }
 
 
+/**
+ * @brief Runs work that is triggered by the control loop but doesn't need to
+ * be cycle-exact.
+ * 
+ * This function is executed after every control loop iteration in an
+ * interrupt context with a lower priority than the control loop. It can
+ * therefore be preempted by the next control loop iteration.
+ */
+void ODrive::housekeeping_cb() {
+    MEASURE_TIME(task_times_.housekeeping) {
+        oscilloscope_.update();
+        telemetry_.update(n_evt_control_loop_);
+        odCAN->time_sync_.update();
+        pwm_sync_.update();
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            axes[i].controller_.anticogging_fit_step();
+            axes[i].controller_.learning_step();
+            axes[i].controller_.update_anticogging_operation();
+        }
+        if (n_evt_control_loop_ % std::max(current_meas_hz / 100, 1) == 0) {
+            update_analog_endpoints(); // at 100Hz
+        }
+        pwm0_input.update();
+    }
+}
+
+
 /** @brief For diagnostics only */
 uint32_t ODrive::get_interrupt_status(int32_t irqn) {
     if ((irqn < -14) || (irqn >= 240)) {
@@ -412,6 +985,32 @@ uint32_t ODrive::get_interrupt_status(int32_t irqn) {
     return priority | ((counter & 0x7ffffff) << 8) | (is_enabled ? 0x80000000 : 0);
 }
 
+/** @brief For diagnostics only */
+uint32_t ODrive::get_interrupt_cycles(int32_t irqn) {
+    if ((irqn < -14) || (irqn >= 240)) {
+        return 0;
+    }
+    return GET_IRQ_CYCLES(irqn);
+}
+
+/** @brief For diagnostics only */
+uint32_t ODrive::get_interrupt_max_cycles(int32_t irqn) {
+    if ((irqn < -14) || (irqn >= 240)) {
+        return 0;
+    }
+    return GET_IRQ_MAX_CYCLES(irqn);
+}
+
+void ODrive::reset_interrupt_max_cycles() {
+#ifdef ENABLE_IRQ_CYCLES
+    CRITICAL_SECTION() {
+        for (size_t i = 0; i < sizeof(irq_max_cycles) / sizeof(irq_max_cycles[0]); ++i) {
+            irq_max_cycles[i] = 0;
+        }
+    }
+#endif
+}
+
 /** @brief For diagnostics only */
 uint32_t ODrive::get_dma_status(uint8_t stream_num) {
     DMA_Stream_TypeDef* streams[] = {
@@ -446,6 +1045,9 @@ uint32_t ODrive::get_gpio_states() {
  * @brief Main thread started from main().
  */
 static void rtos_main(void*) {
+    BootTimes_t& boot = odrv.system_stats_.boot;
+    boot.scheduler_started = micros();
+
     // Init USB device
     MX_USB_DEVICE_Init();
 
@@ -457,9 +1059,14 @@ static void rtos_main(void*) {
     // Init communications (this requires the axis objects to be constructed)
     init_communication();
 
+    // The HAL init functions of the USB, CAN and I2C peripherals set the
+    // CubeMX priorities of their interrupts
+    apply_irq_priorities();
+
     // Start pwm-in compare modules
     // must happen after communication is initialized
     pwm0_input.init();
+    odrv.pwm_sync_.init();
 
     // Set up the CS pins for absolute encoders (TODO: move to GPIO init switch statement)
     for(auto& axis : axes){
@@ -468,16 +1075,23 @@ static void rtos_main(void*) {
         }
     }
 
+    boot.communication_started = micros();
+
+    // The encoders don't depend on the gate drivers, so they are set up while
+    // the gate drivers power up.
+    for(auto& axis: axes){
+        axis.encoder_.setup();
+    }
+    boot.encoders_ready = micros();
+
     // Try to initialized gate drivers for fault-free startup.
     // If this does not succeed, a fault will be raised and the idle loop will
     // periodically attempt to reinit the gate driver.
+    wait_for_gate_drivers();
     for(auto& axis: axes){
         axis.motor_.setup();
     }
-
-    for(auto& axis: axes){
-        axis.encoder_.setup();
-    }
+    boot.gate_drivers_ready = micros();
 
     for(auto& axis: axes){
         axis.acim_estimator_.idq_src_.connect_to(&axis.motor_.Idq_setpoint_);
@@ -485,7 +1099,9 @@ static void rtos_main(void*) {
 
     // Start PWM and enable adc interrupts/callbacks
     start_adc_pwm();
-    start_analog_thread();
+    odrv.telemetry_.start_thread();
+    osThreadDef(move_planner_thread_def, move_planner_thread_fn, osPriorityBelowNormal, 0, 512 / sizeof(StackType_t));
+    osThreadCreate(osThread(move_planner_thread_def), NULL);
 
     // Wait for up to 2s for motor to become ready to allow for error-free
     // startup. This delay gives the current sensor calibration time to
@@ -501,6 +1117,8 @@ static void rtos_main(void*) {
         osDelay(1);
     }
 
+    boot.current_sensors_ready = micros();
+
     for (auto& axis: axes) {
         axis.sensorless_estimator_.error_ &= ~SensorlessEstimator::ERROR_UNKNOWN_CURRENT_MEASUREMENT;
     }
@@ -512,6 +1130,7 @@ static void rtos_main(void*) {
         axes[i].start_thread();
     }
 
+    boot.fully_booted = micros();
     odrv.system_stats_.fully_booted = true;
 
     // Main thread finished starting everything and can delete itself now (yes this is legal).
@@ -570,6 +1189,8 @@ extern "C" void early_start_checks(void) {
  * @brief Main entry point called from assembly startup code.
  */
 extern "C" int main(void) {
+    event_log.init();
+
     // This procedure of building a USB serial number should be identical
     // to the way the STM's built-in USB bootloader does it. This means
     // that the device will have the same serial number in normal and DFU mode.
@@ -603,16 +1224,34 @@ extern "C" int main(void) {
         config_clear_all();
         config_apply_all();
     }
+    config_load_position_backups();
+
+    // The spare flash sector is erased later by the config thread, since
+    // the erase would delay the startup by about a second.
+    // The staging buffer also holds the config blob, see read_config_raw()
+    config_staging_size = std::max(config_get_staging_size(), config_get_blob_size());
+    config_staging_buffer = new uint8_t[config_staging_size];
+
+    // Share the arena among the optional buffers according to the config
+    odrv.oscilloscope_.init(arena.allocate<float>(odrv.config_.oscilloscope_size), odrv.config_.oscilloscope_size);
+    for (Axis& axis: axes) {
+        uint32_t points = axis.controller_.config_.pvt_buffer_size;
+        size_t slots = points ? points + 1 : 0; // one slot stays empty
+        axis.controller_.pvt_buffer_.init(arena.allocate<PvtPoint>(slots), slots);
+    }
 
     odrv.misconfigured_ = odrv.misconfigured_
             || (odrv.config_.enable_uart_a && !uart_a)
             || (odrv.config_.enable_uart_b && !uart_b)
             || (odrv.config_.enable_uart_c && !uart_c);
 
+    odrv.system_stats_.boot.config_loaded = micros();
+
     // Init board-specific peripherals
     if (!board_init()) {
         for (;;); // TODO: handle properly
     }
+    odrv.system_stats_.boot.board_initialized = micros();
 
     // Init GPIOs according to their configured mode
     for (size_t i = 0; i < GPIO_COUNT; ++i) {
@@ -632,6 +1271,8 @@ extern "C" int main(void) {
             mode == ODriveIntf::GPIO_MODE_DIGITAL_PULL_DOWN ||
             mode == ODriveIntf::GPIO_MODE_MECH_BRAKE ||
             mode == ODriveIntf::GPIO_MODE_STATUS ||
+            mode == ODriveIntf::GPIO_MODE_SYNC_IN ||
+            mode == ODriveIntf::GPIO_MODE_SYNC_OUT ||
             mode == ODriveIntf::GPIO_MODE_ANALOG_IN) {
             GPIO_InitStruct.Alternate = 0;
         } else {
@@ -713,6 +1354,11 @@ extern "C" int main(void) {
                 GPIO_InitStruct.Pull = GPIO_PULLDOWN;
                 GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
             } break;
+            case ODriveIntf::GPIO_MODE_STEP_COUNTER: {
+                GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+                GPIO_InitStruct.Pull = GPIO_NOPULL;
+                GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+            } break;
             case ODriveIntf::GPIO_MODE_ENC0: {
                 GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
                 GPIO_InitStruct.Pull = GPIO_NOPULL;
@@ -738,6 +1384,16 @@ extern "C" int main(void) {
                 GPIO_InitStruct.Pull = GPIO_NOPULL;
                 GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
             } break;
+            case ODriveIntf::GPIO_MODE_SYNC_IN: {
+                GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+                GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+                GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+            } break;
+            case ODriveIntf::GPIO_MODE_SYNC_OUT: {
+                GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+                GPIO_InitStruct.Pull = GPIO_NOPULL;
+                GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+            } break;
             default: {
                 odrv.misconfigured_ = true;
                 continue;
@@ -761,17 +1417,28 @@ extern "C" int main(void) {
     sem_usb_rx = osSemaphoreCreate(osSemaphore(sem_usb_rx), 1);
     osSemaphoreWait(sem_usb_rx, 0);  // Remove a token.
 
-    // Create a semaphore for USB TX
-    osSemaphoreDef(sem_usb_tx);
-    sem_usb_tx = osSemaphoreCreate(osSemaphore(sem_usb_tx), 1);
+    // Create a semaphore per USB IN endpoint that counts its free TX buffers
+    osSemaphoreDef(sem_usb_tx_cdc);
+    sem_usb_tx_cdc = osSemaphoreCreate(osSemaphore(sem_usb_tx_cdc), USB_TX_BUFFER_COUNT);
+    osSemaphoreDef(sem_usb_tx_native);
+    sem_usb_tx_native = osSemaphoreCreate(osSemaphore(sem_usb_tx_native), USB_TX_BUFFER_COUNT);
 
     osSemaphoreDef(sem_can);
     sem_can = osSemaphoreCreate(osSemaphore(sem_can), 1);
     osSemaphoreWait(sem_can, 0);
 
+    osSemaphoreDef(sem_config_saved);
+    sem_config_saved = osSemaphoreCreate(osSemaphore(sem_config_saved), 1);
+    osSemaphoreWait(sem_config_saved, 0);
+
     // Construct all objects.
     odCAN = new ODriveCAN(can_config, &hcan1);
 
+    // The config thread has a low priority so that flash writes only happen
+    // when no other thread has work to do
+    osThreadDef(config_thread_def, config_thread_fn, osPriorityLow, 0, stack_size_config_thread / sizeof(StackType_t));
+    config_thread = osThreadCreate(osThread(config_thread_def), NULL);
+
     // Create main thread
     osThreadDef(defaultTask, rtos_main, osPriorityNormal, 0, stack_size_default_task / sizeof(StackType_t));
     defaultTaskHandle = osThreadCreate(osThread(defaultTask), NULL);
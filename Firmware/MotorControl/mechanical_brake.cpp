@@ -1,13 +1,28 @@
 #include <odrive_main.h>
 
 void MechanicalBrake::engage() {
-	if (odrv.config_.gpio_modes[config_.gpio_num] == ODriveIntf::GPIO_MODE_MECH_BRAKE){
+	released_ = false;
+	if (is_present()) {
 		get_gpio(config_.gpio_num).write(config_.is_active_low ? 0 : 1);
 	}
 }
 
 void MechanicalBrake::release() {
-	if (odrv.config_.gpio_modes[config_.gpio_num] == ODriveIntf::GPIO_MODE_MECH_BRAKE){
+	if (!released_) {
+		release_time_ = HAL_GetTick();
+		released_ = true;
+	}
+	if (is_present()) {
 		get_gpio(config_.gpio_num).write(config_.is_active_low ? 1 : 0);
 	}
 }
+
+bool MechanicalBrake::is_present() {
+	return odrv.config_.gpio_modes[config_.gpio_num] == ODriveIntf::GPIO_MODE_MECH_BRAKE;
+}
+
+// @brief True once release_delay passed since the release. Always true
+// without a brake.
+bool MechanicalBrake::is_open() {
+	return !is_present() || (released_ && HAL_GetTick() - release_time_ >= config_.release_delay);
+}
@@ -8,6 +8,8 @@ class MechanicalBrake : public ODriveIntf::MechanicalBrakeIntf  {
     struct Config_t {
         uint16_t gpio_num = 0;
         bool is_active_low = true;
+        uint32_t release_delay = 0; // [ms] from release() until the brake is open
+        uint32_t engage_delay = 0; // [ms] from engage() until the brake holds
 
         // custom setters
         MechanicalBrake* parent = nullptr;
@@ -19,7 +21,12 @@ class MechanicalBrake : public ODriveIntf::MechanicalBrakeIntf  {
     MechanicalBrake::Config_t config_;
     Axis* axis_ = nullptr;
 
+    bool released_ = false;
+    uint32_t release_time_ = 0; // [ms] HAL_GetTick() of the release
+
     void release();
     void engage();
+    bool is_present();
+    bool is_open();
 };
-#endif // __MECHANICAL_BRAKE_HPP
\ No newline at end of file
+#endif // __MECHANICAL_BRAKE_HPP
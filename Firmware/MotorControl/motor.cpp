@@ -1,6 +1,7 @@
 
 #include "motor.hpp"
 #include "axis.hpp"
+#include "acim_flux_optimizer.hpp"
 #include "low_level.h"
 #include "odrive_main.h"
 
@@ -22,13 +23,13 @@ struct ResistanceMeasurementControlLaw : AlphaBetaFrameController {
     }
 
     ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<float2D> Ialpha_beta,
-            uint32_t input_timestamp) final {
+            const AlphaBetaMeasurement& meas) final {
 
-        if (Ialpha_beta.has_value()) {
-            actual_current_ = Ialpha_beta->first;
+        if (meas.has(AlphaBetaMeasurement::kCurrentsValid)) {
+            actual_current_ = meas.currents.first;
             test_voltage_ += (kI * current_meas_period) * (target_current_ - actual_current_);
+            Ialpha_filt_ += filter_k * (meas.currents.first - Ialpha_filt_);
+            Ibeta_filt_ += filter_k * (meas.currents.second - Ibeta_filt_);
         } else {
             actual_current_ = 0.0f;
             test_voltage_ = 0.0f;
@@ -37,10 +38,10 @@ struct ResistanceMeasurementControlLaw : AlphaBetaFrameController {
         if (std::abs(test_voltage_) > max_voltage_) {
             test_voltage_ = NAN;
             return Motor::ERROR_PHASE_RESISTANCE_OUT_OF_RANGE;
-        } else if (!vbus_voltage.has_value()) {
+        } else if (!meas.has(AlphaBetaMeasurement::kVbusValid)) {
             return Motor::ERROR_UNKNOWN_VBUS_VOLTAGE;
         } else {
-            float vfactor = 1.0f / ((2.0f / 3.0f) * *vbus_voltage);
+            float vfactor = 1.0f / ((2.0f / 3.0f) * meas.vbus_voltage);
             test_mod_ = test_voltage_ * vfactor;
             return Motor::ERROR_NONE;
         }
@@ -48,8 +49,8 @@ struct ResistanceMeasurementControlLaw : AlphaBetaFrameController {
 
     ODriveIntf::MotorIntf::Error get_alpha_beta_output(
             uint32_t output_timestamp,
-            std::optional<float2D>* mod_alpha_beta,
-            std::optional<float>* ibus) final {
+            float2D* mod_alpha_beta,
+            float* ibus) final {
         if (!test_mod_.has_value()) {
             return Motor::ERROR_CONTROLLER_INITIALIZING;
         } else {
@@ -64,6 +65,9 @@ struct ResistanceMeasurementControlLaw : AlphaBetaFrameController {
     }
 
     const float kI = 1.0f; // [(V/s)/A]
+    const float filter_k = 0.001f;
+    float Ialpha_filt_ = 0.0f; // [A]
+    float Ibeta_filt_ = 0.0f; // [A] should be 0 for balanced current sensors
     float max_voltage_ = 0.0f;
     float actual_current_ = 0.0f;
     float target_current_ = 0.0f;
@@ -84,37 +88,35 @@ struct InductanceMeasurementControlLaw : AlphaBetaFrameController {
     }
 
     ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<float2D> Ialpha_beta,
-            uint32_t input_timestamp) final
+            const AlphaBetaMeasurement& meas) final
     {
-        if (!Ialpha_beta.has_value()) {
+        if (!meas.has(AlphaBetaMeasurement::kCurrentsValid)) {
             return {Motor::ERROR_UNKNOWN_CURRENT_MEASUREMENT};
         }
 
-        float Ialpha = Ialpha_beta->first;
+        float Ialpha = meas.currents.first;
 
         if (attached_) {
             float sign = test_voltage_ >= 0.0f ? 1.0f : -1.0f;
             deltaI_ += -sign * (Ialpha - last_Ialpha_);
         } else {
-            start_timestamp_ = input_timestamp;
+            start_timestamp_ = meas.timestamp;
             attached_ = true;
         }
 
         last_Ialpha_ = Ialpha;
-        last_input_timestamp_ = input_timestamp;
+        last_input_timestamp_ = meas.timestamp;
 
         return Motor::ERROR_NONE;
     }
 
     ODriveIntf::MotorIntf::Error get_alpha_beta_output(
-            uint32_t output_timestamp, std::optional<float2D>* mod_alpha_beta,
-            std::optional<float>* ibus) final
+            uint32_t output_timestamp, float2D* mod_alpha_beta,
+            float* ibus) final
     {
         test_voltage_ *= -1.0f;
         float vfactor = 1.0f / ((2.0f / 3.0f) * vbus_voltage);
-        *mod_alpha_beta = {test_voltage_ * vfactor, 0.0f};
+        *mod_alpha_beta = {(bias_voltage_ + test_voltage_) * vfactor, 0.0f};
         *ibus = 0.0f;
         return Motor::ERROR_NONE;
     }
@@ -128,6 +130,7 @@ struct InductanceMeasurementControlLaw : AlphaBetaFrameController {
 
     // Config
     float test_voltage_ = 0.0f;
+    float bias_voltage_ = 0.0f; // DC offset to measure the inductance at a bias current. The ripple measurement is not affected by it.
 
     // State
     bool attached_ = false;
@@ -140,6 +143,137 @@ struct InductanceMeasurementControlLaw : AlphaBetaFrameController {
     float deltaI_ = 0.0f;
 };
 
+/**
+ * @brief Tracks a DC test current on the alpha axis like
+ * ResistanceMeasurementControlLaw and superimposes a pseudo random binary
+ * voltage sequence. The response to both is fed into an RLIdentification
+ * which estimates the phase resistance and inductance together, so the
+ * measurement can stop as soon as both are known well enough.
+ *
+ * Like InductanceMeasurementControlLaw this assumes that the current change
+ * between two measurements is caused by the output computed two control
+ * periods earlier.
+ */
+struct RLMeasurementControlLaw : AlphaBetaFrameController {
+    void reset() final {
+        identification_.reset(current_meas_period);
+        min_settled_samples_ = (uint32_t)(kMinSettledTime / current_meas_period);
+        attached_ = false;
+        jump_started_ = false;
+        done_ = false;
+        test_voltage_ = 0.0f;
+        vfactor_ = std::nullopt;
+        outputs_[0] = outputs_[1] = 0.0f;
+        Ialpha_sum_ = Ibeta_sum_ = 0.0f;
+        n_settled_ = 0;
+    }
+
+    ODriveIntf::MotorIntf::Error on_measurement(
+            const AlphaBetaMeasurement& meas) final {
+        if (!meas.has(AlphaBetaMeasurement::kCurrentsValid)) {
+            return Motor::ERROR_UNKNOWN_CURRENT_MEASUREMENT;
+        }
+
+        float Ialpha = meas.currents.first;
+        if (attached_) {
+            identification_.update(Ialpha - last_Ialpha_, last_Ialpha_, outputs_[1]);
+        } else {
+            Ialpha_filt_ = Ialpha;
+            attached_ = true;
+        }
+        last_Ialpha_ = Ialpha;
+        actual_current_ = Ialpha;
+
+        test_voltage_ += (kI * current_meas_period) * (target_current_ - Ialpha);
+
+        // Evaluating the uncertainties is comparatively expensive so it is
+        // only done every few samples.
+        if ((identification_.n_samples_ & (kCheckInterval - 1)) == 0 && identification_.is_valid()) {
+            float R = identification_.get_resistance();
+            bool R_known = identification_.get_resistance_uncertainty() < tolerance_ * R;
+
+            // The integrator is slow, so once a rough resistance is known the
+            // DC voltage jumps to its expected final value.
+            if (!jump_started_ && identification_.get_resistance_uncertainty() < 0.1f * R) {
+                test_voltage_ = R * target_current_;
+                jump_started_ = true;
+            }
+
+            done_ = R_known && n_settled_ >= min_settled_samples_
+                 && identification_.get_inductance_uncertainty() < tolerance_ * identification_.get_inductance();
+        }
+
+        // The binary sequence ripples the current, the filtered current tells
+        // if the DC current settled.
+        Ialpha_filt_ += filter_k * (Ialpha - Ialpha_filt_);
+        if (std::abs(Ialpha_filt_ - target_current_) < 0.05f * std::abs(target_current_)) {
+            Ialpha_sum_ += Ialpha;
+            Ibeta_sum_ += meas.currents.second;
+            n_settled_++;
+        }
+
+        if (std::abs(test_voltage_) > max_voltage_) {
+            test_voltage_ = NAN;
+            return Motor::ERROR_PHASE_RESISTANCE_OUT_OF_RANGE;
+        } else if (!meas.has(AlphaBetaMeasurement::kVbusValid)) {
+            return Motor::ERROR_UNKNOWN_VBUS_VOLTAGE;
+        } else {
+            vfactor_ = 1.0f / ((2.0f / 3.0f) * meas.vbus_voltage);
+            return Motor::ERROR_NONE;
+        }
+    }
+
+    ODriveIntf::MotorIntf::Error get_alpha_beta_output(
+            uint32_t output_timestamp,
+            float2D* mod_alpha_beta,
+            float* ibus) final {
+        if (!vfactor_.has_value()) {
+            return Motor::ERROR_CONTROLLER_INITIALIZING;
+        }
+
+        // 16-bit maximum length LFSR (x^16 + x^14 + x^13 + x^11 + 1)
+        lfsr_ = (lfsr_ >> 1) ^ (-(lfsr_ & 1u) & 0xB400u);
+        float voltage = test_voltage_ + ((lfsr_ & 1u) ? injection_voltage_ : -injection_voltage_);
+
+        outputs_[1] = outputs_[0];
+        outputs_[0] = voltage;
+        float mod = voltage * *vfactor_;
+        *mod_alpha_beta = {mod, 0.0f};
+        *ibus = mod * actual_current_;
+        return Motor::ERROR_NONE;
+    }
+
+    const float kI = 1.0f; // [(V/s)/A]
+    const float filter_k = 0.01f;
+    static constexpr float kMinSettledTime = 0.05f; // [s] minimum time at the test current, for the current sense gain calibration
+    static constexpr uint32_t kCheckInterval = 64; // must be a power of 2
+
+    // Config
+    float target_current_ = 0.0f; // [A]
+    float max_voltage_ = 0.0f; // [V]
+    float injection_voltage_ = 0.0f; // [V] amplitude of the binary sequence
+    float tolerance_ = 0.0f; // relative standard deviation at which the measurement is done
+
+    // State
+    RLIdentification identification_;
+    uint32_t min_settled_samples_ = 0;
+    bool attached_ = false;
+    bool jump_started_ = false;
+    uint16_t lfsr_ = 0xACE1u;
+    float last_Ialpha_ = 0.0f; // [A]
+    float actual_current_ = 0.0f; // [A]
+    float Ialpha_filt_ = 0.0f; // [A]
+    float outputs_[2] = {0.0f, 0.0f}; // [V] last two output voltages, newest first
+    std::optional<float> vfactor_;
+
+    // Outputs
+    volatile bool done_ = false;
+    float test_voltage_ = 0.0f; // [V] DC component
+    float Ialpha_sum_ = 0.0f; // [A] sum over the samples at the test current
+    float Ibeta_sum_ = 0.0f; // [A]
+    uint32_t n_settled_ = 0;
+};
+
 
 Motor::Motor(TIM_HandleTypeDef* timer,
              uint8_t current_sensor_mask,
@@ -194,6 +328,7 @@ bool Motor::arm(PhaseControlLaw<3>* control_law) {
         // Reset controller states, integrators, setpoints, etc.
         axis_->controller_.reset();
         axis_->acim_estimator_.rotor_flux_ = 0.0f;
+        field_weakening_id_ = 0.0f;
         if (control_law_) {
             control_law_->reset();
         }
@@ -273,6 +408,7 @@ bool Motor::disarm(bool* p_was_armed) {
     // Check necessary to prevent infinite recursion
     if (was_armed) {
         update_brake_current();
+        axis_->notify_event();
     }
 
     if (p_was_armed) {
@@ -287,18 +423,89 @@ bool Motor::disarm(bool* p_was_armed) {
 // TODO: allow update on user-request or update automatically via hooks
 void Motor::update_current_controller_gains() {
     // Calculate current control gains
-    float p_gain = config_.current_control_bandwidth * config_.phase_inductance;
-    float plant_pole = config_.phase_resistance / config_.phase_inductance;
-    current_control_.pi_gains_ = {p_gain, plant_pole * p_gain};
+    float phase_inductance = effective_phase_inductance();
+    float p_gain = config_.current_control_bandwidth * phase_inductance;
+    float plant_pole = effective_phase_resistance() / phase_inductance;
+
+    // The integrator gain R * bandwidth doesn't depend on L so only the
+    // proportional gain is scheduled.
+    decltype(current_control_.p_gain_schedule_) p_gain_schedule = {};
+    static_assert(p_gain_schedule.size() == INDUCTANCE_TABLE_SIZE + 1, "size mismatch");
+    float p_gain_schedule_step = 0.0f;
+    if (config_.inductance_table_enable && config_.inductance_table_current > 0.0f) {
+        // Scale the table with the ratio of the (possibly estimated) small
+        // signal inductance to the calibrated one
+        float scale = phase_inductance / config_.phase_inductance;
+        p_gain_schedule[0] = p_gain;
+        for (size_t i = 0; i < INDUCTANCE_TABLE_SIZE; ++i) {
+            p_gain_schedule[i + 1] = config_.current_control_bandwidth * config_.inductance_table[i] * scale;
+        }
+        p_gain_schedule_step = config_.inductance_table_current / (float)INDUCTANCE_TABLE_SIZE;
+    }
+
+    CRITICAL_SECTION() {
+        current_control_.pi_gains_ = {p_gain, plant_pole * p_gain};
+        current_control_.current_control_bandwidth_ = config_.current_control_bandwidth;
+        current_control_.p_gain_schedule_ = p_gain_schedule;
+        current_control_.p_gain_schedule_inv_step_ = p_gain_schedule_step > 0.0f ? 1.0f / p_gain_schedule_step : 0.0f;
+    }
+}
+
+// @brief Restarts the online R/L estimation from the configured values
+void Motor::reset_rl_estimator() {
+    CRITICAL_SECTION() {
+        rl_estimator_.reset(config_.phase_resistance, config_.phase_inductance);
+        rl_estimator_.n_updates_ = 0;
+    }
+}
+
+// @brief Returns the phase resistance used for the current controller gains
+// and feedforward. This is the online estimate if enabled, limited to a
+// plausible range around the calibrated value.
+float Motor::effective_phase_resistance() {
+    if (rl_estimator_.config_.update_gains && rl_estimator_.n_updates_) {
+        return std::clamp(rl_estimator_.get_resistance(), 0.5f * config_.phase_resistance, 2.0f * config_.phase_resistance);
+    }
+    return config_.phase_resistance;
+}
+
+// @brief See effective_phase_resistance()
+float Motor::effective_phase_inductance() {
+    if (rl_estimator_.config_.update_gains && rl_estimator_.n_updates_) {
+        return std::clamp(rl_estimator_.get_inductance(), 0.5f * config_.phase_inductance, 2.0f * config_.phase_inductance);
+    }
+    return config_.phase_inductance;
 }
 
 bool Motor::apply_config() {
     config_.parent = this;
     is_calibrated_ = config_.pre_calibrated;
+    reset_rl_estimator();
     update_current_controller_gains();
+    update_torque_constant_map();
+    current_control_.modulation_mode_ = config_.modulation_mode;
+    current_control_.current_controller_type_ = config_.current_controller_type;
+    current_control_.pwm_delay_compensation_ = config_.pwm_delay_compensation;
     return true;
 }
 
+/**
+ * @brief Recomputes the derived quantities that the config setters marked as
+ * out of date. Called by the control loop before the sensor stages.
+ */
+void Motor::apply_dirty_config() {
+    uint32_t dirty = dirty_.take();
+    if (dirty & DIRTY_RL_ESTIMATOR) {
+        reset_rl_estimator();
+    }
+    if (dirty & DIRTY_CURRENT_CONTROLLER_GAINS) {
+        update_current_controller_gains();
+    }
+    if (dirty & DIRTY_TORQUE_CONSTANT_MAP) {
+        update_torque_constant_map();
+    }
+}
+
 // @brief Set up the gate drivers
 bool Motor::setup() {
     fet_thermistor_.update();
@@ -329,17 +536,46 @@ bool Motor::setup() {
 }
 
 void Motor::disarm_with_error(Motor::Error error){
+    if (Error new_errors = error & ~error_) {
+        event_log.record(EventLog::SOURCE_MOTOR, axis_->axis_num_, new_errors);
+    }
     error_ |= error;
     disarm();
 }
 
-bool Motor::do_checks(uint32_t timestamp) {
-    gate_driver_.do_checks();
+/**
+ * @brief Called from the control loop interrupt if the PWM timings of this
+ * motor were not applied before the timer update event that latches them.
+ * In this case the timer outputs the tentative 50% duty cycle instead.
+ */
+void Motor::on_deadline_miss(uint32_t timestamp) {
+    deadline_miss_count_++;
+    last_deadline_miss_timestamp_ = timestamp;
+
+    switch (config_.deadline_miss_policy) {
+        case DEADLINE_MISS_POLICY_IGNORE: {
+        } break;
+        case DEADLINE_MISS_POLICY_WARN: {
+            odrv.error_ |= ODrive::ERROR_CONTROL_ITERATION_MISSED;
+        } break;
+        default: {
+            disarm_with_error(ERROR_CONTROL_DEADLINE_MISSED);
+        } break;
+    }
+}
 
-    if (!gate_driver_.is_ready()) {
-        disarm_with_error(ERROR_DRV_FAULT);
-        return false;
+// @brief Checks that run once per control loop iteration. The gate driver
+// state is checked in fast_check().
+bool Motor::do_checks(uint32_t timestamp) {
+    // The readout completes in the background and only takes effect in
+    // is_ready() of a later iteration.
+    gate_driver_readout_phase_ += config_.gate_driver_readout_rate * current_meas_period;
+    if (gate_driver_readout_phase_ >= 1.0f) {
+        if (gate_driver_.start_status_readout() || !gate_driver_.is_ready()) {
+            gate_driver_readout_phase_ = 0.0f;
+        }
     }
+
     if (!motor_thermistor_.do_checks()) {
         disarm_with_error(ERROR_MOTOR_THERMISTOR_OVER_TEMP);
         return false;
@@ -351,6 +587,24 @@ bool Motor::do_checks(uint32_t timestamp) {
     return true;
 }
 
+// @brief Feeds the I^2*R losses of the last control period into the thermal
+// models. The sum of the squared phase currents is 3/2 of the squared
+// current vector magnitude that the current limit refers to.
+void Motor::update_thermal_models() {
+    float I_sq = current_meas_.has_value()
+            ? SQ(current_meas_->phA) + SQ(current_meas_->phB) + SQ(current_meas_->phC)
+            : 0.0f;
+
+    float R_motor = motor_thermal_model_.config_.resistance > 0.0f
+            ? motor_thermal_model_.config_.resistance : effective_phase_resistance();
+    float motor_ref_temp = motor_thermistor_.config_.enabled ? motor_thermistor_.temperature_ : NAN;
+    motor_thermal_model_.update(R_motor * I_sq, 1.5f * R_motor, motor_ref_temp, current_meas_period);
+
+    float R_fet = fet_thermal_model_.config_.resistance;
+    float fet_ref_temp = fet_thermistor_.config_.enabled ? fet_thermistor_.temperature_ : NAN;
+    fet_thermal_model_.update(R_fet * I_sq, 1.5f * R_fet, fet_ref_temp, current_meas_period);
+}
+
 float Motor::effective_current_lim() {
     // Configured limit
     float current_lim = config_.current_lim;
@@ -364,11 +618,141 @@ float Motor::effective_current_lim() {
     // Apply thermistor current limiters
     current_lim = std::min(current_lim, motor_thermistor_.get_current_limit(config_.current_lim));
     current_lim = std::min(current_lim, fet_thermistor_.get_current_limit(config_.current_lim));
+    // Apply the predictive thermal model limiters
+    current_lim = std::min(current_lim, motor_thermal_model_.get_current_limit(config_.current_lim));
+    current_lim = std::min(current_lim, fet_thermal_model_.get_current_limit(config_.current_lim));
     effective_current_lim_ = current_lim;
 
     return effective_current_lim_;
 }
 
+/**
+ * @brief Scales iq down such that the predicted bus current stays within
+ * I_bus_limit_.
+ *
+ * In steady state the electrical power of a PM motor is
+ *   P = 3/2 * (R * (id^2 + iq^2) + phase_vel * flux * iq)
+ * (neglecting saliency). For iq scaled by t in [0, 1] this is a convex
+ * quadratic in t. The largest t at which P / vbus is within the limits is
+ * found analytically, so the current is only reduced, never increased or
+ * reversed.
+ */
+float Motor::apply_bus_current_limit(float id, float iq, float phase_vel, float flux) {
+    float I_bus_min = I_bus_limit_.first * vbus_voltage; // [W]
+    float I_bus_max = I_bus_limit_.second * vbus_voltage; // [W]
+    float R = effective_phase_resistance();
+
+    // P(t) = A * t^2 + B * t + C0
+    float A = 1.5f * R * iq * iq;
+    float B = 1.5f * phase_vel * flux * iq;
+    float C0 = 1.5f * R * id * id;
+    float P = A + B + C0;
+
+    float P_lim;
+    bool upper;
+    if (P > I_bus_max) {
+        P_lim = I_bus_max;
+        upper = true;
+    } else if (P < I_bus_min) {
+        P_lim = I_bus_min;
+        upper = false;
+    } else {
+        return iq;
+    }
+
+    // No feasible current in the direction of iq
+    if (C0 > I_bus_max || C0 < I_bus_min) {
+        return 0.0f;
+    }
+
+    // P(0) is within the limits and P(1) is not, so there is exactly one root
+    // in [0, 1). It's the larger one when P rises above the upper limit and
+    // the smaller one when it falls below the lower limit.
+    float C = C0 - P_lim;
+    float t;
+    if (A > 0.0f) {
+        float sqrt_D = std::sqrt(std::max(B * B - 4.0f * A * C, 0.0f));
+        t = (-B + (upper ? sqrt_D : -sqrt_D)) / (2.0f * A);
+    } else {
+        t = B != 0.0f ? -C / B : 0.0f;
+    }
+    return std::clamp(t, 0.0f, 1.0f) * iq;
+}
+
+void Motor::update_torque_constant_map() {
+    TorqueConstantMap<TORQUE_CONSTANT_TABLE_SIZE> map;
+    bool active = config_.torque_constant_table_enable
+               && map.set(config_.torque_constant_table);
+    CRITICAL_SECTION() {
+        torque_constant_map_ = map;
+        torque_constant_map_active_ = active;
+    }
+}
+
+// @brief Torque [Nm] of a PM motor at the q-axis current [A]
+float Motor::torque_from_current(float current) {
+    return torque_constant_map_active_ ? torque_constant_map_.torque(current)
+                                       : config_.torque_constant * current;
+}
+
+// @brief Inverse of torque_from_current()
+float Motor::current_from_torque(float torque) {
+    return torque_constant_map_active_ ? torque_constant_map_.current(torque)
+                                       : torque / config_.torque_constant;
+}
+
+/**
+ * @brief Adds a point to torque_constant_table from the present current and
+ * a known load torque.
+ *
+ * The axis must hold the load in closed loop control, e.g. a weight on a
+ * lever of known length, and the current must have settled. The current is
+ * averaged over 100ms, which blocks the calling thread. The point takes
+ * the place of an existing one at a similar current (within 5%) or is
+ * inserted in order of current. Returns false if the motor is not armed, the
+ * current is too small to give a meaningful result or the table is full.
+ * The table is applied if the new point keeps it valid.
+ */
+bool Motor::record_torque_constant_point(float torque) {
+    if (!is_armed_ || config_.motor_type == MOTOR_TYPE_ACIM || !(std::abs(torque) > 0.0f)) {
+        return false;
+    }
+    constexpr size_t num_samples = 100;
+    float current = 0.0f;
+    for (size_t i = 0; i < num_samples; ++i) {
+        current += current_control_.Iq_measured_;
+        osDelay(1);
+    }
+    current = std::abs(current / (float)num_samples);
+    torque = std::abs(torque);
+    if (!is_armed_ || !(current > 0.05f * config_.calibration_current)) {
+        return false;
+    }
+
+    auto& table = config_.torque_constant_table;
+    size_t n = 0;
+    while (n < TORQUE_CONSTANT_TABLE_SIZE && table[n].current != 0.0f) {
+        n++;
+    }
+
+    size_t i = 0;
+    while (i < n && table[i].current < 0.95f * current) {
+        i++;
+    }
+    if (i == n || table[i].current > 1.05f * current) {
+        if (n == TORQUE_CONSTANT_TABLE_SIZE) {
+            return false;
+        }
+        for (size_t j = n; j > i; --j) {
+            table[j] = table[j - 1];
+        }
+    }
+    table[i] = {current, torque / current};
+
+    update_torque_constant_map();
+    return true;
+}
+
 //return the maximum available torque for the motor.
 //Note - for ACIM motors, available torque is allowed to be 0.
 float Motor::max_available_torque() {
@@ -377,13 +761,13 @@ float Motor::max_available_torque() {
         max_torque = std::clamp(max_torque, 0.0f, config_.torque_lim);
         return max_torque;
     } else {
-        float max_torque = effective_current_lim_ * config_.torque_constant;
+        float max_torque = torque_from_current(effective_current_lim_);
         max_torque = std::clamp(max_torque, 0.0f, config_.torque_lim);
         return max_torque;
     }
 }
 
-std::optional<float> Motor::phase_current_from_adcval(uint32_t ADCValue) {
+std::optional<float> Motor::phase_current_from_adcval(uint32_t ADCValue, size_t phase) {
     // Make sure the measurements don't come too close to the current sensor's hardware limitations
     if (ADCValue < CURRENT_ADC_LOWER_BOUND || ADCValue > CURRENT_ADC_UPPER_BOUND) {
         error_ |= ERROR_CURRENT_SENSE_SATURATION;
@@ -393,7 +777,7 @@ std::optional<float> Motor::phase_current_from_adcval(uint32_t ADCValue) {
     int adcval_bal = (int)ADCValue - (1 << 11);
     float amp_out_volt = (3.3f / (float)(1 << 12)) * (float)adcval_bal;
     float shunt_volt = amp_out_volt * phase_current_rev_gain_;
-    float current = shunt_volt * shunt_conductance_;
+    float current = shunt_volt * shunt_conductance_ * config_.current_sense_gain[phase];
     return current;
 }
 
@@ -401,45 +785,118 @@ std::optional<float> Motor::phase_current_from_adcval(uint32_t ADCValue) {
 // Measurement and calibration
 //--------------------------------
 
+/**
+ * @brief Measures the phase resistance and inductance in one go.
+ *
+ * Holds test_current on the alpha axis while a binary voltage sequence of
+ * a quarter of max_voltage is superimposed (see RLMeasurementControlLaw). Stops
+ * as soon as the relative standard deviation of both estimates is below
+ * config_.rl_identification_tolerance, or after 3 seconds.
+ */
 // TODO check Ibeta balance to verify good motor connection
-bool Motor::measure_phase_resistance(float test_current, float max_voltage) {
-    ResistanceMeasurementControlLaw control_law;
+bool Motor::measure_phase_rl(float test_current, float max_voltage) {
+    RLMeasurementControlLaw control_law;
     control_law.target_current_ = test_current;
     control_law.max_voltage_ = max_voltage;
+    control_law.injection_voltage_ = 0.25f * max_voltage;
+    control_law.tolerance_ = config_.rl_identification_tolerance;
 
     arm(&control_law);
 
     for (size_t i = 0; i < 3000; ++i) {
-        if (!((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_)) {
+        if (!((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_)
+            || control_law.done_) {
             break;
         }
         osDelay(1);
     }
 
     bool success = is_armed_;
-
-    //// De-energize motor
-    //if (!enqueue_voltage_timings(motor, 0.0f, 0.0f))
-    //    return false; // error set inside enqueue_voltage_timings
-
     disarm();
 
-    config_.phase_resistance = control_law.get_resistance();
-    if (is_nan(config_.phase_resistance)) {
+    if (success && config_.calibrate_current_sense_gains && control_law.n_settled_) {
+        float n = (float)control_law.n_settled_;
+        calibrate_current_sense_gains(control_law.Ialpha_sum_ / n, control_law.Ibeta_sum_ / n);
+    }
+
+    RLIdentification& identification = control_law.identification_;
+    if (is_nan(control_law.test_voltage_) || !identification.is_valid()) {
         // TODO: the motor is already disarmed at this stage. This is an error
         // that only pretains to the measurement and its result so it should
         // just be a return value of this function.
         disarm_with_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE);
+        return false;
+    }
+
+    config_.phase_resistance = identification.get_resistance();
+    config_.phase_inductance = identification.get_inductance();
+    phase_resistance_uncertainty_ = identification.get_resistance_uncertainty();
+    phase_inductance_uncertainty_ = identification.get_inductance_uncertainty();
+
+    // TODO arbitrary values set for now
+    if (!(config_.phase_inductance >= 2e-6f && config_.phase_inductance <= 4000e-6f)) {
+        error_ |= ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE;
         success = false;
     }
 
     return success;
 }
 
+/**
+ * @brief Balances the gains of the two sensed phases (B and C).
+ *
+ * During the resistance measurement the current is applied on the alpha axis
+ * so phases B and C both carry -Ialpha/2 and Ibeta should be zero. A nonzero
+ * Ibeta means that the two current sense channels have different gains.
+ * The correction keeps the mean gain of both channels unchanged.
+ *
+ * Corrections larger than 20% are rejected since they point to a wiring
+ * problem rather than a gain mismatch.
+ */
+void Motor::calibrate_current_sense_gains(float Ialpha, float Ibeta) {
+    float I_ref = -0.5f * Ialpha;
+    float I_b = I_ref + sqrt3_by_2 * Ibeta;
+    float I_c = I_ref - sqrt3_by_2 * Ibeta;
+    float k_b = I_ref / I_b;
+    float k_c = I_ref / I_c;
+    if (std::abs(k_b - 1.0f) < 0.2f && std::abs(k_c - 1.0f) < 0.2f) {
+        config_.current_sense_gain[1] *= k_b;
+        config_.current_sense_gain[2] *= k_c;
+    }
+}
+
+/**
+ * @brief Measures the inductance table used for gain scheduling.
+ *
+ * The measurement is repeated at 25%, 50%, 75% and 100% of test_current
+ * on top of which the inductance measurement ripple is applied. Requires
+ * phase_resistance and phase_inductance to be measured already.
+ * 
+ * Since the rotor position is unknown, this measures the inductance along an
+ * arbitrary axis, which is a reasonable approximation for the saturation of
+ * the stator iron.
+ */
+bool Motor::measure_inductance_table(float test_current, float test_voltage) {
+    for (size_t i = 0; i < INDUCTANCE_TABLE_SIZE; ++i) {
+        float bias_current = test_current * (float)(i + 1) / (float)INDUCTANCE_TABLE_SIZE;
+        float inductance;
+        if (!measure_inductance_at_bias(test_voltage, bias_current * config_.phase_resistance, &inductance)) {
+            return false;
+        }
+        if (!(inductance >= 2e-6f && inductance <= 4000e-6f)) {
+            error_ |= ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE;
+            return false;
+        }
+        config_.inductance_table[i] = inductance;
+    }
+    config_.inductance_table_current = test_current;
+    return true;
+}
 
-bool Motor::measure_phase_inductance(float test_voltage) {
+bool Motor::measure_inductance_at_bias(float test_voltage, float bias_voltage, float* inductance) {
     InductanceMeasurementControlLaw control_law;
     control_law.test_voltage_ = test_voltage;
+    control_law.bias_voltage_ = bias_voltage;
 
     arm(&control_law);
 
@@ -458,18 +915,68 @@ bool Motor::measure_phase_inductance(float test_voltage) {
 
     disarm();
 
-    config_.phase_inductance = control_law.get_inductance();
-    
-    // TODO arbitrary values set for now
-    if (!(config_.phase_inductance >= 2e-6f && config_.phase_inductance <= 4000e-6f)) {
-        error_ |= ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE;
-        success = false;
-    }
-
+    *inductance = control_law.get_inductance();
     return success;
 }
 
 
+/**
+ * @brief Identifies the dead time compensation curve.
+ *
+ * Holds three different currents on the alpha axis and records the voltage
+ * needed for each. The two larger currents define the resistive slope, the
+ * remaining offset is the inverter voltage error. The smallest current
+ * determines how fast the error builds up around zero current.
+ *
+ * Phase A carries the full test current and phases B and C half of it in
+ * the opposite direction, so the voltage error in the alpha frame is 4/3 of
+ * the per-phase error.
+ */
+bool Motor::measure_dead_time(float test_current, float max_voltage) {
+    const float test_currents[] = {0.1f * test_current, 0.5f * test_current, test_current};
+    float test_voltages[3];
+
+    for (size_t i = 0; i < 3; ++i) {
+        ResistanceMeasurementControlLaw control_law;
+        control_law.target_current_ = test_currents[i];
+        control_law.max_voltage_ = max_voltage;
+
+        arm(&control_law);
+
+        for (size_t j = 0; j < 3000; ++j) {
+            if (!((axis_->requested_state_ == Axis::AXIS_STATE_UNDEFINED) && axis_->motor_.is_armed_)) {
+                break;
+            }
+            osDelay(1);
+        }
+
+        bool success = is_armed_;
+        disarm();
+
+        test_voltages[i] = control_law.test_voltage_;
+        if (!success || is_nan(test_voltages[i])) {
+            return false;
+        }
+    }
+
+    float R = (test_voltages[2] - test_voltages[1]) / (test_currents[2] - test_currents[1]);
+    float V_offset = test_voltages[2] - R * test_currents[2];
+
+    if (!(V_offset > 0.0f)) {
+        // No measurable inverter nonlinearity
+        config_.dead_time_comp_voltage = 0.0f;
+        return true;
+    }
+
+    // The error is modelled as V_offset * min(I / I_sat, 1)
+    float V_low = test_voltages[0] - R * test_currents[0];
+    float I_sat = V_low > 0.0f ? test_currents[0] * V_offset / V_low : test_currents[0];
+
+    config_.dead_time_comp_voltage = 0.75f * V_offset;
+    config_.dead_time_comp_current = std::min(I_sat, test_currents[1]);
+    return true;
+}
+
 // TODO: motor calibration should only be a utility function that's called from
 // the UI on explicit user request. It should take its parameters as input
 // arguments and return the measured results without modifying any config values.
@@ -477,9 +984,11 @@ bool Motor::run_calibration() {
     float R_calib_max_voltage = config_.resistance_calib_max_voltage;
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT
         || config_.motor_type == MOTOR_TYPE_ACIM) {
-        if (!measure_phase_resistance(config_.calibration_current, R_calib_max_voltage))
+        if (!measure_phase_rl(config_.calibration_current, R_calib_max_voltage))
             return false;
-        if (!measure_phase_inductance(R_calib_max_voltage))
+        if (config_.calibrate_dead_time && !measure_dead_time(config_.calibration_current, R_calib_max_voltage))
+            return false;
+        if (config_.calibrate_inductance_table && !measure_inductance_table(config_.calibration_current, R_calib_max_voltage))
             return false;
     } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
         // no calibration needed
@@ -487,6 +996,7 @@ bool Motor::run_calibration() {
         return false;
     }
 
+    reset_rl_estimator();
     update_current_controller_gains();
     
     is_calibrated_ = true;
@@ -504,27 +1014,88 @@ void Motor::update(uint32_t timestamp) {
     auto [id, iq] = Idq_setpoint_.previous()
                      .value_or(float2D{0.0f, 0.0f}); // Id doubles as a state variable
 
+    float flux = (2.0f / 3.0f) * config_.torque_constant / config_.pole_pairs; // [Wb] permanent magnet flux linkage
+
     // Convert torque to current
     if (axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_ACIM) {
         iq = *torque / (axis_->motor_.config_.torque_constant * std::max(axis_->acim_estimator_.rotor_flux_, config_.acim_gain_min_flux));
     } else {
-        iq = *torque / axis_->motor_.config_.torque_constant;
+        iq = current_from_torque(*torque);
     }
 
     iq *= direction_;
 
+    // The ripple is locked to the rotor, which the phase of an ACIM isn't
+    if (ripple_canceller_.config_.enable && config_.motor_type != MOTOR_TYPE_ACIM && is_armed_) {
+        std::optional<float> phase = current_control_.phase_src_.present();
+        std::optional<float> phase_vel = phase_vel_src_.present();
+        std::optional<float> vel = axis_->controller_.vel_estimate_src_.present();
+        if (phase.has_value() && phase_vel.has_value() && vel.has_value()) {
+            auto [sin_phase, cos_phase] = fast_sincos(*phase);
+            auto [sin_delayed, cos_delayed] = fast_sincos(*phase - *phase_vel * ripple_canceller_.config_.delay);
+            float vel_error = direction_ * (*vel - axis_->controller_.vel_setpoint_);
+            iq += ripple_canceller_.update(cos_phase, sin_phase, cos_delayed, sin_delayed,
+                                           *phase_vel, *vel, vel_error, current_meas_period);
+        }
+    } else {
+        ripple_canceller_.iq_comp_ = 0.0f;
+    }
+
     // TODO: 2-norm vs independent clamping (current could be sqrt(2) bigger)
     float ilim = axis_->motor_.effective_current_lim_;
     id = std::clamp(id, -ilim, ilim);
     iq = std::clamp(iq, -ilim, ilim);
 
     if ((axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_ACIM) && config_.acim_autoflux_enable) {
-        float abs_iq = std::abs(iq);
-        float gain = abs_iq > id ? config_.acim_autoflux_attack_gain : config_.acim_autoflux_decay_gain;
-        id += gain * (abs_iq - id) * current_meas_period;
+        float target_id = std::abs(iq);
+        if (config_.acim_min_loss_enable) {
+            // The attack and decay gains keep the rate of change of the flux
+            // within what the rotor time constant and the current limit allow
+            AcimLossModel model = {
+                .torque_constant = config_.torque_constant,
+                .pole_pairs = (float)config_.pole_pairs,
+                .phase_resistance = effective_phase_resistance(),
+                .slip_velocity = axis_->acim_estimator_.config_.slip_velocity,
+                .core_loss_coeff = config_.acim_core_loss_coeff,
+            };
+            target_id = model.get_min_loss_id(*torque, phase_vel_src_.present().value_or(0.0f));
+        }
+        float gain = target_id > id ? config_.acim_autoflux_attack_gain : config_.acim_autoflux_decay_gain;
+        id += gain * (target_id - id) * current_meas_period;
         id = std::clamp(id, config_.acim_autoflux_min_Id, ilim);
     }
 
+    if (config_.motor_type == Motor::MOTOR_TYPE_HIGH_CURRENT
+        && (config_.mtpa_inductance_difference > 0.0f || config_.field_weakening_enable)) {
+        id = 0.0f;
+
+        if (config_.mtpa_inductance_difference > 0.0f) {
+            // Maximum torque per amp for salient motors:
+            // Id = psi / (4 dL) - sqrt(psi^2 / (16 dL^2) + Iq^2 / 2)
+            float a = flux / (4.0f * config_.mtpa_inductance_difference);
+            id = a - std::sqrt(a * a + 0.5f * iq * iq);
+        }
+
+        if (config_.field_weakening_enable) {
+            // Push Id negative while the FOC runs out of voltage headroom
+            float utilization_err = config_.field_weakening_threshold - current_control_.modulation_utilization_;
+            field_weakening_id_ += config_.field_weakening_gain * utilization_err * current_meas_period;
+            field_weakening_id_ = std::clamp(field_weakening_id_, -config_.field_weakening_max_current, 0.0f);
+            id += field_weakening_id_;
+        }
+
+        // Id takes precedence, the remaining current is available for torque
+        id = std::clamp(id, -ilim, ilim);
+        float iq_lim = std::sqrt(std::max(SQ(ilim) - SQ(id), 0.0f));
+        iq = std::clamp(iq, -iq_lim, iq_lim);
+    } else {
+        field_weakening_id_ = 0.0f;
+    }
+
+    if (config_.motor_type == Motor::MOTOR_TYPE_HIGH_CURRENT && is_armed_) {
+        iq = apply_bus_current_limit(id, iq, phase_vel_src_.present().value_or(0.0f), flux);
+    }
+
     if (axis_->motor_.config_.motor_type != Motor::MOTOR_TYPE_GIMBAL) {
         Idq_setpoint_ = {id, iq};
     }
@@ -534,24 +1105,42 @@ void Motor::update(uint32_t timestamp) {
     // in this function.
     // A cleaner fix would be to take the feedforward calculation out of here
     // and turn it into a separate component.
-    MEASURE_TIME(axis_->task_times_.acim_estimator_update)
-        axis_->acim_estimator_.update(timestamp);
+    if (config_.motor_type == MOTOR_TYPE_ACIM) {
+        MEASURE_TIME(axis_->task_times_.acim_estimator_update)
+            axis_->acim_estimator_.update(timestamp);
+    }
 
     float vd = 0.0f;
     float vq = 0.0f;
 
     std::optional<float> phase_vel = phase_vel_src_.present();
 
+    if (rl_estimator_.config_.enable && config_.motor_type == MOTOR_TYPE_HIGH_CURRENT
+        && is_armed_ && control_law_ == &current_control_ && phase_vel.has_value()) {
+        float2D Vdq_last, Idq_last;
+        CRITICAL_SECTION() {
+            Vdq_last = current_control_.Vdq_last_;
+            Idq_last = current_control_.Idq_last_;
+        }
+        uint32_t n_updates = rl_estimator_.n_updates_;
+        rl_estimator_.update(Vdq_last.first, Vdq_last.second, Idq_last.first, Idq_last.second, *phase_vel, flux);
+        if (rl_estimator_.config_.update_gains && rl_estimator_.n_updates_ != n_updates) {
+            update_current_controller_gains();
+        }
+    }
+
     if (config_.R_wL_FF_enable) {
         if (!phase_vel.has_value()) {
             error_ |= ERROR_UNKNOWN_PHASE_VEL;
             return;
         }
 
-        vd -= *phase_vel * config_.phase_inductance * iq;
-        vq += *phase_vel * config_.phase_inductance * id;
-        vd += config_.phase_resistance * id;
-        vq += config_.phase_resistance * iq;
+        float phase_inductance = effective_phase_inductance();
+        float phase_resistance = effective_phase_resistance();
+        vd -= *phase_vel * phase_inductance * iq;
+        vq += *phase_vel * phase_inductance * id;
+        vd += phase_resistance * id;
+        vq += phase_resistance * iq;
     }
 
     if (config_.bEMF_FF_enable) {
@@ -560,7 +1149,7 @@ void Motor::update(uint32_t timestamp) {
             return;
         }
 
-        vq += *phase_vel * (2.0f/3.0f) * (config_.torque_constant / config_.pole_pairs);
+        vq += *phase_vel * flux;
     }
     
     if (axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_GIMBAL) {
@@ -572,10 +1161,33 @@ void Motor::update(uint32_t timestamp) {
 }
 
 
+/**
+ * @brief Adds the inverter voltage error back onto the PWM timings in the
+ * direction of each phase current.
+ *
+ * The timings are rising edge timings so a positive voltage correction
+ * shifts them to earlier.
+ */
+void Motor::apply_dead_time_compensation(float (&pwm_timings)[3]) {
+    if (!current_meas_.has_value()) {
+        return;
+    }
+
+    float timing_per_volt = 1.0f / vbus_voltage_filtered;
+    float k = config_.dead_time_comp_voltage * timing_per_volt;
+    float inv_current = 1.0f / std::max(config_.dead_time_comp_current, 0.001f);
+    float currents[3] = {current_meas_->phA, current_meas_->phB, current_meas_->phC};
+
+    for (size_t i = 0; i < 3; ++i) {
+        float comp = k * std::clamp(currents[i] * inv_current, -1.0f, 1.0f);
+        pwm_timings[i] = std::clamp(pwm_timings[i] - comp, 0.0f, 1.0f);
+    }
+}
+
 /**
  * @brief Called when the underlying hardware timer triggers an update event.
  */
-void Motor::current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current) {
+void Motor::current_meas_cb(const Measurement<Iph_ABC_t>& current) {
     // TODO: this is platform specific
     //const float current_meas_period = static_cast<float>(2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1)) / TIM_1_8_CLOCK_HZ;
     TaskTimerContext tmr{axis_->task_times_.current_sense};
@@ -587,21 +1199,32 @@ void Motor::current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current
                        && (abs(DC_calib_.phB) < max_dc_calib_)
                        && (abs(DC_calib_.phC) < max_dc_calib_);
 
-    if (current.has_value() && dc_calib_valid) {
+    if (current.has(Measurement<Iph_ABC_t>::kCurrentsValid) && dc_calib_valid) {
         current_meas_ = {
-            current->phA - DC_calib_.phA,
-            current->phB - DC_calib_.phB,
-            current->phC - DC_calib_.phC
+            current.currents.phA - DC_calib_.phA,
+            current.currents.phB - DC_calib_.phB,
+            current.currents.phC - DC_calib_.phC
         };
     } else {
         current_meas_ = std::nullopt;
     }
+    current_meas_timestamp_ = current.timestamp;
+}
 
-    // Run system-level checks (e.g. overvoltage/undervoltage condition)
-    // The motor might be disarmed in this function. In this case the
-    // handler will continue to run until the end but it won't have an
-    // effect on the PWM.
-    odrv.do_fast_checks();
+/**
+ * @brief Evaluates the checks of this motor that must run on every current
+ * measurement. Called once per cycle by ODrive::do_fast_checks() after
+ * current_meas_cb().
+ *
+ * @returns The errors that were found. They take effect in fast_checks_cb().
+ */
+Motor::Error Motor::fast_check() {
+    Error faults = ERROR_NONE;
+
+    gate_driver_.do_checks();
+    if (!gate_driver_.is_ready()) {
+        faults |= ERROR_DRV_FAULT;
+    }
 
     if (current_meas_.has_value()) {
         // Check for violation of current limit
@@ -615,21 +1238,40 @@ void Motor::current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current
         // Hack: we disable the current check during motor calibration because
         // it tends to briefly overshoot when the motor moves to align flux with I_alpha
         if (Inorm_sq > SQ(Itrip)) {
-            disarm_with_error(ERROR_CURRENT_LIMIT_VIOLATION);
+            faults |= ERROR_CURRENT_LIMIT_VIOLATION;
         }
     } else if (is_armed_) {
         // Since we can't check current limits, be safe for now and disarm.
         // Theoretically we could continue to operate if there is no active
         // current limit.
-        disarm_with_error(ERROR_UNKNOWN_CURRENT_MEASUREMENT);
+        faults |= ERROR_UNKNOWN_CURRENT_MEASUREMENT;
+    }
+
+    return faults;
+}
+
+/**
+ * @brief Applies the result of the fast checks and passes the current
+ * measurement on to the control law.
+ *
+ * The motor might already be disarmed at this point, e.g. by a system level
+ * check. In this case there is no control law and the measurement is dropped.
+ */
+void Motor::fast_checks_cb(Error faults) {
+    if (faults != ERROR_NONE) {
+        disarm_with_error(faults);
     }
 
     if (control_law_) {
-        Error err = control_law_->on_measurement(vbus_voltage,
-                            current_meas_.has_value() ?
-                                std::make_optional(std::array<float, 3>{current_meas_->phA, current_meas_->phB, current_meas_->phC})
-                                : std::nullopt,
-                            timestamp);
+        Measurement<std::array<float, 3>> meas;
+        meas.vbus_voltage = vbus_voltage_filtered;
+        meas.timestamp = current_meas_timestamp_;
+        meas.valid = Measurement<std::array<float, 3>>::kVbusValid;
+        if (current_meas_.has_value()) {
+            meas.currents = {current_meas_->phA, current_meas_->phB, current_meas_->phC};
+            meas.valid |= Measurement<std::array<float, 3>>::kCurrentsValid;
+        }
+        Error err = control_law_->on_measurement(meas);
         if (err != ERROR_NONE) {
             disarm_with_error(err);
         }
@@ -639,15 +1281,15 @@ void Motor::current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current
 /**
  * @brief Called when the underlying hardware timer triggers an update event.
  */
-void Motor::dc_calib_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current) {
-    const float dc_calib_period = static_cast<float>(2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1)) / TIM_1_8_CLOCK_HZ;
+void Motor::dc_calib_cb(const Measurement<Iph_ABC_t>& current) {
+    const float dc_calib_period = current_meas_period;
     TaskTimerContext tmr{axis_->task_times_.dc_calib};
 
-    if (current.has_value()) {
+    if (current.has(Measurement<Iph_ABC_t>::kCurrentsValid)) {
         const float calib_filter_k = std::min(dc_calib_period / config_.dc_calib_tau, 1.0f);
-        DC_calib_.phA += (current->phA - DC_calib_.phA) * calib_filter_k;
-        DC_calib_.phB += (current->phB - DC_calib_.phB) * calib_filter_k;
-        DC_calib_.phC += (current->phC - DC_calib_.phC) * calib_filter_k;
+        DC_calib_.phA += (current.currents.phA - DC_calib_.phA) * calib_filter_k;
+        DC_calib_.phB += (current.currents.phB - DC_calib_.phB) * calib_filter_k;
+        DC_calib_.phC += (current.currents.phC - DC_calib_.phC) * calib_filter_k;
         dc_calib_running_since_ += dc_calib_period;
     } else {
         DC_calib_.phA = 0.0f;
@@ -664,19 +1306,27 @@ void Motor::pwm_update_cb(uint32_t output_timestamp) {
 
     Error control_law_status = ERROR_CONTROLLER_FAILED;
     float pwm_timings[3] = {NAN, NAN, NAN};
-    std::optional<float> i_bus;
+    float i_bus = NAN; // stays NAN if unknown
 
     if (control_law_) {
-        control_law_status = control_law_->get_output(
-            output_timestamp, pwm_timings, &i_bus);
+        MEASURE_TIME(axis_->task_times_.current_controller_update) {
+            control_law_status = control_law_->get_output(
+                output_timestamp, pwm_timings, &i_bus);
+        }
     }
 
     // Apply control law to calculate PWM duty cycles
     if (is_armed_ && control_law_status == ERROR_NONE) {
+        // Not applied to the calibration control laws since they
+        // (partially) measure the inverter nonlinearity.
+        if (control_law_ == &current_control_ && config_.dead_time_comp_voltage > 0.0f) {
+            apply_dead_time_compensation(pwm_timings);
+        }
+
         uint16_t next_timings[] = {
-            (uint16_t)(pwm_timings[0] * (float)TIM_1_8_PERIOD_CLOCKS),
-            (uint16_t)(pwm_timings[1] * (float)TIM_1_8_PERIOD_CLOCKS),
-            (uint16_t)(pwm_timings[2] * (float)TIM_1_8_PERIOD_CLOCKS)
+            (uint16_t)(pwm_timings[0] * (float)pwm_period_clocks),
+            (uint16_t)(pwm_timings[1] * (float)pwm_period_clocks),
+            (uint16_t)(pwm_timings[2] * (float)pwm_period_clocks)
         };
 
         apply_pwm_timings(next_timings, false);
@@ -693,17 +1343,18 @@ void Motor::pwm_update_cb(uint32_t output_timestamp) {
     if (!is_armed_) {
         // If something above failed, reset I_bus to 0A.
         i_bus = 0.0f;
-    } else if (is_armed_ && !i_bus.has_value()) {
+    } else if (is_armed_ && is_nan(i_bus)) {
         // If the motor is armed then i_bus must be known
         disarm_with_error(ERROR_UNKNOWN_CURRENT_MEASUREMENT);
         i_bus = 0.0f;
     }
 
-    I_bus_ = *i_bus;
+    I_bus_ = i_bus;
 
-    if (*i_bus < config_.I_bus_hard_min || *i_bus > config_.I_bus_hard_max) {
+    if (i_bus < config_.I_bus_hard_min || i_bus > config_.I_bus_hard_max) {
         disarm_with_error(ERROR_I_BUS_OUT_OF_RANGE);
     }
 
-    update_brake_current();
+    // The bus current of both motors is checked by update_brake_current()
+    // once after all PWM updates, see ControlLoop_IRQHandler().
 }
@@ -6,10 +6,25 @@ class Motor;
 
 #include <board.h>
 #include <autogen/interfaces.hpp>
+#include "dirty_flags.hpp"
 #include "foc.hpp"
+#include "rl_estimator.hpp"
+#include "rl_identification.hpp"
+#include "ripple_canceller.hpp"
+#include "thermal_model.hpp"
+#include "torque_constant_map.hpp"
 
 class Motor : public ODriveIntf::MotorIntf {
 public:
+    static constexpr size_t INDUCTANCE_TABLE_SIZE = 4;
+    static constexpr size_t TORQUE_CONSTANT_TABLE_SIZE = 4;
+
+    // Derived quantities that the setters leave to apply_dirty_config()
+    enum DirtyFlag : uint32_t {
+        DIRTY_RL_ESTIMATOR = 1 << 0,
+        DIRTY_CURRENT_CONTROLLER_GAINS = 1 << 1,
+        DIRTY_TORQUE_CONSTANT_MAP = 1 << 2,
+    };
 
     // NOTE: for gimbal motors, all units of Nm are instead V.
     // example: vel_gain is [V/(turn/s)] instead of [Nm/(turn/s)]
@@ -19,10 +34,28 @@ public:
         int32_t pole_pairs = 7;
         float calibration_current = 10.0f;    // [A]
         float resistance_calib_max_voltage = 2.0f; // [V] - You may need to increase this if this voltage isn't sufficient to drive calibration_current through the motor.
-        float phase_inductance = 0.0f;        // to be set by measure_phase_inductance
-        float phase_resistance = 0.0f;        // to be set by measure_phase_resistance
+        float phase_inductance = 0.0f;        // to be set by measure_phase_rl
+        float phase_resistance = 0.0f;        // to be set by measure_phase_rl
+        float rl_identification_tolerance = 0.01f; // relative standard deviation of R and L at which measure_phase_rl stops
         float torque_constant = 0.04f;         // [Nm/A] for PM motors, [Nm/A^2] for induction motors. Equal to 8.27/Kv of the motor
         MotorType motor_type = MOTOR_TYPE_HIGH_CURRENT;
+        DeadlineMissPolicy deadline_miss_policy = DEADLINE_MISS_POLICY_DISARM;
+        ModulationMode modulation_mode = MODULATION_MODE_LINEAR;
+        CurrentControllerType current_controller_type = CURRENT_CONTROLLER_TYPE_PI;
+        float pwm_delay_compensation = 1.0f; // scales the phase extrapolation from the control timestamp to the PWM output
+        // Phase inductance at |Iq| = (i + 1) / INDUCTANCE_TABLE_SIZE * inductance_table_current
+        bool inductance_table_enable = false;
+        bool calibrate_inductance_table = false;
+        float inductance_table_current = 0.0f; // [A]
+        float inductance_table[INDUCTANCE_TABLE_SIZE] = {0.0f}; // [H]
+        // Torque constant over |Iq| for PM motors that saturate, replaces torque_constant if enabled
+        bool torque_constant_table_enable = false;
+        TorqueConstantMap<TORQUE_CONSTANT_TABLE_SIZE>::Point torque_constant_table[TORQUE_CONSTANT_TABLE_SIZE] = {}; // applied by set_torque_constant_table_enable()
+        float current_sense_gain[3] = {1.0f, 1.0f, 1.0f}; // correction factors per phase (A, B, C)
+        bool calibrate_current_sense_gains = false;
+        float dead_time_comp_voltage = 0.0f; // [V] set to 0 to disable dead time compensation
+        float dead_time_comp_current = 0.5f; // [A]
+        bool calibrate_dead_time = false;
         // Read out max_allowed_current to see max supported value for current_lim.
         // float current_lim = 70.0f; //[A]
         float current_lim = 10.0f;          //[A]
@@ -34,11 +67,20 @@ public:
         float inverter_temp_limit_lower = 100;
         float inverter_temp_limit_upper = 120;
 
+        float mtpa_inductance_difference = 0.0f; // [H] Lq - Ld, set to 0 to disable MTPA
+        bool field_weakening_enable = false;
+        float field_weakening_threshold = 0.9f; // fraction of the maximum modulation
+        float field_weakening_gain = 100.0f; // [A/s] per unit of modulation utilization error
+        float field_weakening_max_current = 10.0f; // [A]
+
         float acim_gain_min_flux = 10; // [A]
         float acim_autoflux_min_Id = 10; // [A]
         bool acim_autoflux_enable = false;
         float acim_autoflux_attack_gain = 10.0f;
         float acim_autoflux_decay_gain = 1.0f;
+        // Autoflux target from the loss model instead of |Iq|, see AcimLossModel
+        bool acim_min_loss_enable = false;
+        float acim_core_loss_coeff = 0.0f; // [W/(A^2*rad/s)] core loss per Id^2 and electrical velocity
         
         bool R_wL_FF_enable = false; // Enable feedforwards for R*I and w*L*I terms
         bool bEMF_FF_enable = false; // Enable feedforward for bEMF
@@ -48,6 +90,7 @@ public:
         float I_leak_max = 0.1f;
 
         float dc_calib_tau = 0.2f;
+        float gate_driver_readout_rate = 10.0f; // [Hz] rate of the non-blocking gate driver register readout, 0 to disable
 
         // custom property setters
         Motor* parent = nullptr;
@@ -55,9 +98,15 @@ public:
             pre_calibrated = value;
             parent->is_calibrated_ = parent->is_calibrated_ || parent->config_.pre_calibrated;
         }
-        void set_phase_inductance(float value) { phase_inductance = value; parent->update_current_controller_gains(); }
-        void set_phase_resistance(float value) { phase_resistance = value; parent->update_current_controller_gains(); }
-        void set_current_control_bandwidth(float value) { current_control_bandwidth = value; parent->update_current_controller_gains(); }
+        void set_phase_inductance(float value) { phase_inductance = value; parent->dirty_.mark(DIRTY_RL_ESTIMATOR | DIRTY_CURRENT_CONTROLLER_GAINS); }
+        void set_phase_resistance(float value) { phase_resistance = value; parent->dirty_.mark(DIRTY_RL_ESTIMATOR | DIRTY_CURRENT_CONTROLLER_GAINS); }
+        void set_current_control_bandwidth(float value) { current_control_bandwidth = value; parent->dirty_.mark(DIRTY_CURRENT_CONTROLLER_GAINS); }
+        void set_inductance_table_enable(bool value) { inductance_table_enable = value; parent->dirty_.mark(DIRTY_CURRENT_CONTROLLER_GAINS); }
+        void set_inductance_table_current(float value) { inductance_table_current = value; parent->dirty_.mark(DIRTY_CURRENT_CONTROLLER_GAINS); }
+        void set_torque_constant_table_enable(bool value) { torque_constant_table_enable = value; parent->dirty_.mark(DIRTY_TORQUE_CONSTANT_MAP); }
+        void set_modulation_mode(ModulationMode value) { modulation_mode = value; parent->current_control_.modulation_mode_ = value; }
+        void set_current_controller_type(CurrentControllerType value) { current_controller_type = value; parent->current_control_.current_controller_type_ = value; }
+        void set_pwm_delay_compensation(float value) { pwm_delay_compensation = value; parent->current_control_.pwm_delay_compensation_ = value; }
     };
 
     Motor(TIM_HandleTypeDef* timer,
@@ -72,23 +121,40 @@ public:
     void apply_pwm_timings(uint16_t timings[3], bool tentative);
     bool disarm(bool* was_armed = nullptr);
     bool apply_config();
+    void apply_dirty_config();
     bool setup();
 
     void update_current_controller_gains();
+    void update_torque_constant_map();
+    float torque_from_current(float current);
+    float current_from_torque(float torque);
+    bool record_torque_constant_point(float torque);
+    void reset_rl_estimator();
+    float effective_phase_resistance();
+    float effective_phase_inductance();
     void disarm_with_error(Error error);
+    void on_deadline_miss(uint32_t timestamp);
     bool do_checks(uint32_t timestamp);
+    void update_thermal_models();
     float effective_current_lim();
+    float apply_bus_current_limit(float id, float iq, float phase_vel, float flux);
     float max_available_torque();
-    std::optional<float> phase_current_from_adcval(uint32_t ADCValue);
-    bool measure_phase_resistance(float test_current, float max_voltage);
-    bool measure_phase_inductance(float test_voltage);
+    std::optional<float> phase_current_from_adcval(uint32_t ADCValue, size_t phase);
+    bool measure_phase_rl(float test_current, float max_voltage);
+    void calibrate_current_sense_gains(float Ialpha, float Ibeta);
+    bool measure_inductance_table(float test_current, float test_voltage);
+    bool measure_inductance_at_bias(float test_voltage, float bias_voltage, float* inductance);
+    bool measure_dead_time(float test_current, float max_voltage);
     bool run_calibration();
     void update(uint32_t timestamp);
 
     // These functions are called as appropriate from the board.cpp file.
-    void current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current);
-    void dc_calib_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current);
+    void current_meas_cb(const Measurement<Iph_ABC_t>& current);
+    Error fast_check();
+    void fast_checks_cb(Error faults);
+    void dc_calib_cb(const Measurement<Iph_ABC_t>& current);
     void pwm_update_cb(uint32_t output_timestamp);
+    void apply_dead_time_compensation(float (&pwm_timings)[3]);
 
     // hardware config
     TIM_HandleTypeDef* const timer_;
@@ -100,12 +166,15 @@ public:
     OffboardThermistorCurrentLimiter& motor_thermistor_;
 
     Config_t config_;
+    DirtyFlags dirty_; // see DirtyFlag
     Axis* axis_ = nullptr; // set by Axis constructor
 
 //private:
 
     uint32_t n_evt_current_measurement_ = 0;
     uint32_t n_evt_pwm_update_ = 0;
+    uint32_t deadline_miss_count_ = 0;
+    uint32_t last_deadline_miss_timestamp_ = 0;
 
     // variables exposed on protocol
     Error error_ = ERROR_NONE;
@@ -114,14 +183,26 @@ public:
     bool is_armed_ = false;
     bool is_calibrated_ = false; // Set in apply_config()
     std::optional<Iph_ABC_t> current_meas_;
+    uint32_t current_meas_timestamp_ = 0;
     Iph_ABC_t DC_calib_ = {0.0f, 0.0f, 0.0f};
     float dc_calib_running_since_ = 0.0f; // current sensor calibration needs some time to settle
     float I_bus_ = 0.0f; // this motors contribution to the bus current
+    float2D I_bus_limit_ = {-INFINITY, INFINITY}; // [A] min and max bus current for the next iteration, set by update_brake_current()
+    float field_weakening_id_ = 0.0f; // [A] state of the field weakening integrator
+    TorqueConstantMap<TORQUE_CONSTANT_TABLE_SIZE> torque_constant_map_; // copy of config_.torque_constant_table with precomputed slopes
+    bool torque_constant_map_active_ = false; // false if disabled or if the table is not valid
+    float phase_resistance_uncertainty_ = 0.0f; // [Ohm] standard deviation of the last phase_resistance measurement
+    float phase_inductance_uncertainty_ = 0.0f; // [H] standard deviation of the last phase_inductance measurement
     float phase_current_rev_gain_ = 0.0f; // Reverse gain for ADC to Amps (to be set by DRV8301_setup)
     FieldOrientedController current_control_;
+    RLEstimator rl_estimator_;
+    RippleCanceller ripple_canceller_;
+    ThermalModel motor_thermal_model_; // winding hot spot
+    ThermalModel fet_thermal_model_; // power stage hot spot
     float effective_current_lim_ = 10.0f; // [A]
     float max_allowed_current_ = 0.0f; // [A] set in setup()
     float max_dc_calib_ = 0.0f; // [A] set in setup()
+    float gate_driver_readout_phase_ = 0.0f; // counts up to 1 between two gate driver readouts
 
     InputPort<float> torque_setpoint_src_; // Usually points to the Controller object's output
     InputPort<float> phase_vel_src_; // Usually points to the Encoder object's output
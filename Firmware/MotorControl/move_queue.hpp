@@ -0,0 +1,169 @@
+#ifndef __MOVE_QUEUE_HPP
+#define __MOVE_QUEUE_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+
+#include "pvt_buffer.hpp"
+
+/**
+ * @brief Queue of point-to-point moves that are blended into one trajectory.
+ *
+ * Each move is a trapezoidal velocity profile to the next waypoint. Unlike
+ * INPUT_MODE_TRAP_TRAJ it doesn't stop at the waypoints: where two moves go
+ * in the same direction the trajectory passes the waypoint at the highest
+ * velocity from which it can still stop within the remaining queued moves
+ * (lookahead). It only stops at reversals and at the last waypoint.
+ *
+ * plan_next() turns the next move into the points at the boundaries of its
+ * acceleration, cruise and deceleration phases. The positions of these phases
+ * are polynomials of at most second order, so the cubic Hermite segments of
+ * PvtBuffer reproduce them exactly.
+ *
+ * There must only be one writer (push(), request_clear()) and one planner
+ * (all other functions). The planner may preempt the writer but not the
+ * other way around.
+ */
+template<size_t N>
+class MoveQueue {
+public:
+    static constexpr size_t kMaxPoints = 3; // per move
+
+    struct Limits {
+        float vel; // [turn/s]
+        float accel; // [turn/s^2]
+        float decel; // [turn/s^2]
+    };
+
+    /**
+     * @brief Appends a waypoint. Returns false if the queue is full.
+     */
+    bool push(float pos) {
+        size_t write = write_.load();
+        size_t next = (write + 1) % (N + 1);
+        if (next == read_.load()) {
+            return false;
+        }
+        waypoints_[write] = pos;
+        write_.store(next);
+        return true;
+    }
+
+    /**
+     * @brief Asks the planner to drop all moves that are not planned yet.
+     */
+    void request_clear() {
+        clear_requested_.store(true);
+    }
+
+    size_t level() const {
+        return (write_.load() + N + 1 - read_.load()) % (N + 1);
+    }
+
+    /**
+     * @brief Drops the queued moves if a clear was requested. Returns true in
+     * that case.
+     */
+    bool handle_clear_request() {
+        if (!clear_requested_.exchange(false)) {
+            return false;
+        }
+        read_.store(write_.load());
+        return true;
+    }
+
+    /**
+     * @brief Plans the next queued move and removes it from the queue.
+     *
+     * @param pos: End of the trajectory that was planned so far [turn],
+     *        advanced to the end of the move
+     * @param vel: Velocity at pos [turn/s], advanced like pos
+     * @param points: Receives the points of the move
+     * @returns the number of points, 0 if no move is queued
+     */
+    size_t plan_next(float* pos, float* vel, const Limits& limits, PvtPoint (&points)[kMaxPoints]) {
+        // Displacements of the queued moves, without the ones of length 0
+        float moves[N];
+        size_t n = 0;
+        size_t first = 0; // slot of the waypoint of the first move
+        float prev = *pos;
+        for (size_t i = read_.load(); i != write_.load(); i = (i + 1) % (N + 1)) {
+            if (waypoints_[i] != prev) {
+                if (n == 0) {
+                    first = i;
+                }
+                moves[n++] = waypoints_[i] - prev;
+            }
+            prev = waypoints_[i];
+        }
+        if (n == 0) {
+            read_.store(write_.load());
+            return 0;
+        }
+
+        // Backward pass: the fastest velocity at the end of the first move
+        // from which the trajectory can still stop at the last waypoint
+        float v_end = 0.0f;
+        for (size_t k = n - 1; k > 0; --k) {
+            bool same_direction = (moves[k - 1] > 0.0f) == (moves[k] > 0.0f);
+            v_end = same_direction
+                  ? std::min(limits.vel, std::sqrt(v_end * v_end + 2.0f * limits.decel * std::abs(moves[k])))
+                  : 0.0f;
+        }
+
+        float d = moves[0];
+        float s = d > 0.0f ? 1.0f : -1.0f;
+        float L = std::abs(d);
+        float v0 = s * *vel > 0.0f ? s * *vel : 0.0f;
+
+        // Forward pass: the end velocity must be reachable within the move
+        float v1 = std::min(v_end, std::sqrt(v0 * v0 + 2.0f * limits.accel * L));
+
+        // Peak velocity of the triangle profile, limited by the cruise velocity
+        float A = limits.accel;
+        float D = limits.decel;
+        float vp = std::sqrt((2.0f * A * D * L + D * v0 * v0 + A * v1 * v1) / (A + D));
+        vp = std::min(vp, limits.vel); // v1 <= vp since v1 <= v_end <= limits.vel
+
+        // The first ramp decelerates if the move starts above the velocity
+        // limit, e.g. because the limit was lowered
+        float a0 = vp >= v0 ? A : D;
+        float t0 = std::abs(vp - v0) / a0;
+        float d0 = 0.5f * (v0 + vp) * t0;
+        float t2 = (vp - v1) / D;
+        float d2 = 0.5f * (vp + v1) * t2;
+        float t1 = vp > 0.0f ? std::max(L - d0 - d2, 0.0f) / vp : 0.0f;
+
+        size_t count = 0;
+        if (t0 > 0.0f) {
+            points[count++] = {t0, *pos + s * d0, s * vp, 0.0f};
+        }
+        if (t1 > 0.0f) {
+            points[count++] = {t1, *pos + s * (L - d2), s * vp, 0.0f};
+        }
+        if (t2 > 0.0f || count == 0) {
+            points[count++] = {std::max(t2, 1e-6f), waypoints_[first], s * v1, 0.0f};
+        }
+        // No rounding errors at the waypoints
+        points[count - 1].pos = waypoints_[first];
+        points[count - 1].vel = s * v1;
+
+        // Remove the move from the queue, including the ones of length 0
+        // in front of it
+        read_.store((first + 1) % (N + 1));
+        *pos = waypoints_[first];
+        *vel = s * v1;
+        return count;
+    }
+
+private:
+    float waypoints_[N + 1]; // [turn] one slot stays empty to tell full from empty
+    std::atomic<size_t> read_ = 0;
+    std::atomic<size_t> write_ = 0;
+    std::atomic<bool> clear_requested_ = false;
+};
+
+#endif // __MOVE_QUEUE_HPP
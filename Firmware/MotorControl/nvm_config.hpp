@@ -1,14 +1,35 @@
 /*
 * Convenience functions to load and store multiple objects from and to NVM.
-* 
-* The NVM stores consecutive one-to-one copies of arbitrary objects.
-* The types of these objects are passed as template arguments to Config<Ts...>.
+*
+* The NVM is an append-only log of records, each of which holds a one-to-one
+* copy of one object. The configuration objects are identified by the order
+* in which they are passed to read() and stage(). Large calibration data
+* (blobs) is identified by a fixed blob number instead. Blobs have their own
+* version, so they survive changes of the configuration layout, and they are
+* only read when needed (see read_blob()).
+*
+* Sector layout:
+*  - sector header (magic number, generation), written last when the sector
+*    is filled, so a sector without a valid header is ignored
+*  - records (object ID, length, sequence number, version, CRC16, data),
+*    4 byte aligned
+*  - commit record (ID 0xfffe) after the records of each store operation
+*  - erased space
+*
+* A store operation only appends the objects that differ from their latest
+* committed record, followed by a commit record. Records of a store that was
+* interrupted before its commit record are ignored on load. When the sector
+* is full, all objects are written to the other sector, which was erased
+* beforehand, so the two sectors are erased in turn. Blobs that were not
+* staged are copied over from the old sector.
 */
 
 /* Includes ------------------------------------------------------------------*/
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <Drivers/STM32/stm32_nvm.h>
 #include <fibre/crc.hpp>
@@ -17,6 +38,11 @@
 /* Private defines -----------------------------------------------------------*/
 #define CONFIG_CRC16_INIT 0xabcd
 #define CONFIG_CRC16_POLYNOMIAL 0x3d65
+#define CONFIG_SECTOR_MAGIC 0x4643444fUL // "ODCF"
+#define CONFIG_MAX_OBJECTS 64
+#define CONFIG_MAX_BLOBS 8
+#define CONFIG_BLOB_ID_BASE (CONFIG_MAX_OBJECTS - CONFIG_MAX_BLOBS)
+#define CONFIG_COMMIT_ID 0xfffe
 
 /* Private macros ------------------------------------------------------------*/
 /* Private typedef -----------------------------------------------------------*/
@@ -25,7 +51,9 @@
 /* Private constant data -----------------------------------------------------*/
 
 // IMPORTANT: if you change, reorder or otherwise modify any of the fields in
-// the config structs without changing its total length, make sure to increment this number:
+// the config structs without changing its total length, or change the order
+// of the objects, make sure to increment this number. Blobs are versioned
+// separately by their owners.
 static constexpr uint16_t config_version = 0x0001;
 
 /* Private variables ---------------------------------------------------------*/
@@ -34,21 +62,33 @@ static constexpr uint16_t config_version = 0x0001;
 
 /**
  * @brief Manages configuration load and store operations from and to NVM
- * 
+ *
  * Usage:
  *  1. start_load()
  *  2. read() (as often needed)
- *  3. finish_load() (to see if all reads were successful and the CRC in the end is valid)
- * 
- *  1. prepare_store()
- *  2. write() (as often as needed)
- *  3. start_store()
- *  4. write() (same sequence as before)
- *  5. finish_store()
- * 
- * The two store passes are required in order to measure the size on the first
- * pass. If the size increases between the first and second pass, finish_store()
- * will return an error.
+ *  3. finish_load() (to see if all reads were successful and found a valid record)
+ *
+ *  1. start_staging()
+ *  2. stage() (same sequence as read()) and stage_blob() (for the blobs
+ *     that should be updated)
+ *  3. finish_staging()
+ *  4. store_staged()
+ *
+ * read_blob() can be called at any time after start_load() from the thread
+ * that stores. store_blob() writes a small blob right away, e.g. on a power
+ * loss, and must also be called from that thread.
+ *
+ * Staging copies the objects into a RAM buffer, so it is quick and the
+ * objects can be modified again right after. store_staged() compares the
+ * copies with the NVM and programs the changed ones. It can run in another
+ * thread.
+ *
+ * store_staged() never erases a sector. If the changed objects don't fit
+ * into the current sector, it writes all objects to the other sector, which
+ * must have been erased with erase_spare() before. Erasing stalls the CPU
+ * on any flash access for about a second, so the user decides when this is
+ * safe. needs_erase() tells whether the staged objects can't be stored
+ * without it.
  */
 class ConfigManager {
 public:
@@ -57,136 +97,491 @@ public:
      * way through a previous load operation.
      */
     bool start_load() {
-        if (NVM_init() != 0) {
+        if (!scan()) {
             return (load_state = kLoadStateFailed), false;
         }
-        load_offset = 0;
-        load_crc16 = CONFIG_CRC16_INIT ^ config_version;
+        load_index = 0;
+        load_size = 0;
         load_state = kLoadStateInProgress;
         return true;
     }
 
     /**
-     * @brief Loads the next chunk from NVM.
-     * Note that this may return true even if invalid data was read. The user
-     * will know the final verdict by the return value of finish_load().
+     * @brief Loads the next object from NVM.
+     * Fails if there is no committed record of the object or its size changed.
      */
     template<typename T>
     bool read(T* val) {
-        if (load_state != 1) {
+        if (load_state != kLoadStateInProgress) {
             return (load_state = kLoadStateFailed), false;
         }
-        size_t size = sizeof(T);
-        if (NVM_read(load_offset, (uint8_t *)val, size) != 0)
+        size_t id = load_index++;
+        if (id >= CONFIG_BLOB_ID_BASE || !read_record(id, config_version, (uint8_t*)val, sizeof(T))) {
             return (load_state = kLoadStateFailed), false;
-        load_crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(load_crc16, (uint8_t *)val, size);
-        load_offset += size;
+        }
+        load_size += sizeof(T);
         return true;
     }
 
+    /**
+     * @brief Loads a blob from NVM.
+     * Fails if there is no committed record of the blob or its size or
+     * version changed. In that case val is not modified.
+     */
+    template<typename T>
+    bool read_blob(size_t blob, uint16_t version, T* val) {
+        return blob < CONFIG_MAX_BLOBS
+            && read_record(CONFIG_BLOB_ID_BASE + blob, version, (uint8_t*)val, sizeof(T));
+    }
+
     /**
      * @brief Checks the final state of the load operation.
-     * If this function returns false, it is possible that previous read()
-     * operations actually returned garbage.
+     * If this function returns false, some of the objects may have been
+     * loaded and others not.
      */
     bool finish_load(size_t* occupied_size) {
         if (occupied_size) {
-            *occupied_size = load_offset + 2;
-        }
-
-        uint16_t crc16_calculated = load_crc16;
-        uint16_t crc16_loaded;
-        if (!read(&crc16_loaded)) {
-            return (load_state = kLoadStateFailed), false;
+            *occupied_size = load_size;
         }
-        bool result = (load_state == 1) && (crc16_loaded == crc16_calculated);
+        bool result = (load_state == kLoadStateInProgress);
         load_state = kLoadStateIdle;
         return result;
     }
 
     /**
-     * @brief Starts preparation of a new store operation.
+     * @brief Returns the size of the staging buffer that an object of the
+     * given size takes.
+     */
+    static constexpr size_t get_staged_size(size_t length) {
+        return (length + 3) & ~(size_t)3;
+    }
+
+    /**
+     * @brief Starts a new store operation.
+     * Fails if the previous one was staged but not stored yet.
      */
-    bool prepare_store() {
-        if (store_state != kStoreStateIdle) {
-            // it might be possible to restart the store process from other states but let's be safe
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_offset = 0;
-        store_crc16 = CONFIG_CRC16_INIT ^ config_version;
-        store_state = kStoreStatePreparing;
+    bool start_staging(uint8_t* buffer, size_t size) {
+        if (store_state == kStoreStateStaged) {
+            return false;
+        }
+        staging_buffer_ = buffer;
+        staging_size_ = size;
+        staging_offset_ = 0;
+        num_staged_ = 0;
+        for (Entry& entry: staged_) {
+            entry = {};
+        }
+        store_state = kStoreStateStaging;
         return true;
     }
 
     template<typename T>
-    bool write(T* val) {
-        if (store_state == kStoreStateInProgress) {
-            if (NVM_write(store_offset, (uint8_t*)val, sizeof(T)) != 0) {
-                return (store_state = kStoreStateFailed), false;
-            }
-        } else if (store_state != kStoreStatePreparing) {
-            return (store_state = kStoreStateFailed), false;
+    bool stage(const T* val) {
+        if (num_staged_ >= CONFIG_BLOB_ID_BASE) {
+            return (store_state = kStoreStateIdle), false;
         }
-        store_crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(store_crc16, (uint8_t *)val, sizeof(T));
-        store_offset += sizeof(T);
-        return true;
+        return stage_record(num_staged_++, config_version, (const uint8_t*)val, sizeof(T));
     }
 
     /**
-     * @brief Finishes the prepare pass and starts the actual store pass.
+     * @brief Stages a new version of a blob. Blobs that are not staged keep
+     * their latest committed record.
      */
-    bool start_store(size_t* occupied_size) {
-        if (occupied_size) {
-            *occupied_size = store_offset + 2;
+    template<typename T>
+    bool stage_blob(size_t blob, uint16_t version, const T* val) {
+        if (blob >= CONFIG_MAX_BLOBS) {
+            return (store_state = kStoreStateIdle), false;
         }
+        return stage_record(CONFIG_BLOB_ID_BASE + blob, version, (const uint8_t*)val, sizeof(T));
+    }
 
-        if (store_state != kStoreStatePreparing) {
-            return (store_state = kStoreStateFailed), false;
+    bool finish_staging() {
+        if (store_state != kStoreStateStaging) {
+            return (store_state = kStoreStateIdle), false;
         }
-        store_offset += 2; // account for CRC16
-        if (store_offset > NVM_get_max_write_length()) {
-            return (store_state = kStoreStateFailed), false;
+        store_state = kStoreStateStaged;
+        return true;
+    }
+
+    /**
+     * @brief Returns true if the staged objects can only be stored after
+     * erase_spare().
+     */
+    bool needs_erase() {
+        size_t changed_size, total_size;
+        return (store_state == kStoreStateStaged) && !spare_erased_
+            && !fits_in_sector(&changed_size, &total_size);
+    }
+
+    /**
+     * @brief Erases the sector that the next compaction writes to, unless it
+     * is erased already. This takes about a second.
+     */
+    bool erase_spare() {
+        if (spare_erased_) {
+            return true;
         }
-        if (NVM_start_write(store_offset) != 0) {
-            return (store_state = kStoreStateFailed), false;
+        if (NVM_erase_sector(get_spare_sector()) != 0) {
+            return false;
         }
-        store_offset = 0;
-        store_crc16 = CONFIG_CRC16_INIT ^ config_version;
-        store_state = kStoreStateInProgress;
+        spare_erased_ = true;
         return true;
     }
 
     /**
-     * @brief Commits the store operation.
+     * @brief Writes the staged objects that changed to NVM and commits them.
      * If this function succeeds, the new configuration was successfully saved.
      * If this function fails, the old configuration was not touched.
      */
-    bool finish_store() {
-        uint16_t crc16 = store_crc16;
-        if (!write(&crc16)) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        if (NVM_commit() != 0) {
-            return (store_state = kStoreStateFailed), false;
+    bool store_staged() {
+        if (store_state != kStoreStateStaged) {
+            return (store_state = kStoreStateIdle), false;
         }
+        // The staging buffer stays in use until the records are written
+        bool result = write_staged();
         store_state = kStoreStateIdle;
+        return result;
+    }
+
+    /**
+     * @brief Appends a new version of a blob and commits it right away,
+     * without staging. This never compacts and doesn't touch a store
+     * operation that is in progress. Fails if the record doesn't fit into
+     * the current sector, in which case the next save_configuration()
+     * compacts.
+     */
+    template<typename T>
+    bool store_blob(size_t blob, uint16_t version, const T* val) {
+        if (blob >= CONFIG_MAX_BLOBS
+            || record_size(sizeof(T)) + sizeof(RecordHeader) > get_free_space()) {
+            return false;
+        }
+        size_t id = CONFIG_BLOB_ID_BASE + blob;
+        for (Entry& entry: pending_) {
+            entry = {};
+        }
+        write_sector_ = active_;
+        store_sequence = next_sequence_++;
+        if (!write_record(id, version, (const uint8_t*)val, sizeof(T))
+            || !write_record(CONFIG_COMMIT_ID, 0, nullptr, 0)) {
+            return false;
+        }
+        committed_[id] = pending_[id];
         return true;
     }
 
+    /**
+     * @brief Returns the number of bytes that can still be appended to the
+     * current sector.
+     */
+    size_t get_free_space() {
+        return (active_ >= 0 && !dirty_) ? NVM_get_sector_size() - write_offset_ : 0;
+    }
+
     enum {
         kLoadStateIdle = 0,
         kLoadStateInProgress = 1,
         kLoadStateFailed = 2
     } load_state = kLoadStateIdle;
-    size_t load_offset;
-    size_t load_crc16;
+    size_t load_index;
+    size_t load_size;
 
     enum {
         kStoreStateIdle = 0,
-        kStoreStatePreparing = 1,
-        kStoreStateInProgress = 2,
-        kStoreStateFailed = 3
+        kStoreStateStaging = 1,
+        kStoreStateStaged = 2,
     } store_state = kStoreStateIdle;
-    size_t store_offset;
-    size_t store_crc16;
+    uint16_t store_sequence;
+
+private:
+    bool write_staged() {
+        size_t changed_size, total_size;
+        compacting_ = !fits_in_sector(&changed_size, &total_size);
+        if (!compacting_ && !changed_size) {
+            return true; // nothing changed
+        }
+        if (sizeof(SectorHeader) + total_size + sizeof(RecordHeader) > NVM_get_sector_size()) {
+            return false;
+        }
+
+        if (compacting_) {
+            if (!spare_erased_) {
+                return false;
+            }
+            write_sector_ = get_spare_sector();
+            write_offset_ = sizeof(SectorHeader);
+            dirty_ = true; // until the header of the new sector was written
+            spare_erased_ = false;
+        } else {
+            write_sector_ = active_;
+        }
+
+        for (Entry& entry: pending_) {
+            entry = {};
+        }
+        store_sequence = next_sequence_++;
+        for (size_t id = 0; id < CONFIG_MAX_OBJECTS; ++id) {
+            const Entry& entry = staged_[id];
+            if (entry.length) {
+                const uint8_t* data = staging_buffer_ + entry.offset;
+                if ((compacting_ || !is_unchanged(id, entry, data))
+                    && !write_record(id, entry.version, data, entry.length)) {
+                    return false;
+                }
+            } else if (compacting_ && is_kept_blob(id)) {
+                const Entry& old = committed_[id];
+                if (!write_record(id, old.version, record_data(active_, old), old.length)) {
+                    return false;
+                }
+            }
+        }
+        if (!write_record(CONFIG_COMMIT_ID, 0, nullptr, 0)) {
+            return false;
+        }
+
+        if (compacting_) {
+            SectorHeader header = {CONFIG_SECTOR_MAGIC, (active_ >= 0) ? generation_ + 1 : 1};
+            if (NVM_program(write_sector_, 0, (const uint8_t*)&header, sizeof(header)) != 0) {
+                return false;
+            }
+            generation_ = header.generation;
+            active_ = write_sector_;
+            dirty_ = false;
+            for (size_t i = 0; i < CONFIG_MAX_OBJECTS; ++i) {
+                committed_[i] = pending_[i];
+            }
+        } else {
+            for (size_t i = 0; i < CONFIG_MAX_OBJECTS; ++i) {
+                if (pending_[i].offset) {
+                    committed_[i] = pending_[i];
+                }
+            }
+        }
+        return true;
+    }
+
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t generation; // incremented each time a sector is filled
+    };
+
+    struct RecordHeader {
+        uint16_t id; // 0xffff: erased space
+        uint16_t length;
+        uint16_t sequence; // same for all records of one store operation
+        uint16_t version; // config_version or the version of the blob
+        uint16_t crc16; // of the fields above and the data
+        uint16_t reserved; // left erased
+    };
+
+    struct Entry {
+        uint32_t offset; // 0 if there is no record
+        uint16_t length; // 0 if the object is not staged
+        uint16_t version;
+    };
+
+    static size_t record_size(size_t length) {
+        return sizeof(RecordHeader) + ((length + 3) & ~(size_t)3);
+    }
+
+    static uint16_t record_crc(const RecordHeader& header, const uint8_t* data) {
+        uint16_t crc = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT,
+                (const uint8_t*)&header, offsetof(RecordHeader, crc16));
+        return calc_crc16<CONFIG_CRC16_POLYNOMIAL>(crc, data, header.length);
+    }
+
+    int get_spare_sector() {
+        return (active_ >= 0) ? (NVM_NUM_SECTORS - 1 - active_) : 0;
+    }
+
+    bool stage_record(size_t id, uint16_t version, const uint8_t* val, size_t length) {
+        if (store_state != kStoreStateStaging || staging_offset_ + length > staging_size_) {
+            return (store_state = kStoreStateIdle), false;
+        }
+        memcpy(staging_buffer_ + staging_offset_, val, length);
+        staged_[id] = {(uint32_t)staging_offset_, (uint16_t)length, version};
+        staging_offset_ += get_staged_size(length);
+        return true;
+    }
+
+    bool read_record(size_t id, uint16_t version, uint8_t* val, size_t length) {
+        const Entry& entry = committed_[id];
+        if (active_ < 0 || !entry.offset || entry.length != length || entry.version != version) {
+            return false;
+        }
+        memcpy(val, record_data(active_, entry), length);
+        return true;
+    }
+
+    // True for a blob that a compaction copies over from the current sector
+    bool is_kept_blob(size_t id) {
+        return id >= CONFIG_BLOB_ID_BASE && !staged_[id].length
+            && active_ >= 0 && committed_[id].offset;
+    }
+
+    /**
+     * @brief Sums up the space that the staged objects and the kept blobs
+     * take and checks if the changed ones can be appended to the current
+     * sector.
+     */
+    bool fits_in_sector(size_t* changed_size, size_t* total_size) {
+        *changed_size = 0;
+        *total_size = 0;
+        for (size_t id = 0; id < CONFIG_MAX_OBJECTS; ++id) {
+            const Entry& entry = staged_[id];
+            if (entry.length) {
+                size_t size = record_size(entry.length);
+                *total_size += size;
+                if (!is_unchanged(id, entry, staging_buffer_ + entry.offset)) {
+                    *changed_size += size;
+                }
+            } else if (is_kept_blob(id)) {
+                *total_size += record_size(committed_[id].length);
+            }
+        }
+        return (active_ >= 0) && !dirty_
+            && (write_offset_ + *changed_size + sizeof(RecordHeader) <= NVM_get_sector_size());
+    }
+
+    static const uint8_t* record_data(int sector, const Entry& entry) {
+        return NVM_get_sector(sector) + entry.offset + sizeof(RecordHeader);
+    }
+
+    bool is_unchanged(size_t id, const Entry& staged, const uint8_t* val) {
+        const Entry& entry = committed_[id];
+        return (active_ >= 0) && entry.offset && (entry.length == staged.length)
+            && (entry.version == staged.version)
+            && !memcmp(record_data(active_, entry), val, staged.length);
+    }
+
+    bool write_record(uint16_t id, uint16_t version, const uint8_t* data, size_t length) {
+        RecordHeader header = {id, (uint16_t)length, store_sequence, version, 0, 0xffff};
+        header.crc16 = record_crc(header, data);
+        uint32_t offset = write_offset_;
+
+        // Whatever happens, the space is used now
+        write_offset_ += record_size(length);
+        if (write_offset_ > NVM_get_sector_size()) {
+            return (dirty_ = true), false;
+        }
+        if (NVM_program(write_sector_, offset, (const uint8_t*)&header, sizeof(header)) != 0
+            || (length && NVM_program(write_sector_, offset + sizeof(header), data, length) != 0)) {
+            return (dirty_ = true), false;
+        }
+
+        if (id < CONFIG_MAX_OBJECTS) {
+            pending_[id] = {offset, (uint16_t)length, version};
+        }
+        return true;
+    }
+
+    /**
+     * @brief Finds the newest sector and the latest committed record of each
+     * object in it.
+     */
+    bool scan() {
+        size_t sector_size = NVM_get_sector_size();
+
+        active_ = -1;
+        for (int i = 0; i < NVM_NUM_SECTORS; ++i) {
+            const uint8_t* sector = NVM_get_sector(i);
+            if (!sector) {
+                return false;
+            }
+            SectorHeader header;
+            memcpy(&header, sector, sizeof(header));
+            if (header.magic == CONFIG_SECTOR_MAGIC
+                && (active_ < 0 || (int32_t)(header.generation - generation_) > 0)) {
+                active_ = i;
+                generation_ = header.generation;
+            }
+        }
+
+        for (size_t i = 0; i < CONFIG_MAX_OBJECTS; ++i) {
+            committed_[i] = {};
+            pending_[i] = {};
+        }
+        dirty_ = false;
+        write_offset_ = 0;
+
+        const uint8_t* spare = NVM_get_sector(get_spare_sector());
+        spare_erased_ = true;
+        for (size_t i = 0; i < sector_size && spare_erased_; i += 4) {
+            uint32_t word;
+            memcpy(&word, spare + i, sizeof(word));
+            spare_erased_ = (word == 0xffffffff);
+        }
+
+        if (active_ < 0) {
+            return true; // the NVM is empty
+        }
+
+        const uint8_t* sector = NVM_get_sector(active_);
+        uint32_t offset = sizeof(SectorHeader);
+        bool have_pending = false;
+        uint16_t pending_sequence = 0;
+
+        while (offset + sizeof(RecordHeader) <= sector_size) {
+            RecordHeader header;
+            memcpy(&header, sector + offset, sizeof(header));
+            const uint8_t* data = sector + offset + sizeof(header);
+
+            if (header.id == 0xffff && header.length == 0xffff && header.sequence == 0xffff
+                && header.version == 0xffff && header.crc16 == 0xffff) {
+                break; // end of the log
+            }
+            if ((header.id >= CONFIG_MAX_OBJECTS && header.id != CONFIG_COMMIT_ID)
+                || offset + record_size(header.length) > sector_size
+                || header.crc16 != record_crc(header, data)) {
+                // Interrupted write or data of an incompatible firmware. The
+                // next store starts from a freshly erased sector.
+                dirty_ = true;
+                break;
+            }
+
+            if (!have_pending || header.sequence != pending_sequence) {
+                // a new store operation, the previous one was not committed
+                for (Entry& entry: pending_) {
+                    entry = {};
+                }
+                pending_sequence = header.sequence;
+                have_pending = true;
+            }
+            next_sequence_ = header.sequence + 1;
+
+            if (header.id == CONFIG_COMMIT_ID) {
+                for (size_t i = 0; i < CONFIG_MAX_OBJECTS; ++i) {
+                    if (pending_[i].offset) {
+                        committed_[i] = pending_[i];
+                        pending_[i] = {};
+                    }
+                }
+                have_pending = false;
+            } else {
+                pending_[header.id] = {offset, header.length, header.version};
+            }
+
+            offset += record_size(header.length);
+        }
+
+        write_offset_ = offset;
+        return true;
+    }
+
+    int active_ = -1; // sector with the current configuration, -1 if none
+    uint32_t generation_ = 0;
+    bool dirty_ = false; // true if the current sector has garbage at its end
+    uint32_t write_offset_ = 0;
+    int write_sector_ = 0;
+    bool spare_erased_ = false;
+    bool compacting_ = false;
+    uint16_t next_sequence_ = 0;
+    Entry committed_[CONFIG_MAX_OBJECTS] = {};
+    Entry pending_[CONFIG_MAX_OBJECTS] = {};
+
+    uint8_t* staging_buffer_ = nullptr;
+    size_t staging_size_ = 0;
+    size_t staging_offset_ = 0;
+    size_t num_staged_ = 0;
+    Entry staged_[CONFIG_MAX_OBJECTS] = {}; // by object ID, offset into the staging buffer
 };
@@ -25,6 +25,19 @@ extern char serial_number_str[13];
 #ifdef __cplusplus
 }
 
+// Time since the system timer was started [us] at the end of each startup
+// phase, 0 until the phase is done
+typedef struct {
+    uint32_t config_loaded;
+    uint32_t board_initialized;
+    uint32_t scheduler_started;
+    uint32_t communication_started;
+    uint32_t encoders_ready;
+    uint32_t gate_drivers_ready;
+    uint32_t current_sensors_ready;
+    uint32_t fully_booted;
+} BootTimes_t;
+
 typedef struct {
     bool fully_booted;
     uint32_t uptime; // [ms]
@@ -47,10 +60,28 @@ typedef struct {
     int32_t prio_startup;
     int32_t prio_can;
 
+    // Shares of the CPU time over the last second (see vApplicationIdleHook())
+    float cpu_load;
+    float isr_load; // control loop and housekeeping interrupts
+    float cpu_usage_axis; // both axes, including the interrupts that preempted them
+    float cpu_usage_usb;
+    float cpu_usage_uart;
+    float cpu_usage_startup;
+    float cpu_usage_can;
+
+    BootTimes_t boot;
     USBStats_t& usb = usb_stats_;
     I2CStats_t& i2c = i2c_stats_;
+    IrqLatencyStats_t& irq_latency = irq_latency_stats_;
 } SystemStats_t;
 
+struct VbusStats_t {
+    float mean = 0.0f; // [V] low pass filtered with a time constant of 100 ms
+    float ripple_rms = 0.0f; // [V] RMS deviation of the raw measurement from the mean
+    float min = INFINITY; // [V] since the last reset
+    float max = -INFINITY; // [V]
+};
+
 struct PWMMapping_t {
     endpoint_ref_t endpoint;
     float min = 0;
@@ -104,16 +135,29 @@ struct BoardConfig_t {
 
     float dc_max_positive_current = INFINITY; // Max current [A] the power supply can source
     float dc_max_negative_current = -0.000001f; // Max current [A] the power supply can sink. You most likely want a non-positive value here. Set to -INFINITY to disable.
+    float vbus_filter_bandwidth = 0.0f; // [rad/s] of the vbus estimate used to compute the modulation, 0 to use the raw measurement
+    float calibration_bus_current_budget = INFINITY; // [A] estimated DC bus current that the calibrations of all axes may draw at the same time
+    bool enable_bus_current_limiter = false; // limit the torque of all axes ahead of time such that the DC bus current stays within the limits above
+    float bus_current_limiter_margin = 0.9f; // fraction of the DC bus current limits that the limiter aims for
+    float bus_current_limiter_voltage_range = 2.0f; // [V] regen (motoring) is ramped down to zero within this range below (above) the over (under) voltage trip level
     uint32_t error_gpio_pin = DEFAULT_ERROR_PIN;
+    float pwm_frequency = DEFAULT_PWM_FREQUENCY; // [Hz] applied on startup
+    float pwm_phase_offset = DEFAULT_PWM_PHASE_OFFSET; // [PWM periods] phase lead of M0 over M1, applied on startup
+    ODriveIntf::IrqPriorityProfile irq_priority_profile = ODriveIntf::IRQ_PRIORITY_PROFILE_CONTROL_LATENCY; // applied on startup
+    uint32_t oscilloscope_size = 4096; // [samples] taken from the arena on startup
     PWMMapping_t pwm_mappings[4];
     PWMMapping_t analog_mappings[GPIO_COUNT];
 };
 
 struct TaskTimes {
+    TaskTimer control_loop; // the whole control loop interrupt, including the timers below
     TaskTimer sampling;
     TaskTimer control_loop_misc;
+    TaskTimer fast_checks; // both axes
     TaskTimer control_loop_checks;
+    TaskTimer sensorless_estimator_update; // both axes
     TaskTimer dc_calib_wait;
+    TaskTimer housekeeping;
 };
 
 
@@ -150,6 +194,13 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 #include <mechanical_brake.hpp>
 #include <axis.hpp>
 #include <oscilloscope.hpp>
+#include <telemetry.hpp>
+#include <event_log.hpp>
+#include <protocol_stats.hpp>
+#include <operations.hpp>
+#include <pwm_sync.hpp>
+#include <kernel_benchmark.hpp>
+#include <arena.hpp>
 #include <communication/communication.h>
 
 // Defined in autogen/version.c based on git-derived version numbers
@@ -168,11 +219,20 @@ static Stm32Gpio get_gpio(size_t gpio_num) {
 class ODrive : public ODriveIntf {
 public:
     bool save_configuration() override;
+    uint32_t save_configuration_async() override;
     void erase_configuration() override;
+    bool read_config_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+    bool write_config_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+    bool apply_config_raw() override;
+    bool read_errors_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+    void load_calibration_data();
+    bool reserve_calibration_current(float current);
+    void release_calibration_current(float current);
     void reboot() override { NVIC_SystemReset(); }
     void enter_dfu_mode() override;
     bool any_error();
     void clear_errors() override;
+    void reset_vbus_stats();
 
     float get_adc_voltage(uint32_t gpio) override {
         return ::get_adc_voltage(get_gpio(gpio));
@@ -186,11 +246,22 @@ public:
     void do_fast_checks();
     void sampling_cb();
     void control_loop_cb(uint32_t timestamp);
+    void housekeeping_cb();
 
     Axis& get_axis(int num) { return axes[num]; }
     ODriveCAN& get_can() { return *odCAN; }
+    TraceBuffer& get_trace() { return trace_buffer; }
+    EventLog& get_event_log() { return event_log; }
+    ProtocolStats& get_protocol_stats() { return protocol_stats; }
+    Arena& get_arena() { return arena; }
+    uint8_t get_pwm_input_active() { return pwm0_input.get_active_channels(); }
+
+    float move_coordinated(float pos0, float pos1, float min_duration);
 
     uint32_t get_interrupt_status(int32_t irqn);
+    uint32_t get_interrupt_cycles(int32_t irqn);
+    uint32_t get_interrupt_max_cycles(int32_t irqn);
+    void reset_interrupt_max_cycles();
     uint32_t get_dma_status(uint8_t stream_num);
     uint32_t get_gpio_states();
     void disarm_with_error(Error error);
@@ -199,6 +270,8 @@ public:
     float& vbus_voltage_ = ::vbus_voltage; // TODO: make this the actual variable
     float& ibus_ = ::ibus_; // TODO: make this the actual variable
     float ibus_report_filter_k_ = 1.0f;
+    float& vbus_voltage_filtered_ = ::vbus_voltage_filtered; // used for the modulation, see config_.vbus_filter_bandwidth
+    VbusStats_t vbus_stats_;
 
     const uint64_t& serial_number_ = ::serial_number;
 
@@ -235,24 +308,38 @@ public:
 
     SystemStats_t system_stats_;
 
-    // Edit these to suit your capture needs
-    Oscilloscope oscilloscope_{
-        nullptr, // trigger_src
-        0.5f, // trigger_threshold
-        nullptr // data_src TODO: change data type
-    };
+    Oscilloscope oscilloscope_;
+    Telemetry telemetry_;
+    KernelBenchmark kernel_benchmark_;
+    Operations operations_;
+    PwmSync pwm_sync_;
 
     BoardConfig_t config_;
     uint32_t user_config_loaded_ = 0;
     bool misconfigured_ = false;
 
+    // Calibrations that currently draw current, see reserve_calibration_current()
+    uint32_t n_calibrations_running_ = 0;
+    float calibration_bus_current_ = 0.0f; // [A]
+
     uint32_t test_property_ = 0;
 
     uint32_t last_update_timestamp_ = 0;
     uint32_t n_evt_sampling_ = 0;
     uint32_t n_evt_control_loop_ = 0;
     bool task_timers_armed_ = false;
+    volatile uint32_t isr_cycles_ = 0; // CPU cycles spent in the control loop and housekeeping interrupts (modulo 2^32)
     TaskTimes task_times_;
+
+    // Trapezoidal moves that the control loop starts in the same iteration
+    struct CoordinatedMove {
+        bool active[AXIS_COUNT];
+        float goal[AXIS_COUNT]; // [turn]
+        float vel_limit[AXIS_COUNT]; // [turn/s]
+        float accel_limit[AXIS_COUNT]; // [turn/s^2]
+        float decel_limit[AXIS_COUNT]; // [turn/s^2]
+    };
+    Mailbox<CoordinatedMove> coordinated_move_;
 };
 
 extern ODrive odrv; // defined in main.cpp
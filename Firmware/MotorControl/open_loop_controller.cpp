@@ -3,6 +3,12 @@
 #include <board.h>
 
 void OpenLoopController::update(uint32_t timestamp) {
+    if (vf_mode_) {
+        update_vf((float)(timestamp - timestamp_) / (float)TIM_1_8_CLOCK_HZ);
+        timestamp_ = timestamp;
+        return;
+    }
+
     auto [prev_Id, prev_Iq] = Idq_setpoint_.previous().value_or(float2D{0.0f, 0.0f});
     auto [prev_Vd, prev_Vq] = Vdq_setpoint_.previous().value_or(float2D{0.0f, 0.0f});
     float phase = phase_.previous().value_or(initial_phase_);
@@ -28,3 +34,34 @@ void OpenLoopController::update(uint32_t timestamp) {
     total_distance_ = total_distance_.previous().value_or(0.0f) + phase_vel * dt;
     timestamp_ = timestamp;
 }
+
+void OpenLoopController::update_vf(float dt) {
+    float phase = phase_.previous().value_or(initial_phase_);
+    float voltage = Vdq_setpoint_.previous().value_or(float2D{0.0f, 0.0f}).first;
+    auto [Id, Iq] = Idq_measured_src_ ? *Idq_measured_src_ : float2D{0.0f, 0.0f};
+
+    // The voltage is on the d axis, so the air gap power is the input power
+    // V * Id minus the copper loss of the stator. It is zero at standstill,
+    // where the boost voltage only drives a DC current.
+    float I_sq = SQ(Id) + SQ(Iq);
+    float torque_current = voltage > 0.01f ? Id - phase_resistance_ * I_sq / voltage : 0.0f;
+    vf_torque_current_ += vf_slip_filter_k_ * (torque_current - vf_torque_current_);
+
+    // Above the current limit the ramp holds instead of pulling the motor
+    // further out of its slip range
+    bool accelerating = std::abs(target_vel_) > std::abs(vf_ramp_vel_) && target_vel_ * vf_ramp_vel_ >= 0.0f;
+    float ramp = !accelerating ? max_phase_vel_decel_
+               : I_sq > SQ(vf_current_lim_) ? 0.0f
+               : max_phase_vel_ramp_;
+    vf_ramp_vel_ = std::clamp(target_vel_, vf_ramp_vel_ - ramp * dt, vf_ramp_vel_ + ramp * dt);
+
+    // The rotor lags the field both ways, so the slip adds to the magnitude
+    float dir = (vf_ramp_vel_ > 0.0f) - (vf_ramp_vel_ < 0.0f);
+    float phase_vel = vf_ramp_vel_ + dir * vf_slip_gain_ * vf_torque_current_;
+
+    Idq_setpoint_ = {0.0f, 0.0f};
+    Vdq_setpoint_ = {std::min(vf_boost_voltage_ + vf_slope_ * std::abs(phase_vel), vf_max_voltage_), 0.0f};
+    phase_vel_ = phase_vel;
+    phase_ = wrap_pm_pi(phase + phase_vel * dt);
+    total_distance_ = total_distance_.previous().value_or(0.0f) + phase_vel * dt;
+}
@@ -5,6 +5,15 @@
 #include <cmath>
 #include <autogen/interfaces.hpp>
 
+/**
+ * @brief Ramps the current or voltage and the phase velocity towards their
+ * targets, for the lockin spin.
+ *
+ * In V/f mode (see Axis::run_vf_control()) the voltage follows the phase
+ * velocity instead: the boost voltage at standstill plus vf_slope_ per rad/s.
+ * The phase velocity is the ramp towards target_vel_ plus the slip of the
+ * torque producing current, which is estimated from the measured currents.
+ */
 class OpenLoopController : public ComponentBase {
 public:
     void update(uint32_t timestamp) final;
@@ -12,21 +21,37 @@ public:
     // Config
     float max_current_ramp_ = INFINITY; // [A/s]
     float max_voltage_ramp_ = INFINITY; // [V/s]
-    float max_phase_vel_ramp_ = INFINITY; // [rad/s^2]
+    float max_phase_vel_ramp_ = INFINITY; // [rad/s^2] in V/f mode only away from zero
+
+    bool vf_mode_ = false;
+    float max_phase_vel_decel_ = INFINITY; // [rad/s^2] towards zero
+    float vf_boost_voltage_ = 0.0f; // [V]
+    float vf_slope_ = 0.0f; // [V/(rad/s)]
+    float vf_max_voltage_ = 0.0f; // [V]
+    float vf_slip_gain_ = 0.0f; // [rad/s/A]
+    float vf_slip_filter_k_ = 1.0f; // per update
+    float vf_current_lim_ = INFINITY; // [A] the ramp doesn't move away from zero above this
+    float phase_resistance_ = 0.0f; // [Ohm]
 
     // Inputs
     float target_vel_ = 0.0f;
     float target_current_ = 0.0f;
     float target_voltage_ = 0.0f;
     float initial_phase_ = 0.0f;
+    const float2D* Idq_measured_src_ = nullptr; // [A] in the frame of phase_, V/f mode only
 
     // State/Outputs
     uint32_t timestamp_ = 0;
+    float vf_ramp_vel_ = 0.0f; // [rad/s] phase velocity without the slip
+    float vf_torque_current_ = 0.0f; // [A] filtered
     OutputPort<float2D> Idq_setpoint_ = {{0.0f, 0.0f}};
     OutputPort<float2D> Vdq_setpoint_ = {{0.0f, 0.0f}};
     OutputPort<float> phase_ = 0.0f;
     OutputPort<float> phase_vel_ = 0.0f;
     OutputPort<float> total_distance_ = 0.0f;
+
+private:
+    void update_vf(float dt);
 };
 
 #endif // __OPEN_LOOP_CONTROLLER_HPP
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "operations.hpp"
+#include <odrive_main.h>
+
+uint32_t Operations::start() {
+    uint32_t handle = 0;
+    CRITICAL_SECTION() {
+        // Take the oldest slot that is free or completed
+        Slot* slot = nullptr;
+        for (Slot& candidate: slots_) {
+            if (candidate.state != OPERATION_STATE_RUNNING && (!slot || candidate.handle < slot->handle)) {
+                slot = &candidate;
+            }
+        }
+        if (slot) {
+            handle = next_handle_++;
+            *slot = {handle, OPERATION_STATE_RUNNING, 0};
+        }
+    }
+    return handle;
+}
+
+void Operations::finish(uint32_t handle, bool success, uint32_t result) {
+    CRITICAL_SECTION() {
+        for (Slot& slot: slots_) {
+            if (slot.handle == handle && slot.state == OPERATION_STATE_RUNNING) {
+                slot.state = success ? OPERATION_STATE_SUCCEEDED : OPERATION_STATE_FAILED;
+                slot.result = result;
+                last_completed_ = handle;
+            }
+        }
+    }
+}
+
+const Operations::Slot* Operations::find(uint32_t handle) const {
+    for (const Slot& slot: slots_) {
+        if (handle && slot.handle == handle) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
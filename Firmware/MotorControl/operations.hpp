@@ -0,0 +1,46 @@
+#ifndef __OPERATIONS_HPP
+#define __OPERATIONS_HPP
+
+#include <stdint.h>
+#include <autogen/interfaces.hpp>
+
+#define OPERATIONS_SIZE 8 // operations whose status is kept
+
+/**
+ * @brief Status of the operations that the `*_async` functions start.
+ *
+ * Each operation gets a handle that is unique since boot (never 0). When it
+ * completes, its handle is stored in `last_completed`, so a host that
+ * subscribes to `last_completed` with on_change is notified instead of
+ * polling. The status of the OPERATIONS_SIZE most recent
+ * operations can be read with get_state() and get_result(). Running operations are never
+ * evicted, so start() fails if OPERATIONS_SIZE of them are running.
+ *
+ * start() and finish() can be called from any thread or interrupt.
+ */
+class Operations : public ODriveIntf::OperationsIntf {
+public:
+    // Returns the handle of a new running operation or 0 if all slots are
+    // taken by running operations.
+    uint32_t start();
+    void finish(uint32_t handle, bool success, uint32_t result);
+
+    OperationState get_state(uint32_t handle) { const Slot* slot = find(handle); return slot ? slot->state : OPERATION_STATE_UNKNOWN; }
+    uint32_t get_result(uint32_t handle) { const Slot* slot = find(handle); return slot ? slot->result : 0; }
+
+    uint32_t last_completed_ = 0;
+
+private:
+    struct Slot {
+        uint32_t handle;
+        OperationState state;
+        uint32_t result;
+    };
+
+    const Slot* find(uint32_t handle) const;
+
+    uint32_t next_handle_ = 1;
+    Slot slots_[OPERATIONS_SIZE] = {};
+};
+
+#endif // __OPERATIONS_HPP
@@ -1,27 +1,151 @@
 
 #include "oscilloscope.hpp"
+#include "odrive_main.h"
 
-// if you use the oscilloscope feature you can bump up this value
-#define OSCILLOSCOPE_SIZE 4096
+#include <algorithm>
 
-void Oscilloscope::update() {
-    float trigger_data = trigger_src_ ? *trigger_src_ : 0.0f;
-    float trigger_threshold = trigger_threshold_;
-    float sample_data = data_src_ ? **data_src_ : 0.0f;
-
-    if (trigger_data < trigger_threshold) {
-        ready_ = true;
-    }
-    if (ready_ && trigger_data >= trigger_threshold) {
-        capturing_ = true;
-        ready_ = false;
-    }
-    if (capturing_) {
-        if (pos_ < OSCILLOSCOPE_SIZE) {
-            data_[pos_++] = sample_data;
-        } else {
-            pos_ = 0;
-            capturing_ = false;
+/**
+ * @brief Sets the sample buffer. Must be called before the control loop
+ * starts.
+ */
+void Oscilloscope::init(float* buffer, size_t size) {
+    data_ = buffer;
+    size_ = buffer ? size : 0;
+}
+
+/**
+ * @brief Returns the samples in chronological order, starting with the oldest
+ * one that is still in the ring buffer.
+ */
+float Oscilloscope::get_val(uint32_t index) {
+    size_t k = index / num_channels_;
+    if (k >= num_samples_) {
+        return NAN;
+    }
+    size_t oldest = pos_ / num_channels_ + capacity_ - num_samples_;
+    return data_[((oldest + k) % capacity_) * num_channels_ + index % num_channels_];
+}
+
+/**
+ * @brief Returns as many samples as fit into the response, in the order of
+ * get_val() and as little endian floats.
+ *
+ * The request contains the offset in bytes, like the reads of the JSON
+ * endpoint, so the host can use the same chunked read for both. The response
+ * is empty past the last sample.
+ */
+bool Oscilloscope::read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    uint32_t end = num_samples_ * num_channels_;
+    for (uint32_t index = offset.value() / sizeof(float); index < end && output_buffer->size() >= sizeof(float); ++index) {
+        fibre::Codec<float>::encode(get_val(index), output_buffer);
+    }
+    return true;
+}
+
+/**
+ * @brief Takes over the configuration and starts recording. The trigger is
+ * taken as fired right away if `forced` is true.
+ *
+ * This runs in the protocol thread, which can be preempted by update() but
+ * not the other way around. The oscilloscope is therefore idle while the
+ * configuration is copied.
+ */
+void Oscilloscope::start(bool forced) {
+    state_ = CAPTURE_STATE_IDLE;
+
+    num_channels_ = std::clamp<uint32_t>(config_.num_channels, 1, OSCILLOSCOPE_MAX_CHANNELS);
+    for (size_t i = 0; i < num_channels_; ++i) {
+        channels_[i].resolve(config_.channels[i]);
+    }
+    trigger_src_.resolve(config_.trigger_src);
+    decimation_ = std::max<uint32_t>(config_.decimation, 1);
+    trigger_mode_ = config_.trigger_mode;
+    trigger_level_ = config_.trigger_level;
+    trigger_on_error_ = config_.trigger_on_error;
+    capacity_ = size_ / num_channels_;
+    pretrigger_samples_ = std::min((size_t)(std::clamp(config_.pretrigger, 0.0f, 1.0f) * (float)capacity_), capacity_ - 1);
+
+    trigger_ready_ = false;
+    had_error_ = odrv.any_error();
+    forced_ = forced;
+    decimation_count_ = 0;
+    num_samples_ = 0;
+    trigger_sample_ = 0;
+    pos_ = 0;
+
+    if (capacity_ > 0) {
+        state_ = CAPTURE_STATE_ARMED;
+    }
+}
+
+void Oscilloscope::sample() {
+    for (size_t i = 0; i < num_channels_; ++i) {
+        data_[pos_ + i] = channels_[i].read();
+    }
+    pos_ += num_channels_;
+    if (pos_ >= capacity_ * num_channels_) {
+        pos_ = 0;
+    }
+    if (num_samples_ < capacity_) {
+        num_samples_++;
+    }
+}
+
+bool Oscilloscope::check_trigger() {
+    bool triggered = forced_;
+
+    if (trigger_on_error_) {
+        bool error = odrv.any_error();
+        triggered = triggered || (error && !had_error_);
+        had_error_ = error;
+    }
+
+    if (trigger_mode_ != TRIGGER_MODE_SOFTWARE) {
+        float value = trigger_src_.read();
+        switch (trigger_mode_) {
+            case TRIGGER_MODE_RISING: {
+                triggered = triggered || (trigger_ready_ && value >= trigger_level_);
+                trigger_ready_ = value < trigger_level_;
+            } break;
+            case TRIGGER_MODE_FALLING: {
+                triggered = triggered || (trigger_ready_ && value <= trigger_level_);
+                trigger_ready_ = value > trigger_level_;
+            } break;
+            case TRIGGER_MODE_LEVEL: {
+                triggered = triggered || value >= trigger_level_;
+            } break;
+            default: break;
         }
     }
+
+    return triggered;
+}
+
+void Oscilloscope::update() {
+    if (state_ == CAPTURE_STATE_ARMED && check_trigger()) {
+        trigger_sample_ = std::min((size_t)num_samples_, pretrigger_samples_);
+        remaining_ = capacity_ - trigger_sample_;
+        // The trigger sample is taken right away, so the last sample before
+        // it can be less than one decimation period earlier.
+        decimation_count_ = decimation_ - 1;
+        state_ = CAPTURE_STATE_CAPTURING;
+    }
+
+    if (state_ != CAPTURE_STATE_ARMED && state_ != CAPTURE_STATE_CAPTURING) {
+        return;
+    }
+    if (++decimation_count_ < decimation_) {
+        return;
+    }
+    decimation_count_ = 0;
+    sample();
+
+    if (state_ == CAPTURE_STATE_CAPTURING && --remaining_ == 0) {
+        state_ = CAPTURE_STATE_DONE;
+    }
 }
@@ -2,30 +2,81 @@
 #define __OSCILLOSCOPE_HPP
 
 #include <autogen/interfaces.hpp>
+#include "endpoint_source.hpp"
 
-// if you use the oscilloscope feature you can bump up this value
-#define OSCILLOSCOPE_SIZE 4096
+#define OSCILLOSCOPE_MAX_CHANNELS 4
 
+/**
+ * @brief Records up to OSCILLOSCOPE_MAX_CHANNELS properties, which are selected
+ * at runtime by their endpoint, once every `decimation` control loop
+ * iterations.
+ *
+ * The samples of all channels share one buffer and are interleaved, that is
+ * get_val(k * num_channels + c) is sample k of channel c.
+ *
+ * The buffer is a ring that is written continuously from arm() on, so a
+ * capture also contains the `pretrigger` share of the buffer from before the
+ * trigger. Just like the trigger condition, any error of the ODrive can freeze
+ * the buffer, which makes the oscilloscope a crash recorder.
+ *
+ * The configuration is copied by arm(), so changing it during a capture only
+ * affects the next capture.
+ *
+ * The buffer is taken from the arena on startup (see init()). Without one the
+ * oscilloscope can't be armed.
+ */
 class Oscilloscope : public ODriveIntf::OscilloscopeIntf {
 public:
-    Oscilloscope(float* trigger_src, float trigger_threshold, float** data_src)
-        : trigger_src_(trigger_src), trigger_threshold_(trigger_threshold), data_src_(data_src) {}
+    struct Config_t {
+        uint32_t num_channels = 1;
+        endpoint_ref_t channels[OSCILLOSCOPE_MAX_CHANNELS];
+        uint32_t decimation = 1;
+        TriggerMode trigger_mode = TRIGGER_MODE_RISING;
+        endpoint_ref_t trigger_src;
+        float trigger_level = 0.5f;
+        float pretrigger = 0.0f; // share of the buffer before the trigger, in [0, 1]
+        bool trigger_on_error = false;
+    };
 
-    float get_val(uint32_t index) override {
-        return index < OSCILLOSCOPE_SIZE ? data_[index] : NAN;
-    }
+    void init(float* buffer, size_t size);
+
+    float get_val(uint32_t index) override;
+    bool read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+
+    void arm() override { start(false); }
+    void trigger() override { start(true); }
 
     void update();
 
-    const uint32_t size_ = OSCILLOSCOPE_SIZE;
-    const float* trigger_src_;
-    const float trigger_threshold_;
-    float* const * data_src_;
+    Config_t config_;
+    uint32_t size_ = 0;
+    CaptureState state_ = CAPTURE_STATE_IDLE;
+    uint32_t num_samples_ = 0; // samples per channel in the buffer
+    uint32_t trigger_sample_ = 0; // the sample that was taken when the trigger fired
+
+private:
+    void start(bool forced);
+    bool check_trigger();
+    void sample();
+
+    EndpointSource channels_[OSCILLOSCOPE_MAX_CHANNELS];
+    EndpointSource trigger_src_;
+    size_t num_channels_ = 1;
+    uint32_t decimation_ = 1;
+    TriggerMode trigger_mode_ = TRIGGER_MODE_RISING;
+    float trigger_level_ = 0.5f;
+    bool trigger_on_error_ = false;
+    size_t capacity_ = 0; // samples per channel
+    size_t pretrigger_samples_ = 0;
+
+    bool trigger_ready_ = false;
+    bool had_error_ = false;
+    bool forced_ = false;
+    uint32_t decimation_count_ = 0;
+    size_t remaining_ = 0; // samples left to take after the trigger
+    size_t pos_ = 0; // write index into data_
 
-    float data_[OSCILLOSCOPE_SIZE] = {0};
-    size_t pos_ = 0;
-    bool ready_ = false;
-    bool capturing_ = false;
+    float* data_ = nullptr; // size_ samples
 };
 
-#endif // __OSCILLOSCOPE_HPP
\ No newline at end of file
+#endif // __OSCILLOSCOPE_HPP
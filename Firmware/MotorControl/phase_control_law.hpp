@@ -4,6 +4,27 @@
 #include <autogen/interfaces.hpp>
 #include <variant>
 
+/**
+ * @brief A set of measurements as it is handed down the current sense ISR.
+ *
+ * The bits in `valid` tell which of the members hold a measurement. The
+ * others are undefined and must not be used.
+ */
+template<typename TCurrents>
+struct Measurement {
+    static constexpr uint8_t kVbusValid = 1 << 0;
+    static constexpr uint8_t kCurrentsValid = 1 << 1;
+
+    bool has(uint8_t flags) const { return (valid & flags) == flags; }
+
+    TCurrents currents; // [A]
+    float vbus_voltage; // [V]
+    uint32_t timestamp; // [HCLK ticks]
+    uint8_t valid = 0;
+};
+
+using AlphaBetaMeasurement = Measurement<float2D>;
+
 template<size_t N_PHASES>
 class PhaseControlLaw {
 public:
@@ -20,20 +41,14 @@ public:
      *
      * Beware that all inputs can be NAN.
      *
-     * @param vbus_voltage: The most recently measured DC link voltage. Can be
-     *        std::nullopt if the measurement is not available or valid for any
-     *        reason.
-     * @param currents: The most recently measured (or inferred) phase currents
-     *        in Amps. Can be std::nullopt if no valid measurements are available
-     *        (e.g. because the opamp isn't started or because the sensors were
-     *        saturated).
-     * @param input_timestamp: The timestamp (in HCLK ticks) corresponding to
-     *        the vbus_voltage and current measurement.
+     * @param meas: The most recently measured DC link voltage and the most
+     *        recently measured (or inferred) phase currents, together with
+     *        the timestamp (in HCLK ticks) at which they were measured.
+     *        Either of the measurements can be flagged invalid, e.g. because
+     *        the opamp isn't started or because the sensors were saturated.
      */
     virtual ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<std::array<float, N_PHASES>> currents,
-            uint32_t input_timestamp) = 0;
+            const Measurement<std::array<float, N_PHASES>>& meas) = 0;
 
     /**
      * @brief Shall calculate the PWM timings for the specified target time.
@@ -53,7 +68,8 @@ public:
      *        of an error.
      * @param ibus: The variable pointed to by this argument is set to the
      *        estimated DC current around the output timestamp when the desired
-     *        PWM timings get applied.
+     *        PWM timings get applied. It is NAN on entry and shall be left NAN
+     *        if the DC current is unknown.
      *        The function is not required to return a valid I_bus estimate in
      *        case of an error.
      * 
@@ -67,31 +83,33 @@ public:
     virtual ODriveIntf::MotorIntf::Error get_output(
             uint32_t output_timestamp,
             float (&pwm_timings)[N_PHASES],
-            std::optional<float>* ibus) = 0;
+            float* ibus) = 0;
 };
 
 class AlphaBetaFrameController : public PhaseControlLaw<3> {
+public:
+    // Determines how get_output() handles modulation vectors outside of the
+    // SVM hexagon.
+    ODriveIntf::MotorIntf::ModulationMode modulation_mode_ = ODriveIntf::MotorIntf::MODULATION_MODE_LINEAR;
+
 private:
     ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<std::array<float, 3>> currents,
-            uint32_t input_timestamp) final;
+            const Measurement<std::array<float, 3>>& meas) final;
 
     ODriveIntf::MotorIntf::Error get_output(
             uint32_t output_timestamp,
             float (&pwm_timings)[3],
-            std::optional<float>* ibus) final;
+            float* ibus) final;
 
 protected:
     virtual ODriveIntf::MotorIntf::Error on_measurement(
-            std::optional<float> vbus_voltage,
-            std::optional<float2D> Ialpha_beta,
-            uint32_t input_timestamp) = 0;
+            const AlphaBetaMeasurement& meas) = 0;
 
+    // mod_alpha_beta is NAN on entry and must be set if no error is returned.
     virtual ODriveIntf::MotorIntf::Error get_alpha_beta_output(
             uint32_t output_timestamp,
-            std::optional<float2D>* mod_alpha_beta,
-            std::optional<float>* ibus) = 0;
+            float2D* mod_alpha_beta,
+            float* ibus) = 0;
 };
 
 #endif // __PHASE_CONTROL_LAW_HPP
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef __PHASE_OFFSET_FIT_HPP
+#define __PHASE_OFFSET_FIT_HPP
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * @brief Straight line fit of the encoder count against the commanded
+ * electrical angle of an open loop scan.
+ *
+ *   count = offset + slope * angle
+ *
+ * The slope gives the direction and checks the CPR and pole pairs, the
+ * count at angle 0 is the phase offset. The means and co-moments are
+ * updated incrementally (Welford) so that single precision is sufficient
+ * even for large counts.
+ */
+class PhaseOffsetFit {
+public:
+    void reset() {
+        n_ = 0;
+        mean_angle_ = mean_count_ = 0.0f;
+        m_aa_ = m_ac_ = m_cc_ = 0.0f;
+    }
+
+    /**
+     * @param angle: Commanded electrical angle [rad]
+     * @param count: Encoder count (relative to any fixed reference)
+     */
+    void update(float angle, float count) {
+        n_++;
+        float d_angle = angle - mean_angle_;
+        float d_count = count - mean_count_;
+        mean_angle_ += d_angle / (float)n_;
+        mean_count_ += d_count / (float)n_;
+        m_aa_ += d_angle * (angle - mean_angle_);
+        m_ac_ += d_angle * (count - mean_count_);
+        m_cc_ += d_count * (count - mean_count_);
+    }
+
+    /**
+     * @brief Returns false as long as the samples don't span a range of
+     * angles.
+     */
+    bool is_valid() {
+        return n_ > 2 && m_aa_ > 0.0f;
+    }
+
+    float get_slope() { return m_ac_ / m_aa_; } // [count/rad]
+
+    // [count] fitted count at the specified angle
+    float get_count(float angle) {
+        return mean_count_ + get_slope() * (angle - mean_angle_);
+    }
+
+    // [count] standard error of get_count(angle)
+    float get_count_uncertainty(float angle) {
+        float d = angle - mean_angle_;
+        return std::sqrt(get_residual_variance() * (1.0f / (float)n_ + d * d / m_aa_));
+    }
+
+    uint32_t n_ = 0;
+
+private:
+    float get_residual_variance() {
+        float ss_res = std::max(m_cc_ - m_ac_ * m_ac_ / m_aa_, 0.0f);
+        return ss_res / (float)(n_ - 2);
+    }
+
+    float mean_angle_ = 0.0f; // [rad]
+    float mean_count_ = 0.0f; // [count]
+    float m_aa_ = 0.0f; // [rad^2] sum of squared deviations
+    float m_ac_ = 0.0f; // [rad*count]
+    float m_cc_ = 0.0f; // [count^2]
+};
+
+#endif // __PHASE_OFFSET_FIT_HPP
@@ -0,0 +1,61 @@
+#ifndef __POLY_TABLE_HPP
+#define __POLY_TABLE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+/**
+ * @brief Evaluates a polynomial on [0, 1] from a table with linear
+ * interpolation.
+ *
+ * The table is rebuilt whenever the coefficients differ from the ones it was
+ * built from, so they can be changed at runtime. Arguments outside of [0, 1]
+ * (including NaN) and polynomials with more than kMaxCoeffs coefficients are
+ * evaluated directly.
+ */
+class PolyTable {
+public:
+    static constexpr size_t kSize = 33;
+    static constexpr size_t kMaxCoeffs = 8;
+
+    /**
+     * @param coeffs: Coefficients, highest order first (like horner_poly_eval())
+     */
+    float eval(const float* coeffs, size_t num_coeffs, float x) {
+        if (!(x >= 0.0f && x <= 1.0f) || num_coeffs > kMaxCoeffs) {
+            return eval_poly(coeffs, num_coeffs, x);
+        }
+        if (num_coeffs != num_coeffs_ || memcmp(coeffs, coeffs_, num_coeffs * sizeof(float))) {
+            build(coeffs, num_coeffs);
+        }
+
+        float pos = x * (float)(kSize - 1);
+        size_t i = std::min((size_t)pos, kSize - 2);
+        float frac = pos - (float)i;
+        return table_[i] + frac * (table_[i + 1] - table_[i]);
+    }
+
+private:
+    static float eval_poly(const float* coeffs, size_t num_coeffs, float x) {
+        float result = 0.0f;
+        for (size_t i = 0; i < num_coeffs; ++i)
+            result = (result * x) + coeffs[i];
+        return result;
+    }
+
+    void build(const float* coeffs, size_t num_coeffs) {
+        memcpy(coeffs_, coeffs, num_coeffs * sizeof(float));
+        num_coeffs_ = num_coeffs;
+        for (size_t i = 0; i < kSize; ++i) {
+            table_[i] = eval_poly(coeffs, num_coeffs, (float)i / (float)(kSize - 1));
+        }
+    }
+
+    float table_[kSize] = {};
+    float coeffs_[kMaxCoeffs] = {};
+    size_t num_coeffs_ = SIZE_MAX; // no table yet
+};
+
+#endif // __POLY_TABLE_HPP
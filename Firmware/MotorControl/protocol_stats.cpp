@@ -0,0 +1,79 @@
+#include "protocol_stats.hpp"
+#include "odrive_main.h"
+
+#include <algorithm>
+
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+void fibre::record_endpoint_access(uint16_t endpoint_id, bool is_write) {
+    protocol_stats.record(endpoint_id, is_write);
+}
+#endif
+
+uint32_t ProtocolStats::read_channel_counter(Channel channel) {
+    switch (channel) {
+#if defined(USB_PROTOCOL_NATIVE) || defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
+        case CHANNEL_USB: return usb_channel.request_count_;
+#endif
+        case CHANNEL_UART: return uart_channel.request_count_;
+        case CHANNEL_I2C: return i2c1_channel.request_count_;
+        case CHANNEL_CAN: return odCAN ? odCAN->n_rx_frames_ : 0;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Updates the request rates about once per second. Called from the
+ * idle task.
+ */
+void ProtocolStats::update_rates() {
+    uint32_t now = HAL_GetTick();
+    uint32_t dt = now - last_tick_;
+    if (dt < 1000) {
+        return;
+    }
+    float* rates[CHANNEL_COUNT] = {&usb_rate_, &uart_rate_, &i2c_rate_, &can_rate_};
+    for (size_t i = 0; i < CHANNEL_COUNT; ++i) {
+        uint32_t count = read_channel_counter((Channel)i);
+        *rates[i] = (float)(count - last_counts_[i]) * 1000.0f / (float)dt;
+        last_counts_[i] = count;
+    }
+    last_tick_ = now;
+}
+
+void ProtocolStats::reset() {
+    for (size_t i = 0; i < CHANNEL_COUNT; ++i) {
+        reset_counts_[i] = read_channel_counter((Channel)i);
+    }
+    reset_tick_ = HAL_GetTick();
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+    std::fill(std::begin(counts_), std::end(counts_), Counts{0, 0});
+#endif
+}
+
+uint32_t ProtocolStats::get_time_since_reset() {
+    return HAL_GetTick() - reset_tick_;
+}
+
+/**
+ * @brief Returns as many bytes of the per-endpoint counters as fit into the
+ * response, as {uint16 reads, uint16 writes} per endpoint ID starting at 0.
+ *
+ * The request contains the offset in bytes, the same as for
+ * EventLog::read_raw(). The response is empty past the last endpoint, so it
+ * is always empty if the counters are not compiled in.
+ */
+bool ProtocolStats::read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    std::optional<uint32_t> offset = read_le<uint32_t>(input_buffer);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(counts_);
+    for (uint32_t pos = offset.value(); pos < sizeof(counts_) && !output_buffer->empty(); ++pos) {
+        *output_buffer->begin() = bytes[pos];
+        *output_buffer += 1;
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef __PROTOCOL_STATS_HPP
+#define __PROTOCOL_STATS_HPP
+
+#include <stdint.h>
+#include <autogen/interfaces.hpp>
+
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+#define PROTOCOL_STATS_NUM_ENDPOINTS 2048 // endpoints with a higher ID are not counted
+#else
+#define PROTOCOL_STATS_NUM_ENDPOINTS 0
+#endif
+
+/**
+ * @brief Counts the native protocol requests per endpoint and per channel, to
+ * find out which endpoints a host polls and how much of the bus they take.
+ *
+ * The per-endpoint counters are called from the fibre dispatch path (see
+ * fibre::record_endpoint_access()) and are only available if the firmware was
+ * built with CONFIG_ENDPOINT_STATS=true. They saturate at 65535. The channels
+ * can dispatch concurrently, so an access can get lost now and then.
+ *
+ * The per-channel request counts are always available. CAN has no fibre
+ * channel, so the received frames are counted instead. ASCII commands are not
+ * counted on any channel.
+ */
+class ProtocolStats : public ODriveIntf::ProtocolStatsIntf {
+public:
+    struct Counts {
+        uint16_t reads;
+        uint16_t writes;
+    };
+
+    void record(uint16_t endpoint_id, bool is_write) {
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+        if (endpoint_id >= PROTOCOL_STATS_NUM_ENDPOINTS) {
+            return;
+        }
+        uint16_t& counter = is_write ? counts_[endpoint_id].writes : counts_[endpoint_id].reads;
+        if (counter != UINT16_MAX) {
+            counter++;
+        }
+#else
+        (void)endpoint_id;
+        (void)is_write;
+#endif
+    }
+
+    void update_rates();
+    void reset() override;
+    bool read_raw(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) override;
+
+    uint32_t get_time_since_reset();
+    uint32_t get_usb_requests() { return get_request_count(CHANNEL_USB); }
+    uint32_t get_uart_requests() { return get_request_count(CHANNEL_UART); }
+    uint32_t get_i2c_requests() { return get_request_count(CHANNEL_I2C); }
+    uint32_t get_can_frames() { return get_request_count(CHANNEL_CAN); }
+
+    const uint32_t num_endpoints_ = PROTOCOL_STATS_NUM_ENDPOINTS;
+    float usb_rate_ = 0.0f; // [requests/s] over the last second
+    float uart_rate_ = 0.0f; // [requests/s] over the last second
+    float i2c_rate_ = 0.0f; // [requests/s] over the last second
+    float can_rate_ = 0.0f; // [frames/s] over the last second
+
+private:
+    enum Channel { CHANNEL_USB, CHANNEL_UART, CHANNEL_I2C, CHANNEL_CAN, CHANNEL_COUNT };
+
+    static uint32_t read_channel_counter(Channel channel);
+    uint32_t get_request_count(Channel channel) { return read_channel_counter(channel) - reset_counts_[channel]; }
+
+    uint32_t reset_tick_ = 0;
+    uint32_t reset_counts_[CHANNEL_COUNT] = {};
+    uint32_t last_tick_ = 0;
+    uint32_t last_counts_[CHANNEL_COUNT] = {};
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+    Counts counts_[PROTOCOL_STATS_NUM_ENDPOINTS] = {};
+#endif
+};
+
+extern ProtocolStats protocol_stats;
+
+#endif // __PROTOCOL_STATS_HPP
@@ -0,0 +1,154 @@
+#ifndef __PVT_BUFFER_HPP
+#define __PVT_BUFFER_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief One point of a streamed trajectory.
+ */
+struct PvtPoint {
+    float duration; // [s] time since the previous point
+    float pos; // [turn]
+    float vel; // [turn/s]
+    float torque; // [Nm] feedforward
+};
+
+/**
+ * @brief Ring buffer of trajectory points that are written by a communication
+ * thread and played back by the control loop.
+ *
+ * Between two points the position follows a cubic Hermite spline through the
+ * positions and velocities of both points, the torque is interpolated
+ * linearly.
+ *
+ * There must only be one writer (push(), request_clear()) and one reader
+ * (all other functions). The reader may preempt the writer but not the other
+ * way around.
+ *
+ * The storage is assigned once by init() before the buffer is used. Without
+ * it the buffer has a capacity of 0 and rejects all points.
+ */
+class PvtBuffer {
+public:
+    struct Step_t {
+        float pos; // [turn]
+        float vel; // [turn/s]
+        float accel; // [turn/s^2]
+        float torque; // [Nm]
+    };
+
+    /**
+     * @brief Uses `slots` points of storage, which holds slots - 1 points.
+     */
+    void init(PvtPoint* storage, size_t slots) {
+        if (storage && slots > 0) {
+            points_ = storage;
+            slots_ = slots;
+        }
+    }
+
+    size_t capacity() const { return slots_ - 1; }
+
+    /**
+     * @brief Appends a point. Returns false and counts an overrun if the
+     * buffer is full or the point is invalid.
+     */
+    bool push(const PvtPoint& point) {
+        size_t write = write_.load();
+        size_t next = (write + 1) % slots_;
+        if (next == read_.load() || !(point.duration > 0.0f)) {
+            overrun_count_++;
+            return false;
+        }
+        points_[write] = point;
+        write_.store(next);
+        return true;
+    }
+
+    /**
+     * @brief Asks the reader to drop all points at its next update. The
+     * output then stops where it was.
+     */
+    void request_clear() {
+        clear_requested_.store(true);
+    }
+
+    size_t level() const {
+        return (write_.load() + slots_ - read_.load()) % slots_;
+    }
+
+    /**
+     * @brief Sets the state from which the first point is approached.
+     */
+    void start(float pos, float vel, float torque) {
+        from_ = {0.0f, pos, vel, torque};
+        last_ = {pos, vel, 0.0f, torque};
+        t_ = 0.0f;
+    }
+
+    /**
+     * @brief Advances the playback by dt and returns the interpolated state.
+     *
+     * If the points run out while the last one has a nonzero velocity an
+     * underrun is counted. The output then stops at the last position and
+     * the next point is approached from standstill.
+     */
+    Step_t update(float dt) {
+        if (clear_requested_.exchange(false)) {
+            read_.store(write_.load());
+            from_ = {0.0f, last_.pos, 0.0f, last_.torque};
+            t_ = 0.0f;
+        }
+
+        t_ += dt;
+        while (read_.load() != write_.load() && t_ >= points_[read_.load()].duration) {
+            size_t read = read_.load();
+            t_ -= points_[read].duration;
+            from_ = points_[read];
+            read_.store((read + 1) % slots_);
+        }
+
+        if (read_.load() == write_.load()) {
+            if (from_.vel != 0.0f) {
+                from_.vel = 0.0f;
+                underrun_count_++;
+            }
+            t_ = 0.0f;
+            last_ = {from_.pos, 0.0f, 0.0f, from_.torque};
+            return last_;
+        }
+
+        const PvtPoint& to = points_[read_.load()];
+        float T = to.duration;
+        float s = t_ / T;
+        float dp = to.pos - from_.pos;
+        float h01 = (3.0f - 2.0f * s) * s * s; // h00 = 1 - h01
+        float pos = from_.pos + h01 * dp
+                  + T * (((s - 2.0f) * s + 1.0f) * s * from_.vel + (s - 1.0f) * s * s * to.vel);
+        float vel = 6.0f * (1.0f - s) * s * dp / T
+                  + ((3.0f * s - 4.0f) * s + 1.0f) * from_.vel + (3.0f * s - 2.0f) * s * to.vel;
+        float accel = ((6.0f - 12.0f * s) * dp / T + (6.0f * s - 4.0f) * from_.vel + (6.0f * s - 2.0f) * to.vel) / T;
+        float torque = from_.torque + s * (to.torque - from_.torque);
+        last_ = {pos, vel, accel, torque};
+        return last_;
+    }
+
+    uint32_t underrun_count_ = 0;
+    uint32_t overrun_count_ = 0;
+
+private:
+    PvtPoint empty_slot_ = {0.0f, 0.0f, 0.0f, 0.0f};
+    PvtPoint* points_ = &empty_slot_; // one slot stays empty to tell full from empty
+    size_t slots_ = 1;
+    std::atomic<size_t> read_ = 0;
+    std::atomic<size_t> write_ = 0;
+    std::atomic<bool> clear_requested_ = false;
+
+    PvtPoint from_ = {0.0f, 0.0f, 0.0f, 0.0f}; // last point that was passed
+    float t_ = 0.0f; // [s] time since from_
+    Step_t last_ = {0.0f, 0.0f, 0.0f, 0.0f}; // last output
+};
+
+#endif // __PVT_BUFFER_HPP
@@ -1,7 +1,10 @@
-
 #include "pwm_input.hpp"
 #include "odrive_main.h"
 
+static const uint32_t channel_ids[] = {TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3, TIM_CHANNEL_4};
+static const uint16_t dma_ids[] = {TIM_DMA_ID_CC1, TIM_DMA_ID_CC2, TIM_DMA_ID_CC3, TIM_DMA_ID_CC4};
+static const uint32_t dma_sources[] = {TIM_DMA_CC1, TIM_DMA_CC2, TIM_DMA_CC3, TIM_DMA_CC4};
+
 void PwmInput::init() {
     TIM_IC_InitTypeDef sConfigIC;
     sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
@@ -9,13 +12,23 @@ void PwmInput::init() {
     sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
     sConfigIC.ICFilter = 15;
 
-    uint32_t channels[] = {TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3, TIM_CHANNEL_4};
+    volatile uint32_t* ccrs[] = {&htim_->Instance->CCR1, &htim_->Instance->CCR2, &htim_->Instance->CCR3, &htim_->Instance->CCR4};
 
     for (size_t i = 0; i < 4; ++i) {
         if (!fibre::is_endpoint_ref_valid(odrv.config_.pwm_mappings[i].endpoint))
             continue;
-        HAL_TIM_IC_ConfigChannel(htim_, &sConfigIC, channels[i]);
-        HAL_TIM_IC_Start_IT(htim_, channels[i]);
+        if (!get_gpio(gpios_[i]))
+            continue;
+        channels_[i].enabled = true;
+        HAL_TIM_IC_ConfigChannel(htim_, &sConfigIC, channel_ids[i]);
+
+        if (DMA_HandleTypeDef* hdma = htim_->hdma[dma_ids[i]]) {
+            HAL_DMA_Start(hdma, (uint32_t)ccrs[i], (uint32_t)channels_[i].timestamps, kBufferSize);
+            __HAL_TIM_ENABLE_DMA(htim_, dma_sources[i]);
+            HAL_TIM_IC_Start(htim_, channel_ids[i]);
+        } else {
+            HAL_TIM_IC_Start_IT(htim_, channel_ids[i]);
+        }
     }
 }
 
@@ -25,14 +38,17 @@ void PwmInput::init() {
 #define PWM_MAX_HIGH_TIME          ((TIM_2_5_CLOCK_HZ / 1000000UL) * 2000UL) // 2ms high is considered full forward
 #define PWM_MIN_LEGAL_HIGH_TIME    ((TIM_2_5_CLOCK_HZ / 1000000UL) * 500UL) // ignore high periods shorter than 0.5ms
 #define PWM_MAX_LEGAL_HIGH_TIME    ((TIM_2_5_CLOCK_HZ / 1000000UL) * 2500UL) // ignore high periods longer than 2.5ms
+#define PWM_CAPTURE_DELAY          ((TIM_2_5_CLOCK_HZ / 1000000UL) * 5UL) // the input filter delays the capture by 256 timer clocks (3us)
+#define PWM_TIMEOUT                ((TIM_2_5_CLOCK_HZ / 1000000UL) * 100000UL) // the signal is lost after 100ms without a valid pulse
 #define PWM_INVERT_INPUT        false
 
 /**
  * @param channel: A channel number in [0, 3]
+ * @returns true if the pulse was valid and applied to the mapped endpoint
  */
-void handle_pulse(int channel, uint32_t high_time) {
+static bool handle_pulse(int channel, uint32_t high_time) {
     if (high_time < PWM_MIN_LEGAL_HIGH_TIME || high_time > PWM_MAX_LEGAL_HIGH_TIME)
-        return;
+        return false;
 
     if (high_time < PWM_MIN_HIGH_TIME)
         high_time = PWM_MIN_HIGH_TIME;
@@ -43,32 +59,17 @@ void handle_pulse(int channel, uint32_t high_time) {
                   (fraction * (odrv.config_.pwm_mappings[channel].max - odrv.config_.pwm_mappings[channel].min));
 
     fibre::set_endpoint_from_float(odrv.config_.pwm_mappings[channel].endpoint, value);
+    return true;
 }
 
 /**
  * @param channel: A channel number in [0, 3]
  */
-void PwmInput::on_capture(int channel, uint32_t timestamp) {
-    static uint32_t last_timestamp[4] = { 0 };
-    static bool last_pin_state[4] = { false };
-    static bool last_sample_valid[4] = { false };
-
-    if (channel >= 4)
-        return;
-    Stm32Gpio gpio = get_gpio(gpios_[channel]);
-    if (!gpio)
-        return;
-    bool current_pin_state = gpio.read();
-
-    if (last_sample_valid[channel]
-        && (last_pin_state[channel] != PWM_INVERT_INPUT)
-        && (current_pin_state == PWM_INVERT_INPUT)) {
-        handle_pulse(channel, timestamp - last_timestamp[channel]);
-    }
-
-    last_timestamp[channel] = timestamp;
-    last_pin_state[channel] = current_pin_state;
-    last_sample_valid[channel] = true;
+void PwmInput::on_capture(size_t channel, uint32_t timestamp) {
+    Channel& ch = channels_[channel];
+    size_t pos = ch.write_pos;
+    ch.timestamps[pos] = timestamp;
+    ch.write_pos = (pos + 1) % kBufferSize;
 }
 
 void PwmInput::on_capture() {
@@ -89,3 +90,68 @@ void PwmInput::on_capture() {
         on_capture(3, htim_->Instance->CCR4);
     }
 }
+
+// @brief Returns the buffer position where the next edge will be stored.
+size_t PwmInput::get_write_pos(size_t channel) {
+    if (DMA_HandleTypeDef* hdma = htim_->hdma[dma_ids[channel]]) {
+        return (kBufferSize - __HAL_DMA_GET_COUNTER(hdma)) % kBufferSize;
+    }
+    return channels_[channel].write_pos;
+}
+
+// @brief Latches the pin level that belongs to the edge before write_pos.
+// The capture lags the pin by the input filter delay, so if an edge shows up
+// shortly after reading the pin, the level may be newer than the buffer and
+// the lock is retried on the next edge.
+bool PwmInput::lock(size_t channel, size_t write_pos) {
+    Channel& ch = channels_[channel];
+    ch.read_pos = write_pos;
+
+    uint32_t start = htim_->Instance->CNT;
+    bool level = get_gpio(gpios_[channel]).read();
+    while (htim_->Instance->CNT - start < PWM_CAPTURE_DELAY) {}
+    if (get_write_pos(channel) != write_pos)
+        return false;
+
+    ch.level = level;
+    ch.last_edge_valid = false;
+    ch.locked = true;
+    return true;
+}
+
+// @brief Decodes the edges that were captured since the last call and feeds
+// the pulses to the mapped endpoints. Called at low priority.
+void PwmInput::update() {
+    for (size_t i = 0; i < 4; ++i) {
+        Channel& ch = channels_[i];
+        if (!ch.enabled)
+            continue;
+
+        size_t write_pos = get_write_pos(i);
+        uint32_t now = htim_->Instance->CNT; // not older than the buffered edges
+
+        if (!ch.locked) {
+            if (write_pos == ch.read_pos || !lock(i, write_pos))
+                continue;
+            ch.last_pulse = now;
+        }
+
+        for (; ch.read_pos != write_pos; ch.read_pos = (ch.read_pos + 1) % kBufferSize) {
+            uint32_t timestamp = ch.timestamps[ch.read_pos];
+            ch.level = !ch.level;
+            if (ch.last_edge_valid && (ch.level == PWM_INVERT_INPUT)
+                && handle_pulse(i, timestamp - ch.last_edge)) {
+                ch.last_pulse = timestamp;
+                active_channels_ |= (1 << i);
+            }
+            ch.last_edge = timestamp;
+            ch.last_edge_valid = true;
+        }
+
+        // Without pulses the channel is locked again on the next edge
+        if (now - ch.last_pulse > PWM_TIMEOUT) {
+            active_channels_ &= ~(1 << i);
+            ch.locked = false;
+        }
+    }
+}
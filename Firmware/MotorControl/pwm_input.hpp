@@ -4,6 +4,18 @@
 #include <tim.h>
 #include <array>
 
+/**
+ * @brief Decodes RC PWM signals on the four input capture channels of a timer.
+ *
+ * The capture timestamps of both edges of each channel go into a ring buffer.
+ * Channels that have a DMA handle linked to the timer handle are captured by
+ * the DMA in circular mode without any interrupt. The other channels are
+ * captured by on_capture(), which does nothing but store the timestamp.
+ *
+ * The pulses are decoded in update(), at low priority. Since the buffer only
+ * holds timestamps, the edge polarity is derived from the pin level once
+ * (see lock()) and from there on alternates with each edge.
+ */
 class PwmInput {
 public:
     PwmInput(TIM_HandleTypeDef* htim, std::array<uint16_t, 4> gpios)
@@ -11,12 +23,35 @@ public:
 
     void init();
     void on_capture();
+    void update();
+
+    // Bit i is set while channel i receives valid pulses
+    uint8_t get_active_channels() { return active_channels_; }
 
 private:
-    void on_capture(int channel, uint32_t timestamp);
+    // Must be even so that the edge polarity survives a buffer overrun
+    static constexpr size_t kBufferSize = 16;
+
+    struct Channel {
+        volatile uint32_t timestamps[kBufferSize]; // written by the DMA or on_capture()
+        volatile size_t write_pos = 0; // only used if the channel has no DMA
+        size_t read_pos = 0;
+        bool enabled = false;
+        bool locked = false; // true if level is known
+        bool level = false; // pin level after the edge before read_pos
+        bool last_edge_valid = false;
+        uint32_t last_edge = 0; // timestamp of the edge before read_pos
+        uint32_t last_pulse = 0; // timestamp of the end of the last valid pulse
+    };
+
+    void on_capture(size_t channel, uint32_t timestamp);
+    size_t get_write_pos(size_t channel);
+    bool lock(size_t channel, size_t write_pos);
 
     TIM_HandleTypeDef* htim_;
     std::array<uint16_t, 4> gpios_;
+    Channel channels_[4];
+    uint8_t active_channels_ = 0;
 };
 
-#endif // __PWM_INPUT_HPP
\ No newline at end of file
+#endif // __PWM_INPUT_HPP
@@ -0,0 +1,93 @@
+#include "pwm_sync.hpp"
+#include "odrive_main.h"
+
+#include <algorithm>
+#include <cmath>
+
+static void edge_cb_wrapper(void* ctx) {
+    reinterpret_cast<PwmSync*>(ctx)->on_edge();
+}
+
+// Looks for the GPIOs of the sync modes. Must run after the GPIOs were
+// initialized and before the PWM starts.
+void PwmSync::init() {
+    for (size_t i = 0; i < GPIO_COUNT; ++i) {
+        if (odrv.config_.gpio_modes[i] == ODriveIntf::GPIO_MODE_SYNC_OUT && !out_gpio_) {
+            out_gpio_ = get_gpio(i);
+            out_gpio_.write(false);
+        } else if (odrv.config_.gpio_modes[i] == ODriveIntf::GPIO_MODE_SYNC_IN && !in_gpio_) {
+            in_gpio_ = get_gpio(i);
+        } else if (odrv.config_.gpio_modes[i] == ODriveIntf::GPIO_MODE_SYNC_OUT
+                || odrv.config_.gpio_modes[i] == ODriveIntf::GPIO_MODE_SYNC_IN) {
+            odrv.misconfigured_ = true; // only one GPIO per direction
+        }
+    }
+    if (in_gpio_ && !in_gpio_.subscribe(true, false, edge_cb_wrapper, this)) {
+        in_gpio_ = Stm32Gpio::none;
+        odrv.misconfigured_ = true;
+    }
+    is_master_ = out_gpio_;
+    is_slave_ = in_gpio_;
+}
+
+// Called in the EXTI interrupt on the rising edge of the sync input
+void PwmSync::on_edge() {
+    edge_cyccnt_ = DWT->CYCCNT;
+    n_edges_ = n_edges_ + 1;
+}
+
+// Trims the period of the next control loop iteration like
+// TimeSync::update_phase_lock(). Called after every control loop iteration.
+void PwmSync::update() {
+    if (!is_slave_) {
+        return;
+    }
+
+    // TimeSync::update() ran before and wrote its own trim
+    pwm_period_trim = trim_;
+
+    uint32_t n_edges = n_edges_;
+    uint32_t edge = edge_cyccnt_;
+    if (n_edges == last_n_edges_) {
+        if (++periods_without_edge_ >= PWM_SYNC_TIMEOUT_PERIODS) {
+            is_locked_ = false;
+            n_pulses_in_lock_ = 0;
+            phase_ns_ = 0.0f;
+            phase_error_ = 0.0f;
+            pwm_period_trim = trim_ = 0;
+        }
+        return;
+    }
+    periods_without_edge_ = 0;
+    n_pulses_ += n_edges - last_n_edges_;
+    last_n_edges_ = n_edges;
+
+    // Offset of the edge from the middle of the local control loop period,
+    // wrapped to half a period in either direction
+    int32_t period = CONTROL_TIMER_PERIOD_TICKS;
+    int32_t phase = (int32_t)(edge - control_tick_cyccnt - (uint32_t)(period / 2)) % period;
+    if (phase >= period / 2) {
+        phase -= period;
+    } else if (phase < -period / 2) {
+        phase += period;
+    }
+
+    // The interrupt latency of the edge varies, the filter averages it out
+    float phase_ns = (float)phase * (1e9f / (float)TIM_1_8_CLOCK_HZ);
+    phase_ns_ += 0.1f * (phase_ns - phase_ns_);
+    phase_error_ = phase_ns_ * 1e-3f;
+
+    // A positive phase means that the local period started before the one
+    // of the master, so it is lengthened, and vice versa
+    trim_ = phase_ns_ > PWM_SYNC_DEADBAND_NS ? 1
+          : phase_ns_ < -PWM_SYNC_DEADBAND_NS ? -1 : 0;
+    pwm_period_trim = trim_;
+
+    if (std::abs(phase_ns_) < PWM_SYNC_LOCK_THRESHOLD_NS) {
+        n_pulses_in_lock_ = std::min<uint32_t>(n_pulses_in_lock_ + 1, PWM_SYNC_LOCK_PULSES);
+        is_locked_ = n_pulses_in_lock_ >= PWM_SYNC_LOCK_PULSES;
+    } else {
+        n_pulses_in_lock_ = 0;
+        is_locked_ = false;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef __PWM_SYNC_HPP
+#define __PWM_SYNC_HPP
+
+#include <stdint.h>
+#include <board.h>
+#include <autogen/interfaces.hpp>
+
+#define PWM_SYNC_DEADBAND_NS 100 // the PWM period is trimmed above this (filtered) phase error
+#define PWM_SYNC_LOCK_THRESHOLD_NS 500 // is_locked is set below this (filtered) phase error
+#define PWM_SYNC_LOCK_PULSES 100 // consecutive pulses within the threshold to set is_locked
+#define PWM_SYNC_TIMEOUT_PERIODS 10 // control loop periods without a pulse that clear is_locked
+
+/**
+ * @brief Phase-locks the PWM timers of several ODrives with a wire between
+ * their GPIOs, so that they sample the currents and update the PWM in the
+ * same instant like the two axes of one ODrive.
+ *
+ * The master has a GPIO in GPIO_MODE_SYNC_OUT, which goes high in the middle
+ * of each control loop period and low at the control loop tick. The slaves
+ * have a GPIO in GPIO_MODE_SYNC_IN and take the DWT cycle count of each
+ * rising edge in the EXTI interrupt. After every control loop iteration the
+ * offset of the edge from the middle of the local control loop period is
+ * low pass filtered and the control loop timer is trimmed by one tick per
+ * PWM half-period until it is below PWM_SYNC_DEADBAND_NS. The edge is in the
+ * middle of the period so that the EXTI interrupt doesn't wait for the
+ * sampling in the timer update interrupt.
+ *
+ * This uses the same trim as the phase lock of TimeSync and takes precedence
+ * over it while a GPIO is in GPIO_MODE_SYNC_IN.
+ */
+class PwmSync : public ODriveIntf::PwmSyncIntf {
+public:
+    void init();
+    void on_timer_update(bool counting_down) {
+        if (out_gpio_) {
+            out_gpio_.write(counting_down);
+        }
+    }
+    void on_edge();
+    void update();
+
+    bool is_master_ = false; // a GPIO is in GPIO_MODE_SYNC_OUT
+    bool is_slave_ = false; // a GPIO is in GPIO_MODE_SYNC_IN
+    bool is_locked_ = false;
+    float phase_error_ = 0.0f; // [us] filtered
+    uint32_t n_pulses_ = 0;
+
+private:
+    Stm32Gpio out_gpio_;
+    Stm32Gpio in_gpio_;
+    volatile uint32_t edge_cyccnt_ = 0;
+    volatile uint32_t n_edges_ = 0;
+    uint32_t last_n_edges_ = 0;
+    uint32_t periods_without_edge_ = 0;
+    uint32_t n_pulses_in_lock_ = 0;
+    float phase_ns_ = 0.0f; // filtered
+    int32_t trim_ = 0;
+};
+
+#endif // __PWM_SYNC_HPP
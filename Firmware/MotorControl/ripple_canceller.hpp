@@ -0,0 +1,141 @@
+#ifndef __RIPPLE_CANCELLER_HPP
+#define __RIPPLE_CANCELLER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Adaptive feedforward cancellation of the torque ripple at harmonics
+ * of the electrical phase.
+ *
+ * Flux harmonics and current sensor errors cause a torque ripple at fixed
+ * orders n of the electrical phase theta (e.g. 6 and 12 for the flux, 1 and 2
+ * for offset and gain errors of the current sensors). For each selected order
+ * the canceller injects
+ *
+ *   Iq = a * cos(n * theta) + b * sin(n * theta)
+ *
+ * and adapts a and b by LMS to remove that harmonic from the velocity error.
+ * The velocity of an inertia lags the torque by 90 degrees, and the control
+ * loop, the current controller and the velocity estimate add a delay, so the
+ * gradient uses the regressor shifted by both. The adaptation converges as
+ * long as the actual phase of the velocity response at the harmonic is
+ * within 90 degrees of this. That holds above the bandwidth of the velocity
+ * loop, which is why the canceller only fades in above a configured
+ * velocity, and below the bandwidth of the velocity estimate, which limits
+ * the useful orders at high velocities.
+ *
+ * The step size is scaled with the frequency of the harmonic, which makes the
+ * convergence time independent of the velocity: about
+ * 2 * inertia / (gain * torque_constant).
+ */
+class RippleCanceller {
+public:
+    static constexpr size_t kMaxHarmonics = 4;
+    static constexpr uint32_t kMaxOrder = 24;
+
+    struct Config_t {
+        bool enable = false;
+        uint32_t harmonics[kMaxHarmonics] = {1, 2, 6, 0}; // orders of the electrical phase, 0 for unused entries
+        float gain = 0.1f; // [A/(turn/s)] adaptation gain
+        float fade_in_vel = 5.0f; // [turn/s] velocity at which the compensation starts
+        float fade_in_range = 5.0f; // [turn/s] the compensation is complete this much above fade_in_vel
+        float max_current = 2.0f; // [A] limit of the amplitude of each harmonic
+        float delay = 250e-6f; // [s] from the Iq setpoint to the velocity estimate
+    };
+
+    // @brief Forgets the learned harmonics
+    void reset() {
+        for (size_t i = 0; i < kMaxHarmonics; ++i) {
+            a_[i] = 0.0f;
+            b_[i] = 0.0f;
+        }
+        iq_comp_ = 0.0f;
+    }
+
+    /**
+     * @brief Returns the compensating Iq [A] of this control loop iteration
+     * and adapts the harmonics to the velocity error.
+     *
+     * Below fade_in_vel the compensation is zero and the learned harmonics
+     * are kept for the next time.
+     *
+     * @param cos_phase, sin_phase: Cosine and sine of the electrical phase
+     * @param cos_delayed, sin_delayed: Cosine and sine of the electrical
+     *        phase config_.delay ago (phase - phase_vel * delay)
+     * @param phase_vel: Electrical velocity [rad/s]
+     * @param vel: Mechanical velocity [turn/s]
+     * @param vel_error: Velocity estimate minus setpoint [turn/s], positive
+     *        in the direction of positive Iq.
+     * @param dt: Time since the last update [s]
+     */
+    float update(float cos_phase, float sin_phase, float cos_delayed, float sin_delayed,
+                 float phase_vel, float vel, float vel_error, float dt) {
+        float fade = std::clamp((std::abs(vel) - config_.fade_in_vel) / std::max(config_.fade_in_range, 1e-6f), 0.0f, 1.0f);
+        if (!(fade > 0.0f)) {
+            iq_comp_ = 0.0f;
+            return 0.0f;
+        }
+
+        uint32_t max_order = 0;
+        for (size_t i = 0; i < kMaxHarmonics; ++i) {
+            if (config_.harmonics[i] <= kMaxOrder) {
+                max_order = std::max(max_order, config_.harmonics[i]);
+            }
+        }
+
+        // cos and sin of n * theta by rotating through the orders, which is
+        // cheaper than evaluating them for each harmonic
+        float c = 1.0f;
+        float s = 0.0f;
+        float c_delayed = 1.0f;
+        float s_delayed = 0.0f;
+        float iq = 0.0f;
+        float max_sq = config_.max_current * config_.max_current;
+        for (uint32_t n = 1; n <= max_order; ++n) {
+            float c_next = c * cos_phase - s * sin_phase;
+            s = s * cos_phase + c * sin_phase;
+            c = c_next;
+            c_next = c_delayed * cos_delayed - s_delayed * sin_delayed;
+            s_delayed = s_delayed * cos_delayed + c_delayed * sin_delayed;
+            c_delayed = c_next;
+            for (size_t i = 0; i < kMaxHarmonics; ++i) {
+                if (config_.harmonics[i] != n) {
+                    continue;
+                }
+                iq += a_[i] * c + b_[i] * s;
+
+                // The delayed regressor, also shifted by the 90 degrees of
+                // the inertia, which change sign with the direction
+                float k = config_.gain * (float)n * phase_vel * dt * fade;
+                a_[i] -= k * vel_error * s_delayed;
+                b_[i] += k * vel_error * c_delayed;
+                float amplitude_sq = a_[i] * a_[i] + b_[i] * b_[i];
+                if (amplitude_sq > max_sq) {
+                    float scale = std::sqrt(max_sq / amplitude_sq);
+                    a_[i] *= scale;
+                    b_[i] *= scale;
+                }
+            }
+        }
+
+        iq_comp_ = fade * iq;
+        return iq_comp_;
+    }
+
+    // @brief Amplitude [A] of the compensation of the harmonic with the index i
+    float get_amplitude(size_t i) {
+        return i < kMaxHarmonics ? std::sqrt(a_[i] * a_[i] + b_[i] * b_[i]) : 0.0f;
+    }
+
+    Config_t config_;
+    float iq_comp_ = 0.0f; // [A] output of the last update
+
+private:
+    float a_[kMaxHarmonics] = {}; // [A] cosine coefficients
+    float b_[kMaxHarmonics] = {}; // [A] sine coefficients
+};
+
+#endif // __RIPPLE_CANCELLER_HPP
@@ -0,0 +1,115 @@
+#ifndef __RL_ESTIMATOR_HPP
+#define __RL_ESTIMATOR_HPP
+
+#include <stdint.h>
+#include <cmath>
+
+/**
+ * @brief Online estimator for the phase resistance and inductance of a PM
+ * motor during closed loop operation.
+ *
+ * Uses recursive least squares on the steady state d/q voltage equations:
+ *   Vd = R * Id - w * L * Iq
+ *   Vq = R * Iq + w * L * Id + w * flux
+ *
+ * The parameters are normalized to the values that the estimator was reset
+ * with so that both have a similar magnitude. This keeps the covariance
+ * matrix well conditioned in single precision.
+ *
+ * The estimate includes everything that behaves like a series resistance
+ * (e.g. the inverter voltage error at low currents).
+ */
+class RLEstimator {
+public:
+    struct Config_t {
+        bool enable = false;
+        bool update_gains = false; // use the estimate for the current controller gains and feedforward
+        uint32_t decimation = 8; // run once every N control loop iterations
+        float forgetting_factor = 0.999f;
+        float min_current = 1.0f; // [A] no update below this current magnitude (insufficient excitation)
+    };
+
+    /**
+     * @brief Restarts the estimation from the specified values.
+     */
+    void reset(float resistance, float inductance) {
+        R0_ = resistance;
+        L0_ = inductance;
+        theta_[0] = 1.0f;
+        theta_[1] = 1.0f;
+        P_[0][0] = 1.0f; P_[0][1] = 0.0f;
+        P_[1][0] = 0.0f; P_[1][1] = 1.0f;
+        countdown_ = 0;
+    }
+
+    /**
+     * @brief Feeds one set of d/q measurements into the estimator.
+     *
+     * Must be called once per control loop iteration. Only every
+     * config_.decimation-th call is used.
+     *
+     * @param flux: Flux linkage of the permanent magnet [Wb]
+     */
+    void update(float Vd, float Vq, float Id, float Iq, float phase_vel, float flux) {
+        if (countdown_ > 0) {
+            countdown_--;
+            return;
+        }
+        countdown_ = config_.decimation > 0 ? config_.decimation - 1 : 0;
+
+        if (Id * Id + Iq * Iq < config_.min_current * config_.min_current) {
+            return;
+        }
+
+        update_rls(Vd, R0_ * Id, -phase_vel * L0_ * Iq);
+        update_rls(Vq - phase_vel * flux, R0_ * Iq, phase_vel * L0_ * Id);
+        n_updates_++;
+    }
+
+    float get_resistance() { return theta_[0] * R0_; }
+    float get_inductance() { return theta_[1] * L0_; }
+
+    Config_t config_;
+    uint32_t n_updates_ = 0;
+
+private:
+    void update_rls(float y, float phi0, float phi1) {
+        float lambda = config_.forgetting_factor;
+
+        float Pphi0 = P_[0][0] * phi0 + P_[0][1] * phi1;
+        float Pphi1 = P_[1][0] * phi0 + P_[1][1] * phi1;
+        float denom = lambda + phi0 * Pphi0 + phi1 * Pphi1;
+        if (!(denom > 0.0f)) {
+            return;
+        }
+
+        float K0 = Pphi0 / denom;
+        float K1 = Pphi1 / denom;
+        float err = y - (phi0 * theta_[0] + phi1 * theta_[1]);
+        theta_[0] += K0 * err;
+        theta_[1] += K1 * err;
+
+        // P = (P - K * phi^T * P) / lambda, using phi^T * P = (P * phi)^T
+        float inv_lambda = 1.0f / lambda;
+        P_[0][0] = (P_[0][0] - K0 * Pphi0) * inv_lambda;
+        P_[0][1] = (P_[0][1] - K0 * Pphi1) * inv_lambda;
+        P_[1][0] = (P_[1][0] - K1 * Pphi0) * inv_lambda;
+        P_[1][1] = (P_[1][1] - K1 * Pphi1) * inv_lambda;
+
+        // Limit covariance windup during periods of poor excitation
+        constexpr float P_max = 100.0f;
+        if (P_[0][0] + P_[1][1] > P_max) {
+            float k = P_max / (P_[0][0] + P_[1][1]);
+            P_[0][0] *= k; P_[0][1] *= k;
+            P_[1][0] *= k; P_[1][1] *= k;
+        }
+    }
+
+    float R0_ = 0.0f; // [Ohm]
+    float L0_ = 0.0f; // [H]
+    float theta_[2] = {1.0f, 1.0f}; // normalized resistance and inductance
+    float P_[2][2] = {{1.0f, 0.0f}, {0.0f, 1.0f}};
+    uint32_t countdown_ = 0;
+};
+
+#endif // __RL_ESTIMATOR_HPP
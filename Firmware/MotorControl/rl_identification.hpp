@@ -0,0 +1,117 @@
+#ifndef __RL_IDENTIFICATION_HPP
+#define __RL_IDENTIFICATION_HPP
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * @brief Identifies the phase resistance and inductance of a motor at
+ * standstill from the current response to the applied voltage.
+ *
+ * With the voltage held constant over a sample period T, the current of an
+ * RL circuit follows exactly
+ *   I[k] - I[k-1] = alpha * I[k-1] + beta * V
+ * with alpha = exp(-R*T/L) - 1 and beta = -alpha / R. Both parameters are
+ * estimated together with recursive least squares (without forgetting, so
+ * the result is the batch least squares solution). The residuals give the
+ * noise variance, which together with the covariance matrix yields the
+ * uncertainty of the estimates. The measurement can stop as soon as they
+ * are small enough.
+ *
+ * The excitation must contain both a DC component (for R) and fast voltage
+ * changes (for L).
+ */
+class RLIdentification {
+public:
+    /**
+     * @brief Restarts the identification.
+     * @param sample_period: Time between two updates [s]
+     */
+    void reset(float sample_period) {
+        T_ = sample_period;
+        theta_[0] = 0.0f;
+        theta_[1] = 0.0f;
+        P_[0][0] = P0; P_[0][1] = 0.0f;
+        P_[1][0] = 0.0f; P_[1][1] = P0;
+        cost_ = 0.0f;
+        n_samples_ = 0;
+    }
+
+    /**
+     * @brief Feeds one sample into the estimator.
+     * @param delta_I: Change of the current during the sample period [A]
+     * @param I: Current at the start of the sample period [A]
+     * @param V: Voltage applied during the sample period [V]
+     */
+    void update(float delta_I, float I, float V) {
+        float Pphi0 = P_[0][0] * I + P_[0][1] * V;
+        float Pphi1 = P_[1][0] * I + P_[1][1] * V;
+        float denom = 1.0f + I * Pphi0 + V * Pphi1;
+        if (!(denom > 0.0f)) {
+            return;
+        }
+
+        float K0 = Pphi0 / denom;
+        float K1 = Pphi1 / denom;
+        float err = delta_I - (I * theta_[0] + V * theta_[1]);
+        theta_[0] += K0 * err;
+        theta_[1] += K1 * err;
+
+        P_[0][0] -= K0 * Pphi0;
+        P_[0][1] -= K0 * Pphi1;
+        P_[1][0] -= K1 * Pphi0;
+        P_[1][1] -= K1 * Pphi1;
+
+        // The sum of squared residuals grows by the product of the a priori
+        // and a posteriori errors
+        cost_ += err * (err / denom);
+        n_samples_++;
+    }
+
+    /**
+     * @brief Returns true if the estimates are physically meaningful.
+     */
+    bool is_valid() {
+        return n_samples_ > 2 && theta_[0] < 0.0f && theta_[0] > -1.0f && theta_[1] > 0.0f;
+    }
+
+    float get_resistance() { return -theta_[0] / theta_[1]; } // [Ohm]
+    float get_inductance() { return get_resistance() * T_ / -std::log1p(theta_[0]); } // [H]
+
+    /**
+     * @brief Standard deviations of the estimates [Ohm] and [H], linearized
+     * around the current estimate. Only meaningful if is_valid() is true.
+     */
+    float get_resistance_uncertainty() {
+        float a = theta_[0], b = theta_[1];
+        return get_std(-1.0f / b, a / (b * b));
+    }
+
+    float get_inductance_uncertainty() {
+        // L = T * g(a) / b with g(a) = a / log1p(a)
+        float a = theta_[0], b = theta_[1];
+        float log_a = std::log1p(a);
+        float dg_da = (log_a - a / (1.0f + a)) / (log_a * log_a);
+        return get_std(T_ * dg_da / b, -get_inductance() / b);
+    }
+
+    uint32_t n_samples_ = 0;
+
+private:
+    static constexpr float P0 = 1e4f; // initial covariance, large compared to the information of one sample
+
+    // Standard deviation of a function of theta with the given gradient
+    float get_std(float d0, float d1) {
+        float sigma_sq = n_samples_ > 2 ? cost_ / (float)(n_samples_ - 2) : INFINITY;
+        float var = sigma_sq * (d0 * (P_[0][0] * d0 + P_[0][1] * d1) + d1 * (P_[1][0] * d0 + P_[1][1] * d1));
+        return std::sqrt(std::max(var, 0.0f));
+    }
+
+    float T_ = 0.0f; // [s]
+    float theta_[2] = {0.0f, 0.0f}; // alpha, beta [A/V]
+    float P_[2][2] = {{P0, 0.0f}, {0.0f, P0}};
+    float cost_ = 0.0f; // sum of squared residuals [A^2]
+};
+
+#endif // __RL_IDENTIFICATION_HPP
@@ -0,0 +1,115 @@
+#include "scurve_traj.hpp"
+#include <cmath>
+#include <algorithm>
+
+SCurveTrajectory::Ramp SCurveTrajectory::plan_ramp(float dv, float Amax, float Jmax) {
+    dv = std::abs(dv);
+    if (dv >= Amax * Amax / Jmax) {
+        // Trapezoidal acceleration profile (reaches Amax)
+        float Tj = Amax / Jmax;
+        return {Tj, dv / Amax + Tj, Amax};
+    } else {
+        // Triangular acceleration profile
+        float Tj = std::sqrt(dv / Jmax);
+        return {Tj, 2.0f * Tj, Jmax * Tj};
+    }
+}
+
+float SCurveTrajectory::ramp_distance(float v0, float v1, float Amax, float Jmax) {
+    return 0.5f * (v0 + v1) * plan_ramp(v1 - v0, Amax, Jmax).T;
+}
+
+void SCurveTrajectory::add_segment(float duration, float jerk) {
+    if (!(duration > 0.0f) || n_segments_ >= kMaxSegments) {
+        return;
+    }
+    segments_[n_segments_++] = {t_end_, y_end_, v_end_, a_end_, jerk};
+    float tau = duration;
+    y_end_ += tau * (v_end_ + tau * (0.5f * a_end_ + tau * jerk / 6.0f));
+    v_end_ += tau * (a_end_ + tau * 0.5f * jerk);
+    a_end_ += tau * jerk;
+    t_end_ += tau;
+}
+
+void SCurveTrajectory::add_ramp(float v0, float v1, float Amax, float Jmax) {
+    Ramp ramp = plan_ramp(v1 - v0, Amax, Jmax);
+    float jerk = (v1 >= v0) ? Jmax : -Jmax;
+    add_segment(ramp.Tj, jerk);
+    add_segment(ramp.T - 2.0f * ramp.Tj, 0.0f);
+    add_segment(ramp.Tj, -jerk);
+    // Remove the rounding residue so that it doesn't accumulate
+    v_end_ = v1;
+    a_end_ = 0.0f;
+}
+
+bool SCurveTrajectory::plan(float Xf, float Xi, float Vi,
+                            float Vmax, float Amax, float Dmax, float Jmax) {
+    if (!(Vmax > 0.0f) || !(Amax > 0.0f) || !(Dmax > 0.0f) || !(Jmax > 0.0f)) {
+        return false;
+    }
+
+    float dX = Xf - Xi; // Distance to travel
+    float dXstop = ramp_distance(Vi, 0.0f, Dmax, Jmax); // Minimum stopping displacement
+    float s = std::signbit(dX - dXstop) ? -1.0f : 1.0f; // Sign of coast velocity (if any)
+    float Vr = s * Vmax;
+
+    auto move_distance = [&](float vr) {
+        return ramp_distance(Vi, vr, Amax, Jmax) + ramp_distance(vr, 0.0f, Dmax, Jmax);
+    };
+
+    // If we start faster than the cruise velocity the first phase decelerates
+    // to Vmax and the move is long enough by definition of s.
+    if ((s * Vi) <= Vmax && (s * dX) < (s * move_distance(Vr))) {
+        // Short move: find the peak velocity. The travelled distance grows
+        // monotonically with it between these bounds.
+        float lo = std::max(s * Vi, 0.0f);
+        float hi = Vmax;
+        for (int i = 0; i < 32; ++i) {
+            float mid = 0.5f * (lo + hi);
+            if ((s * move_distance(s * mid)) < (s * dX)) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        Vr = s * lo;
+    }
+
+    float Tv = (Vr != 0.0f) ? std::max((dX - move_distance(Vr)) / Vr, 0.0f) : 0.0f;
+
+    n_segments_ = 0;
+    t_end_ = 0.0f;
+    y_end_ = Xi;
+    v_end_ = Vi;
+    a_end_ = 0.0f;
+    add_ramp(Vi, Vr, Amax, Jmax);
+    add_segment(Tv, 0.0f);
+    add_ramp(Vr, 0.0f, Dmax, Jmax);
+
+    Tf_ = t_end_;
+    Xi_ = Xi;
+    Xf_ = Xf;
+    Vi_ = Vi;
+    return true;
+}
+
+SCurveTrajectory::Step_t SCurveTrajectory::eval(float t) const {
+    if (t < 0.0f) { // Initial Condition
+        return {Xi_, Vi_, 0.0f};
+    }
+    if (!(t < Tf_) || n_segments_ == 0) { // Final Condition
+        return {Xf_, 0.0f, 0.0f};
+    }
+
+    size_t i = n_segments_ - 1;
+    while (i > 0 && segments_[i].t0 > t) {
+        --i;
+    }
+    const Segment& seg = segments_[i];
+    float tau = t - seg.t0;
+    return {
+        seg.y0 + tau * (seg.v0 + tau * (0.5f * seg.a0 + tau * seg.j / 6.0f)),
+        seg.v0 + tau * (seg.a0 + tau * 0.5f * seg.j),
+        seg.a0 + tau * seg.j
+    };
+}
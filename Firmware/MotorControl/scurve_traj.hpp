@@ -0,0 +1,73 @@
+#ifndef __SCURVE_TRAJ_HPP
+#define __SCURVE_TRAJ_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Jerk limited point to point trajectory (7 segment S-curve).
+ *
+ * Like TrapezoidalTrajectory the move consists of an acceleration phase from
+ * the initial velocity to the cruise velocity, a cruise phase and a
+ * deceleration phase to standstill, but the acceleration ramps up and down
+ * with a bounded jerk. The velocity changes are point symmetric, so the
+ * distance covered by each of them is the mean velocity times its duration.
+ *
+ * All polynomial coefficients are computed by plan() so that eval() only has
+ * to find the segment and evaluate one cubic.
+ */
+class SCurveTrajectory {
+public:
+    struct Step_t {
+        float Y;
+        float Yd;
+        float Ydd;
+    };
+
+    /**
+     * @brief Plans a move from Xi (with velocity Vi and zero acceleration) to
+     * Xf. Returns false if one of the limits is not positive.
+     */
+    bool plan(float Xf, float Xi, float Vi,
+              float Vmax, float Amax, float Dmax, float Jmax);
+    Step_t eval(float t) const;
+
+    float Tf_ = 0.0f; // [s] duration of the move
+    float t_ = 0.0f; // [s] time since the start of the move, advanced by the controller
+
+private:
+    // Duration of a jerk limited velocity change
+    struct Ramp {
+        float Tj; // [s] duration of each jerk phase
+        float T; // [s] total duration
+        float a; // [turn/s^2] peak acceleration (unsigned)
+    };
+    static Ramp plan_ramp(float dv, float Amax, float Jmax);
+    static float ramp_distance(float v0, float v1, float Amax, float Jmax);
+
+    void add_ramp(float v0, float v1, float Amax, float Jmax);
+    void add_segment(float duration, float jerk);
+
+    struct Segment {
+        float t0; // [s] start time
+        float y0; // [turn]
+        float v0; // [turn/s]
+        float a0; // [turn/s^2]
+        float j; // [turn/s^3]
+    };
+
+    static constexpr size_t kMaxSegments = 7;
+    Segment segments_[kMaxSegments];
+    size_t n_segments_ = 0;
+
+    // Running end state while planning
+    float t_end_ = 0.0f;
+    float y_end_ = 0.0f;
+    float v_end_ = 0.0f;
+    float a_end_ = 0.0f;
+
+    float Xi_ = 0.0f;
+    float Xf_ = 0.0f;
+    float Vi_ = 0.0f;
+};
+
+#endif // __SCURVE_TRAJ_HPP
@@ -1,6 +1,58 @@
 
 #include "odrive_main.h"
 
+bool SensorlessEstimator::apply_config() {
+    config_.parent = this;
+    update_gain_schedule();
+    return true;
+}
+
+/**
+ * @brief Recomputes the derived quantities that the config setters marked as
+ * out of date. Called by the control loop before the sensor stages.
+ */
+void SensorlessEstimator::apply_dirty_config() {
+    if (dirty_.take() & DIRTY_GAIN_SCHEDULE) {
+        update_gain_schedule();
+    }
+}
+
+void SensorlessEstimator::update_gain_schedule() {
+    float vel[SENSORLESS_GAIN_SCHEDULE_SIZE];
+    float gains[SENSORLESS_GAIN_SCHEDULE_SIZE][2];
+    for (size_t i = 0; i < SENSORLESS_GAIN_SCHEDULE_SIZE; ++i) {
+        vel[i] = config_.gain_schedule[i].vel;
+        gains[i][0] = config_.gain_schedule[i].observer_gain;
+        gains[i][1] = config_.gain_schedule[i].pll_bandwidth;
+    }
+    LinearSchedule<SENSORLESS_GAIN_SCHEDULE_SIZE, 2> schedule;
+    bool active = config_.gain_schedule_enable && schedule.set(vel, gains);
+    CRITICAL_SECTION() {
+        gain_schedule_ = schedule;
+        gain_schedule_active_ = active;
+    }
+}
+
+/**
+ * @brief Returns the observer gain and the PLL bandwidth at the specified
+ * electrical velocity, from the gain schedule and pll_bandwidth_vel_ratio.
+ */
+void SensorlessEstimator::get_gains(float phase_vel, float* observer_gain, float* pll_bandwidth) {
+    float abs_vel = std::abs(phase_vel);
+    *observer_gain = config_.observer_gain;
+    *pll_bandwidth = config_.pll_bandwidth;
+    if (gain_schedule_active_) {
+        float gains[2];
+        gain_schedule_.eval(abs_vel, gains);
+        *observer_gain = gains[0];
+        *pll_bandwidth = gains[1];
+    }
+    // Keeps the phase lag of the PLL small at high electrical frequencies.
+    // The limit keeps current_meas_period * pll_kp at 0.5.
+    float adaptive_bandwidth = std::min(config_.pll_bandwidth_vel_ratio * abs_vel, 0.25f * current_meas_hz);
+    *pll_bandwidth = std::max(*pll_bandwidth, adaptive_bandwidth);
+}
+
 void SensorlessEstimator::reset() {
     pll_pos_ = 0.0f;
     vel_estimate_ = 0.0f;
@@ -10,24 +62,23 @@ void SensorlessEstimator::reset() {
     flux_state_[1] = 0.0f;
 }
 
-bool SensorlessEstimator::update() {
-    // Algorithm based on paper: Sensorless Control of Surface-Mount Permanent-Magnet Synchronous Motors Based on a Nonlinear Observer
-    // http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
-    // In particular, equation 8 (and by extension eqn 4 and 6).
-
-    // The V_alpha_beta applied immedietly prior to the current measurement associated with this cycle
-    // is the one computed two cycles ago. To get the correct measurement, it was stored twice:
-    // once by final_v_alpha/final_v_beta in the current control reporting, and once by V_alpha_beta_memory.
+/**
+ * @brief Checks the preconditions of this axis and gathers the inputs of the
+ * observer. Returns false if the estimator can't run this iteration.
+ */
+bool SensorlessEstimator::prepare(Inputs* in) {
+    in->phase_vel = phase_vel_.previous().value_or(0.0f);
+    get_gains(in->phase_vel, &observer_gain_, &pll_bandwidth_);
 
     // PLL
     // TODO: the PLL part has some code duplication with the encoder PLL
     // Pll gains as a function of bandwidth
-    float pll_kp = 2.0f * config_.pll_bandwidth;
+    in->pll_kp = 2.0f * pll_bandwidth_;
     // Critically damped
-    float pll_ki = 0.25f * (pll_kp * pll_kp);
+    in->pll_ki = 0.25f * (in->pll_kp * in->pll_kp);
 
     // Check that we don't get problems with discrete time approximation
-    if (!(current_meas_period * pll_kp < 1.0f)) {
+    if (!(current_meas_period * in->pll_kp < 1.0f)) {
         error_ |= ERROR_UNSTABLE_GAIN;
         reset(); // Reset state for when the next valid current measurement comes in.
         return false;
@@ -43,59 +94,166 @@ bool SensorlessEstimator::update() {
     }
 
     // Clarke transform
-    float I_alpha_beta[2] = {
-        current_meas->phA,
-        one_by_sqrt3 * (current_meas->phB - current_meas->phC)};
+    in->I_alpha_beta[0] = current_meas->phA;
+    in->I_alpha_beta[1] = one_by_sqrt3 * (current_meas->phB - current_meas->phC);
+
+    in->R = axis_->motor_.config_.phase_resistance;
+    in->L = axis_->motor_.config_.phase_inductance;
+    in->pm_flux_sqr = config_.pm_flux_linkage * config_.pm_flux_linkage;
+    in->observer_gain = observer_gain_;
+    return true;
+}
+
+/**
+ * @brief Updates the estimators of all axes that run in sensorless mode.
+ *
+ * The observer and PLL math has no branches and is written as loops over the
+ * axes with the inputs and states gathered in arrays. The dependency chains
+ * of the axes are independent, so the compiler can interleave them to hide
+ * the FPU latency of the divisions.
+ */
+void SensorlessEstimator::update_all() {
+    // Algorithm based on paper: Sensorless Control of Surface-Mount Permanent-Magnet Synchronous Motors Based on a Nonlinear Observer
+    // http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
+    // In particular, equation 8 (and by extension eqn 4 and 6).
+
+    // The V_alpha_beta applied immedietly prior to the current measurement associated with this cycle
+    // is the one computed two cycles ago. To get the correct measurement, it was stored twice:
+    // once by final_v_alpha/final_v_beta in the current control reporting, and once by V_alpha_beta_memory.
+
+    constexpr size_t N = AXIS_COUNT;
+    bool active[N];
+    Inputs in[N];
+    float flux[N][2];
+    float V[N][2];
+    float pll_pos[N];
+    bool any_active = false;
+
+    for (size_t n = 0; n < N; ++n) {
+        SensorlessEstimator& est = axes[n].sensorless_estimator_;
+        active[n] = axes[n].config_.enable_sensorless_mode && est.prepare(&in[n]);
+        if (!active[n]) {
+            in[n] = {}; // keeps the math of inactive axes finite
+            in[n].pm_flux_sqr = 1.0f;
+        }
+        any_active = any_active || active[n];
+        for (int i = 0; i <= 1; ++i) {
+            flux[n][i] = est.flux_state_[i];
+            V[n][i] = est.V_alpha_beta_memory_[i];
+        }
+        pll_pos[n] = est.pll_pos_;
+    }
+    if (!any_active) {
+        return;
+    }
 
     // alpha-beta vector operations
-    float eta[2];
-    for (int i = 0; i <= 1; ++i) {
-        // y is the total flux-driving voltage (see paper eqn 4)
-        float y = -axis_->motor_.config_.phase_resistance * I_alpha_beta[i] + V_alpha_beta_memory_[i];
-        // flux dynamics (prediction)
-        float x_dot = y;
-        // integrate prediction to current timestep
-        flux_state_[i] += x_dot * current_meas_period;
-
-        // eta is the estimated permanent magnet flux (see paper eqn 6)
-        eta[i] = flux_state_[i] - axis_->motor_.config_.phase_inductance * I_alpha_beta[i];
+    float eta[N][2];
+    for (size_t n = 0; n < N; ++n) {
+        for (int i = 0; i <= 1; ++i) {
+            // y is the total flux-driving voltage (see paper eqn 4)
+            float y = -in[n].R * in[n].I_alpha_beta[i] + V[n][i];
+            // flux dynamics (prediction)
+            float x_dot = y;
+            // integrate prediction to current timestep
+            flux[n][i] += x_dot * current_meas_period;
+
+            // eta is the estimated permanent magnet flux (see paper eqn 6)
+            eta[n][i] = flux[n][i] - in[n].L * in[n].I_alpha_beta[i];
+        }
     }
 
     // Non-linear observer (see paper eqn 8):
-    float pm_flux_sqr = config_.pm_flux_linkage * config_.pm_flux_linkage;
-    float est_pm_flux_sqr = eta[0] * eta[0] + eta[1] * eta[1];
-    float bandwidth_factor = 1.0f / pm_flux_sqr;
-    float eta_factor = 0.5f * (config_.observer_gain * bandwidth_factor) * (pm_flux_sqr - est_pm_flux_sqr);
+    for (size_t n = 0; n < N; ++n) {
+        float est_pm_flux_sqr = eta[n][0] * eta[n][0] + eta[n][1] * eta[n][1];
+        float bandwidth_factor = 1.0f / in[n].pm_flux_sqr;
+        float eta_factor = 0.5f * (in[n].observer_gain * bandwidth_factor) * (in[n].pm_flux_sqr - est_pm_flux_sqr);
 
-    // alpha-beta vector operations
-    for (int i = 0; i <= 1; ++i) {
-        // add observer action to flux estimate dynamics
-        float x_dot = eta_factor * eta[i];
-        // convert action to discrete-time
-        flux_state_[i] += x_dot * current_meas_period;
-        // update new eta
-        eta[i] = flux_state_[i] - axis_->motor_.config_.phase_inductance * I_alpha_beta[i];
+        // alpha-beta vector operations
+        for (int i = 0; i <= 1; ++i) {
+            // add observer action to flux estimate dynamics
+            float x_dot = eta_factor * eta[n][i];
+            // convert action to discrete-time
+            flux[n][i] += x_dot * current_meas_period;
+            // update new eta
+            eta[n][i] = flux[n][i] - in[n].L * in[n].I_alpha_beta[i];
+        }
+    }
+
+    float phase[N];
+    for (size_t n = 0; n < N; ++n) {
+        phase[n] = fast_atan2(eta[n][1], eta[n][0]);
     }
 
+    for (size_t n = 0; n < N; ++n) {
+        // predict PLL phase with velocity
+        pll_pos[n] = wrap_pm_pi(pll_pos[n] + current_meas_period * in[n].phase_vel);
+        // update PLL phase with observer permanent magnet phase
+        float delta_phase = wrap_pm_pi(phase[n] - pll_pos[n]);
+        pll_pos[n] = wrap_pm_pi(pll_pos[n] + current_meas_period * in[n].pll_kp * delta_phase);
+        // update PLL velocity
+        in[n].phase_vel += current_meas_period * in[n].pll_ki * delta_phase;
+    }
+
+    for (size_t n = 0; n < N; ++n) {
+        if (active[n]) {
+            axes[n].sensorless_estimator_.finish(in[n], flux[n], pll_pos[n], phase[n], in[n].phase_vel);
+        }
+    }
+}
+
+/**
+ * @brief Stores the new observer state, applies high frequency injection and
+ * sets the outputs.
+ */
+void SensorlessEstimator::finish(const Inputs& in, const float (&flux)[2], float pll_pos, float phase, float phase_vel) {
+    const float (&I_alpha_beta)[2] = in.I_alpha_beta;
+    flux_state_[0] = flux[0];
+    flux_state_[1] = flux[1];
+    pll_pos_ = pll_pos;
+
     // Flux state estimation done, store V_alpha_beta for next timestep
     V_alpha_beta_memory_[0] = axis_->motor_.current_control_.final_v_alpha_;
     V_alpha_beta_memory_[1] = axis_->motor_.current_control_.final_v_beta_;
 
-    float phase_vel = phase_vel_.previous().value_or(0.0f);
+    if (config_.enable_hfi) {
+        hfi_.update(I_alpha_beta[0], I_alpha_beta[1], config_.hfi_pll_bandwidth,
+                    config_.hfi_polarity_current, current_meas_period);
+        if (hfi_.state() == HfiObserver::STATE_FAILED) {
+            error_ |= ERROR_HFI_NO_SALIENCY;
+            return;
+        }
 
-    // predict PLL phase with velocity
-    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * phase_vel);
-    // update PLL phase with observer permanent magnet phase
-    float phase = fast_atan2(eta[1], eta[0]);
-    float delta_phase = wrap_pm_pi(phase - pll_pos_);
-    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * pll_kp * delta_phase);
-    // update PLL velocity
-    phase_vel += current_meas_period * pll_ki * delta_phase;
+        // Blend from HFI to the flux observer between half the crossover
+        // velocity and the crossover velocity.
+        float weight = 0.0f;
+        if (hfi_.state() == HfiObserver::STATE_TRACK && config_.hfi_crossover_vel > 0.0f) {
+            weight = std::clamp(2.0f * std::abs(phase_vel) / config_.hfi_crossover_vel - 1.0f, 0.0f, 1.0f);
+        }
+        if (weight >= 1.0f) {
+            hfi_.follow(phase, phase_vel);
+        } else if (hfi_.state() != HfiObserver::STATE_IDLE) {
+            phase = wrap_pm_pi(hfi_.phase() + weight * wrap_pm_pi(phase - hfi_.phase()));
+            phase_vel = hfi_.phase_vel() + weight * (phase_vel - hfi_.phase_vel());
+        }
+        hfi_weight_ = weight;
+
+        auto [s, c] = fast_sincos(phase);
+        if (weight <= 0.0f) {
+            // The flux observer is not reliable at this speed. Keep it aligned
+            // with HFI so that it takes over smoothly.
+            for (int i = 0; i <= 1; ++i) {
+                flux_state_[i] = config_.pm_flux_linkage * (i ? s : c) + axis_->motor_.config_.phase_inductance * I_alpha_beta[i];
+            }
+            pll_pos_ = phase;
+        }
+
+        hfi_voltage_ = hfi_.inject(config_.hfi_voltage * (1.0f - weight), phase, c, s);
+        hfi_Idq_setpoint_ = {hfi_.id_bias(), 0.0f};
+    }
 
     // set outputs
     phase_ = phase;
     phase_vel_ = phase_vel;
     vel_estimate_ = phase_vel / (std::max((float)axis_->motor_.config_.pole_pairs, 1.0f) * 2.0f * M_PI);
-
-    return true;
-};
+}
@@ -2,30 +2,106 @@
 #define __SENSORLESS_ESTIMATOR_HPP
 
 #include "component.hpp"
+#include "dirty_flags.hpp"
+#include "hfi_observer.hpp"
+#include "gain_schedule.hpp"
+
+#define SENSORLESS_GAIN_SCHEDULE_SIZE 4 // number of breakpoints of the observer gain schedule
 
 class SensorlessEstimator : public ODriveIntf::SensorlessEstimatorIntf {
 public:
+    // Derived quantities that the setters leave to apply_dirty_config()
+    enum DirtyFlag : uint32_t {
+        DIRTY_GAIN_SCHEDULE = 1 << 0,
+    };
+
+    struct GainSchedulePoint {
+        float vel; // [rad/s] electrical
+        float observer_gain; // [rad/s]
+        float pll_bandwidth; // [rad/s]
+    };
+
     struct Config_t {
         float observer_gain = 1000.0f; // [rad/s]
         float pll_bandwidth = 1000.0f;  // [rad/s]
+        // Observer and PLL gains over the electrical velocity, replace the two above
+        bool gain_schedule_enable = false;
+        GainSchedulePoint gain_schedule[SENSORLESS_GAIN_SCHEDULE_SIZE] = {
+            {0.0f, 1000.0f, 1000.0f},
+            {1000.0f, 1000.0f, 1000.0f},
+            {2000.0f, 1000.0f, 1000.0f},
+            {3000.0f, 1000.0f, 1000.0f},
+        }; // breakpoints in increasing order of vel, applied by set_gain_schedule_enable()
+        float pll_bandwidth_vel_ratio = 0.0f; // the PLL bandwidth is at least this times the electrical velocity
         float pm_flux_linkage = 1.58e-3f; // [V / (rad/s)]  { 5.51328895422 / (<pole pairs> * <rpm/v>) }
+        bool enable_hfi = false; // start and run at low speed with high frequency injection instead of the lock-in spin
+        float hfi_voltage = 0.5f; // [V] amplitude of the injected square wave
+        float hfi_pll_bandwidth = 200.0f; // [rad/s]
+        float hfi_crossover_vel = 300.0f; // [rad/s] electrical, above this the flux observer is used exclusively
+        float hfi_polarity_current = 5.0f; // [A] d axis current of the magnet polarity test
+        float handoff_max_phase_error = 1.0f; // [rad] largest load angle of the lock-in spin at which the observer takes over
+        float handoff_max_vel_error = 0.1f; // largest velocity error of the observer relative to the lock-in velocity
+        float handoff_hold_time = 0.05f; // [s] how long both errors must be within bounds
+        float handoff_timeout = 1.0f; // [s] after the lock-in spin finished
+
+        // custom setters
+        SensorlessEstimator* parent = nullptr;
+        void set_gain_schedule_enable(bool value) { gain_schedule_enable = value; parent->dirty_.mark(DIRTY_GAIN_SCHEDULE); }
     };
 
+    bool apply_config();
+    void apply_dirty_config();
     void reset();
-    bool update();
+    void update_gain_schedule();
+
+    // Updates the estimators of all axes with enable_sensorless_mode. Called
+    // by the control loop after the sensor stages.
+    static void update_all();
+
+    HfiState hfi_state() { return (HfiState)hfi_.state(); }
 
     Axis* axis_ = nullptr; // set by Axis constructor
     Config_t config_;
+    DirtyFlags dirty_; // see DirtyFlag
 
     // TODO: expose on protocol
     Error error_ = ERROR_NONE;
     float pll_pos_ = 0.0f;                      // [rad]
     float flux_state_[2] = {0.0f, 0.0f};        // [Vs]
     float V_alpha_beta_memory_[2] = {0.0f, 0.0f}; // [V]
+    float observer_gain_ = 0.0f; // [rad/s] of the last update
+    float pll_bandwidth_ = 0.0f; // [rad/s] of the last update
 
     OutputPort<float> phase_ = 0.0f;                   // [rad]
     OutputPort<float> phase_vel_ = 0.0f;               // [rad/s]
     OutputPort<float> vel_estimate_ = 0.0f;            // [turns/s]
+
+    // High frequency injection
+    HfiObserver hfi_;
+    float hfi_weight_ = 0.0f; // 0: phase from HFI, 1: phase from the flux observer
+    OutputPort<float> hfi_voltage_ = 0.0f; // [V] added to the d axis voltage by the FOC
+    float2D hfi_Idq_setpoint_ = {0.0f, 0.0f}; // [A] current setpoint during the HFI start-up
+    float2D hfi_Vdq_setpoint_ = {0.0f, 0.0f}; // [V] voltage feedforward during the HFI start-up
+
+private:
+    // Per axis inputs of the batched update
+    struct Inputs {
+        float I_alpha_beta[2]; // [A]
+        float R; // [Ohm]
+        float L; // [H]
+        float pm_flux_sqr; // [(V / (rad/s))^2]
+        float observer_gain; // [rad/s]
+        float pll_kp;
+        float pll_ki;
+        float phase_vel; // [rad/s]
+    };
+
+    bool prepare(Inputs* in);
+    void get_gains(float phase_vel, float* observer_gain, float* pll_bandwidth);
+    void finish(const Inputs& in, const float (&flux)[2], float pll_pos, float phase, float phase_vel);
+
+    LinearSchedule<SENSORLESS_GAIN_SCHEDULE_SIZE, 2> gain_schedule_; // copy of config_.gain_schedule with precomputed slopes
+    bool gain_schedule_active_ = false; // false if disabled or if the breakpoints are not sorted
 };
 
 #endif /* __SENSORLESS_ESTIMATOR_HPP */
@@ -0,0 +1,94 @@
+#ifndef __SINCOS_CALIBRATION_HPP
+#define __SINCOS_CALIBRATION_HPP
+
+#include <cmath>
+#include <algorithm>
+
+/**
+ * @brief Online estimator of the offset, gain and phase errors of the two
+ * channels of a sin/cos encoder (i.e. an ellipse fit of the raw samples).
+ *
+ * The raw samples are modelled as
+ *   s = A_s * sin(x + phi) + offset_s
+ *   c = A_c * cos(x) + offset_c
+ * Over whole periods of x the means of s and c are the offsets, their
+ * variances are A^2 / 2 and their covariance is A_s * A_c * sin(phi) / 2.
+ * The samples are weighted with the angle that they cover so that the
+ * estimate doesn't depend on the speed profile.
+ */
+class SincosCalibration {
+public:
+    struct Result {
+        float offset_s;
+        float offset_c;
+        float gain_s; // A_c / A_s
+        float skew; // sin(phi)
+    };
+
+    void reset() {
+        w_ = 0.0f;
+        s_ = c_ = ss_ = cc_ = sc_ = 0.0f;
+    }
+
+    /**
+     * @brief Adds one pair of raw samples.
+     * @param delta_angle: Electrical angle [rad] travelled since the last
+     *        sample, e.g. from the estimate of the previous iteration.
+     * @param periods: Number of signal periods that the estimate averages
+     *        over.
+     */
+    void update(float s, float c, float delta_angle, float periods) {
+        float k = std::min(std::abs(delta_angle) / (2.0f * (float)M_PI * periods), 1.0f);
+        w_ += k * (1.0f - w_);
+        s_ += k * (s - s_);
+        c_ += k * (c - c_);
+        ss_ += k * (s * s - ss_);
+        cc_ += k * (c * c - cc_);
+        sc_ += k * (s * c - sc_);
+    }
+
+    /**
+     * @brief Returns false until the samples cover enough periods.
+     */
+    bool get(Result* result) {
+        if (w_ < 0.9f) {
+            return false;
+        }
+        float offset_s = s_ / w_;
+        float offset_c = c_ / w_;
+        float var_s = ss_ / w_ - offset_s * offset_s;
+        float var_c = cc_ / w_ - offset_c * offset_c;
+        float cov = sc_ / w_ - offset_s * offset_c;
+        if (!(var_s > 0.0f) || !(var_c > 0.0f)) {
+            return false;
+        }
+        *result = {
+            .offset_s = offset_s,
+            .offset_c = offset_c,
+            .gain_s = std::sqrt(var_c / var_s),
+            .skew = std::clamp(cov / std::sqrt(var_s * var_c), -0.5f, 0.5f),
+        };
+        return true;
+    }
+
+    /**
+     * @brief Removes the errors from a pair of raw samples. The angle is
+     * atan2(*y, *x).
+     */
+    static void correct(const Result& cal, float s, float c, float* y, float* x) {
+        float s1 = (s - cal.offset_s) * cal.gain_s;
+        float c1 = c - cal.offset_c;
+        *y = s1 - c1 * cal.skew;
+        *x = c1 * std::sqrt(1.0f - cal.skew * cal.skew);
+    }
+
+private:
+    float w_ = 0.0f; // sum of the weights, approaches 1
+    float s_ = 0.0f;
+    float c_ = 0.0f;
+    float ss_ = 0.0f;
+    float cc_ = 0.0f;
+    float sc_ = 0.0f;
+};
+
+#endif // __SINCOS_CALIBRATION_HPP
@@ -0,0 +1,119 @@
+#ifndef __SINE_ANALYZER_HPP
+#define __SINE_ANALYZER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+/**
+ * @brief Measures the frequency response of a system at one frequency.
+ *
+ * The caller adds excitation() to the input of the system and passes the
+ * resulting input and output to update() once per sample. After the settle
+ * cycles, both signals are correlated with the excitation over an integer
+ * number of periods (a single bin DFT), so only the fundamental remains and
+ * the result doesn't leak into other frequencies.
+ *
+ * The sine is generated with a rotating phasor, so no trigonometric
+ * functions are evaluated per sample.
+ */
+class SineAnalyzer {
+public:
+    /**
+     * @brief Starts a measurement. The frequency is adjusted slightly so that
+     * the measurement covers an integer number of samples.
+     *
+     * @returns the actual frequency [Hz]
+     */
+    float start(float freq, uint32_t settle_cycles, uint32_t measure_cycles, float sample_period) {
+        measure_cycles = std::max<uint32_t>(measure_cycles, 1);
+        float samples_per_cycle = std::max(1.0f / (freq * sample_period), 2.0f);
+        measure_samples_ = std::max<uint32_t>((uint32_t)std::round(samples_per_cycle * (float)measure_cycles), 2);
+        freq = (float)measure_cycles / ((float)measure_samples_ * sample_period);
+        settle_samples_ = (uint32_t)std::round(samples_per_cycle * (float)settle_cycles);
+
+        float step = 2.0f * (float)M_PI * freq * sample_period;
+        step_cos_ = std::cos(step);
+        step_sin_ = std::sin(step);
+        cos_ = 1.0f;
+        sin_ = 0.0f;
+        count_ = 0;
+        u_sin_ = u_cos_ = y_sin_ = y_cos_ = 0.0f;
+        freq_ = freq;
+        return freq;
+    }
+
+    // Unit excitation for the current sample. Starts at zero.
+    float excitation() const {
+        return sin_;
+    }
+
+    /**
+     * @brief Accumulates one sample and advances the excitation. Returns
+     * true once the measurement is complete.
+     */
+    bool update(float u, float y) {
+        if (done()) {
+            return true;
+        }
+        if (count_ >= settle_samples_) {
+            u_sin_ += u * sin_;
+            u_cos_ += u * cos_;
+            y_sin_ += y * sin_;
+            y_cos_ += y * cos_;
+        }
+
+        float c = cos_ * step_cos_ - sin_ * step_sin_;
+        float s = sin_ * step_cos_ + cos_ * step_sin_;
+        float norm = 0.5f * (3.0f - (c * c + s * s)); // first order correction keeps the magnitude at 1
+        cos_ = c * norm;
+        sin_ = s * norm;
+
+        return ++count_ >= settle_samples_ + measure_samples_;
+    }
+
+    bool done() const {
+        return measure_samples_ && count_ >= settle_samples_ + measure_samples_;
+    }
+
+    float freq() const { return freq_; } // [Hz]
+
+    // |Y/U|
+    float gain() const {
+        float u = std::sqrt(u_sin_ * u_sin_ + u_cos_ * u_cos_);
+        float y = std::sqrt(y_sin_ * y_sin_ + y_cos_ * y_cos_);
+        return u > 0.0f ? y / u : 0.0f;
+    }
+
+    // arg(Y/U) in [-pi, pi] [rad]
+    float phase() const {
+        float phase = std::atan2(y_cos_, y_sin_) - std::atan2(u_cos_, u_sin_);
+        if (phase > (float)M_PI) {
+            phase -= 2.0f * (float)M_PI;
+        } else if (phase < -(float)M_PI) {
+            phase += 2.0f * (float)M_PI;
+        }
+        return phase;
+    }
+
+    // Amplitude of the input at the excitation frequency
+    float input_amplitude() const {
+        return measure_samples_ ? 2.0f * std::sqrt(u_sin_ * u_sin_ + u_cos_ * u_cos_) / (float)measure_samples_ : 0.0f;
+    }
+
+private:
+    uint32_t settle_samples_ = 0;
+    uint32_t measure_samples_ = 0;
+    uint32_t count_ = 0;
+    float freq_ = 0.0f;
+    float step_cos_ = 1.0f;
+    float step_sin_ = 0.0f;
+    float cos_ = 1.0f;
+    float sin_ = 0.0f;
+    float u_sin_ = 0.0f;
+    float u_cos_ = 0.0f;
+    float y_sin_ = 0.0f;
+    float y_cos_ = 0.0f;
+};
+
+#endif // __SINE_ANALYZER_HPP
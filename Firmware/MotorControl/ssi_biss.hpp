@@ -0,0 +1,101 @@
+#ifndef __SSI_BISS_HPP
+#define __SSI_BISS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Decoders for SSI and BiSS-C position frames that were clocked in by
+ * an SPI peripheral as 16-bit words (MSB first).
+ */
+
+/**
+ * @brief Returns the n-th received bit of the frame (0 being the first one).
+ */
+inline bool frame_bit(const uint16_t* words, size_t n) {
+    return (words[n / 16] >> (15 - (n % 16))) & 1;
+}
+
+/**
+ * @brief CRC6 of a BiSS-C frame (polynomial x^6 + x + 1, initial value 0),
+ * computed over the position bits followed by the nE and nW bits.
+ * The encoder transmits the inverted CRC.
+ */
+inline uint8_t biss_crc6(const uint16_t* words, size_t first_bit, size_t n_bits) {
+    uint8_t crc = 0;
+    for (size_t i = first_bit; i < first_bit + n_bits; ++i) {
+        bool feedback = ((crc >> 5) & 1) ^ frame_bit(words, i);
+        crc = (crc << 1) & 0x3f;
+        if (feedback) {
+            crc ^= 0x03;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Decodes an SSI frame which consists of one leading bit followed by
+ * `pos_bits` binary coded position bits.
+ *
+ * Returns false if the frame is too short.
+ */
+inline bool decode_ssi(const uint16_t* words, size_t n_words, size_t pos_bits, uint32_t* pos) {
+    if (pos_bits == 0 || pos_bits > 32 || 1 + pos_bits > n_words * 16) {
+        return false;
+    }
+    uint32_t val = 0;
+    for (size_t i = 1; i < 1 + pos_bits; ++i) {
+        val = (val << 1) | frame_bit(words, i);
+    }
+    *pos = val;
+    return true;
+}
+
+/**
+ * @brief Decodes a BiSS-C frame:
+ *   [idle (1)] [ack (0...)] [start (1)] [CDS] [position] [nE] [nW] [~CRC6]
+ *
+ * Returns false if no start bit was found, the frame is too short, the CRC
+ * doesn't match or the encoder reports an error (nE = 0). Warnings are
+ * ignored.
+ */
+inline bool decode_biss_c(const uint16_t* words, size_t n_words, size_t pos_bits, uint32_t* pos) {
+    size_t n_bits = n_words * 16;
+    size_t i = 0;
+
+    // The slave pulls the line low to acknowledge the request and raises it
+    // again when the data is ready.
+    while (i < n_bits && frame_bit(words, i)) {
+        ++i;
+    }
+    while (i < n_bits && !frame_bit(words, i)) {
+        ++i;
+    }
+    i += 2; // start bit and CDS bit
+
+    if (pos_bits == 0 || pos_bits > 32 || i + pos_bits + 8 > n_bits) {
+        return false;
+    }
+
+    uint32_t val = 0;
+    for (size_t j = i; j < i + pos_bits; ++j) {
+        val = (val << 1) | frame_bit(words, j);
+    }
+    size_t nE_bit = i + pos_bits;
+
+    uint8_t crc = 0;
+    for (size_t j = nE_bit + 2; j < nE_bit + 8; ++j) {
+        crc = (crc << 1) | frame_bit(words, j);
+    }
+    if ((uint8_t)(~crc & 0x3f) != biss_crc6(words, i, pos_bits + 2)) {
+        return false;
+    }
+    if (!frame_bit(words, nE_bit)) {
+        return false;
+    }
+
+    *pos = val;
+    return true;
+}
+
+#endif // __SSI_BISS_HPP
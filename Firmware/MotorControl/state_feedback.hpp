@@ -0,0 +1,66 @@
+#ifndef __STATE_FEEDBACK_HPP
+#define __STATE_FEEDBACK_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Full state feedback torque = K * e with the gains K of an offline
+ * design, e.g. LQR on a model of the axis.
+ *
+ * The error vector e is the reference minus the estimate of each state (see
+ * State). The integral of the position error is kept here. It doesn't
+ * integrate while the torque is limited, so that it doesn't wind up.
+ *
+ * The cost of an update is a fixed number of multiply-adds, independent of
+ * which gains are used.
+ */
+class StateFeedback {
+public:
+    enum State {
+        kPos = 0,      // [turn] position error
+        kVel,          // [turn/s] velocity error
+        kAccel,        // [turn/s^2] acceleration error
+        kIntegral,     // [turn * s] integral of the position error
+        kTwist,        // [turn] deflection of the transmission around its mean (dual encoder)
+        kTwistVel,     // [turn/s] rate of the deflection (dual encoder)
+        kNumStates
+    };
+
+    typedef float Vector[kNumStates];
+
+    void reset() {
+        integral_ = 0.0f;
+    }
+
+    /**
+     * @brief Returns K * e for the error vector e. The integral state of e is
+     * set by this function.
+     */
+    float update(const Vector& gains, Vector& error) const {
+        error[kIntegral] = integral_;
+        float torque = 0.0f;
+        for (size_t i = 0; i < kNumStates; ++i) {
+            torque += gains[i] * error[i];
+        }
+        return torque;
+    }
+
+    /**
+     * @brief Integrates the position error at the end of an update.
+     *
+     * @param limited: The torque was limited in this update.
+     * @param dt: Time until the next update [s]
+     */
+    void integrate(float pos_err, bool limited, float dt) {
+        if (!limited) {
+            integral_ += dt * pos_err;
+        }
+    }
+
+    float integral() const { return integral_; }
+
+private:
+    float integral_ = 0.0f;
+};
+
+#endif // __STATE_FEEDBACK_HPP
@@ -2,7 +2,11 @@
 #define __TASK_TIMER_HPP
 
 #include <stdint.h>
+#include <algorithm>
+#include <iterator>
 #include <board.h>
+#include <autogen/interfaces.hpp>
+#include "trace.hpp"
 
 #define MEASURE_START_TIME
 #define MEASURE_END_TIME
@@ -14,21 +18,51 @@ inline uint16_t sample_TIM13() {
     return clocks_per_cnt * TIM13->CNT;  // TODO: Use a hw_config
 }
 
-struct TaskTimer {
+#if defined(TASK_TIMER_DWT)
+// Statistics are only collected in DWT mode because they need the full 32-bit
+// range of the cycle counter. DWT->CYCCNT runs at HCLK which is the same as
+// the TIM1/TIM8 clock so the unit of all values is the same in both modes.
+#define MEASURE_STATISTICS
+
+inline uint32_t sample_DWT() {
+    return DWT->CYCCNT;
+}
+#endif
+
+// Bucket i counts lengths in [2^i, 2^(i+1)). The last bucket also counts
+// everything above.
+#define TASK_TIMER_HISTOGRAM_SIZE 16
+
+struct TaskTimer : ODriveIntf::TaskTimerIntf {
     uint32_t start_time_ = 0;
     uint32_t end_time_ = 0;
     uint32_t length_ = 0;
     uint32_t max_length_ = 0;
 
+    uint32_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t sum_sq_ = 0;
+    uint32_t histogram_[TASK_TIMER_HISTOGRAM_SIZE] = {0};
+
     static bool enabled;
 
     uint32_t start() {
+        trace_buffer.record(get_trace_id());
+#if defined(TASK_TIMER_DWT)
+        return sample_DWT();
+#else
         return sample_TIM13();
+#endif
     }
 
     void stop(uint32_t start_time) {
+#if defined(TASK_TIMER_DWT)
+        uint32_t end_time = sample_DWT();
+#else
         uint32_t end_time = sample_TIM13();
+#endif
         uint32_t length = end_time - start_time;
+        trace_buffer.record(get_trace_id() | TRACE_FLAG_EXIT);
 
         if (enabled) {
 #ifdef MEASURE_START_TIME
@@ -44,6 +78,41 @@ struct TaskTimer {
 #ifdef MEASURE_MAX_LENGTH
         max_length_ = std::max(max_length_, length);
 #endif
+#ifdef MEASURE_STATISTICS
+        count_++;
+        sum_ += length;
+        sum_sq_ += (uint64_t)length * length;
+        uint32_t bucket = length ? 31 - __builtin_clz(length) : 0;
+        histogram_[std::min<uint32_t>(bucket, TASK_TIMER_HISTOGRAM_SIZE - 1)]++;
+#endif
+    }
+
+    uint32_t get_trace_id() {
+        return (uint32_t)reinterpret_cast<uintptr_t>(this);
+    }
+
+    float get_mean() {
+        return count_ ? (float)((double)sum_ / (double)count_) : NAN;
+    }
+
+    float get_variance() {
+        if (!count_) {
+            return NAN;
+        }
+        double mean = (double)sum_ / (double)count_;
+        return (float)((double)sum_sq_ / (double)count_ - mean * mean);
+    }
+
+    uint32_t get_histogram(uint32_t bucket) override {
+        return bucket < TASK_TIMER_HISTOGRAM_SIZE ? histogram_[bucket] : 0;
+    }
+
+    void reset() override {
+        max_length_ = 0;
+        count_ = 0;
+        sum_ = 0;
+        sum_sq_ = 0;
+        std::fill(std::begin(histogram_), std::end(histogram_), 0);
     }
 };
 
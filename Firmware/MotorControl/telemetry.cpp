@@ -0,0 +1,135 @@
+
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <cmsis_os.h>
+#include <communication/interface_usb.h>
+
+bool Telemetry::apply_config() {
+    config_.parent = this;
+    restart();
+    return true;
+}
+
+/**
+ * @brief Takes over the configuration and starts or stops streaming.
+ *
+ * This runs in the protocol thread, which can be preempted by update() but
+ * not the other way around. So once active_ is cleared no frame is in the
+ * making while the channels are resolved.
+ */
+void Telemetry::restart() {
+    active_ = false;
+
+    num_channels_ = std::clamp<uint32_t>(config_.num_channels, 1, TELEMETRY_MAX_CHANNELS);
+    for (size_t i = 0; i < num_channels_; ++i) {
+        channels_[i].resolve(config_.channels[i]);
+    }
+    decimation_ = std::max<uint32_t>(config_.decimation, 1);
+    decimation_count_ = 0;
+    encoding_ = config_.encoding;
+    std::copy(std::begin(config_.scales), std::end(config_.scales), scales_);
+    restarted_ = true;
+
+#if defined(USB_PROTOCOL_NATIVE)
+    active_ = config_.enabled;
+#endif
+}
+
+/**
+ * @brief Samples the channels into the queue. Called once per control loop
+ * iteration.
+ */
+void Telemetry::update(uint32_t loop_count) {
+    if (!active_ || ++decimation_count_ < decimation_) {
+        return;
+    }
+    decimation_count_ = 0;
+    uint16_t counter = counter_++;
+
+    size_t write = write_.load();
+    size_t next = (write + 1) % (TELEMETRY_QUEUE_SIZE + 1);
+    if (next == read_.load()) {
+        overrun_count_++;
+        return;
+    }
+
+    Slot& slot = queue_[write];
+    slot.frame.marker = TELEMETRY_FRAME_MARKER;
+    slot.frame.counter = counter;
+    slot.frame.loop_count = loop_count;
+    for (size_t i = 0; i < num_channels_; ++i) {
+        slot.frame.values[i] = channels_[i].read();
+    }
+    slot.length = offsetof(Frame, values) + num_channels_ * sizeof(float);
+    write_.store(next);
+}
+
+void Telemetry::sender_thread_wrapper(void* ctx) {
+    reinterpret_cast<Telemetry*>(ctx)->sender_thread();
+}
+
+void Telemetry::sender_thread() {
+    for (size_t buf = 0;; buf ^= 1) {
+        size_t read;
+        while ((read = read_.load()) == write_.load()) {
+            osDelay(1);
+        }
+
+        size_t length;
+        if (encoding_ == ENCODING_DELTA) {
+            length = encode_delta(queue_[read], tx_buf_[buf]);
+        } else {
+            length = queue_[read].length;
+            memcpy(tx_buf_[buf], &queue_[read].frame, length);
+        }
+        read_.store((read + 1) % (TELEMETRY_QUEUE_SIZE + 1));
+
+        if (length && usb_native_output_ptr->process_packet(tx_buf_[buf], length) == 0) {
+            frames_sent_++;
+        } else {
+            need_key_ = true; // the host can't apply the next delta
+        }
+    }
+}
+
+/**
+ * @brief Compresses a frame into a key frame or a delta frame.
+ * @returns The length of the encoded frame [bytes]
+ */
+size_t Telemetry::encode_delta(const Slot& slot, uint8_t* buffer) {
+    const Frame& frame = slot.frame;
+    bool key = restarted_.exchange(false) || need_key_
+            || frame.counter != (uint16_t)(prev_counter_ + 1)
+            || frames_since_key_ >= TELEMETRY_KEY_FRAME_INTERVAL;
+    size_t n = (slot.length - offsetof(Frame, values)) / sizeof(float);
+
+    size_t pos = 0;
+    pos += write_le<uint16_t>(key ? TELEMETRY_KEY_FRAME_MARKER : TELEMETRY_DELTA_FRAME_MARKER, buffer + pos);
+    pos += write_le<uint16_t>(frame.counter, buffer + pos);
+    if (key) {
+        pos += write_le<uint32_t>(frame.loop_count, buffer + pos);
+    } else {
+        pos += DeltaEncoder::put_varint(frame.loop_count - prev_loop_count_, buffer + pos, sizeof(tx_buf_[0]) - pos);
+    }
+    size_t cnt = encoder_.encode(frame.values, scales_, n, key, buffer + pos, sizeof(tx_buf_[0]) - pos);
+    if (!cnt) {
+        return 0;
+    }
+
+    need_key_ = false;
+    prev_counter_ = frame.counter;
+    prev_loop_count_ = frame.loop_count;
+    frames_since_key_ = key ? 0 : frames_since_key_ + 1;
+    return pos + cnt;
+}
+
+// @brief Starts the sender in a thread with a lower priority than the
+// communication threads, so that telemetry never delays a fibre response.
+void Telemetry::start_thread() {
+    osThreadDef(thread_def, sender_thread_wrapper, osPriorityBelowNormal, 0, 512 / sizeof(StackType_t));
+    osThreadCreate(osThread(thread_def), this);
+}
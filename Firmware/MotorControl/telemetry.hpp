@@ -0,0 +1,107 @@
+#ifndef __TELEMETRY_HPP
+#define __TELEMETRY_HPP
+
+#include <atomic>
+#include <autogen/interfaces.hpp>
+#include "endpoint_source.hpp"
+#include "telemetry_codec.hpp"
+
+#define TELEMETRY_MAX_CHANNELS 8
+#define TELEMETRY_QUEUE_SIZE 32 // frames
+#define TELEMETRY_KEY_FRAME_INTERVAL 64 // frames
+
+// First two bytes of a telemetry frame. Requests from the host always have
+// bit 7 set in this field and responses have bit 15 set, so the host can
+// tell the frames apart from fibre traffic.
+#define TELEMETRY_FRAME_MARKER 0x7454
+#define TELEMETRY_KEY_FRAME_MARKER 0x744B
+#define TELEMETRY_DELTA_FRAME_MARKER 0x7444
+
+/**
+ * @brief Streams up to TELEMETRY_MAX_CHANNELS properties, which are selected
+ * by their endpoint, on the native USB interface.
+ *
+ * update() samples the properties once every `decimation` control loop
+ * iterations into a lock-free queue. A low priority thread sends each sample
+ * as one packet of fixed size on the IN endpoint of the native interface.
+ * The F405 USB core has no endpoint left for a separate stream, so the frames
+ * start with TELEMETRY_FRAME_MARKER instead of a sequence number.
+ *
+ * If the host doesn't keep up, frames are dropped in the control loop. The
+ * frame counter lets the host detect this.
+ *
+ * With ENCODING_DELTA the sender thread compresses the frames with
+ * DeltaEncoder. A delta frame has a varint of the loop_count increment in
+ * place of loop_count and only follows a frame with the previous counter.
+ * After a gap and every TELEMETRY_KEY_FRAME_INTERVAL frames a key frame is
+ * sent, so the host can resume decoding.
+ */
+class Telemetry : public ODriveIntf::TelemetryIntf {
+public:
+    struct Config_t {
+        bool enabled = false;
+        uint32_t num_channels = 1;
+        endpoint_ref_t channels[TELEMETRY_MAX_CHANNELS];
+        uint32_t decimation = 8;
+        Encoding encoding = ENCODING_RAW;
+        float scales[TELEMETRY_MAX_CHANNELS] = {1e-3f, 1e-3f, 1e-3f, 1e-3f, 1e-3f, 1e-3f, 1e-3f, 1e-3f};
+
+        // custom setters
+        Telemetry* parent = nullptr;
+        void set_enabled(bool value) { enabled = value; parent->restart(); }
+    };
+
+    struct Frame {
+        uint16_t marker; // TELEMETRY_FRAME_MARKER
+        uint16_t counter; // counts all frames including dropped ones
+        uint32_t loop_count; // control loop iteration of the sample
+        float values[TELEMETRY_MAX_CHANNELS]; // only num_channels are sent
+    };
+
+    bool apply_config();
+    void restart();
+    void update(uint32_t loop_count);
+    void start_thread();
+
+    Config_t config_;
+    uint32_t frames_sent_ = 0;
+    uint32_t overrun_count_ = 0;
+
+private:
+    struct Slot {
+        Frame frame;
+        size_t length; // [bytes]
+    };
+
+    static void sender_thread_wrapper(void* ctx);
+    void sender_thread();
+    size_t encode_delta(const Slot& slot, uint8_t* buffer);
+
+    EndpointSource channels_[TELEMETRY_MAX_CHANNELS];
+    size_t num_channels_ = 1;
+    uint32_t decimation_ = 1;
+    uint32_t decimation_count_ = 0;
+    uint16_t counter_ = 0;
+    std::atomic<bool> active_ = false;
+    std::atomic<bool> restarted_ = false;
+    Encoding encoding_ = ENCODING_RAW;
+    float scales_[TELEMETRY_MAX_CHANNELS] = {};
+
+    // Written by update() and read by the sender thread
+    Slot queue_[TELEMETRY_QUEUE_SIZE + 1];
+    std::atomic<size_t> write_ = 0;
+    std::atomic<size_t> read_ = 0;
+
+    // The USB stack reads the packet after process_packet() returns, so the
+    // sender alternates between two buffers.
+    uint8_t tx_buf_[2][sizeof(Frame)];
+
+    // State of the sender thread for ENCODING_DELTA
+    DeltaEncoder encoder_;
+    bool need_key_ = true;
+    uint16_t prev_counter_ = 0;
+    uint32_t prev_loop_count_ = 0;
+    uint32_t frames_since_key_ = 0;
+};
+
+#endif // __TELEMETRY_HPP
@@ -0,0 +1,92 @@
+#ifndef __TELEMETRY_CODEC_HPP
+#define __TELEMETRY_CODEC_HPP
+
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Compact encoding of telemetry samples.
+ *
+ * Every value is quantized to int16 with a scale per channel. A key frame
+ * holds the quantized values, a delta frame their difference to the previous
+ * frame. Both are zigzag encoded, so that small numbers of either sign become
+ * small unsigned numbers, and packed as varints with 7 bits per byte. So a
+ * channel that changes by less than 64 steps between two samples takes one
+ * byte instead of four.
+ */
+class DeltaEncoder {
+public:
+    static constexpr size_t kMaxChannels = 8;
+    static constexpr size_t kMaxVarintSize = 5; // of a uint32_t
+
+    static int16_t quantize(float value, float scale) {
+        float q = std::round(value / scale);
+        if (std::isnan(q)) {
+            return 0;
+        }
+        return (int16_t)std::fmax(-32768.0f, std::fmin(32767.0f, q));
+    }
+
+    static uint32_t zigzag(int32_t value) {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    static int32_t unzigzag(uint32_t value) {
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    // Returns the number of bytes written or 0 if the buffer is too small.
+    static size_t put_varint(uint32_t value, uint8_t* buffer, size_t length) {
+        size_t n = 0;
+        do {
+            if (n >= length) {
+                return 0;
+            }
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            buffer[n++] = byte | (value ? 0x80 : 0x00);
+        } while (value);
+        return n;
+    }
+
+    // Returns the number of bytes read or 0 if the varint is incomplete.
+    static size_t get_varint(uint32_t* value, const uint8_t* buffer, size_t length) {
+        *value = 0;
+        for (size_t n = 0; n < length && n < kMaxVarintSize; ++n) {
+            *value |= (uint32_t)(buffer[n] & 0x7f) << (7 * n);
+            if (!(buffer[n] & 0x80)) {
+                return n + 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Encodes the values of one frame and remembers them as the
+     * reference of the next delta frame.
+     * @param key: Encode the values themselves instead of the difference to
+     *        the previous call.
+     * @returns The number of bytes written or 0 if the buffer is too small,
+     *          at most n * 3 bytes are needed.
+     */
+    size_t encode(const float* values, const float* scales, size_t n, bool key, uint8_t* buffer, size_t length) {
+        size_t pos = 0;
+        for (size_t i = 0; i < n && i < kMaxChannels; ++i) {
+            int16_t q = quantize(values[i], scales[i]);
+            int32_t v = key ? (int32_t)q : (int32_t)q - (int32_t)prev_[i];
+            size_t cnt = put_varint(zigzag(v), buffer + pos, length - pos);
+            if (!cnt) {
+                return 0;
+            }
+            pos += cnt;
+            prev_[i] = q;
+        }
+        return pos;
+    }
+
+private:
+    int16_t prev_[kMaxChannels] = {};
+};
+
+#endif // __TELEMETRY_CODEC_HPP
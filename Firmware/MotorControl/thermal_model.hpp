@@ -0,0 +1,85 @@
+#ifndef __THERMAL_MODEL_HPP
+#define __THERMAL_MODEL_HPP
+
+#include "current_limiter.hpp"
+#include <cmath>
+#include <algorithm>
+
+/**
+ * @brief First order thermal model of the hot spot of a motor winding or of
+ * the power stage, driven by the I^2*R losses.
+ *
+ * The model predicts the rise of the hot spot above a reference temperature:
+ *   tau * d(delta)/dt = P * R_th - delta
+ * The reference is the thermistor temperature if there is one. It lags the
+ * hot spot, but that slow part is measured, the fast part is modelled.
+ *
+ * The current limit is the current that, applied from now on for
+ * config_.horizon seconds, just reaches config_.temp_limit. Cold, this
+ * allows high currents for short bursts. Under a sustained load it
+ * converges on the continuous current.
+ */
+class ThermalModel : public CurrentLimiter {
+public:
+    struct Config_t {
+        bool enabled = false;
+        float thermal_resistance = 1.0f; // [K/W] from the hot spot to the reference
+        float time_constant = 10.0f; // [s]
+        float temp_limit = 120.0f; // [°C]
+        float ambient_temp = 40.0f; // [°C] reference if there is no thermistor
+        float horizon = 1.0f; // [s] how long the current limit may be applied for
+        float resistance = 0.0f; // [Ohm] loss resistance per phase, 0 for the motor phase resistance (motor model only)
+    };
+
+    /**
+     * @param power: Losses during the last period [W]
+     * @param loss_coefficient: Losses per squared current magnitude [W/A^2],
+     *        used for the current limit
+     * @param reference_temp: Temperature the rise refers to [°C], NaN to use
+     *        config_.ambient_temp
+     * @param dt: Time since the last update [s]
+     */
+    void update(float power, float loss_coefficient, float reference_temp, float dt) {
+        float k = std::min(dt / config_.time_constant, 1.0f);
+        if (!(k >= 0.0f)) {
+            k = 1.0f;
+        }
+        delta_temp_ += k * (power * config_.thermal_resistance - delta_temp_);
+        loss_coefficient_ = loss_coefficient;
+        reference_temp_ = std::isnan(reference_temp) ? config_.ambient_temp : reference_temp;
+        temperature_ = reference_temp_ + delta_temp_;
+    }
+
+    float get_current_limit(float base_current_lim) const override {
+        if (!config_.enabled) {
+            return base_current_lim;
+        }
+
+        // delta(h) = delta_ss + (delta - delta_ss) * exp(-h / tau)
+        // with delta_ss = loss_coefficient * I^2 * R_th
+        float decay = std::exp(-config_.horizon / config_.time_constant);
+        float allowed_rise = config_.temp_limit - reference_temp_ - delta_temp_ * decay;
+        float rise_per_current_sq = loss_coefficient_ * config_.thermal_resistance * (1.0f - decay);
+        if (!(allowed_rise > 0.0f)) {
+            return 0.0f;
+        }
+        if (!(rise_per_current_sq > 0.0f)) {
+            return base_current_lim;
+        }
+        return std::min(std::sqrt(allowed_rise / rise_per_current_sq), base_current_lim);
+    }
+
+    void reset() {
+        delta_temp_ = 0.0f;
+    }
+
+    Config_t config_;
+    float temperature_ = 0.0f; // [°C] predicted hot spot temperature
+    float delta_temp_ = 0.0f; // [K] rise above the reference temperature
+
+private:
+    float loss_coefficient_ = 0.0f; // [W/A^2]
+    float reference_temp_ = 0.0f; // [°C]
+};
+
+#endif // __THERMAL_MODEL_HPP
@@ -20,7 +20,7 @@ ThermistorCurrentLimiter::ThermistorCurrentLimiter(uint16_t adc_channel,
 
 void ThermistorCurrentLimiter::update() {
     const float normalized_voltage = get_adc_relative_voltage_ch(adc_channel_);
-    temperature_ = horner_poly_eval(normalized_voltage, coefficients_, num_coeffs_);
+    temperature_ = table_.eval(coefficients_, num_coeffs_, normalized_voltage);
 }
 
 bool ThermistorCurrentLimiter::do_checks() {
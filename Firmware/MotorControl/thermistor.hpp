@@ -4,6 +4,7 @@
 class Motor; // declared in motor.hpp
 
 #include "current_limiter.hpp"
+#include "poly_table.hpp"
 #include <autogen/interfaces.hpp>
 
 class ThermistorCurrentLimiter : public CurrentLimiter, public ODriveIntf::ThermistorCurrentLimiterIntf {
@@ -29,6 +30,9 @@ public:
     const float& temp_limit_upper_;
     const bool& enabled_;
     Motor* motor_ = nullptr; // set by Motor::apply_config()
+
+private:
+    PolyTable table_; // follows changes of the coefficients
 };
 
 class OnboardThermistorCurrentLimiter : public ThermistorCurrentLimiter, public ODriveIntf::OnboardThermistorCurrentLimiterIntf {
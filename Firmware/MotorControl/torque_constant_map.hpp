@@ -0,0 +1,111 @@
+#ifndef __TORQUE_CONSTANT_MAP_HPP
+#define __TORQUE_CONSTANT_MAP_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Torque of a motor whose torque constant drops at high current
+ * because the iron saturates.
+ *
+ * The breakpoints give the torque constant at a few currents. The torque
+ * (torque constant times current) is interpolated linearly between them and
+ * between the origin and the first breakpoint. Beyond the last breakpoint the
+ * slope of the last segment applies. The torque is odd in the current.
+ *
+ * Because the torque is piecewise linear in the current, current() is the
+ * exact inverse of torque(). Both are a short segment search and one
+ * multiply-add.
+ */
+template<size_t N>
+class TorqueConstantMap {
+public:
+    static_assert(N >= 1, "at least one breakpoint required");
+
+    struct Point {
+        float current; // [A] 0 for an unused breakpoint
+        float torque_constant; // [Nm/A] at this current
+    };
+
+    /**
+     * @brief Precomputes the segments. The used breakpoints must come first,
+     * in increasing order of current, and the torque must increase with the
+     * current. Otherwise returns false and leaves the map unchanged.
+     */
+    bool set(const Point (&points)[N]) {
+        size_t n = 0;
+        float current = 0.0f;
+        float torque = 0.0f;
+        for (size_t i = 0; i < N && points[i].current != 0.0f; ++i) {
+            float next_torque = points[i].current * points[i].torque_constant;
+            if (!(points[i].current > current) || !(next_torque > torque)) {
+                return false;
+            }
+            current = points[i].current;
+            torque = next_torque;
+            n++;
+        }
+        for (size_t i = n; i < N; ++i) {
+            if (points[i].current != 0.0f) {
+                return false; // used breakpoint after an unused one
+            }
+        }
+        if (n == 0) {
+            return false;
+        }
+
+        Segment segments[N];
+        Segment start = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (size_t i = 0; i < n; ++i) {
+            float end_current = points[i].current;
+            float end_torque = end_current * points[i].torque_constant;
+            start.slope = (end_torque - start.torque) / (end_current - start.current);
+            start.inv_slope = 1.0f / start.slope;
+            segments[i] = start;
+            start = {end_current, end_torque, 0.0f, 0.0f};
+        }
+        for (size_t i = 0; i < n; ++i) {
+            segments_[i] = segments[i];
+        }
+        n_segments_ = n;
+        return true;
+    }
+
+    // @brief Torque [Nm] at the current [A]
+    float torque(float current) const {
+        float abs_current = current < 0.0f ? -current : current;
+        size_t i = n_segments_ - 1;
+        while (i > 0 && abs_current < segments_[i].current) {
+            i--;
+        }
+        const Segment& s = segments_[i];
+        float abs_torque = s.torque + (abs_current - s.current) * s.slope;
+        return current < 0.0f ? -abs_torque : abs_torque;
+    }
+
+    // @brief Current [A] that produces the torque [Nm]
+    float current(float torque) const {
+        float abs_torque = torque < 0.0f ? -torque : torque;
+        size_t i = n_segments_ - 1;
+        while (i > 0 && abs_torque < segments_[i].torque) {
+            i--;
+        }
+        const Segment& s = segments_[i];
+        float abs_current = s.current + (abs_torque - s.torque) * s.inv_slope;
+        return torque < 0.0f ? -abs_current : abs_current;
+    }
+
+private:
+    struct Segment {
+        float current; // [A] start of the segment
+        float torque; // [Nm] at the start of the segment
+        float slope; // [Nm/A]
+        float inv_slope; // [A/Nm]
+    };
+
+    // Default: torque constant of 1 Nm/A, never used by the motor because
+    // the map is only active after a successful set()
+    Segment segments_[N] = {{0.0f, 0.0f, 1.0f, 1.0f}};
+    size_t n_segments_ = 1;
+};
+
+#endif // __TORQUE_CONSTANT_MAP_HPP
@@ -0,0 +1,90 @@
+#ifndef __TRACE_HPP
+#define __TRACE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <board.h>
+#include <autogen/interfaces.hpp>
+
+#if defined(ENABLE_TRACE)
+#define TRACE_BUFFER_SIZE 1024 // must be a power of two
+#else
+#define TRACE_BUFFER_SIZE 1
+#endif
+
+// Task timers are identified in the trace by their address which is always
+// 4-byte aligned and never in the range used for interrupts.
+#define TRACE_ID_IRQ(irqn) (0xff000000UL | ((uint32_t)((irqn) + 16) << 2))
+#define TRACE_FLAG_EXIT 1UL
+
+/**
+ * @brief Ring buffer of timestamped enter/exit events.
+ * 
+ * record() is lock-free and can be called from any interrupt priority. The
+ * oldest events are overwritten when the buffer is full. While tracing is
+ * enabled an event that is read back can be in the process of being
+ * overwritten so the host should disable tracing before reading the events.
+ * 
+ * Timestamps are taken from the DWT cycle counter (HCLK ticks).
+ */
+class TraceBuffer : public ODriveIntf::TraceBufferIntf {
+public:
+    void record(uint32_t id) {
+#if defined(ENABLE_TRACE)
+        if (!enabled_) {
+            return;
+        }
+        uint32_t timestamp = DWT->CYCCNT;
+        uint32_t index = write_index_.fetch_add(1, std::memory_order_relaxed);
+        events_[index & (TRACE_BUFFER_SIZE - 1)] = {timestamp, id};
+#else
+        (void)id;
+#endif
+    }
+
+    uint32_t get_write_index() {
+        return write_index_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the event with the specified absolute index (modulo 2^32)
+     * with the ID in the upper and the timestamp in the lower 32 bits.
+     */
+    uint64_t get_event(uint32_t index) override {
+        Event event = events_[index & (TRACE_BUFFER_SIZE - 1)];
+        return ((uint64_t)event.id << 32) | event.timestamp;
+    }
+
+    const uint32_t size_ = TRACE_BUFFER_SIZE;
+    volatile bool enabled_ = false;
+
+private:
+    struct Event {
+        uint32_t timestamp;
+        uint32_t id;
+    };
+
+    std::atomic<uint32_t> write_index_{0};
+    Event events_[TRACE_BUFFER_SIZE] = {};
+};
+
+extern TraceBuffer trace_buffer;
+
+struct TraceScope {
+    TraceScope(const TraceScope&) = delete;
+    TraceScope(const TraceScope&&) = delete;
+    void operator=(const TraceScope&) = delete;
+    void operator=(const TraceScope&&) = delete;
+    TraceScope(uint32_t id) : id_(id) { trace_buffer.record(id_); }
+    ~TraceScope() { trace_buffer.record(id_ | TRACE_FLAG_EXIT); }
+
+    uint32_t id_;
+};
+
+#if defined(ENABLE_TRACE)
+#define TRACE_IRQ(irqn) TraceScope __trace_scope{TRACE_ID_IRQ(irqn)}
+#else
+#define TRACE_IRQ(irqn) ((void)0)
+#endif
+
+#endif // __TRACE_HPP
@@ -1,5 +1,6 @@
 #include <cmath>
-#include "odrive_main.h"
+#include <algorithm>
+#include "trapTraj.hpp"
 #include "utils.hpp"
 
 // A sign function where input 0 has positive sign (not 0)
@@ -61,6 +62,31 @@ bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi,
     return true;
 }
 
+// Returns the duration of a move of length 1 from standstill. If that is
+// shorter than min_duration, Vmax is lowered such that the move takes
+// min_duration. The profile scales linearly with the distance, so moves with
+// the limits multiplied by their distance all have this duration and shape.
+float TrapezoidalTrajectory::planUnitMove(float* Vmax, float Amax, float Dmax, float min_duration) {
+    float k = 0.5f / Amax + 0.5f / Dmax; // distance of the ramps = k * Vr^2
+    float Tf;
+    if (k * SQ(*Vmax) <= 1.0f) {
+        Tf = *Vmax * 2.0f * k + (1.0f - k * SQ(*Vmax)) / *Vmax;
+    } else {
+        Tf = 2.0f * std::sqrt(k); // triangle profile
+    }
+
+    if (min_duration > Tf) {
+        // Solve Tf = 2 * k * Vr + (1 - k * Vr^2) / Vr = k * Vr + 1 / Vr for Vr
+        *Vmax = (min_duration - std::sqrt(SQ(min_duration) - 4.0f * k)) / (2.0f * k);
+        Tf = min_duration;
+    }
+    return Tf;
+}
+
+// Evaluated in closed form on every control loop iteration. Each phase costs
+// only a few multiply-adds. An incremental (forward differencing) variant
+// was not faster because every step depends on the stored result of the
+// previous one, and it needs periodic re-anchoring against this function.
 TrapezoidalTrajectory::Step_t TrapezoidalTrajectory::eval(float t) {
     Step_t trajStep;
     if (t < 0.0f) {  // Initial Condition
@@ -1,12 +1,17 @@
 #ifndef _TRAP_TRAJ_H
 #define _TRAP_TRAJ_H
 
+class Axis;
+
+// Doesn't depend on the rest of the firmware so that the same planner is
+// built into the host planning library (see Simulation/planning_lib.cpp).
 class TrapezoidalTrajectory {
 public:
     struct Config_t {
         float vel_limit = 2.0f;   // [turn/s]
         float accel_limit = 0.5f; // [turn/s^2]
         float decel_limit = 0.5f; // [turn/s^2]
+        float jerk_limit = 10.0f; // [turn/s^3] only used by INPUT_MODE_SCURVE_TRAJ
     };
     
     struct Step_t {
@@ -17,6 +22,7 @@ public:
 
     bool planTrapezoidal(float Xf, float Xi, float Vi,
                          float Vmax, float Amax, float Dmax);
+    static float planUnitMove(float* Vmax, float Amax, float Dmax, float min_duration);
     Step_t eval(float t);
 
     Axis* axis_ = nullptr;  // set by Axis constructor
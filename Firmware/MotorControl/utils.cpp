@@ -1,149 +1,60 @@
 
 #include <utils.hpp>
 #include <board.h>
+#include <arm_common_tables.h>
 
 
 // Compute rising edge timings (0.0 - 1.0) as a function of alpha-beta
 // as per the magnitude invariant clarke transform
 // The magnitude of the alpha-beta vector may not be larger than sqrt(3)/2
 // Returns true on success, and false if the input was out of range
-std::tuple<float, float, float, bool> SVM(float alpha, float beta) {
-    float tA, tB, tC;
-    int Sextant;
-
-    if (beta >= 0.0f) {
-        if (alpha >= 0.0f) {
-            //quadrant I
-            if (one_by_sqrt3 * beta > alpha)
-                Sextant = 2; //sextant v2-v3
-            else
-                Sextant = 1; //sextant v1-v2
-        } else {
-            //quadrant II
-            if (-one_by_sqrt3 * beta > alpha)
-                Sextant = 3; //sextant v3-v4
-            else
-                Sextant = 2; //sextant v2-v3
-        }
-    } else {
-        if (alpha >= 0.0f) {
-            //quadrant IV
-            if (-one_by_sqrt3 * beta > alpha)
-                Sextant = 5; //sextant v5-v6
-            else
-                Sextant = 6; //sextant v6-v1
-        } else {
-            //quadrant III
-            if (one_by_sqrt3 * beta > alpha)
-                Sextant = 4; //sextant v4-v5
-            else
-                Sextant = 5; //sextant v5-v6
-        }
-    }
-
-    switch (Sextant) {
-        // sextant v1-v2
-        case 1: {
-            // Vector on-times
-            float t1 = alpha - one_by_sqrt3 * beta;
-            float t2 = two_by_sqrt3 * beta;
-
-            // PWM timings
-            tA = (1.0f - t1 - t2) * 0.5f;
-            tB = tA + t1;
-            tC = tB + t2;
-        } break;
-
-        // sextant v2-v3
-        case 2: {
-            // Vector on-times
-            float t2 = alpha + one_by_sqrt3 * beta;
-            float t3 = -alpha + one_by_sqrt3 * beta;
-
-            // PWM timings
-            tB = (1.0f - t2 - t3) * 0.5f;
-            tA = tB + t3;
-            tC = tA + t2;
-        } break;
-
-        // sextant v3-v4
-        case 3: {
-            // Vector on-times
-            float t3 = two_by_sqrt3 * beta;
-            float t4 = -alpha - one_by_sqrt3 * beta;
-
-            // PWM timings
-            tB = (1.0f - t3 - t4) * 0.5f;
-            tC = tB + t3;
-            tA = tC + t4;
-        } break;
-
-        // sextant v4-v5
-        case 4: {
-            // Vector on-times
-            float t4 = -alpha + one_by_sqrt3 * beta;
-            float t5 = -two_by_sqrt3 * beta;
-
-            // PWM timings
-            tC = (1.0f - t4 - t5) * 0.5f;
-            tB = tC + t5;
-            tA = tB + t4;
-        } break;
-
-        // sextant v5-v6
-        case 5: {
-            // Vector on-times
-            float t5 = -alpha - one_by_sqrt3 * beta;
-            float t6 = alpha - one_by_sqrt3 * beta;
-
-            // PWM timings
-            tC = (1.0f - t5 - t6) * 0.5f;
-            tA = tC + t5;
-            tB = tA + t6;
-        } break;
-
-        // sextant v6-v1
-        case 6: {
-            // Vector on-times
-            float t6 = -two_by_sqrt3 * beta;
-            float t1 = alpha + one_by_sqrt3 * beta;
-
-            // PWM timings
-            tA = (1.0f - t6 - t1) * 0.5f;
-            tC = tA + t1;
-            tB = tC + t6;
-        } break;
-    }
-
-    bool result_valid =
-            tA >= 0.0f && tA <= 1.0f
-         && tB >= 0.0f && tB <= 1.0f
-         && tC >= 0.0f && tC <= 1.0f;
+// (the timings are still returned in this case and may lie outside [0, 1])
+RAMFUNC std::tuple<float, float, float, bool> SVM(float alpha, float beta) {
+    // Inverse clarke transform, negated and scaled by 2/3 so that the edge of
+    // the hexagon corresponds to a peak-to-peak span of 1.0
+    float uA = -(2.0f / 3.0f) * alpha;
+    float uB = (1.0f / 3.0f) * alpha - one_by_sqrt3 * beta;
+    float uC = (1.0f / 3.0f) * alpha + one_by_sqrt3 * beta;
+
+    // Min/max zero sequence injection. This is equivalent to centering the
+    // active vectors of the classic sextant based SVM.
+    float u_max = std::max(uA, std::max(uB, uC));
+    float u_min = std::min(uA, std::min(uB, uC));
+    float offset = 0.5f - 0.5f * (u_max + u_min);
+
+    float tA = uA + offset;
+    float tB = uB + offset;
+    float tC = uC + offset;
+
+    // Also false for NaN inputs
+    bool result_valid = (u_max - u_min) <= 1.0f;
     return {tA, tB, tC, result_valid};
 }
 
-// based on https://math.stackexchange.com/a/1105038/81278
-float fast_atan2(float y, float x) {
-    // a := min (|x|, |y|) / max (|x|, |y|)
-    float abs_y = std::abs(y);
-    float abs_x = std::abs(x);
-    // inject FLT_MIN in denominator to avoid division by zero
-    float a = std::min(abs_x, abs_y) / (std::max(abs_x, abs_y) + std::numeric_limits<float>::min());
-    // s := a * a
-    float s = a * a;
-    // r := ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a
-    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
-    // if |y| > |x| then r := 1.57079637 - r
-    if (abs_y > abs_x)
-        r = 1.57079637f - r;
-    // if x < 0 then r := 3.14159274 - r
-    if (x < 0.0f)
-        r = 3.14159274f - r;
-    // if y < 0 then r := -r
-    if (y < 0.0f)
-        r = -r;
-
-    return r;
+// Computes {sin(x), cos(x)} with a single range reduction and table lookup.
+// Uses the same table and linear interpolation as our_arm_sin_f32() and
+// our_arm_cos_f32(). The cosine is read from the sine table shifted by a
+// quarter turn.
+RAMFUNC std::pair<float, float> fast_sincos(float x) {
+    // Map input to [0 1) turns, rounding towards -infinity
+    float in = x * 0.159154943092f;
+    int32_t n = (int32_t)in;
+    if (in < 0.0f)
+        n--;
+    in -= (float)n;
+
+    float findex = (float)FAST_MATH_TABLE_SIZE * in;
+    uint32_t index = (uint32_t)findex;
+    float fract = findex - (float)index;
+    // when "in" rounds to exactly 1 the index wraps around to 0
+    index &= FAST_MATH_TABLE_SIZE - 1;
+    uint32_t index_c = (index + FAST_MATH_TABLE_SIZE / 4) & (FAST_MATH_TABLE_SIZE - 1);
+
+    // Written as a + fract * (b - a) so that each interpolation is a single
+    // fused multiply-add
+    float s = sinTable_f32[index] + fract * (sinTable_f32[index + 1] - sinTable_f32[index]);
+    float c = sinTable_f32[index_c] + fract * (sinTable_f32[index_c + 1] - sinTable_f32[index_c]);
+    return {s, c};
 }
 
 // @brief: Returns how much time is left until the deadline is reached.
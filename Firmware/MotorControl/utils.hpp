@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
+#include <cmath>
 #include <limits>
 #include <algorithm>
 #include <array>
@@ -64,7 +66,7 @@ constexpr float sqrt3_by_2 = 0.86602540378f;
 
 // Function prototypes for implementations in utils.cpp
 std::tuple<float, float, float, bool> SVM(float alpha, float beta);
-float fast_atan2(float y, float x);
+std::pair<float, float> fast_sincos(float x);
 uint32_t deadline_to_timeout(uint32_t deadline_ms);
 uint32_t timeout_to_deadline(uint32_t timeout_ms);
 int is_in_the_future(uint32_t time_ms);
@@ -139,6 +141,94 @@ inline float wrap_pm_pi(float x) {
     return wrap_pm(x, 2 * M_PI);
 }
 
+// Reduces atan2(y, x) to atan(a) for a in [0, 1], which atan_0_1 computes.
+// Inline so that callers which compute several angles at once can interleave them
+template<typename TAtan>
+inline float atan2_by_octant(float y, float x, TAtan atan_0_1) {
+    // a := min (|x|, |y|) / max (|x|, |y|)
+    float abs_y = std::abs(y);
+    float abs_x = std::abs(x);
+    // inject FLT_MIN in denominator to avoid division by zero
+    float a = std::min(abs_x, abs_y) / (std::max(abs_x, abs_y) + std::numeric_limits<float>::min());
+    float r = atan_0_1(a);
+    // if |y| > |x| then r := 1.57079637 - r
+    if (abs_y > abs_x)
+        r = 1.57079637f - r;
+    // if x < 0 then r := 3.14159274 - r
+    if (x < 0.0f)
+        r = 3.14159274f - r;
+    // if y < 0 then r := -r
+    if (y < 0.0f)
+        r = -r;
+
+    return r;
+}
+
+// There are three atan2 kernels, so that each caller can pick its trade-off
+// between accuracy and cycles. The maximum errors are checked in
+// Tests/test_fast_math.cpp, the cycles are measured by KernelBenchmark.
+
+// based on https://math.stackexchange.com/a/1105038/81278
+// Max error 2.1e-4 rad
+inline float fast_atan2(float y, float x) {
+    return atan2_by_octant(y, x, [](float a) {
+        // r := ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a
+        float s = a * a;
+        return ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    });
+}
+
+// atan(i / 64) for i = 0..64
+inline constexpr float atan_table[65] = {
+    0.0f, 0.0156237287f, 0.0312398337f, 0.0468407124f, 0.062418811f, 0.0779666305f, 0.0934767798f, 0.108941957f,
+    0.124354996f, 0.139708877f, 0.154996738f, 0.170211926f, 0.185347944f, 0.200398549f, 0.215357706f, 0.230219588f,
+    0.244978666f, 0.259629637f, 0.274167448f, 0.288587362f, 0.302884877f, 0.317055762f, 0.331096083f, 0.345002174f,
+    0.358770669f, 0.372398436f, 0.385882676f, 0.399220765f, 0.412410438f, 0.42544964f, 0.438336551f, 0.451069653f,
+    0.463647604f, 0.476069331f, 0.488333941f, 0.500440836f, 0.512389481f, 0.524179637f, 0.535811245f, 0.547284365f,
+    0.558599293f, 0.569756448f, 0.580756366f, 0.591599703f, 0.602287352f, 0.612820208f, 0.623199344f, 0.633425891f,
+    0.643501103f, 0.653426349f, 0.663203001f, 0.672832549f, 0.682316542f, 0.691656649f, 0.700854421f, 0.709911644f,
+    0.718829989f, 0.727611303f, 0.736257434f, 0.74477011f, 0.753151298f, 0.761402786f, 0.769526482f, 0.777524292f,
+    0.785398185f
+};
+
+// Linear interpolation in atan_table instead of the polynomial of
+// fast_atan2(): a shorter chain of FPU operations and ten times more
+// accurate, but two table reads. Max error 2.0e-5 rad
+inline float lut_atan2(float y, float x) {
+    return atan2_by_octant(y, x, [](float a) {
+        float findex = 64.0f * a;
+        // Clamped after the conversion, so that a = 1 interpolates to the
+        // last entry and NaN can't read out of bounds
+        uint32_t index = std::min((uint32_t)findex, 63u);
+        float fract = findex - (float)index;
+        return atan_table[index] + fract * (atan_table[index + 1] - atan_table[index]);
+    });
+}
+
+// Odd polynomial of degree 13, fitted for the minimax error on [0, 1].
+// Max error 5e-7 rad, which is about two steps of a float near pi.
+inline float precise_atan2(float y, float x) {
+    return atan2_by_octant(y, x, [](float a) {
+        float s = a * a;
+        return a * (0.99999613f + s * (-0.33317408f + s * (0.19808182f + s * (-0.13234772f
+                 + s * (0.079650380f + s * (-0.033627883f + s * 0.0068197795f))))));
+    });
+}
+
+// 1 / sqrt(x) for x > 0 from the exponent bit trick with two Newton steps.
+// Cheaper than the division and square root that it replaces on the M4,
+// which take 14 cycles each. Max relative error 5e-6
+inline float fast_rsqrt(float x) {
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86UL - (i >> 1);
+    float y;
+    memcpy(&y, &i, sizeof(y));
+    y *= 1.5f - 0.5f * x * y * y;
+    y *= 1.5f - 0.5f * x * y * y;
+    return y;
+}
+
 // Evaluate polynomials in an efficient way
 // coeffs[0] is highest order, as per numpy.polyfit
 // p(x) = coeffs[0] * x^deg + ... + coeffs[deg], for some degree "deg"
@@ -149,6 +239,21 @@ inline float horner_poly_eval(float x, const float *coeffs, size_t count) {
     return result;
 }
 
+// Linear position that keeps its resolution regardless of the distance
+// travelled (a plain float in [turn] loses resolution as it grows).
+struct TurnPosition {
+    int32_t turns;
+    float fraction; // [turn] in [0, 1]
+
+    float to_float() const { return (float)turns + fraction; }
+};
+
+// Returns `a - b` without rounding `b` to a float first. The subtraction of the
+// integer part is exact as long as `a` is close to `b`.
+inline float sub_turns(float a, TurnPosition b) {
+    return (a - (float)b.turns) - b.fraction;
+}
+
 // Modulo (as opposed to remainder), per https://stackoverflow.com/a/19288271
 inline int mod(const int dividend, const int divisor){
     int r = dividend % divisor;
@@ -0,0 +1,143 @@
+#ifndef __CAPTURE_FILE_HPP
+#define __CAPTURE_FILE_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Reader of the binary capture files (.odcap) that `odrivetool record`
+ * writes, to replay recorded encoder and current data into host simulations.
+ *
+ * See tools/odrive/capture.py for the layout. All samples are loaded into
+ * memory. A truncated last block (from an interrupted recording) is ignored,
+ * like in the Python reader.
+ */
+class CaptureFile {
+public:
+    static constexpr size_t kHeaderSize = 24;
+    static constexpr size_t kChannelNameLength = 40;
+    static constexpr size_t kChannelUnitLength = 8;
+
+    /**
+     * @brief Parses a capture file in memory. Returns false if it is not a
+     * capture file of a supported version.
+     */
+    bool load(const uint8_t* data, size_t length) {
+        channels_.clear();
+        units_.clear();
+        timestamps_.clear();
+        values_.clear();
+        if (length < kHeaderSize || memcmp(data, "ODCAP\0", 6) || read<uint16_t>(data + 6) != 1) {
+            return false;
+        }
+        size_t num_channels = read<uint16_t>(data + 8);
+        size_t info_length = read<uint32_t>(data + 12);
+        sample_rate_ = read<double>(data + 16);
+
+        size_t pos = kHeaderSize;
+        if (length < pos + num_channels * (kChannelNameLength + kChannelUnitLength) + info_length) {
+            return false;
+        }
+        for (size_t i = 0; i < num_channels; ++i) {
+            channels_.push_back(read_string(data + pos, kChannelNameLength));
+            units_.push_back(read_string(data + pos + kChannelNameLength, kChannelUnitLength));
+            pos += kChannelNameLength + kChannelUnitLength;
+        }
+        info_ = std::string((const char*)data + pos, info_length);
+        pos += align(info_length);
+
+        while (pos + 8 <= length && !memcmp(data + pos, "BLK\0", 4)) {
+            size_t num_samples = read<uint32_t>(data + pos + 4);
+            size_t values_length = num_samples * num_channels * sizeof(float);
+            if (length - pos - 8 < num_samples * sizeof(int64_t) + values_length) {
+                break; // truncated
+            }
+            pos += 8;
+            for (size_t i = 0; i < num_samples; ++i) {
+                timestamps_.push_back(read<int64_t>(data + pos + i * sizeof(int64_t)));
+            }
+            pos += num_samples * sizeof(int64_t);
+            for (size_t i = 0; i < num_samples * num_channels; ++i) {
+                values_.push_back(read<float>(data + pos + i * sizeof(float)));
+            }
+            pos += align(values_length);
+        }
+        return true;
+    }
+
+    bool open(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return load(data.data(), data.size());
+    }
+
+    size_t num_channels() const { return channels_.size(); }
+    size_t num_samples() const { return timestamps_.size(); }
+
+    // Returns the index of the channel or -1 if there is none of that name
+    int find_channel(const std::string& name) const {
+        for (size_t i = 0; i < channels_.size(); ++i) {
+            if (channels_[i] == name) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    int64_t timestamp_ns(size_t sample) const { return timestamps_[sample]; }
+    float value(size_t sample, size_t channel) const { return values_[sample * channels_.size() + channel]; }
+
+    /**
+     * @brief Returns the value of the channel at the given time, holding the
+     * last sample before it like the firmware holds a measurement until the
+     * next one. Before the first sample the first sample is returned.
+     * This lets a simulation run at another step size than the recording.
+     * The capture must not be empty.
+     */
+    float value_at(int64_t time_ns, size_t channel) const {
+        size_t lo = 0;
+        size_t hi = timestamps_.size();
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (timestamps_[mid] <= time_ns) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return value(lo, channel);
+    }
+
+    std::vector<std::string> channels_;
+    std::vector<std::string> units_;
+    std::string info_; // JSON
+    double sample_rate_ = 0.0; // [Hz] 0 if the samples are not regular
+
+private:
+    template<typename T>
+    static T read(const uint8_t* data) {
+        T value; // the file is little endian, like the host simulations
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static std::string read_string(const uint8_t* data, size_t max_length) {
+        return std::string((const char*)data, strnlen((const char*)data, max_length));
+    }
+
+    static size_t align(size_t length) {
+        return (length + 7) & ~(size_t)7;
+    }
+
+    std::vector<int64_t> timestamps_;
+    std::vector<float> values_;
+};
+
+#endif // __CAPTURE_FILE_HPP
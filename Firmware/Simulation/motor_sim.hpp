@@ -0,0 +1,160 @@
+#ifndef __MOTOR_SIM_HPP
+#define __MOTOR_SIM_HPP
+
+#include <stdint.h>
+#include <cmath>
+#include <array>
+
+/**
+ * @brief Plant model of a PMSM for software-in-the-loop tests on the host.
+ *
+ * C++ port of analysis/Simulation/MotorSim.py. The state is integrated with
+ * one Dormand-Prince step (the 5th order solution of scipy's RK45) per call
+ * to step(), with the inputs held constant over the step. The angles are
+ * mechanical except where noted. SI units are used throughout because this
+ * models physics, not the firmware.
+ *
+ * The alpha-beta interface models what the firmware sees through the
+ * inverter and the current sensors: it applies the stationary-frame voltage
+ * that the FOC outputs and returns the phase currents that the ADCs would
+ * measure.
+ */
+class MotorSim {
+public:
+    struct Params {
+        double J = 1e-4; // [kg m^2] moment of inertia
+        double b_coulomb = 0.0; // [Nm] Coulomb friction
+        double b_viscous = 0.01; // [Nm/(rad/s)] viscous friction
+        double R = 0.039; // [Ohm] phase resistance
+        double L_d = 1.57e-5; // [H]
+        double L_q = 1.57e-5; // [H]
+        double KV = 270.0; // [rpm/V]
+        uint32_t pole_pairs = 7;
+    };
+
+    struct State {
+        double theta = 0.0; // [rad]
+        double theta_dot = 0.0; // [rad/s]
+        double I_d = 0.0; // [A]
+        double I_q = 0.0; // [A]
+    };
+
+    explicit MotorSim(const Params& params)
+        : params_(params),
+          lambda_m_(2.0 * (8.27 / params.KV) / (3.0 * (double)params.pole_pairs)) {}
+
+    /**
+     * @brief Advances the simulation with voltages in the rotor frame.
+     * @param dt: Step size [s]
+     * @param V_d, V_q: Applied voltages [V]
+     * @param T_load: Load torque against the motor torque [Nm]
+     */
+    void step(double dt, double V_d, double V_q, double T_load) {
+        // Dormand-Prince tableau, as in scipy.integrate.RK45. The system is
+        // time invariant so the time increments (C) are not needed.
+        static constexpr double A[6][5] = {
+            {0.0, 0.0, 0.0, 0.0, 0.0},
+            {1.0 / 5.0, 0.0, 0.0, 0.0, 0.0},
+            {3.0 / 40.0, 9.0 / 40.0, 0.0, 0.0, 0.0},
+            {44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0, 0.0, 0.0},
+            {19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0, 0.0},
+            {9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0},
+        };
+        static constexpr double B[6] = {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0};
+
+        Vec y = to_vec(state_);
+        Vec K[6];
+        for (size_t s = 0; s < 6; ++s) {
+            Vec y_s = y;
+            for (size_t j = 0; j < s; ++j) {
+                for (size_t i = 0; i < 4; ++i) {
+                    y_s[i] += dt * A[s][j] * K[j][i];
+                }
+            }
+            K[s] = derivatives(y_s, V_d, V_q, T_load);
+        }
+        for (size_t s = 0; s < 6; ++s) {
+            for (size_t i = 0; i < 4; ++i) {
+                y[i] += dt * B[s] * K[s][i];
+            }
+        }
+        state_ = {y[0], y[1], y[2], y[3]};
+    }
+
+    /**
+     * @brief Advances the simulation with a voltage in the stationary frame.
+     *
+     * The voltage is transformed with the electrical angle at the start of
+     * the step.
+     */
+    void step_alpha_beta(double dt, double V_alpha, double V_beta, double T_load) {
+        double c = std::cos(get_electrical_angle());
+        double s = std::sin(get_electrical_angle());
+        step(dt, c * V_alpha + s * V_beta, c * V_beta - s * V_alpha, T_load);
+    }
+
+    /**
+     * @brief Returns the phase currents A, B and C [A].
+     */
+    std::array<double, 3> get_phase_currents() const {
+        double c = std::cos(get_electrical_angle());
+        double s = std::sin(get_electrical_angle());
+        double I_alpha = c * state_.I_d - s * state_.I_q;
+        double I_beta = s * state_.I_d + c * state_.I_q;
+        return {
+            I_alpha,
+            -0.5 * I_alpha + (std::sqrt(3.0) / 2.0) * I_beta,
+            -0.5 * I_alpha - (std::sqrt(3.0) / 2.0) * I_beta
+        };
+    }
+
+    double get_electrical_angle() const { return state_.theta * (double)params_.pole_pairs; } // [rad]
+    double get_lambda_m() const { return lambda_m_; } // [Vs/rad] flux linkage, per electrical rad
+
+    /**
+     * @brief Returns the torque that the currents produce [Nm].
+     */
+    double get_torque() const {
+        return 1.5 * (double)params_.pole_pairs
+             * (lambda_m_ * state_.I_q + (params_.L_d - params_.L_q) * state_.I_d * state_.I_q);
+    }
+
+    State state_;
+
+private:
+    using Vec = std::array<double, 4>;
+
+    static Vec to_vec(const State& state) {
+        return {state.theta, state.theta_dot, state.I_d, state.I_q};
+    }
+
+    static double sign(double x) {
+        return x > 0.0 ? 1.0 : x < 0.0 ? -1.0 : 0.0;
+    }
+
+    Vec derivatives(const Vec& y, double V_d, double V_q, double T_load) const {
+        const Params& p = params_;
+        double theta_dot = y[1];
+        double I_d = y[2];
+        double I_q = y[3];
+        double omega_e = theta_dot * (double)p.pole_pairs;
+
+        double torque = 1.5 * (double)p.pole_pairs * (lambda_m_ * I_q + (p.L_d - p.L_q) * I_d * I_q) - T_load;
+
+        // Static friction holds the rotor
+        if (theta_dot == 0.0 && torque > -p.b_coulomb && torque < p.b_coulomb) {
+            torque = 0.0;
+        }
+
+        double theta_ddot = (torque - p.b_viscous * theta_dot - p.b_coulomb * sign(theta_dot)) / p.J;
+        double I_d_dot = (V_d - p.R * I_d + omega_e * p.L_q * I_q) / p.L_d;
+        double I_q_dot = (V_q - p.R * I_q - omega_e * p.L_d * I_d - omega_e * lambda_m_) / p.L_q;
+
+        return {theta_dot, theta_ddot, I_d_dot, I_q_dot};
+    }
+
+    Params params_;
+    double lambda_m_;
+};
+
+#endif // __MOTOR_SIM_HPP
@@ -0,0 +1,116 @@
+#include "planning_lib.h"
+#include <MotorControl/trapTraj.hpp>
+#include <MotorControl/scurve_traj.hpp>
+#include <cmath>
+
+// Incremented when the interface changes
+#define PLANNING_LIB_VERSION 1
+
+static void save_plan(const TrapezoidalTrajectory& traj, odrive_trap_plan_t* plan) {
+    *plan = {
+        traj.Xi_, traj.Xf_, traj.Vi_,
+        traj.Ar_, traj.Vr_, traj.Dr_,
+        traj.Ta_, traj.Tv_, traj.Td_, traj.Tf_,
+        traj.yAccel_
+    };
+}
+
+static TrapezoidalTrajectory load_plan(const odrive_trap_plan_t* plan) {
+    TrapezoidalTrajectory traj;
+    traj.Xi_ = plan->Xi;
+    traj.Xf_ = plan->Xf;
+    traj.Vi_ = plan->Vi;
+    traj.Ar_ = plan->Ar;
+    traj.Vr_ = plan->Vr;
+    traj.Dr_ = plan->Dr;
+    traj.Ta_ = plan->Ta;
+    traj.Tv_ = plan->Tv;
+    traj.Td_ = plan->Td;
+    traj.Tf_ = plan->Tf;
+    traj.yAccel_ = plan->yAccel;
+    return traj;
+}
+
+int odrive_planning_version(void) {
+    return PLANNING_LIB_VERSION;
+}
+
+/**
+ * @brief Plans a move like Controller does for INPUT_MODE_TRAP_TRAJ.
+ * Returns 0 if the planner rejected the move.
+ */
+int odrive_plan_trap(float Xf, float Xi, float Vi, float Vmax, float Amax, float Dmax,
+                     odrive_trap_plan_t* plan) {
+    TrapezoidalTrajectory traj;
+    bool ok = traj.planTrapezoidal(Xf, Xi, Vi, Vmax, Amax, Dmax);
+    save_plan(traj, plan);
+    return ok && std::isfinite(traj.Tf_);
+}
+
+// @brief Evaluates a plan at the n times in t. Any of the outputs may be null.
+void odrive_eval_trap(const odrive_trap_plan_t* plan, const float* t, size_t n,
+                      float* Y, float* Yd, float* Ydd) {
+    TrapezoidalTrajectory traj = load_plan(plan);
+    for (size_t i = 0; i < n; ++i) {
+        TrapezoidalTrajectory::Step_t step = traj.eval(t[i]);
+        if (Y) Y[i] = step.Y;
+        if (Yd) Yd[i] = step.Yd;
+        if (Ydd) Ydd[i] = step.Ydd;
+    }
+}
+
+/**
+ * @brief Plans n moves of ODRIVE_TRAP_MOVE_SIZE floats each and writes their
+ * durations. Rejected moves get a duration of NAN.
+ * Returns the number of moves that were planned successfully.
+ */
+size_t odrive_plan_trap_batch(const float* moves, size_t n, float* durations) {
+    size_t n_ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const float* m = moves + i * ODRIVE_TRAP_MOVE_SIZE;
+        odrive_trap_plan_t plan;
+        if (odrive_plan_trap(m[0], m[1], m[2], m[3], m[4], m[5], &plan)) {
+            durations[i] = plan.Tf;
+            n_ok++;
+        } else {
+            durations[i] = NAN;
+        }
+    }
+    return n_ok;
+}
+
+/**
+ * @brief Plans a move like Controller does for INPUT_MODE_SCURVE_TRAJ and
+ * evaluates it at the n times in t. Any of the outputs may be null.
+ * Returns 0 if the planner rejected the move.
+ */
+int odrive_eval_scurve(float Xf, float Xi, float Vi, float Vmax, float Amax, float Dmax, float Jmax,
+                       const float* t, size_t n, float* Y, float* Yd, float* Ydd, float* Tf) {
+    SCurveTrajectory traj;
+    if (!traj.plan(Xf, Xi, Vi, Vmax, Amax, Dmax, Jmax)) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        SCurveTrajectory::Step_t step = traj.eval(t[i]);
+        if (Y) Y[i] = step.Y;
+        if (Yd) Yd[i] = step.Yd;
+        if (Ydd) Ydd[i] = step.Ydd;
+    }
+    if (Tf) *Tf = traj.Tf_;
+    return 1;
+}
+
+// @brief Like odrive_plan_trap_batch() with ODRIVE_SCURVE_MOVE_SIZE floats per move.
+size_t odrive_plan_scurve_batch(const float* moves, size_t n, float* durations) {
+    size_t n_ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const float* m = moves + i * ODRIVE_SCURVE_MOVE_SIZE;
+        if (odrive_eval_scurve(m[0], m[1], m[2], m[3], m[4], m[5], m[6], nullptr, 0,
+                               nullptr, nullptr, nullptr, &durations[i])) {
+            n_ok++;
+        } else {
+            durations[i] = NAN;
+        }
+    }
+    return n_ok;
+}
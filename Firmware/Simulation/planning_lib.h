@@ -0,0 +1,49 @@
+#ifndef __PLANNING_LIB_H
+#define __PLANNING_LIB_H
+
+/**
+ * C interface of the firmware trajectory planners for host tools, built as
+ * a shared library with `CONFIG_PLANNING_LIB=true` (see Tupfile.lua) and
+ * wrapped by tools/odrive/planning.py.
+ *
+ * The planners are the same code that runs on the ODrive, so durations and
+ * setpoints match the firmware up to the rounding of the control loop period.
+ * Moves are passed as rows of floats so that large batches take one call.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of floats per row of odrive_plan_trap_batch(): Xf, Xi, Vi, Vmax, Amax, Dmax
+#define ODRIVE_TRAP_MOVE_SIZE 6
+// Number of floats per row of odrive_plan_scurve_batch(): Xf, Xi, Vi, Vmax, Amax, Dmax, Jmax
+#define ODRIVE_SCURVE_MOVE_SIZE 7
+
+// State of TrapezoidalTrajectory after planning
+typedef struct {
+    float Xi, Xf, Vi;
+    float Ar, Vr, Dr; // reached acceleration, velocity and deceleration (signed)
+    float Ta, Tv, Td, Tf; // [s] duration of the phases and of the whole move
+    float yAccel; // position at the end of the acceleration phase
+} odrive_trap_plan_t;
+
+int odrive_planning_version(void);
+
+int odrive_plan_trap(float Xf, float Xi, float Vi, float Vmax, float Amax, float Dmax,
+                     odrive_trap_plan_t* plan);
+void odrive_eval_trap(const odrive_trap_plan_t* plan, const float* t, size_t n,
+                      float* Y, float* Yd, float* Ydd);
+size_t odrive_plan_trap_batch(const float* moves, size_t n, float* durations);
+
+int odrive_eval_scurve(float Xf, float Xi, float Vi, float Vmax, float Amax, float Dmax, float Jmax,
+                       const float* t, size_t n, float* Y, float* Yd, float* Ydd, float* Tf);
+size_t odrive_plan_scurve_batch(const float* moves, size_t n, float* durations);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PLANNING_LIB_H
@@ -0,0 +1,22 @@
+#ifndef __SIL_ARM_COMMON_TABLES_H
+#define __SIL_ARM_COMMON_TABLES_H
+
+// The CMSIS sine table that fast_sincos() interpolates. The firmware links
+// the one of the CMSIS DSP library, the SIL build fills the same table on
+// startup (see sil_bench.cpp).
+
+#define FAST_MATH_TABLE_SIZE 512
+
+typedef float float32_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIL_ARM_COMMON_TABLES_H
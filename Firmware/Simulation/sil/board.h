@@ -0,0 +1,56 @@
+/*
+* @brief Simulated board layer for the software-in-the-loop host build
+*
+* Replaces Board/v3/Inc/board.h on the include path of the SIL build (see
+* Tupfile.lua). The timer constants are the ones of ODrive v3 so that the
+* control code runs with the same periods as on the hardware. The ADC,
+* timers and gate drivers are replaced by the plant model in SilBench.
+*/
+
+#ifndef __BOARD_CONFIG_H
+#define __BOARD_CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cmsis_os.h"
+
+#define AXIS_COUNT (2)
+
+#define CCM_DATA
+#define RAMFUNC
+
+#define TIM_1_8_CLOCK_HZ 168000000
+#define TIM_1_8_PERIOD_CLOCKS 3500
+#define TIM_1_8_RCR 2
+
+#define DEFAULT_PWM_FREQUENCY ((float)TIM_1_8_CLOCK_HZ / (float)(2 * TIM_1_8_PERIOD_CLOCKS)) // [Hz]
+#define DEFAULT_CURRENT_MEAS_PERIOD ((float)(2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1)) / (float)TIM_1_8_CLOCK_HZ) // [s]
+#define CONTROL_TIMER_PERIOD_TICKS  (2 * pwm_period_clocks * (TIM_1_8_RCR + 1))
+#define MAX_CONTROL_LOOP_UPDATE_TO_CURRENT_UPDATE_DELTA ((int32_t)(pwm_period_clocks / 2 + 1 * 128))
+
+// The simulation runs the control loop and the current control in one
+// thread, so there is nothing to lock out.
+#define CRITICAL_SECTION() if (true)
+
+extern uint32_t pwm_period_clocks; // [timer ticks]
+extern float current_meas_period; // [s]
+
+// Time base of micros(): the HAL tick [ms] and the timer counting the [us]
+// within it. Both follow the simulated time.
+typedef struct { volatile uint32_t CNT; } SilTimer_t;
+extern SilTimer_t sil_time_base;
+#define TIM_TIME_BASE (&sil_time_base)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t HAL_GetTick(void);
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+#include "sil_motor.hpp"
+#endif
+
+#endif // __BOARD_CONFIG_H
@@ -0,0 +1,25 @@
+#ifndef __SIL_CMSIS_OS_H
+#define __SIL_CMSIS_OS_H
+
+// RTOS calls of the control code, for the single threaded SIL build. The
+// system tick is the simulated time.
+
+#include <stdint.h>
+
+#define osKernelSysTickFrequency 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t osKernelSysTick(void); // [ms] defined in sil_bench.cpp
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline void osThreadSuspendAll(void) {}
+static inline int32_t osThreadResumeAll(void) { return 0; }
+static inline int32_t osDelay(uint32_t millisec) { (void)millisec; return 0; }
+
+#endif // __SIL_CMSIS_OS_H
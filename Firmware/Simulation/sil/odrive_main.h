@@ -0,0 +1,76 @@
+#ifndef __ODRIVE_MAIN_H
+#define __ODRIVE_MAIN_H
+
+/**
+ * Replaces MotorControl/odrive_main.h in the software-in-the-loop host build
+ * (see Tupfile.lua and SilBench). It declares the parts of the firmware that
+ * the real Controller, TrapezoidalTrajectory and FieldOrientedController
+ * reach through odrive_main.h. Motor and Encoder are stand-ins declared in
+ * sil_motor.hpp, Axis and ODrive below only hold the components.
+ */
+
+// Simulated board layer
+#include <board.h>
+#include <cmsis_os.h>
+
+// Forward Declarations
+class Axis;
+
+#include <autogen/interfaces.hpp>
+
+#include <MotorControl/utils.hpp>
+#include <MotorControl/component.hpp>
+#include <MotorControl/controller.hpp>
+#include <MotorControl/trapTraj.hpp>
+#include <MotorControl/frequency_response.hpp>
+#include <MotorControl/operations.hpp>
+#include <MotorControl/event_log.hpp>
+
+#include <array>
+
+// Declared by low_level.h in the firmware, set by SilBench
+extern float vbus_voltage; // [V]
+extern float ibus_; // [A]
+
+class Axis : public ODriveIntf::AxisIntf {
+public:
+    Axis(int axis_num);
+
+    bool apply_config();
+    void start_closed_loop_control();
+    void stop_closed_loop_control();
+    void control_loop_cb(uint32_t timestamp);
+
+    void watchdog_feed() override {}
+    uint32_t request_state_async(AxisState state) override { return 0; }
+
+    int axis_num_;
+    Error error_ = ERROR_NONE;
+    AxisState requested_state_ = AXIS_STATE_UNDEFINED;
+    AxisState current_state_ = AXIS_STATE_IDLE;
+
+    Motor motor_;
+    Encoder encoder_;
+    Controller controller_;
+    TrapezoidalTrajectory trap_traj_;
+    FrequencyResponse frequency_response_;
+
+    // The SIL motor is a PMSM, the controller only reads the flux of an ACIM
+    struct {
+        float rotor_flux_ = 0.0f; // [A]
+    } acim_estimator_;
+};
+
+extern std::array<Axis, AXIS_COUNT> axes; // defined in sil_bench.cpp
+
+class ODrive {
+public:
+    Axis& get_axis(int num) { return axes[num]; }
+
+    Operations operations_;
+    uint32_t n_evt_control_loop_ = 0;
+};
+
+extern ODrive odrv; // defined in sil_bench.cpp
+
+#endif /* __ODRIVE_MAIN_H */
@@ -0,0 +1,167 @@
+#include "sil_bench.hpp"
+#include <arm_common_tables.h>
+
+uint32_t pwm_period_clocks = TIM_1_8_PERIOD_CLOCKS;
+float current_meas_period = DEFAULT_CURRENT_MEAS_PERIOD;
+float vbus_voltage = 24.0f;
+float ibus_ = 0.0f;
+
+std::array<Axis, AXIS_COUNT> axes{{{0}, {1}}};
+ODrive odrv;
+EventLog event_log;
+
+float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+static bool init_sin_table() {
+    for (size_t i = 0; i <= FAST_MATH_TABLE_SIZE; ++i) {
+        sinTable_f32[i] = (float32_t)std::sin(2.0 * M_PI * (double)i / (double)FAST_MATH_TABLE_SIZE);
+    }
+    return true;
+}
+static bool sin_table_initialized = init_sin_table();
+
+SilTimer_t sil_time_base = {0};
+
+// Simulated time since startup [us]
+static uint64_t sil_time_us() {
+    return 1000000ull * (uint64_t)odrv.n_evt_control_loop_ * (uint64_t)CONTROL_TIMER_PERIOD_TICKS / (uint64_t)TIM_1_8_CLOCK_HZ;
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(sil_time_us() / 1000);
+}
+
+uint32_t osKernelSysTick(void) {
+    return HAL_GetTick();
+}
+
+Axis::Axis(int axis_num) : axis_num_(axis_num) {
+    controller_.axis_ = this;
+    trap_traj_.axis_ = this;
+    frequency_response_.axis_ = this;
+}
+
+bool Axis::apply_config() {
+    controller_.update_period_ = current_meas_period;
+    return motor_.apply_config()
+        && encoder_.apply_config()
+        && controller_.apply_config();
+}
+
+/**
+ * @brief Connects the components as Axis::update_control_pipeline() does for
+ * closed loop control with the encoder, and arms the motor.
+ */
+void Axis::start_closed_loop_control() {
+    controller_.pos_estimate_linear_src_.connect_to(&encoder_.pos_estimate_);
+    controller_.pos_estimate_linear_turns_src_.connect_to(&encoder_.pos_estimate_turns_);
+    controller_.vel_estimate_src_.connect_to(&encoder_.vel_estimate_);
+
+    controller_.reset();
+    if (controller_.config_.control_mode >= Controller::CONTROL_MODE_POSITION_CONTROL) {
+        controller_.apply_input_command();
+        float pos = encoder_.pos_estimate_.any().value_or(0.0f);
+        controller_.pos_setpoint_ = pos;
+        controller_.input_pos_ = pos;
+    }
+    controller_.input_pos_updated();
+
+    motor_.torque_setpoint_src_.connect_to(&controller_.torque_output_);
+    motor_.current_control_.enable_current_control_src_ = true;
+    motor_.current_control_.Idq_setpoint_src_.connect_to(&motor_.Idq_setpoint_);
+    motor_.current_control_.Vdq_setpoint_src_.connect_to(&motor_.Vdq_setpoint_);
+    motor_.current_control_.phase_src_.connect_to(&encoder_.phase_);
+    motor_.current_control_.phase_vel_src_.connect_to(&encoder_.phase_vel_);
+
+    motor_.arm();
+    current_state_ = AXIS_STATE_CLOSED_LOOP_CONTROL;
+}
+
+void Axis::stop_closed_loop_control() {
+    motor_.disarm();
+    current_state_ = AXIS_STATE_IDLE;
+}
+
+// @brief Runs the control stages after the sensor update (see SilBench::step()).
+// The errors are reported by the components, as in the firmware.
+void Axis::control_loop_cb(uint32_t timestamp) {
+    if (current_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+        bool ok = controller_.update();
+        motor_.update(timestamp);
+        if (!ok || motor_.error_ != Motor::ERROR_NONE) {
+            stop_closed_loop_control();
+        }
+    }
+    motor_.current_control_.update(timestamp);
+}
+
+SilBench::SilBench(const MotorSim::Params& params, size_t axis_num)
+    : plant_(params), axis_(axes[axis_num]) {}
+
+void SilBench::step() {
+    control_loop_epoch++;
+    odrv.n_evt_control_loop_++;
+    sil_time_base.CNT = (uint32_t)(sil_time_us() % 1000);
+    vbus_voltage = vbus_voltage_;
+
+    // Current measurement at the start of the period
+    std::array<double, 3> currents = plant_.get_phase_currents();
+    Measurement<std::array<float, 3>> meas;
+    meas.currents = {(float)currents[0], (float)currents[1], (float)currents[2]};
+    meas.vbus_voltage = vbus_voltage_;
+    meas.timestamp = timestamp_;
+    meas.valid = Measurement<std::array<float, 3>>::kVbusValid | Measurement<std::array<float, 3>>::kCurrentsValid;
+    if (axis_.motor_.is_armed_) {
+        Motor::Error err = static_cast<PhaseControlLaw<3>&>(axis_.motor_.current_control_).on_measurement(meas);
+        if (err != Motor::ERROR_NONE) {
+            axis_.motor_.error_ |= err;
+        }
+    }
+
+    axis_.encoder_.update((float)plant_.state_.theta);
+    axis_.control_loop_cb(timestamp_);
+
+    // Apply the timings of the previous iteration and compute the next ones,
+    // centered on the period in which they take effect (see board.cpp)
+    float Va = vbus_voltage_ * (1.0f - pwm_timings_[0]);
+    float Vb = vbus_voltage_ * (1.0f - pwm_timings_[1]);
+    float Vc = vbus_voltage_ * (1.0f - pwm_timings_[2]);
+    double V_alpha = (2.0 / 3.0) * (Va - 0.5 * (Vb + Vc));
+    double V_beta = (Vb - Vc) / std::sqrt(3.0);
+
+    bool pwm_enabled = pwm_enabled_;
+    pwm_enabled_ = false;
+    float next_timings[3] = {0.5f, 0.5f, 0.5f};
+    if (axis_.motor_.is_armed_) {
+        uint32_t output_timestamp = timestamp_ + 3 * pwm_period_clocks * (TIM_1_8_RCR + 1);
+        Motor::Error err = static_cast<PhaseControlLaw<3>&>(axis_.motor_.current_control_).get_output(output_timestamp, next_timings, &ibus_);
+        if (err == Motor::ERROR_NONE) {
+            pwm_enabled_ = true;
+        } else {
+            axis_.motor_.error_ |= err;
+            axis_.stop_closed_loop_control();
+        }
+    }
+
+    double dt = (double)current_meas_period / (double)plant_substeps_;
+    for (size_t i = 0; i < plant_substeps_; ++i) {
+        plant_.step_alpha_beta(dt, V_alpha, V_beta, load_torque_);
+        if (!pwm_enabled) {
+            // The bridge is off. The back EMF stays below the DC bus
+            // voltage, so no current flows through the body diodes.
+            plant_.state_.I_d = 0.0;
+            plant_.state_.I_q = 0.0;
+        }
+    }
+
+    std::copy(std::begin(next_timings), std::end(next_timings), pwm_timings_);
+    timestamp_ += CONTROL_TIMER_PERIOD_TICKS;
+    n_steps_++;
+}
+
+void SilBench::run(float duration) {
+    uint64_t n = (uint64_t)std::round(duration / current_meas_period);
+    for (uint64_t i = 0; i < n; ++i) {
+        step();
+    }
+}
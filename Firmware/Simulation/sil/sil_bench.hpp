@@ -0,0 +1,44 @@
+#ifndef __SIL_BENCH_HPP
+#define __SIL_BENCH_HPP
+
+#include <odrive_main.h>
+#include <Simulation/motor_sim.hpp>
+
+/**
+ * @brief Runs the control loop of one axis against the plant model.
+ *
+ * Each control loop period of current_meas_period:
+ *  1. The phase currents of the plant are sampled and handed to the FOC, as
+ *     Motor::fast_checks_cb() does with the ADC measurement.
+ *  2. The encoder, the controller, the motor and the FOC update in the order
+ *     of Axis::update_control_pipeline().
+ *  3. The FOC computes the PWM timings for the output timestamp that
+ *     board.cpp uses. The timings take effect one period later, like the
+ *     preloaded timer compare registers, and are held over that period.
+ *
+ * The inverter is ideal: the plant sees the mean phase voltages of the PWM
+ * timings at the DC bus voltage vbus_voltage_. While the motor is disarmed
+ * the bridge is off and no current flows.
+ */
+class SilBench {
+public:
+    explicit SilBench(const MotorSim::Params& params, size_t axis_num = 0);
+
+    void step();
+    void run(float duration); // [s]
+
+    float time() const { return (float)n_steps_ * current_meas_period; } // [s]
+
+    MotorSim plant_;
+    Axis& axis_;
+    float vbus_voltage_ = 24.0f; // [V]
+    float load_torque_ = 0.0f; // [Nm] against the motor torque
+    size_t plant_substeps_ = 4; // integration steps of the plant per control loop period
+
+    uint64_t n_steps_ = 0;
+    uint32_t timestamp_ = 0; // [HCLK ticks] of the current measurement
+    float pwm_timings_[3] = {0.5f, 0.5f, 0.5f}; // applied over the current period
+    bool pwm_enabled_ = false; // false if the bridge is off over the current period
+};
+
+#endif // __SIL_BENCH_HPP
@@ -0,0 +1,77 @@
+#include <odrive_main.h>
+
+bool Motor::apply_config() {
+    float p_gain = config_.current_control_bandwidth * config_.phase_inductance;
+    float plant_pole = config_.phase_resistance / config_.phase_inductance;
+    current_control_.pi_gains_ = {p_gain, plant_pole * p_gain};
+    current_control_.current_control_bandwidth_ = config_.current_control_bandwidth;
+    return true;
+}
+
+void Motor::arm() {
+    current_control_.reset();
+    is_armed_ = true;
+}
+
+void Motor::disarm() {
+    is_armed_ = false;
+}
+
+void Motor::update(uint32_t timestamp) {
+    std::optional<float> torque = torque_setpoint_src_.present();
+    if (!torque.has_value()) {
+        error_ |= ERROR_UNKNOWN_TORQUE;
+        return;
+    }
+
+    float ilim = config_.current_lim;
+    float iq = std::clamp(current_from_torque(*torque), -ilim, ilim);
+    Idq_setpoint_ = {0.0f, iq};
+    Vdq_setpoint_ = {0.0f, 0.0f};
+}
+
+bool Encoder::apply_config() {
+    pll_kp_ = 2.0f * config_.bandwidth;  // basic conversion to discrete time
+    pll_ki_ = 0.25f * (pll_kp_ * pll_kp_); // Critically damped
+    return current_meas_period * pll_kp_ < 1.0f;
+}
+
+void Encoder::set_linear_count(int32_t count) {
+    count_offset_ += count - shadow_count_;
+    shadow_count_ = count;
+    pos_turns_ = count / config_.cpr;
+    pos_estimate_counts_ = (float)(count - pos_turns_ * config_.cpr);
+}
+
+void Encoder::update(float mech_angle) {
+    // Count the edges that the encoder would have seen
+    int32_t count = (int32_t)std::floor(mech_angle * (float)config_.cpr / (2.0f * (float)M_PI));
+    shadow_count_ = count + count_offset_;
+
+    // Predict the position and correct it with the count, as Encoder::update()
+    pos_estimate_counts_ += current_meas_period * vel_estimate_counts_;
+    float delta_pos_counts = (float)(shadow_count_ - pos_turns_ * config_.cpr) - std::floor(pos_estimate_counts_);
+    pos_estimate_counts_ += current_meas_period * pll_kp_ * delta_pos_counts;
+    vel_estimate_counts_ += current_meas_period * pll_ki_ * delta_pos_counts;
+
+    // Keep the estimate within one turn to retain its resolution
+    while (pos_estimate_counts_ >= (float)config_.cpr) {
+        pos_estimate_counts_ -= (float)config_.cpr;
+        pos_turns_++;
+    }
+    while (pos_estimate_counts_ < 0.0f) {
+        pos_estimate_counts_ += (float)config_.cpr;
+        pos_turns_--;
+    }
+
+    float inv_cpr = 1.0f / (float)config_.cpr;
+    pos_estimate_turns_ = TurnPosition{pos_turns_, pos_estimate_counts_ * inv_cpr};
+    pos_estimate_ = (float)pos_turns_ + pos_estimate_counts_ * inv_cpr;
+    vel_estimate_ = vel_estimate_counts_ * inv_cpr;
+
+    // The encoder is aligned to the rotor, so the electrical phase is 0 at
+    // count 0 of the plant. The phase is taken at the center of the count.
+    float elec_rad_per_enc = (float)config_.pole_pairs * 2.0f * (float)M_PI * inv_cpr;
+    phase_ = wrap_pm_pi(((float)mod(count, config_.cpr) + 0.5f) * elec_rad_per_enc);
+    phase_vel_ = elec_rad_per_enc * vel_estimate_counts_;
+}
@@ -0,0 +1,98 @@
+#ifndef __SIL_MOTOR_HPP
+#define __SIL_MOTOR_HPP
+
+#include <autogen/interfaces.hpp>
+#include <MotorControl/foc.hpp>
+#include <MotorControl/utils.hpp>
+#include <cmath>
+
+/**
+ * @brief Stand-in for Motor in the SIL build.
+ *
+ * Has the members of Motor that the controller, the trajectory planner and
+ * the FOC use. The torque setpoint is converted to a current setpoint as in
+ * Motor::update() for a PMSM, without the optional compensations. The gate
+ * driver and the current sensors are replaced by the plant model, see
+ * SilBench.
+ */
+class Motor : public ODriveIntf::MotorIntf {
+public:
+    struct Config_t {
+        MotorType motor_type = MOTOR_TYPE_HIGH_CURRENT;
+        uint32_t pole_pairs = 7;
+        float phase_resistance = 0.039f; // [Ohm]
+        float phase_inductance = 1.57e-5f; // [H]
+        float torque_constant = 8.27f / 270.0f; // [Nm/A]
+        float current_lim = 10.0f; // [A]
+        float torque_lim = INFINITY; // [Nm]
+        float current_control_bandwidth = 1000.0f; // [rad/s]
+        float acim_gain_min_flux = 10.0f; // [A]
+    };
+
+    bool apply_config();
+    void arm();
+    void disarm();
+    void update(uint32_t timestamp);
+
+    float torque_from_current(float current) { return config_.torque_constant * current; }
+    float current_from_torque(float torque) { return torque / config_.torque_constant; }
+    float max_available_torque() {
+        return std::clamp(torque_from_current(config_.current_lim), 0.0f, config_.torque_lim);
+    }
+
+    bool record_torque_constant_point(float torque) override { return false; }
+
+    Config_t config_;
+    Error error_ = ERROR_NONE;
+    bool is_armed_ = false;
+
+    FieldOrientedController current_control_;
+
+    InputPort<float> torque_setpoint_src_; // [Nm]
+    OutputPort<float2D> Idq_setpoint_ = float2D{0.0f, 0.0f}; // [A]
+    OutputPort<float2D> Vdq_setpoint_ = float2D{0.0f, 0.0f}; // [V]
+};
+
+/**
+ * @brief Stand-in for Encoder in the SIL build.
+ *
+ * An ideal incremental encoder with config_.cpr counts per turn at the
+ * mechanical angle of the plant. The counts go through the same second order
+ * PLL as in Encoder::update(), so the controller sees the quantization and
+ * the estimator dynamics of the hardware.
+ */
+class Encoder : public ODriveIntf::EncoderIntf {
+public:
+    struct Config_t {
+        int32_t cpr = 8192;
+        float bandwidth = 1000.0f; // [rad/s] of the PLL
+        uint32_t pole_pairs = 7;
+    };
+
+    bool apply_config();
+    void update(float mech_angle); // [rad]
+    void set_linear_count(int32_t count) override;
+
+    constexpr float getCoggingRatio() {
+        return 1.0f / 3600.0f;
+    }
+
+    Config_t config_;
+    Error error_ = ERROR_NONE;
+
+    float pll_kp_ = 0.0f; // [count/s / count]
+    float pll_ki_ = 0.0f; // [(count/s^2) / count]
+    int32_t count_offset_ = 0; // [count] added by set_linear_count()
+    int32_t shadow_count_ = 0; // [count]
+    int32_t pos_turns_ = 0; // [turn] integer part of pos_estimate_turns_
+    float pos_estimate_counts_ = 0.0f; // [count] within the turn pos_turns_
+    float vel_estimate_counts_ = 0.0f; // [count/s]
+
+    OutputPort<float> pos_estimate_ = 0.0f; // [turn]
+    OutputPort<TurnPosition> pos_estimate_turns_ = TurnPosition{0, 0.0f};
+    OutputPort<float> vel_estimate_ = 0.0f; // [turn/s]
+    OutputPort<float> phase_ = 0.0f; // [rad]
+    OutputPort<float> phase_vel_ = 0.0f; // [rad/s]
+};
+
+#endif // __SIL_MOTOR_HPP
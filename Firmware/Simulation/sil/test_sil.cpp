@@ -0,0 +1,96 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#define DOCTEST_CONFIG_TREAT_CHAR_STAR_AS_STRING
+#define DOCTEST_CONFIG_USE_STD_HEADERS
+#define DOCTEST_CONFIG_NO_TRY_CATCH_IN_ASSERTS
+#define DOCTEST_CONFIG_NO_EXCEPTIONS
+#define DOCTEST_CONFIG_NO_WINDOWS_SEH
+#define DOCTEST_CONFIG_NO_POSIX_SIGNALS
+#include <doctest.h>
+
+#include "sil_bench.hpp"
+
+// Closed loop tests of the firmware controller, trajectory planner and FOC
+// against the plant model. Each test case starts axis 0 from the default
+// configuration (see reset_axis()).
+
+static void reset_axis(Axis& axis) {
+    axis.stop_closed_loop_control();
+    axis.motor_ = Motor{};
+    axis.encoder_ = Encoder{};
+    axis.controller_.config_ = Controller::Config_t{};
+    axis.controller_.error_ = Controller::ERROR_NONE;
+    axis.controller_.input_pos_ = 0.0f;
+    axis.controller_.input_vel_ = 0.0f;
+    axis.controller_.input_torque_ = 0.0f;
+    axis.trap_traj_.config_ = TrapezoidalTrajectory::Config_t{};
+}
+
+static MotorSim::Params plant_params() {
+    MotorSim::Params params;
+    params.b_viscous = 1e-4; // [Nm/(rad/s)]
+    return params;
+}
+
+TEST_CASE("SIL current control tracks the torque command") {
+    SilBench bench(plant_params());
+    Axis& axis = bench.axis_;
+    reset_axis(axis);
+    axis.controller_.config_.control_mode = Controller::CONTROL_MODE_TORQUE_CONTROL;
+    axis.controller_.config_.enable_current_mode_vel_limit = false;
+    CHECK(axis.apply_config());
+    axis.start_closed_loop_control();
+
+    axis.controller_.set_input(std::nullopt, std::nullopt, 0.1f);
+    bench.run(0.01f);
+    CHECK(axis.motor_.is_armed_);
+    CHECK(bench.plant_.get_torque() == doctest::Approx(0.1).epsilon(0.02));
+    CHECK(bench.plant_.state_.I_d == doctest::Approx(0.0).epsilon(0.1));
+}
+
+TEST_CASE("SIL velocity control reaches the setpoint") {
+    SilBench bench(plant_params());
+    Axis& axis = bench.axis_;
+    reset_axis(axis);
+    axis.controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
+    axis.controller_.config_.vel_limit = 20.0f;
+    CHECK(axis.apply_config());
+    axis.start_closed_loop_control();
+
+    axis.controller_.set_input(std::nullopt, 10.0f, std::nullopt);
+    bench.run(2.0f);
+    CHECK(axis.motor_.is_armed_);
+    CHECK(bench.plant_.state_.theta_dot / (2.0 * M_PI) == doctest::Approx(10.0).epsilon(0.01));
+    CHECK(*axis.encoder_.vel_estimate_.any() == doctest::Approx(10.0f).epsilon(0.01));
+
+    // The integrator takes up a load torque
+    bench.load_torque_ = 0.1f;
+    bench.run(2.0f);
+    CHECK(bench.plant_.state_.theta_dot / (2.0 * M_PI) == doctest::Approx(10.0).epsilon(0.01));
+}
+
+TEST_CASE("SIL trapezoidal move ends at the goal") {
+    SilBench bench(plant_params());
+    Axis& axis = bench.axis_;
+    reset_axis(axis);
+    axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
+    axis.controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
+    axis.controller_.config_.vel_limit = 20.0f;
+    axis.trap_traj_.config_.vel_limit = 5.0f;
+    axis.trap_traj_.config_.accel_limit = 20.0f;
+    axis.trap_traj_.config_.decel_limit = 20.0f;
+    CHECK(axis.apply_config());
+    axis.start_closed_loop_control();
+    bench.run(0.05f);
+
+    float start = *axis.encoder_.pos_estimate_.any();
+    axis.controller_.set_input(start + 3.0f, std::nullopt, std::nullopt);
+    bench.run(1.0f);
+    CHECK(axis.motor_.is_armed_);
+    CHECK(axis.controller_.trajectory_done_);
+    CHECK(*axis.encoder_.pos_estimate_.any() == doctest::Approx(start + 3.0f).epsilon(1e-3));
+    CHECK(std::abs(bench.plant_.state_.theta_dot) < 0.1);
+
+    // The planned duration is 0.25 s of acceleration and deceleration each
+    // plus 0.35 s at the velocity limit
+    CHECK(axis.trap_traj_.Tf_ == doctest::Approx(0.85f));
+}
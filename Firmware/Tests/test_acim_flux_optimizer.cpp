@@ -0,0 +1,41 @@
+#include <doctest.h>
+#include "MotorControl/acim_flux_optimizer.hpp"
+#include <cmath>
+#include <initializer_list>
+
+TEST_CASE("acim flux optimizer") {
+    AcimLossModel model = {
+        .torque_constant = 0.01f,
+        .pole_pairs = 2.0f,
+        .phase_resistance = 0.1f,
+        .slip_velocity = 15.0f,
+        .core_loss_coeff = 0.0005f,
+    };
+
+    SUBCASE("finds the minimum of the loss") {
+        for (float torque: {0.5f, 2.0f, -3.0f}) {
+            for (float phase_vel: {0.0f, 100.0f, 800.0f}) {
+                float id = model.get_min_loss_id(torque, phase_vel);
+                REQUIRE(id > 0.0f);
+                float loss = model.get_loss(torque, id, phase_vel);
+                CHECK(loss <= model.get_loss(torque, 0.9f * id, phase_vel));
+                CHECK(loss <= model.get_loss(torque, 1.1f * id, phase_vel));
+                // Both parts of the loss are equal at the minimum
+                float iq = torque / (model.torque_constant * id);
+                CHECK(model.id_coeff(phase_vel) * id * id == doctest::Approx(model.iq_coeff() * iq * iq));
+            }
+        }
+    }
+
+    SUBCASE("less flux at partial load and high speed") {
+        CHECK(model.get_min_loss_id(0.5f, 100.0f) < model.get_min_loss_id(2.0f, 100.0f));
+        CHECK(model.get_min_loss_id(2.0f, 800.0f) < model.get_min_loss_id(2.0f, 100.0f));
+        CHECK(model.get_min_loss_id(0.0f, 100.0f) == 0.0f);
+    }
+
+    SUBCASE("invalid parameters") {
+        model.phase_resistance = 0.0f;
+        model.core_loss_coeff = 0.0f;
+        CHECK(model.get_min_loss_id(1.0f, 100.0f) == 0.0f);
+    }
+}
@@ -0,0 +1,38 @@
+#include <doctest.h>
+#include "MotorControl/arena.hpp"
+
+struct Point { float a; float b; };
+
+TEST_CASE("arena") {
+    alignas(8) static uint8_t buffer[64];
+    Arena arena(buffer, sizeof(buffer));
+    CHECK(arena.size_ == 64);
+
+    uint8_t* bytes = arena.allocate<uint8_t>(3);
+    REQUIRE(bytes != nullptr);
+    CHECK(bytes == buffer);
+    CHECK(arena.used_ == 3);
+
+    // Aligned after the padding and value-initialized
+    buffer[4] = 0xff;
+    float* floats = arena.allocate<float>(4);
+    REQUIRE(floats != nullptr);
+    CHECK((uintptr_t)floats % alignof(float) == 0);
+    CHECK(arena.used_ == 20);
+    CHECK(floats[0] == 0.0f);
+
+    // Doesn't fit: fails as a whole and leaves the rest for others
+    CHECK(arena.allocate<Point>(6) == nullptr);
+    CHECK(arena.failed_allocations_ == 1);
+    CHECK(arena.used_ == 20);
+    Point* points = arena.allocate<Point>(5);
+    REQUIRE(points != nullptr);
+    CHECK(arena.used_ == 60);
+
+    CHECK(arena.allocate<float>(0) == nullptr);
+    CHECK(arena.failed_allocations_ == 1);
+    CHECK(arena.allocate<float>(2) == nullptr);
+    CHECK(arena.failed_allocations_ == 2);
+    CHECK(arena.allocate<float>(1) != nullptr);
+    CHECK(arena.used_ == 64);
+}
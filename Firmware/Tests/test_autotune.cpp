@@ -0,0 +1,48 @@
+#include <doctest.h>
+#include "MotorControl/autotune.hpp"
+#include <complex>
+
+TEST_CASE("autotune") {
+    const PlantModel plant = {0.002f, 0.01f, 300e-6f};
+    auto response = [&](float w) {
+        std::complex<float> s(0.0f, w);
+        return std::exp(-s * plant.delay) / (plant.inertia * s + plant.friction);
+    };
+
+    float freq[20], gain[20], phase[20];
+    for (size_t i = 0; i < 20; ++i) {
+        freq[i] = 2.0f * std::pow(100.0f, (float)i / 19.0f);
+        std::complex<float> h = response(2.0f * (float)M_PI * freq[i]);
+        gain[i] = std::abs(h);
+        phase[i] = std::arg(h);
+    }
+
+    PlantModel model;
+    REQUIRE(fit_plant_model(freq, gain, phase, 20, &model));
+    CHECK(model.inertia == doctest::Approx(plant.inertia).epsilon(1e-3));
+    CHECK(model.friction == doctest::Approx(plant.friction).epsilon(1e-2));
+    CHECK(model.delay == doctest::Approx(plant.delay).epsilon(1e-2));
+
+    SUBCASE("crossover and phase margin") {
+        const float bandwidth = 30.0f;
+        const float phase_margin = 50.0f * (float)M_PI / 180.0f;
+        ControllerGains gains;
+        REQUIRE(design_gains(model, bandwidth, phase_margin, &gains));
+
+        float w = 2.0f * (float)M_PI * bandwidth;
+        std::complex<float> s(0.0f, w);
+        std::complex<float> loop = (gains.vel_gain + gains.vel_integrator_gain / s) * response(w);
+        CHECK(std::abs(loop) == doctest::Approx(1.0f).epsilon(1e-2));
+        CHECK(std::arg(loop) + (float)M_PI >= phase_margin - 0.01f);
+        CHECK(gains.pos_gain == doctest::Approx(w / 4.0f));
+    }
+
+    SUBCASE("bandwidth too high for the delay") {
+        ControllerGains gains;
+        CHECK(!design_gains(model, 1000.0f, 50.0f * (float)M_PI / 180.0f, &gains));
+    }
+
+    SUBCASE("not enough points") {
+        CHECK(!fit_plant_model(freq, gain, phase, 1, &model));
+    }
+}
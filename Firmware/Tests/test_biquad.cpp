@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "MotorControl/biquad.hpp"
+#include <complex>
+
+static float gain(const Biquad& c, float freq, float sample_rate) {
+    std::complex<float> z1 = std::polar(1.0f, -2.0f * (float)M_PI * freq / sample_rate); // z^-1
+    std::complex<float> num = c.b0 + z1 * (c.b1 + z1 * c.b2);
+    std::complex<float> den = 1.0f + z1 * (c.a1 + z1 * c.a2);
+    return std::abs(num / den);
+}
+
+TEST_CASE("biquad design") {
+    const float fs = 8000.0f;
+
+    SUBCASE("low pass") {
+        Biquad c = Biquad::low_pass(500.0f, 0.7071f, fs);
+        CHECK(gain(c, 0.0f, fs) == doctest::Approx(1.0f));
+        CHECK(gain(c, 500.0f, fs) == doctest::Approx(0.7071f).epsilon(1e-3));
+        CHECK(gain(c, 2000.0f, fs) < 0.07f);
+    }
+
+    SUBCASE("notch") {
+        Biquad c = Biquad::notch(1000.0f, 2.0f, fs);
+        CHECK(gain(c, 0.0f, fs) == doctest::Approx(1.0f));
+        CHECK(gain(c, 1000.0f, fs) < 1e-3f);
+        CHECK(gain(c, 500.0f, fs) > 0.7f);
+        CHECK(gain(c, 2000.0f, fs) > 0.7f);
+        CHECK(gain(c, 3999.0f, fs) == doctest::Approx(1.0f).epsilon(1e-3));
+    }
+
+    SUBCASE("lead-lag") {
+        Biquad c = Biquad::lead_lag(100.0f, 1000.0f, fs);
+        CHECK(gain(c, 0.0f, fs) == doctest::Approx(1.0f));
+        CHECK(gain(c, 100.0f, fs) == doctest::Approx(std::sqrt(2.0f / (1.0f + 0.01f))).epsilon(1e-3));
+        // At Nyquist the gain is the ratio of the prewarped corner frequencies
+        float hf_gain = std::tan((float)M_PI * 1000.0f / fs) / std::tan((float)M_PI * 100.0f / fs);
+        CHECK(gain(c, 4000.0f, fs) == doctest::Approx(hf_gain).epsilon(1e-3));
+    }
+
+    SUBCASE("frequency above Nyquist stays stable") {
+        Biquad c = Biquad::low_pass(10000.0f, 0.7071f, fs);
+        CHECK(std::abs(c.a2) < 1.0f);
+        CHECK(std::abs(c.a1) < 1.0f + c.a2);
+    }
+}
+
+TEST_CASE("biquad state") {
+    Biquad c = Biquad::notch(50.0f, 1.0f, 1000.0f);
+    BiquadState state;
+    CHECK(state.settle(c, 2.0f) == doctest::Approx(2.0f));
+    for (int i = 0; i < 10; ++i) {
+        CHECK(state.update(c, 2.0f) == doctest::Approx(2.0f));
+    }
+
+    // A sine at the notch frequency dies out
+    state = {};
+    float last = 1.0f;
+    for (int i = 0; i < 2000; ++i) {
+        last = state.update(c, std::sin(2.0f * (float)M_PI * 50.0f * (float)i / 1000.0f));
+    }
+    CHECK(std::abs(last) < 1e-3f);
+}
@@ -0,0 +1,163 @@
+#include <doctest.h>
+#include "communication/can_update.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Two sectors of 4 KiB, writable like flash: programming only clears bits
+struct FakeFlashPort {
+    static constexpr size_t kSectorSize = 4096;
+    static constexpr uint32_t kNumSectors = 2;
+
+    FakeFlashPort() { memset(flash, 0xFF, sizeof(flash)); }
+
+    size_t sector_size(uint32_t sector) { return sector < kNumSectors ? kSectorSize : 0; }
+    const uint8_t* sector_base(uint32_t sector) { return flash + sector * kSectorSize; }
+    bool erase(uint32_t sector) {
+        memset(flash + sector * kSectorSize, 0xFF, kSectorSize);
+        erase_count++;
+        return true;
+    }
+    bool program(const uint8_t* addr, uint32_t word) {
+        uint32_t current;
+        memcpy(&current, addr, 4);
+        current &= word;
+        memcpy((uint8_t*)addr, &current, 4);
+        return true;
+    }
+    void send_status(const uint8_t (&payload)[8]) {
+        status.assign(payload, payload + 8);
+    }
+
+    uint8_t flash[kNumSectors * kSectorSize];
+    size_t erase_count = 0;
+    std::vector<uint8_t> status;
+};
+
+void put_le32(uint8_t* data, uint32_t value) {
+    for (size_t i = 0; i < 4; ++i) {
+        data[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+}
+
+TEST_CASE("can update crc32") {
+    const char* text = "123456789";
+    CHECK(can_update_crc32(0, (const uint8_t*)text, 9) == 0xCBF43926UL);
+    // Can be continued like zlib.crc32()
+    CHECK(can_update_crc32(can_update_crc32(0, (const uint8_t*)text, 4), (const uint8_t*)text + 4, 5) == 0xCBF43926UL);
+}
+
+TEST_CASE("can update session") {
+    FakeFlashPort port;
+    CanUpdateSession<FakeFlashPort> session(port);
+
+    // New content of sector 1: 2.5 chunks of data, the rest stays erased
+    const uint32_t length = 2560;
+    std::vector<uint8_t> image(FakeFlashPort::kSectorSize, 0xFF);
+    for (size_t i = 0; i < length; ++i) {
+        image[i] = (uint8_t)(i * 7 + 3);
+    }
+    uint32_t sector_crc = can_update_crc32(0, image.data(), image.size());
+
+    auto command = [&](uint32_t cmd, std::vector<uint8_t> payload) {
+        payload.resize(8);
+        return session.handle_command(cmd, payload.data(), 8);
+    };
+    auto start = [&](uint32_t sector) {
+        std::vector<uint8_t> payload = {(uint8_t)sector, (uint8_t)length, (uint8_t)(length >> 8), 0, 0, 0, 0, 0};
+        put_le32(payload.data() + 4, sector_crc);
+        command(CAN_UPDATE_CMD_SECTOR, payload);
+    };
+    auto send_chunk = [&](uint32_t chunk, uint32_t skip_block = UINT32_MAX) {
+        uint32_t offset = chunk * CAN_UPDATE_CHUNK_SIZE;
+        uint32_t end = std::min(offset + CAN_UPDATE_CHUNK_SIZE, length);
+        for (uint32_t block = offset / 8; block < end / 8; ++block) {
+            if (block != skip_block) {
+                session.handle_data(block, image.data() + block * 8);
+            }
+        }
+        std::vector<uint8_t> payload = {(uint8_t)chunk, (uint8_t)(chunk >> 8), 0, 0, 0, 0, 0, 0};
+        put_le32(payload.data() + 4, can_update_crc32(0, image.data() + offset, end - offset));
+        command(CAN_UPDATE_CMD_CHUNK_CRC, payload);
+    };
+    auto end_sector = [&]() {
+        command(CAN_UPDATE_CMD_SECTOR_END, {});
+        return port.status;
+    };
+
+    session.send_ready();
+    CHECK(port.status[0] == CAN_UPDATE_STATUS_READY);
+
+    SUBCASE("a complete sector") {
+        start(1);
+        CHECK(port.status[0] == CAN_UPDATE_STATUS_ERASED);
+        CHECK(port.status[1] == 1);
+        for (uint32_t chunk = 0; chunk < 3; ++chunk) {
+            send_chunk(chunk);
+        }
+        CHECK(end_sector()[0] == CAN_UPDATE_STATUS_COMPLETE);
+        CHECK(memcmp(port.flash + FakeFlashPort::kSectorSize, image.data(), image.size()) == 0);
+
+        // The same sector again is skipped without erasing
+        start(1);
+        CHECK(port.status[0] == CAN_UPDATE_STATUS_SKIPPED);
+        CHECK(port.erase_count == 1);
+        session.handle_data(0, image.data() + 8); // ignored
+        CHECK(end_sector()[0] == CAN_UPDATE_STATUS_SKIPPED);
+        CHECK(port.flash[FakeFlashPort::kSectorSize] == image[0]);
+    }
+
+    SUBCASE("lost frames are reported and sent again") {
+        start(1);
+        send_chunk(0, 5); // a data frame got lost
+        send_chunk(1);
+        // the chunk CRC of chunk 2 got lost
+        uint32_t offset = 2 * CAN_UPDATE_CHUNK_SIZE;
+        for (uint32_t block = offset / 8; block < length / 8; ++block) {
+            session.handle_data(block, image.data() + block * 8);
+        }
+
+        std::vector<uint8_t> status = end_sector();
+        CHECK(status[0] == CAN_UPDATE_STATUS_MISSING);
+        CHECK(status[2] == 0); // first missing chunk
+        CHECK(status[4] == 0x5); // chunks 0 and 2
+
+        // Sending the chunks again only programs the missing words
+        send_chunk(0);
+        send_chunk(2);
+        CHECK(end_sector()[0] == CAN_UPDATE_STATUS_COMPLETE);
+        CHECK(port.erase_count == 1);
+    }
+
+    SUBCASE("data that doesn't match the programmed data fails the sector") {
+        start(1);
+        send_chunk(0);
+        std::vector<uint8_t> other(8, 0x00);
+        session.handle_data(1, other.data());
+        CHECK(end_sector()[0] == CAN_UPDATE_STATUS_FAILED);
+
+        // Restarting the sector erases it again
+        start(1);
+        CHECK(port.status[0] == CAN_UPDATE_STATUS_ERASED);
+        CHECK(port.erase_count == 2);
+    }
+
+    SUBCASE("invalid sectors") {
+        start(2);
+        CHECK(port.status[0] == CAN_UPDATE_STATUS_INVALID);
+        CHECK(end_sector()[0] == CAN_UPDATE_STATUS_INVALID);
+        std::vector<uint8_t> payload = {0, 0x04, 0x00, 0x00, 0, 0, 0, 0}; // length not a multiple of 8
+        command(CAN_UPDATE_CMD_SECTOR, payload);
+        CHECK(port.status[0] == CAN_UPDATE_STATUS_INVALID);
+        CHECK(port.erase_count == 0);
+    }
+
+    SUBCASE("reset") {
+        CHECK(command(CAN_UPDATE_CMD_SECTOR_END, {}));
+        CHECK_FALSE(command(CAN_UPDATE_CMD_RESET, {}));
+    }
+}
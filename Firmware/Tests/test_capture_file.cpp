@@ -0,0 +1,103 @@
+#include <doctest.h>
+#include "Simulation/capture_file.hpp"
+#include "Simulation/motor_sim.hpp"
+
+// Builds a capture file as tools/odrive/capture.py writes it
+struct CaptureBuilder {
+    CaptureBuilder(std::vector<std::string> channels, double sample_rate, std::string info) : num_channels(channels.size()) {
+        append("ODCAP\0", 6);
+        append_value<uint16_t>(1);
+        append_value<uint16_t>((uint16_t)channels.size());
+        append_value<uint16_t>(0);
+        append_value<uint32_t>((uint32_t)info.size());
+        append_value<double>(sample_rate);
+        for (auto& name: channels) {
+            char entry[48] = {0};
+            memcpy(entry, name.data(), name.size());
+            append(entry, sizeof(entry));
+        }
+        append(info.data(), info.size());
+        pad();
+    }
+
+    void block(std::vector<int64_t> timestamps, std::vector<float> values) {
+        append("BLK\0", 4);
+        append_value<uint32_t>((uint32_t)timestamps.size());
+        for (int64_t t: timestamps) append_value(t);
+        for (float v: values) append_value(v);
+        pad();
+    }
+
+    void append(const void* ptr, size_t length) { bytes.insert(bytes.end(), (const uint8_t*)ptr, (const uint8_t*)ptr + length); }
+    template<typename T> void append_value(T value) { append(&value, sizeof(value)); }
+    void pad() { bytes.resize((bytes.size() + 7) & ~(size_t)7); }
+
+    size_t num_channels;
+    std::vector<uint8_t> bytes;
+};
+
+TEST_CASE("CaptureFile reads the channels and the samples of all blocks") {
+    CaptureBuilder builder({"axis0.encoder.pos_estimate", "Iq"}, 8000.0, "{\"source\": \"telemetry\"}");
+    builder.block({0, 125000, 250000}, {0.0f, 1.0f, 0.5f, 2.0f, 1.0f, 3.0f});
+    builder.block({375000}, {1.5f, 4.0f});
+
+    CaptureFile capture;
+    REQUIRE(capture.load(builder.bytes.data(), builder.bytes.size()));
+    CHECK(capture.num_channels() == 2);
+    CHECK(capture.find_channel("Iq") == 1);
+    CHECK(capture.find_channel("Id") == -1);
+    CHECK(capture.channels_[0] == "axis0.encoder.pos_estimate");
+    CHECK(capture.info_ == "{\"source\": \"telemetry\"}");
+    CHECK(capture.sample_rate_ == 8000.0);
+    REQUIRE(capture.num_samples() == 4);
+    CHECK(capture.timestamp_ns(3) == 375000);
+    CHECK(capture.value(2, 0) == 1.0f);
+    CHECK(capture.value(3, 1) == 4.0f);
+
+    // Sample and hold
+    CHECK(capture.value_at(-1, 1) == 1.0f);
+    CHECK(capture.value_at(124999, 1) == 1.0f);
+    CHECK(capture.value_at(125000, 1) == 2.0f);
+    CHECK(capture.value_at(1000000, 1) == 4.0f);
+}
+
+TEST_CASE("CaptureFile rejects other files and ignores a truncated block") {
+    CaptureBuilder builder({"a"}, 0.0, "");
+    builder.block({0, 1}, {1.0f, 2.0f});
+    size_t complete = builder.bytes.size();
+    builder.block({2, 3}, {3.0f, 4.0f});
+
+    CaptureFile capture;
+    CHECK(capture.load(builder.bytes.data(), complete + 12));
+    CHECK(capture.num_samples() == 2);
+
+    std::vector<uint8_t> bytes = builder.bytes;
+    bytes[0] = 'X';
+    CHECK_FALSE(capture.load(bytes.data(), bytes.size()));
+    CHECK_FALSE(capture.load(builder.bytes.data(), 10));
+    CHECK_FALSE(capture.open("/nonexistent.odcap"));
+}
+
+TEST_CASE("A captured voltage replays into MotorSim") {
+    // 10ms of Vq = 1V recorded at 1kHz, replayed at the step size of the simulation
+    CaptureBuilder builder({"Vd", "Vq"}, 1000.0, "");
+    std::vector<int64_t> timestamps;
+    std::vector<float> values;
+    for (int64_t i = 0; i < 10; ++i) {
+        timestamps.push_back(i * 1000000);
+        values.push_back(0.0f);
+        values.push_back(1.0f);
+    }
+    builder.block(timestamps, values);
+    CaptureFile capture;
+    REQUIRE(capture.load(builder.bytes.data(), builder.bytes.size()));
+
+    MotorSim::Params params;
+    params.J = 1e6; // locked rotor
+    MotorSim sim(params);
+    const double dt = 1.0 / 48000.0;
+    for (int64_t t = 0; t < 10000000; t += (int64_t)(dt * 1e9)) {
+        sim.step(dt, capture.value_at(t, capture.find_channel("Vd")), capture.value_at(t, capture.find_channel("Vq")), 0.0);
+    }
+    CHECK(sim.state_.I_q == doctest::Approx(1.0 / params.R).epsilon(1e-3));
+}
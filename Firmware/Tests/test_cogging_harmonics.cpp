@@ -0,0 +1,58 @@
+#include <doctest.h>
+#include "MotorControl/cogging_harmonics.hpp"
+#include <vector>
+
+static float eval(const CoggingHarmonic* h, size_t n, float pos) {
+    float torque = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float phase = 2.0f * (float)M_PI * (float)h[i].order * pos;
+        torque += h[i].cos_coeff * std::cos(phase) + h[i].sin_coeff * std::sin(phase);
+    }
+    return torque;
+}
+
+TEST_CASE("LUT interpolation") {
+    float lut[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    CHECK(lut_interpolate(lut, 4, 0.0f, 0.0f) == doctest::Approx(0.0f));
+    CHECK(lut_interpolate(lut, 4, 0.0f, 0.125f) == doctest::Approx(0.5f));
+    CHECK(lut_interpolate(lut, 4, 0.0f, 0.875f) == doctest::Approx(1.5f)); // wraps to the first sample
+    CHECK(lut_interpolate(lut, 4, 0.5f, 0.125f) == doctest::Approx(0.0f));
+    CHECK(lut_interpolate(lut, 4, 0.5f, 0.0f) == doctest::Approx(1.5f)); // wraps to the last sample
+}
+
+TEST_CASE("cogging harmonic fit") {
+    const size_t size = 360;
+    const float offset = 0.45f;
+    auto torque = [](float pos) {
+        float x = 2.0f * (float)M_PI * pos;
+        return 0.05f + 0.3f * std::cos(12.0f * x) - 0.1f * std::sin(24.0f * x) + 0.02f * std::sin(7.0f * x + 1.0f);
+    };
+
+    std::vector<float> map(size);
+    for (size_t i = 0; i < size; ++i) {
+        map[i] = torque(((float)i + offset) / (float)size);
+    }
+
+    CoggingHarmonic harmonics[3];
+    CoggingHarmonicFit fit;
+    fit.start(map.data(), size, offset, harmonics, 3);
+    size_t steps = 1;
+    while (!fit.step()) {
+        ++steps;
+    }
+    CHECK(steps == size / 2);
+    REQUIRE(fit.count() == 3);
+
+    CHECK(harmonics[0].order == 12);
+    CHECK(harmonics[0].cos_coeff == doctest::Approx(0.3f).epsilon(0.001));
+    CHECK(harmonics[0].sin_coeff == doctest::Approx(0.0f).epsilon(0.001));
+    CHECK(harmonics[1].order == 24);
+    CHECK(harmonics[1].sin_coeff == doctest::Approx(-0.1f).epsilon(0.001));
+    CHECK(harmonics[2].order == 0);
+    CHECK(harmonics[2].cos_coeff == doctest::Approx(0.05f).epsilon(0.001));
+
+    // The dropped 7th harmonic is the only residual
+    for (float pos = 0.0f; pos < 1.0f; pos += 0.01f) {
+        CHECK(std::abs(eval(harmonics, 3, pos) - torque(pos)) <= 0.021f);
+    }
+}
@@ -0,0 +1,76 @@
+#include <doctest.h>
+#include "MotorControl/component.hpp"
+
+TEST_CASE("OutputPort freshness") {
+    OutputPort<float> port = 1.0f;
+    CHECK(!port.present().has_value());
+    CHECK(!port.previous().has_value());
+    CHECK(port.any() == 1.0f);
+
+    port = 2.0f;
+    CHECK(port.present() == 2.0f);
+    CHECK(!port.previous().has_value());
+
+    control_loop_epoch++;
+    CHECK(!port.present().has_value());
+    CHECK(port.previous() == 2.0f);
+
+    control_loop_epoch++;
+    CHECK(!port.present().has_value());
+    CHECK(!port.previous().has_value());
+    CHECK(port.any() == 2.0f);
+}
+
+TEST_CASE("OutputPort freshness across epoch overflow") {
+    control_loop_epoch = UINT32_MAX;
+    OutputPort<float> port = 0.0f;
+    CHECK(!port.present().has_value());
+
+    port = 3.0f;
+    control_loop_epoch++;
+    CHECK(port.previous() == 3.0f);
+}
+
+TEST_CASE("InputPort connected to OutputPort") {
+    OutputPort<float> output = 0.0f;
+    InputPort<float> input;
+    input.connect_to(&output);
+    CHECK(!input.present().has_value());
+
+    output = 4.0f;
+    CHECK(input.present() == 4.0f);
+
+    control_loop_epoch++;
+    CHECK(!input.present().has_value());
+    CHECK(input.any() == 4.0f);
+
+    input.disconnect();
+    CHECK(!input.any().has_value());
+}
+
+TEST_CASE("InputPort sources") {
+    // Until the first connection the port presents the default value
+    InputPort<float> input;
+    CHECK(input.present() == 0.0f);
+    CHECK(input.any() == 0.0f);
+
+    float value = 5.0f;
+    input.connect_to(&value);
+    control_loop_epoch++;
+    CHECK(input.present() == 5.0f);
+    value = 6.0f;
+    CHECK(input.any() == 6.0f);
+
+    input.connect_to((float*)nullptr);
+    CHECK(!input.present().has_value());
+
+    // A copy reads the same source
+    OutputPort<float> output = 0.0f;
+    input.connect_to(&output);
+    InputPort<float> copy = input;
+    output = 7.0f;
+    CHECK(copy.present() == 7.0f);
+    input.connect_to((OutputPort<float>*)nullptr);
+    CHECK(!input.any().has_value());
+    CHECK(copy.any() == 7.0f);
+}
@@ -0,0 +1,29 @@
+#include <doctest.h>
+#include <fibre/crc.hpp>
+
+#include <vector>
+
+// Reference values from the Python implementation in fibre/protocol.py
+TEST_CASE("crc lookup tables") {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK(calc_crc8<0x37>(0x42, check, sizeof(check)) == 0x8c);
+    CHECK(calc_crc16<0x3d65>(0x1337, check, sizeof(check)) == 0xaa01);
+    CHECK(calc_crc16<0x3d65>(1, check, sizeof(check)) == 0xb0bc);
+
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 3 * 256; ++i) {
+        data.push_back((uint8_t)i);
+    }
+    CHECK(calc_crc16<0x3d65>(0xabcd, data.data(), data.size()) == 0x6abd);
+
+    // A packet followed by its big endian CRC has the remainder zero
+    uint16_t crc = calc_crc16<0x3d65>(0x1337, data.data(), 100);
+    data[100] = crc >> 8;
+    data[101] = crc & 0xff;
+    CHECK(calc_crc16<0x3d65>(0x1337, data.data(), 102) == 0);
+
+    for (unsigned i = 0; i < 256; ++i) {
+        CHECK(calc_crc8<0x37>(0x42, (uint8_t)i) == calc_crc_bitwise<uint8_t, 0x37>(0x42, (uint8_t)i));
+        CHECK(calc_crc16<0x3d65>(0x1337, (uint8_t)i) == calc_crc_bitwise<uint16_t, 0x3d65>(0x1337, (uint8_t)i));
+    }
+}
@@ -0,0 +1,16 @@
+#include <doctest.h>
+#include "MotorControl/dirty_flags.hpp"
+
+TEST_CASE("DirtyFlags coalesces marks until they are taken") {
+    DirtyFlags dirty;
+    CHECK(!dirty.any());
+    CHECK(dirty.take() == 0);
+
+    dirty.mark(1 << 0);
+    dirty.mark(1 << 2);
+    dirty.mark(1 << 0);
+    CHECK(dirty.any());
+    CHECK(dirty.take() == ((1 << 0) | (1 << 2)));
+    CHECK(!dirty.any());
+    CHECK(dirty.take() == 0);
+}
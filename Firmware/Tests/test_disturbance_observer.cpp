@@ -0,0 +1,39 @@
+#include <doctest.h>
+#include "MotorControl/disturbance_observer.hpp"
+#include <algorithm>
+
+// Velocity loop with a P controller on a pure inertia. Returns the largest
+// velocity error after a load step.
+static float load_step_response(bool use_observer, float* final_estimate) {
+    const float dt = 1.0f / 8000.0f;
+    const float inertia = 0.001f;
+    const float vel_gain = 0.05f;
+    const float load = -0.5f;
+    DisturbanceObserver observer;
+
+    float vel = 0.0f;
+    float torque = 0.0f;
+    float max_err = 0.0f;
+    for (int i = 0; i < 8000; ++i) {
+        float d = i > 800 ? load : 0.0f;
+        float command = -vel_gain * vel;
+        if (use_observer) {
+            command -= observer.update(vel, torque, inertia, 200.0f, dt);
+        }
+        torque = command;
+        vel += (torque + d) / inertia * dt;
+        if (i > 4000) {
+            max_err = std::max(max_err, std::abs(vel));
+        }
+    }
+    *final_estimate = observer.estimate();
+    return max_err;
+}
+
+TEST_CASE("disturbance observer") {
+    float estimate;
+    float err_without = load_step_response(false, &estimate);
+    float err_with = load_step_response(true, &estimate);
+    CHECK(estimate == doctest::Approx(-0.5f).epsilon(1e-3));
+    CHECK(err_with < 0.01f * err_without);
+}
@@ -0,0 +1,45 @@
+#include <doctest.h>
+#include "MotorControl/edge_velocity_estimator.hpp"
+
+TEST_CASE("EdgeVelocityEstimator measures the edge interval") {
+    EdgeVelocityEstimator estimator;
+    estimator.config_.window = 6;
+    CHECK(!estimator.get_velocity().has_value());
+
+    // -1 count every 40 samples
+    for (size_t i = 0; i < 400; ++i) {
+        estimator.update(i % 40 == 0 ? -1 : 0);
+    }
+    CHECK(*estimator.get_velocity() == doctest::Approx(-1.0f / 40.0f));
+}
+
+TEST_CASE("EdgeVelocityEstimator decays and times out when stopped") {
+    EdgeVelocityEstimator estimator;
+    estimator.config_.timeout = 1000;
+
+    for (size_t i = 0; i < 100; ++i) {
+        estimator.update(i % 10 == 0 ? 1 : 0);
+    }
+    CHECK(*estimator.get_velocity() == doctest::Approx(0.1f));
+
+    for (size_t i = 0; i < 100; ++i) {
+        estimator.update(0);
+    }
+    float vel = *estimator.get_velocity();
+    CHECK(vel > 0.0f);
+    CHECK(vel <= 1.0f / 100.0f);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        estimator.update(0);
+    }
+    CHECK(*estimator.get_velocity() == 0.0f);
+}
+
+TEST_CASE("EdgeVelocityEstimator restarts on reversal") {
+    EdgeVelocityEstimator estimator;
+    for (size_t i = 0; i < 100; ++i) {
+        estimator.update(i % 10 == 0 ? 1 : 0);
+    }
+    estimator.update(-1);
+    CHECK(!estimator.get_velocity().has_value());
+}
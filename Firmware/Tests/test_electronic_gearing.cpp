@@ -0,0 +1,61 @@
+#include <doctest.h>
+#include "MotorControl/electronic_gearing.hpp"
+
+TEST_CASE("rational gear ratio") {
+    // 7/3 of 3000000.5 turns is exactly 7000001.1666... turns
+    TurnPosition slave = gear_rational({3000000, 0.5f}, 7, 3);
+    CHECK(slave.turns == 7000001);
+    CHECK(slave.fraction == doctest::Approx(1.0f / 6.0f));
+
+    slave = gear_rational({-1, 0.25f}, 7, 3); // -0.75 * 7 / 3 = -1.75
+    CHECK(slave.turns == -2);
+    CHECK(slave.fraction == doctest::Approx(0.25f));
+
+    slave = gear_rational({-5, 0.0f}, -1, 2); // 2.5
+    CHECK(slave.turns == 2);
+    CHECK(slave.fraction == doctest::Approx(0.5f));
+}
+
+TEST_CASE("cam follower") {
+    // Reciprocating cam: slave position 0.5 * sin(2 pi phase), 32 points
+    const size_t n = 32;
+    float table[n];
+    for (size_t i = 0; i < n; ++i) {
+        table[i] = 0.5f * std::sin(2.0f * (float)M_PI * (float)i / (float)n);
+    }
+
+    CamFollower cam;
+    cam.start({0, 0.0f}, 1.0f, 0.0f);
+
+    SUBCASE("interpolates the table and its derivative") {
+        for (float x = 0.0f; x < 3.0f; x += 0.01f) {
+            TurnPosition master = {(int32_t)std::floor(x), x - std::floor(x)};
+            CamFollower::Output out = cam.update(master, 2.0f, table, n, 1.0f, 0.0f);
+            CHECK(out.pos == doctest::Approx(0.5f * std::sin(2.0f * (float)M_PI * x)).epsilon(2e-3));
+            CHECK(out.vel == doctest::Approx(2.0f * (float)M_PI * std::cos(2.0f * (float)M_PI * x)).epsilon(1e-2));
+        }
+        CHECK(cam.cycle() == 2);
+    }
+
+    SUBCASE("rise accumulates over cycles without drift") {
+        // Indexing table: 0.25 turn per master turn, master runs far away
+        float ramp[4] = {0.0f, 0.0625f, 0.125f, 0.1875f};
+        cam.start({1000000, 0.0f}, 1.0f, 0.0f);
+        CamFollower::Output out = cam.update({1000000, 0.5f}, 1.0f, ramp, 4, 1.0f, 0.25f);
+        CHECK(cam.cycle() == 1000000);
+        CHECK(out.pos == doctest::Approx(250000.125f));
+        CHECK(out.vel == doctest::Approx(0.25f));
+
+        for (int32_t turns = 1000000; turns < 1001000; ++turns) {
+            out = cam.update({turns, 0.75f}, 1.0f, ramp, 4, 1.0f, 0.25f);
+        }
+        CHECK(cam.cycle() == 1000999);
+        CHECK(out.pos - 0.25f * 1000999.0f == doctest::Approx(0.1875f).epsilon(1e-2));
+    }
+
+    SUBCASE("moves backwards across cycles") {
+        cam.update({0, 0.1f}, 1.0f, table, n, 1.0f, 0.0f);
+        cam.update({-1, 0.9f}, -1.0f, table, n, 1.0f, 0.0f);
+        CHECK(cam.cycle() == -1);
+    }
+}
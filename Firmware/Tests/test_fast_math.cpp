@@ -0,0 +1,45 @@
+#include <doctest.h>
+#include <cmath>
+#include "MotorControl/utils.hpp"
+
+// Largest error against atan2() on a circle of angles, one of them exactly on
+// each axis and diagonal
+template<typename TAtan2>
+static double max_atan2_error(TAtan2 kernel, float radius) {
+    double max_error = 0.0;
+    for (int i = 0; i < 100000; ++i) {
+        double angle = 2.0 * M_PI * i / 100000.0 - M_PI;
+        float y = (float)(radius * std::sin(angle));
+        float x = (float)(radius * std::cos(angle));
+        double error = std::abs(kernel(y, x) - std::atan2((double)y, (double)x));
+        // -pi and pi are the same angle
+        max_error = std::max(max_error, std::min(error, 2.0 * M_PI - error));
+    }
+    for (float y: {-1.0f, 0.0f, 1.0f}) {
+        for (float x: {-1.0f, 0.0f, 1.0f}) {
+            if (x != 0.0f || y != 0.0f) {
+                double error = std::abs(kernel(y, x) - std::atan2((double)y, (double)x));
+                max_error = std::max(max_error, std::min(error, 2.0 * M_PI - error));
+            }
+        }
+    }
+    return max_error;
+}
+
+TEST_CASE("atan2 kernels") {
+    for (float radius: {1.0f, 1e-4f, 3000.0f}) {
+        CHECK(max_atan2_error(fast_atan2, radius) < 2.1e-4);
+        CHECK(max_atan2_error(lut_atan2, radius) < 2.1e-5);
+        CHECK(max_atan2_error(precise_atan2, radius) < 6e-7);
+    }
+    CHECK(lut_atan2(0.0f, 0.0f) == 0.0f);
+    CHECK(precise_atan2(0.0f, 0.0f) == 0.0f);
+}
+
+TEST_CASE("fast_rsqrt") {
+    double max_error = 0.0;
+    for (float x = 1e-6f; x < 1e6f; x *= 1.001f) {
+        max_error = std::max(max_error, std::abs(fast_rsqrt(x) * std::sqrt((double)x) - 1.0));
+    }
+    CHECK(max_error < 5e-6);
+}
@@ -0,0 +1,58 @@
+#include <doctest.h>
+#include "MotorControl/friction_model.hpp"
+
+TEST_CASE("friction torque") {
+    CHECK(friction_torque(0.0f, 0.1f, 0.2f, 0.05f, 0.02f, 0.001f) == doctest::Approx(0.0f));
+    CHECK(friction_torque(0.0005f, 0.1f, 0.0f, 0.0f, 0.02f, 0.001f) == doctest::Approx(0.05f));
+    CHECK(friction_torque(-1.0f, 0.1f, 0.2f, 0.0f, 0.02f, 0.001f) == doctest::Approx(-0.3f));
+    CHECK(friction_torque(0.02f, 0.1f, 0.0f, 0.04f, 0.02f, 0.001f) == doctest::Approx(0.12f));
+    CHECK(friction_torque(1.0f, 0.1f, 0.0f, 0.0f, 0.0f, 0.0f) == doctest::Approx(0.1f));
+}
+
+TEST_CASE("friction fit") {
+    const float vel[] = {0.01f, 0.04f, 0.16f, 0.64f};
+    float friction[4];
+    float coulomb, viscous, stribeck;
+
+    for (size_t i = 0; i < 4; ++i) {
+        friction[i] = friction_torque(vel[i], 0.1f, 0.3f, 0.05f, 0.02f, 0.0f);
+    }
+    REQUIRE(fit_friction(vel, friction, 4, 0.02f, &coulomb, &viscous, &stribeck));
+    CHECK(coulomb == doctest::Approx(0.1f).epsilon(0.01));
+    CHECK(viscous == doctest::Approx(0.3f).epsilon(0.01));
+    CHECK(stribeck == doctest::Approx(0.05f).epsilon(0.01));
+
+    // Friction that falls off more than the Stribeck term of the model can
+    // explain would give a negative viscous term, the fit drops the Stribeck
+    // term and keeps the viscous friction at 0
+    const float falling[] = {0.5f, 0.4f, 0.3f, 0.2f};
+    REQUIRE(fit_friction(vel, falling, 4, 0.02f, &coulomb, &viscous, &stribeck));
+    CHECK(viscous >= 0.0f);
+    CHECK(stribeck == 0.0f);
+    CHECK(coulomb == doctest::Approx(0.35f));
+
+    // One velocity doesn't determine the model
+    CHECK(!fit_friction(vel, friction, 1, 0.02f, &coulomb, &viscous, &stribeck));
+}
+
+TEST_CASE("backlash from reversal") {
+    // Torque goes from 0.2 to -0.2 after two bins of free travel
+    const float torque[] = {0.2f, 0.15f, 0.0f, 0.0f, -0.1f, -0.2f, -0.2f, -0.2f};
+    CHECK(backlash_from_reversal(torque, 8, 0.01f, 0.2f, -0.2f) == doctest::Approx(0.04f));
+    const float stiff[] = {-0.2f, -0.2f, -0.2f};
+    CHECK(backlash_from_reversal(stiff, 3, 0.01f, 0.2f, -0.2f) == doctest::Approx(0.0f));
+    const float slow[] = {0.2f, 0.0f, -0.1f};
+    CHECK(backlash_from_reversal(slow, 3, 0.01f, 0.2f, -0.2f) == doctest::Approx(0.03f));
+}
+
+TEST_CASE("backlash offset") {
+    float offset = 0.0f;
+    for (int i = 0; i < 100; ++i) {
+        offset = update_backlash_offset(offset, 1.0f, 0.02f, 0.001f, 1.0f, 0.001f);
+    }
+    CHECK(offset == doctest::Approx(0.01f));
+    offset = update_backlash_offset(offset, 0.0f, 0.02f, 0.001f, 1.0f, 0.001f);
+    CHECK(offset == doctest::Approx(0.01f));
+    offset = update_backlash_offset(offset, -1.0f, 0.02f, 0.001f, 1.0f, 0.001f);
+    CHECK(offset == doctest::Approx(0.009f));
+}
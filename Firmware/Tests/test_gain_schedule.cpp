@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "MotorControl/gain_schedule.hpp"
+
+TEST_CASE("gain schedule") {
+    using Schedule = GainSchedule<4>;
+    Schedule schedule;
+    Schedule::Point points[4] = {
+        {0.0f, 20.0f, 0.2f, 0.4f},
+        {1.0f, 20.0f, 0.1f, 0.2f},
+        {1.0f, 10.0f, 0.1f, 0.2f}, // step at x = 1
+        {3.0f, 30.0f, 0.3f, 0.0f},
+    };
+    REQUIRE(schedule.set(points));
+
+    CHECK(schedule.eval(-1.0f).vel_gain == doctest::Approx(0.2f));
+    CHECK(schedule.eval(0.5f).vel_gain == doctest::Approx(0.15f));
+    CHECK(schedule.eval(0.5f).vel_integrator_gain == doctest::Approx(0.3f));
+    CHECK(schedule.eval(0.999f).pos_gain == doctest::Approx(20.0f));
+    CHECK(schedule.eval(1.0f).pos_gain == doctest::Approx(10.0f));
+    CHECK(schedule.eval(2.0f).pos_gain == doctest::Approx(20.0f));
+    CHECK(schedule.eval(2.0f).vel_integrator_gain == doctest::Approx(0.1f));
+    CHECK(schedule.eval(5.0f).pos_gain == doctest::Approx(30.0f));
+
+    // Unsorted breakpoints are rejected
+    points[3].x = 0.5f;
+    CHECK(!schedule.set(points));
+    CHECK(schedule.eval(5.0f).pos_gain == doctest::Approx(30.0f));
+}
+
+TEST_CASE("linear schedule") {
+    LinearSchedule<4, 2> schedule;
+    const float x[4] = {0.0f, 1.0f, 1.0f, 3.0f};
+    const float y[4][2] = {
+        {20.0f, 0.2f},
+        {20.0f, 0.1f},
+        {10.0f, 0.1f}, // step at x = 1
+        {30.0f, 0.3f},
+    };
+    REQUIRE(schedule.set(x, y));
+
+    float out[2];
+    schedule.eval(-1.0f, out);
+    CHECK(out[1] == doctest::Approx(0.2f));
+    schedule.eval(0.5f, out);
+    CHECK(out[0] == doctest::Approx(20.0f));
+    CHECK(out[1] == doctest::Approx(0.15f));
+    schedule.eval(0.999f, out);
+    CHECK(out[0] == doctest::Approx(20.0f));
+    schedule.eval(1.0f, out);
+    CHECK(out[0] == doctest::Approx(10.0f));
+    schedule.eval(2.0f, out);
+    CHECK(out[0] == doctest::Approx(20.0f));
+    CHECK(out[1] == doctest::Approx(0.2f));
+    schedule.eval(5.0f, out);
+    CHECK(out[0] == doctest::Approx(30.0f));
+
+    // Unsorted breakpoints are rejected
+    const float unsorted[4] = {0.0f, 1.0f, 2.0f, 0.5f};
+    CHECK(!schedule.set(unsorted, y));
+    schedule.eval(5.0f, out);
+    CHECK(out[0] == doctest::Approx(30.0f));
+}
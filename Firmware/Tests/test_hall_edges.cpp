@@ -0,0 +1,78 @@
+#include <doctest.h>
+#include "MotorControl/hall_edges.hpp"
+#include <cmath>
+
+TEST_CASE("hall edges") {
+    const float offsets[kHallEdges] = {0.1f, -0.05f, 0.0f, 0.15f, -0.1f, -0.1f};
+
+    SUBCASE("states cover one electrical revolution") {
+        float total = 0.0f;
+        for (int32_t k = 0; k < (int32_t)kHallEdges; ++k) {
+            total += hall_edge_width(offsets, k);
+            CHECK(hall_edge_position(offsets, k, 0.0f) == doctest::Approx(offsets[k]));
+            CHECK(hall_edge_position(offsets, k, 1.0f) == doctest::Approx(1.0f + offsets[(k + 1) % kHallEdges]));
+        }
+        CHECK(total == doctest::Approx(6.0f));
+    }
+
+    SUBCASE("phase detector") {
+        const float zero[kHallEdges] = {};
+        for (float d = -2.5f; d < 2.5f; d += 0.125f) {
+            CHECK(hall_edge_phase_error(zero, 3, d) == -std::floor(d));
+        }
+        // State 3 covers [0.15, 0.9) relative to its count
+        CHECK(hall_edge_phase_error(offsets, 3, 0.1f) == 1.0f);
+        CHECK(hall_edge_phase_error(offsets, 3, 0.15f) == 0.0f);
+        CHECK(hall_edge_phase_error(offsets, 3, 0.85f) == 0.0f);
+        CHECK(hall_edge_phase_error(offsets, 3, 0.9f) == -1.0f);
+        CHECK(hall_edge_phase_error(offsets, 3, -1.0f) == 2.0f);
+    }
+
+    SUBCASE("calibration cancels lag and removes the mean") {
+        HallEdgeCalibration calibration;
+        const float lag = 0.3f; // [count]
+        const float shift = 0.2f; // [count] belongs to the phase offset
+        for (int pass = 0; pass < 3; ++pass) {
+            for (size_t k = 0; k < kHallEdges; ++k) {
+                calibration.add(k, true, offsets[k] + shift + lag);
+                calibration.add(k, false, offsets[k] + shift - lag);
+            }
+        }
+        float result[kHallEdges] = {};
+        REQUIRE(calibration.get_offsets(result));
+        float mean = 0.0f;
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            mean += offsets[k] / (float)kHallEdges;
+        }
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            CHECK(result[k] == doctest::Approx(offsets[k] - mean));
+        }
+    }
+
+    SUBCASE("calibration needs both directions of all edges") {
+        HallEdgeCalibration calibration;
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            calibration.add(k, true, 0.0f);
+            if (k != 2) {
+                calibration.add(k, false, 0.0f);
+            }
+        }
+        float result[kHallEdges] = {1.0f};
+        CHECK_FALSE(calibration.get_offsets(result));
+        CHECK(result[0] == 1.0f);
+        calibration.add(2, false, 0.0f);
+        CHECK(calibration.get_offsets(result));
+        CHECK(result[0] == 0.0f);
+    }
+
+    SUBCASE("implausible offsets are rejected") {
+        HallEdgeCalibration calibration;
+        for (size_t k = 0; k < kHallEdges; ++k) {
+            float error = k == 1 ? 0.9f : 0.0f; // state 1 would be almost empty
+            calibration.add(k, true, error);
+            calibration.add(k, false, error);
+        }
+        float result[kHallEdges] = {};
+        CHECK_FALSE(calibration.get_offsets(result));
+    }
+}
@@ -0,0 +1,84 @@
+#include <doctest.h>
+#include "MotorControl/hfi_observer.hpp"
+
+// Salient motor with a current controller that tracks the requested d axis
+// current perfectly. Only the ripple caused by the injection is simulated.
+struct SalientMotor {
+    float Ld0 = 100e-6f; // [H]
+    float Lq = 160e-6f; // [H]
+    float saturation = 0.02f; // relative decrease of Ld per A of d axis current
+    float theta = 0.0f; // [rad] rotor angle
+    float ripple[2] = {0.0f, 0.0f}; // [A]
+
+    // Applies `v` [V] along `angle` on top of `id` [A] along the same angle for dt
+    void step(float v, float angle, float id, float dt, float I[2]) {
+        float err = angle - theta;
+        float id_true = id * std::cos(err);
+        float inv_Ld = 1.0f / (Ld0 * (1.0f - saturation * id_true));
+        float inv_Lq = 1.0f / Lq;
+        // voltage in rotor frame
+        float vd = v * std::cos(err);
+        float vq = v * std::sin(err);
+        float did = dt * inv_Ld * vd;
+        float diq = dt * inv_Lq * vq;
+        ripple[0] += std::cos(theta) * did - std::sin(theta) * diq;
+        ripple[1] += std::sin(theta) * did + std::cos(theta) * diq;
+        I[0] = id * std::cos(angle) + ripple[0];
+        I[1] = id * std::sin(angle) + ripple[1];
+    }
+};
+
+// Runs the observer in closed loop with the motor. Returns the final phase
+// error after `n` updates.
+static float run(HfiObserver& hfi, SalientMotor& motor, size_t n, float rotor_vel) {
+    const float dt = 1.0f / 8000.0f;
+    float I[2] = {0.0f, 0.0f};
+    float v_prev = 0.0f, angle_prev = 0.0f, id_prev = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        hfi.update(I[0], I[1], 200.0f, 5.0f, dt);
+        float angle = hfi.phase();
+        float v = hfi.inject(0.5f, angle, std::cos(angle), std::sin(angle));
+        // The voltage computed in the previous update is applied now
+        motor.step(v_prev, angle_prev, id_prev, dt, I);
+        motor.theta = wrap_pm_pi(motor.theta + rotor_vel * dt);
+        v_prev = v;
+        angle_prev = angle;
+        id_prev = hfi.id_bias();
+    }
+    return wrap_pm_pi(hfi.phase() - motor.theta);
+}
+
+TEST_CASE("hfi observer") {
+    HfiObserver hfi;
+
+    SUBCASE("finds the rotor angle and polarity at standstill") {
+        for (float theta : {-3.0f, -1.2f, 0.0f, 0.4f, 1.6f, 2.9f}) {
+            SalientMotor motor;
+            motor.theta = theta;
+            hfi.start();
+            float err = run(hfi, motor, 4000, 0.0f);
+            CHECK(hfi.state() == HfiObserver::STATE_TRACK);
+            CHECK(std::abs(err) < 0.03f);
+            CHECK(hfi.saliency() == doctest::Approx((160.0f - 100.0f) / (160.0f + 100.0f)).epsilon(0.05));
+        }
+    }
+
+    SUBCASE("tracks a slowly moving rotor") {
+        SalientMotor motor;
+        motor.theta = 1.0f;
+        hfi.start();
+        run(hfi, motor, 4000, 0.0f);
+        float err = run(hfi, motor, 8000, 30.0f);
+        CHECK(std::abs(err) < 0.05f);
+        CHECK(hfi.phase_vel() == doctest::Approx(30.0f).epsilon(0.1));
+    }
+
+    SUBCASE("fails on a motor without saliency") {
+        SalientMotor motor;
+        motor.Lq = motor.Ld0;
+        motor.saturation = 0.0f;
+        hfi.start();
+        run(hfi, motor, 2000, 0.0f);
+        CHECK(hfi.state() == HfiObserver::STATE_FAILED);
+    }
+}
@@ -0,0 +1,56 @@
+#include <doctest.h>
+#include "MotorControl/input_shaper.hpp"
+
+// Drives a damped oscillator with a shaped step and returns the largest
+// deviation from the target after the shaper has settled.
+template<size_t N>
+static float residual_vibration(InputShaper<N>& shaper, float freq, float damping, float dt) {
+    float w = 2.0f * (float)M_PI * freq;
+    float x = 0.0f, v = 0.0f;
+    float max_dev = 0.0f;
+    for (int i = 0; i < (int)(2.0f / dt); ++i) {
+        float u = shaper.update({i ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f}).pos;
+        float a = w * w * (u - x) - 2.0f * damping * w * v;
+        v += a * dt;
+        x += v * dt;
+        if (i * dt > 0.2f) {
+            max_dev = std::max(max_dev, std::abs(x - 1.0f));
+        }
+    }
+    return max_dev;
+}
+
+TEST_CASE("input shaper") {
+    const float dt = 1.0f / 8000.0f;
+    const float freq = 8.0f;
+    const float damping = 0.05f;
+    InputShaper<128> shaper;
+
+    SUBCASE("disabled") {
+        shaper.set_params(InputShaper<128>::design(0, freq, damping, dt));
+        CHECK(!shaper.enabled());
+        CHECK(residual_vibration(shaper, freq, damping, dt) > 0.3f);
+    }
+
+    SUBCASE("ZV") {
+        auto params = InputShaper<128>::design(2, freq, damping, dt);
+        CHECK(params.amplitude[0] + params.amplitude[1] == doctest::Approx(1.0f));
+        CHECK(params.stride > 1); // 62.6 ms don't fit into 126 updates
+        shaper.set_params(params);
+        CHECK(residual_vibration(shaper, freq, damping, dt) < 0.01f);
+    }
+
+    SUBCASE("ZVD is robust against a wrong frequency") {
+        shaper.set_params(InputShaper<128>::design(3, freq, damping, dt));
+        CHECK(residual_vibration(shaper, freq * 1.1f, damping, dt) < 0.05f);
+    }
+
+    SUBCASE("steady input passes unchanged") {
+        shaper.set_params(InputShaper<128>::design(3, freq, damping, dt));
+        for (int i = 0; i < 3000; ++i) {
+            InputShaper<128>::Sample out = shaper.update({2.0f, 1.0f, 0.5f, 0.25f});
+            CHECK(out.pos == doctest::Approx(2.0f));
+            CHECK(out.torque == doctest::Approx(0.25f));
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include <doctest.h>
+#include "MotorControl/iterative_learning.hpp"
+#include <cmath>
+
+TEST_CASE("iterative learning") {
+    constexpr size_t N = 32;
+    IterativeLearning<N> learning;
+    IterativeLearning<N>::Table table;
+    const float stiffness = 10.0f; // [Nm/turn] of the position loop
+
+    // Periodic load torque that the position loop alone can't reject
+    auto disturbance = [](float phase) {
+        return 0.5f * std::sin(2.0f * (float)M_PI * phase) + 0.2f;
+    };
+
+    // Quasi-static loop: the position error is the torque that the
+    // feedforward leaves over, divided by the loop stiffness
+    auto run_cycle = [&](size_t samples) {
+        for (size_t k = 0; k < samples; ++k) {
+            float phase = (float)k / (float)samples;
+            float residual = disturbance(phase) - IterativeLearning<N>::feedforward(table, phase);
+            learning.record(phase, residual / stiffness);
+        }
+        return learning.end_cycle();
+    };
+
+    SUBCASE("converges to the disturbance") {
+        IterativeLearning<N>::Params params = {true, 0.5f * stiffness, 0, 0.2f, 1.0f};
+        float first_rms = 0.0f;
+        for (int cycle = 0; cycle < 30; ++cycle) {
+            CHECK(run_cycle(400));
+            CHECK(learning.update(&table, params));
+            if (cycle == 0) {
+                first_rms = learning.rms_error_;
+            }
+        }
+        CHECK(table.learned);
+        CHECK(learning.cycle_count_ == 30);
+        CHECK(learning.rms_error_ < 0.05f * first_rms);
+        for (size_t i = 0; i < N; ++i) {
+            float phase = (float)i / (float)N;
+            CHECK(table.values[i] == doctest::Approx(disturbance(phase)).epsilon(0.05));
+        }
+        CHECK_FALSE(learning.update(&table, params)); // nothing pending
+    }
+
+    SUBCASE("the torque limit bounds the table") {
+        IterativeLearning<N>::Params params = {true, stiffness, 0, 0.0f, 0.3f};
+        for (int cycle = 0; cycle < 10; ++cycle) {
+            run_cycle(400);
+            learning.update(&table, params);
+        }
+        for (size_t i = 0; i < N; ++i) {
+            CHECK(std::abs(table.values[i]) <= 0.3f);
+        }
+    }
+
+    SUBCASE("learn = false only measures") {
+        IterativeLearning<N>::Params params = {false, stiffness, 0, 0.5f, 1.0f};
+        run_cycle(400);
+        CHECK(learning.update(&table, params));
+        CHECK_FALSE(table.learned);
+        CHECK(learning.cycle_count_ == 0);
+        CHECK(learning.rms_error_ > 0.0f);
+        for (size_t i = 0; i < N; ++i) {
+            CHECK(table.values[i] == 0.0f);
+        }
+    }
+
+    SUBCASE("lead shifts the error") {
+        IterativeLearning<N>::Params params = {true, 1.0f, 2, 0.0f, 1.0f};
+        learning.record(5.5f / N, 0.1f);
+        learning.end_cycle();
+        learning.update(&table, params);
+        CHECK(table.values[3] == doctest::Approx(0.1f));
+        CHECK(table.values[5] == 0.0f);
+    }
+
+    SUBCASE("the filter keeps constants and the phase of harmonics") {
+        IterativeLearning<N>::Params params = {true, 1.0f, 0, 0.5f, 10.0f};
+        for (size_t i = 0; i < N; ++i) {
+            float phase = ((float)i + 0.5f) / (float)N;
+            learning.record(phase, 1.0f + std::cos(2.0f * (float)M_PI * phase));
+        }
+        learning.end_cycle();
+        learning.update(&table, params);
+        // The peak of the attenuated cosine stays between bins N - 1 and 0
+        CHECK(table.values[0] == doctest::Approx(table.values[N - 1]).epsilon(1e-3));
+        float mean = 0.0f;
+        for (size_t i = 0; i < N; ++i) {
+            mean += table.values[i] / (float)N;
+        }
+        CHECK(mean == doctest::Approx(1.0f).epsilon(1e-3));
+        CHECK(table.values[0] > 1.5f);
+        CHECK(table.values[0] < 2.0f);
+    }
+
+    SUBCASE("a cycle that ends before the update is skipped") {
+        IterativeLearning<N>::Params params = {true, stiffness, 0, 0.0f, 1.0f};
+        CHECK(run_cycle(100));
+        CHECK_FALSE(run_cycle(100));
+        CHECK(learning.skipped_count_ == 1);
+        CHECK(learning.update(&table, params));
+        CHECK(run_cycle(100));
+        CHECK(learning.update(&table, params));
+        CHECK(learning.cycle_count_ == 2);
+    }
+}
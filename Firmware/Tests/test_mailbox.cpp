@@ -0,0 +1,41 @@
+#include <doctest.h>
+#include "MotorControl/mailbox.hpp"
+
+struct TestCommand {
+    std::optional<float> a;
+    std::optional<float> b;
+};
+
+TEST_CASE("Mailbox delivers each value once") {
+    Mailbox<TestCommand> mailbox;
+    CHECK(!mailbox.fetch().has_value());
+
+    mailbox.post([](TestCommand& cmd) { cmd.a = 1.0f; });
+    std::optional<TestCommand> cmd = mailbox.fetch();
+    REQUIRE(cmd.has_value());
+    CHECK(cmd->a == 1.0f);
+    CHECK(!cmd->b.has_value());
+    CHECK(!mailbox.fetch().has_value());
+}
+
+TEST_CASE("Mailbox combines unconsumed posts") {
+    Mailbox<TestCommand> mailbox;
+    mailbox.post([](TestCommand& cmd) { cmd.a = 1.0f; });
+    mailbox.post([](TestCommand& cmd) { cmd.b = 2.0f; });
+    mailbox.post([](TestCommand& cmd) { cmd.a = 3.0f; });
+    std::optional<TestCommand> cmd = mailbox.fetch();
+    REQUIRE(cmd.has_value());
+    CHECK(cmd->a == 3.0f);
+    CHECK(cmd->b == 2.0f);
+
+    // Once fetched, the next post starts from a clean value
+    mailbox.post([](TestCommand& cmd) { cmd.b = 4.0f; });
+    cmd = mailbox.fetch();
+    REQUIRE(cmd.has_value());
+    CHECK(!cmd->a.has_value());
+    CHECK(cmd->b == 4.0f);
+
+    mailbox.post([](TestCommand& cmd) { cmd.a = 5.0f; });
+    mailbox.clear();
+    CHECK(!mailbox.fetch().has_value());
+}
@@ -0,0 +1,73 @@
+#include <doctest.h>
+#include "Simulation/motor_sim.hpp"
+
+static constexpr double kDt = 1.0 / 48000.0; // as in MotorSim.py
+
+TEST_CASE("MotorSim current follows the RL time constant at standstill") {
+    MotorSim::Params params;
+    params.J = 1e6; // locked rotor
+    MotorSim sim(params);
+
+    double tau = params.L_q / params.R;
+    size_t n = (size_t)std::round(tau / kDt);
+    for (size_t i = 0; i < n; ++i) {
+        sim.step(kDt, 0.0, 1.0, 0.0);
+    }
+    double I_final = 1.0 / params.R;
+    CHECK(sim.state_.I_q == doctest::Approx(I_final * (1.0 - std::exp(-(double)n * kDt / tau))).epsilon(1e-4));
+    CHECK(sim.state_.I_d == doctest::Approx(0.0));
+
+    for (size_t i = 0; i < 20 * n; ++i) {
+        sim.step(kDt, 0.0, 1.0, 0.0);
+    }
+    CHECK(sim.state_.I_q == doctest::Approx(I_final).epsilon(1e-4));
+}
+
+TEST_CASE("MotorSim reaches the steady state of the example in MotorSim.py") {
+    MotorSim::Params params;
+    MotorSim sim(params);
+    for (size_t i = 0; i < 24000; ++i) {
+        sim.step(kDt, 0.0, 1.0, 0.0);
+    }
+
+    // Torque balance and voltage equations with all derivatives zero
+    double omega_e = sim.state_.theta_dot * params.pole_pairs;
+    double lambda = sim.get_lambda_m();
+    CHECK(sim.state_.theta_dot > 0.0);
+    CHECK(sim.get_torque() == doctest::Approx(params.b_viscous * sim.state_.theta_dot).epsilon(1e-4));
+    CHECK(params.R * sim.state_.I_q + omega_e * params.L_d * sim.state_.I_d + omega_e * lambda
+          == doctest::Approx(1.0).epsilon(1e-4));
+    CHECK(params.R * sim.state_.I_d - omega_e * params.L_q * sim.state_.I_q == doctest::Approx(0.0).epsilon(1e-4));
+}
+
+TEST_CASE("MotorSim Coulomb friction holds the rotor") {
+    MotorSim::Params params;
+    params.b_coulomb = 0.01;
+    MotorSim sim(params);
+    for (size_t i = 0; i < 4800; ++i) {
+        sim.step(kDt, 0.0, 0.0, 0.005);
+    }
+    CHECK(sim.state_.theta == 0.0);
+    CHECK(sim.state_.theta_dot == 0.0);
+
+    // A larger load torque overcomes it
+    for (size_t i = 0; i < 4800; ++i) {
+        sim.step(kDt, 0.0, 0.0, 0.02);
+    }
+    CHECK(sim.state_.theta_dot < 0.0);
+}
+
+TEST_CASE("MotorSim stationary frame interface") {
+    MotorSim::Params params;
+    params.J = 1e6;
+    MotorSim sim(params);
+    sim.state_.theta = 0.3;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        sim.step_alpha_beta(kDt, 0.5, -0.2, 0.0);
+    }
+    std::array<double, 3> I = sim.get_phase_currents();
+    CHECK(I[0] + I[1] + I[2] == doctest::Approx(0.0));
+    CHECK(I[0] == doctest::Approx(0.5 / params.R).epsilon(1e-4));
+    CHECK((I[1] - I[2]) / std::sqrt(3.0) == doctest::Approx(-0.2 / params.R).epsilon(1e-4));
+}
@@ -0,0 +1,123 @@
+#include <doctest.h>
+#include "MotorControl/move_queue.hpp"
+#include <cmath>
+
+// Plans all queued moves and returns the number of points
+static size_t plan_all(MoveQueue<8>& queue, float* pos, float* vel, const MoveQueue<8>::Limits& limits,
+                       PvtPoint* out, size_t max_points) {
+    size_t total = 0;
+    PvtPoint points[MoveQueue<8>::kMaxPoints];
+    while (size_t n = queue.plan_next(pos, vel, limits, points)) {
+        for (size_t i = 0; i < n && total < max_points; ++i) {
+            out[total++] = points[i];
+        }
+    }
+    return total;
+}
+
+TEST_CASE("move queue") {
+    MoveQueue<8> queue;
+    MoveQueue<8>::Limits limits = {2.0f, 4.0f, 8.0f};
+    float pos = 0.0f;
+    float vel = 0.0f;
+    PvtPoint points[MoveQueue<8>::kMaxPoints];
+
+    SUBCASE("single move is a trapezoid") {
+        CHECK(queue.push(3.0f));
+        CHECK(queue.level() == 1);
+        size_t n = queue.plan_next(&pos, &vel, limits, points);
+        REQUIRE(n == 3);
+        CHECK(points[0].duration == doctest::Approx(0.5f)); // 2 / 4
+        CHECK(points[0].pos == doctest::Approx(0.5f));
+        CHECK(points[0].vel == doctest::Approx(2.0f));
+        CHECK(points[1].pos == doctest::Approx(2.75f)); // 3 - 2^2 / (2 * 8)
+        CHECK(points[2].duration == doctest::Approx(0.25f));
+        CHECK(points[2].pos == 3.0f);
+        CHECK(points[2].vel == 0.0f);
+        CHECK(pos == 3.0f);
+        CHECK(vel == 0.0f);
+        CHECK(queue.level() == 0);
+        CHECK(queue.plan_next(&pos, &vel, limits, points) == 0);
+    }
+
+    SUBCASE("blends through waypoints in the same direction") {
+        CHECK(queue.push(1.0f));
+        CHECK(queue.push(2.0f));
+        CHECK(queue.push(3.0f));
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(pos == 1.0f);
+        CHECK(vel == doctest::Approx(2.0f)); // cruise through the first waypoint
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(pos == 2.0f);
+        CHECK(vel == doctest::Approx(2.0f)); // 1 turn is enough to stop from 2 turn/s
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(pos == 3.0f);
+        CHECK(vel == 0.0f);
+    }
+
+    SUBCASE("lookahead limits the velocity at the waypoints") {
+        CHECK(queue.push(1.0f));
+        CHECK(queue.push(1.0625f));
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(pos == 1.0f);
+        CHECK(vel == doctest::Approx(1.0f)); // sqrt(2 * 8 * 0.0625)
+    }
+
+    SUBCASE("stops at reversals and skips repeated waypoints") {
+        CHECK(queue.push(1.0f));
+        CHECK(queue.push(1.0f));
+        CHECK(queue.push(0.5f));
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(pos == 1.0f);
+        CHECK(vel == 0.0f);
+        REQUIRE(queue.plan_next(&pos, &vel, limits, points) > 0);
+        CHECK(points[0].vel < 0.0f);
+        CHECK(pos == 0.5f);
+        CHECK(vel == 0.0f);
+        CHECK(queue.level() == 0);
+    }
+
+    SUBCASE("full and clear") {
+        for (int i = 0; i < 8; ++i) {
+            CHECK(queue.push((float)(i + 1)));
+        }
+        CHECK_FALSE(queue.push(9.0f));
+        CHECK_FALSE(queue.handle_clear_request());
+        queue.request_clear();
+        CHECK(queue.handle_clear_request());
+        CHECK(queue.level() == 0);
+        CHECK(queue.plan_next(&pos, &vel, limits, points) == 0);
+    }
+
+    SUBCASE("playback is continuous and within the limits") {
+        const float waypoints[] = {0.5f, 1.5f, 1.6f, 0.2f, -1.0f, -1.0f, 0.0f};
+        for (float waypoint: waypoints) {
+            CHECK(queue.push(waypoint));
+        }
+        PvtPoint planned[8 * MoveQueue<8>::kMaxPoints];
+        size_t n = plan_all(queue, &pos, &vel, limits, planned, 8 * MoveQueue<8>::kMaxPoints);
+
+        PvtPoint storage[8 * MoveQueue<8>::kMaxPoints + 1];
+        PvtBuffer buf;
+        buf.init(storage, 8 * MoveQueue<8>::kMaxPoints + 1);
+        buf.start(0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(buf.push(planned[i]));
+        }
+
+        float dt = 1e-3f;
+        auto last = buf.update(dt);
+        float max_step = 0.0f;
+        for (int i = 0; i < 10000 && buf.level() > 0; ++i) {
+            auto step = buf.update(dt);
+            max_step = std::max(max_step, std::abs(step.vel - last.vel));
+            CHECK(std::abs(step.vel) <= limits.vel * 1.001f);
+            CHECK(std::abs(step.accel) <= limits.decel * 1.001f);
+            CHECK(std::abs(step.pos - last.pos) <= limits.vel * dt * 1.001f);
+            last = step;
+        }
+        CHECK(max_step <= limits.decel * dt * 1.001f);
+        CHECK(buf.update(dt).pos == 0.0f);
+        CHECK(buf.underrun_count_ == 0);
+    }
+}
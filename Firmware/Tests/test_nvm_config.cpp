@@ -0,0 +1,382 @@
+#include <doctest.h>
+#include "MotorControl/nvm_config.hpp"
+
+// Flash emulation: programming can only clear bits, erasing sets them again.
+static constexpr size_t kSectorSize = 1024;
+static uint8_t flash[NVM_NUM_SECTORS][kSectorSize];
+static size_t erase_count[NVM_NUM_SECTORS];
+static size_t bytes_programmed;
+static int program_budget = -1; // number of NVM_program calls until a power loss, -1 for no limit
+
+size_t NVM_get_sector_size(void) {
+    return kSectorSize;
+}
+
+const uint8_t* NVM_get_sector(size_t sector) {
+    return sector < NVM_NUM_SECTORS ? flash[sector] : nullptr;
+}
+
+int NVM_erase_sector(size_t sector) {
+    memset(flash[sector], 0xff, kSectorSize);
+    erase_count[sector]++;
+    return 0;
+}
+
+int NVM_program(size_t sector, size_t offset, const uint8_t *data, size_t length) {
+    if (program_budget == 0)
+        return -1;
+    if (program_budget > 0)
+        program_budget--;
+    REQUIRE(offset + length <= kSectorSize);
+    for (size_t i = 0; i < length; ++i) {
+        REQUIRE((flash[sector][offset + i] & data[i]) == data[i]);
+        flash[sector][offset + i] = data[i];
+    }
+    bytes_programmed += length;
+    return 0;
+}
+
+int NVM_erase(void) {
+    for (size_t i = 0; i < NVM_NUM_SECTORS; ++i)
+        NVM_erase_sector(i);
+    return 0;
+}
+
+struct SmallConfig {
+    uint32_t a = 1;
+    float b = 2.0f;
+};
+
+struct LargeConfig {
+    float map[40] = {};
+};
+
+struct TestConfig {
+    SmallConfig small;
+    LargeConfig large;
+    uint8_t odd[3] = {4, 5, 6};
+};
+
+static uint8_t staging_buffer[512];
+
+static bool stage(ConfigManager& manager, TestConfig& config) {
+    return manager.start_staging(staging_buffer, sizeof(staging_buffer))
+        && manager.stage(&config.small) && manager.stage(&config.large) && manager.stage(&config.odd)
+        && manager.finish_staging();
+}
+
+// Saves like the firmware does when the motors are disarmed
+static bool save(ConfigManager& manager, TestConfig& config) {
+    if (!stage(manager, config)) {
+        return false;
+    }
+    if (manager.needs_erase()) {
+        manager.erase_spare();
+    }
+    bool success = manager.store_staged();
+    manager.erase_spare();
+    return success;
+}
+
+static bool load(TestConfig& config) {
+    ConfigManager manager; // like after a reboot
+    return manager.start_load()
+        && manager.read(&config.small) && manager.read(&config.large) && manager.read(&config.odd)
+        && manager.finish_load(nullptr);
+}
+
+static void reset_flash() {
+    NVM_erase();
+    for (size_t& count: erase_count)
+        count = 0;
+    bytes_programmed = 0;
+    program_budget = -1;
+}
+
+static bool equal(const TestConfig& x, const TestConfig& y) {
+    return !memcmp(&x.small, &y.small, sizeof(x.small))
+        && !memcmp(&x.large, &y.large, sizeof(x.large))
+        && !memcmp(&x.odd, &y.odd, sizeof(x.odd));
+}
+
+TEST_CASE("config store loads what was saved") {
+    reset_flash();
+    TestConfig config, loaded;
+    CHECK(!load(loaded));
+
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    config.small.a = 42;
+    config.large.map[7] = 3.0f;
+    REQUIRE(save(manager, config));
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+}
+
+TEST_CASE("config store only appends changed objects") {
+    reset_flash();
+    TestConfig config, loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    REQUIRE(save(manager, config));
+    size_t initial_erases = erase_count[0] + erase_count[1];
+
+    // Nothing changed: nothing is written
+    bytes_programmed = 0;
+    REQUIRE(save(manager, config));
+    CHECK(bytes_programmed == 0);
+
+    // One small object changed: only its record and a commit record
+    config.small.b = 5.0f;
+    REQUIRE(save(manager, config));
+    CHECK(bytes_programmed == 12 + sizeof(SmallConfig) + 12);
+    CHECK(erase_count[0] + erase_count[1] == initial_erases);
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+}
+
+TEST_CASE("config store alternates the sectors when full") {
+    reset_flash();
+    TestConfig config, loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+
+    for (int i = 0; i < 100; ++i) {
+        config.large.map[i % 40] = (float)i;
+        config.odd[0] = (uint8_t)i;
+        REQUIRE(save(manager, config));
+        REQUIRE(load(loaded));
+        CHECK(equal(config, loaded));
+
+        // the manager survives a reboot at any point
+        if (i % 7 == 0) {
+            manager = ConfigManager();
+            REQUIRE(manager.start_load());
+        }
+    }
+    CHECK(erase_count[0] > 2);
+    CHECK(erase_count[1] > 2);
+    CHECK(abs((int)erase_count[0] - (int)erase_count[1]) <= 1);
+}
+
+TEST_CASE("config store ignores interrupted saves") {
+    reset_flash();
+    TestConfig config, loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    REQUIRE(save(manager, config));
+
+    for (int budget = 0; budget < 5; ++budget) {
+        TestConfig changed = config;
+        changed.small.a = 100 + budget;
+        changed.large.map[0] = 1.0f + budget;
+
+        // power loss before the commit record is complete
+        program_budget = budget;
+        CHECK(!save(manager, changed));
+        program_budget = -1;
+        REQUIRE(load(loaded));
+        CHECK(equal(config, loaded));
+
+        // the next boot can save again
+        manager = ConfigManager();
+        REQUIRE(manager.start_load());
+        config = changed;
+        REQUIRE(save(manager, config));
+        REQUIRE(load(loaded));
+        CHECK(equal(config, loaded));
+    }
+}
+
+TEST_CASE("config store rejects objects that changed their size") {
+    reset_flash();
+    TestConfig config;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    REQUIRE(save(manager, config));
+
+    ConfigManager reader;
+    LargeConfig large;
+    uint32_t wrong_size;
+    REQUIRE(reader.start_load());
+    CHECK(reader.read(&config.small));
+    CHECK(!reader.read(&wrong_size));
+    CHECK(!reader.read(&large));
+    CHECK(!reader.finish_load(nullptr));
+}
+
+TEST_CASE("config store doesn't erase on its own") {
+    reset_flash();
+    TestConfig config, loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    REQUIRE(stage(manager, config));
+    CHECK(!manager.needs_erase()); // the flash was erased
+    REQUIRE(manager.store_staged());
+
+    // Without erasing ahead, a compaction fails and keeps the old data
+    size_t erases = erase_count[0] + erase_count[1];
+    int i = 0;
+    for (; i < 100; ++i) {
+        config.large.map[0] = (float)i;
+        REQUIRE(stage(manager, config));
+        if (manager.needs_erase()) {
+            break;
+        }
+        REQUIRE(manager.store_staged());
+    }
+    REQUIRE(i < 100);
+    TestConfig previous = config;
+    previous.large.map[0] = (float)(i - 1);
+    CHECK(!manager.store_staged());
+    CHECK(erase_count[0] + erase_count[1] == erases);
+    REQUIRE(load(loaded));
+    CHECK(equal(previous, loaded));
+
+    // The spare sector is erased once, after that the compaction succeeds
+    REQUIRE(stage(manager, config));
+    CHECK(manager.erase_spare());
+    CHECK(manager.erase_spare());
+    CHECK(erase_count[0] + erase_count[1] == erases + 1);
+    CHECK(manager.store_staged());
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+}
+
+TEST_CASE("config store stages a copy") {
+    reset_flash();
+    TestConfig config, loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    config.small.a = 7;
+    REQUIRE(stage(manager, config));
+    CHECK(!manager.start_staging(staging_buffer, sizeof(staging_buffer))); // busy until stored
+    config.small.a = 8;
+    REQUIRE(manager.store_staged());
+    REQUIRE(load(loaded));
+    CHECK(loaded.small.a == 7);
+
+    // An object that doesn't fit into the staging buffer fails the staging
+    uint8_t small_buffer[16];
+    REQUIRE(manager.start_staging(small_buffer, sizeof(small_buffer)));
+    CHECK(manager.stage(&config.small));
+    CHECK(!manager.stage(&config.large));
+    CHECK(!manager.finish_staging());
+    CHECK(!manager.store_staged());
+}
+
+TEST_CASE("config store keeps blobs that are not staged") {
+    reset_flash();
+    TestConfig config, loaded;
+    LargeConfig blob, blob_loaded;
+    blob.map[3] = 9.0f;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    CHECK(!manager.read_blob(0, 1, &blob_loaded));
+    REQUIRE(manager.start_staging(staging_buffer, sizeof(staging_buffer)));
+    REQUIRE(manager.stage(&config.small));
+    REQUIRE(manager.stage(&config.large));
+    REQUIRE(manager.stage(&config.odd));
+    REQUIRE(manager.stage_blob(0, 1, &blob));
+    REQUIRE(manager.finish_staging());
+    REQUIRE(manager.store_staged());
+
+    // Saves without the blob, across several compactions
+    size_t erases = erase_count[0] + erase_count[1];
+    for (int i = 0; i < 50; ++i) {
+        config.large.map[i % 40] = (float)i;
+        REQUIRE(save(manager, config));
+    }
+    CHECK(erase_count[0] + erase_count[1] > erases + 2);
+
+    ConfigManager reader;
+    REQUIRE(reader.start_load());
+    CHECK(reader.read_blob(0, 1, &blob_loaded));
+    CHECK(!memcmp(&blob, &blob_loaded, sizeof(blob)));
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+
+    // A blob of another version or size is not loaded
+    LargeConfig untouched;
+    SmallConfig wrong_size;
+    CHECK(!reader.read_blob(0, 2, &untouched));
+    CHECK(untouched.map[3] == 0.0f);
+    CHECK(!reader.read_blob(0, 1, &wrong_size));
+    CHECK(!reader.read_blob(1, 1, &untouched));
+    CHECK(!reader.read_blob(CONFIG_MAX_BLOBS, 1, &untouched));
+}
+
+TEST_CASE("config store only appends changed blobs") {
+    reset_flash();
+    TestConfig config;
+    LargeConfig blob, blob_loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    auto save_with_blob = [&](uint16_t version) {
+        return manager.start_staging(staging_buffer, sizeof(staging_buffer))
+            && manager.stage(&config.small) && manager.stage(&config.large) && manager.stage(&config.odd)
+            && manager.stage_blob(1, version, &blob) && manager.finish_staging()
+            && manager.store_staged();
+    };
+    REQUIRE(save_with_blob(1));
+
+    bytes_programmed = 0;
+    REQUIRE(save_with_blob(1));
+    CHECK(bytes_programmed == 0);
+
+    // A new version is written even if the content is the same
+    REQUIRE(save_with_blob(2));
+    CHECK(bytes_programmed == 12 + sizeof(LargeConfig) + 12);
+    REQUIRE(manager.read_blob(1, 2, &blob_loaded));
+    CHECK(!manager.read_blob(1, 1, &blob_loaded));
+}
+
+TEST_CASE("config store writes single blobs right away") {
+    reset_flash();
+    TestConfig config, loaded;
+    SmallConfig blob, blob_loaded;
+    ConfigManager manager;
+    REQUIRE(manager.start_load());
+    CHECK(!manager.store_blob(2, 1, &blob)); // there is no sector yet
+    REQUIRE(save(manager, config));
+
+    blob.a = 7;
+    bytes_programmed = 0;
+    REQUIRE(manager.store_blob(2, 1, &blob));
+    CHECK(bytes_programmed == 12 + sizeof(SmallConfig) + 12);
+    CHECK(!manager.store_blob(CONFIG_MAX_BLOBS, 1, &blob));
+
+    // Visible after a reboot, and the configuration is not affected
+    ConfigManager reader;
+    REQUIRE(reader.start_load());
+    REQUIRE(reader.read_blob(2, 1, &blob_loaded));
+    CHECK(blob_loaded.a == 7);
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+
+    // When the sector is full the blob is rejected, and the next save
+    // compacts and keeps the latest version
+    while (manager.store_blob(2, 1, &blob)) {
+        blob.a++;
+    }
+    CHECK(manager.get_free_space() < 12 + sizeof(SmallConfig) + 12);
+    blob.a--;
+    config.small.a = 3;
+    REQUIRE(save(manager, config));
+    ConfigManager compacted;
+    REQUIRE(compacted.start_load());
+    REQUIRE(compacted.read_blob(2, 1, &blob_loaded));
+    CHECK(blob_loaded.a == blob.a);
+    REQUIRE(load(loaded));
+    CHECK(equal(config, loaded));
+
+    // A power loss during the write leaves the previous version
+    uint32_t previous = blob.a;
+    program_budget = 1;
+    blob.a = 100;
+    CHECK(!manager.store_blob(2, 1, &blob));
+    ConfigManager interrupted;
+    REQUIRE(interrupted.start_load());
+    REQUIRE(interrupted.read_blob(2, 1, &blob_loaded));
+    CHECK(blob_loaded.a == previous);
+}
@@ -0,0 +1,48 @@
+#include <doctest.h>
+#include "MotorControl/phase_offset_fit.hpp"
+
+// Simulates a short back and forth scan in which the rotor lags the
+// commanded angle by a constant amount and the encoder quantizes the
+// position to whole counts.
+static void scan(PhaseOffsetFit& fit, float offset, float counts_per_rad, float lag, size_t passes) {
+    const float distance = 2.0f * (float)M_PI;
+    const size_t steps = 500;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        for (size_t dir = 0; dir < 2; ++dir) {
+            for (size_t i = 0; i < steps; ++i) {
+                float x = distance * (float)i / (float)steps;
+                float angle = dir == 0 ? -0.5f * distance + x : 0.5f * distance - x;
+                float rotor = angle + (dir == 0 ? -lag : lag);
+                fit.update(angle, std::floor(offset + counts_per_rad * rotor));
+            }
+        }
+    }
+}
+
+TEST_CASE("PhaseOffsetFit finds offset and direction") {
+    PhaseOffsetFit fit;
+    fit.reset();
+    CHECK(!fit.is_valid());
+
+    const float counts_per_rad = 8192.0f / (2.0f * (float)M_PI * 7.0f);
+    scan(fit, 100000.25f, -counts_per_rad, 0.0f, 1);
+    REQUIRE(fit.is_valid());
+    CHECK(fit.get_slope() == doctest::Approx(-counts_per_rad).epsilon(0.001));
+    CHECK(fit.get_count(0.0f) == doctest::Approx(100000.25f - 0.5f).epsilon(1e-5));
+    CHECK(fit.get_count_uncertainty(0.0f) < 0.1f);
+}
+
+TEST_CASE("PhaseOffsetFit cancels the lag of a round trip") {
+    PhaseOffsetFit fit;
+    fit.reset();
+    const float counts_per_rad = 100.0f;
+    scan(fit, 50.0f, counts_per_rad, 0.2f, 1);
+    REQUIRE(fit.is_valid());
+    CHECK(fit.get_count(0.0f) == doctest::Approx(49.5f).epsilon(0.01));
+    float uncertainty = fit.get_count_uncertainty(0.0f);
+    CHECK(uncertainty > 0.1f); // the lag shows up in the residuals
+
+    scan(fit, 50.0f, counts_per_rad, 0.2f, 3);
+    CHECK(fit.get_count(0.0f) == doctest::Approx(49.5f).epsilon(0.01));
+    CHECK(fit.get_count_uncertainty(0.0f) < 0.6f * uncertainty);
+}
@@ -0,0 +1,39 @@
+#include <doctest.h>
+#include "MotorControl/poly_table.hpp"
+#include <cmath>
+
+static float eval_direct(const float* coeffs, size_t num_coeffs, float x) {
+    float result = 0.0f;
+    for (size_t i = 0; i < num_coeffs; ++i)
+        result = (result * x) + coeffs[i];
+    return result;
+}
+
+TEST_CASE("PolyTable matches the thermistor polynomial") {
+    const float coeffs[] = {363.93910201f, -462.15369634f, 307.55129571f, -27.72569531f};
+    PolyTable table;
+    for (float x = 0.0f; x <= 1.0f; x += 0.001f) {
+        CHECK(std::abs(table.eval(coeffs, 4, x) - eval_direct(coeffs, 4, x)) < 0.2f); // [°C]
+    }
+    // exact at the table points and the ends
+    CHECK(table.eval(coeffs, 4, 0.0f) == doctest::Approx(coeffs[3]));
+    CHECK(table.eval(coeffs, 4, 1.0f) == doctest::Approx(eval_direct(coeffs, 4, 1.0f)));
+    CHECK(table.eval(coeffs, 4, 0.5f) == doctest::Approx(eval_direct(coeffs, 4, 0.5f)));
+}
+
+TEST_CASE("PolyTable follows coefficient changes") {
+    float coeffs[] = {0.0f, 0.0f, 1.0f, 0.0f}; // x
+    PolyTable table;
+    CHECK(table.eval(coeffs, 4, 0.25f) == doctest::Approx(0.25f));
+    coeffs[3] = 10.0f; // x + 10
+    CHECK(table.eval(coeffs, 4, 0.25f) == doctest::Approx(10.25f));
+    CHECK(table.eval(coeffs, 3, 0.25f) == doctest::Approx(1.0f)); // the first three: 1
+}
+
+TEST_CASE("PolyTable evaluates invalid arguments directly") {
+    const float coeffs[] = {1.0f, 0.0f, 0.0f}; // x^2
+    PolyTable table;
+    CHECK(std::isnan(table.eval(coeffs, 3, NAN)));
+    CHECK(table.eval(coeffs, 3, 2.0f) == doctest::Approx(4.0f));
+    CHECK(table.eval(coeffs, 3, -1.0f) == doctest::Approx(1.0f));
+}
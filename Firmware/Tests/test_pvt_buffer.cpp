@@ -0,0 +1,68 @@
+#include <doctest.h>
+#include "MotorControl/pvt_buffer.hpp"
+#include <cmath>
+
+TEST_CASE("PVT buffer") {
+    PvtPoint storage[5];
+    PvtBuffer buf;
+    buf.init(storage, 5);
+    CHECK(buf.capacity() == 4);
+    buf.start(0.0f, 0.0f, 0.0f);
+
+    SUBCASE("interpolation") {
+        // Points on pos = t^3 with exact velocities, which a cubic reproduces
+        CHECK(buf.push({0.5f, 0.125f, 0.75f, 1.0f}));
+        CHECK(buf.push({0.5f, 1.0f, 3.0f, 2.0f}));
+        CHECK(buf.level() == 2);
+
+        float dt = 0.01f;
+        float t = 0.0f;
+        for (int i = 0; i < 99; ++i) {
+            auto step = buf.update(dt);
+            t += dt;
+            float expected_torque = (t < 0.5f) ? (2.0f * t) : (1.0f + 2.0f * (t - 0.5f));
+            CHECK(step.pos == doctest::Approx(t * t * t).epsilon(1e-4));
+            CHECK(step.vel == doctest::Approx(3.0f * t * t).epsilon(1e-3));
+            CHECK(step.accel == doctest::Approx(6.0f * t).epsilon(1e-3));
+            CHECK(step.torque == doctest::Approx(expected_torque).epsilon(1e-4));
+        }
+        CHECK(buf.underrun_count_ == 0);
+
+        // The last point has a nonzero velocity, so running out is an underrun
+        auto step = buf.update(dt);
+        step = buf.update(dt);
+        CHECK(buf.underrun_count_ == 1);
+        CHECK(step.pos == 1.0f);
+        CHECK(step.vel == 0.0f);
+        buf.update(dt);
+        CHECK(buf.underrun_count_ == 1);
+    }
+
+    SUBCASE("overrun") {
+        for (int i = 0; i < 4; ++i) {
+            CHECK(buf.push({0.1f, 0.0f, 0.0f, 0.0f}));
+        }
+        CHECK(!buf.push({0.1f, 0.0f, 0.0f, 0.0f}));
+        CHECK(!buf.push({0.0f, 0.0f, 0.0f, 0.0f}));
+        CHECK(buf.overrun_count_ == 2);
+        CHECK(buf.level() == 4);
+
+        buf.update(0.05f);
+        buf.request_clear();
+        auto step = buf.update(0.01f);
+        CHECK(buf.level() == 0);
+        CHECK(step.pos == 0.0f);
+        CHECK(buf.underrun_count_ == 0);
+    }
+}
+
+TEST_CASE("PVT buffer without storage") {
+    PvtBuffer buf;
+    buf.init(nullptr, 0);
+    buf.start(1.0f, 0.0f, 0.0f);
+    CHECK(buf.capacity() == 0);
+    CHECK(!buf.push({0.1f, 2.0f, 0.0f, 0.0f}));
+    CHECK(buf.overrun_count_ == 1);
+    CHECK(buf.level() == 0);
+    CHECK(buf.update(0.01f).pos == 1.0f);
+}
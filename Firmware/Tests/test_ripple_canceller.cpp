@@ -0,0 +1,78 @@
+#include <doctest.h>
+#include "MotorControl/ripple_canceller.hpp"
+#include <cmath>
+
+static const float kTorqueConstant = 0.05f; // [Nm/A]
+static const float kInertia = 1e-4f; // [Nm/(turn/s^2)]
+static const float kPolePairs = 7.0f;
+static const float kDt = 1.0f / 8000.0f;
+
+// Runs a velocity loop with a bandwidth of 100 rad/s on an inertia with
+// torque ripple at the 1st and 6th electrical harmonic. Returns the RMS
+// velocity ripple [turn/s] of the last 0.1 s.
+static float run(RippleCanceller* canceller, float vel_setpoint, float duration) {
+    const float dt = kDt;
+    const float vel_gain = 0.01f; // [Nm/(turn/s)]
+    const float vel_integrator_gain = 0.1f; // [Nm/(turn/s * s)]
+    float pos = 0.0f;
+    float vel = vel_setpoint;
+    float integrator = 0.0f;
+    double sum_sq = 0.0;
+    size_t n = 0;
+    size_t steps = (size_t)(duration / dt);
+    for (size_t i = 0; i < steps; ++i) {
+        float phase = 2.0f * (float)M_PI * kPolePairs * pos;
+        float vel_error = vel_setpoint - vel;
+        integrator += vel_integrator_gain * vel_error * dt;
+        float torque = vel_gain * vel_error + integrator;
+        if (canceller) {
+            float phase_vel = 2.0f * (float)M_PI * kPolePairs * vel;
+            float delayed = phase - phase_vel * canceller->config_.delay;
+            torque += kTorqueConstant * canceller->update(std::cos(phase), std::sin(phase),
+                    std::cos(delayed), std::sin(delayed), phase_vel, vel, -vel_error, dt);
+        }
+        torque += 0.05f * std::cos(6.0f * phase + 0.3f) + 0.02f * std::sin(phase);
+        vel += torque / kInertia * dt;
+        pos += vel * dt;
+        if (i >= steps - (size_t)(0.1f / dt)) {
+            sum_sq += (vel - vel_setpoint) * (vel - vel_setpoint);
+            n++;
+        }
+    }
+    return (float)std::sqrt(sum_sq / n);
+}
+
+TEST_CASE("ripple canceller") {
+    RippleCanceller canceller;
+    canceller.config_.enable = true;
+    canceller.config_.harmonics[3] = 12;
+    // The velocity of the simulation sees the torque a step later, plus half
+    // a step for holding the torque over the step
+    canceller.config_.delay = 1.5f * kDt;
+
+    SUBCASE("cancels the harmonics at speed") {
+        float ripple = run(nullptr, 20.0f, 1.0f);
+        float compensated = run(&canceller, 20.0f, 1.0f);
+        CHECK(compensated < 0.05f * ripple);
+        CHECK(canceller.get_amplitude(0) == doctest::Approx(0.02f / kTorqueConstant).epsilon(0.05));
+        CHECK(canceller.get_amplitude(2) == doctest::Approx(0.05f / kTorqueConstant).epsilon(0.05));
+        CHECK(canceller.get_amplitude(1) < 0.01f);
+        CHECK(canceller.get_amplitude(3) < 0.01f);
+
+        // Also in the other direction
+        canceller.reset();
+        CHECK(run(&canceller, -20.0f, 1.0f) < 0.05f * run(nullptr, -20.0f, 1.0f));
+    }
+
+    SUBCASE("stays off below the fade in velocity") {
+        run(&canceller, 3.0f, 0.5f);
+        CHECK(canceller.iq_comp_ == 0.0f);
+        CHECK(canceller.get_amplitude(0) == 0.0f);
+    }
+
+    SUBCASE("limits the amplitude") {
+        canceller.config_.max_current = 0.2f;
+        run(&canceller, 20.0f, 1.0f);
+        CHECK(canceller.get_amplitude(2) == doctest::Approx(0.2f));
+    }
+}
@@ -0,0 +1,46 @@
+#include <doctest.h>
+#include "MotorControl/rl_estimator.hpp"
+#include <random>
+
+TEST_CASE("RLEstimator converges to the true parameters") {
+    const float R = 0.1f; // [Ohm]
+    const float L = 30e-6f; // [H]
+    const float flux = 0.005f; // [Wb]
+
+    RLEstimator estimator;
+    estimator.config_.decimation = 1;
+    estimator.reset(0.05f, 60e-6f);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> current(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> vel(-2000.0f, 2000.0f);
+
+    for (size_t i = 0; i < 2000; ++i) {
+        float Id = current(rng);
+        float Iq = current(rng);
+        float w = vel(rng);
+        float Vd = R * Id - w * L * Iq;
+        float Vq = R * Iq + w * L * Id + w * flux;
+        estimator.update(Vd, Vq, Id, Iq, w, flux);
+    }
+
+    CHECK(estimator.get_resistance() == doctest::Approx(R).epsilon(0.01));
+    CHECK(estimator.get_inductance() == doctest::Approx(L).epsilon(0.01));
+}
+
+TEST_CASE("RLEstimator ignores low currents and decimates") {
+    RLEstimator estimator;
+    estimator.config_.decimation = 4;
+    estimator.reset(0.05f, 60e-6f);
+
+    for (size_t i = 0; i < 100; ++i) {
+        estimator.update(1.0f, 1.0f, 0.1f, 0.1f, 0.0f, 0.0f);
+    }
+    CHECK(estimator.n_updates_ == 0);
+    CHECK(estimator.get_resistance() == 0.05f);
+
+    for (size_t i = 0; i < 100; ++i) {
+        estimator.update(0.5f, 0.5f, 5.0f, 5.0f, 0.0f, 0.0f);
+    }
+    CHECK(estimator.n_updates_ == 25);
+}
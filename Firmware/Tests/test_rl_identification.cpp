@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "MotorControl/rl_identification.hpp"
+#include <random>
+
+// Simulates an RL circuit that is driven with a DC voltage and a random
+// binary voltage on top, and measured with noise.
+static void simulate(RLIdentification& id, float R, float L, float T, float noise, size_t n) {
+    std::mt19937 rng(1);
+    std::bernoulli_distribution bit(0.5);
+    std::normal_distribution<float> meas_noise(0.0f, noise);
+
+    float a = std::exp(-R * T / L);
+    float I = 0.0f;
+    float I_meas = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float V = 10.0f * R + (bit(rng) ? 0.5f : -0.5f);
+        I = a * I + (1.0f - a) / R * V;
+        float I_meas_next = I + meas_noise(rng);
+        id.update(I_meas_next - I_meas, I_meas, V);
+        I_meas = I_meas_next;
+    }
+}
+
+TEST_CASE("RLIdentification finds R and L from noise free data") {
+    const float T = 125e-6f;
+    for (auto [R, L]: {std::pair{0.05f, 20e-6f}, std::pair{0.1f, 50e-6f}, std::pair{1.0f, 2e-3f}}) {
+        RLIdentification id;
+        id.reset(T);
+        simulate(id, R, L, T, 0.0f, 400);
+        REQUIRE(id.is_valid());
+        CHECK(id.get_resistance() == doctest::Approx(R).epsilon(0.01));
+        CHECK(id.get_inductance() == doctest::Approx(L).epsilon(0.01));
+        CHECK(id.get_resistance_uncertainty() < 0.01f * R);
+        CHECK(id.get_inductance_uncertainty() < 0.01f * L);
+    }
+}
+
+TEST_CASE("RLIdentification reports the uncertainty of noisy data") {
+    const float T = 125e-6f, R = 0.1f, L = 50e-6f;
+    RLIdentification id;
+    id.reset(T);
+    CHECK(!id.is_valid());
+
+    simulate(id, R, L, T, 0.05f, 200);
+    REQUIRE(id.is_valid());
+    float sigma_R_short = id.get_resistance_uncertainty();
+    float sigma_L_short = id.get_inductance_uncertainty();
+
+    id.reset(T);
+    simulate(id, R, L, T, 0.05f, 8000);
+    REQUIRE(id.is_valid());
+    float sigma_R = id.get_resistance_uncertainty();
+    float sigma_L = id.get_inductance_uncertainty();
+
+    // More samples give a smaller uncertainty that still covers the error
+    CHECK(sigma_R < 0.5f * sigma_R_short);
+    CHECK(sigma_L < 0.5f * sigma_L_short);
+    CHECK(std::abs(id.get_resistance() - R) < 4.0f * sigma_R);
+    CHECK(std::abs(id.get_inductance() - L) < 4.0f * sigma_L);
+    CHECK(sigma_R < 0.02f * R);
+    CHECK(sigma_L < 0.02f * L);
+}
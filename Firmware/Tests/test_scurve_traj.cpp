@@ -0,0 +1,61 @@
+#include <doctest.h>
+#include "MotorControl/scurve_traj.hpp"
+#include "MotorControl/scurve_traj.cpp" // not part of the test build otherwise
+#include <cmath>
+
+// Integrates the trajectory numerically and checks continuity and the limits
+static void check_trajectory(SCurveTrajectory& traj, float Xf, float Xi, float Vi,
+                             float Vmax, float Amax, float Dmax, float Jmax) {
+    REQUIRE(traj.plan(Xf, Xi, Vi, Vmax, Amax, Dmax, Jmax));
+    const float dt = 1e-4f;
+    SCurveTrajectory::Step_t prev = traj.eval(0.0f);
+    CHECK(prev.Y == doctest::Approx(Xi));
+    CHECK(prev.Yd == doctest::Approx(Vi));
+    CHECK(prev.Ydd == doctest::Approx(0.0f));
+
+    float max_vel = std::max(Vmax, std::abs(Vi));
+    bool continuous = true;
+    bool within_limits = true;
+    for (float t = dt; t < traj.Tf_ + 2 * dt; t += dt) {
+        SCurveTrajectory::Step_t step = traj.eval(t);
+        continuous &= std::abs(step.Y - prev.Y) <= (max_vel * dt * 1.01f + 1e-5f);
+        continuous &= std::abs(step.Yd - prev.Yd) <= (std::max(Amax, Dmax) * dt * 1.01f + 1e-5f);
+        continuous &= std::abs(step.Ydd - prev.Ydd) <= (Jmax * dt * 1.01f + 1e-4f);
+        within_limits &= std::abs(step.Yd) <= max_vel * 1.001f;
+        within_limits &= std::abs(step.Ydd) <= std::max(Amax, Dmax) * 1.001f;
+        prev = step;
+    }
+    CHECK(continuous);
+    CHECK(within_limits);
+    CHECK(prev.Y == doctest::Approx(Xf));
+    CHECK(prev.Yd == 0.0f);
+    CHECK(prev.Ydd == 0.0f);
+}
+
+TEST_CASE("S-curve trajectory") {
+    SCurveTrajectory traj;
+
+    SUBCASE("long move from rest") {
+        check_trajectory(traj, 10.0f, 0.0f, 0.0f, 2.0f, 4.0f, 4.0f, 40.0f);
+        // Accel ramp: Tj = 0.1 s, T = 0.6 s, covering 0.6 turn. Same for decel.
+        CHECK(traj.Tf_ == doctest::Approx(0.6f + (10.0f - 1.2f) / 2.0f + 0.6f).epsilon(1e-4));
+        CHECK(traj.eval(traj.Tf_ / 2).Yd == doctest::Approx(2.0f));
+    }
+
+    SUBCASE("short move without cruise phase") {
+        check_trajectory(traj, -0.1f, 0.0f, 0.0f, 2.0f, 4.0f, 4.0f, 40.0f);
+        CHECK(std::abs(traj.eval(traj.Tf_ / 2).Yd) < 2.0f);
+    }
+
+    SUBCASE("reversing the direction of motion") {
+        check_trajectory(traj, 0.0f, 0.0f, 1.0f, 2.0f, 4.0f, 2.0f, 40.0f);
+    }
+
+    SUBCASE("starting faster than the velocity limit") {
+        check_trajectory(traj, 5.0f, 0.0f, 3.0f, 2.0f, 4.0f, 4.0f, 40.0f);
+    }
+
+    SUBCASE("invalid limits") {
+        CHECK(!traj.plan(1.0f, 0.0f, 0.0f, 2.0f, 4.0f, 4.0f, 0.0f));
+    }
+}
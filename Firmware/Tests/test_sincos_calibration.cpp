@@ -0,0 +1,32 @@
+#include <doctest.h>
+#include "MotorControl/sincos_calibration.hpp"
+
+TEST_CASE("SincosCalibration fits offset, gain and phase errors") {
+    const float A_s = 0.3f, A_c = 0.25f;
+    const float offset_s = 0.02f, offset_c = -0.03f;
+    const float phi = 0.1f;
+
+    SincosCalibration calibration;
+    SincosCalibration::Result cal;
+    CHECK(!calibration.get(&cal));
+
+    // Uneven speed, the weighting by angle must take care of that
+    float x = 0.0f;
+    for (size_t i = 0; i < 300000; ++i) {
+        float dx = 0.01f + 0.02f * (1.0f + std::sin(0.001f * i));
+        x += dx;
+        calibration.update(A_s * std::sin(x + phi) + offset_s, A_c * std::cos(x) + offset_c, dx, 100.0f);
+    }
+
+    REQUIRE(calibration.get(&cal));
+    CHECK(cal.offset_s == doctest::Approx(offset_s).epsilon(0.05));
+    CHECK(cal.offset_c == doctest::Approx(offset_c).epsilon(0.05));
+    CHECK(cal.gain_s == doctest::Approx(A_c / A_s).epsilon(0.01));
+    CHECK(cal.skew == doctest::Approx(std::sin(phi)).epsilon(0.05));
+
+    for (float angle = -3.0f; angle < 3.0f; angle += 0.5f) {
+        float y, x;
+        SincosCalibration::correct(cal, A_s * std::sin(angle + phi) + offset_s, A_c * std::cos(angle) + offset_c, &y, &x);
+        CHECK(std::atan2(y, x) == doctest::Approx(angle).epsilon(0.005));
+    }
+}
@@ -0,0 +1,37 @@
+#include <doctest.h>
+#include "MotorControl/sine_analyzer.hpp"
+#include <complex>
+
+TEST_CASE("sine analyzer") {
+    const float dt = 1.0f / 8000.0f;
+    SineAnalyzer analyzer;
+
+    SUBCASE("first order low pass") {
+        // y[k] = a * y[k-1] + (1 - a) * u[k]
+        const float a = 0.99f;
+        for (float freq : {1.0f, 17.0f, 300.0f, 3000.0f}) {
+            CAPTURE(freq);
+            // settle for at least 8 time constants
+            uint32_t settle_cycles = 1 + (uint32_t)(freq * 800.0f * dt);
+            float actual = analyzer.start(freq, settle_cycles, 10, dt);
+            CHECK(actual == doctest::Approx(freq).epsilon(0.02));
+            float y = 0.0f;
+            float dc = 0.5f; // must not disturb the result
+            while (!analyzer.done()) {
+                float u = dc + 2.0f * analyzer.excitation();
+                y = a * y + (1.0f - a) * u;
+                analyzer.update(u, y);
+            }
+            std::complex<float> z1 = std::polar(1.0f, -2.0f * (float)M_PI * actual * dt);
+            std::complex<float> h = (1.0f - a) / (1.0f - a * z1);
+            CHECK(analyzer.gain() == doctest::Approx(std::abs(h)).epsilon(1e-3));
+            CHECK(analyzer.phase() == doctest::Approx(std::arg(h)).epsilon(1e-3));
+            CHECK(analyzer.input_amplitude() == doctest::Approx(2.0f).epsilon(1e-3));
+        }
+    }
+
+    SUBCASE("no measurement started") {
+        CHECK(!analyzer.done());
+        CHECK(analyzer.gain() == 0.0f);
+    }
+}
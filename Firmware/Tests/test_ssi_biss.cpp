@@ -0,0 +1,73 @@
+#include <doctest.h>
+#include "MotorControl/ssi_biss.hpp"
+#include <vector>
+
+// Packs a bit sequence MSB first into 16-bit words, padding with ones (idle)
+static std::vector<uint16_t> pack(const std::vector<bool>& bits, size_t n_words) {
+    std::vector<uint16_t> words(n_words, 0xffff);
+    for (size_t i = 0; i < bits.size(); ++i) {
+        if (!bits[i]) {
+            words[i / 16] &= ~(1 << (15 - (i % 16)));
+        }
+    }
+    return words;
+}
+
+static void append(std::vector<bool>& bits, uint32_t val, size_t n) {
+    for (size_t i = n; i > 0; --i) {
+        bits.push_back((val >> (i - 1)) & 1);
+    }
+}
+
+static std::vector<uint16_t> make_biss_frame(uint32_t pos, size_t pos_bits, bool nE, size_t ack_bits) {
+    std::vector<bool> bits = {1};
+    append(bits, 0, ack_bits); // ack
+    bits.push_back(1); // start
+    bits.push_back(0); // CDS
+    size_t pos_start = bits.size();
+    append(bits, pos, pos_bits);
+    bits.push_back(nE);
+    bits.push_back(1); // nW
+    std::vector<uint16_t> words = pack(bits, 3);
+    uint8_t crc = biss_crc6(words.data(), pos_start, pos_bits + 2);
+    append(bits, ~crc & 0x3f, 6);
+    return pack(bits, 3);
+}
+
+TEST_CASE("BiSS-C CRC6") {
+    // x^6 mod (x^6 + x + 1) = x + 1
+    uint16_t word = 0x8000;
+    CHECK(biss_crc6(&word, 0, 1) == 0x03);
+    // x^11 mod (x^6 + x + 1) = x^5 + x + 1
+    CHECK(biss_crc6(&word, 0, 6) == 0x23);
+}
+
+TEST_CASE("BiSS-C decoding") {
+    uint32_t pos = 0;
+    std::vector<uint16_t> frame = make_biss_frame(0x5a5a5a, 23, true, 3);
+    CHECK(decode_biss_c(frame.data(), 3, 23, &pos));
+    CHECK(pos == 0x5a5a5a);
+
+    // Error bit set
+    frame = make_biss_frame(0x123456, 23, false, 3);
+    CHECK(!decode_biss_c(frame.data(), 3, 23, &pos));
+
+    // Corrupted position bit
+    frame = make_biss_frame(0x123456, 23, true, 2);
+    frame[1] ^= 0x0100;
+    CHECK(!decode_biss_c(frame.data(), 3, 23, &pos));
+
+    // Frame too short for the ack period
+    frame = make_biss_frame(0x123456, 23, true, 20);
+    CHECK(!decode_biss_c(frame.data(), 3, 23, &pos));
+}
+
+TEST_CASE("SSI decoding") {
+    std::vector<bool> bits = {1};
+    append(bits, 0x2aaaaa, 23);
+    std::vector<uint16_t> frame = pack(bits, 2);
+    uint32_t pos = 0;
+    CHECK(decode_ssi(frame.data(), 2, 23, &pos));
+    CHECK(pos == 0x2aaaaa);
+    CHECK(!decode_ssi(frame.data(), 1, 23, &pos));
+}
@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "MotorControl/state_feedback.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Position control of a pure inertia with the poles at -100 rad/s:
+//   inertia * s^3 + k_vel * s^2 + k_pos * s + k_integral = inertia * (s + 100)^3
+static const float kInertia = 0.001f; // [Nm/(turn/s^2)]
+static const StateFeedback::Vector kGains = {30.0f, 0.3f, 0.0f, 1000.0f, 0.0f, 0.0f};
+
+// Runs the loop to the setpoint pos_ref with a load torque after 0.1 s.
+// Returns the final position. Without anti_windup the integral doesn't know
+// about the limit.
+static float run(StateFeedback& feedback, float pos_ref, float load, float torque_lim, float* max_pos,
+                 bool anti_windup = true) {
+    const float dt = 1.0f / 8000.0f;
+    float pos = 0.0f;
+    float vel = 0.0f;
+    *max_pos = 0.0f;
+    for (int i = 0; i < 8000; ++i) {
+        StateFeedback::Vector error = {pos_ref - pos, -vel, 0.0f, 0.0f, 0.0f, 0.0f};
+        float torque = feedback.update(kGains, error);
+        bool limited = std::abs(torque) > torque_lim;
+        torque = std::clamp(torque, -torque_lim, torque_lim);
+        feedback.integrate(pos_ref - pos, limited && anti_windup, dt);
+
+        float d = i > 800 ? load : 0.0f;
+        vel += (torque + d) / kInertia * dt;
+        pos += vel * dt;
+        *max_pos = std::max(*max_pos, pos);
+    }
+    return pos;
+}
+
+TEST_CASE("state feedback") {
+    StateFeedback feedback;
+    float max_pos;
+
+    SUBCASE("the integral removes the error of a load") {
+        float pos = run(feedback, 0.0f, -0.5f, 100.0f, &max_pos);
+        CHECK(pos == doctest::Approx(0.0f).epsilon(1e-4));
+        CHECK(feedback.integral() * kGains[StateFeedback::kIntegral] == doctest::Approx(0.5f).epsilon(1e-3));
+    }
+
+    SUBCASE("the integral doesn't wind up while the torque is limited") {
+        float pos = run(feedback, 1.0f, 0.0f, 0.2f, &max_pos);
+        CHECK(pos == doctest::Approx(1.0f).epsilon(1e-4));
+        StateFeedback windup;
+        float max_pos_windup;
+        run(windup, 1.0f, 0.0f, 0.2f, &max_pos_windup, false);
+        CHECK(max_pos - 1.0f < 0.5f * (max_pos_windup - 1.0f));
+    }
+
+    SUBCASE("the error vector gets the integral") {
+        StateFeedback::Vector error = {0.1f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        feedback.integrate(0.1f, false, 0.5f);
+        CHECK(feedback.update(kGains, error) == doctest::Approx(30.0f * 0.1f + 1000.0f * 0.05f));
+        CHECK(error[StateFeedback::kIntegral] == doctest::Approx(0.05f));
+        feedback.reset();
+        CHECK(feedback.integral() == 0.0f);
+    }
+}
@@ -0,0 +1,77 @@
+#include <doctest.h>
+#include "MotorControl/telemetry_codec.hpp"
+
+// Decodes one frame the way the host does
+static size_t decode(const uint8_t* buffer, size_t length, const float* scales, int32_t* q, bool key, float* values) {
+    size_t pos = 0;
+    size_t i = 0;
+    while (pos < length) {
+        uint32_t v;
+        size_t cnt = DeltaEncoder::get_varint(&v, buffer + pos, length - pos);
+        REQUIRE(cnt > 0);
+        pos += cnt;
+        q[i] = (key ? 0 : q[i]) + DeltaEncoder::unzigzag(v);
+        values[i] = (float)q[i] * scales[i];
+        i++;
+    }
+    return i;
+}
+
+TEST_CASE("zigzag varint") {
+    uint8_t buf[DeltaEncoder::kMaxVarintSize];
+    const int32_t values[] = {0, 1, -1, 63, -64, 64, 32767, -32768, 65535, -65535};
+    for (int32_t v : values) {
+        uint32_t z = DeltaEncoder::zigzag(v);
+        size_t n = DeltaEncoder::put_varint(z, buf, sizeof(buf));
+        uint32_t decoded = 0;
+        CHECK(DeltaEncoder::get_varint(&decoded, buf, n) == n);
+        CHECK(DeltaEncoder::unzigzag(decoded) == v);
+        CHECK(n == (z < 128 ? 1 : z < 16384 ? 2 : 3));
+    }
+    CHECK(DeltaEncoder::put_varint(300, buf, 1) == 0);
+    uint32_t decoded;
+    const uint8_t incomplete[] = {0x80};
+    CHECK(DeltaEncoder::get_varint(&decoded, incomplete, sizeof(incomplete)) == 0);
+}
+
+TEST_CASE("delta encoder") {
+    const float scales[3] = {1e-3f, 0.01f, 1.0f};
+    DeltaEncoder encoder;
+    int32_t q[3] = {};
+    float decoded[3];
+    uint8_t buf[3 * 3];
+
+    SUBCASE("round trip within the resolution") {
+        size_t total = 0;
+        for (int i = 0; i < 100; ++i) {
+            float values[3] = {0.5f + 0.0003f * (float)i, -2.0f - 0.02f * (float)i, 100.0f};
+            bool key = i % 64 == 0;
+            size_t n = encoder.encode(values, scales, 3, key, buf, sizeof(buf));
+            REQUIRE(n > 0);
+            total += n;
+            CHECK(decode(buf, n, scales, q, key, decoded) == 3);
+            for (size_t c = 0; c < 3; ++c) {
+                CHECK(std::abs(decoded[c] - values[c]) <= 0.51f * scales[c]);
+            }
+        }
+        // one byte per channel for most delta frames instead of four
+        CHECK(total < 100 * 3 * 4 / 3);
+    }
+
+    SUBCASE("saturates and maps NaN to zero") {
+        float values[3] = {100.0f, NAN, -1e6f};
+        size_t n = encoder.encode(values, scales, 3, true, buf, sizeof(buf));
+        decode(buf, n, scales, q, true, decoded);
+        CHECK(q[0] == 32767);
+        CHECK(q[1] == 0);
+        CHECK(q[2] == -32768);
+
+        // the largest possible step still fits in three bytes per channel
+        float values2[3] = {-100.0f, NAN, 1e6f};
+        n = encoder.encode(values2, scales, 3, false, buf, sizeof(buf));
+        REQUIRE(n == 7);
+        decode(buf, n, scales, q, false, decoded);
+        CHECK(q[0] == -32768);
+        CHECK(q[2] == 32767);
+    }
+}
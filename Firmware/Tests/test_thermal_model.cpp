@@ -0,0 +1,61 @@
+#include <doctest.h>
+#include "MotorControl/thermal_model.hpp"
+
+TEST_CASE("ThermalModel follows the first order step response") {
+    ThermalModel model;
+    model.config_.thermal_resistance = 2.0f;
+    model.config_.time_constant = 1.0f;
+    const float dt = 0.001f;
+
+    // 10 W for one time constant: 63% of the 20 K steady state rise
+    for (size_t i = 0; i < 1000; ++i) {
+        model.update(10.0f, 0.1f, 30.0f, dt);
+    }
+    CHECK(model.delta_temp_ == doctest::Approx(20.0f * (1.0f - std::exp(-1.0f))).epsilon(0.01));
+    CHECK(model.temperature_ == doctest::Approx(30.0f + model.delta_temp_));
+
+    // Without thermistor the ambient temperature is the reference
+    model.update(10.0f, 0.1f, NAN, dt);
+    CHECK(model.temperature_ == doctest::Approx(model.config_.ambient_temp + model.delta_temp_));
+}
+
+TEST_CASE("ThermalModel allows bursts but not a sustained overload") {
+    ThermalModel model;
+    model.config_.enabled = true;
+    model.config_.thermal_resistance = 1.0f;
+    model.config_.time_constant = 5.0f;
+    model.config_.temp_limit = 100.0f;
+    model.config_.horizon = 1.0f;
+    const float loss_coefficient = 0.15f; // [W/A^2]
+    const float reference = 25.0f;
+    const float base_lim = 1000.0f;
+    const float dt = 0.001f;
+    const float I_cont = std::sqrt(75.0f / loss_coefficient); // reaches exactly 100°C in steady state
+
+    model.update(0.0f, loss_coefficient, reference, dt);
+    float cold_lim = model.get_current_limit(base_lim);
+    CHECK(cold_lim > 2.0f * I_cont);
+
+    // The cold limit reaches the temperature limit after the horizon
+    for (size_t i = 0; i < 1000; ++i) {
+        model.update(loss_coefficient * cold_lim * cold_lim, loss_coefficient, reference, dt);
+    }
+    CHECK(model.temperature_ == doctest::Approx(100.0f).epsilon(0.01));
+
+    // Running at the limit never overshoots and converges on the continuous current
+    float lim = 0.0f;
+    for (size_t i = 0; i < 60000; ++i) {
+        lim = model.get_current_limit(base_lim);
+        model.update(loss_coefficient * lim * lim, loss_coefficient, reference, dt);
+        REQUIRE(model.temperature_ < 100.5f);
+    }
+    CHECK(lim == doctest::Approx(I_cont).epsilon(0.01));
+
+    // Disabled or too hot
+    CHECK(model.get_current_limit(10.0f) == doctest::Approx(10.0f));
+    model.config_.enabled = false;
+    CHECK(model.get_current_limit(base_lim) == base_lim);
+    model.config_.enabled = true;
+    model.update(0.0f, loss_coefficient, 150.0f, dt);
+    CHECK(model.get_current_limit(base_lim) == 0.0f);
+}
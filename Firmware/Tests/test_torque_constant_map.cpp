@@ -0,0 +1,37 @@
+#include <doctest.h>
+#include "MotorControl/torque_constant_map.hpp"
+
+TEST_CASE("torque constant map") {
+    using Map = TorqueConstantMap<4>;
+    Map map;
+    Map::Point points[4] = {
+        {10.0f, 0.1f}, // 1 Nm
+        {20.0f, 0.09f}, // 1.8 Nm
+        {40.0f, 0.07f}, // 2.8 Nm
+        {0.0f, 0.0f}, // unused
+    };
+    REQUIRE(map.set(points));
+
+    CHECK(map.torque(5.0f) == doctest::Approx(0.5f));
+    CHECK(map.torque(15.0f) == doctest::Approx(1.4f));
+    CHECK(map.torque(-30.0f) == doctest::Approx(-2.3f));
+    CHECK(map.torque(60.0f) == doctest::Approx(3.8f)); // last slope extrapolated
+
+    const float currents[] = {-50.0f, -12.0f, 0.0f, 3.0f, 19.0f, 25.0f, 45.0f};
+    for (float current : currents) {
+        CHECK(map.current(map.torque(current)) == doctest::Approx(current));
+    }
+
+    // The torque must increase with the current
+    points[2].torque_constant = 0.04f; // 1.6 Nm
+    CHECK(!map.set(points));
+    CHECK(map.torque(60.0f) == doctest::Approx(3.8f));
+
+    // Used breakpoints must come first
+    points[2] = {0.0f, 0.0f};
+    points[3] = {50.0f, 0.07f};
+    CHECK(!map.set(points));
+
+    Map::Point empty[4] = {};
+    CHECK(!map.set(empty));
+}
@@ -115,6 +115,26 @@ if tup.getconfig("STEP_DIR") == "y" then
     end
 end
 
+if tup.getconfig("DWT_TASK_TIMERS") == "true" then
+    FLAGS += "-DTASK_TIMER_DWT"
+end
+
+if tup.getconfig("IRQ_CYCLES") == "true" then
+    FLAGS += "-DENABLE_IRQ_CYCLES"
+end
+
+if tup.getconfig("TRACE") == "true" then
+    FLAGS += "-DENABLE_TRACE"
+end
+
+if tup.getconfig("ENDPOINT_STATS") == "true" then
+    FLAGS += "-DFIBRE_ENABLE_ENDPOINT_STATS"
+end
+
+if tup.getconfig("FAST_RAM") == "true" then
+    FLAGS += "-DFAST_RAM"
+end
+
 -- Compiler settings
 if tup.getconfig("STRICT") == "true" then
     FLAGS += '-Werror'
@@ -203,20 +223,33 @@ sources = {
     'MotorControl/encoder.cpp',
     'MotorControl/endstop.cpp',
     'MotorControl/acim_estimator.cpp',
+    'MotorControl/encoder_fusion.cpp',
+    'MotorControl/filter_bank.cpp',
+    'MotorControl/frequency_response.cpp',
     'MotorControl/mechanical_brake.cpp',
     'MotorControl/controller.cpp',
     'MotorControl/foc.cpp',
     'MotorControl/open_loop_controller.cpp',
     'MotorControl/oscilloscope.cpp',
+    'MotorControl/telemetry.cpp',
+    'MotorControl/event_log.cpp',
+    'MotorControl/protocol_stats.cpp',
+    'MotorControl/kernel_benchmark.cpp',
+    'MotorControl/operations.cpp',
     'MotorControl/sensorless_estimator.cpp',
     'MotorControl/trapTraj.cpp',
+    'MotorControl/scurve_traj.cpp',
     'MotorControl/pwm_input.cpp',
+    'MotorControl/pwm_sync.cpp',
     'MotorControl/main.cpp',
     'Drivers/STM32/stm32_system.cpp',
     'Drivers/STM32/stm32_gpio.cpp',
     'Drivers/STM32/stm32_nvm.c',
     'Drivers/STM32/stm32_spi_arbiter.cpp',
     'communication/can_simple.cpp',
+    'communication/can_update.cpp',
+    'communication/canopen.cpp',
+    'communication/time_sync.cpp',
     'communication/communication.cpp',
     'communication/ascii_protocol.cpp',
     'communication/interface_uart.cpp',
@@ -250,3 +283,47 @@ if tup.getconfig('DOCTEST') == 'true' then
     tup.frule{inputs='Tests/bin/*.o', command='g++ %f -o %o', outputs='Tests/test_runner.exe'}
     tup.frule{inputs='Tests/test_runner.exe', command='%f'}
 end
+
+if tup.getconfig('BENCHMARK') == 'true' then
+    BENCH_INCLUDES = '-I. -I./MotorControl -I./fibre/cpp/include'
+    tup.foreach_rule({'Benchmarks/*.cpp', 'fibre/cpp/protocol.cpp'}, 'g++ -O3 -std=c++17 '..BENCH_INCLUDES..' -c %f -o %o', 'Benchmarks/bin/%B.o')
+    tup.frule{inputs='Benchmarks/bin/*.o', command='g++ %f -o %o', outputs='Benchmarks/bench_runner.exe'}
+    tup.frule{inputs='Benchmarks/bench_runner.exe', command='%f > %o', outputs='Benchmarks/benchmarks.json'}
+end
+
+if tup.getconfig('PLANNING_LIB') == 'true' then
+    PLANNING_SOURCES = {'Simulation/planning_lib.cpp', 'MotorControl/trapTraj.cpp', 'MotorControl/scurve_traj.cpp'}
+    tup.frule{inputs=PLANNING_SOURCES, command='g++ -O3 -std=c++17 -shared -fPIC -I. -I./MotorControl %f -o %o', outputs='Simulation/bin/libodrive_planning.so'}
+end
+
+if tup.getconfig('SIL') == 'true' then
+    -- The control code with the simulated board layer in Simulation/sil,
+    -- which shadows board.h and odrive_main.h
+    SIL_INCLUDES = '-I./Simulation/sil -I. -I./MotorControl -I./fibre/cpp/include -I./doctest'
+    SIL_SOURCES = {
+        'Simulation/sil/*.cpp',
+        'MotorControl/foc.cpp',
+        'MotorControl/controller.cpp',
+        'MotorControl/trapTraj.cpp',
+        'MotorControl/scurve_traj.cpp',
+        'MotorControl/frequency_response.cpp',
+        'MotorControl/operations.cpp',
+        'MotorControl/event_log.cpp',
+        'MotorControl/utils.cpp',
+        extra_inputs={'autogen/interfaces.hpp'}
+    }
+    tup.foreach_rule(SIL_SOURCES, 'g++ -O3 -std=c++17 '..SIL_INCLUDES..' -c %f -o %o', 'Simulation/bin/%B.o')
+    tup.frule{inputs='Simulation/bin/*.o', command='g++ %f -o %o', outputs='Simulation/sil_runner.exe'}
+    tup.frule{inputs='Simulation/sil_runner.exe', command='%f'}
+end
+
+if tup.getconfig('MEMORY_REPORT') == 'true' then
+    baseline = tup.getconfig('MEMORY_BASELINE')
+    inputs = {'build/ODriveFirmware.elf', 'build/ODriveFirmware.map'}
+    command = python_command..' memory_report.py build/ODriveFirmware.elf --map build/ODriveFirmware.map --save %o'
+    if baseline ~= '' then
+        table.insert(inputs, baseline)
+        command = command..' --baseline '..baseline
+    end
+    tup.frule{inputs=inputs, command=command, outputs={'build/memory_report.json'}}
+end
@@ -22,7 +22,10 @@
 /* Global variables ----------------------------------------------------------*/
 /* Private constant data -----------------------------------------------------*/
 
-#define MAX_LINE_LENGTH 256
+#define PROPERTY_CACHE_SIZE 20 // resolved property paths
+#define PROPERTY_CACHE_MAX_HANDLES (PROPERTY_CACHE_SIZE - 4) // the rest is for the LRU replacement
+#define PROPERTY_CACHE_MAX_PATH_LENGTH 63
+#define FEEDBACK_STREAM_MAX_RATE 1000 // [Hz]
 #define TO_STR_INNER(s) #s
 #define TO_STR(s) TO_STR_INNER(s)
 
@@ -32,6 +35,29 @@
 static Introspectable root_obj = ODrive3TypeInfo<ODrive>::make_introspectable(odrv);
 #endif
 
+// Properties that were accessed recently, so that hosts that poll the same
+// paths don't pay for the lookup by name each time. Entries with a handle
+// ("rh" command) are never replaced, the handle is the index of the entry.
+struct PropertyCacheEntry {
+    uint32_t hash;
+    uint32_t last_used; // 0 for free entries
+    bool has_handle;
+    char path[PROPERTY_CACHE_MAX_PATH_LENGTH + 1];
+    Introspectable property;
+};
+static PropertyCacheEntry property_cache[PROPERTY_CACHE_SIZE];
+static uint32_t property_cache_clock = 0;
+static size_t property_cache_handles = 0;
+
+// Periodic feedback ("fs" command). Only one channel can stream at a time.
+static struct {
+    StreamSink* channel = nullptr;
+    bool use_checksum;
+    uint32_t axis_mask;
+    uint32_t period_ms;
+    uint32_t last_ms;
+} feedback_stream;
+
 /* Private function prototypes -----------------------------------------------*/
 
 void cmd_set_position(char * pStr, StreamSink& response_channel, bool use_checksum);
@@ -40,12 +66,15 @@ void cmd_set_velocity(char * pStr, StreamSink& response_channel, bool use_checks
 void cmd_set_torque(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_set_trapezoid_trajectory(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_get_feedback(char * pStr, StreamSink& response_channel, bool use_checksum);
+void cmd_stream_feedback(char * pStr, StreamSink& response_channel, bool use_checksum);
+void cmd_multi_axis(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_help(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_info_dump(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_system_ctrl(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_read_property(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_write_property(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_update_axis_wdg(char * pStr, StreamSink& response_channel, bool use_checksum);
+void cmd_property_handle(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_unknown(char * pStr, StreamSink& response_channel, bool use_checksum);
 void cmd_encoder(char * pStr, StreamSink& response_channel, bool use_checksum);
 
@@ -54,7 +83,7 @@ void cmd_encoder(char * pStr, StreamSink& response_channel, bool use_checksum);
 // @brief Sends a line on the specified output.
 template<typename ... TArgs>
 void respond(StreamSink& output, bool include_checksum, const char * fmt, TArgs&& ... args) {
-    char response[64]; // Hardcoded max buffer size. We silently truncate the output if it's too long for the buffer.
+    char response[128]; // Hardcoded max buffer size. We silently truncate the output if it's too long for the buffer.
     size_t len = snprintf(response, sizeof(response), fmt, std::forward<TArgs>(args)...);
     len = std::min(len, sizeof(response));
     output.process_bytes((uint8_t*)response, len, nullptr); // TODO: use process_all instead
@@ -69,48 +98,19 @@ void respond(StreamSink& output, bool include_checksum, const char * fmt, TArgs&
     output.process_bytes((const uint8_t*)"\r\n", 2, nullptr);
 }
 
-
-// @brief Executes an ASCII protocol command
-// @param buffer buffer of ASCII encoded characters
-// @param len size of the buffer
-void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
-    static_assert(sizeof(char) == sizeof(uint8_t));
-
-    // scan line to find beginning of checksum and prune comment
-    uint8_t checksum = 0;
-    size_t checksum_start = SIZE_MAX;
-    for (size_t i = 0; i < len; ++i) {
-        if (buffer[i] == ';') { // ';' is the comment start char
-            len = i;
-            break;
-        }
-        if (checksum_start > i) {
-            if (buffer[i] == '*') {
-                checksum_start = i + 1;
-            } else {
-                checksum ^= buffer[i];
-            }
-        }
-    }
-
-    // copy everything into a local buffer so we can insert null-termination
-    char cmd[MAX_LINE_LENGTH + 1];
-    if (len > MAX_LINE_LENGTH) len = MAX_LINE_LENGTH;
-    memcpy(cmd, buffer, len);
-    cmd[len] = 0; // null-terminate
-
-    // optional checksum validation
-    bool use_checksum = (checksum_start < len);
-    if (use_checksum) {
-        unsigned int received_checksum;
-        int numscan = sscanf(&cmd[checksum_start], "%u", &received_checksum);
-        if ((numscan < 1) || (received_checksum != checksum))
-            return;
-        len = checksum_start - 1; // prune checksum and asterisk
-        cmd[len] = 0; // null-terminate
-    }
+// @brief Feeds the watchdog of the interface that the command came from.
+// The commands always respond on the AsciiResponseBuffer of their interface.
+static void feed_watchdog(Axis& axis, StreamSink& response_channel) {
+    size_t channel = static_cast<AsciiResponseBuffer&>(response_channel).watchdog_channel_;
+    axis.watchdog_feed(static_cast<Axis::WatchdogChannel>(channel));
+}
 
 
+// @brief Executes an ASCII protocol command
+// @param cmd null-terminated command, without comment and checksum
+// @param response_channel reference to the stream to respond on
+// @param use_checksum bool to indicate whether a checksum is required on response
+static void ASCII_protocol_process_command(char* cmd, StreamSink& response_channel, bool use_checksum) {
     // check incoming packet type
     switch(cmd[0]) {
         case 'p': cmd_set_position(cmd, response_channel, use_checksum);                break;  // position control
@@ -118,11 +118,14 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
         case 'v': cmd_set_velocity(cmd, response_channel, use_checksum);                break;  // velocity control
         case 'c': cmd_set_torque(cmd, response_channel, use_checksum);                  break;  // current control
         case 't': cmd_set_trapezoid_trajectory(cmd, response_channel, use_checksum);    break;  // trapezoidal trajectory
-        case 'f': cmd_get_feedback(cmd, response_channel, use_checksum);                break;  // feedback
+        case 'f': if (cmd[1] == 's') cmd_stream_feedback(cmd, response_channel, use_checksum);  // periodic feedback
+                  else cmd_get_feedback(cmd, response_channel, use_checksum);           break;  // feedback
+        case 'm': cmd_multi_axis(cmd, response_channel, use_checksum);                  break;  // setpoints for all axes
         case 'h': cmd_help(cmd, response_channel, use_checksum);                        break;  // Help
         case 'i': cmd_info_dump(cmd, response_channel, use_checksum);                   break;  // Dump device info
         case 's': cmd_system_ctrl(cmd, response_channel, use_checksum);                 break;  // System
-        case 'r': cmd_read_property(cmd, response_channel,  use_checksum);              break;  // read property
+        case 'r': if (cmd[1] == 'h') cmd_property_handle(cmd, response_channel, use_checksum);  // get property handle
+                  else cmd_read_property(cmd, response_channel, use_checksum);          break;  // read property
         case 'w': cmd_write_property(cmd, response_channel, use_checksum);              break;  // write property
         case 'u': cmd_update_axis_wdg(cmd, response_channel, use_checksum);             break;  // Update axis watchdog. 
         case 'e': cmd_encoder(cmd, response_channel, use_checksum);                     break;  // Encoder commands
@@ -130,6 +133,65 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
     }
 }
 
+// @brief Returns a field of a binary frame, NaN meaning "not given"
+static std::optional<float> get_binary_frame_field(const uint8_t* frame, size_t offset) {
+    float value;
+    read_le<float>(&value, frame + offset);
+    return is_nan(value) ? std::nullopt : std::make_optional(value);
+}
+
+// @brief Executes a binary command frame and responds with the feedback of the
+// axis in a frame of the same size
+// @param frame BINARY_FRAME_SIZE bytes, starting with BINARY_FRAME_PREFIX
+// @param response_channel reference to the stream to respond on
+static void ASCII_protocol_process_binary_frame(const uint8_t* frame, StreamSink& response_channel) {
+    // Corrupted frames are dropped like ASCII lines with a wrong checksum
+    if (calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, frame, BINARY_FRAME_SIZE - 1) != frame[BINARY_FRAME_SIZE - 1])
+        return;
+
+    unsigned motor_number = frame[1] >> 4;
+    unsigned op = frame[1] & 0x0f;
+    uint8_t status = BINARY_FRAME_STATUS_OK;
+    std::optional<float> setpoint = get_binary_frame_field(frame, 2);
+    std::optional<float> feed_forward1 = get_binary_frame_field(frame, 6);
+    std::optional<float> feed_forward2 = get_binary_frame_field(frame, 10);
+
+    if (motor_number >= AXIS_COUNT) {
+        status = BINARY_FRAME_STATUS_INVALID_AXIS;
+    } else if (op != BINARY_FRAME_OP_FEEDBACK) {
+        Axis& axis = axes[motor_number];
+        switch (op) {
+            case BINARY_FRAME_OP_POSITION:
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
+                axis.controller_.set_input(setpoint, feed_forward1, feed_forward2);
+                break;
+            case BINARY_FRAME_OP_VELOCITY:
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
+                axis.controller_.set_input(std::nullopt, setpoint, feed_forward1);
+                break;
+            case BINARY_FRAME_OP_TORQUE:
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_TORQUE_CONTROL;
+                axis.controller_.set_input(std::nullopt, std::nullopt, setpoint);
+                break;
+            default:
+                status = BINARY_FRAME_STATUS_INVALID_OP;
+                break;
+        }
+        if (status == BINARY_FRAME_STATUS_OK)
+            feed_watchdog(axis, response_channel);
+    }
+
+    uint8_t response[BINARY_FRAME_SIZE] = {BINARY_FRAME_PREFIX, (uint8_t)((frame[1] & 0xf0) | status)};
+    if (motor_number < AXIS_COUNT) {
+        Axis& axis = axes[motor_number];
+        write_le<float>(axis.encoder_.pos_estimate_.any().value_or(0.0f), response + 2);
+        write_le<float>(axis.encoder_.vel_estimate_.any().value_or(0.0f), response + 6);
+        write_le<float>(axis.motor_.current_control_.Iq_measured_, response + 10);
+    }
+    response[BINARY_FRAME_SIZE - 1] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, response, BINARY_FRAME_SIZE - 1);
+    response_channel.process_bytes(response, sizeof(response), nullptr);
+}
+
 // @brief Executes the set position command
 // @param pStr buffer of ASCII encoded values
 // @param response_channel reference to the stream to respond on
@@ -146,13 +208,10 @@ void cmd_set_position(char * pStr, StreamSink& response_channel, bool use_checks
     } else {
         Axis& axis = axes[motor_number];
         axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
-        axis.controller_.input_pos_ = pos_setpoint;
-        if (numscan >= 3)
-            axis.controller_.input_vel_ = vel_feed_forward;
-        if (numscan >= 4)
-            axis.controller_.input_torque_ = torque_feed_forward;
-        axis.controller_.input_pos_updated();
-        axis.watchdog_feed();
+        axis.controller_.set_input(pos_setpoint,
+                                   (numscan >= 3) ? std::make_optional(vel_feed_forward) : std::nullopt,
+                                   (numscan >= 4) ? std::make_optional(torque_feed_forward) : std::nullopt);
+        feed_watchdog(axis, response_channel);
     }
 }
 
@@ -172,13 +231,12 @@ void cmd_set_position_wl(char * pStr, StreamSink& response_channel, bool use_che
     } else {
         Axis& axis = axes[motor_number];
         axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
-        axis.controller_.input_pos_ = pos_setpoint;
         if (numscan >= 3)
             axis.controller_.config_.vel_limit = vel_limit;
         if (numscan >= 4)
             axis.motor_.config_.torque_lim = torque_lim;
-        axis.controller_.input_pos_updated();
-        axis.watchdog_feed();
+        axis.controller_.set_input(pos_setpoint, std::nullopt, std::nullopt);
+        feed_watchdog(axis, response_channel);
     }
 }
 
@@ -197,10 +255,9 @@ void cmd_set_velocity(char * pStr, StreamSink& response_channel, bool use_checks
     } else {
         Axis& axis = axes[motor_number];
         axis.controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
-        axis.controller_.input_vel_ = vel_setpoint;
-        if (numscan >= 3)
-            axis.controller_.input_torque_ = torque_feed_forward;
-        axis.watchdog_feed();
+        axis.controller_.set_input(std::nullopt, vel_setpoint,
+                                   (numscan >= 3) ? std::make_optional(torque_feed_forward) : std::nullopt);
+        feed_watchdog(axis, response_channel);
     }
 }
 
@@ -219,8 +276,8 @@ void cmd_set_torque(char * pStr, StreamSink& response_channel, bool use_checksum
     } else {
         Axis& axis = axes[motor_number];
         axis.controller_.config_.control_mode = Controller::CONTROL_MODE_TORQUE_CONTROL;
-        axis.controller_.input_torque_ = torque_setpoint;
-        axis.watchdog_feed();
+        axis.controller_.set_input(std::nullopt, std::nullopt, torque_setpoint);
+        feed_watchdog(axis, response_channel);
     }
 }
 
@@ -242,7 +299,7 @@ void cmd_encoder(char * pStr, StreamSink& response_channel, bool use_checksum) {
         } else {
             Axis& axis = axes[motor_number];
             axis.encoder_.set_linear_count(encoder_count);
-            axis.watchdog_feed();
+            feed_watchdog(axis, response_channel);
             respond(response_channel, use_checksum, "encoder set to %u", encoder_count);
         }
     } else {
@@ -266,9 +323,8 @@ void cmd_set_trapezoid_trajectory(char* pStr, StreamSink& response_channel, bool
         Axis& axis = axes[motor_number];
         axis.controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
         axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
-        axis.controller_.input_pos_ = goal_point;
-        axis.controller_.input_pos_updated();
-        axis.watchdog_feed();
+        axis.controller_.set_input(goal_point, std::nullopt, std::nullopt);
+        feed_watchdog(axis, response_channel);
     }
 }
 
@@ -291,6 +347,108 @@ void cmd_get_feedback(char * pStr, StreamSink& response_channel, bool use_checks
     }
 }
 
+// @brief Sends one line with "pos vel Iq" of each selected axis
+static void respond_feedback(StreamSink& response_channel, bool use_checksum, uint32_t axis_mask) {
+    char line[AXIS_COUNT * 48 + 1] = "";
+    size_t len = 0;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (axis_mask & (1 << i)) {
+            Axis& axis = axes[i];
+            len += snprintf(line + len, sizeof(line) - len, len ? " %f %f %f" : "%f %f %f",
+                    (double)axis.encoder_.pos_estimate_.any().value_or(0.0f),
+                    (double)axis.encoder_.vel_estimate_.any().value_or(0.0f),
+                    (double)axis.motor_.current_control_.Iq_measured_);
+            len = std::min(len, sizeof(line) - 1);
+        }
+    }
+    respond(response_channel, use_checksum, "%s", line);
+}
+
+// @brief Executes the periodic feedback command
+// @param pStr buffer of ASCII encoded values
+// @param response_channel reference to the stream to respond on
+// @param use_checksum bool to indicate whether a checksum is required on response
+void cmd_stream_feedback(char * pStr, StreamSink& response_channel, bool use_checksum) {
+    unsigned rate;
+    int offset;
+
+    if (sscanf(pStr, "fs %u%n", &rate, &offset) < 1) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+
+    // Without motor numbers all axes are streamed
+    uint32_t axis_mask = 0;
+    unsigned motor_number;
+    int n;
+    for (char* str = pStr + offset; sscanf(str, " %u%n", &motor_number, &n) == 1; str += n) {
+        if (motor_number >= AXIS_COUNT) {
+            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
+            return;
+        }
+        axis_mask |= 1 << motor_number;
+    }
+
+    if (rate == 0) {
+        feedback_stream.channel = nullptr;
+        return;
+    }
+    feedback_stream.use_checksum = use_checksum;
+    feedback_stream.axis_mask = axis_mask ? axis_mask : (1 << AXIS_COUNT) - 1;
+    feedback_stream.period_ms = 1000 / std::min(rate, (unsigned)FEEDBACK_STREAM_MAX_RATE);
+    feedback_stream.last_ms = HAL_GetTick() - feedback_stream.period_ms;
+    feedback_stream.channel = &response_channel;
+}
+
+// @brief Executes the multi-axis command, which sets the inputs of all axes at
+// once and responds with the feedback of all axes
+// @param pStr buffer of ASCII encoded values
+// @param response_channel reference to the stream to respond on
+// @param use_checksum bool to indicate whether a checksum is required on response
+void cmd_multi_axis(char * pStr, StreamSink& response_channel, bool use_checksum) {
+    // The values are grouped by argument, e.g. pos0 pos1 vel_ff0 vel_ff1
+    const size_t max_args = pStr[1] == 'p' ? 3 : pStr[1] == 'v' ? 2 : pStr[1] == 'c' ? 1 : 0;
+    float values[3][AXIS_COUNT];
+    size_t n_values = 0;
+    char* str = pStr + 2;
+    for (; n_values < max_args * AXIS_COUNT; ++n_values) {
+        char* end;
+        values[n_values / AXIS_COUNT][n_values % AXIS_COUNT] = strtof(str, &end);
+        if (end == str)
+            break;
+        str = end;
+    }
+
+    if (!max_args || !n_values || (n_values % AXIS_COUNT)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+
+    size_t n_args = n_values / AXIS_COUNT;
+    auto arg = [&](size_t i, size_t axis) {
+        return (i < n_args) ? std::make_optional(values[i][axis]) : std::nullopt;
+    };
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Axis& axis = axes[i];
+        switch (pStr[1]) {
+            case 'p':
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL;
+                axis.controller_.set_input(arg(0, i), arg(1, i), arg(2, i));
+                break;
+            case 'v':
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL;
+                axis.controller_.set_input(std::nullopt, arg(0, i), arg(1, i));
+                break;
+            case 'c':
+                axis.controller_.config_.control_mode = Controller::CONTROL_MODE_TORQUE_CONTROL;
+                axis.controller_.set_input(std::nullopt, std::nullopt, arg(0, i));
+                break;
+        }
+        feed_watchdog(axis, response_channel);
+    }
+    respond_feedback(response_channel, use_checksum, (1 << AXIS_COUNT) - 1);
+}
+
 // @brief Shows help text
 // @param pStr buffer of ASCII encoded values
 // @param response_channel reference to the stream to respond on
@@ -304,10 +462,13 @@ void cmd_help(char * pStr, StreamSink& response_channel, bool use_checksum) {
     respond(response_channel, use_checksum, "Position: p axis pos vel-ff I-ff");
     respond(response_channel, use_checksum, "Velocity: v axis vel I-ff");
     respond(response_channel, use_checksum, "Torque: c axis T");
+    respond(response_channel, use_checksum, "All axes: mp pos0 pos1 [vel-ff0 vel-ff1 [I-ff0 I-ff1]], mv vel0 vel1 [I-ff0 I-ff1], mc T0 T1");
+    respond(response_channel, use_checksum, "Feedback: f axis, periodic: fs rate [axis ...]");
     respond(response_channel, use_checksum, "");
     respond(response_channel, use_checksum, "Properties start at odrive root, such as axis0.requested_state");
     respond(response_channel, use_checksum, "Read: r property");
     respond(response_channel, use_checksum, "Write: w property value");
+    respond(response_channel, use_checksum, "Handle: rh property, then r #handle / w #handle value");
     respond(response_channel, use_checksum, "");
     respond(response_channel, use_checksum, "Save config: ss");
     respond(response_channel, use_checksum, "Erase config: se");
@@ -341,6 +502,60 @@ void cmd_system_ctrl(char * pStr, StreamSink& response_channel, bool use_checksu
     }
 }
 
+// FNV-1a
+static uint32_t hash_path(const char* path) {
+    uint32_t hash = 2166136261u;
+    for (; *path; ++path) {
+        hash = (hash ^ (uint8_t)*path) * 16777619u;
+    }
+    return hash;
+}
+
+// @brief Looks up a property by its path, first in the cache.
+// @returns the cache entry of the property, or nullptr if the path is too
+// long for the cache or doesn't exist (then property is invalid)
+static PropertyCacheEntry* find_property(const char* path, Introspectable* property) {
+    uint32_t hash = hash_path(path);
+    for (PropertyCacheEntry& entry: property_cache) {
+        if (entry.last_used && entry.hash == hash && !strcmp(entry.path, path)) {
+            entry.last_used = ++property_cache_clock;
+            *property = entry.property;
+            return &entry;
+        }
+    }
+
+    *property = root_obj.get_child(path, MAX_LINE_LENGTH);
+    if (!property->is_valid() || strlen(path) > PROPERTY_CACHE_MAX_PATH_LENGTH) {
+        return nullptr;
+    }
+
+    // Replace the least recently used entry that has no handle
+    PropertyCacheEntry* victim = nullptr;
+    for (PropertyCacheEntry& entry: property_cache) {
+        if (!entry.has_handle && (!victim || entry.last_used < victim->last_used)) {
+            victim = &entry;
+        }
+    }
+    victim->hash = hash;
+    victim->last_used = ++property_cache_clock;
+    strcpy(victim->path, path);
+    victim->property = *property;
+    return victim;
+}
+
+// @brief Resolves a property path or a handle ("#" followed by the number that
+// the "rh" command returned)
+static Introspectable get_property(const char* name) {
+    Introspectable property;
+    unsigned handle;
+    if (name[0] != '#') {
+        find_property(name, &property);
+    } else if (sscanf(name, "#%u", &handle) == 1 && handle < PROPERTY_CACHE_SIZE && property_cache[handle].has_handle) {
+        property = property_cache[handle].property;
+    }
+    return property;
+}
+
 // @brief Executes the read parameter command
 // @param pStr buffer of ASCII encoded values
 // @param response_channel reference to the stream to respond on
@@ -351,7 +566,7 @@ void cmd_read_property(char * pStr, StreamSink& response_channel, bool use_check
     if (sscanf(pStr, "r %255s", name) < 1) {
         respond(response_channel, use_checksum, "invalid command format");
     } else {
-        Introspectable property = root_obj.get_child(name, sizeof(name));
+        Introspectable property = get_property(name);
         const StringConvertibleTypeInfo* type_info = dynamic_cast<const StringConvertibleTypeInfo*>(property.get_type_info());
         if (!type_info) {
             respond(response_channel, use_checksum, "invalid property");
@@ -374,7 +589,7 @@ void cmd_write_property(char * pStr, StreamSink& response_channel, bool use_chec
     if (sscanf(pStr, "w %255s %255s", name, value) < 1) {
         respond(response_channel, use_checksum, "invalid command format");
     } else {
-        Introspectable property = root_obj.get_child(name, sizeof(name));
+        Introspectable property = get_property(name);
         const StringConvertibleTypeInfo* type_info = dynamic_cast<const StringConvertibleTypeInfo*>(property.get_type_info());
         if (!type_info) {
             respond(response_channel, use_checksum, "invalid property");
@@ -387,6 +602,34 @@ void cmd_write_property(char * pStr, StreamSink& response_channel, bool use_chec
     }
 }
 
+// @brief Returns a numeric handle for a property path, with which the read and
+// write commands skip the lookup by name. The handles stay valid until reboot.
+// @param pStr buffer of ASCII encoded values
+// @param response_channel reference to the stream to respond on
+// @param use_checksum bool to indicate whether a checksum is required on response
+void cmd_property_handle(char * pStr, StreamSink& response_channel, bool use_checksum) {
+    char name[MAX_LINE_LENGTH];
+
+    if (sscanf(pStr, "rh %255s", name) < 1) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+
+    Introspectable property;
+    PropertyCacheEntry* entry = find_property(name, &property);
+    if (!dynamic_cast<const StringConvertibleTypeInfo*>(property.get_type_info())) {
+        respond(response_channel, use_checksum, "invalid property");
+    } else if (!entry || (!entry->has_handle && property_cache_handles >= PROPERTY_CACHE_MAX_HANDLES)) {
+        respond(response_channel, use_checksum, "no free handle");
+    } else {
+        if (!entry->has_handle) {
+            entry->has_handle = true;
+            property_cache_handles++;
+        }
+        respond(response_channel, use_checksum, "%u", (unsigned)(entry - property_cache));
+    }
+}
+
 // @brief Executes the motor watchdog update command
 // @param pStr buffer of ASCII encoded values
 // @param response_channel reference to the stream to respond on
@@ -399,7 +642,7 @@ void cmd_update_axis_wdg(char * pStr, StreamSink& response_channel, bool use_che
     } else if (motor_number >= AXIS_COUNT) {
         respond(response_channel, use_checksum, "invalid motor %u", motor_number);
     } else {
-        axes[motor_number].watchdog_feed();
+        feed_watchdog(axes[motor_number], response_channel);
     }
 }
 
@@ -412,34 +655,105 @@ void cmd_unknown(char * pStr, StreamSink& response_channel, bool use_checksum) {
     respond(response_channel, use_checksum, "unknown command");
 }
 
+int AsciiResponseBuffer::process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
+    while (length) {
+        if (length_ == sizeof(buffer_))
+            flush();
+        size_t chunk = std::min(length, sizeof(buffer_) - length_);
+        memcpy(buffer_ + length_, buffer, chunk);
+        length_ += chunk;
+        buffer += chunk;
+        length -= chunk;
+        if (processed_bytes)
+            *processed_bytes += chunk;
+    }
+    return 0;
+}
+
+void AsciiResponseBuffer::flush() {
+    if (length_)
+        output_.process_bytes(buffer_, length_, nullptr); // TODO: use process_all instead
+    length_ = 0;
+}
+
 // @brief Parses the received ASCII char stream
 // @param buffer buffer of ASCII encoded values
-// @param response_channel reference to the stream to respond on
-// @param use_checksum bool to indicate whether a checksum is required on response
-void ASCII_protocol_parse_stream(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
-    static uint8_t parse_buffer[MAX_LINE_LENGTH];
-    static bool read_active = true;
-    static uint32_t parse_buffer_idx = 0;
-
+// @param len number of bytes in the buffer
+void AsciiProtocol::parse_stream(const uint8_t* buffer, size_t len) {
     while (len--) {
-        // if the line becomes too long, reset buffer and wait for the next line
-        if (parse_buffer_idx >= MAX_LINE_LENGTH) {
-            read_active = false;
-            parse_buffer_idx = 0;
+        uint8_t c = *(buffer++);
+
+        // binary frames have a fixed size and may contain end of line chars
+        if (binary_frame_active_) {
+            line_[line_length_++] = c;
+            if (line_length_ >= BINARY_FRAME_SIZE) {
+                ASCII_protocol_process_binary_frame((const uint8_t*)line_, response_);
+                response_.flush();
+                reset_line();
+            }
+            continue;
         }
 
-        // Fetch the next char
-        uint8_t c = *(buffer++);
-        bool is_end_of_line = (c == '\r' || c == '\n' || c == '!');
-        if (is_end_of_line) {
-            if (read_active)
-                ASCII_protocol_process_line(parse_buffer, parse_buffer_idx, response_channel);
-            parse_buffer_idx = 0;
-            read_active = true;
+        if (c == '\r' || c == '\n' || c == '!') {
+            if (read_active_)
+                process_line();
+            reset_line();
+        } else if (!read_active_ || in_comment_) {
+            // wait for the end of the line
+        } else if (c == BINARY_FRAME_PREFIX && line_length_ == 0) {
+            line_[line_length_++] = c;
+            binary_frame_active_ = true;
+        } else if (c == ';') { // ';' is the comment start char
+            in_comment_ = true;
+        } else if (line_length_ >= MAX_LINE_LENGTH) {
+            read_active_ = false; // the line is too long, ignore it
         } else {
-            if (read_active) {
-                parse_buffer[parse_buffer_idx++] = c;
+            if (checksum_start_ == SIZE_MAX) {
+                if (c == '*') {
+                    checksum_start_ = line_length_ + 1;
+                } else {
+                    checksum_ ^= c;
+                }
             }
+            line_[line_length_++] = c;
         }
     }
 }
+
+void AsciiProtocol::process_line() {
+    line_[line_length_] = 0; // null-terminate
+
+    // optional checksum validation
+    bool use_checksum = (checksum_start_ < line_length_);
+    if (use_checksum) {
+        unsigned int received_checksum;
+        int numscan = sscanf(&line_[checksum_start_], "%u", &received_checksum);
+        if ((numscan < 1) || (received_checksum != checksum_))
+            return;
+        line_[checksum_start_ - 1] = 0; // prune checksum and asterisk
+    }
+
+    ASCII_protocol_process_command(line_, response_, use_checksum);
+    response_.flush();
+}
+
+void AsciiProtocol::reset_line() {
+    line_length_ = 0;
+    checksum_start_ = SIZE_MAX;
+    checksum_ = 0;
+    read_active_ = true;
+    in_comment_ = false;
+    binary_frame_active_ = false;
+}
+
+void AsciiProtocol::publish(uint32_t now_ms) {
+    if (!is_streaming() || now_ms - feedback_stream.last_ms < feedback_stream.period_ms)
+        return;
+    feedback_stream.last_ms = now_ms;
+    respond_feedback(response_, feedback_stream.use_checksum, feedback_stream.axis_mask);
+    response_.flush();
+}
+
+bool AsciiProtocol::is_streaming() {
+    return feedback_stream.channel == &response_;
+}
@@ -9,14 +9,77 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-/* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
-/* Exported variables --------------------------------------------------------*/
-/* Exported macro ------------------------------------------------------------*/
-/* Exported functions --------------------------------------------------------*/
 
-/* Exported functions --------------------------------------------------------*/
-void ASCII_protocol_parse_stream(const uint8_t* buffer, size_t len, StreamSink& response_channel);
+#define MAX_LINE_LENGTH 256
+#define ASCII_RESPONSE_BUFFER_SIZE 128
+
+// Binary command frames can be mixed with the ASCII lines. A frame starts with
+// BINARY_FRAME_PREFIX at the beginning of a line and has a fixed size, see
+// docs/ascii-protocol.md for the layout.
+#define BINARY_FRAME_PREFIX 0xF5
+#define BINARY_FRAME_SIZE 15
+
+enum BinaryFrameOp {
+    BINARY_FRAME_OP_FEEDBACK = 0,
+    BINARY_FRAME_OP_POSITION = 1,
+    BINARY_FRAME_OP_VELOCITY = 2,
+    BINARY_FRAME_OP_TORQUE = 3,
+};
+
+enum BinaryFrameStatus {
+    BINARY_FRAME_STATUS_OK = 0,
+    BINARY_FRAME_STATUS_INVALID_AXIS = 1,
+    BINARY_FRAME_STATUS_INVALID_OP = 2,
+};
+
+/* Exported types ------------------------------------------------------------*/
+
+// @brief Collects the responses to one command so that they go out in as few
+// writes to the interface as possible. Only flushes earlier if it is full.
+// The commands find the watchdog channel of their interface through it.
+class AsciiResponseBuffer : public StreamSink {
+public:
+    AsciiResponseBuffer(StreamSink& output, size_t watchdog_channel)
+        : output_(output), watchdog_channel_(watchdog_channel) {}
+
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) override;
+    size_t get_free_space() override { return SIZE_MAX; }
+    void flush();
+
+    const size_t watchdog_channel_; // Axis::WatchdogChannel
+
+private:
+    StreamSink& output_;
+    uint8_t buffer_[ASCII_RESPONSE_BUFFER_SIZE];
+    size_t length_ = 0;
+};
+
+// @brief ASCII protocol state of one interface. The line is tokenized as the
+// bytes arrive: comments are dropped and the checksum is calculated on the fly,
+// so a complete line is executed directly from the receive buffer.
+class AsciiProtocol {
+public:
+    AsciiProtocol(StreamSink& output, size_t watchdog_channel) : response_(output, watchdog_channel) {}
+
+    void parse_stream(const uint8_t* buffer, size_t len);
+    // @brief Sends the periodic feedback ("fs" command) if it is due
+    void publish(uint32_t now_ms);
+    bool is_streaming();
+
+private:
+    void process_line();
+    void reset_line();
+
+    AsciiResponseBuffer response_;
+    char line_[MAX_LINE_LENGTH + 1]; // including the null-termination
+    size_t line_length_ = 0;
+    size_t checksum_start_ = SIZE_MAX; // index after the '*'
+    uint8_t checksum_ = 0;
+    bool read_active_ = true; // false for the rest of a line that is too long
+    bool in_comment_ = false;
+    bool binary_frame_active_ = false;
+};
 
 
 #endif /* __ASCII_PROTOCOL_H */
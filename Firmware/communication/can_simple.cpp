@@ -1,12 +1,19 @@
 
 #include "can_simple.hpp"
 
+#include "can_update.hpp"
+
 #include <odrive_main.h>
+#include <limits>
 
 void CANSimple::handle_can_message(const can_Message_t& msg) {
     //     Frame
     // nodeID | CMD
     // 6 bits | 5 bits
+    if (!msg.isExt && msg.id == odCAN->config_.sync_id) {
+        handle_sync();
+    }
+
     uint32_t nodeID = get_node_id(msg.id);
 
     for (auto& axis : axes) {
@@ -17,96 +24,115 @@ void CANSimple::handle_can_message(const can_Message_t& msg) {
     }
 }
 
+// Applies the inputs that were held back for the axes in sync mode. They take
+// effect on the next control loop tick, which also sends the encoder estimates
+// (see send_cyclic()). All drives on the bus queue their estimates at about
+// the same time, so they arrive in the order of their CAN IDs.
+void CANSimple::handle_sync() {
+    for (auto& axis : axes) {
+        if (!axis.config_.can.sync_mode)
+            continue;
+        if (axis.can_.sync_input_pos || axis.can_.sync_input_vel || axis.can_.sync_input_torque) {
+            axis.controller_.set_input(axis.can_.sync_input_pos, axis.can_.sync_input_vel, axis.can_.sync_input_torque);
+            axis.can_.sync_input_pos = axis.can_.sync_input_vel = axis.can_.sync_input_torque = std::nullopt;
+        }
+        axis.can_.sync_pending = true;
+    }
+}
+
+// Sets the inputs right away or holds them back until the next SYNC message
+void CANSimple::set_input(Axis& axis, std::optional<float> pos, std::optional<float> vel, std::optional<float> torque) {
+    if (!axis.config_.can.sync_mode) {
+        axis.controller_.set_input(pos, vel, torque);
+        return;
+    }
+    if (pos.has_value())
+        axis.can_.sync_input_pos = pos;
+    if (vel.has_value())
+        axis.can_.sync_input_vel = vel;
+    if (torque.has_value())
+        axis.can_.sync_input_torque = torque;
+}
+
+// Returns the ID and mask of the frames that handle_can_message() passes on
+// to the axis, for the hardware filters. Returns false if no frame can match.
+bool CANSimple::get_filter(const Axis& axis, uint32_t* id, uint32_t* mask) {
+    uint32_t id_mask = axis.config_.can.is_extended ? 0x1FFFFFFF : 0x7FF;
+    *id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
+    *mask = id_mask & ~(uint32_t)0x01F; // any command
+    return (*id & id_mask) == *id && ((*id >> NUM_CMD_ID_BITS) == axis.config_.can.node_id);
+}
+
+// Handlers by command ID. A remote frame calls get if there is one, any other
+// frame calls set. Commands without handlers are only counted.
+constexpr std::array<CANSimple::Command, CANSimple::NUM_COMMANDS> CANSimple::make_command_table() {
+    std::array<Command, NUM_COMMANDS> table{};
+    // MSG_CO_NMT_CTRL and MSG_ODRIVE_HEARTBEAT are accepted but not acted upon
+    table[MSG_ODRIVE_ESTOP] = {nullptr, estop_callback, 0};
+    table[MSG_GET_MOTOR_ERROR] = {get_motor_error_callback, nullptr, 0};
+    table[MSG_GET_ENCODER_ERROR] = {get_encoder_error_callback, nullptr, 0};
+    table[MSG_GET_SENSORLESS_ERROR] = {get_sensorless_error_callback, nullptr, 0};
+    table[MSG_SET_AXIS_NODE_ID] = {nullptr, set_axis_nodeid_callback, 4};
+    table[MSG_SET_AXIS_REQUESTED_STATE] = {nullptr, set_axis_requested_state_callback, 4};
+    table[MSG_SET_AXIS_STARTUP_CONFIG] = {nullptr, set_axis_startup_config_callback, 0};
+    table[MSG_GET_ENCODER_ESTIMATES] = {[](const Axis& axis) { return get_encoder_estimates_callback(axis); }, nullptr, 0};
+    table[MSG_GET_ENCODER_COUNT] = {get_encoder_count_callback, nullptr, 0};
+    table[MSG_SET_CONTROLLER_MODES] = {nullptr, set_controller_modes_callback, 8};
+    table[MSG_SET_INPUT_POS] = {nullptr, set_input_pos_callback, 8};
+    table[MSG_SET_INPUT_VEL] = {nullptr, set_input_vel_callback, 8};
+    table[MSG_SET_INPUT_TORQUE] = {nullptr, set_input_torque_callback, 4};
+    table[MSG_SET_VEL_LIMIT] = {nullptr, set_vel_limit_callback, 4};
+    table[MSG_START_ANTICOGGING] = {nullptr, start_anticogging_callback, 0};
+    table[MSG_SET_TRAJ_VEL_LIMIT] = {nullptr, set_traj_vel_limit_callback, 4};
+    table[MSG_SET_TRAJ_ACCEL_LIMITS] = {nullptr, set_traj_accel_limits_callback, 8};
+    table[MSG_SET_TRAJ_INERTIA] = {nullptr, set_traj_inertia_callback, 4};
+    table[MSG_GET_IQ] = {get_iq_callback, nullptr, 0};
+    table[MSG_GET_SENSORLESS_ESTIMATES] = {get_sensorless_estimates_callback, nullptr, 0};
+    table[MSG_RESET_ODRIVE] = {nullptr, reset_odrive_callback, 0};
+    table[MSG_GET_VBUS_VOLTAGE] = {get_vbus_voltage_callback, nullptr, 0};
+    table[MSG_CLEAR_ERRORS] = {nullptr, clear_errors_callback, 0};
+    table[MSG_SET_LINEAR_COUNT] = {nullptr, set_linear_count_callback, 4};
+    table[MSG_SET_INPUT_POS_COMBINED] = {nullptr, set_input_pos_combined_callback, 8};
+    table[MSG_SET_INPUT_VEL_COMBINED] = {nullptr, set_input_vel_combined_callback, 8};
+    table[MSG_GET_POS_COMBINED] = {[](const Axis& axis) { return get_pos_combined_callback(axis); }, nullptr, 0};
+    table[MSG_GET_VEL_IQ_COMBINED] = {[](const Axis& axis) { return get_vel_iq_combined_callback(axis); }, nullptr, 0};
+    return table;
+}
+
+constexpr std::array<CANSimple::Command, CANSimple::NUM_COMMANDS> CANSimple::commands_ = CANSimple::make_command_table();
+uint32_t CANSimple::command_counts_[CANSimple::NUM_COMMANDS] = {};
+uint32_t CANSimple::last_combined_feedback_ = 0;
+
+// Converts to a fixed point signal in units of scale, rounded and saturated
+template<typename T>
+static T to_fixed(float value, float scale) {
+    float scaled = (std::isnan(value) || scale == 0.0f) ? 0.0f : std::round(value / scale);
+    if (scaled >= (float)std::numeric_limits<T>::max())
+        return std::numeric_limits<T>::max();
+    if (scaled <= (float)std::numeric_limits<T>::min())
+        return std::numeric_limits<T>::min();
+    return (T)scaled;
+}
+
 void CANSimple::doCommand(Axis& axis, const can_Message_t& msg) {
     const uint32_t cmd = get_cmd_id(msg.id);
-    axis.watchdog_feed();
-    switch (cmd) {
-        case MSG_CO_NMT_CTRL:
-            break;
-        case MSG_CO_HEARTBEAT_CMD:
-            break;
-        case MSG_ODRIVE_HEARTBEAT:
-            // We don't currently do anything to respond to ODrive heartbeat messages
-            break;
-        case MSG_ODRIVE_ESTOP:
-            estop_callback(axis, msg);
-            break;
-        case MSG_GET_MOTOR_ERROR:
-            if (msg.rtr)
-                get_motor_error_callback(axis);
-            break;
-        case MSG_GET_ENCODER_ERROR:
-            if (msg.rtr)
-                get_encoder_error_callback(axis);
-            break;
-        case MSG_GET_SENSORLESS_ERROR:
-            if (msg.rtr)
-                get_sensorless_error_callback(axis);
-            break;
-        case MSG_SET_AXIS_NODE_ID:
-            set_axis_nodeid_callback(axis, msg);
-            break;
-        case MSG_SET_AXIS_REQUESTED_STATE:
-            set_axis_requested_state_callback(axis, msg);
-            break;
-        case MSG_SET_AXIS_STARTUP_CONFIG:
-            set_axis_startup_config_callback(axis, msg);
-            break;
-        case MSG_GET_ENCODER_ESTIMATES:
-            if (msg.rtr)
-                get_encoder_estimates_callback(axis);
-            break;
-        case MSG_GET_ENCODER_COUNT:
-            if (msg.rtr)
-                get_encoder_count_callback(axis);
-            break;
-        case MSG_SET_INPUT_POS:
-            set_input_pos_callback(axis, msg);
-            break;
-        case MSG_SET_INPUT_VEL:
-            set_input_vel_callback(axis, msg);
-            break;
-        case MSG_SET_INPUT_TORQUE:
-            set_input_torque_callback(axis, msg);
-            break;
-        case MSG_SET_CONTROLLER_MODES:
-            set_controller_modes_callback(axis, msg);
-            break;
-        case MSG_SET_VEL_LIMIT:
-            set_vel_limit_callback(axis, msg);
-            break;
-        case MSG_START_ANTICOGGING:
-            start_anticogging_callback(axis, msg);
-            break;
-        case MSG_SET_TRAJ_INERTIA:
-            set_traj_inertia_callback(axis, msg);
-            break;
-        case MSG_SET_TRAJ_ACCEL_LIMITS:
-            set_traj_accel_limits_callback(axis, msg);
-            break;
-        case MSG_SET_TRAJ_VEL_LIMIT:
-            set_traj_vel_limit_callback(axis, msg);
-            break;
-        case MSG_GET_IQ:
-            if (msg.rtr)
-                get_iq_callback(axis);
-            break;
-        case MSG_GET_SENSORLESS_ESTIMATES:
-            if (msg.rtr)
-                get_sensorless_estimates_callback(axis);
-            break;
-        case MSG_RESET_ODRIVE:
-            NVIC_SystemReset();
-            break;
-        case MSG_GET_VBUS_VOLTAGE:
-            if (msg.rtr)
-                get_vbus_voltage_callback(axis);
-            break;
-        case MSG_CLEAR_ERRORS:
-            clear_errors_callback(axis, msg);
-            break;
-        default:
-            break;
+    const Command& command = commands_[cmd];
+    axis.watchdog_feed(Axis::WATCHDOG_CHANNEL_CAN);
+    command_counts_[cmd]++;
+
+    if (msg.rtr && command.get) {
+        command.get(axis);
+    } else if (command.set) {
+        // The bytes after the DLC are left over from the previous frame,
+        // so short frames read as zero padded.
+        if (msg.rtr || msg.len < command.payload_len) {
+            can_Message_t padded = msg;
+            uint8_t len = msg.rtr ? 0 : std::min<uint8_t>(msg.len, sizeof(padded.buf));
+            std::fill(padded.buf + len, std::end(padded.buf), 0);
+            command.set(axis, padded);
+        } else {
+            command.set(axis, msg);
+        }
     }
 }
 
@@ -159,14 +185,14 @@ void CANSimple::set_axis_nodeid_callback(Axis& axis, const can_Message_t& msg) {
 }
 
 void CANSimple::set_axis_requested_state_callback(Axis& axis, const can_Message_t& msg) {
-    axis.requested_state_ = static_cast<Axis::AxisState>(can_getSignal<int32_t>(msg, 0, 16, true));
+    axis.request_state(static_cast<Axis::AxisState>(can_getSignal<int32_t>(msg, 0, 16, true)));
 }
 
 void CANSimple::set_axis_startup_config_callback(Axis& axis, const can_Message_t& msg) {
     // Not Implemented
 }
 
-int32_t CANSimple::get_encoder_estimates_callback(const Axis& axis) {
+int32_t CANSimple::get_encoder_estimates_callback(const Axis& axis, ODriveCAN::TxPriority priority) {
     can_Message_t txmsg;
     txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
     txmsg.id += MSG_GET_ENCODER_ESTIMATES;  // heartbeat ID
@@ -176,7 +202,7 @@ int32_t CANSimple::get_encoder_estimates_callback(const Axis& axis) {
     can_setSignal<float>(txmsg, axis.encoder_.pos_estimate_.any().value_or(0.0f), 0, 32, true);
     can_setSignal<float>(txmsg, axis.encoder_.vel_estimate_.any().value_or(0.0f), 32, 32, true);
 
-    return odCAN->write(txmsg);
+    return odCAN->write(txmsg, priority);
 }
 
 int32_t CANSimple::get_sensorless_estimates_callback(const Axis& axis) {
@@ -207,19 +233,19 @@ int32_t CANSimple::get_encoder_count_callback(const Axis& axis) {
 }
 
 void CANSimple::set_input_pos_callback(Axis& axis, const can_Message_t& msg) {
-    axis.controller_.input_pos_ = can_getSignal<float>(msg, 0, 32, true);
-    axis.controller_.input_vel_ = can_getSignal<int16_t>(msg, 32, 16, true, 0.001f, 0);
-    axis.controller_.input_torque_ = can_getSignal<int16_t>(msg, 48, 16, true, 0.001f, 0);
-    axis.controller_.input_pos_updated();
+    set_input(axis, can_getSignal<float>(msg, 0, 32, true),
+                    can_getSignal<int16_t>(msg, 32, 16, true, 0.001f, 0),
+                    can_getSignal<int16_t>(msg, 48, 16, true, 0.001f, 0));
 }
 
 void CANSimple::set_input_vel_callback(Axis& axis, const can_Message_t& msg) {
-    axis.controller_.input_vel_ = can_getSignal<float>(msg, 0, 32, true);
-    axis.controller_.input_torque_ = can_getSignal<float>(msg, 32, 32, true);
+    set_input(axis, std::nullopt,
+                    can_getSignal<float>(msg, 0, 32, true),
+                    can_getSignal<float>(msg, 32, 32, true));
 }
 
 void CANSimple::set_input_torque_callback(Axis& axis, const can_Message_t& msg) {
-    axis.controller_.input_torque_ = can_getSignal<float>(msg, 0, 32, true);
+    set_input(axis, std::nullopt, std::nullopt, can_getSignal<float>(msg, 0, 32, true));
 }
 
 void CANSimple::set_controller_modes_callback(Axis& axis, const can_Message_t& msg) {
@@ -231,7 +257,7 @@ void CANSimple::set_vel_limit_callback(Axis& axis, const can_Message_t& msg) {
     axis.controller_.config_.vel_limit = can_getSignal<float>(msg, 0, 32, true);
 }
 
-void CANSimple::start_anticogging_callback(const Axis& axis, const can_Message_t& msg) {
+void CANSimple::start_anticogging_callback(Axis& axis, const can_Message_t& msg) {
     axis.controller_.start_anticogging_calibration();
 }
 
@@ -252,6 +278,27 @@ void CANSimple::set_linear_count_callback(Axis& axis, const can_Message_t& msg){
     axis.encoder_.set_linear_count(can_getSignal<int32_t>(msg, 0, 32, true));
 }
 
+// The combined commands address both axes of the board, whichever of their
+// node IDs they were sent to. Slot i of a frame belongs to axis i.
+void CANSimple::set_input_pos_combined_callback(Axis& axis, const can_Message_t& msg) {
+    const ODriveCAN::Config_t& config = odCAN->config_;
+    for (size_t i = 0; i < NUM_COMBINED_AXES; ++i) {
+        axes[i].watchdog_feed(Axis::WATCHDOG_CHANNEL_CAN);
+        set_input(axes[i], can_getSignal<int32_t>(msg, 32 * i, 32, true, config.combined_pos_scale, 0),
+                           std::nullopt, std::nullopt);
+    }
+}
+
+void CANSimple::set_input_vel_combined_callback(Axis& axis, const can_Message_t& msg) {
+    const ODriveCAN::Config_t& config = odCAN->config_;
+    for (size_t i = 0; i < NUM_COMBINED_AXES; ++i) {
+        axes[i].watchdog_feed(Axis::WATCHDOG_CHANNEL_CAN);
+        set_input(axes[i], std::nullopt,
+                           can_getSignal<int16_t>(msg, 16 * i, 16, true, config.combined_vel_scale, 0),
+                           can_getSignal<int16_t>(msg, 32 + 16 * i, 16, true, config.combined_torque_scale, 0));
+    }
+}
+
 int32_t CANSimple::get_iq_callback(const Axis& axis) {
     can_Message_t txmsg;
     txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
@@ -287,6 +334,49 @@ int32_t CANSimple::get_vbus_voltage_callback(const Axis& axis) {
     return odCAN->write(txmsg);
 }
 
+int32_t CANSimple::get_pos_combined_callback(const Axis& axis, ODriveCAN::TxPriority priority) {
+    can_Message_t txmsg;
+    txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
+    txmsg.id += MSG_GET_POS_COMBINED;
+    txmsg.isExt = axis.config_.can.is_extended;
+    txmsg.len = 8;
+
+    const ODriveCAN::Config_t& config = odCAN->config_;
+    for (size_t i = 0; i < NUM_COMBINED_AXES; ++i) {
+        float pos = axes[i].encoder_.pos_estimate_.any().value_or(0.0f);
+        can_setSignal<int32_t>(txmsg, to_fixed<int32_t>(pos, config.combined_pos_scale), 32 * i, 32, true);
+    }
+
+    return odCAN->write(txmsg, priority);
+}
+
+int32_t CANSimple::get_vel_iq_combined_callback(const Axis& axis, ODriveCAN::TxPriority priority) {
+    can_Message_t txmsg;
+    txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
+    txmsg.id += MSG_GET_VEL_IQ_COMBINED;
+    txmsg.isExt = axis.config_.can.is_extended;
+    txmsg.len = 8;
+
+    const ODriveCAN::Config_t& config = odCAN->config_;
+    for (size_t i = 0; i < NUM_COMBINED_AXES; ++i) {
+        float vel = axes[i].encoder_.vel_estimate_.any().value_or(0.0f);
+        float iq = axes[i].motor_.current_control_.Iq_measured_;
+        can_setSignal<int16_t>(txmsg, to_fixed<int16_t>(vel, config.combined_vel_scale), 16 * i, 16, true);
+        can_setSignal<int16_t>(txmsg, to_fixed<int16_t>(iq, config.combined_current_scale), 32 + 16 * i, 16, true);
+    }
+
+    return odCAN->write(txmsg, priority);
+}
+
+// With CAN_UPDATE_MAGIC in the first 4 bytes the board enters the firmware
+// update mode instead of rebooting. It answers with the ID of this command.
+void CANSimple::reset_odrive_callback(Axis& axis, const can_Message_t& msg) {
+    if (!msg.rtr && msg.len >= 4 && can_getSignal<uint32_t>(msg, 0, 32, true) == CAN_UPDATE_MAGIC) {
+        odCAN->enter_update_mode((axis.config_.can.node_id << NUM_CMD_ID_BITS) + MSG_RESET_ODRIVE, axis.config_.can.is_extended);
+    }
+    NVIC_SystemReset();
+}
+
 void CANSimple::clear_errors_callback(Axis& axis, const can_Message_t& msg) {
     odrv.clear_errors(); // TODO: might want to clear axis errors only
 }
@@ -301,7 +391,7 @@ int32_t CANSimple::send_heartbeat(const Axis& axis) {
     can_setSignal(txmsg, axis.error_, 0, 32, true);
     can_setSignal(txmsg, axis.current_state_, 32, 32, true);
 
-    return odCAN->write(txmsg);
+    return odCAN->write(txmsg, ODriveCAN::TX_PRIORITY_HEARTBEAT);
 }
 
 void CANSimple::send_cyclic(Axis& axis) {
@@ -314,10 +404,69 @@ void CANSimple::send_cyclic(Axis& axis) {
         }
     }
 
-    if (axis.config_.can.encoder_rate_ms > 0) {
+    if (axis.config_.can.sync_mode) {
+        // This is the control loop tick after the SYNC message
+        if (axis.can_.sync_pending && get_encoder_estimates_callback(axis, ODriveCAN::TX_PRIORITY_CYCLIC) >= 0)
+            axis.can_.sync_pending = false;
+    } else if (axis.config_.can.encoder_rate_ms > 0) {
         if ((now - axis.can_.last_encoder) >= axis.config_.can.encoder_rate_ms) {
-            if(get_encoder_estimates_callback(axis) >= 0)
+            if(get_encoder_estimates_callback(axis, ODriveCAN::TX_PRIORITY_CYCLIC) >= 0)
                 axis.can_.last_encoder = now;
         }
     }
+
+    // The combined feedback goes out with the node ID of the first axis
+    uint32_t combined_rate_ms = odCAN->config_.combined_feedback_rate_ms;
+    if (&axis == &axes[0] && combined_rate_ms > 0 && (now - last_combined_feedback_) >= combined_rate_ms) {
+        if (get_pos_combined_callback(axis, ODriveCAN::TX_PRIORITY_CYCLIC) >= 0
+                && get_vel_iq_combined_callback(axis, ODriveCAN::TX_PRIORITY_CYCLIC) >= 0)
+            last_combined_feedback_ = now;
+    }
+
+    for (size_t i = 0; i < CAN_CYCLIC_FRAME_COUNT; ++i) {
+        uint32_t rate_ms = axis.config_.can.cyclic_frames[i].rate_ms;
+        if (rate_ms > 0 && (now - axis.can_.cyclic_frames[i].last_sent) >= rate_ms) {
+            if (send_cyclic_frame(axis, i) >= 0)
+                axis.can_.cyclic_frames[i].last_sent = now;
+        }
+    }
+}
+
+// Sends one of the user configured cyclic frames (see Axis::CANCyclicFrame_t).
+// The signals are resolved here when their endpoint was changed, so that a
+// new mapping takes effect without a restart.
+int32_t CANSimple::send_cyclic_frame(Axis& axis, size_t frame_num) {
+    const Axis::CANCyclicFrame_t& config = axis.config_.can.cyclic_frames[frame_num];
+    auto& state = axis.can_.cyclic_frames[frame_num];
+
+    can_Message_t txmsg;
+    txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
+    txmsg.id += config.cmd_id & 0x01F;
+    txmsg.isExt = axis.config_.can.is_extended;
+
+    uint8_t bit = 0;
+    size_t num_signals = std::min<uint32_t>(config.num_signals, CAN_CYCLIC_FRAME_MAX_SIGNALS);
+    for (size_t i = 0; i < num_signals; ++i) {
+        endpoint_ref_t endpoint = config.signals[i];
+        if (endpoint.endpoint_id != state.endpoints[i].endpoint_id || endpoint.json_crc != state.endpoints[i].json_crc) {
+            state.sources[i].resolve(endpoint);
+            state.endpoints[i] = endpoint;
+        }
+
+        float value = state.sources[i].read();
+        float scale = config.scales[i];
+        if (scale == 0.0f && bit <= 32) {
+            can_setSignal<float>(txmsg, value, bit, 32, true);
+            bit += 32;
+        } else if (scale != 0.0f && bit <= 48) {
+            float scaled = std::isnan(value) ? 0.0f : std::clamp(value / scale, (float)INT16_MIN, (float)INT16_MAX);
+            can_setSignal<int16_t>(txmsg, (int16_t)scaled, bit, 16, true);
+            bit += 16;
+        } else {
+            break;
+        }
+    }
+    txmsg.len = bit / 8;
+
+    return odCAN->write(txmsg, ODriveCAN::TX_PRIORITY_CYCLIC);
 }
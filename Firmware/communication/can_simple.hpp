@@ -3,6 +3,8 @@
 
 #include "interface_can.hpp"
 
+#include <array>
+
 class CANSimple {
    public:
     enum {
@@ -31,15 +33,24 @@ class CANSimple {
         MSG_RESET_ODRIVE,
         MSG_GET_VBUS_VOLTAGE,
         MSG_CLEAR_ERRORS,
+        MSG_SET_LINEAR_COUNT,
+        // 0x01A and 0x01B are the default IDs of the cyclic frames
+        MSG_SET_INPUT_POS_COMBINED = 0x01C,  // Board level, for both axes
+        MSG_SET_INPUT_VEL_COMBINED,
+        MSG_GET_POS_COMBINED,
+        MSG_GET_VEL_IQ_COMBINED,
         MSG_CO_HEARTBEAT_CMD = 0x700,  // CANOpen NMT Heartbeat  SEND
     };
 
     static void handle_can_message(const can_Message_t& msg);
+    static bool get_filter(const Axis& axis, uint32_t* id, uint32_t* mask);
+    static void handle_sync();
     static void doCommand(Axis& axis, const can_Message_t& cmd);
 
     // Cyclic Senders
     static int32_t send_heartbeat(const Axis& axis);
     static void send_cyclic(Axis& axis);
+    static int32_t send_cyclic_frame(Axis& axis, size_t frame_num);
 
    private:
     // Get functions (msg.rtr bit must be set)
@@ -47,11 +58,13 @@ class CANSimple {
     static int32_t get_encoder_error_callback(const Axis& axis);
     static int32_t get_controller_error_callback(const Axis& axis);
     static int32_t get_sensorless_error_callback(const Axis& axis);
-    static int32_t get_encoder_estimates_callback(const Axis& axis);
+    static int32_t get_encoder_estimates_callback(const Axis& axis, ODriveCAN::TxPriority priority = ODriveCAN::TX_PRIORITY_RESPONSE);
     static int32_t get_encoder_count_callback(const Axis& axis);
     static int32_t get_iq_callback(const Axis& axis);
     static int32_t get_sensorless_estimates_callback(const Axis& axis);
     static int32_t get_vbus_voltage_callback(const Axis& axis);
+    static int32_t get_pos_combined_callback(const Axis& axis, ODriveCAN::TxPriority priority = ODriveCAN::TX_PRIORITY_RESPONSE);
+    static int32_t get_vel_iq_combined_callback(const Axis& axis, ODriveCAN::TxPriority priority = ODriveCAN::TX_PRIORITY_RESPONSE);
 
     // Set functions
     static void set_axis_nodeid_callback(Axis& axis, const can_Message_t& msg);
@@ -66,16 +79,44 @@ class CANSimple {
     static void set_traj_accel_limits_callback(Axis& axis, const can_Message_t& msg);
     static void set_traj_inertia_callback(Axis& axis, const can_Message_t& msg);
     static void set_linear_count_callback(Axis& axis, const can_Message_t& msg);
+    static void set_input_pos_combined_callback(Axis& axis, const can_Message_t& msg);
+    static void set_input_vel_combined_callback(Axis& axis, const can_Message_t& msg);
+
+    static void set_input(Axis& axis, std::optional<float> pos, std::optional<float> vel, std::optional<float> torque);
 
     // Other functions
     static void nmt_callback(const Axis& axis, const can_Message_t& msg);
     static void estop_callback(Axis& axis, const can_Message_t& msg);
     static void clear_errors_callback(Axis& axis, const can_Message_t& msg);
-    static void start_anticogging_callback(const Axis& axis, const can_Message_t& msg);
+    static void reset_odrive_callback(Axis& axis, const can_Message_t& msg);
+    static void start_anticogging_callback(Axis& axis, const can_Message_t& msg);
 
     static constexpr uint8_t NUM_NODE_ID_BITS = 6;
     static constexpr uint8_t NUM_CMD_ID_BITS = 11 - NUM_NODE_ID_BITS;
 
+   public:
+    static constexpr size_t NUM_COMMANDS = 1 << NUM_CMD_ID_BITS;
+
+    // Number of frames received for each command ID, for all axes
+    static uint32_t get_command_count(uint32_t cmd_id) {
+        return cmd_id < NUM_COMMANDS ? command_counts_[cmd_id] : 0;
+    }
+
+   private:
+    struct Command {
+        int32_t (*get)(const Axis& axis); // answers remote frames
+        void (*set)(Axis& axis, const can_Message_t& msg); // handles data frames
+        uint8_t payload_len; // number of bytes that set reads
+    };
+
+    static constexpr std::array<Command, NUM_COMMANDS> make_command_table();
+    static const std::array<Command, NUM_COMMANDS> commands_;
+    static uint32_t command_counts_[NUM_COMMANDS];
+
+    // The combined frames carry one slot for each of the first two axes
+    static constexpr size_t NUM_COMBINED_AXES = AXIS_COUNT < 2 ? AXIS_COUNT : 2;
+    static uint32_t last_combined_feedback_;
+
     // Utility functions
     static constexpr uint32_t get_node_id(uint32_t msgID) {
         return (msgID >> NUM_CMD_ID_BITS);  // Upper 6 or more bits
@@ -0,0 +1,169 @@
+/*
+* Firmware update over CAN, see docs/can-protocol.md.
+*
+* The update mode replaces the firmware while it runs, so it stops the motors,
+* disables all interrupts and polls the CAN controller from a loop in RAM.
+* Nothing in here may call into the flash: the HAL, the C library and
+* constant tables in .rodata are off limits, the flash controller and the CAN
+* controller are accessed through their registers.
+*/
+
+#include "can_update.hpp"
+#include "interface_can.hpp"
+
+#include <odrive_main.h>
+
+#define FLASH_KEY1 0x45670123UL
+#define FLASH_KEY2 0xCDEF89ABUL
+#define FLASH_SR_ERRORS (FLASH_SR_OPERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+#define CAN_UPDATE_TX_TIMEOUT 1000000UL // [loop iterations] until a status frame is dropped
+
+namespace {
+
+// Sectors 0 to 9 hold the firmware, 10 and 11 the configuration (see
+// stm32_nvm.c), which the update keeps.
+struct FlashPort {
+    CAN_TypeDef* can;
+    uint32_t status_id;
+    bool status_is_extended;
+
+    RAMFUNC size_t sector_size(uint32_t sector) {
+        return sector < 4 ? 0x4000 : sector == 4 ? 0x10000 : sector < 10 ? 0x20000 : 0;
+    }
+
+    RAMFUNC const uint8_t* sector_base(uint32_t sector) {
+        uint32_t offset = sector < 4 ? sector * 0x4000 : sector == 4 ? 0x10000 : (sector - 4) * 0x20000;
+        return (const uint8_t*)(FLASH_BASE + offset);
+    }
+
+    RAMFUNC static void wait_and_unlock() {
+        while (FLASH->SR & FLASH_SR_BSY) {
+        }
+        if (FLASH->CR & FLASH_CR_LOCK) {
+            FLASH->KEYR = FLASH_KEY1;
+            FLASH->KEYR = FLASH_KEY2;
+        }
+        FLASH->SR = FLASH_SR_EOP | FLASH_SR_ERRORS;
+    }
+
+    RAMFUNC bool erase(uint32_t sector) {
+        wait_and_unlock();
+        FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos);
+        FLASH->CR |= FLASH_CR_STRT;
+        while (FLASH->SR & FLASH_SR_BSY) {
+        }
+        FLASH->CR = 0;
+
+        // The caches may still hold the old content
+        FLASH->ACR &= ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+        FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+        FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+        FLASH->ACR |= FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+        return !(FLASH->SR & FLASH_SR_ERRORS);
+    }
+
+    RAMFUNC bool program(const uint8_t* addr, uint32_t word) {
+        wait_and_unlock();
+        FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+        *(volatile uint32_t*)addr = word;
+        while (FLASH->SR & FLASH_SR_BSY) {
+        }
+        FLASH->CR = 0;
+        return !(FLASH->SR & FLASH_SR_ERRORS);
+    }
+
+    // Sends on mailbox 0. A frame that doesn't go out in time, e.g. without
+    // a host on the bus, is aborted so that the update mode doesn't hang.
+    RAMFUNC void send_status(const uint8_t (&payload)[8]) {
+        uint32_t timeout = CAN_UPDATE_TX_TIMEOUT;
+        while (!(can->TSR & CAN_TSR_TME0) && --timeout) {
+        }
+        if (!timeout) {
+            can->TSR = CAN_TSR_ABRQ0;
+            while (!(can->TSR & CAN_TSR_TME0)) {
+            }
+        }
+        CAN_TxMailBox_TypeDef& mailbox = can->sTxMailBox[0];
+        mailbox.TIR = status_is_extended ? ((status_id << CAN_TI0R_EXID_Pos) | CAN_TI0R_IDE) : (status_id << CAN_TI0R_STID_Pos);
+        mailbox.TDTR = 8;
+        mailbox.TDLR = can_update_read_le32(payload);
+        mailbox.TDHR = can_update_read_le32(payload + 4);
+        mailbox.TIR |= CAN_TI0R_TXRQ;
+    }
+};
+
+RAMFUNC __attribute__((noreturn)) void run_update_mode(CAN_TypeDef* can, uint32_t status_id, bool status_is_extended) {
+    // Drop the frames that are still queued and accept all frames into FIFO 0
+    can->TSR = CAN_TSR_ABRQ0 | CAN_TSR_ABRQ1 | CAN_TSR_ABRQ2;
+    can->FMR |= CAN_FMR_FINIT;
+    can->FA1R = 0;
+    can->FM1R &= ~1UL; // mask mode
+    can->FS1R |= 1UL; // 32 bit
+    can->FFA1R &= ~1UL; // FIFO 0
+    can->sFilterRegister[0].FR1 = 0;
+    can->sFilterRegister[0].FR2 = 0;
+    can->FA1R = 1UL;
+    can->FMR &= ~CAN_FMR_FINIT;
+
+    FlashPort port = {can, status_id, status_is_extended};
+    CanUpdateSession<FlashPort> session(port);
+    session.send_ready();
+
+    for (;;) {
+        if (can->RF0R & CAN_RF0R_FOVR0) {
+            can->RF0R = CAN_RF0R_FOVR0; // lost frames show up as missing chunks
+        }
+        if (!(can->RF0R & CAN_RF0R_FMP0)) {
+            continue;
+        }
+
+        const CAN_FIFOMailBox_TypeDef& mailbox = can->sFIFOMailBox[0];
+        uint32_t rir = mailbox.RIR;
+        uint8_t length = mailbox.RDTR & CAN_RDT0R_DLC;
+        uint32_t low = mailbox.RDLR;
+        uint32_t high = mailbox.RDHR;
+        can->RF0R = CAN_RF0R_RFOM0;
+
+        if (rir & CAN_RI0R_RTR) {
+            continue;
+        }
+        uint8_t data[8] = {
+            (uint8_t)low, (uint8_t)(low >> 8), (uint8_t)(low >> 16), (uint8_t)(low >> 24),
+            (uint8_t)high, (uint8_t)(high >> 8), (uint8_t)(high >> 16), (uint8_t)(high >> 24)
+        };
+        if (rir & CAN_RI0R_IDE) {
+            uint32_t id = rir >> CAN_RI0R_EXID_Pos;
+            if ((id & ~CAN_UPDATE_DATA_ID_MASK) == CAN_UPDATE_DATA_ID_BASE && length == CAN_UPDATE_BLOCK_SIZE) {
+                session.handle_data(id & CAN_UPDATE_DATA_ID_MASK, data);
+            }
+        } else {
+            uint32_t id = rir >> CAN_RI0R_STID_Pos;
+            if (id >= CAN_UPDATE_CMD_ID_BASE && id < CAN_UPDATE_CMD_ID_BASE + CAN_UPDATE_CMD_COUNT
+                    && !session.handle_command(id - CAN_UPDATE_CMD_ID_BASE, data, length)) {
+                // Like NVIC_SystemReset(), which might not be inlined
+                __DSB();
+                SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) | SCB_AIRCR_SYSRESETREQ_Msk;
+                __DSB();
+                for (;;) {
+                }
+            }
+        }
+    }
+}
+
+}
+
+/**
+ * @brief Stops the motors and replaces the firmware with the image that a
+ * host sends, see CanUpdateSession. Only a reset leaves the update mode.
+ *
+ * @param status_id: CAN ID of the status frames of this board
+ */
+[[noreturn]] void ODriveCAN::enter_update_mode(uint32_t status_id, bool status_is_extended) {
+    for (auto& axis : axes) {
+        axis.motor_.disarm();
+    }
+    safety_critical_disarm_brake_resistor();
+    __disable_irq();
+    run_update_mode(handle_->Instance, status_id, status_is_extended);
+}
@@ -0,0 +1,218 @@
+#ifndef __CAN_UPDATE_HPP
+#define __CAN_UPDATE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAN_UPDATE_MAGIC 0x44505543UL // "CUPD", payload of a Reboot ODrive frame that enters the update mode
+#define CAN_UPDATE_CMD_ID_BASE 0x7E0 // standard IDs of the broadcast commands (CAN Simple node 0x3F)
+#define CAN_UPDATE_DATA_ID_BASE 0x1FFE0000UL // extended IDs of the data frames, plus the block index
+#define CAN_UPDATE_DATA_ID_MASK 0x3FFFUL // block index bits of the data frame IDs
+#define CAN_UPDATE_BLOCK_SIZE 8 // [bytes] of data per frame
+#define CAN_UPDATE_CHUNK_SIZE 1024 // [bytes] covered by one chunk CRC
+#define CAN_UPDATE_MAX_CHUNKS 128 // 128 KiB, the largest flash sector
+
+// The code in here runs from RAM while the flash is rewritten, so it must not
+// call into the flash. Everything is inlined into the caller, which is a
+// RAMFUNC in the firmware.
+#define CAN_UPDATE_INLINE inline __attribute__((always_inline))
+
+enum CanUpdateCommand {
+    CAN_UPDATE_CMD_SECTOR = 0, // [sector, length (3 bytes), crc32 of the whole sector (4 bytes)]
+    CAN_UPDATE_CMD_CHUNK_CRC = 1, // [chunk (2 bytes), 0, 0, crc32 of the chunk (4 bytes)]
+    CAN_UPDATE_CMD_SECTOR_END = 2, // requests the status of the sector
+    CAN_UPDATE_CMD_RESET = 3, // leaves the update mode
+    CAN_UPDATE_CMD_COUNT
+};
+
+// First byte of the status frames that the device answers with
+enum CanUpdateStatus {
+    CAN_UPDATE_STATUS_READY = 0, // entered the update mode
+    CAN_UPDATE_STATUS_SKIPPED = 1, // the sector already holds the data
+    CAN_UPDATE_STATUS_ERASED = 2, // the sector was erased and takes data frames
+    CAN_UPDATE_STATUS_COMPLETE = 3, // all chunks of the sector were verified
+    CAN_UPDATE_STATUS_MISSING = 4, // some chunks weren't verified yet
+    CAN_UPDATE_STATUS_FAILED = 5, // erase or programming failed, the sector has to be sent again
+    CAN_UPDATE_STATUS_INVALID = 6, // the sector can't be written or the length is invalid
+};
+
+// @brief CRC-32 like zlib (reflected 0x04C11DB7), without tables in flash
+CAN_UPDATE_INLINE uint32_t can_update_crc32(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (size_t k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1UL)));
+        }
+    }
+    return ~crc;
+}
+
+CAN_UPDATE_INLINE uint32_t can_update_read_le32(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * @brief Device side of the firmware update over CAN.
+ *
+ * The host broadcasts a sector header, the data frames and a CRC after each
+ * chunk of the sector to all devices at once. Each device checks the CRC of
+ * the whole sector first and skips the sector if it already holds the data,
+ * so that only the changed sectors are erased and written. The chunks whose
+ * CRC didn't match, e.g. because frames got lost, are reported in the answer
+ * to CAN_UPDATE_CMD_SECTOR_END and the host sends them again. Programming
+ * skips the words that already hold their value, so a chunk can be sent any
+ * number of times.
+ *
+ * Port provides:
+ *   size_t sector_size(uint32_t sector); // 0 if the sector may not be written
+ *   const uint8_t* sector_base(uint32_t sector);
+ *   bool erase(uint32_t sector);
+ *   bool program(const uint8_t* addr, uint32_t word);
+ *   void send_status(const uint8_t (&payload)[8]);
+ */
+template<typename Port>
+class CanUpdateSession {
+public:
+    CAN_UPDATE_INLINE explicit CanUpdateSession(Port& port) : port_(port) {}
+
+    CAN_UPDATE_INLINE void send_ready() {
+        send_status(CAN_UPDATE_STATUS_READY);
+    }
+
+    // @brief Returns false for CAN_UPDATE_CMD_RESET
+    CAN_UPDATE_INLINE bool handle_command(uint32_t cmd, const uint8_t* data, uint8_t length) {
+        if (cmd == CAN_UPDATE_CMD_SECTOR && length >= 8) {
+            start_sector(data[0], (uint32_t)data[1] | ((uint32_t)data[2] << 8) | ((uint32_t)data[3] << 16),
+                         can_update_read_le32(data + 4));
+        } else if (cmd == CAN_UPDATE_CMD_CHUNK_CRC && length >= 8) {
+            check_chunk((uint32_t)data[0] | ((uint32_t)data[1] << 8), can_update_read_le32(data + 4));
+        } else if (cmd == CAN_UPDATE_CMD_SECTOR_END) {
+            end_sector();
+        } else if (cmd == CAN_UPDATE_CMD_RESET) {
+            return false;
+        }
+        return true;
+    }
+
+    // @brief Programs the 8 bytes of block index block of the current sector
+    CAN_UPDATE_INLINE void handle_data(uint32_t block, const uint8_t* data) {
+        uint32_t offset = block * CAN_UPDATE_BLOCK_SIZE;
+        if (state_ != kStateWriting || offset >= length_) {
+            return;
+        }
+        for (uint32_t i = 0; i < CAN_UPDATE_BLOCK_SIZE; i += 4) {
+            const uint8_t* addr = base_ + offset + i;
+            uint32_t word = can_update_read_le32(data + i);
+            uint32_t current = *(const volatile uint32_t*)addr;
+            if (current == word) {
+                continue;
+            }
+            // Programming can only clear bits of an erased word
+            if (current != 0xFFFFFFFFUL || !port_.program(addr, word)) {
+                failed_ = true;
+            }
+        }
+    }
+
+private:
+    enum State {
+        kStateIdle,
+        kStateSkipped,
+        kStateWriting,
+        kStateFailed,
+    };
+
+    CAN_UPDATE_INLINE void start_sector(uint32_t sector, uint32_t length, uint32_t crc) {
+        sector_ = sector;
+        size_t size = port_.sector_size(sector);
+        if (!size || length > size || (length % CAN_UPDATE_BLOCK_SIZE)
+                || length > CAN_UPDATE_MAX_CHUNKS * CAN_UPDATE_CHUNK_SIZE) {
+            state_ = kStateIdle;
+            send_status(CAN_UPDATE_STATUS_INVALID);
+            return;
+        }
+        base_ = port_.sector_base(sector);
+        length_ = length;
+        num_chunks_ = (length + CAN_UPDATE_CHUNK_SIZE - 1) / CAN_UPDATE_CHUNK_SIZE;
+        for (size_t i = 0; i < kBitmapWords; ++i) {
+            chunks_ok_[i] = 0;
+        }
+        failed_ = false;
+
+        if (can_update_crc32(0, base_, size) == crc) {
+            state_ = kStateSkipped;
+            send_status(CAN_UPDATE_STATUS_SKIPPED);
+        } else if (!port_.erase(sector)) {
+            state_ = kStateFailed;
+            send_status(CAN_UPDATE_STATUS_FAILED);
+        } else {
+            state_ = kStateWriting;
+            send_status(CAN_UPDATE_STATUS_ERASED);
+        }
+    }
+
+    CAN_UPDATE_INLINE void check_chunk(uint32_t chunk, uint32_t crc) {
+        if (state_ != kStateWriting || chunk >= num_chunks_) {
+            return;
+        }
+        uint32_t offset = chunk * CAN_UPDATE_CHUNK_SIZE;
+        uint32_t length = length_ - offset < CAN_UPDATE_CHUNK_SIZE ? length_ - offset : CAN_UPDATE_CHUNK_SIZE;
+        if (can_update_crc32(0, base_ + offset, length) == crc) {
+            chunks_ok_[chunk / 32] |= 1UL << (chunk % 32);
+        }
+    }
+
+    CAN_UPDATE_INLINE void end_sector() {
+        if (state_ == kStateSkipped) {
+            send_status(CAN_UPDATE_STATUS_SKIPPED);
+        } else if (state_ == kStateFailed || (state_ == kStateWriting && failed_)) {
+            send_status(CAN_UPDATE_STATUS_FAILED);
+        } else if (state_ == kStateWriting) {
+            // First missing chunk and a bitmap of the 32 chunks from there on
+            uint32_t first = num_chunks_;
+            uint32_t missing = 0;
+            for (uint32_t chunk = 0; chunk < num_chunks_; ++chunk) {
+                if (chunks_ok_[chunk / 32] & (1UL << (chunk % 32))) {
+                    continue;
+                }
+                if (first == num_chunks_) {
+                    first = chunk;
+                }
+                if (chunk - first >= 32) {
+                    break;
+                }
+                missing |= 1UL << (chunk - first);
+            }
+            if (first == num_chunks_) {
+                send_status(CAN_UPDATE_STATUS_COMPLETE);
+            } else {
+                send_status(CAN_UPDATE_STATUS_MISSING, first, missing);
+            }
+        } else {
+            send_status(CAN_UPDATE_STATUS_INVALID);
+        }
+    }
+
+    // [status, sector, first missing chunk (2 bytes), missing chunk bitmap (4 bytes)]
+    CAN_UPDATE_INLINE void send_status(CanUpdateStatus status, uint32_t first = 0, uint32_t missing = 0) {
+        uint8_t payload[8] = {
+            (uint8_t)status, (uint8_t)sector_, (uint8_t)first, (uint8_t)(first >> 8),
+            (uint8_t)missing, (uint8_t)(missing >> 8), (uint8_t)(missing >> 16), (uint8_t)(missing >> 24)
+        };
+        port_.send_status(payload);
+    }
+
+    static constexpr size_t kBitmapWords = CAN_UPDATE_MAX_CHUNKS / 32;
+
+    Port& port_;
+    State state_ = kStateIdle;
+    uint32_t sector_ = 0xFF;
+    const uint8_t* base_ = nullptr;
+    uint32_t length_ = 0; // [bytes] of the sector that the host sends
+    uint32_t num_chunks_ = 0;
+    uint32_t chunks_ok_[kBitmapWords] = {}; // chunks whose CRC matched
+    bool failed_ = false; // a word couldn't be programmed
+};
+
+#endif // __CAN_UPDATE_HPP
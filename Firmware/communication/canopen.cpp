@@ -0,0 +1,628 @@
+
+#include "canopen.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <odrive_main.h>
+#include <endpoint_source.hpp>
+
+// SDO abort codes (CiA 301)
+#define SDO_ABORT_COMMAND           0x05040001 // command specifier not valid or unknown
+#define SDO_ABORT_WRITE_ONLY        0x06010001
+#define SDO_ABORT_READ_ONLY         0x06010002
+#define SDO_ABORT_NO_OBJECT         0x06020000
+#define SDO_ABORT_NOT_MAPPABLE      0x06040041
+#define SDO_ABORT_PDO_LENGTH        0x06040042
+#define SDO_ABORT_LENGTH            0x06070010
+#define SDO_ABORT_NO_SUBINDEX       0x06090011
+#define SDO_ABORT_VALUE_RANGE       0x06090030
+#define SDO_ABORT_DEVICE_STATE      0x08000022
+
+#define COB_ID_INVALID 0x80000000
+
+CANopen::Node CANopen::nodes_[AXIS_COUNT];
+
+// Unit conversions of the CiA 402 objects: positions in encoder counts,
+// velocities in counts/s and torques in 1/1000 of the rated torque (0x6076).
+static int32_t turns_to_counts(const Axis& axis, float turns) {
+    return (int32_t)std::lrintf(turns * (float)axis.encoder_.config_.cpr);
+}
+
+static float counts_to_turns(const Axis& axis, uint32_t counts) {
+    return (float)(int32_t)counts / (float)axis.encoder_.config_.cpr;
+}
+
+static float rated_torque(const Axis& axis) {
+    return axis.motor_.config_.torque_constant * axis.motor_.config_.current_lim; // [Nm]
+}
+
+static int16_t torque_to_permille(const Axis& axis, float torque) {
+    float rated = rated_torque(axis);
+    float permille = rated > 0.0f ? torque / rated * 1000.0f : 0.0f;
+    return (int16_t)std::clamp(permille, (float)INT16_MIN, (float)INT16_MAX);
+}
+
+static float permille_to_torque(const Axis& axis, uint32_t permille) {
+    return (float)(int16_t)permille * rated_torque(axis) / 1000.0f;
+}
+
+// Sorted by index and subindex for find_object()
+const CANopen::Object CANopen::objects_[] = {
+    {0x1000, 0, 4, [](Axis& axis) -> uint32_t { return 0x00020192; }, nullptr}, // device type: CiA 402 servo drive
+    {0x1001, 0, 1, [](Axis& axis) -> uint32_t { return axis.error_ != Axis::ERROR_NONE ? 0x01 : 0x00; }, nullptr}, // error register
+    {0x1005, 0, 4, [](Axis& axis) -> uint32_t { return odCAN->config_.sync_id; },
+                   [](Axis& axis, uint32_t value) -> uint32_t {
+                       if (value & ~(uint32_t)0x7FF)
+                           return SDO_ABORT_VALUE_RANGE; // producing SYNC and extended IDs are not supported
+                       odCAN->config_.sync_id = value;
+                       return 0;
+                   }},
+    {0x1017, 0, 2, [](Axis& axis) -> uint32_t { return axis.config_.can.heartbeat_rate_ms; },
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.config_.can.heartbeat_rate_ms = (uint16_t)value; return 0; }},
+    {0x1018, 0, 1, [](Axis& axis) -> uint32_t { return 4; }, nullptr},
+    {0x1018, 1, 4, [](Axis& axis) -> uint32_t { return 0; }, nullptr}, // vendor ID (none assigned)
+    {0x1018, 2, 4, [](Axis& axis) -> uint32_t { return (odrv.hw_version_major_ << 16) | (odrv.hw_version_minor_ << 8) | odrv.hw_version_variant_; }, nullptr},
+    {0x1018, 3, 4, [](Axis& axis) -> uint32_t { return (odrv.fw_version_major_ << 16) | (odrv.fw_version_minor_ << 8) | odrv.fw_version_revision_; }, nullptr},
+    {0x1018, 4, 4, [](Axis& axis) -> uint32_t { return (uint32_t)serial_number; }, nullptr},
+    {0x6040, 0, 2, [](Axis& axis) -> uint32_t { return node(axis).controlword; },
+                   [](Axis& axis, uint32_t value) -> uint32_t { set_controlword(axis, value); return 0; }},
+    {0x6041, 0, 2, [](Axis& axis) -> uint32_t { return get_statusword(axis); }, nullptr},
+    {0x6060, 0, 1, [](Axis& axis) -> uint32_t { return (uint8_t)get_mode(axis); },
+                   [](Axis& axis, uint32_t value) -> uint32_t { return set_mode(axis, (int8_t)value); }},
+    {0x6061, 0, 1, [](Axis& axis) -> uint32_t { return (uint8_t)get_mode(axis); }, nullptr},
+    {0x6064, 0, 4, [](Axis& axis) -> uint32_t { // position actual value
+        TurnPosition pos = axis.encoder_.pos_estimate_turns_.any().value_or(TurnPosition{0, 0.0f});
+        return pos.turns * axis.encoder_.config_.cpr + turns_to_counts(axis, pos.fraction);
+    }, nullptr},
+    {0x606C, 0, 4, [](Axis& axis) -> uint32_t { return turns_to_counts(axis, axis.encoder_.vel_estimate_.any().value_or(0.0f)); }, nullptr},
+    {0x6071, 0, 2, [](Axis& axis) -> uint32_t { return (uint16_t)torque_to_permille(axis, axis.controller_.input_torque_); },
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.controller_.set_input(std::nullopt, std::nullopt, permille_to_torque(axis, value)); return 0; }},
+    {0x6076, 0, 4, [](Axis& axis) -> uint32_t { return (uint32_t)std::lrintf(rated_torque(axis) * 1000.0f); }, nullptr}, // [mNm]
+    {0x6077, 0, 2, [](Axis& axis) -> uint32_t {
+        return (uint16_t)torque_to_permille(axis, axis.motor_.current_control_.Iq_measured_ * axis.motor_.config_.torque_constant);
+    }, nullptr},
+    {0x607A, 0, 4, [](Axis& axis) -> uint32_t { return turns_to_counts(axis, axis.controller_.input_pos_); },
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.controller_.set_input(counts_to_turns(axis, value), std::nullopt, std::nullopt); return 0; }},
+    {0x60B1, 0, 4, [](Axis& axis) -> uint32_t { return turns_to_counts(axis, axis.controller_.input_vel_); }, // velocity offset
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.controller_.set_input(std::nullopt, counts_to_turns(axis, value), std::nullopt); return 0; }},
+    {0x60B2, 0, 2, [](Axis& axis) -> uint32_t { return (uint16_t)torque_to_permille(axis, axis.controller_.input_torque_); }, // torque offset
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.controller_.set_input(std::nullopt, std::nullopt, permille_to_torque(axis, value)); return 0; }},
+    {0x60FF, 0, 4, [](Axis& axis) -> uint32_t { return turns_to_counts(axis, axis.controller_.input_vel_); },
+                   [](Axis& axis, uint32_t value) -> uint32_t { axis.controller_.set_input(std::nullopt, counts_to_turns(axis, value), std::nullopt); return 0; }},
+    {0x6502, 0, 4, [](Axis& axis) -> uint32_t { return (1 << 7) | (1 << 8) | (1 << 9); }, nullptr}, // csp, csv, cst
+};
+
+const size_t CANopen::num_objects_ = sizeof(objects_) / sizeof(objects_[0]);
+
+void CANopen::handle_can_message(const can_Message_t& msg) {
+    if (msg.isExt || msg.rtr)
+        return;
+
+    if (msg.id == FUNC_NMT) {
+        handle_nmt(msg);
+        return;
+    }
+    if (msg.id == odCAN->config_.sync_id) {
+        handle_sync();
+        return;
+    }
+
+    for (auto& axis : axes) {
+        Node& n = node(axis);
+        if (axis.config_.can.is_extended || n.nmt_state == NMT_BOOTUP || n.nmt_state == NMT_STOPPED)
+            continue;
+        if (msg.id == FUNC_SDO_RX + axis.config_.can.node_id) {
+            axis.watchdog_feed(Axis::WATCHDOG_CHANNEL_CAN);
+            handle_sdo(axis, msg);
+            return;
+        }
+        for (size_t i = 0; i < CANOPEN_NUM_RPDOS; ++i) {
+            if (n.nmt_state == NMT_OPERATIONAL && n.rpdos[i].cob_id == msg.id) {
+                axis.watchdog_feed(Axis::WATCHDOG_CHANNEL_CAN);
+                handle_rpdo(axis, i, msg);
+                return;
+            }
+        }
+    }
+}
+
+// Accepts all function codes of the node ID. The NMT and SYNC messages are
+// let through by separate filter banks.
+bool CANopen::get_filter(const Axis& axis, uint32_t* id, uint32_t* mask) {
+    *id = axis.config_.can.node_id;
+    *mask = 0x07F;
+    return !axis.config_.can.is_extended && axis.config_.can.node_id >= 1 && axis.config_.can.node_id <= 127;
+}
+
+// Called in the control loop. A node in NMT_BOOTUP is (re)initialized here so
+// that it is never seen half initialized by the CAN thread, which ignores
+// nodes in this state.
+void CANopen::send_cyclic(Axis& axis) {
+    Node& n = node(axis);
+    const uint32_t now = HAL_GetTick();
+    if (axis.config_.can.is_extended)
+        return;
+
+    if (n.nmt_state == NMT_BOOTUP) {
+        reset_communication(axis);
+        if (send_heartbeat(axis, NMT_BOOTUP) >= 0) {
+            n.last_heartbeat = now;
+            n.nmt_state = NMT_PRE_OPERATIONAL;
+        }
+        return;
+    }
+
+    if (axis.config_.can.heartbeat_rate_ms > 0 && (now - n.last_heartbeat) >= axis.config_.can.heartbeat_rate_ms) {
+        if (send_heartbeat(axis, n.nmt_state) >= 0)
+            n.last_heartbeat = now;
+    }
+
+    bool sync = n.sync_pending;
+    n.sync_pending = false;
+    if (n.nmt_state != NMT_OPERATIONAL)
+        return;
+
+    for (size_t i = 0; i < CANOPEN_NUM_TPDOS; ++i) {
+        const Pdo& pdo = n.tpdos[i];
+        if (pdo.cob_id & COB_ID_INVALID)
+            continue;
+        if (pdo.transmission_type <= 240) {
+            // Type 0 (acyclic synchronous) is sent on every SYNC like type 1
+            if (sync && ++n.sync_count[i] >= std::max<uint8_t>(pdo.transmission_type, 1)) {
+                n.sync_count[i] = 0;
+                send_tpdo(axis, i);
+            }
+        } else if (pdo.event_timer_ms > 0 && (now - n.last_tpdo[i]) >= pdo.event_timer_ms) {
+            if (send_tpdo(axis, i) >= 0)
+                n.last_tpdo[i] = now;
+        }
+    }
+}
+
+// Sets the communication objects of the node to their defaults: RPDO1 with
+// controlword and target position, RPDO2 with controlword, target velocity
+// and target torque, TPDO1 with statusword, position actual value and torque
+// actual value and TPDO2 with statusword and velocity actual value.
+void CANopen::reset_communication(Axis& axis) {
+    Node& n = node(axis);
+    uint32_t node_id = axis.config_.can.node_id;
+
+    static const uint32_t rpdo_mappings[CANOPEN_NUM_RPDOS][CANOPEN_MAX_PDO_MAPPINGS] = {
+        {0x60400010, 0x607A0020},
+        {0x60400010, 0x60FF0020, 0x60710010},
+    };
+    static const uint32_t tpdo_mappings[CANOPEN_NUM_TPDOS][CANOPEN_MAX_PDO_MAPPINGS] = {
+        {0x60410010, 0x60640020, 0x60770010},
+        {0x60410010, 0x606C0020},
+    };
+    static const uint8_t rpdo_num_mappings[CANOPEN_NUM_RPDOS] = {2, 3};
+    static const uint8_t tpdo_num_mappings[CANOPEN_NUM_TPDOS] = {3, 2};
+    static const uint32_t rpdo_cob_ids[CANOPEN_NUM_RPDOS] = {FUNC_RPDO1, FUNC_RPDO2};
+    static const uint32_t tpdo_cob_ids[CANOPEN_NUM_TPDOS] = {FUNC_TPDO1, FUNC_TPDO2};
+
+    for (size_t i = 0; i < CANOPEN_NUM_RPDOS; ++i) {
+        Pdo& pdo = n.rpdos[i];
+        pdo = {};
+        pdo.cob_id = rpdo_cob_ids[i] + node_id;
+        pdo.transmission_type = 255;
+        std::copy_n(rpdo_mappings[i], CANOPEN_MAX_PDO_MAPPINGS, pdo.mappings);
+        map_pdo(pdo, true, rpdo_num_mappings[i]);
+        n.rpdo_pending[i] = false;
+    }
+    for (size_t i = 0; i < CANOPEN_NUM_TPDOS; ++i) {
+        Pdo& pdo = n.tpdos[i];
+        pdo = {};
+        pdo.cob_id = tpdo_cob_ids[i] + node_id;
+        pdo.transmission_type = 1;
+        std::copy_n(tpdo_mappings[i], CANOPEN_MAX_PDO_MAPPINGS, pdo.mappings);
+        map_pdo(pdo, false, tpdo_num_mappings[i]);
+        n.sync_count[i] = 0;
+    }
+}
+
+void CANopen::handle_nmt(const can_Message_t& msg) {
+    if (msg.len < 2)
+        return;
+    uint8_t command = msg.buf[0];
+    uint8_t node_id = msg.buf[1];
+
+    for (auto& axis : axes) {
+        Node& n = node(axis);
+        if (axis.config_.can.is_extended || (node_id != 0 && node_id != axis.config_.can.node_id))
+            continue;
+        if (n.nmt_state == NMT_BOOTUP)
+            continue;
+        switch (command) {
+            case 0x01: n.nmt_state = NMT_OPERATIONAL; break;
+            case 0x02: n.nmt_state = NMT_STOPPED; break;
+            case 0x80: n.nmt_state = NMT_PRE_OPERATIONAL; break;
+            case 0x81: // reset node
+                if (n.drive_state == DRIVE_OPERATION_ENABLED)
+                    axis.request_state(Axis::AXIS_STATE_IDLE);
+                n.drive_state = DRIVE_SWITCH_ON_DISABLED;
+                n.controlword = 0;
+                n.nmt_state = NMT_BOOTUP;
+                break;
+            case 0x82: // reset communication
+                n.nmt_state = NMT_BOOTUP;
+                break;
+        }
+    }
+}
+
+// Applies the synchronous RPDOs and lets the control loop send the
+// synchronous TPDOs on its next tick, like the SYNC mode of CANSimple.
+void CANopen::handle_sync() {
+    for (auto& axis : axes) {
+        Node& n = node(axis);
+        if (axis.config_.can.is_extended || n.nmt_state != NMT_OPERATIONAL)
+            continue;
+        for (size_t i = 0; i < CANOPEN_NUM_RPDOS; ++i) {
+            if (n.rpdo_pending[i]) {
+                n.rpdo_pending[i] = false;
+                apply_rpdo(axis, i, n.rpdo_data[i]);
+            }
+        }
+        n.sync_pending = true;
+    }
+}
+
+void CANopen::handle_rpdo(Axis& axis, size_t pdo_num, const can_Message_t& msg) {
+    Node& n = node(axis);
+    if (n.rpdos[pdo_num].transmission_type <= 240) {
+        n.rpdo_data[pdo_num] = msg;
+        n.rpdo_pending[pdo_num] = true;
+    } else {
+        apply_rpdo(axis, pdo_num, msg);
+    }
+}
+
+void CANopen::apply_rpdo(Axis& axis, size_t pdo_num, const can_Message_t& msg) {
+    const Pdo& pdo = node(axis).rpdos[pdo_num];
+    uint8_t bit = 0;
+    for (size_t i = 0; i < pdo.num_mappings; ++i)
+        bit += pdo.objects[i]->size * 8;
+    if (msg.len * 8 < bit)
+        return; // too short for the mapping
+
+    bit = 0;
+    for (size_t i = 0; i < pdo.num_mappings; ++i) {
+        const Object* object = pdo.objects[i];
+        object->set(axis, can_getSignal<uint32_t>(msg, bit, object->size * 8, true));
+        bit += object->size * 8;
+    }
+}
+
+int32_t CANopen::send_tpdo(Axis& axis, size_t pdo_num) {
+    const Pdo& pdo = node(axis).tpdos[pdo_num];
+    can_Message_t txmsg;
+    txmsg.id = pdo.cob_id & 0x7FF;
+    txmsg.isExt = false;
+
+    uint8_t bit = 0;
+    for (size_t i = 0; i < pdo.num_mappings; ++i) {
+        const Object* object = pdo.objects[i];
+        can_setSignal<uint32_t>(txmsg, object->get(axis), bit, object->size * 8, true);
+        bit += object->size * 8;
+    }
+    txmsg.len = bit / 8;
+
+    return odCAN->write(txmsg, ODriveCAN::TX_PRIORITY_CYCLIC);
+}
+
+int32_t CANopen::send_heartbeat(const Axis& axis, NmtState state) {
+    can_Message_t txmsg;
+    txmsg.id = FUNC_HEARTBEAT + axis.config_.can.node_id;
+    txmsg.isExt = false;
+    txmsg.len = 1;
+    txmsg.buf[0] = state;
+
+    return odCAN->write(txmsg, ODriveCAN::TX_PRIORITY_HEARTBEAT);
+}
+
+// Expedited SDO transfers only, so all objects are at most 4 bytes long
+void CANopen::handle_sdo(Axis& axis, const can_Message_t& msg) {
+    if (msg.len < 8)
+        return;
+
+    uint8_t command = msg.buf[0];
+    uint16_t index = msg.buf[1] | (msg.buf[2] << 8);
+    uint8_t subindex = msg.buf[3];
+    uint32_t value = can_getSignal<uint32_t>(msg, 32, 32, true);
+    uint8_t size = 0;
+    uint32_t abort_code;
+
+    can_Message_t txmsg;
+    txmsg.id = FUNC_SDO_TX + axis.config_.can.node_id;
+    txmsg.isExt = false;
+    txmsg.len = 8;
+    txmsg.buf[1] = msg.buf[1];
+    txmsg.buf[2] = msg.buf[2];
+    txmsg.buf[3] = msg.buf[3];
+
+    switch (command >> 5) {
+        case 2: // initiate upload
+            abort_code = read_object(axis, index, subindex, &value, &size);
+            if (!abort_code) {
+                txmsg.buf[0] = 0x43 | ((4 - size) << 2);
+                can_setSignal<uint32_t>(txmsg, value, 32, size * 8, true);
+            }
+            break;
+        case 1: // initiate download
+            if (!(command & 0x02)) {
+                abort_code = SDO_ABORT_COMMAND; // segmented transfers are not supported
+                break;
+            }
+            size = (command & 0x01) ? 4 - ((command >> 2) & 0x03) : 0;
+            if (size)
+                value &= size < 4 ? (1UL << (size * 8)) - 1 : 0xFFFFFFFF;
+            abort_code = write_object(axis, index, subindex, value, size);
+            if (!abort_code)
+                txmsg.buf[0] = 0x60;
+            break;
+        case 4: // abort from the client
+            return;
+        default:
+            abort_code = SDO_ABORT_COMMAND;
+            break;
+    }
+
+    if (abort_code) {
+        txmsg.buf[0] = 0x80;
+        can_setSignal<uint32_t>(txmsg, abort_code, 32, 32, true);
+    }
+    odCAN->write(txmsg);
+}
+
+const CANopen::Object* CANopen::find_object(uint16_t index, uint8_t subindex) {
+    const Object* end = objects_ + num_objects_;
+    const Object* object = std::lower_bound(objects_, end, std::make_pair(index, subindex),
+        [](const Object& object, const std::pair<uint16_t, uint8_t>& key) {
+            return std::make_pair(object.index, object.subindex) < key;
+        });
+    return (object != end && object->index == index && object->subindex == subindex) ? object : nullptr;
+}
+
+static bool is_pdo_object(uint16_t index) {
+    return (index >= 0x1400 && index < 0x1400 + CANOPEN_NUM_RPDOS)
+        || (index >= 0x1600 && index < 0x1600 + CANOPEN_NUM_RPDOS)
+        || (index >= 0x1800 && index < 0x1800 + CANOPEN_NUM_TPDOS)
+        || (index >= 0x1A00 && index < 0x1A00 + CANOPEN_NUM_TPDOS);
+}
+
+uint32_t CANopen::read_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size) {
+    if (is_pdo_object(index))
+        return access_pdo_object(axis, index, subindex, value, size, false);
+    if (index >= 0x2000 && index <= 0x2FFF)
+        return access_endpoint_object(index, subindex, value, size, false);
+
+    const Object* object = find_object(index, subindex);
+    if (!object)
+        return find_object(index, 0) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT;
+    if (!object->get)
+        return SDO_ABORT_WRITE_ONLY;
+    *value = object->get(axis);
+    *size = object->size;
+    return 0;
+}
+
+uint32_t CANopen::write_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size) {
+    if (is_pdo_object(index))
+        return access_pdo_object(axis, index, subindex, &value, &size, true);
+    if (index >= 0x2000 && index <= 0x2FFF)
+        return access_endpoint_object(index, subindex, &value, &size, true);
+
+    const Object* object = find_object(index, subindex);
+    if (!object)
+        return find_object(index, 0) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT;
+    if (!object->set)
+        return SDO_ABORT_READ_ONLY;
+    if (size && size != object->size)
+        return SDO_ABORT_LENGTH;
+    return object->set(axis, value);
+}
+
+// PDO communication parameters (0x1400, 0x1800) and mapping parameters
+// (0x1600, 0x1A00). The mapping entries can only be changed while
+// subindex 0 is 0, which then activates the new mapping.
+uint32_t CANopen::access_pdo_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size, bool write) {
+    Node& n = node(axis);
+    bool is_rpdo = index < 0x1800;
+    bool is_mapping = (index & 0x0200) != 0;
+    Pdo& pdo = is_rpdo ? n.rpdos[index & 0xFF] : n.tpdos[index & 0xFF];
+
+    uint8_t object_size;
+    if (is_mapping) {
+        if (subindex > CANOPEN_MAX_PDO_MAPPINGS)
+            return SDO_ABORT_NO_SUBINDEX;
+        object_size = subindex == 0 ? 1 : 4;
+    } else {
+        switch (subindex) {
+            case 0: object_size = 1; break;
+            case 1: object_size = 4; break;
+            case 2: object_size = 1; break;
+            case 5: if (!is_rpdo) { object_size = 2; break; } [[fallthrough]];
+            default: return SDO_ABORT_NO_SUBINDEX;
+        }
+    }
+
+    if (!write) {
+        *size = object_size;
+        if (is_mapping) {
+            *value = subindex == 0 ? pdo.num_mappings : pdo.mappings[subindex - 1];
+        } else {
+            switch (subindex) {
+                case 0: *value = is_rpdo ? 2 : 5; break;
+                case 1: *value = pdo.cob_id; break;
+                case 2: *value = pdo.transmission_type; break;
+                case 5: *value = pdo.event_timer_ms; break;
+            }
+        }
+        return 0;
+    }
+
+    if (*size && *size != object_size)
+        return SDO_ABORT_LENGTH;
+    if (is_mapping) {
+        if (subindex == 0)
+            return map_pdo(pdo, is_rpdo, *value);
+        if (pdo.num_mappings)
+            return SDO_ABORT_DEVICE_STATE;
+        pdo.mappings[subindex - 1] = *value;
+        return 0;
+    }
+    switch (subindex) {
+        case 0:
+            return SDO_ABORT_READ_ONLY;
+        case 1:
+            // The filters only pass the function codes of the node ID
+            if ((*value & 0x7F) != axis.config_.can.node_id || (*value & 0x7FFFF800 & ~0x40000000))
+                return SDO_ABORT_VALUE_RANGE;
+            pdo.cob_id = *value & (COB_ID_INVALID | 0x7FF);
+            return 0;
+        case 2:
+            if (*value > 240 && *value < 254)
+                return SDO_ABORT_VALUE_RANGE;
+            pdo.transmission_type = *value;
+            return 0;
+        case 5:
+            pdo.event_timer_ms = *value;
+            return 0;
+    }
+    return SDO_ABORT_NO_SUBINDEX;
+}
+
+// Activates the first num_mappings entries of pdo.mappings
+uint32_t CANopen::map_pdo(Pdo& pdo, bool is_rpdo, uint8_t num_mappings) {
+    if (num_mappings > CANOPEN_MAX_PDO_MAPPINGS)
+        return SDO_ABORT_VALUE_RANGE;
+
+    const Object* objects[CANOPEN_MAX_PDO_MAPPINGS];
+    size_t bits = 0;
+    for (size_t i = 0; i < num_mappings; ++i) {
+        uint32_t mapping = pdo.mappings[i];
+        objects[i] = find_object(mapping >> 16, (mapping >> 8) & 0xFF);
+        if (!objects[i])
+            return SDO_ABORT_NO_OBJECT;
+        if ((mapping & 0xFF) != objects[i]->size * 8u || (is_rpdo ? !objects[i]->set : !objects[i]->get))
+            return SDO_ABORT_NOT_MAPPABLE;
+        bits += mapping & 0xFF;
+    }
+    if (bits > 64)
+        return SDO_ABORT_PDO_LENGTH;
+
+    CRITICAL_SECTION() {
+        std::copy_n(objects, num_mappings, pdo.objects);
+        pdo.num_mappings = num_mappings;
+    }
+    return 0;
+}
+
+// The manufacturer specific objects 0x2000 to 0x2FFF give access to all
+// fibre properties that convert to and from float, as REAL32. The endpoint
+// ID is (index - 0x2000) << 8 | subindex.
+uint32_t CANopen::access_endpoint_object(uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size, bool write) {
+    endpoint_ref_t endpoint;
+    endpoint.json_crc = fibre::json_crc_;
+    endpoint.endpoint_id = ((index - 0x2000) << 8) | subindex;
+
+    if (write) {
+        if (*size && *size != 4)
+            return SDO_ABORT_LENGTH;
+        float float_value;
+        std::memcpy(&float_value, value, sizeof(float_value));
+        return fibre::set_endpoint_from_float(endpoint, float_value) ? 0 : SDO_ABORT_NO_OBJECT;
+    }
+
+    EndpointSource source;
+    source.resolve(endpoint);
+    float float_value = source.read();
+    if (std::isnan(float_value))
+        return SDO_ABORT_NO_OBJECT;
+    std::memcpy(value, &float_value, sizeof(float_value));
+    *size = 4;
+    return 0;
+}
+
+// CiA 402 device control. Operation enabled runs the closed loop control of
+// the axis, all other states leave it idle.
+void CANopen::set_controlword(Axis& axis, uint16_t controlword) {
+    Node& n = node(axis);
+    uint16_t prev_controlword = n.controlword;
+    n.controlword = controlword;
+
+    update_drive_state(axis);
+    DriveState state = n.drive_state;
+
+    if (state == DRIVE_FAULT) {
+        if ((controlword & 0x80) && !(prev_controlword & 0x80)) { // fault reset
+            odrv.clear_errors();
+            n.drive_state = DRIVE_SWITCH_ON_DISABLED;
+        }
+        return;
+    }
+
+    if ((controlword & 0x02) == 0 || (controlword & 0x04) == 0) {
+        state = DRIVE_SWITCH_ON_DISABLED; // disable voltage or quick stop
+    } else if ((controlword & 0x07) == 0x06) {
+        state = DRIVE_READY_TO_SWITCH_ON; // shutdown
+    } else if ((controlword & 0x0F) == 0x07) {
+        if (state != DRIVE_SWITCH_ON_DISABLED)
+            state = DRIVE_SWITCHED_ON; // switch on or disable operation
+    } else if ((controlword & 0x0F) == 0x0F) {
+        if (state != DRIVE_SWITCH_ON_DISABLED)
+            state = DRIVE_OPERATION_ENABLED; // enable operation, also from ready to switch on
+    }
+
+    if (state == DRIVE_OPERATION_ENABLED && n.drive_state != DRIVE_OPERATION_ENABLED) {
+        axis.request_state(Axis::AXIS_STATE_CLOSED_LOOP_CONTROL);
+    } else if (state != DRIVE_OPERATION_ENABLED && n.drive_state == DRIVE_OPERATION_ENABLED) {
+        axis.request_state(Axis::AXIS_STATE_IDLE);
+    }
+    n.drive_state = state;
+}
+
+void CANopen::update_drive_state(Axis& axis) {
+    if (axis.error_ != Axis::ERROR_NONE)
+        node(axis).drive_state = DRIVE_FAULT;
+}
+
+uint16_t CANopen::get_statusword(Axis& axis) {
+    update_drive_state(axis);
+    const uint16_t remote = 0x0200;
+    switch (node(axis).drive_state) {
+        case DRIVE_SWITCH_ON_DISABLED: return remote | 0x0040;
+        case DRIVE_READY_TO_SWITCH_ON: return remote | 0x0031;
+        case DRIVE_SWITCHED_ON: return remote | 0x0033;
+        case DRIVE_OPERATION_ENABLED:
+            // bit 12: the drive follows the targets
+            return remote | 0x0037 | (axis.current_state_ == Axis::AXIS_STATE_CLOSED_LOOP_CONTROL ? 0x1000 : 0);
+        case DRIVE_FAULT: return remote | 0x0008;
+    }
+    return remote;
+}
+
+// The cyclic synchronous modes pass the targets through to the controller
+uint32_t CANopen::set_mode(Axis& axis, int8_t mode) {
+    switch (mode) {
+        case MODE_CYCLIC_SYNC_POSITION: axis.controller_.config_.control_mode = Controller::CONTROL_MODE_POSITION_CONTROL; break;
+        case MODE_CYCLIC_SYNC_VELOCITY: axis.controller_.config_.control_mode = Controller::CONTROL_MODE_VELOCITY_CONTROL; break;
+        case MODE_CYCLIC_SYNC_TORQUE: axis.controller_.config_.control_mode = Controller::CONTROL_MODE_TORQUE_CONTROL; break;
+        default: return SDO_ABORT_VALUE_RANGE;
+    }
+    axis.controller_.config_.input_mode = Controller::INPUT_MODE_PASSTHROUGH;
+    return 0;
+}
+
+int8_t CANopen::get_mode(const Axis& axis) {
+    if (axis.controller_.config_.input_mode != Controller::INPUT_MODE_PASSTHROUGH)
+        return MODE_NONE;
+    switch (axis.controller_.config_.control_mode) {
+        case Controller::CONTROL_MODE_POSITION_CONTROL: return MODE_CYCLIC_SYNC_POSITION;
+        case Controller::CONTROL_MODE_VELOCITY_CONTROL: return MODE_CYCLIC_SYNC_VELOCITY;
+        case Controller::CONTROL_MODE_TORQUE_CONTROL: return MODE_CYCLIC_SYNC_TORQUE;
+        default: return MODE_NONE;
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef __CANOPEN_HPP_
+#define __CANOPEN_HPP_
+
+#include "interface_can.hpp"
+
+#define CANOPEN_NUM_RPDOS 2
+#define CANOPEN_NUM_TPDOS 2
+#define CANOPEN_MAX_PDO_MAPPINGS 4
+
+/**
+ * @brief A subset of CANopen (CiA 301) with the CiA 402 drive profile.
+ *
+ * Each axis is one node with the node ID config.can.node_id (1 to 127,
+ * standard IDs only). Supported are NMT, the heartbeat producer, expedited
+ * SDO transfers, 2 RPDOs and 2 TPDOs with configurable mapping and the
+ * cyclic synchronous position, velocity and torque modes. See
+ * docs/can-protocol.md for the object dictionary.
+ *
+ * handle_can_message() runs in the CAN thread and send_cyclic() in the
+ * control loop, like for CANSimple.
+ */
+class CANopen {
+   public:
+    static void handle_can_message(const can_Message_t& msg);
+    static bool get_filter(const Axis& axis, uint32_t* id, uint32_t* mask);
+    static void send_cyclic(Axis& axis);
+
+   private:
+    enum FunctionCode {
+        FUNC_NMT = 0x000,
+        FUNC_SYNC = 0x080,
+        FUNC_TPDO1 = 0x180,
+        FUNC_RPDO1 = 0x200,
+        FUNC_TPDO2 = 0x280,
+        FUNC_RPDO2 = 0x300,
+        FUNC_SDO_TX = 0x580,
+        FUNC_SDO_RX = 0x600,
+        FUNC_HEARTBEAT = 0x700,
+    };
+
+    enum NmtState : uint8_t {
+        NMT_BOOTUP = 0x00,
+        NMT_STOPPED = 0x04,
+        NMT_OPERATIONAL = 0x05,
+        NMT_PRE_OPERATIONAL = 0x7F,
+    };
+
+    // CiA 402 power state machine
+    enum DriveState : uint8_t {
+        DRIVE_SWITCH_ON_DISABLED,
+        DRIVE_READY_TO_SWITCH_ON,
+        DRIVE_SWITCHED_ON,
+        DRIVE_OPERATION_ENABLED,
+        DRIVE_FAULT,
+    };
+
+    enum OperationMode : int8_t {
+        MODE_NONE = 0,
+        MODE_CYCLIC_SYNC_POSITION = 8,
+        MODE_CYCLIC_SYNC_VELOCITY = 9,
+        MODE_CYCLIC_SYNC_TORQUE = 10,
+    };
+
+    // An entry of the object dictionary. Values are passed as the raw bits
+    // of their CANopen type, which is size bytes long.
+    struct Object {
+        uint16_t index;
+        uint8_t subindex;
+        uint8_t size;
+        uint32_t (*get)(Axis& axis); // nullptr if write only
+        uint32_t (*set)(Axis& axis, uint32_t value); // returns an SDO abort code or 0, nullptr if read only
+    };
+
+    struct Pdo {
+        uint32_t cob_id; // bit 31 disables the PDO
+        uint8_t transmission_type; // 0 to 240: synchronous, 254 and 255: event driven
+        uint16_t event_timer_ms; // TPDOs only
+        uint8_t num_mappings;
+        uint32_t mappings[CANOPEN_MAX_PDO_MAPPINGS]; // index << 16 | subindex << 8 | bit length
+        const Object* objects[CANOPEN_MAX_PDO_MAPPINGS];
+    };
+
+    struct Node {
+        NmtState nmt_state = NMT_BOOTUP;
+        DriveState drive_state = DRIVE_SWITCH_ON_DISABLED;
+        uint16_t controlword = 0;
+        uint32_t last_heartbeat = 0;
+        Pdo rpdos[CANOPEN_NUM_RPDOS];
+        Pdo tpdos[CANOPEN_NUM_TPDOS];
+        uint32_t last_tpdo[CANOPEN_NUM_TPDOS] = {};
+        uint8_t sync_count[CANOPEN_NUM_TPDOS] = {};
+
+        // Data of the synchronous RPDOs, applied on the next SYNC
+        can_Message_t rpdo_data[CANOPEN_NUM_RPDOS];
+        bool rpdo_pending[CANOPEN_NUM_RPDOS] = {};
+        volatile bool sync_pending = false; // sample the synchronous TPDOs on the next control tick
+    };
+
+    static void reset_communication(Axis& axis);
+    static void handle_nmt(const can_Message_t& msg);
+    static void handle_sync();
+    static void handle_sdo(Axis& axis, const can_Message_t& msg);
+    static void handle_rpdo(Axis& axis, size_t pdo_num, const can_Message_t& msg);
+    static void apply_rpdo(Axis& axis, size_t pdo_num, const can_Message_t& msg);
+    static int32_t send_tpdo(Axis& axis, size_t pdo_num);
+    static int32_t send_heartbeat(const Axis& axis, NmtState state);
+
+    static uint32_t read_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size);
+    static uint32_t write_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
+    static uint32_t access_pdo_object(Axis& axis, uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size, bool write);
+    static uint32_t access_endpoint_object(uint16_t index, uint8_t subindex, uint32_t* value, uint8_t* size, bool write);
+    static const Object* find_object(uint16_t index, uint8_t subindex);
+    static uint32_t map_pdo(Pdo& pdo, bool is_rpdo, uint8_t num_mappings);
+
+    static void set_controlword(Axis& axis, uint16_t controlword);
+    static void update_drive_state(Axis& axis);
+    static uint16_t get_statusword(Axis& axis);
+    static uint32_t set_mode(Axis& axis, int8_t mode);
+    static int8_t get_mode(const Axis& axis);
+
+    static Node& node(const Axis& axis) { return nodes_[axis.axis_num_]; }
+
+    static const Object objects_[];
+    static const size_t num_objects_;
+    static Node nodes_[AXIS_COUNT];
+};
+
+#endif // __CANOPEN_HPP_
@@ -9,6 +9,11 @@
 
 // Specific CAN Protocols
 #include "can_simple.hpp"
+#include "canopen.hpp"
+
+// The interrupts that the server thread (re-)enables
+#define CAN_NOTIFICATIONS (CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_RX_FIFO1_OVERRUN | CAN_IT_TX_MAILBOX_EMPTY \
+                         | CAN_IT_ERROR | CAN_IT_LAST_ERROR_CODE | CAN_IT_BUSOFF)
 
 // Safer context handling via maps instead of arrays
 // #include <unordered_map>
@@ -17,6 +22,7 @@
 // Constructor is called by communication.cpp and the handle is assigned appropriately
 ODriveCAN::ODriveCAN(ODriveCAN::Config_t &config, CAN_HandleTypeDef *handle)
     : config_{config},
+      time_sync_{config.time_sync},
       handle_{handle} {
     // ctxMap[handle_] = this;
 }
@@ -27,22 +33,34 @@ void ODriveCAN::can_server_thread() {
         if (status == HAL_CAN_ERROR_NONE) {
             can_Message_t rxmsg;
 
-            osSemaphoreWait(sem_can, 10);  // Poll every 10ms regardless of sempahore status
+            // Woken up by the FIFO message pending interrupt. The timeout
+            // picks up changes of the node IDs for the filters.
+            osSemaphoreWait(sem_can, 10);
+            update_filters();
+            update_stats();
+            if (rx_pending_ && available()) {
+                rx_latency_ = (float)(DWT->CYCCNT - rx_pending_cyccnt_) / (float)(SystemCoreClock / 1000000);
+                max_rx_latency_ = std::max(max_rx_latency_, rx_latency_);
+            }
+            rx_pending_ = false;
             while (available()) {
                 read(rxmsg);
                 switch (config_.protocol) {
                     case PROTOCOL_SIMPLE:
                         CANSimple::handle_can_message(rxmsg);
                         break;
+                    case PROTOCOL_CAN_OPEN:
+                        CANopen::handle_can_message(rxmsg);
+                        break;
                 }
             }
-            HAL_CAN_ActivateNotification(handle_, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+            HAL_CAN_ActivateNotification(handle_, CAN_NOTIFICATIONS);
         } else {
             if (status == HAL_CAN_ERROR_TIMEOUT) {
                 HAL_CAN_ResetError(handle_);
                 status = HAL_CAN_Start(handle_);
                 if (status == HAL_OK)
-                    status = HAL_CAN_ActivateNotification(handle_, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+                    status = HAL_CAN_ActivateNotification(handle_, CAN_NOTIFICATIONS);
             }
         }
     }
@@ -60,22 +78,12 @@ bool ODriveCAN::start_can_server() {
 
     status = HAL_CAN_Init(handle_);
 
-    CAN_FilterTypeDef filter;
-    filter.FilterActivation = ENABLE;
-    filter.FilterBank = 0;
-    filter.FilterFIFOAssignment = CAN_RX_FIFO0;
-    filter.FilterIdHigh = 0x0000;
-    filter.FilterIdLow = 0x0000;
-    filter.FilterMaskIdHigh = 0x0000;
-    filter.FilterMaskIdLow = 0x0000;
-    filter.FilterMode = CAN_FILTERMODE_IDMASK;
-    filter.FilterScale = CAN_FILTERSCALE_32BIT;
-
-    status = HAL_CAN_ConfigFilter(handle_, &filter);
+    filters_valid_ = false;
+    update_filters();
 
     status = HAL_CAN_Start(handle_);
     if (status == HAL_OK)
-        status = HAL_CAN_ActivateNotification(handle_, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+        status = HAL_CAN_ActivateNotification(handle_, CAN_NOTIFICATIONS);
 
     osThreadDef(can_server_thread_def, can_server_thread_wrapper, osPriorityNormal, 0, stack_size_ / sizeof(StackType_t));
     thread_id_ = osThreadCreate(osThread(can_server_thread_def), this);
@@ -84,30 +92,162 @@ bool ODriveCAN::start_can_server() {
     return status;
 }
 
-// Send a CAN message on the bus
-int32_t ODriveCAN::write(can_Message_t &txmsg) {
-    if (HAL_CAN_GetError(handle_) == HAL_CAN_ERROR_NONE) {
-        CAN_TxHeaderTypeDef header;
-        header.StdId = txmsg.id;
-        header.ExtId = txmsg.id;
-        header.IDE = txmsg.isExt ? CAN_ID_EXT : CAN_ID_STD;
-        header.RTR = CAN_RTR_DATA;
-        header.DLC = txmsg.len;
-        header.TransmitGlobalTime = FunctionalState::DISABLE;
-
-        uint32_t retTxMailbox = 0;
-        if (HAL_CAN_GetTxMailboxesFreeLevel(handle_) > 0)
-            HAL_CAN_AddTxMessage(handle_, &header, txmsg.buf, &retTxMailbox);
-        else
-            return -1;
-        return (int32_t)retTxMailbox;
-    } else {
+// Sets up one filter bank per axis that only accepts the frames for its node
+// ID, so that the traffic of other nodes on the bus never reaches the CPU,
+// one for the SYNC message if an axis is in sync mode and one that routes the
+// time sync frames to FIFO 1.
+// Does nothing if the configuration didn't change since the last call.
+void ODriveCAN::update_filters() {
+    // CANopen always uses SYNC
+    bool sync_enabled = config_.protocol == PROTOCOL_CAN_OPEN;
+    for (auto& axis: axes) {
+        sync_enabled = sync_enabled || axis.config_.can.sync_mode;
+    }
+
+    bool time_sync_enabled = config_.time_sync.mode == TimeSync::MODE_SLAVE && config_.time_sync.can_id <= 0x7FF;
+
+    bool changed = !filters_valid_ || filter_protocol_ != config_.protocol
+                || sync_filter_enabled_ != sync_enabled || sync_filter_id_ != config_.sync_id
+                || time_sync_filter_enabled_ != time_sync_enabled || time_sync_filter_id_ != config_.time_sync.can_id;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        changed = changed || filters_[i].node_id != axes[i].config_.can.node_id
+                          || filters_[i].is_extended != axes[i].config_.can.is_extended;
+    }
+    if (!changed)
+        return;
+
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        const Axis& axis = axes[i];
+        uint32_t id = 0, mask = 0;
+        bool accept = false;
+        switch (config_.protocol) {
+            case PROTOCOL_SIMPLE:
+                accept = CANSimple::get_filter(axis, &id, &mask);
+                break;
+            case PROTOCOL_CAN_OPEN:
+                accept = CANopen::get_filter(axis, &id, &mask);
+                break;
+        }
+
+        // Layout of the filter registers: STID[10:0] in bits 31:21 or
+        // EXID[28:0] in bits 31:3, then IDE and RTR. IDE must always match.
+        uint32_t filter_id, filter_mask;
+        if (axis.config_.can.is_extended) {
+            filter_id = (id << 3) | CAN_ID_EXT;
+            filter_mask = (mask << 3) | CAN_ID_EXT;
+        } else {
+            filter_id = id << 21;
+            filter_mask = (mask << 21) | CAN_ID_EXT;
+        }
+
+        CAN_FilterTypeDef filter;
+        filter.FilterActivation = accept ? ENABLE : DISABLE;
+        filter.FilterBank = i;
+        filter.FilterFIFOAssignment = CAN_RX_FIFO0;
+        filter.FilterIdHigh = filter_id >> 16;
+        filter.FilterIdLow = filter_id & 0xffff;
+        filter.FilterMaskIdHigh = filter_mask >> 16;
+        filter.FilterMaskIdLow = filter_mask & 0xffff;
+        filter.FilterMode = CAN_FILTERMODE_IDMASK;
+        filter.FilterScale = CAN_FILTERSCALE_32BIT;
+        filter.SlaveStartFilterBank = 14; // CAN1 has the first half of the banks
+        HAL_CAN_ConfigFilter(handle_, &filter);
+
+        filters_[i].node_id = axis.config_.can.node_id;
+        filters_[i].is_extended = axis.config_.can.is_extended;
+    }
+
+    CAN_FilterTypeDef filter;
+    filter.FilterActivation = (sync_enabled && config_.sync_id <= 0x7FF) ? ENABLE : DISABLE;
+    filter.FilterBank = AXIS_COUNT;
+    filter.FilterFIFOAssignment = CAN_RX_FIFO0;
+    filter.FilterIdHigh = (config_.sync_id << 21) >> 16;
+    filter.FilterIdLow = 0;
+    filter.FilterMaskIdHigh = (0x7FF << 21) >> 16;
+    filter.FilterMaskIdLow = CAN_ID_EXT;
+    filter.FilterMode = CAN_FILTERMODE_IDMASK;
+    filter.FilterScale = CAN_FILTERSCALE_32BIT;
+    filter.SlaveStartFilterBank = 14;
+    HAL_CAN_ConfigFilter(handle_, &filter);
+
+    // NMT commands of CANopen
+    filter.FilterActivation = config_.protocol == PROTOCOL_CAN_OPEN ? ENABLE : DISABLE;
+    filter.FilterBank = AXIS_COUNT + 1;
+    filter.FilterIdHigh = 0;
+    HAL_CAN_ConfigFilter(handle_, &filter);
+
+    // Filters in list mode take precedence over the ones in mask mode, so
+    // the time frames always go to FIFO 1 even if an axis filter matches.
+    filter.FilterActivation = time_sync_enabled ? ENABLE : DISABLE;
+    filter.FilterBank = AXIS_COUNT + 2;
+    filter.FilterFIFOAssignment = CAN_RX_FIFO1;
+    filter.FilterIdHigh = (config_.time_sync.can_id << 21) >> 16;
+    filter.FilterIdLow = 0;
+    filter.FilterMaskIdHigh = filter.FilterIdHigh;
+    filter.FilterMaskIdLow = 0;
+    filter.FilterMode = CAN_FILTERMODE_IDLIST;
+    HAL_CAN_ConfigFilter(handle_, &filter);
+
+    filter_protocol_ = config_.protocol;
+    sync_filter_enabled_ = sync_enabled;
+    sync_filter_id_ = config_.sync_id;
+    time_sync_filter_enabled_ = time_sync_enabled;
+    time_sync_filter_id_ = config_.time_sync.can_id;
+    filters_valid_ = true;
+}
+
+// Queue a CAN message for sending on the bus. Returns -1 if the queue of the
+// priority is full or the bus is in an error state.
+int32_t ODriveCAN::write(can_Message_t &txmsg, TxPriority priority) {
+    if (HAL_CAN_GetError(handle_) != HAL_CAN_ERROR_NONE) {
         return -1;
     }
+
+    int32_t result = -1;
+    CRITICAL_SECTION() {
+        TxQueue& queue = tx_queues_[priority];
+        if (queue.count < CAN_TX_QUEUE_LENGTH) {
+            queue.messages[(queue.head + queue.count) % CAN_TX_QUEUE_LENGTH] = txmsg;
+            queue.count++;
+            tx_queue_high_water_ = std::max<uint32_t>(tx_queue_high_water_, queue.count);
+            result = 0;
+        } else {
+            n_tx_dropped_++;
+        }
+        process_tx_queue();
+    }
+    return result;
+}
+
+// Moves queued frames into free TX mailboxes, highest priority first. Called
+// from a critical section or from the TX mailbox complete interrupt.
+void ODriveCAN::process_tx_queue() {
+    for (size_t priority = 0; priority < TX_PRIORITY_COUNT; ++priority) {
+        TxQueue& queue = tx_queues_[priority];
+        uint32_t reserved_mailboxes = (priority == TX_PRIORITY_RESPONSE) ? 0 : 1;
+        while (queue.count && HAL_CAN_GetTxMailboxesFreeLevel(handle_) > reserved_mailboxes) {
+            can_Message_t& txmsg = queue.messages[queue.head];
+            CAN_TxHeaderTypeDef header;
+            header.StdId = txmsg.id;
+            header.ExtId = txmsg.id;
+            header.IDE = txmsg.isExt ? CAN_ID_EXT : CAN_ID_STD;
+            header.RTR = CAN_RTR_DATA;
+            header.DLC = txmsg.len;
+            header.TransmitGlobalTime = FunctionalState::DISABLE;
+
+            uint32_t retTxMailbox = 0;
+            if (HAL_CAN_AddTxMessage(handle_, &header, txmsg.buf, &retTxMailbox) != HAL_OK)
+                return;
+            time_sync_.on_tx_queued(txmsg, retTxMailbox);
+            queue.head = (queue.head + 1) % CAN_TX_QUEUE_LENGTH;
+            queue.count--;
+        }
+    }
 }
 
+// FIFO 1 is reserved for the time sync and is read in its interrupt
 uint32_t ODriveCAN::available() {
-    return (HAL_CAN_GetRxFifoFillLevel(handle_, CAN_RX_FIFO0) + HAL_CAN_GetRxFifoFillLevel(handle_, CAN_RX_FIFO1));
+    return HAL_CAN_GetRxFifoFillLevel(handle_, CAN_RX_FIFO0);
 }
 
 bool ODriveCAN::read(can_Message_t &rxmsg) {
@@ -116,9 +256,9 @@ bool ODriveCAN::read(can_Message_t &rxmsg) {
     if (HAL_CAN_GetRxFifoFillLevel(handle_, CAN_RX_FIFO0) > 0) {
         HAL_CAN_GetRxMessage(handle_, CAN_RX_FIFO0, &header, rxmsg.buf);
         validRead = true;
-    } else if (HAL_CAN_GetRxFifoFillLevel(handle_, CAN_RX_FIFO1) > 0) {
-        HAL_CAN_GetRxMessage(handle_, CAN_RX_FIFO1, &header, rxmsg.buf);
-        validRead = true;
+        CRITICAL_SECTION() {
+            n_rx_frames_++; // also counted in the RX FIFO 1 interrupt
+        }
     }
 
     rxmsg.isExt = header.IDE;
@@ -129,6 +269,43 @@ bool ODriveCAN::read(can_Message_t &rxmsg) {
     return validRead;
 }
 
+uint32_t ODriveCAN::get_command_count(uint32_t cmd_id) {
+    return CANSimple::get_command_count(cmd_id);
+}
+
+// Updates the frame rates once per second. Called by the server thread.
+void ODriveCAN::update_stats() {
+    uint32_t now = HAL_GetTick();
+    uint32_t dt = now - stats_time_;
+    if (dt >= 1000) {
+        uint32_t n_rx = n_rx_frames_;
+        uint32_t n_tx = n_tx_frames_;
+        rx_rate_ = (float)(n_rx - stats_rx_frames_) * 1000.0f / (float)dt;
+        tx_rate_ = (float)(n_tx - stats_tx_frames_) * 1000.0f / (float)dt;
+        stats_rx_frames_ = n_rx;
+        stats_tx_frames_ = n_tx;
+        stats_time_ = now;
+    }
+}
+
+// Called at the start of the TX interrupt, before the HAL clears the status
+// of the completed mailboxes. With automatic retransmission the arbitration
+// lost flag of a mailbox stays set until its frame is sent.
+void ODriveCAN::on_tx_interrupt() {
+    uint32_t tsr = handle_->Instance->TSR;
+    n_arbitration_lost_ += ((tsr & CAN_TSR_RQCP0) && (tsr & CAN_TSR_ALST0)) ? 1 : 0;
+    n_arbitration_lost_ += ((tsr & CAN_TSR_RQCP1) && (tsr & CAN_TSR_ALST1)) ? 1 : 0;
+    n_arbitration_lost_ += ((tsr & CAN_TSR_RQCP2) && (tsr & CAN_TSR_ALST2)) ? 1 : 0;
+}
+
+// Called by the RX FIFO 0 interrupt to measure the latency of the server thread
+void ODriveCAN::on_rx_pending() {
+    if (!rx_pending_) {
+        rx_pending_cyccnt_ = DWT->CYCCNT;
+        rx_pending_ = true;
+    }
+}
+
 // Set one of only a few common baud rates.  CAN doesn't do arbitrary baud rates well due to the time-quanta issue.
 // 21 TQ allows for easy sampling at exactly 80% (recommended by Vector Informatik GmbH for high reliability systems)
 // Conveniently, the CAN peripheral's 42MHz clock lets us easily create 21TQs for all common baud rates
@@ -169,7 +346,7 @@ void ODriveCAN::reinit_can() {
     HAL_CAN_Init(handle_);
     auto status = HAL_CAN_Start(handle_);
     if (status == HAL_OK)
-        status = HAL_CAN_ActivateNotification(handle_, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
+        status = HAL_CAN_ActivateNotification(handle_, CAN_NOTIFICATIONS);
 }
 
 void ODriveCAN::set_error(Error error) {
@@ -184,35 +361,77 @@ void ODriveCAN::send_cyclic(Axis &axis) {
         case PROTOCOL_SIMPLE:
             CANSimple::send_cyclic(axis);
             break;
+        case PROTOCOL_CAN_OPEN:
+            CANopen::send_cyclic(axis);
+            break;
     }
 }
 
 void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) {
-    HAL_CAN_DeactivateNotification(hcan, CAN_IT_TX_MAILBOX_EMPTY);
-    osSemaphoreRelease(sem_can);
+    odCAN->n_tx_frames_++;
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX0, true);
+    odCAN->process_tx_queue();
 }
 void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) {
-    HAL_CAN_DeactivateNotification(hcan, CAN_IT_TX_MAILBOX_EMPTY);
-    osSemaphoreRelease(sem_can);
+    odCAN->n_tx_frames_++;
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX1, true);
+    odCAN->process_tx_queue();
 }
 void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) {
-    HAL_CAN_DeactivateNotification(hcan, CAN_IT_TX_MAILBOX_EMPTY);
-    osSemaphoreRelease(sem_can);
+    odCAN->n_tx_frames_++;
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX2, true);
+    odCAN->process_tx_queue();
+}
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan) {
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX0, false);
+    odCAN->process_tx_queue();
+}
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan) {
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX1, false);
+    odCAN->process_tx_queue();
+}
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan) {
+    odCAN->time_sync_.on_tx_complete(CAN_TX_MAILBOX2, false);
+    odCAN->process_tx_queue();
 }
-void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan) {}
-void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan) {}
-void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan) {}
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+    odCAN->on_rx_pending();
     HAL_CAN_DeactivateNotification(hcan, CAN_IT_RX_FIFO0_MSG_PENDING);
     osSemaphoreRelease(sem_can);
 }
 void HAL_CAN_RxFifo0FullCallback(CAN_HandleTypeDef *hcan) {
     // osSemaphoreRelease(sem_can);
 }
-void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) {}
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+    uint32_t cyccnt = DWT->CYCCNT;
+    while (HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO1) > 0) {
+        CAN_RxHeaderTypeDef header;
+        can_Message_t rxmsg;
+        if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, rxmsg.buf) != HAL_OK)
+            break;
+        rxmsg.isExt = header.IDE;
+        rxmsg.id = rxmsg.isExt ? header.ExtId : header.StdId;
+        rxmsg.len = header.DLC;
+        rxmsg.rtr = header.RTR;
+        odCAN->n_rx_frames_++;
+        odCAN->time_sync_.handle_can_message(rxmsg, cyccnt);
+    }
+}
 void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan) {}
 void HAL_CAN_SleepCallback(CAN_HandleTypeDef *hcan) {}
 void HAL_CAN_WakeUpFromRxMsgCallback(CAN_HandleTypeDef *hcan) {}
 void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) {
+    if (hcan->ErrorCode & (HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1))
+        odCAN->n_rx_overruns_++;
+    if (hcan->ErrorCode & (HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | HAL_CAN_ERROR_ACK
+                         | HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD | HAL_CAN_ERROR_CRC))
+        odCAN->n_bus_errors_++;
+    if (hcan->ErrorCode & HAL_CAN_ERROR_BOF)
+        odCAN->n_bus_off_++;
     HAL_CAN_ResetError(hcan);
 }
+
+// Called by CAN1_TX_IRQHandler() before the HAL
+extern "C" void can_tx_irq_handler(CAN_HandleTypeDef *hcan) {
+    odCAN->on_tx_interrupt();
+}
@@ -5,9 +5,11 @@
 #include "fibre/protocol.hpp"
 #include "odrive_main.h"
 #include "can_helpers.hpp"
+#include "time_sync.hpp"
 
 #define CAN_CLK_HZ (42000000)
 #define CAN_CLK_MHZ (42)
+#define CAN_TX_QUEUE_LENGTH 8 // per priority
 
 // Anonymous enum for defining the most common CAN baud rates
 enum {
@@ -23,6 +25,24 @@ class ODriveCAN : public ODriveIntf::CanIntf {
     struct Config_t {
         uint32_t baud_rate = CAN_BAUD_250K;
         Protocol protocol = PROTOCOL_SIMPLE;
+        uint32_t sync_id = 0x080;
+        TimeSync::Config_t time_sync;
+
+        // Combined frames of CAN Simple (both axes in one frame)
+        uint32_t combined_feedback_rate_ms = 0; // 0 to disable
+        float combined_pos_scale = 1.0f / 65536.0f; // [turn] per LSB of the int32 positions
+        float combined_vel_scale = 0.001f; // [turn/s] per LSB
+        float combined_torque_scale = 0.001f; // [Nm] per LSB
+        float combined_current_scale = 0.01f; // [A] per LSB
+    };
+
+    // Queued frames go out in this order. Responses always get a mailbox,
+    // the other priorities only use two of the three.
+    enum TxPriority {
+        TX_PRIORITY_RESPONSE = 0,
+        TX_PRIORITY_CYCLIC = 1,
+        TX_PRIORITY_HEARTBEAT = 2,
+        TX_PRIORITY_COUNT
     };
 
     ODriveCAN(ODriveCAN::Config_t &config, CAN_HandleTypeDef *handle);
@@ -31,26 +51,74 @@ class ODriveCAN : public ODriveIntf::CanIntf {
     osThreadId thread_id_;
     const uint32_t stack_size_ = 1024; // Bytes
     Error error_ = ERROR_NONE;
+    uint32_t n_tx_dropped_ = 0; // frames that didn't fit into the TX queue
+    uint32_t n_rx_overruns_ = 0; // frames lost because the RX FIFO was full
+
+    // Bus statistics
+    uint32_t n_rx_frames_ = 0;
+    uint32_t n_tx_frames_ = 0; // successfully sent
+    float rx_rate_ = 0.0f; // [frames/s] over the last second
+    float tx_rate_ = 0.0f; // [frames/s] over the last second
+    uint32_t n_bus_errors_ = 0; // stuff, form, ACK, bit and CRC errors seen by this node
+    uint32_t n_bus_off_ = 0;
+    uint32_t n_arbitration_lost_ = 0; // sent frames that lost the arbitration at least once
+    uint32_t tx_queue_high_water_ = 0; // largest number of frames in a TX queue, write 0 to reset
+    float rx_latency_ = 0.0f; // [us] from the RX interrupt to the handler
+    float max_rx_latency_ = 0.0f; // [us] write 0 to reset
 
     volatile bool thread_id_valid_ = false;
     bool start_can_server();
     void can_server_thread();
     void send_cyclic(Axis& axis);
     void reinit_can();
+    void update_filters();
+    [[noreturn]] void enter_update_mode(uint32_t status_id, bool status_is_extended);
 
     void set_error(Error error);
 
     // I/O Functions
     uint32_t available();
-    int32_t write(can_Message_t &txmsg);
+    int32_t write(can_Message_t &txmsg, TxPriority priority = TX_PRIORITY_RESPONSE);
+    void process_tx_queue();
     bool read(can_Message_t &rxmsg);
+    uint32_t get_command_count(uint32_t cmd_id);
+    uint32_t get_tx_error_counter() { return (handle_->Instance->ESR & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos; }
+    uint32_t get_rx_error_counter() { return (handle_->Instance->ESR & CAN_ESR_REC) >> CAN_ESR_REC_Pos; }
+    void on_tx_interrupt();
+    void on_rx_pending();
 
     ODriveCAN::Config_t &config_;
+    TimeSync time_sync_;
 
 private:
     CAN_HandleTypeDef *handle_ = nullptr;
 
+    // The CAN configuration of the axes that the filter banks are set up for
+    struct {
+        uint32_t node_id;
+        bool is_extended;
+    } filters_[AXIS_COUNT];
+    Protocol filter_protocol_ = PROTOCOL_SIMPLE;
+    uint32_t sync_filter_id_ = 0;
+    bool sync_filter_enabled_ = false;
+    uint32_t time_sync_filter_id_ = 0;
+    bool time_sync_filter_enabled_ = false;
+    bool filters_valid_ = false;
+
+    struct TxQueue {
+        can_Message_t messages[CAN_TX_QUEUE_LENGTH];
+        size_t head = 0; // index of the oldest frame
+        size_t count = 0;
+    } tx_queues_[TX_PRIORITY_COUNT];
+
     void set_baud_rate(uint32_t baudRate);
+    void update_stats();
+
+    volatile uint32_t rx_pending_cyccnt_ = 0;
+    volatile bool rx_pending_ = false;
+    uint32_t stats_time_ = 0; // [ms]
+    uint32_t stats_rx_frames_ = 0;
+    uint32_t stats_tx_frames_ = 0;
 };
 
 #endif  // __INTERFACE_CAN_HPP
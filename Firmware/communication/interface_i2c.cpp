@@ -1,18 +1,37 @@
-
 #include "interface_i2c.h"
 #include "fibre/protocol.hpp"
 
+#include <Drivers/STM32/stm32_system.h>
+
 #include <i2c.h>
+#include <cmsis_os.h>
 
 #define I2C_RX_BUFFER_SIZE 128
 #define I2C_RX_BUFFER_PREAMBLE_SIZE   4
 #define I2C_TX_BUFFER_SIZE 128
+#define I2C_SIGNAL_REQUEST 0x0001
 
 I2CStats_t i2c_stats_;
 
+osThreadId i2c_thread = 0;
+const uint32_t stack_size_i2c_thread = 2048; // Bytes
+
 static uint8_t i2c_rx_buffer[I2C_RX_BUFFER_PREAMBLE_SIZE + I2C_RX_BUFFER_SIZE];
 static uint8_t i2c_tx_buffer[I2C_TX_BUFFER_SIZE];
 
+// With DMA, a complete write transaction is copied here and handed to the
+// server thread, so the next transaction can be received while it runs.
+static uint8_t i2c_request_buffer[I2C_RX_BUFFER_PREAMBLE_SIZE + I2C_RX_BUFFER_SIZE];
+static volatile size_t i2c_request_length = 0; // 0 if no request is pending
+
+enum I2CState {
+    I2C_STATE_IDLE,
+    I2C_STATE_RX,
+    I2C_STATE_TX,
+    I2C_STATE_TX_WAITING, // read started while a request was pending, SCL is stretched
+};
+static volatile I2CState i2c_state = I2C_STATE_IDLE;
+
 class I2CSender : public PacketSink {
 public:
     int process_packet(const uint8_t* buffer, size_t length) {
@@ -24,24 +43,157 @@ public:
 } i2c1_packet_output;
 BidirectionalPacketBasedChannel i2c1_channel(i2c1_packet_output);
 
-void start_i2c_server() {
-    // CAN H = SDA
-    // CAN L = SCL
-    HAL_I2C_EnableListen_IT(&hi2c1);
+// Turns a received I2C write into a fibre request and processes it. The
+// request's response ends up in i2c_tx_buffer.
+static void i2c_process_request(uint8_t* buf, size_t received) {
+    i2c_stats_.rx_cnt++;
+
+    write_le<uint16_t>(0, buf); // hallucinate seq-no (not needed for I2C)
+    buf[2] = buf[4]; // endpoint-id = I2C register address
+    buf[3] = buf[5] | 0x80; // MSB must be 1
+    size_t expected_bytes = (TX_BUF_SIZE - 2) < I2C_TX_BUFFER_SIZE ? (TX_BUF_SIZE - 2) : I2C_TX_BUFFER_SIZE;
+    write_le<uint16_t>(expected_bytes, buf + 4); // hallucinate maximum number of expected response bytes
+
+    i2c1_channel.process_packet(buf, received);
 }
 
-void i2c_handle_packet(I2C_HandleTypeDef *hi2c) {
-    size_t received = sizeof(i2c_rx_buffer) - hi2c->XferCount;
+
+/* DMA mode ------------------------------------------------------------------*/
+
+// The HAL version in this tree has no slave DMA listen mode, so the
+// peripheral is driven directly: the address match and stop events run in
+// the event interrupt and the data bytes are moved by the DMA.
+
+static void i2c_start_rx(I2C_HandleTypeDef* hi2c) {
+    HAL_DMA_Abort(hi2c->hdmarx);
+    HAL_DMA_Start(hi2c->hdmarx, (uint32_t)&hi2c->Instance->DR,
+                  (uint32_t)(i2c_rx_buffer + I2C_RX_BUFFER_PREAMBLE_SIZE), I2C_RX_BUFFER_SIZE);
+    i2c_state = I2C_STATE_RX;
+}
+
+static void i2c_finish_rx(I2C_HandleTypeDef* hi2c) {
+    size_t received = sizeof(i2c_rx_buffer) - __HAL_DMA_GET_COUNTER(hi2c->hdmarx);
+    HAL_DMA_Abort(hi2c->hdmarx);
+    i2c_state = I2C_STATE_IDLE;
+
     if (received > I2C_RX_BUFFER_PREAMBLE_SIZE) {
-        i2c_stats_.rx_cnt++;
-        
-        write_le<uint16_t>(0, i2c_rx_buffer); // hallucinate seq-no (not needed for I2C)
-        i2c_rx_buffer[2] = i2c_rx_buffer[4]; // endpoint-id = I2C register address
-        i2c_rx_buffer[3] = i2c_rx_buffer[5] | 0x80; // MSB must be 1
-        size_t expected_bytes = (TX_BUF_SIZE - 2) < I2C_TX_BUFFER_SIZE ? (TX_BUF_SIZE - 2) : I2C_TX_BUFFER_SIZE;
-        write_le<uint16_t>(expected_bytes, i2c_rx_buffer + 4); // hallucinate maximum number of expected response bytes
+        if (i2c_request_length) {
+            i2c_stats_.error_cnt++; // the previous request is still being processed
+            return;
+        }
+        memcpy(i2c_request_buffer, i2c_rx_buffer, received);
+        i2c_request_length = received;
+        osSignalSet(i2c_thread, I2C_SIGNAL_REQUEST);
+    }
+}
+
+static void i2c_start_tx(I2C_HandleTypeDef* hi2c) {
+    HAL_DMA_Abort(hi2c->hdmatx);
+    HAL_DMA_Start(hi2c->hdmatx, (uint32_t)i2c_tx_buffer,
+                  (uint32_t)&hi2c->Instance->DR, I2C_TX_BUFFER_SIZE);
+    i2c_state = I2C_STATE_TX;
+}
+
+static void i2c_stop_tx(I2C_HandleTypeDef* hi2c) {
+    HAL_DMA_Abort(hi2c->hdmatx);
+    i2c_state = I2C_STATE_IDLE;
+}
+
+static void i2c_server_thread(void* ctx) {
+    I2C_HandleTypeDef* hi2c = (I2C_HandleTypeDef*)ctx;
+
+    for (;;) {
+        osSignalWait(I2C_SIGNAL_REQUEST, osWaitForever);
+        if (!i2c_request_length)
+            continue;
+
+        i2c_process_request(i2c_request_buffer, i2c_request_length);
+
+        CRITICAL_SECTION() {
+            i2c_request_length = 0;
+            if (i2c_state == I2C_STATE_TX_WAITING) {
+                // The master is already reading, release SCL
+                i2c_start_tx(hi2c);
+            }
+            hi2c->Instance->CR2 |= I2C_CR2_ITEVTEN;
+        }
+    }
+}
+
+static void i2c_dma_ev_irq_handler(I2C_HandleTypeDef* hi2c) {
+    I2C_TypeDef* i2c = hi2c->Instance;
+    uint32_t sr1 = i2c->SR1;
+
+    if (sr1 & I2C_SR1_ADDR) {
+        i2c_stats_.addr_match_cnt++;
 
-        i2c1_channel.process_packet(i2c_rx_buffer, received);
+        // A repeated start ends the previous transfer
+        if (i2c_state == I2C_STATE_RX)
+            i2c_finish_rx(hi2c);
+        else if (i2c_state == I2C_STATE_TX)
+            i2c_stop_tx(hi2c);
+
+        uint32_t sr2 = i2c->SR2; // reading SR1 and SR2 clears ADDR
+        if (sr2 & I2C_SR2_TRA) {
+            if (i2c_request_length) {
+                // The response is not ready yet. The slave stretches SCL
+                // until the first byte is written, so the thread starts the
+                // transfer once it is done. The event interrupt is masked
+                // until then because BTF stays set.
+                i2c_state = I2C_STATE_TX_WAITING;
+                i2c->CR2 &= ~I2C_CR2_ITEVTEN;
+            } else {
+                i2c_start_tx(hi2c);
+            }
+        } else {
+            i2c_start_rx(hi2c);
+        }
+    } else if (sr1 & I2C_SR1_STOPF) {
+        __HAL_I2C_CLEAR_STOPFLAG(hi2c);
+        if (i2c_state == I2C_STATE_RX)
+            i2c_finish_rx(hi2c);
+        else if (i2c_state == I2C_STATE_TX)
+            i2c_stop_tx(hi2c);
+    } else if (sr1 & I2C_SR1_BTF) {
+        // The master transfers more than the buffers hold
+        if (sr1 & I2C_SR1_TXE)
+            i2c->DR = 0;
+        else
+            (void)i2c->DR;
+    }
+}
+
+static void i2c_dma_er_irq_handler(I2C_HandleTypeDef* hi2c) {
+    uint32_t sr1 = hi2c->Instance->SR1;
+
+    // The master acknowledges the end of a read with a NACK
+    if (sr1 & I2C_SR1_AF) {
+        __HAL_I2C_CLEAR_FLAG(hi2c, I2C_FLAG_AF);
+        if (i2c_state == I2C_STATE_TX)
+            i2c_stop_tx(hi2c);
+    }
+
+    if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR)) {
+        __HAL_I2C_CLEAR_FLAG(hi2c, I2C_FLAG_BERR);
+        __HAL_I2C_CLEAR_FLAG(hi2c, I2C_FLAG_ARLO);
+        __HAL_I2C_CLEAR_FLAG(hi2c, I2C_FLAG_OVR);
+        HAL_DMA_Abort(hi2c->hdmarx);
+        HAL_DMA_Abort(hi2c->hdmatx);
+        i2c_stats_.error_cnt += 1;
+        i2c_state = I2C_STATE_IDLE;
+    }
+}
+
+
+/* Interrupt mode ------------------------------------------------------------*/
+
+// Used when the DMA streams are taken by other peripherals. The request is
+// processed in the interrupt of the next address match or stop condition.
+
+static void i2c_handle_packet(I2C_HandleTypeDef *hi2c) {
+    size_t received = sizeof(i2c_rx_buffer) - hi2c->XferCount;
+    if (received > I2C_RX_BUFFER_PREAMBLE_SIZE) {
+        i2c_process_request(i2c_rx_buffer, received);
 
         // reset receive buffer
         hi2c->pBuffPtr = I2C_RX_BUFFER_PREAMBLE_SIZE + i2c_rx_buffer;
@@ -62,7 +214,7 @@ void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c) {
 
 void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, uint16_t AddrMatchCode) {
     i2c_stats_.addr_match_cnt += 1;
-    
+
     i2c_handle_packet(hi2c);
 
     if (TransferDirection == I2C_DIRECTION_TRANSMIT) {
@@ -84,3 +236,33 @@ void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
     // Continue listening
     HAL_I2C_EnableListen_IT(hi2c);
 }
+
+
+void start_i2c_server() {
+    // CAN H = SDA
+    // CAN L = SCL
+    if (!hi2c1.hdmarx) {
+        HAL_I2C_EnableListen_IT(&hi2c1);
+        return;
+    }
+
+    osThreadDef(i2c_server_thread_def, i2c_server_thread, osPriorityNormal, 0, stack_size_i2c_thread / sizeof(StackType_t));
+    i2c_thread = osThreadCreate(osThread(i2c_server_thread_def), &hi2c1);
+
+    hi2c1.Instance->CR1 |= I2C_CR1_ACK;
+    hi2c1.Instance->CR2 |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN;
+}
+
+void i2c_ev_irq_handler(I2C_HandleTypeDef* hi2c) {
+    if (hi2c->hdmarx)
+        i2c_dma_ev_irq_handler(hi2c);
+    else
+        HAL_I2C_EV_IRQHandler(hi2c);
+}
+
+void i2c_er_irq_handler(I2C_HandleTypeDef* hi2c) {
+    if (hi2c->hdmarx)
+        i2c_dma_er_irq_handler(hi2c);
+    else
+        HAL_I2C_ER_IRQHandler(hi2c);
+}
@@ -2,13 +2,20 @@
 #define __INTERFACE_I2C_HPP
 
 #ifdef __cplusplus
+#include "fibre/protocol.hpp"
+extern BidirectionalPacketBasedChannel i2c1_channel;
+
 extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <cmsis_os.h>
+#include <i2c.h>
 
 struct I2CStats_t {
     uint8_t addr;
+    bool dma; // transfers use DMA and the requests are processed in a thread
     uint32_t addr_match_cnt;
     uint32_t rx_cnt;
     uint32_t error_cnt;
@@ -16,7 +23,12 @@ struct I2CStats_t {
 
 extern I2CStats_t i2c_stats_;
 
+extern osThreadId i2c_thread;
+extern const uint32_t stack_size_i2c_thread;
+
 void start_i2c_server(void);
+void i2c_ev_irq_handler(I2C_HandleTypeDef* hi2c);
+void i2c_er_irq_handler(I2C_HandleTypeDef* hi2c);
 
 #ifdef __cplusplus
 }
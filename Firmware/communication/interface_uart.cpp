@@ -4,17 +4,20 @@
 #include "ascii_protocol.hpp"
 
 #include <MotorControl/utils.hpp>
+#include <Drivers/STM32/stm32_system.h>
 
 #include <fibre/protocol.hpp>
 #include <usart.h>
 #include <cmsis_os.h>
 #include <freertos_vars.h>
 
-#define UART_TX_BUFFER_SIZE 64
-#define UART_RX_BUFFER_SIZE 64
+#define UART_TX_BUFFER_SIZE 512 // ring buffer
+#define UART_RX_BUFFER_SIZE 64 // see STREAM_PIPELINE_BYTES in fibre/python/fibre/protocol.py before reducing this
+#define UART_SIGNAL_RX 0x0001
 
-// DMA open loop continous circular buffer
-// 1ms delay periodic, chase DMA ptr around
+// DMA continous circular buffer. The server thread chases the DMA ptr around
+// when it is woken up by the idle line, half transfer or transfer complete
+// interrupt.
 static uint8_t dma_rx_buffer[UART_RX_BUFFER_SIZE];
 static uint32_t dma_last_rcv_idx;
 
@@ -22,21 +25,45 @@ osThreadId uart_thread = 0;
 static UART_HandleTypeDef* huart_ = nullptr;
 const uint32_t stack_size_uart_thread = 4096;  // Bytes
 
+// TX ring buffer. The DMA is restarted from the completion interrupt as long
+// as there is data, so the line stays busy while the writer keeps filling it.
+static uint8_t tx_buf[UART_TX_BUFFER_SIZE];
+static volatile size_t tx_head = 0; // total number of bytes queued
+static volatile size_t tx_tail = 0; // total number of bytes sent
+static volatile size_t tx_dma_len = 0; // size of the running DMA transfer, 0 if idle
+
+// Starts a DMA transfer for the longest contiguous block of queued data.
+// Must be called from a critical section or from the completion interrupt.
+static void uart_start_tx() {
+    size_t pending = tx_head - tx_tail;
+    if (tx_dma_len || !pending)
+        return;
+    size_t offset = tx_tail % UART_TX_BUFFER_SIZE;
+    size_t chunk = std::min(pending, UART_TX_BUFFER_SIZE - offset);
+    if (HAL_UART_Transmit_DMA(huart_, tx_buf + offset, chunk) == HAL_OK)
+        tx_dma_len = chunk;
+}
 
 class UARTSender : public StreamSink {
 public:
+    // Queues the bytes and returns as soon as they fit into the ring buffer.
+    // Like before, only one thread may write at a time.
     int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
-        // Loop to ensure all bytes get sent
         while (length) {
-            size_t chunk = length < UART_TX_BUFFER_SIZE ? length : UART_TX_BUFFER_SIZE;
-            // wait for USB interface to become ready
-            // TODO: implement ring buffer to get a more continuous stream of data
-            if (osSemaphoreWait(sem_uart_dma, PROTOCOL_SERVER_TIMEOUT_MS) != osOK)
-                return -1;
-            // transmit chunk
-            memcpy(tx_buf_, buffer, chunk);
-            if (HAL_UART_Transmit_DMA(huart_, tx_buf_, chunk) != HAL_OK)
-                return -1;
+            size_t free_space = UART_TX_BUFFER_SIZE - (tx_head - tx_tail);
+            if (!free_space) {
+                // wait for the running DMA transfer to free up space
+                if (osSemaphoreWait(sem_uart_dma, PROTOCOL_SERVER_TIMEOUT_MS) != osOK)
+                    return -1;
+                continue;
+            }
+            size_t offset = tx_head % UART_TX_BUFFER_SIZE;
+            size_t chunk = std::min({length, free_space, UART_TX_BUFFER_SIZE - offset});
+            memcpy(tx_buf + offset, buffer, chunk);
+            CRITICAL_SECTION() {
+                tx_head += chunk;
+                uart_start_tx();
+            }
             buffer += chunk;
             length -= chunk;
             if (processed_bytes)
@@ -46,14 +73,14 @@ public:
     }
 
     size_t get_free_space() { return SIZE_MAX; }
-private:
-    uint8_t tx_buf_[UART_TX_BUFFER_SIZE];
 } uart_stream_output;
 StreamSink* uart_stream_output_ptr = &uart_stream_output;
 
 StreamBasedPacketSink uart_packet_output(uart_stream_output);
-BidirectionalPacketBasedChannel uart_channel(uart_packet_output);
+static uint8_t uart_response_buf[STREAM_MAX_PACKET_SIZE];
+BidirectionalPacketBasedChannel uart_channel(uart_packet_output, uart_response_buf);
 StreamToPacketSegmenter uart_stream_input(uart_channel);
+static AsciiProtocol uart_ascii_protocol(uart_stream_output, Axis::WATCHDOG_CHANNEL_UART);
 
 static void uart_server_thread(void * ctx) {
     (void) ctx;
@@ -64,7 +91,16 @@ static void uart_server_thread(void * ctx) {
             HAL_UART_AbortReceive(huart_);
             HAL_UART_Receive_DMA(huart_, dma_rx_buffer, sizeof(dma_rx_buffer));
             dma_last_rcv_idx = 0;
+            __HAL_UART_ENABLE_IT(huart_, UART_IT_IDLE);
+        }
+        // Resend the last TX chunk if an error aborted its DMA transfer
+        CRITICAL_SECTION() {
+            if (tx_dma_len && huart_->gState == HAL_UART_STATE_READY) {
+                tx_dma_len = 0;
+                uart_start_tx();
+            }
         }
+
         // Fetch the circular buffer "write pointer", where it would write next
         uint32_t new_rcv_idx = UART_RX_BUFFER_SIZE - huart_->hdmarx->Instance->NDTR;
         if (new_rcv_idx > UART_RX_BUFFER_SIZE) { // defensive programming
@@ -75,23 +111,28 @@ static void uart_server_thread(void * ctx) {
         if (new_rcv_idx < dma_last_rcv_idx) {
             uart_stream_input.process_bytes(dma_rx_buffer + dma_last_rcv_idx,
                     UART_RX_BUFFER_SIZE - dma_last_rcv_idx, nullptr); // TODO: use process_all
-            ASCII_protocol_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
-                    UART_RX_BUFFER_SIZE - dma_last_rcv_idx, uart_stream_output);
+            uart_ascii_protocol.parse_stream(dma_rx_buffer + dma_last_rcv_idx,
+                    UART_RX_BUFFER_SIZE - dma_last_rcv_idx);
             dma_last_rcv_idx = 0;
         }
         if (new_rcv_idx > dma_last_rcv_idx) {
             uart_stream_input.process_bytes(dma_rx_buffer + dma_last_rcv_idx,
                     new_rcv_idx - dma_last_rcv_idx, nullptr); // TODO: use process_all
-            ASCII_protocol_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
-                    new_rcv_idx - dma_last_rcv_idx, uart_stream_output);
+            uart_ascii_protocol.parse_stream(dma_rx_buffer + dma_last_rcv_idx,
+                    new_rcv_idx - dma_last_rcv_idx);
             dma_last_rcv_idx = new_rcv_idx;
         }
 
-        // The thread is woken up by the control loop at 8kHz. This should be
-        // enough for most applications.
-        // At 1Mbaud/s that corresponds to at most 12.5 bytes which can arrive
-        // during the sleep period.
-        osThreadSuspend(nullptr);
+        uart_channel.publish(HAL_GetTick());
+        uart_ascii_protocol.publish(HAL_GetTick());
+
+        // Sleep until the UART interrupts report received data or an error.
+        // The idle line interrupt fires one character time after the end of a
+        // command, the half and full transfer interrupts of the DMA make sure
+        // that the circular buffer doesn't overflow during longer bursts.
+        // Publishing needs a wakeup every millisecond.
+        bool is_publishing = uart_channel.has_subscriptions() || uart_ascii_protocol.is_streaming();
+        osSignalWait(UART_SIGNAL_RX, is_publishing ? 1 : osWaitForever);
     }
 }
 
@@ -104,18 +145,48 @@ void start_uart_server(UART_HandleTypeDef* huart) {
     // data out of the circular buffer into a parse buffer, controlled by a state machine
     HAL_UART_Receive_DMA(huart_, dma_rx_buffer, sizeof(dma_rx_buffer));
     dma_last_rcv_idx = 0;
+    __HAL_UART_ENABLE_IT(huart_, UART_IT_IDLE);
 
     // Start UART communication thread
     osThreadDef(uart_server_thread_def, uart_server_thread, osPriorityNormal, 0, stack_size_uart_thread / sizeof(StackType_t) /* the ascii protocol needs considerable stack space */);
     uart_thread = osThreadCreate(osThread(uart_server_thread_def), NULL);
 }
 
-void uart_poll() {
+static void uart_wake_thread() {
     if (uart_thread) { // the thread is only started if UART is enabled
-        osThreadResume(uart_thread);
+        osSignalSet(uart_thread, UART_SIGNAL_RX);
+    }
+}
+
+// Called from the UART interrupt handlers, before the HAL handler
+void uart_irq_handler(UART_HandleTypeDef* huart) {
+    if (huart == huart_ && __HAL_UART_GET_FLAG(huart, UART_FLAG_IDLE)) {
+        __HAL_UART_CLEAR_IDLEFLAG(huart);
+        uart_wake_thread();
     }
 }
 
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef* huart) {
+    if (huart == huart_)
+        uart_wake_thread();
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart) {
+    if (huart == huart_)
+        uart_wake_thread();
+}
+
+// The HAL aborts the DMA transfers on errors, the thread restarts them
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart) {
+    if (huart == huart_)
+        uart_wake_thread();
+}
+
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart) {
+    if (huart != huart_)
+        return;
+    tx_tail += tx_dma_len;
+    tx_dma_len = 0;
+    uart_start_tx();
     osSemaphoreRelease(sem_uart_dma);
 }
@@ -4,6 +4,7 @@
 #ifdef __cplusplus
 #include "fibre/protocol.hpp"
 extern StreamSink* uart_stream_output_ptr;
+extern BidirectionalPacketBasedChannel uart_channel;
 
 extern "C" {
 #endif
@@ -15,7 +16,7 @@ extern osThreadId uart_thread;
 extern const uint32_t stack_size_uart_thread;
 
 void start_uart_server(UART_HandleTypeDef* huart);
-void uart_poll(void);
+void uart_irq_handler(UART_HandleTypeDef* huart);
 
 #ifdef __cplusplus
 }
@@ -26,7 +26,8 @@ public:
         // cannot send partial packets
         if (length > USB_TX_DATA_SIZE)
             return -1;
-        // wait for USB interface to become ready
+        // wait for a free TX buffer of the endpoint. The packet is copied
+        // there and sent as soon as the previous one is through.
         if (osSemaphoreWait(sem_usb_tx_, PROTOCOL_SERVER_TIMEOUT_MS) != osOK) {
             // If the host resets the device it might be that the TX-complete handler is never called
             // and the sem_usb_tx_ semaphore is never released. To handle this we just override the
@@ -50,9 +51,13 @@ private:
     const osSemaphoreId& sem_usb_tx_;
 };
 
-// Note we could have independent semaphores here to allow concurrent transmission
-USBSender usb_packet_output_cdc(CDC_OUT_EP, sem_usb_tx);
-USBSender usb_packet_output_native(ODRIVE_OUT_EP, sem_usb_tx);
+// Independent semaphores so that ASCII traffic on the CDC interface doesn't
+// hold up the native interface
+USBSender usb_packet_output_cdc(CDC_OUT_EP, sem_usb_tx_cdc);
+USBSender usb_packet_output_native(ODRIVE_OUT_EP, sem_usb_tx_native);
+
+// Used to send unsolicited packets (telemetry) on the native interface
+PacketSink* usb_native_output_ptr = &usb_packet_output_native;
 
 class TreatPacketSinkAsStreamSink : public StreamSink {
 public:
@@ -79,11 +84,14 @@ private:
 // TODO: less spaghetti code
 StreamSink* usb_stream_output_ptr = &usb_stream_output;
 
+static AsciiProtocol usb_ascii_protocol(usb_stream_output, Axis::WATCHDOG_CHANNEL_USB);
+
 #if defined(USB_PROTOCOL_NATIVE)
 BidirectionalPacketBasedChannel usb_channel(usb_packet_output_native);
 #elif defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
 StreamBasedPacketSink usb_packetized_output(usb_stream_output);
-BidirectionalPacketBasedChannel usb_channel(usb_packetized_output);
+static uint8_t usb_response_buf[STREAM_MAX_PACKET_SIZE];
+BidirectionalPacketBasedChannel usb_channel(usb_packetized_output, usb_response_buf);
 StreamToPacketSegmenter usb_native_stream_input(usb_channel);
 #endif
 
@@ -120,7 +128,10 @@ static void usb_server_thread(void * ctx) {
     
     for (;;) {
         // const uint32_t usb_check_timeout = 1; // ms
-        osStatus sem_stat = osSemaphoreWait(sem_usb_rx, osWaitForever);
+        // Wake up every millisecond to send the subscribed properties and the
+        // periodic ASCII feedback
+        bool is_publishing = usb_channel.has_subscriptions() || usb_ascii_protocol.is_streaming();
+        osStatus sem_stat = osSemaphoreWait(sem_usb_rx, is_publishing ? 1 : osWaitForever);
         if (sem_stat == osOK) {
             usb_stats_.rx_cnt++;
 
@@ -128,8 +139,8 @@ static void usb_server_thread(void * ctx) {
             if (CDC_interface.data_pending) {
                 CDC_interface.data_pending = false;
                 if (odrv.config_.enable_ascii_protocol_on_usb) {
-                    ASCII_protocol_parse_stream(CDC_interface.rx_buf,
-                            CDC_interface.rx_len, usb_stream_output);
+                    usb_ascii_protocol.parse_stream(CDC_interface.rx_buf,
+                            CDC_interface.rx_len);
                 } else {
 #if defined(USB_PROTOCOL_NATIVE)
                     usb_channel.process_packet(CDC_interface.rx_buf, CDC_interface.rx_len);
@@ -153,6 +164,9 @@ static void usb_server_thread(void * ctx) {
                 USBD_CDC_ReceivePacket(&usb_dev_handle, ODrive_interface.out_ep);  // Allow next packet
             }
         }
+
+        usb_channel.publish(HAL_GetTick());
+        usb_ascii_protocol.publish(HAL_GetTick());
     }
 }
 
@@ -4,6 +4,10 @@
 #ifdef __cplusplus
 #include "fibre/protocol.hpp"
 extern StreamSink* usb_stream_output_ptr;
+extern PacketSink* usb_native_output_ptr;
+#if defined(USB_PROTOCOL_NATIVE) || defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
+extern BidirectionalPacketBasedChannel usb_channel;
+#endif
 
 extern "C" {
 #endif
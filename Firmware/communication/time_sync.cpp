@@ -0,0 +1,188 @@
+#include "time_sync.hpp"
+
+#include <cmath>
+#include <odrive_main.h>
+#include "interface_can.hpp"
+
+// The local clock is the DWT cycle counter, which runs on HCLK like the
+// control loop timers.
+#define TIME_SYNC_CLOCK_HZ TIM_1_8_CLOCK_HZ
+
+static int64_t ticks_to_ns(int64_t ticks) {
+    return (ticks / TIME_SYNC_CLOCK_HZ) * 1000000000LL
+         + (ticks % TIME_SYNC_CLOCK_HZ) * 1000000000LL / TIME_SYNC_CLOCK_HZ;
+}
+
+// Must be called at least once per wrap-around of the cycle counter.
+uint64_t TimeSync::get_local_ticks() {
+    uint64_t ticks;
+    CRITICAL_SECTION() {
+        uint32_t cyccnt = DWT->CYCCNT;
+        if (cyccnt < last_cyccnt_) {
+            local_ticks_high_++;
+        }
+        last_cyccnt_ = cyccnt;
+        ticks = ((uint64_t)local_ticks_high_ << 32) | cyccnt;
+    }
+    return ticks;
+}
+
+// Extends a cycle count that was sampled within the last wrap-around
+uint64_t TimeSync::to_local_ticks(uint32_t cyccnt) {
+    uint64_t now = get_local_ticks();
+    return now - (uint32_t)((uint32_t)now - cyccnt);
+}
+
+int64_t TimeSync::to_master_ns(uint64_t local_ticks) {
+    if (config_.mode != MODE_SLAVE) {
+        return ticks_to_ns(local_ticks);
+    }
+    int64_t ns;
+    CRITICAL_SECTION() {
+        int64_t dt = (int64_t)(local_ticks - anchor_local_);
+        ns = anchor_master_ + ticks_to_ns(dt)
+           + (int64_t)((float)dt * rate_ * (1e9f / (float)TIME_SYNC_CLOCK_HZ));
+    }
+    return ns;
+}
+
+uint64_t TimeSync::get_time_us() {
+    return (uint64_t)to_master_ns(get_local_ticks()) / 1000;
+}
+
+void TimeSync::update() {
+    uint64_t now = get_local_ticks();
+    bool enabled = odrv.config_.enable_can_a;
+
+    if (enabled && config_.mode == MODE_MASTER) {
+        is_synced_ = true;
+        if (follow_up_pending_) {
+            follow_up_pending_ = false;
+            send_follow_up();
+        }
+        uint64_t period = (uint64_t)config_.period_ms * (TIME_SYNC_CLOCK_HZ / 1000);
+        if (sync_mailbox_ && (now - last_sync_sent_) >= 2 * period) {
+            sync_mailbox_ = 0; // never left the mailbox, e.g. because of bus-off
+        }
+        if (!sync_mailbox_ && (now - last_sync_sent_) >= period) {
+            can_Message_t msg;
+            msg.id = config_.can_id;
+            msg.len = 1;
+            msg.buf[0] = ++sequence_;
+            odCAN->write(msg);
+            last_sync_sent_ = now;
+        }
+    } else if (enabled && config_.mode == MODE_SLAVE) {
+        CRITICAL_SECTION() {
+            if (n_samples_ && (now - last_sample_) > (uint64_t)TIME_SYNC_TIMEOUT_MS * (TIME_SYNC_CLOCK_HZ / 1000)) {
+                n_samples_ = 0;
+                is_synced_ = false;
+            }
+        }
+    } else {
+        is_synced_ = false;
+        n_samples_ = 0;
+    }
+
+    update_phase_lock();
+}
+
+// Called by ODriveCAN when a frame was put into a TX mailbox
+void TimeSync::on_tx_queued(const can_Message_t& msg, uint32_t mailbox) {
+    if (config_.mode == MODE_MASTER && !msg.isExt && msg.id == config_.can_id && msg.len == 1) {
+        sync_mailbox_ = mailbox;
+    }
+}
+
+void TimeSync::on_tx_complete(uint32_t mailbox, bool success) {
+    uint32_t cyccnt = DWT->CYCCNT;
+    if (sync_mailbox_ && mailbox == sync_mailbox_) {
+        sync_tx_cyccnt_ = cyccnt;
+        sync_mailbox_ = 0;
+        follow_up_pending_ = success;
+    }
+}
+
+void TimeSync::send_follow_up() {
+    can_Message_t msg;
+    msg.id = config_.can_id;
+    msg.len = 8;
+    msg.buf[0] = sequence_;
+    can_setSignal<uint64_t>(msg, (uint64_t)to_master_ns(to_local_ticks(sync_tx_cyccnt_)), 8, 56, true);
+    odCAN->write(msg);
+}
+
+// Runs in the RX FIFO 1 interrupt, which only receives the time frames.
+// cyccnt was sampled at the entry of the interrupt.
+void TimeSync::handle_can_message(const can_Message_t& msg, uint32_t cyccnt) {
+    if (config_.mode != MODE_SLAVE || msg.isExt || msg.id != config_.can_id) {
+        return;
+    }
+
+    if (msg.len == 1) {
+        rx_sequence_ = msg.buf[0];
+        rx_time_ = to_local_ticks(cyccnt);
+        rx_valid_ = true;
+    } else if (msg.len == 8 && rx_valid_ && msg.buf[0] == rx_sequence_) {
+        rx_valid_ = false;
+        add_sample(rx_time_, (int64_t)can_getSignal<uint64_t>(msg, 8, 56, true));
+    }
+}
+
+void TimeSync::add_sample(uint64_t local_ticks, int64_t master_ns) {
+    float err = 0.0f;
+    if (n_samples_) {
+        int64_t predicted = to_master_ns(local_ticks);
+        err = (float)(master_ns - predicted);
+        float dt = (float)ticks_to_ns((int64_t)(local_ticks - anchor_local_));
+        CRITICAL_SECTION() {
+            if (std::abs(err) > TIME_SYNC_STEP_THRESHOLD_NS || dt <= 0.0f) {
+                // Start over but keep the drift estimate
+                anchor_master_ = master_ns;
+                n_samples_ = 0;
+            } else if (n_samples_ == 1) {
+                // The first interval gives a direct estimate of the drift
+                rate_ += err / dt;
+                anchor_master_ = master_ns;
+            } else {
+                rate_ += TIME_SYNC_KI * err / dt;
+                anchor_master_ = predicted + (int64_t)(TIME_SYNC_KP * err);
+            }
+            anchor_local_ = local_ticks;
+        }
+    } else {
+        CRITICAL_SECTION() {
+            anchor_local_ = local_ticks;
+            anchor_master_ = master_ns;
+        }
+    }
+
+    n_samples_++;
+    n_syncs_++;
+    last_sample_ = local_ticks;
+    offset_error_ = err * 1e-3f;
+    drift_ = -rate_ * 1e6f;
+    is_synced_ = n_samples_ >= 3 && std::abs(err) < TIME_SYNC_LOCK_THRESHOLD_NS;
+}
+
+// Trims the period of the next control loop iteration by one timer tick per
+// PWM half-period so that the control loop ticks move towards multiples of
+// the control loop period in the synchronized time.
+void TimeSync::update_phase_lock() {
+    int32_t trim = 0;
+    if (config_.phase_lock && is_synced_) {
+        int64_t period_ns = ticks_to_ns(CONTROL_TIMER_PERIOD_TICKS);
+        int64_t phase = to_master_ns(to_local_ticks(control_tick_cyccnt)) % period_ns;
+        if (phase >= period_ns / 2) {
+            phase -= period_ns;
+        } else if (phase < -period_ns / 2) {
+            phase += period_ns;
+        }
+        phase_error_ = (float)phase * 1e-3f;
+        trim = phase > TIME_SYNC_PHASE_DEADBAND_NS ? -1
+             : phase < -TIME_SYNC_PHASE_DEADBAND_NS ? 1 : 0;
+    } else {
+        phase_error_ = 0.0f;
+    }
+    pwm_period_trim = trim;
+}
@@ -0,0 +1,92 @@
+#ifndef __TIME_SYNC_HPP
+#define __TIME_SYNC_HPP
+
+#include <autogen/interfaces.hpp>
+#include "can_helpers.hpp"
+
+#define TIME_SYNC_STEP_THRESHOLD_NS 1000000 // errors above this restart the estimation instead of slewing
+#define TIME_SYNC_LOCK_THRESHOLD_NS 10000 // is_synced is set below this error
+#define TIME_SYNC_TIMEOUT_MS 1000 // is_synced is cleared if no time was received for this long
+#define TIME_SYNC_KP 0.25f // fraction of the offset error that is corrected per sample
+#define TIME_SYNC_KI 0.05f // fraction of the offset error that is added to the drift estimate
+#define TIME_SYNC_PHASE_DEADBAND_NS 50 // the PWM period is trimmed above this phase error
+
+/**
+ * @brief Synchronizes the clocks of several ODrives on one CAN bus.
+ *
+ * The master broadcasts a SYNC frame (1 byte: sequence number) every
+ * config.period_ms. When the frame has left the bus, it sends a follow-up
+ * frame (8 bytes: sequence number and the 56-bit master time of the SYNC in
+ * ns). This way the time in the follow-up doesn't depend on how long the
+ * SYNC waited for the bus.
+ *
+ * The slaves take the local time of the SYNC when it arrives and estimate
+ * the offset and the drift of their clock against the one of the master
+ * with a PI loop on the error of each follow-up. The master time is the
+ * local time of the master.
+ *
+ * With config.phase_lock the control loop timer is trimmed by one tick per
+ * PWM half-period until the control loop ticks of all drives fall on
+ * multiples of the control loop period of the synchronized time.
+ *
+ * on_tx_complete() and handle_can_message() run in the CAN interrupts and
+ * update() after every control loop iteration.
+ */
+class TimeSync : public ODriveIntf::TimeSyncIntf {
+public:
+    struct Config_t {
+        Mode mode = MODE_DISABLED;
+        uint32_t can_id = 0x100; // the CANopen TIME ID
+        uint32_t period_ms = 100;
+        bool phase_lock = false;
+    };
+
+    TimeSync(Config_t& config) : config_(config) {}
+
+    void update();
+    void on_tx_queued(const can_Message_t& msg, uint32_t mailbox);
+    void on_tx_complete(uint32_t mailbox, bool success);
+    void handle_can_message(const can_Message_t& msg, uint32_t cyccnt);
+
+    uint64_t get_time_us();
+
+    Config_t& config_;
+    bool is_synced_ = false;
+    uint32_t n_syncs_ = 0;
+    float offset_error_ = 0.0f; // [us]
+    float drift_ = 0.0f; // [ppm]
+    float phase_error_ = 0.0f; // [us]
+
+private:
+    uint64_t get_local_ticks();
+    uint64_t to_local_ticks(uint32_t cyccnt);
+    int64_t to_master_ns(uint64_t local_ticks);
+    void add_sample(uint64_t local_ticks, int64_t master_ns);
+    void update_phase_lock();
+    void send_follow_up();
+
+    // 64-bit extension of the DWT cycle counter
+    uint32_t local_ticks_high_ = 0;
+    uint32_t last_cyccnt_ = 0;
+
+    // Clock model: master time = anchor_master_ + (local - anchor_local_) * (1 + rate_)
+    uint64_t anchor_local_ = 0; // [ticks]
+    int64_t anchor_master_ = 0; // [ns]
+    float rate_ = 0.0f;
+    uint32_t n_samples_ = 0; // since the last restart of the estimation
+    uint64_t last_sample_ = 0; // [ticks]
+
+    // Master
+    uint8_t sequence_ = 0;
+    uint64_t last_sync_sent_ = 0; // [ticks]
+    volatile uint32_t sync_mailbox_ = 0; // TX mailbox of the pending SYNC, 0 if none
+    volatile uint32_t sync_tx_cyccnt_ = 0;
+    volatile bool follow_up_pending_ = false;
+
+    // Slave
+    uint8_t rx_sequence_ = 0;
+    uint64_t rx_time_ = 0; // [ticks]
+    bool rx_valid_ = false;
+};
+
+#endif // __TIME_SYNC_HPP
@@ -0,0 +1,511 @@
+#include <fibre/client.hpp>
+#include <fibre/crc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <zlib.h>
+
+using namespace fibre;
+
+// Same limits as in the Python implementation: the request of a batch must
+// still fit into one USB packet and the response into TX_BUF_SIZE of the
+// device minus the sequence number.
+constexpr size_t BATCH_REQUEST_SIZE = 56;
+constexpr size_t BATCH_RESPONSE_SIZE = 30;
+
+constexpr size_t JSON_CHUNK_SIZE = 512;
+
+namespace {
+
+/**
+ * @brief Just enough of a JSON parser for the interface definition of a device.
+ */
+struct JsonValue {
+    enum Kind { kNull, kBool, kNumber, kString, kArray, kObject } kind = kNull;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue* get(const char* key) const {
+        for (auto& member: object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string get_string(const char* key, const char* default_value) const {
+        const JsonValue* value = get(key);
+        return (value && value->kind == kString) ? value->string : default_value;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* begin, const char* end) : pos_(begin), end_(end) {}
+
+    bool parse(JsonValue* value) {
+        return parse_value(value, 0) && (skip_whitespace(), pos_ == end_);
+    }
+
+private:
+    static constexpr int kMaxDepth = 32;
+
+    void skip_whitespace() {
+        while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r' || *pos_ == '\n')) {
+            pos_++;
+        }
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if (pos_ < end_ && *pos_ == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_literal(const char* literal) {
+        size_t length = strlen(literal);
+        if ((size_t)(end_ - pos_) < length || strncmp(pos_, literal, length)) {
+            return false;
+        }
+        pos_ += length;
+        return true;
+    }
+
+    bool parse_string(std::string* str) {
+        if (!consume('"')) {
+            return false;
+        }
+        while (pos_ < end_ && *pos_ != '"') {
+            char c = *pos_++;
+            if (c == '\\') {
+                if (pos_ == end_) {
+                    return false;
+                }
+                c = *pos_++;
+                switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u': // names are ASCII, other characters are not decoded
+                        if (end_ - pos_ < 4) {
+                            return false;
+                        }
+                        pos_ += 4;
+                        c = '?';
+                        break;
+                    default: break; // '"', '\\' and '/'
+                }
+            }
+            str->push_back(c);
+        }
+        return consume('"');
+    }
+
+    bool parse_value(JsonValue* value, int depth) {
+        skip_whitespace();
+        if (pos_ == end_ || depth > kMaxDepth) {
+            return false;
+        }
+
+        if (*pos_ == '{') {
+            value->kind = JsonValue::kObject;
+            pos_++;
+            if (consume('}')) {
+                return true;
+            }
+            do {
+                value->object.emplace_back();
+                if (!parse_string(&value->object.back().first) || !consume(':')
+                        || !parse_value(&value->object.back().second, depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume('}');
+
+        } else if (*pos_ == '[') {
+            value->kind = JsonValue::kArray;
+            pos_++;
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                value->array.emplace_back();
+                if (!parse_value(&value->array.back(), depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+
+        } else if (*pos_ == '"') {
+            value->kind = JsonValue::kString;
+            return parse_string(&value->string);
+
+        } else if (consume_literal("true")) {
+            value->kind = JsonValue::kBool;
+            value->number = 1;
+            return true;
+
+        } else if (consume_literal("false")) {
+            value->kind = JsonValue::kBool;
+            return true;
+
+        } else if (consume_literal("null")) {
+            value->kind = JsonValue::kNull;
+            return true;
+
+        } else {
+            value->kind = JsonValue::kNumber;
+            std::string str(pos_, std::find_if(pos_, end_, [](char c) {
+                return !(isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E');
+            }));
+            char* str_end;
+            value->number = strtod(str.c_str(), &str_end);
+            pos_ += str.size();
+            return !str.empty() && str_end == str.c_str() + str.size();
+        }
+    }
+
+    const char* pos_;
+    const char* end_;
+};
+
+// A page of the definition is raw deflate data without the zlib header and
+// without the end of the stream, so it is done when all input is used up.
+bool inflate_json(const std::vector<uint8_t>& compressed, std::vector<uint8_t>* json, bool raw = false) {
+    z_stream stream = {};
+    if (inflateInit2(&stream, raw ? -MAX_WBITS : MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(compressed.data());
+    stream.avail_in = compressed.size();
+
+    int result;
+    do {
+        uint8_t chunk[4096];
+        stream.next_out = chunk;
+        stream.avail_out = sizeof(chunk);
+        result = inflate(&stream, Z_NO_FLUSH);
+        json->insert(json->end(), chunk, chunk + sizeof(chunk) - stream.avail_out);
+    } while (result == Z_OK);
+
+    inflateEnd(&stream);
+    return raw ? (result == Z_BUF_ERROR && !stream.avail_in) : result == Z_STREAM_END;
+}
+
+EndpointInfo to_endpoint_info(const JsonValue& json) {
+    EndpointInfo info;
+    const JsonValue* id = json.get("id");
+    info.id = (id && id->kind == JsonValue::kNumber) ? (uint16_t)id->number : 0;
+    info.type = json.get_string("type", "");
+    std::string access = json.get_string("access", "r");
+    info.readable = access.find('r') != std::string::npos;
+    info.writable = access.find('w') != std::string::npos;
+
+    for (const char* key: {"arguments", "inputs"}) { // "arguments" is used by old firmware
+        const JsonValue* inputs = json.get(key);
+        for (size_t i = 0; inputs && i < inputs->array.size(); ++i) {
+            info.inputs.push_back(to_endpoint_info(inputs->array[i]));
+        }
+    }
+    const JsonValue* outputs = json.get("outputs");
+    for (size_t i = 0; outputs && i < outputs->array.size(); ++i) {
+        info.outputs.push_back(to_endpoint_info(outputs->array[i]));
+    }
+    return info;
+}
+
+void add_endpoints(std::map<std::string, EndpointInfo>* endpoints, const std::string& prefix, const JsonValue& members) {
+    for (const JsonValue& member: members.array) {
+        std::string path = prefix + member.get_string("name", "");
+        const JsonValue* children = member.get("members");
+        if (member.get_string("type", "") == "object" && children) {
+            add_endpoints(endpoints, path + ".", *children);
+        } else {
+            (*endpoints)[path] = to_endpoint_info(member);
+        }
+    }
+}
+
+}
+
+/**
+ * @brief Downloads the JSON definition of the device. Must be called before
+ * any other endpoint than 0 can be accessed.
+ *
+ * Returns false if the device didn't respond or the definition is broken.
+ */
+bool Client::connect() {
+    if (!negotiate_packet_size()) {
+        return false;
+    }
+
+    std::vector<uint8_t> raw_json;
+    if (!read_json(&raw_json) || raw_json.empty()) {
+        return false;
+    }
+
+    // Recent firmware stores the definition zlib compressed. The CRC is
+    // calculated over the bytes as they are sent.
+    std::vector<uint8_t> json;
+    if (raw_json[0] == 0x78) {
+        if (!inflate_json(raw_json, &json)) {
+            return false;
+        }
+    } else {
+        json = raw_json;
+    }
+
+    JsonValue root;
+    const char* text = reinterpret_cast<const char*>(json.data());
+    if (!JsonParser(text, text + json.size()).parse(&root) || root.kind != JsonValue::kArray) {
+        return false;
+    }
+
+    json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, raw_json.data(), raw_json.size());
+    endpoints_.clear();
+    add_endpoints(&endpoints_, "", root);
+    return true;
+}
+
+/**
+ * @brief Downloads only the given objects of the JSON definition, e.g.
+ * {"axis0.controller", "axis1"}. Each subtree must be an object on the first
+ * or second level. Endpoints outside of these objects can't be found
+ * afterwards.
+ *
+ * Returns false if the device doesn't respond or has no page for one of the
+ * subtrees, e.g. because its firmware predates paging. Use connect() then.
+ */
+bool Client::connect(const std::vector<std::string>& subtrees) {
+    if (!negotiate_packet_size()) {
+        return false;
+    }
+
+    // The CRC over the whole definition is the upper half of the version ID
+    uint32_t version_id = 0;
+    uint8_t version_request[4];
+    write_le<uint32_t>(0xffffffff, version_request);
+    bufptr_t version_output{reinterpret_cast<uint8_t*>(&version_id), sizeof(version_id)};
+    if (!endpoint_operation(0, version_request, &version_output) || !version_output.empty()) {
+        return false;
+    }
+
+    endpoints_.clear();
+    for (const std::string& path: subtrees) {
+        std::vector<uint8_t> request(4);
+        write_le<uint32_t>(0xfffffffd, request.data());
+        request.insert(request.end(), path.begin(), path.end());
+        uint32_t page[2];
+        bufptr_t page_output{reinterpret_cast<uint8_t*>(page), sizeof(page)};
+        if (!endpoint_operation(0, {request.data(), request.size()}, &page_output) || !page_output.empty()) {
+            return false;
+        }
+
+        std::vector<uint8_t> raw_json;
+        std::vector<uint8_t> json;
+        if (!read_json(&raw_json, page[0], page[1]) || raw_json.size() != page[1]
+                || !inflate_json(raw_json, &json, true)) {
+            return false;
+        }
+
+        JsonValue object;
+        const char* text = reinterpret_cast<const char*>(json.data());
+        if (!JsonParser(text, text + json.size()).parse(&object) || !object.get("members")) {
+            return false;
+        }
+        add_endpoints(&endpoints_, path + ".", *object.get("members"));
+    }
+
+    json_crc_ = version_id >> 16;
+    return true;
+}
+
+bool Client::negotiate_packet_size() {
+    if (transport_.is_stream_based()) {
+        // Older firmware returns an empty response
+        uint32_t max_packet_size = 0;
+        uint8_t request[4];
+        write_le<uint32_t>(0xfffffffe, request);
+        bufptr_t output{reinterpret_cast<uint8_t*>(&max_packet_size), sizeof(max_packet_size)};
+        if (!endpoint_operation(0, request, &output)) {
+            return false;
+        }
+        large_packets_ = output.empty() && max_packet_size > 127;
+    }
+    return true;
+}
+
+// Reads up to length bytes of the JSON from offset on
+bool Client::read_json(std::vector<uint8_t>* json, uint32_t offset, uint32_t length) {
+    size_t chunk_size = large_packets_ ? STREAM_MAX_PACKET_SIZE - 2 : JSON_CHUNK_SIZE;
+    while (json->size() < length) {
+        uint8_t request[4];
+        write_le<uint32_t>(offset + json->size(), request);
+        size_t end = json->size();
+        size_t n = std::min<size_t>(chunk_size, length - end);
+        json->resize(end + n);
+        bufptr_t output{json->data() + end, n};
+        if (!endpoint_operation(0, request, &output)) {
+            return false;
+        }
+        json->resize(json->size() - output.size());
+        if (json->size() == end) {
+            return true; // empty response past the end
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Carries out one endpoint operation and waits for the response.
+ *
+ * The response is written to the start of output, which is advanced past the
+ * received bytes. At most output->size() bytes are requested. Pass an empty
+ * output for writes and function calls.
+ */
+bool Client::endpoint_operation(uint16_t endpoint_id, cbufptr_t input, bufptr_t* output) {
+    size_t output_length = std::min<size_t>(output->size(), 0x7fff);
+    return transaction(endpoint_id, input, output_length, output);
+}
+
+bool Client::transaction(uint16_t endpoint_id, cbufptr_t input, size_t output_length, bufptr_t* output) {
+    if (input.size() + 8 > sizeof(tx_buf_)) {
+        return false;
+    }
+
+    seq_no_ = (seq_no_ + 1) & 0x7fff;
+    uint16_t seq_no = seq_no_ | 0x80; // keeps the packets apart from the ASCII protocol
+    size_t length = 0;
+    length += write_le<uint16_t>(seq_no, tx_buf_ + length);
+    length += write_le<uint16_t>(endpoint_id | 0x8000, tx_buf_ + length);
+    length += write_le<uint16_t>(output_length | (large_packets_ ? 0x8000 : 0), tx_buf_ + length);
+    memcpy(tx_buf_ + length, input.begin(), input.size());
+    length += input.size();
+    length += write_le<uint16_t>(endpoint_id ? json_crc_ : PROTOCOL_VERSION, tx_buf_ + length);
+
+    for (uint32_t attempt = 0; attempt < attempts_; ++attempt) {
+        if (!transport_.send_packet({tx_buf_, length})) {
+            return false;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_);
+        for (;;) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                break; // resend
+            }
+            uint32_t timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            std::optional<size_t> received = transport_.receive_packet(rx_buf_, timeout_ms);
+            if (!received.has_value()) {
+                continue; // timeout is checked above
+            } else if (*received < 2) {
+                continue;
+            }
+
+            uint16_t header;
+            read_le<uint16_t>(&header, rx_buf_);
+            cbufptr_t payload{rx_buf_ + 2, *received - 2};
+            if (!(header & 0x8000)) {
+                if (unsolicited_packet_handler_) {
+                    unsolicited_packet_handler_(header, payload);
+                }
+            } else if ((header & 0x7fff) == seq_no) {
+                size_t n_copy = std::min(payload.size(), output->size());
+                memcpy(output->begin(), payload.begin(), n_copy);
+                *output += n_copy;
+                return true;
+            }
+            // else: late response to an earlier attempt
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Carries out several endpoint operations in as few round trips as
+ * possible, in the order given.
+ *
+ * The output of each operation is advanced past the received bytes. Returns
+ * false at the first operation that fails. Devices without support for batch
+ * requests get one request per operation.
+ */
+bool Client::batch(Operation* operations, size_t count) {
+    size_t pos = 0;
+    while (pos < count) {
+        uint8_t request[BATCH_REQUEST_SIZE];
+        size_t request_length = 0;
+        size_t response_length = 1;
+        size_t end = pos;
+        while (supports_batch_ && end < count) {
+            const Operation& op = operations[end];
+            if (request_length + 4 + op.input.size() > sizeof(request)
+                    || response_length + op.output.size() > BATCH_RESPONSE_SIZE) {
+                break;
+            }
+            request_length += write_le<uint16_t>(op.endpoint_id, request + request_length);
+            request[request_length++] = op.input.size();
+            request[request_length++] = op.output.size();
+            memcpy(request + request_length, op.input.begin(), op.input.size());
+            request_length += op.input.size();
+            response_length += op.output.size();
+            end++;
+        }
+
+        if (end == pos) {
+            // Too large for a batch request
+            if (!endpoint_operation(operations[pos].endpoint_id, operations[pos].input, &operations[pos].output)) {
+                return false;
+            }
+            pos++;
+            continue;
+        }
+
+        uint8_t response[BATCH_RESPONSE_SIZE];
+        bufptr_t output{response, response_length};
+        if (!transaction(BATCH_ENDPOINT_ID, {request, request_length}, response_length, &output)) {
+            return false;
+        }
+        if (output.size() == response_length) {
+            supports_batch_ = false; // older firmware returns an empty response
+            continue;
+        }
+        size_t done = std::min<size_t>(response[0], end - pos);
+        if (done == 0) {
+            return false;
+        }
+
+        // The device may stop early, then the rest goes into the next request
+        size_t offset = 1;
+        for (size_t i = 0; i < done; ++i) {
+            Operation& op = operations[pos + i];
+            size_t n_copy = std::min(op.output.size(), response_length - output.size() - offset);
+            memcpy(op.output.begin(), response + offset, n_copy);
+            op.output += n_copy;
+            offset += n_copy;
+        }
+        pos += done;
+    }
+    return true;
+}
+
+const EndpointInfo* Client::find(const std::string& path) const {
+    auto it = endpoints_.find(path);
+    return it == endpoints_.end() ? nullptr : &it->second;
+}
+
+std::optional<Function> Client::function(const std::string& path) {
+    const EndpointInfo* info = find(path);
+    if (!info || info->type != "function") {
+        return std::nullopt;
+    }
+    return Function(*this, *info);
+}
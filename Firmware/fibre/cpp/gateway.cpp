@@ -0,0 +1,455 @@
+#include <fibre/gateway.hpp>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace fibre;
+
+#define GATEWAY_RX_BUF_LEN  1024
+#define GATEWAY_MAX_EVENTS  64
+
+template<typename T>
+static T read_value(const uint8_t* buffer) {
+    T value;
+    read_le<T>(&value, buffer);
+    return value;
+}
+static uint16_t read_u16(const uint8_t* buffer) { return read_value<uint16_t>(buffer); }
+static uint32_t read_u32(const uint8_t* buffer) { return read_value<uint32_t>(buffer); }
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief A TCP connection of a client. Received bytes are split into packets
+ * that go to the gateway, packets to the client are framed the same way.
+ */
+struct Gateway::TcpClient : PacketSink, StreamSink {
+    TcpClient(Gateway& gateway, uint64_t id, int fd, size_t device) :
+        gateway_(gateway), id_(id), fd_(fd), device_(device),
+        source_{EventSource::kTcpClient, device, this} {}
+
+    // Packets from the client
+    int process_packet(const uint8_t* buffer, size_t length) override {
+        Waiter waiter = {id_, {}, 0};
+        gateway_.handle_request(device_, waiter, buffer, length);
+        return 0;
+    }
+
+    // Bytes to the client, collected so that a packet goes out in one segment
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) override {
+        tx_buffer_.insert(tx_buffer_.end(), buffer, buffer + length);
+        if (processed_bytes)
+            *processed_bytes += length;
+        return 0;
+    }
+
+    // A client that doesn't read its responses loses them instead of stalling
+    // the other clients
+    void send_packet(const uint8_t* buffer, size_t length) {
+        tx_buffer_.clear();
+        packet_sink_.process_packet(buffer, length);
+        send(fd_, tx_buffer_.data(), tx_buffer_.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+
+    size_t get_free_space() override { return SIZE_MAX; }
+
+    Gateway& gateway_;
+    uint64_t id_;
+    int fd_;
+    size_t device_;
+    EventSource source_;
+    StreamToPacketSegmenter segmenter_{*static_cast<PacketSink*>(this)};
+    StreamBasedPacketSink packet_sink_{*static_cast<StreamSink*>(this)};
+    std::vector<uint8_t> tx_buffer_;
+};
+
+
+Gateway::Gateway() = default;
+
+Gateway::~Gateway() {
+    stop();
+    for (auto& device: devices_) {
+        device->cv.notify_all();
+        if (device->sender.joinable())
+            device->sender.join();
+        if (device->receiver.joinable())
+            device->receiver.join();
+        if (device->tcp_fd != -1)
+            close(device->tcp_fd);
+        if (device->udp_fd != -1)
+            close(device->udp_fd);
+    }
+    for (auto& client: clients_)
+        close(client.second->fd_);
+    if (epoll_fd_ != -1)
+        close(epoll_fd_);
+    if (wakeup_fd_ != -1)
+        close(wakeup_fd_);
+}
+
+bool Gateway::add_device(ClientTransport& transport, const std::string& name) {
+    Client client(transport);
+    if (!client.connect())
+        return false;
+
+    std::unique_ptr<Device> device = std::make_unique<Device>();
+    device->transport = &transport;
+    device->name = name;
+
+    // Reads are requests without input, except for endpoint 0 which takes
+    // the offset. Empty requests to functions trigger them.
+    device->coalescable_endpoints.resize(BATCH_ENDPOINT_ID);
+    device->coalescable_endpoints[0] = true;
+    auto add = [&](const EndpointInfo& info) {
+        if (info.type != "function" && info.readable && info.id < device->coalescable_endpoints.size())
+            device->coalescable_endpoints[info.id] = true;
+    };
+    for (auto& endpoint: client.endpoints()) {
+        add(endpoint.second);
+        for (auto& arg: endpoint.second.inputs)
+            add(arg);
+        for (auto& arg: endpoint.second.outputs)
+            add(arg);
+    }
+
+    devices_.push_back(std::move(device));
+    return true;
+}
+
+void Gateway::stop() {
+    running_ = false;
+    if (wakeup_fd_ != -1) {
+        uint64_t one = 1;
+        (void)!write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+
+/* Device I/O ----------------------------------------------------------------*/
+
+void Gateway::sender_thread(Device& device) {
+    std::unique_lock<std::mutex> lock(device.mutex);
+    while (running_) {
+        device.cv.wait(lock, [&] {
+            return !running_ || (!device.tx_queue.empty() && device.in_flight.size() < kPipelineWindow);
+        });
+        if (!running_)
+            break;
+        OutgoingRequest request = std::move(device.tx_queue.front());
+        device.tx_queue.pop_front();
+        if (request.expect_response)
+            device.in_flight[read_u16(request.packet.data())] = now_ms() + kRequestTimeoutMs;
+        lock.unlock();
+        if (!device.transport->send_packet({request.packet.data(), request.packet.size()})) {
+            std::lock_guard<std::mutex> guard(device.mutex);
+            device.in_flight.erase(read_u16(request.packet.data()));
+        }
+        lock.lock();
+    }
+}
+
+void Gateway::receiver_thread(Device& device) {
+    uint8_t buffer[STREAM_MAX_PACKET_SIZE];
+    while (running_) {
+        uint64_t start = now_ms();
+        std::optional<size_t> length = device.transport->receive_packet(buffer, 100);
+        if (!length.has_value() && now_ms() - start < 10)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10)); // the transport is broken
+
+        std::unique_lock<std::mutex> lock(device.mutex);
+        size_t window = device.in_flight.size();
+        if (length.has_value() && *length >= 2) {
+            uint16_t seq_no = read_u16(buffer);
+            if (seq_no & 0x8000)
+                device.in_flight.erase(seq_no & 0x7fff);
+            device.rx_queue.emplace_back(buffer, buffer + *length);
+        }
+        // Requests that are not answered in time free their slot, the client
+        // retries them with another sequence number
+        uint64_t now = now_ms();
+        for (auto it = device.in_flight.begin(); it != device.in_flight.end();) {
+            it = (it->second < now) ? device.in_flight.erase(it) : std::next(it);
+        }
+        bool has_response = !device.rx_queue.empty();
+        bool window_opened = device.in_flight.size() < window;
+        lock.unlock();
+
+        if (window_opened)
+            device.cv.notify_one();
+        if (has_response) {
+            uint64_t one = 1;
+            (void)!write(wakeup_fd_, &one, sizeof(one));
+        }
+    }
+}
+
+
+/* Epoll loop ----------------------------------------------------------------*/
+
+static bool add_to_epoll(int epoll_fd, int fd, void* source) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = source;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool Gateway::open_sockets(Device& device, size_t index, unsigned int port) {
+    struct sockaddr_in6 si_me = {};
+    si_me.sin6_family = AF_INET6;
+    si_me.sin6_port = htons(port);
+    si_me.sin6_addr = in6addr_any;
+    int reuse = 1;
+
+    device.tcp_fd = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+    if (device.tcp_fd == -1)
+        return false;
+    setsockopt(device.tcp_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(device.tcp_fd, reinterpret_cast<struct sockaddr*>(&si_me), sizeof(si_me)) == -1
+            || listen(device.tcp_fd, 128) == -1)
+        return false;
+
+    device.udp_fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (device.udp_fd == -1
+            || bind(device.udp_fd, reinterpret_cast<struct sockaddr*>(&si_me), sizeof(si_me)) == -1)
+        return false;
+
+    device.tcp_source = {EventSource::kTcpListener, index, nullptr};
+    device.udp_source = {EventSource::kUdpSocket, index, nullptr};
+    return add_to_epoll(epoll_fd_, device.tcp_fd, &device.tcp_source)
+        && add_to_epoll(epoll_fd_, device.udp_fd, &device.udp_source);
+}
+
+bool Gateway::run(unsigned int base_port) {
+    epoll_fd_ = epoll_create1(0);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (epoll_fd_ == -1 || wakeup_fd_ == -1 || !add_to_epoll(epoll_fd_, wakeup_fd_, &wakeup_source_))
+        return false;
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        if (!open_sockets(*devices_[i], i, base_port + i))
+            return false;
+    }
+
+    running_ = true;
+    for (auto& device: devices_) {
+        device->sender = std::thread(&Gateway::sender_thread, this, std::ref(*device));
+        device->receiver = std::thread(&Gateway::receiver_thread, this, std::ref(*device));
+    }
+
+    struct epoll_event events[GATEWAY_MAX_EVENTS];
+    while (running_) {
+        int n_events = epoll_wait(epoll_fd_, events, GATEWAY_MAX_EVENTS, 100);
+        for (int i = 0; i < n_events && running_; ++i) {
+            EventSource* source = static_cast<EventSource*>(events[i].data.ptr);
+            switch (source->kind) {
+                case EventSource::kWakeup: {
+                    uint64_t count;
+                    (void)!read(wakeup_fd_, &count, sizeof(count));
+                    dispatch_responses();
+                } break;
+                case EventSource::kTcpListener: accept_client(source->device); break;
+                case EventSource::kUdpSocket: receive_udp(source->device); break;
+                case EventSource::kTcpClient: receive_tcp(*source->client); break;
+            }
+        }
+        expire_requests();
+    }
+    return true;
+}
+
+void Gateway::accept_client(size_t device) {
+    int fd = accept(devices_[device]->tcp_fd, nullptr, nullptr);
+    if (fd == -1)
+        return;
+    // Responses are small, see serve_on_tcp()
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    uint64_t id = next_client_id_++;
+    std::unique_ptr<TcpClient> client = std::make_unique<TcpClient>(*this, id, fd, device);
+    if (!add_to_epoll(epoll_fd_, fd, &client->source_)) {
+        close(fd);
+        return;
+    }
+    clients_[id] = std::move(client);
+}
+
+void Gateway::close_client(TcpClient& client) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client.fd_, nullptr);
+    close(client.fd_);
+    Device& device = *devices_[client.device_];
+    device.subscribers.erase(std::remove_if(device.subscribers.begin(), device.subscribers.end(),
+            [&](const Waiter& waiter) { return waiter.client_id == client.id_; }), device.subscribers.end());
+    clients_.erase(client.id_); // the responses that are still pending are dropped
+}
+
+void Gateway::receive_tcp(TcpClient& client) {
+    uint8_t buffer[GATEWAY_RX_BUF_LEN];
+    ssize_t n_received = recv(client.fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n_received == 0 || (n_received == -1 && errno != EAGAIN && errno != EINTR)) {
+        close_client(client);
+        return;
+    }
+    if (n_received > 0)
+        client.segmenter_.process_bytes(buffer, n_received, nullptr);
+}
+
+void Gateway::receive_udp(size_t device) {
+    uint8_t buffer[GATEWAY_RX_BUF_LEN];
+    Waiter waiter = {0, {}, 0};
+    socklen_t addr_length = sizeof(waiter.udp_addr);
+    ssize_t n_received = recvfrom(devices_[device]->udp_fd, buffer, sizeof(buffer), MSG_DONTWAIT,
+            reinterpret_cast<struct sockaddr*>(&waiter.udp_addr), &addr_length);
+    if (n_received > 0)
+        handle_request(device, waiter, buffer, n_received);
+}
+
+/**
+ * @brief Forwards a request of a client to its device, or adds the client to
+ * an identical read that is already waiting for the device.
+ */
+void Gateway::handle_request(size_t device_index, const Waiter& from, const uint8_t* packet, size_t length) {
+    Device& device = *devices_[device_index];
+    // sequence number, endpoint ID, response length, trailer
+    if (length < 8)
+        return;
+    stats_.requests++;
+
+    Waiter waiter = from;
+    waiter.seq_no = read_u16(packet);
+    uint16_t endpoint_id = read_u16(packet + 2);
+    bool expect_response = endpoint_id & 0x8000;
+    endpoint_id &= 0x7fff;
+    const uint8_t* input = packet + 6;
+    size_t input_length = length - 8;
+
+    // The packet size that the device accepts on its end doesn't apply to
+    // the clients if the device is connected over USB bulk endpoints. The
+    // empty response is that of older firmware.
+    if (endpoint_id == 0 && input_length == 4 && read_u32(input) == 0xfffffffe
+            && !device.transport->is_stream_based()) {
+        uint8_t response[2];
+        write_le<uint16_t>(waiter.seq_no | 0x8000, response);
+        send_to(device_index, waiter, response, sizeof(response));
+        return;
+    }
+
+    if (endpoint_id == SUBSCRIBE_ENDPOINT_ID) {
+        bool known = std::any_of(device.subscribers.begin(), device.subscribers.end(), [&](const Waiter& subscriber) {
+            return subscriber.client_id ? subscriber.client_id == waiter.client_id
+                : !memcmp(&subscriber.udp_addr, &waiter.udp_addr, sizeof(waiter.udp_addr));
+        });
+        if (!known)
+            device.subscribers.push_back(waiter);
+    }
+
+    std::vector<uint8_t> key;
+    if (expect_response && endpoint_id < device.coalescable_endpoints.size()
+            && device.coalescable_endpoints[endpoint_id] && (endpoint_id == 0 || input_length == 0)) {
+        key.assign(packet + 2, packet + length);
+        auto it = device.coalescing.find(key);
+        if (it != device.coalescing.end()) {
+            device.pending[it->second].waiters.push_back(waiter);
+            stats_.coalesced++;
+            return;
+        }
+    }
+
+    // Keeps bit 7 set like the other clients so that UART devices can tell
+    // the packets apart from the ASCII protocol
+    device.next_seq_no = (device.next_seq_no + 1) & 0x7fff;
+    uint16_t seq_no = device.next_seq_no | 0x80;
+    OutgoingRequest request = {std::vector<uint8_t>(packet, packet + length), expect_response};
+    write_le<uint16_t>(seq_no, request.packet.data());
+
+    if (expect_response) {
+        auto old = device.pending.find(seq_no); // only after the sequence numbers wrapped around
+        if (old != device.pending.end()) {
+            if (!old->second.key.empty())
+                device.coalescing.erase(old->second.key);
+            device.pending.erase(old);
+        }
+        if (!key.empty())
+            device.coalescing[key] = seq_no;
+        device.pending[seq_no] = {std::move(key), {waiter}, now_ms() + kRequestTimeoutMs};
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        device.tx_queue.push_back(std::move(request));
+    }
+    device.cv.notify_one();
+    stats_.forwarded++;
+}
+
+void Gateway::dispatch_responses() {
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        Device& device = *devices_[i];
+        std::deque<std::vector<uint8_t>> packets;
+        {
+            std::lock_guard<std::mutex> lock(device.mutex);
+            packets.swap(device.rx_queue);
+        }
+
+        for (auto& packet: packets) {
+            uint16_t seq_no = read_u16(packet.data());
+            if (seq_no == NOTIFICATION_MARKER) {
+                for (auto& subscriber: device.subscribers)
+                    send_to(i, subscriber, packet.data(), packet.size());
+                continue;
+            }
+            auto it = device.pending.find(seq_no & 0x7fff);
+            if (!(seq_no & 0x8000) || it == device.pending.end())
+                continue; // too late or not a response
+            if (!it->second.key.empty())
+                device.coalescing.erase(it->second.key);
+            std::vector<Waiter> waiters = std::move(it->second.waiters);
+            device.pending.erase(it);
+
+            for (auto& waiter: waiters) {
+                write_le<uint16_t>(waiter.seq_no | 0x8000, packet.data());
+                send_to(i, waiter, packet.data(), packet.size());
+                stats_.responses++;
+            }
+        }
+    }
+}
+
+void Gateway::send_to(size_t device, const Waiter& waiter, const uint8_t* packet, size_t length) {
+    if (waiter.client_id) {
+        auto it = clients_.find(waiter.client_id);
+        if (it != clients_.end())
+            it->second->send_packet(packet, length);
+    } else {
+        sendto(devices_[device]->udp_fd, packet, length, MSG_DONTWAIT,
+               reinterpret_cast<const struct sockaddr*>(&waiter.udp_addr), sizeof(waiter.udp_addr));
+    }
+}
+
+void Gateway::expire_requests() {
+    uint64_t now = now_ms();
+    for (auto& device: devices_) {
+        for (auto it = device->pending.begin(); it != device->pending.end();) {
+            if (it->second.deadline_ms >= now) {
+                ++it;
+                continue;
+            }
+            if (!it->second.key.empty())
+                device->coalescing.erase(it->second.key);
+            stats_.timeouts++;
+            it = device->pending.erase(it);
+        }
+    }
+}
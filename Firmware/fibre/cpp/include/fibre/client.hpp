@@ -0,0 +1,208 @@
+#ifndef __FIBRE_CLIENT_HPP
+#define __FIBRE_CLIENT_HPP
+
+#include <fibre/protocol.hpp>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace fibre {
+
+/**
+ * @brief Packet based connection of a host to one device.
+ */
+class ClientTransport {
+public:
+    virtual ~ClientTransport() = default;
+
+    // @brief Returns false if the packet could not be sent.
+    virtual bool send_packet(cbufptr_t packet) = 0;
+
+    // @brief Receives one packet into buffer and returns its length, or
+    // std::nullopt if none arrived within timeout_ms or the transport broke.
+    virtual std::optional<size_t> receive_packet(bufptr_t buffer, uint32_t timeout_ms) = 0;
+
+    // @brief True if the packets are framed on a byte stream. Those support
+    // packets of up to STREAM_MAX_PACKET_SIZE bytes on recent firmware.
+    virtual bool is_stream_based() const { return false; }
+};
+
+// Name of the type of a property in the JSON definition
+template<typename T> struct json_type_name;
+template<> struct json_type_name<bool> { static constexpr const char* value = "bool"; };
+template<> struct json_type_name<uint8_t> { static constexpr const char* value = "uint8"; };
+template<> struct json_type_name<int8_t> { static constexpr const char* value = "int8"; };
+template<> struct json_type_name<uint16_t> { static constexpr const char* value = "uint16"; };
+template<> struct json_type_name<int16_t> { static constexpr const char* value = "int16"; };
+template<> struct json_type_name<uint32_t> { static constexpr const char* value = "uint32"; };
+template<> struct json_type_name<int32_t> { static constexpr const char* value = "int32"; };
+template<> struct json_type_name<uint64_t> { static constexpr const char* value = "uint64"; };
+template<> struct json_type_name<int64_t> { static constexpr const char* value = "int64"; };
+template<> struct json_type_name<float> { static constexpr const char* value = "float"; };
+template<> struct json_type_name<endpoint_ref_t> { static constexpr const char* value = "endpoint_ref"; };
+
+struct EndpointInfo {
+    uint16_t id = 0;
+    std::string type; // as in the JSON, e.g. "float" or "function"
+    bool readable = false;
+    bool writable = false;
+    std::vector<EndpointInfo> inputs; // of a function
+    std::vector<EndpointInfo> outputs; // of a function
+};
+
+template<typename T> class Property;
+class Function;
+
+/**
+ * @brief Host side of Fibre v0.1: talks to one device over a ClientTransport.
+ *
+ * connect() downloads the JSON definition from endpoint 0, so the endpoints
+ * are resolved at runtime by their path (e.g. "axis0.encoder.pos_estimate")
+ * and the client works with any firmware version. property<T>() checks the
+ * type once and returns a handle that accesses the endpoint by its ID.
+ * connect(subtrees) only downloads the parts of the definition that are used
+ * (e.g. "axis0.controller"), which is much faster on slow links.
+ *
+ * Responses are written straight from the receive buffer into the output
+ * buffers of the caller. The client is not thread-safe.
+ */
+class Client {
+public:
+    struct Operation {
+        uint16_t endpoint_id;
+        cbufptr_t input;
+        bufptr_t output; // advanced past the bytes that were received
+    };
+
+    explicit Client(ClientTransport& transport) : transport_(transport) {}
+
+    bool connect();
+    bool connect(const std::vector<std::string>& subtrees);
+
+    bool endpoint_operation(uint16_t endpoint_id, cbufptr_t input, bufptr_t* output);
+    bool batch(Operation* operations, size_t count);
+
+    const EndpointInfo* find(const std::string& path) const;
+    const std::map<std::string, EndpointInfo>& endpoints() const { return endpoints_; }
+
+    template<typename T>
+    std::optional<Property<T>> property(const std::string& path);
+    std::optional<Function> function(const std::string& path);
+
+    // @brief Sets the function that gets the packets that the device sends on
+    // its own (telemetry, subscriptions) with their 16-bit header.
+    void set_unsolicited_packet_handler(std::function<void(uint16_t header, cbufptr_t payload)> handler) {
+        unsolicited_packet_handler_ = handler;
+    }
+
+    uint16_t json_crc() const { return json_crc_; }
+    uint32_t timeout_ms_ = 500; // per attempt
+    uint32_t attempts_ = 5;
+
+private:
+    bool transaction(uint16_t endpoint_id, cbufptr_t input, size_t output_length, bufptr_t* output);
+    bool negotiate_packet_size();
+    bool read_json(std::vector<uint8_t>* json, uint32_t offset = 0, uint32_t length = UINT32_MAX);
+
+    ClientTransport& transport_;
+    uint16_t seq_no_ = 0;
+    uint16_t json_crc_ = 0;
+    bool supports_batch_ = true;
+    bool large_packets_ = false;
+    std::map<std::string, EndpointInfo> endpoints_;
+    std::function<void(uint16_t, cbufptr_t)> unsolicited_packet_handler_;
+    uint8_t tx_buf_[RX_BUF_SIZE]; // the device doesn't accept larger requests
+    uint8_t rx_buf_[STREAM_MAX_PACKET_SIZE];
+};
+
+template<typename T>
+class Property {
+public:
+    Property(Client& client, uint16_t endpoint_id) : client_(&client), endpoint_id_(endpoint_id) {}
+
+    std::optional<T> read() {
+        T value;
+        bufptr_t output{reinterpret_cast<uint8_t*>(&value), sizeof(value)};
+        if (!client_->endpoint_operation(endpoint_id_, {}, &output) || !output.empty()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    bool write(T value) {
+        bufptr_t output;
+        return client_->endpoint_operation(endpoint_id_, {reinterpret_cast<const uint8_t*>(&value), sizeof(value)}, &output);
+    }
+
+    // @brief Returns a read of this property for Client::batch() that
+    // writes the value to storage. The output of the operation is empty
+    // afterwards if the value was received.
+    Client::Operation read_op(T* storage) {
+        return {endpoint_id_, {}, {reinterpret_cast<uint8_t*>(storage), sizeof(T)}};
+    }
+
+    // @brief Returns a write of this property for Client::batch(). value
+    // must stay valid until the batch is done.
+    Client::Operation write_op(const T* value) {
+        return {endpoint_id_, {reinterpret_cast<const uint8_t*>(value), sizeof(T)}, {}};
+    }
+
+    uint16_t endpoint_id() const { return endpoint_id_; }
+
+private:
+    // Values are sent in the byte order of the host
+    static_assert(std::is_trivially_copyable<T>::value, "the property type must be trivially copyable");
+
+    Client* client_;
+    uint16_t endpoint_id_;
+};
+
+class Function {
+public:
+    Function(Client& client, const EndpointInfo& info) : client_(&client), info_(info) {}
+
+    // @brief Writes the inputs, triggers the function and returns the first
+    // output (or true if it has none) as TRet.
+    template<typename TRet = bool, typename ... TArgs>
+    std::optional<TRet> call(TArgs ... args) {
+        if (sizeof...(args) != info_.inputs.size()) {
+            return std::nullopt;
+        }
+        size_t i = 0;
+        bool ok = (write_input(i++, args) && ...);
+        bufptr_t empty;
+        if (!ok || !client_->endpoint_operation(info_.id, {}, &empty)) {
+            return std::nullopt;
+        }
+        if (info_.outputs.empty()) {
+            return TRet{true};
+        }
+        return Property<TRet>(*client_, info_.outputs[0].id).read();
+    }
+
+private:
+    template<typename T>
+    bool write_input(size_t i, T value) {
+        return info_.inputs[i].type == json_type_name<T>::value
+            && Property<T>(*client_, info_.inputs[i].id).write(value);
+    }
+
+    Client* client_;
+    EndpointInfo info_;
+};
+
+template<typename T>
+std::optional<Property<T>> Client::property(const std::string& path) {
+    const EndpointInfo* info = find(path);
+    if (!info || info->type != json_type_name<T>::value) {
+        return std::nullopt;
+    }
+    return Property<T>(*this, info->id);
+}
+
+}
+
+#endif // __FIBRE_CLIENT_HPP
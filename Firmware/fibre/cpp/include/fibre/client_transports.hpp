@@ -0,0 +1,85 @@
+#ifndef __FIBRE_CLIENT_TRANSPORTS_HPP
+#define __FIBRE_CLIENT_TRANSPORTS_HPP
+
+#include <fibre/client.hpp>
+
+#include <deque>
+
+namespace fibre {
+
+/**
+ * @brief Connects to a device that serves Fibre on a TCP port (see
+ * serve_on_tcp()). The packets are framed like on UART.
+ */
+class TcpClientTransport : public ClientTransport, private PacketSink, private StreamSink {
+public:
+    ~TcpClientTransport();
+
+    // @brief Returns false if the host can't be resolved or doesn't accept
+    // the connection.
+    bool open(const char* host, unsigned int port);
+    void close();
+
+    bool send_packet(cbufptr_t packet) override;
+    std::optional<size_t> receive_packet(bufptr_t buffer, uint32_t timeout_ms) override;
+    bool is_stream_based() const override { return true; }
+
+private:
+    int process_packet(const uint8_t* buffer, size_t length) override; // received packets
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) override; // bytes to send
+    size_t get_free_space() override { return SIZE_MAX; }
+
+    int socket_fd_ = -1;
+    StreamBasedPacketSink packet_sink_{*static_cast<StreamSink*>(this)};
+    StreamToPacketSegmenter segmenter_{*static_cast<PacketSink*>(this)};
+    std::deque<std::vector<uint8_t>> rx_queue_;
+};
+
+/**
+ * @brief Connects to a device that serves Fibre on a UDP port (see
+ * serve_on_udp()). Each packet is one datagram.
+ */
+class UdpClientTransport : public ClientTransport {
+public:
+    ~UdpClientTransport();
+
+    bool open(const char* host, unsigned int port);
+    void close();
+
+    bool send_packet(cbufptr_t packet) override;
+    std::optional<size_t> receive_packet(bufptr_t buffer, uint32_t timeout_ms) override;
+
+private:
+    int socket_fd_ = -1;
+};
+
+/**
+ * @brief Talks to an ODrive over the native USB interface (bulk endpoints),
+ * without a kernel driver. Needs libusb-1.0.
+ */
+class LibusbClientTransport : public ClientTransport {
+public:
+    ~LibusbClientTransport();
+
+    // @brief Opens the first ODrive that is found or the one with the given
+    // serial number (as shown by odrivetool, e.g. "2061377C3548").
+    // Returns false if there is none.
+    bool open(const char* serial_number = nullptr);
+    void close();
+
+    bool send_packet(cbufptr_t packet) override;
+    std::optional<size_t> receive_packet(bufptr_t buffer, uint32_t timeout_ms) override;
+
+private:
+    bool open_device(void* device, const char* serial_number);
+
+    void* context_ = nullptr; // libusb_context
+    void* handle_ = nullptr; // libusb_device_handle
+    int interface_number_ = -1;
+    uint8_t ep_out_ = 0;
+    uint8_t ep_in_ = 0;
+};
+
+}
+
+#endif // __FIBRE_CLIENT_TRANSPORTS_HPP
@@ -2,15 +2,17 @@
 #define __CRC_HPP
 
 #include <stdint.h>
+#include <stddef.h>
 #include <limits.h>
 
-// Calculates an arbitrary CRC for one byte.
+// Calculates an arbitrary CRC for one byte, a bit at a time. Only used to
+// generate the lookup tables below.
 // Adapted from https://barrgroup.com/Embedded-Systems/How-To/CRC-Calculation-C-Code
 template<typename T, unsigned POLYNOMIAL>
-static T calc_crc(T remainder, uint8_t value) {
+constexpr T calc_crc_bitwise(T remainder, uint8_t value) {
     constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
     constexpr T TOPBIT = ((T)1 << (BIT_WIDTH - 1));
-    
+
     // Bring the next byte into the remainder.
     remainder ^= (value << (BIT_WIDTH - 8));
 
@@ -26,6 +28,33 @@ static T calc_crc(T remainder, uint8_t value) {
     return remainder;
 }
 
+// Remainders of all byte values, generated at compile time. The STM32F4
+// hardware CRC unit only does the CRC-32 polynomial on 32-bit words, so it
+// can't be used for the CRC8 and CRC16 of the protocol.
+template<typename T, unsigned POLYNOMIAL>
+struct CrcTable {
+    constexpr CrcTable() : entries() {
+        for (unsigned i = 0; i < 256; ++i) {
+            entries[i] = calc_crc_bitwise<T, POLYNOMIAL>(0, (uint8_t)i);
+        }
+    }
+    T entries[256];
+
+    static const CrcTable instance;
+};
+
+template<typename T, unsigned POLYNOMIAL>
+constexpr CrcTable<T, POLYNOMIAL> CrcTable<T, POLYNOMIAL>::instance{};
+
+// Calculates an arbitrary CRC for one byte, using a table of 256 entries
+// per polynomial instead of eight shift steps.
+template<typename T, unsigned POLYNOMIAL>
+static T calc_crc(T remainder, uint8_t value) {
+    constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
+    uint8_t index = (uint8_t)(remainder >> (BIT_WIDTH - 8)) ^ value;
+    return (T)(remainder << 8) ^ CrcTable<T, POLYNOMIAL>::instance.entries[index];
+}
+
 template<typename T, unsigned POLYNOMIAL>
 static T calc_crc(T remainder, const uint8_t* buffer, size_t length) {
     while (length--)
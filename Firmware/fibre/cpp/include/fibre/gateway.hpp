@@ -0,0 +1,153 @@
+#ifndef __FIBRE_GATEWAY_HPP
+#define __FIBRE_GATEWAY_HPP
+
+#include <fibre/client.hpp>
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fibre {
+
+/**
+ * @brief Serves the Fibre channels of several devices to many network clients.
+ *
+ * The gateway is the only owner of each device connection (usually USB).
+ * Device i is served on TCP and UDP port base_port + i, with the same framing
+ * as serve_on_tcp() and serve_on_udp(), so the usual clients connect to it
+ * like to a device (e.g. `odrivetool --path tcp:gateway-host:9910`).
+ *
+ * The requests of all clients of a device are put on the device connection
+ * with sequence numbers of the gateway and the responses are routed back with
+ * the sequence number of the client. Identical reads of properties (and of the
+ * JSON definition) that wait for the device at the same time are coalesced:
+ * only the first one goes to the device and its response goes to all of them.
+ * Function calls, writes and batch requests are always forwarded.
+ *
+ * All sockets are handled by one epoll loop. Each device has a sender and a
+ * receiver thread that do the blocking transport I/O, with up to
+ * kPipelineWindow requests in flight.
+ *
+ * Subscriptions (see docs/protocol.md) are kept by the device per channel, so
+ * they are shared by all clients of a device. Notifications go to every client
+ * that ever sent a subscription request.
+ */
+class Gateway {
+public:
+    static constexpr size_t kPipelineWindow = 8;
+    static constexpr uint32_t kRequestTimeoutMs = 1000;
+
+    struct Stats {
+        uint64_t requests = 0; // from clients
+        uint64_t forwarded = 0; // to the devices
+        uint64_t coalesced = 0; // answered with the response to another request
+        uint64_t responses = 0; // to clients
+        uint64_t timeouts = 0; // requests that the device didn't answer in time
+    };
+
+    Gateway();
+    ~Gateway();
+
+    // @brief Adds a device that is served on the next port. Downloads the
+    // JSON definition to find out which endpoints are properties. The
+    // transport must be open and stay valid until the gateway is destroyed.
+    // Returns false if the device doesn't respond.
+    bool add_device(ClientTransport& transport, const std::string& name);
+
+    // @brief Serves the devices until stop() is called. Returns false if a
+    // socket could not be set up.
+    bool run(unsigned int base_port);
+
+    // @brief Makes run() return. Can be called from any thread or a signal
+    // handler.
+    void stop();
+
+    // @brief Only valid after run() returned
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct TcpClient;
+
+    // Where a response goes to
+    struct Waiter {
+        uint64_t client_id; // TCP client or 0 for UDP
+        struct sockaddr_in6 udp_addr;
+        uint16_t seq_no; // of the client
+    };
+
+    struct PendingRequest {
+        std::vector<uint8_t> key; // empty if the request can't be coalesced
+        std::vector<Waiter> waiters;
+        uint64_t deadline_ms;
+    };
+
+    struct OutgoingRequest {
+        std::vector<uint8_t> packet;
+        bool expect_response;
+    };
+
+    // Tells the epoll loop what an event belongs to
+    struct EventSource {
+        enum Kind { kWakeup, kTcpListener, kUdpSocket, kTcpClient } kind;
+        size_t device;
+        TcpClient* client;
+    };
+
+    struct Device {
+        ClientTransport* transport;
+        std::string name;
+        std::vector<bool> coalescable_endpoints; // indexed by endpoint ID
+        int tcp_fd = -1;
+        int udp_fd = -1;
+        EventSource tcp_source;
+        EventSource udp_source;
+
+        // Only used by the epoll loop
+        uint16_t next_seq_no = 0;
+        std::map<uint16_t, PendingRequest> pending; // by the sequence number of the gateway
+        std::map<std::vector<uint8_t>, uint16_t> coalescing; // request -> sequence number
+        std::vector<Waiter> subscribers;
+
+        // Shared with the I/O threads
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<OutgoingRequest> tx_queue;
+        std::deque<std::vector<uint8_t>> rx_queue;
+        std::map<uint16_t, uint64_t> in_flight; // sequence number -> deadline
+        std::thread sender;
+        std::thread receiver;
+    };
+
+    void sender_thread(Device& device);
+    void receiver_thread(Device& device);
+
+    bool open_sockets(Device& device, size_t index, unsigned int port);
+    void accept_client(size_t device);
+    void receive_tcp(TcpClient& client);
+    void receive_udp(size_t device);
+    void handle_request(size_t device, const Waiter& waiter, const uint8_t* packet, size_t length);
+    void dispatch_responses();
+    void send_to(size_t device, const Waiter& waiter, const uint8_t* packet, size_t length);
+    void close_client(TcpClient& client);
+    void expire_requests();
+
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::map<uint64_t, std::unique_ptr<TcpClient>> clients_;
+    uint64_t next_client_id_ = 1;
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1; // eventfd
+    EventSource wakeup_source_{EventSource::kWakeup, 0, nullptr};
+    std::atomic<bool> running_{false};
+    Stats stats_; // only updated by the epoll loop
+};
+
+}
+
+#endif // __FIBRE_GATEWAY_HPP
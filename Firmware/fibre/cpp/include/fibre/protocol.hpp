@@ -16,6 +16,8 @@ see protocol.md for the protocol specification
 #include <string.h>
 #include <unistd.h>
 #include <cstring>
+#include <optional>
+#include <vector>
 #include "crc.hpp"
 #include "cpp_utils.hpp"
 #include "bufptr.hpp"
@@ -74,26 +76,68 @@ constexpr uint16_t PROTOCOL_VERSION = 1;
 constexpr uint16_t TX_BUF_SIZE = 32; // does not work with 64 for some reason
 constexpr uint16_t RX_BUF_SIZE = 128; // larger values than 128 have currently no effect because of protocol limitations
 
+// Largest packet on stream based channels (UART, TCP). Packets of 128 bytes
+// and more have a 4 byte header, see StreamToPacketSegmenter.
+constexpr uint16_t STREAM_MAX_PACKET_SIZE = 1024;
+
 // Maximum time we allocate for processing and responding to a request
 constexpr uint32_t PROTOCOL_SERVER_TIMEOUT_MS = 10;
 
+// Reserved endpoint ID of a request that carries a list of endpoint operations
+constexpr uint16_t BATCH_ENDPOINT_ID = 0x7fff;
+
+// Reserved endpoint ID of a request that adds or removes subscriptions, see
+// BidirectionalPacketBasedChannel::publish()
+constexpr uint16_t SUBSCRIBE_ENDPOINT_ID = 0x7ffe;
+constexpr uint16_t SUBSCRIBE_ON_CHANGE = 0x8000; // flag in the period of a subscription
+constexpr uint16_t UNSUBSCRIBE = 0xffff; // period that removes a subscription
+
+// First two bytes of a packet that the server sends on its own with the
+// values of subscribed properties. Responses have bit 15 set in this field.
+constexpr uint16_t NOTIFICATION_MARKER = 0x734E;
+
+constexpr size_t MAX_SUBSCRIPTIONS = 16; // per channel
+constexpr size_t MAX_SUBSCRIBED_SIZE = 8; // largest property that can be subscribed [bytes]
+constexpr size_t NOTIFICATION_BUF_SIZE = 64; // so that a notification fits into one USB packet
+
 
 typedef struct {
     uint16_t json_crc = 0;
     uint16_t endpoint_id = 0;
 } endpoint_ref_t;
 
+class Introspectable;
 
 namespace fibre {
+// An object of the JSON descriptor that can be fetched on its own. Its bytes
+// in embedded_json are raw deflate data that inflate to the JSON of the object.
+struct JsonPage {
+    const char* path; // e.g. "axis0.controller"
+    uint32_t offset;
+    uint32_t length;
+};
+
 // These symbols are defined in the autogenerated endpoints.hpp
 extern const unsigned char embedded_json[];
 extern const size_t embedded_json_length;
+extern const JsonPage embedded_json_pages[];
+extern const size_t embedded_json_page_count;
 extern const uint16_t json_crc_;
 extern const uint32_t json_version_id_;
 bool endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer);
 bool endpoint0_handler(cbufptr_t* input_buffer, bufptr_t* output_buffer);
+bool batch_handler(cbufptr_t* input_buffer, bufptr_t* output_buffer);
 bool is_endpoint_ref_valid(endpoint_ref_t endpoint_ref);
 bool set_endpoint_from_float(endpoint_ref_t endpoint_ref, float value);
+bool get_endpoint_property(endpoint_ref_t endpoint_ref, Introspectable* property);
+
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+// Defined by the application. Called for every endpoint operation that a
+// request carries, including each operation of a batch. is_write is true if
+// the operation has an input (except for endpoint 0, whose input is the
+// offset), so property reads and function calls count as reads.
+void record_endpoint_access(uint16_t endpoint_id, bool is_write);
+#endif
 }
 
 
@@ -194,6 +238,13 @@ public:
     //virtual size_t get_free_space() = 0;
 };
 
+/* @brief Splits a byte stream into packets.
+*
+* Packets shorter than 128 bytes have the header {prefix, length, crc8}.
+* Longer packets have the header {prefix, 0x80 | (length >> 8), length & 0xff,
+* crc8}. Older receivers drop those, so a host only sends them after it found
+* out the maximum packet size of the device (see endpoint0_handler()).
+*/
 class StreamToPacketSegmenter : public StreamSink {
 public:
     explicit StreamToPacketSegmenter(PacketSink& output) :
@@ -206,9 +257,13 @@ public:
     size_t get_free_space() { return SIZE_MAX; }
 
 private:
-    uint8_t header_buffer_[3] = {0};
+    // Returns false if header_buffer_ can't be the start of a valid header
+    bool check_header();
+
+    uint8_t header_buffer_[4] = {0};
     size_t header_index_ = 0;
-    uint8_t packet_buffer_[RX_BUF_SIZE] = {0};
+    size_t header_length_ = 3;
+    uint8_t packet_buffer_[STREAM_MAX_PACKET_SIZE + 2] = {0}; // including the CRC16
     size_t packet_index_ = 0;
     size_t packet_length_ = 0;
     PacketSink& output_;
@@ -423,16 +478,47 @@ template<> struct Codec<endpoint_ref_t> {
 class BidirectionalPacketBasedChannel : public PacketSink {
 public:
     explicit BidirectionalPacketBasedChannel(PacketSink& output) :
-        output_(output)
+        output_(output), tx_buf_(default_tx_buf_)
+    { }
+
+    // @brief Uses the specified buffer for responses instead of the default
+    // one of TX_BUF_SIZE bytes, for channels that support larger packets.
+    BidirectionalPacketBasedChannel(PacketSink& output, fibre::bufptr_t tx_buf) :
+        output_(output), tx_buf_(tx_buf)
     { }
 
     //size_t get_mtu() {
     //    return SIZE_MAX;
     //}
     int process_packet(const uint8_t* buffer, size_t length) override;
+    void publish(uint32_t now_ms);
+    bool has_subscriptions() const { return num_subscriptions_ > 0; }
+
+    uint32_t request_count_ = 0; // requests with a valid trailer (modulo 2^32)
 private:
+    struct Subscription {
+        uint16_t endpoint_id;
+        uint16_t period; // [ms] or'ed with SUBSCRIBE_ON_CHANGE
+        uint32_t last_sent_ms;
+        bool sent; // value holds the last value that was sent
+        uint8_t length;
+        uint8_t value[MAX_SUBSCRIBED_SIZE];
+    };
+
+    bool subscribe_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer);
+
     PacketSink& output_;
-    uint8_t tx_buf_[TX_BUF_SIZE] = {0};
+    uint8_t default_tx_buf_[TX_BUF_SIZE] = {0};
+    fibre::bufptr_t tx_buf_;
+
+    Subscription subscriptions_[MAX_SUBSCRIPTIONS];
+    size_t num_subscriptions_ = 0;
+    uint32_t last_publish_ms_ = 0;
+
+    // A USB packet is read by the hardware after process_packet() returns,
+    // so consecutive notifications alternate between two buffers.
+    uint8_t notification_buf_[2][NOTIFICATION_BUF_SIZE];
+    size_t notification_buf_index_ = 0;
 };
 
 
@@ -468,7 +554,10 @@ template<> struct format_traits_t<uint32_t> { using type = void;
     static constexpr const char * fmtp = "%lu";
 };
 // TODO: change all overloads to fundamental int type space
-template<> struct format_traits_t<unsigned int> { using type = void;
+// On hosts where uint32_t is unsigned int this would be a redefinition, so
+// it's moved to an unused type there.
+struct format_traits_unused_t;
+template<> struct format_traits_t<std::conditional_t<std::is_same<unsigned int, uint32_t>::value, format_traits_unused_t, unsigned int>> { using type = void;
     static constexpr const char * fmt = "%ud";
     static constexpr const char * fmtp = "%ud";
 };
@@ -571,6 +660,18 @@ template<typename T>
 bool set_from_float(float value, T* property) {
     return set_from_float_ex<T>(value, property, 0);
 }
+template<typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+bool get_as_float_ex(T value, float* result, int) {
+    return *result = static_cast<float>(value), true;
+}
+template<typename T>
+bool get_as_float_ex(T value, float* result, ...) {
+    return false;
+}
+template<typename T>
+bool get_as_float(T value, float* result) {
+    return get_as_float_ex<T>(value, result, 0);
+}
 }
 
 
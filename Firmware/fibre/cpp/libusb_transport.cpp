@@ -0,0 +1,126 @@
+#include <fibre/client_transports.hpp>
+
+#include <algorithm>
+#include <libusb-1.0/libusb.h>
+#include <string.h>
+
+using namespace fibre;
+
+static const struct {
+    uint16_t vid;
+    uint16_t pid;
+} well_known_vid_pid_pairs[] = {
+    {0x1209, 0x0D31},
+    {0x1209, 0x0D32},
+    {0x1209, 0x0D33},
+};
+
+#define USB_TX_TIMEOUT_MS   1000
+
+LibusbClientTransport::~LibusbClientTransport() {
+    close();
+}
+
+bool LibusbClientTransport::open(const char* serial_number) {
+    close();
+    libusb_context* context;
+    if (libusb_init(&context) != LIBUSB_SUCCESS)
+        return false;
+    context_ = context;
+
+    libusb_device** devices;
+    ssize_t n_devices = libusb_get_device_list(context, &devices);
+    for (ssize_t i = 0; i < n_devices && !handle_; ++i) {
+        struct libusb_device_descriptor desc;
+        if (libusb_get_device_descriptor(devices[i], &desc) != LIBUSB_SUCCESS)
+            continue;
+        for (auto& pair: well_known_vid_pid_pairs) {
+            if (desc.idVendor == pair.vid && desc.idProduct == pair.pid && open_device(devices[i], serial_number))
+                break;
+        }
+    }
+    if (n_devices >= 0)
+        libusb_free_device_list(devices, 1);
+
+    if (!handle_) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Claims the Fibre interface of the device (class 0x00, subclass 0x01)
+bool LibusbClientTransport::open_device(void* device, const char* serial_number) {
+    libusb_device* dev = static_cast<libusb_device*>(device);
+    libusb_device_handle* handle;
+    if (libusb_open(dev, &handle) != LIBUSB_SUCCESS)
+        return false;
+
+    struct libusb_device_descriptor desc;
+    unsigned char serial[64] = {0};
+    if (serial_number && (libusb_get_device_descriptor(dev, &desc) != LIBUSB_SUCCESS
+            || libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, serial, sizeof(serial)) < 0
+            || strcasecmp(reinterpret_cast<char*>(serial), serial_number))) {
+        libusb_close(handle);
+        return false;
+    }
+
+    struct libusb_config_descriptor* config;
+    if (libusb_get_active_config_descriptor(dev, &config) != LIBUSB_SUCCESS) {
+        libusb_close(handle);
+        return false;
+    }
+    for (uint8_t i = 0; i < config->bNumInterfaces && interface_number_ < 0; ++i) {
+        const struct libusb_interface_descriptor& intf = config->interface[i].altsetting[0];
+        if (intf.bInterfaceClass != 0x00 || intf.bInterfaceSubClass != 0x01)
+            continue;
+        ep_out_ = ep_in_ = 0;
+        for (uint8_t j = 0; j < intf.bNumEndpoints; ++j) {
+            uint8_t address = intf.endpoint[j].bEndpointAddress;
+            uint8_t& ep = (address & LIBUSB_ENDPOINT_IN) ? ep_in_ : ep_out_;
+            if (!ep)
+                ep = address; // the first one of each direction
+        }
+        if (ep_in_ && ep_out_)
+            interface_number_ = intf.bInterfaceNumber;
+    }
+    libusb_free_config_descriptor(config);
+
+    libusb_set_auto_detach_kernel_driver(handle, 1); // not supported on all platforms
+    if (interface_number_ < 0 || libusb_claim_interface(handle, interface_number_) != LIBUSB_SUCCESS) {
+        interface_number_ = -1;
+        libusb_close(handle);
+        return false;
+    }
+    handle_ = handle;
+    return true;
+}
+
+void LibusbClientTransport::close() {
+    if (handle_) {
+        libusb_release_interface(static_cast<libusb_device_handle*>(handle_), interface_number_);
+        libusb_close(static_cast<libusb_device_handle*>(handle_));
+        handle_ = nullptr;
+        interface_number_ = -1;
+    }
+    if (context_) {
+        libusb_exit(static_cast<libusb_context*>(context_));
+        context_ = nullptr;
+    }
+}
+
+bool LibusbClientTransport::send_packet(cbufptr_t packet) {
+    int transferred;
+    return handle_ && libusb_bulk_transfer(static_cast<libusb_device_handle*>(handle_), ep_out_,
+            const_cast<uint8_t*>(packet.begin()), packet.size(), &transferred, USB_TX_TIMEOUT_MS) == LIBUSB_SUCCESS
+        && transferred == (int)packet.size();
+}
+
+std::optional<size_t> LibusbClientTransport::receive_packet(bufptr_t buffer, uint32_t timeout_ms) {
+    int transferred;
+    // A timeout of 0 means infinite to libusb
+    if (!handle_ || libusb_bulk_transfer(static_cast<libusb_device_handle*>(handle_), ep_in_,
+            buffer.begin(), buffer.size(), &transferred, std::max<uint32_t>(timeout_ms, 1)) != LIBUSB_SUCCESS)
+        return std::nullopt;
+    return (size_t)transferred;
+}
@@ -6,3 +6,17 @@ fibre_package = define_package{
     libs={'pthread'},
     headers={'include'}
 }
+
+-- Host client library (see include/fibre/client.hpp)
+fibre_client_package = define_package{
+    sources={'protocol.cpp', 'client.cpp', 'posix_client_transports.cpp', 'libusb_transport.cpp'},
+    libs={'pthread', 'z', 'usb-1.0'},
+    headers={'include'}
+}
+
+-- Gateway that serves devices to many network clients (see include/fibre/gateway.hpp)
+fibre_gateway_package = define_package{
+    packages={fibre_client_package},
+    sources={'gateway.cpp'},
+    headers={'include'}
+}
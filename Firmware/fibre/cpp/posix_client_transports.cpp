@@ -0,0 +1,142 @@
+#include <fibre/client_transports.hpp>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+
+using namespace fibre;
+
+#define CLIENT_RX_BUF_LEN   512
+
+// Returns a connected socket or -1
+static int connect_socket(const char* host, unsigned int port, int socket_type) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socket_type;
+    struct addrinfo* results;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &results))
+        return -1;
+
+    int socket_fd = -1;
+    for (struct addrinfo* addr = results; addr && socket_fd == -1; addr = addr->ai_next) {
+        socket_fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (socket_fd != -1 && connect(socket_fd, addr->ai_addr, addr->ai_addrlen) == -1) {
+            ::close(socket_fd);
+            socket_fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    return socket_fd;
+}
+
+// Returns false on timeout or error
+static bool wait_readable(int socket_fd, uint32_t timeout_ms) {
+    struct pollfd fd = {socket_fd, POLLIN, 0};
+    return poll(&fd, 1, timeout_ms) == 1 && (fd.revents & POLLIN);
+}
+
+
+TcpClientTransport::~TcpClientTransport() {
+    close();
+}
+
+bool TcpClientTransport::open(const char* host, unsigned int port) {
+    close();
+    socket_fd_ = connect_socket(host, port, SOCK_STREAM);
+    if (socket_fd_ == -1)
+        return false;
+    // A packet is sent in several parts (header, payload, CRC), so Nagle's
+    // algorithm would hold back the last ones until a delayed ACK
+    int nodelay = 1;
+    setsockopt(socket_fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return true;
+}
+
+void TcpClientTransport::close() {
+    if (socket_fd_ != -1) {
+        ::close(socket_fd_);
+        socket_fd_ = -1;
+    }
+    rx_queue_.clear();
+}
+
+bool TcpClientTransport::send_packet(cbufptr_t packet) {
+    return socket_fd_ != -1 && packet_sink_.process_packet(packet.begin(), packet.size()) == 0;
+}
+
+int TcpClientTransport::process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
+    while (length) {
+        ssize_t bytes_sent = send(socket_fd_, buffer, length, MSG_NOSIGNAL);
+        if (bytes_sent <= 0)
+            return -1;
+        buffer += bytes_sent;
+        length -= bytes_sent;
+        if (processed_bytes)
+            *processed_bytes += bytes_sent;
+    }
+    return 0;
+}
+
+int TcpClientTransport::process_packet(const uint8_t* buffer, size_t length) {
+    rx_queue_.emplace_back(buffer, buffer + length);
+    return 0;
+}
+
+std::optional<size_t> TcpClientTransport::receive_packet(bufptr_t buffer, uint32_t timeout_ms) {
+    // One read from the socket can contain several packets
+    while (rx_queue_.empty()) {
+        uint8_t rx_buf[CLIENT_RX_BUF_LEN];
+        if (socket_fd_ == -1 || !wait_readable(socket_fd_, timeout_ms))
+            return std::nullopt;
+        ssize_t n_received = recv(socket_fd_, rx_buf, sizeof(rx_buf), 0);
+        if (n_received <= 0) {
+            close(); // connection closed by the device
+            return std::nullopt;
+        }
+        segmenter_.process_bytes(rx_buf, n_received, nullptr);
+    }
+
+    std::vector<uint8_t>& packet = rx_queue_.front();
+    size_t length = std::min(packet.size(), buffer.size());
+    memcpy(buffer.begin(), packet.data(), length);
+    rx_queue_.pop_front();
+    return length;
+}
+
+
+UdpClientTransport::~UdpClientTransport() {
+    close();
+}
+
+bool UdpClientTransport::open(const char* host, unsigned int port) {
+    close();
+    socket_fd_ = connect_socket(host, port, SOCK_DGRAM);
+    return socket_fd_ != -1;
+}
+
+void UdpClientTransport::close() {
+    if (socket_fd_ != -1) {
+        ::close(socket_fd_);
+        socket_fd_ = -1;
+    }
+}
+
+bool UdpClientTransport::send_packet(cbufptr_t packet) {
+    return socket_fd_ != -1 && send(socket_fd_, packet.begin(), packet.size(), 0) == (ssize_t)packet.size();
+}
+
+std::optional<size_t> UdpClientTransport::receive_packet(bufptr_t buffer, uint32_t timeout_ms) {
+    if (socket_fd_ == -1 || !wait_readable(socket_fd_, timeout_ms))
+        return std::nullopt;
+    ssize_t n_received = recv(socket_fd_, buffer.begin(), buffer.size(), 0);
+    if (n_received < 0)
+        return std::nullopt;
+    return (size_t)n_received;
+}
@@ -1,6 +1,7 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -39,7 +40,8 @@ int serve_client(int sock_fd) {
     // initialize output stack for this client
     TCPStreamSink tcp_packet_output(sock_fd);
     StreamBasedPacketSink packet2stream(tcp_packet_output);
-    BidirectionalPacketBasedChannel channel(packet2stream);
+    uint8_t response_buf[STREAM_MAX_PACKET_SIZE];
+    BidirectionalPacketBasedChannel channel(packet2stream, response_buf);
 
     StreamToPacketSegmenter stream2packet(channel);
 
@@ -93,6 +95,10 @@ int serve_on_tcp(unsigned int port) {
         socklen_t silen = sizeof(si_other);
         // TODO: Add a limit on accepting connections
         int client_portal_fd = accept(s, reinterpret_cast<sockaddr *>(&si_other), &silen); // blocking call
+        // Responses are small and sent in several parts (header, payload),
+        // so Nagle's algorithm would hold them back until a delayed ACK.
+        int nodelay = 1;
+        setsockopt(client_portal_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
         serv_pool.push_back(std::async(std::launch::async, serve_client, client_portal_fd));
         // do a little clean up on the pool
         for (std::vector<std::future<int>>::iterator it = serv_pool.end()-1; it >= serv_pool.begin(); --it) {
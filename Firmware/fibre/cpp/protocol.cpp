@@ -3,9 +3,11 @@
 
 #include <memory>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fibre/protocol.hpp>
 #include <fibre/crc.hpp>
+#include <fibre/introspection.hpp>
 
 /* Private defines -----------------------------------------------------------*/
 /* Private macros ------------------------------------------------------------*/
@@ -37,23 +39,49 @@ void hexdump(const uint8_t* buf, size_t len) {
 }
 #endif
 
+static inline void count_endpoint_access(uint16_t endpoint_id, size_t input_length) {
+#if defined(FIBRE_ENABLE_ENDPOINT_STATS)
+    fibre::record_endpoint_access(endpoint_id, endpoint_id != 0 && input_length != 0);
+#else
+    (void)endpoint_id;
+    (void)input_length;
+#endif
+}
+
 
 
+bool StreamToPacketSegmenter::check_header() {
+    if (header_buffer_[0] != CANONICAL_PREFIX) {
+        return false;
+    }
+    header_length_ = (header_index_ >= 2 && (header_buffer_[1] & 0x80)) ? 4 : 3;
+    if (header_index_ < header_length_) {
+        return true; // incomplete but valid so far
+    }
+    if (calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header_buffer_, header_length_)) {
+        return false;
+    }
+    size_t packet_length = (header_length_ == 4 ? (((header_buffer_[1] & 0x7f) << 8) | header_buffer_[2]) : header_buffer_[1]) + 2;
+    if (packet_length > sizeof(packet_buffer_)) {
+        return false; // too large for us
+    }
+    packet_length_ = packet_length;
+    return true;
+}
+
 int StreamToPacketSegmenter::process_bytes(const uint8_t *buffer, size_t length, size_t* processed_bytes) {
     int result = 0;
 
     while (length--) {
-        if (header_index_ < sizeof(header_buffer_)) {
-            // Process header byte
+        if (header_index_ < header_length_) {
+            // Process header byte. If the header turns out to be invalid, a
+            // real one may start within it (e.g. after a stray prefix byte).
             header_buffer_[header_index_++] = *buffer;
-            if (header_index_ == 1 && header_buffer_[0] != CANONICAL_PREFIX) {
-                header_index_ = 0;
-            } else if (header_index_ == 2 && (header_buffer_[1] & 0x80)) {
-                header_index_ = 0; // TODO: support packets larger than 128 bytes
-            } else if (header_index_ == 3 && calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header_buffer_, 3)) {
-                header_index_ = 0;
-            } else if (header_index_ == 3) {
-                packet_length_ = header_buffer_[1] + 2;
+            if (header_index_ == 1 && *buffer != CANONICAL_PREFIX) {
+                header_index_ = 0; // fast path while looking for the prefix
+            }
+            while (header_index_ && !check_header()) {
+                memmove(header_buffer_, header_buffer_ + 1, --header_index_);
             }
         } else if (packet_index_ < sizeof(packet_buffer_)) {
             // Process payload byte
@@ -61,7 +89,7 @@ int StreamToPacketSegmenter::process_bytes(const uint8_t *buffer, size_t length,
         }
 
         // If both header and packet are fully received, hand it on to the packet processor
-        if (header_index_ == 3 && packet_index_ == packet_length_) {
+        if (header_index_ == header_length_ && packet_index_ == packet_length_) {
             if (calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(CANONICAL_CRC16_INIT, packet_buffer_, packet_length_) == 0) {
                 result |= output_.process_packet(packet_buffer_, packet_length_ - 2);
             }
@@ -76,19 +104,23 @@ int StreamToPacketSegmenter::process_bytes(const uint8_t *buffer, size_t length,
 }
 
 int StreamBasedPacketSink::process_packet(const uint8_t *buffer, size_t length) {
-    // TODO: support buffer size >= 128
-    if (length >= 128)
+    if (length > 0x7fff)
         return -1;
 
     LOG_FIBRE("send header\r\n");
-    uint8_t header[] = {
-        CANONICAL_PREFIX,
-        static_cast<uint8_t>(length),
-        0
-    };
-    header[2] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header, 2);
+    uint8_t header[4] = {CANONICAL_PREFIX};
+    size_t header_length;
+    if (length < 128) {
+        header[1] = static_cast<uint8_t>(length);
+        header_length = 3;
+    } else {
+        header[1] = static_cast<uint8_t>(0x80 | (length >> 8));
+        header[2] = static_cast<uint8_t>(length & 0xff);
+        header_length = 4;
+    }
+    header[header_length - 1] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header, header_length - 1);
 
-    if (output_.process_bytes(header, sizeof(header), nullptr))
+    if (output_.process_bytes(header, header_length, nullptr))
         return -1;
     LOG_FIBRE("send payload:\r\n");
     hexdump(buffer, length);
@@ -119,6 +151,24 @@ bool fibre::endpoint0_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* o
     } else if (offset.value() == 0xffffffff) {
         // If the offset is special value 0xFFFFFFFF, send back the JSON version ID instead
         return write_le<uint32_t>(json_version_id_, output_buffer);
+    } else if (offset.value() == 0xfffffffe) {
+        // If the offset is special value 0xFFFFFFFE, send back the largest
+        // packet that we accept on stream based channels. Older firmware
+        // returns an empty response.
+        return write_le<uint32_t>(STREAM_MAX_PACKET_SIZE, output_buffer);
+    } else if (offset.value() == 0xfffffffd) {
+        // If the offset is special value 0xFFFFFFFD, the rest of the request
+        // is the path of an object. Send back the offset and length of its
+        // page in the JSON, or an empty response if it has no page.
+        for (size_t i = 0; i < embedded_json_page_count; ++i) {
+            const JsonPage& page = embedded_json_pages[i];
+            if (strlen(page.path) == input_buffer->size()
+                    && !memcmp(page.path, input_buffer->begin(), input_buffer->size())) {
+                return write_le<uint32_t>(page.offset, output_buffer)
+                    && write_le<uint32_t>(page.length, output_buffer);
+            }
+        }
+        return true;
     } else if (offset.value() >= embedded_json_length) {
         // Attempt to read beyond the buffer end - return empty response
         return true;
@@ -131,6 +181,48 @@ bool fibre::endpoint0_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* o
     }
 }
 
+/**
+ * @brief Runs a list of endpoint operations that arrived in one request.
+ *
+ * Each operation in the request consists of the endpoint ID (uint16), the
+ * input length and the expected output length (uint8 each), followed by the
+ * input. The response starts with the number of operations that were carried
+ * out (uint8), followed by their outputs. Processing stops at the first
+ * operation that fails or whose output doesn't fit into the response, so the
+ * host can send the rest in another request.
+ */
+bool fibre::batch_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    if (output_buffer->empty()) {
+        return false;
+    }
+    uint8_t& count = output_buffer->front();
+    count = 0;
+    *output_buffer += 1;
+
+    while (input_buffer->size() >= 4 && count < 0xff) {
+        const uint8_t* header = input_buffer->begin();
+        uint16_t endpoint_id = header[0] | (header[1] << 8);
+        size_t input_length = header[2];
+        size_t output_length = header[3];
+        if (endpoint_id == 0 || endpoint_id == BATCH_ENDPOINT_ID
+                || input_buffer->size() < 4 + input_length
+                || output_buffer->size() < output_length) {
+            break;
+        }
+
+        fibre::cbufptr_t op_input{header + 4, input_length};
+        fibre::bufptr_t op_output{output_buffer->begin(), output_length};
+        count_endpoint_access(endpoint_id, input_length);
+        if (!fibre::endpoint_handler(endpoint_id, &op_input, &op_output)) {
+            break;
+        }
+        *output_buffer += output_length - op_output.size();
+        *input_buffer += 4 + input_length;
+        count++;
+    }
+    return true;
+}
+
 int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_t length) {
     LOG_FIBRE("got packet of length %d: \r\n", length);
     hexdump(buffer, length);
@@ -159,29 +251,178 @@ int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_
             return -1;
         }
         LOG_FIBRE("trailer ok for endpoint %d\r\n", endpoint_id);
+        request_count_++;
 
         // TODO: if more bytes than the MTU were requested, should we abort or just return as much as possible?
 
+        // The MSB of the expected response length is set by hosts that accept
+        // packets of 128 bytes and more. The response of older hosts must fit
+        // into a packet with the short header.
         uint16_t expected_response_length = read_le<uint16_t>(&buffer, &length);
+        bool allow_large_response = expected_response_length & 0x8000;
+        expected_response_length &= 0x7fff;
+        if (!allow_large_response && expected_response_length > 125)
+            expected_response_length = 125;
 
         // Limit response length according to our local TX buffer size
-        if (expected_response_length > sizeof(tx_buf_) - 2)
-            expected_response_length = sizeof(tx_buf_) - 2;
+        if (expected_response_length > tx_buf_.size() - 2)
+            expected_response_length = tx_buf_.size() - 2;
 
         fibre::cbufptr_t input_buffer{buffer, length - 2};
-        fibre::bufptr_t output_buffer{tx_buf_ + 2, expected_response_length};
-        fibre::endpoint_handler(endpoint_id, &input_buffer, &output_buffer);
+        fibre::bufptr_t output_buffer{tx_buf_.begin() + 2, expected_response_length};
+        if (endpoint_id == BATCH_ENDPOINT_ID) {
+            fibre::batch_handler(&input_buffer, &output_buffer);
+        } else if (endpoint_id == SUBSCRIBE_ENDPOINT_ID) {
+            subscribe_handler(&input_buffer, &output_buffer);
+        } else {
+            count_endpoint_access(endpoint_id, input_buffer.size());
+            fibre::endpoint_handler(endpoint_id, &input_buffer, &output_buffer);
+        }
 
         // Send response
         if (expect_response) {
             size_t actual_response_length = expected_response_length - output_buffer.size() + 2;
-            write_le<uint16_t>(seq_no | 0x8000, tx_buf_);
+            write_le<uint16_t>(seq_no | 0x8000, tx_buf_.begin());
 
             LOG_FIBRE("send packet:\r\n");
-            hexdump(tx_buf_, actual_response_length);
-            output_.process_packet(tx_buf_, actual_response_length);
+            hexdump(tx_buf_.begin(), actual_response_length);
+            output_.process_packet(tx_buf_.begin(), actual_response_length);
         }
     }
 
     return 0;
 }
+
+/**
+ * @brief Adds, updates or removes subscriptions of this channel.
+ *
+ * The request is a list of (uint16 endpoint ID, uint16 period) entries. A
+ * period of UNSUBSCRIBE removes the subscription of the endpoint, or all
+ * subscriptions for endpoint ID 0. The response holds the number of entries
+ * that were applied. The server stops at the first entry that is not a
+ * property or doesn't fit into the table of MAX_SUBSCRIPTIONS entries.
+ */
+bool BidirectionalPacketBasedChannel::subscribe_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    if (output_buffer->empty()) {
+        return false;
+    }
+    uint8_t& count = output_buffer->front();
+    count = 0;
+    *output_buffer += 1;
+
+    while (input_buffer->size() >= 4 && count < 0xff) {
+        const uint8_t* entry = input_buffer->begin();
+        uint16_t endpoint_id = entry[0] | (entry[1] << 8);
+        uint16_t period = entry[2] | (entry[3] << 8);
+
+        size_t i = 0;
+        while (i < num_subscriptions_ && subscriptions_[i].endpoint_id != endpoint_id) {
+            i++;
+        }
+
+        if (period == UNSUBSCRIBE && endpoint_id == 0) {
+            num_subscriptions_ = 0;
+        } else if (period == UNSUBSCRIBE) {
+            if (i < num_subscriptions_) {
+                subscriptions_[i] = subscriptions_[--num_subscriptions_];
+            }
+        } else {
+            Introspectable property;
+            if (!fibre::get_endpoint_property({fibre::json_crc_, endpoint_id}, &property)) {
+                break; // not a property, reading it could have side effects
+            }
+            if (i == num_subscriptions_) {
+                if (num_subscriptions_ >= MAX_SUBSCRIPTIONS) {
+                    break;
+                }
+                num_subscriptions_++;
+            }
+            subscriptions_[i] = {
+                .endpoint_id = endpoint_id,
+                .period = period,
+                .last_sent_ms = 0,
+                .sent = false,
+                .length = 0,
+                .value = {},
+            };
+        }
+
+        *input_buffer += 4;
+        count++;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends the values of the subscribed properties that are due.
+ *
+ * A subscription is due when its period has elapsed since its value was last
+ * sent. With SUBSCRIBE_ON_CHANGE it is only sent if the value differs from
+ * the last one that was sent. The values are packed into notifications of at
+ * most NOTIFICATION_BUF_SIZE bytes: NOTIFICATION_MARKER followed by
+ * (uint16 endpoint ID, uint8 length, value) entries.
+ *
+ * Must be called periodically by the thread that calls process_packet(). The
+ * subscriptions are checked at most once per millisecond.
+ */
+void BidirectionalPacketBasedChannel::publish(uint32_t now_ms) {
+    if (!num_subscriptions_ || now_ms == last_publish_ms_) {
+        return;
+    }
+    last_publish_ms_ = now_ms;
+
+    uint8_t* buf = notification_buf_[notification_buf_index_];
+    size_t pos = 0;
+    size_t first = 0; // first subscription in the current notification
+
+    auto flush = [&](size_t end) {
+        if (pos) {
+            if (output_.process_packet(buf, pos) != 0) {
+                for (size_t j = first; j < end; ++j) {
+                    subscriptions_[j].sent = false; // send again next time
+                }
+            }
+            notification_buf_index_ ^= 1;
+            buf = notification_buf_[notification_buf_index_];
+            pos = 0;
+        }
+        first = end;
+    };
+
+    for (size_t i = 0; i < num_subscriptions_; ++i) {
+        Subscription& sub = subscriptions_[i];
+        uint16_t period = sub.period & ~SUBSCRIBE_ON_CHANGE;
+        if (sub.sent && (uint32_t)(now_ms - sub.last_sent_ms) < period) {
+            continue;
+        }
+
+        uint8_t value[MAX_SUBSCRIBED_SIZE];
+        fibre::cbufptr_t input_buffer{value, (size_t)0};
+        fibre::bufptr_t output_buffer{value, sizeof(value)};
+        if (!fibre::endpoint_handler(sub.endpoint_id, &input_buffer, &output_buffer)) {
+            continue;
+        }
+        size_t length = sizeof(value) - output_buffer.size();
+        bool changed = !sub.sent || length != sub.length || memcmp(value, sub.value, length);
+        if ((sub.period & SUBSCRIBE_ON_CHANGE) && !changed) {
+            continue;
+        }
+
+        if (pos + 3 + length > NOTIFICATION_BUF_SIZE) {
+            flush(i);
+        }
+        if (!pos) {
+            pos += write_le<uint16_t>(NOTIFICATION_MARKER, buf);
+        }
+        pos += write_le<uint16_t>(sub.endpoint_id, buf + pos);
+        buf[pos++] = (uint8_t)length;
+        memcpy(buf + pos, value, length);
+        pos += length;
+
+        sub.sent = true;
+        sub.length = (uint8_t)length;
+        memcpy(sub.value, value, length);
+        sub.last_sent_ms = now_ms;
+    }
+    flush(num_subscriptions_);
+}
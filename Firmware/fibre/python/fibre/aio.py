@@ -0,0 +1,138 @@
+"""
+asyncio interface to Fibre objects (Python 3.5 or later)
+
+The blocking API waits for each response on the calling thread. Here the
+requests are sent from the event loop and the responses are delivered to it
+by the receiver thread that every channel already has, so many properties of
+many devices can be accessed concurrently from one thread:
+
+    odrv0 = fibre.aio.AsyncObject(odrive.find_any())
+    pos, vel = await asyncio.gather(odrv0.axis0.encoder.pos_estimate,
+                                    odrv0.axis0.encoder.vel_estimate)
+    await odrv0.axis0.controller.write(input_pos=pos + 1.0)
+    await odrv0.save_configuration()
+
+Concurrent requests on the same channel are pipelined like in
+Channel.remote_endpoint_operations().
+"""
+
+import asyncio
+import fibre.protocol
+import fibre.remote_object
+from fibre.protocol import ChannelBrokenException, StreamBasedPacketSink
+
+
+class _FutureSignal():
+    """
+    Takes the place of the Event in Channel._expected_acks, which the
+    receiver thread sets when the response arrives
+    """
+    def __init__(self, loop, future):
+        self._loop = loop
+        self._future = future
+
+    def set(self):
+        self._loop.call_soon_threadsafe(self._set)
+
+    def _set(self):
+        if not self._future.done():
+            self._future.set_result(None)
+
+
+def _get_window(channel):
+    # Created on first use so that it belongs to the running event loop
+    window = getattr(channel, '_aio_window', None)
+    if window is None:
+        # Requests of a single property are 14 bytes on stream channels,
+        # see STREAM_PIPELINE_BYTES
+        size = (fibre.protocol.STREAM_PIPELINE_BYTES // 16
+                if isinstance(channel._output, StreamBasedPacketSink) else fibre.protocol.PIPELINE_WINDOW)
+        window = channel._aio_window = asyncio.Semaphore(max(size, 1))
+    return window
+
+async def remote_endpoint_operation(channel, endpoint_id, input, output_length):
+    """
+    Same as Channel.remote_endpoint_operation() with expect_ack = True, but
+    waits for the response without blocking the event loop
+    """
+    loop = asyncio.get_event_loop()
+    async with _get_window(channel):
+        seq_no, packet = channel._make_request(endpoint_id, input, True, output_length)
+        future = loop.create_future()
+        signal = _FutureSignal(loop, future)
+        channel._expected_acks[seq_no] = signal
+        broken_sub = channel._channel_broken.subscribe(signal.set)
+        try:
+            for attempt in range(channel._send_attempts):
+                if not channel._send_request(packet):
+                    continue # resend
+                try:
+                    await asyncio.wait_for(asyncio.shield(future), channel._resend_timeout)
+                except asyncio.TimeoutError:
+                    continue # resend
+                if seq_no not in channel._responses:
+                    raise ChannelBrokenException()
+                return channel._responses.pop(seq_no)
+            raise ChannelBrokenException() # Too many resend attempts
+        finally:
+            channel._channel_broken.unsubscribe(broken_sub)
+            channel._expected_acks.pop(seq_no, None)
+            channel._responses.pop(seq_no, None)
+
+
+async def get_value(prop):
+    buffer = await remote_endpoint_operation(prop.__channel__, prop._id, None, prop._codec.get_length())
+    return prop._codec.deserialize(buffer)
+
+async def set_value(prop, value):
+    await remote_endpoint_operation(prop.__channel__, prop._id, prop._codec.serialize(value), 0)
+
+async def call(func, *args):
+    if (len(func._inputs) != len(args)):
+        raise TypeError("expected {} arguments but have {}".format(len(func._inputs), len(args)))
+    # The inputs must be written before the trigger
+    for prop, arg in zip(func._inputs, args):
+        await set_value(prop, arg)
+    await remote_endpoint_operation(func._parent.__channel__, func._trigger_id, None, 0)
+    if len(func._outputs) > 0:
+        return await get_value(func._outputs[0])
+
+async def read_properties(properties):
+    """
+    Reads several properties, which may belong to different devices, at the
+    same time. Returns the list of values.
+    """
+    return await asyncio.gather(*[get_value(p) for p in properties])
+
+
+class AsyncObject():
+    """
+    View of a RemoteObject in which reading a property returns an awaitable
+    and functions are coroutines
+    """
+    def __init__(self, obj):
+        self._obj = obj
+
+    def __getattr__(self, name):
+        attr = self._obj._remote_attributes.get(name, None)
+        if isinstance(attr, fibre.remote_object.RemoteObject):
+            return AsyncObject(attr)
+        elif isinstance(attr, fibre.remote_object.RemoteProperty):
+            if not attr._can_read:
+                raise Exception("Cannot read from property {}".format(name))
+            return get_value(attr)
+        elif isinstance(attr, fibre.remote_object.RemoteFunction):
+            return lambda *args: call(attr, *args)
+        raise AttributeError("Attribute {} not found".format(name))
+
+    async def write(self, **values):
+        """
+        Writes properties of this object in the order given
+        """
+        for name, value in values.items():
+            attr = self._obj._remote_attributes.get(name, None)
+            if not isinstance(attr, fibre.remote_object.RemoteProperty):
+                raise AttributeError("Attribute {} not found".format(name))
+            if not attr._can_write:
+                raise Exception("Cannot write to property {}".format(name))
+            await set_value(attr, value)
@@ -0,0 +1,138 @@
+"""
+Measures the latency and throughput of a Fibre channel.
+
+Works with any transport that fibre.find_any() supports (usb, serial for
+both USB CDC and UART, tcp, udp), against a device or fibre/test/test_server.
+
+Usage:
+    python3 -m fibre.benchmark --path tcp:localhost:9910
+    python3 -m fibre.benchmark --path serial:/dev/ttyACM0 --property vbus_voltage
+"""
+
+import sys
+import json
+import time
+import argparse
+import fibre
+import fibre.protocol
+from fibre.remote_object import RemoteObject, RemoteProperty
+
+def find_property(obj, path=None):
+    """
+    Returns the RemoteProperty at the dotted path (e.g. "axis0.encoder.pos_estimate")
+    or the first readable property of up to 4 bytes if path is None.
+    """
+    if path is not None:
+        for name in path.split('.'):
+            attr = obj._remote_attributes.get(name, None)
+            if attr is None:
+                raise Exception("{} not found".format(path))
+            obj = attr
+        if not isinstance(obj, RemoteProperty):
+            raise Exception("{} is not a property".format(path))
+        return obj
+
+    candidates = [obj]
+    while candidates:
+        o = candidates.pop(0)
+        for attr in o._remote_attributes.values():
+            if isinstance(attr, RemoteProperty) and attr._can_read and 0 < attr._codec.get_length() <= 4:
+                return attr
+            elif isinstance(attr, RemoteObject):
+                candidates.append(attr)
+    raise Exception("the device has no readable property")
+
+def percentile(sorted_values, p):
+    return sorted_values[min(int(p / 100.0 * len(sorted_values)), len(sorted_values) - 1)]
+
+def measure_latency(channel, prop, n):
+    """
+    Returns the round trip times [s] of n sequential reads, sorted.
+    """
+    rtts = []
+    length = prop._codec.get_length()
+    for _ in range(n):
+        start = time.perf_counter()
+        channel.remote_endpoint_operation(prop._id, None, True, length)
+        rtts.append(time.perf_counter() - start)
+    return sorted(rtts)
+
+def measure_pipelined(channel, prop, n, window):
+    """
+    Returns the reads per second with up to window requests in flight.
+    """
+    operations = [(prop._id, None, prop._codec.get_length())] * n
+    start = time.perf_counter()
+    channel.remote_endpoint_operations(operations, window=window)
+    return n / (time.perf_counter() - start)
+
+def measure_batched(channel, prop, n):
+    """
+    Returns the reads per second with several reads per request.
+    """
+    operations = [(prop._id, None, prop._codec.get_length())] * n
+    start = time.perf_counter()
+    channel.remote_endpoint_batch(operations)
+    return n / (time.perf_counter() - start)
+
+def measure_bulk(channel, duration):
+    """
+    Returns the bytes per second of reading the JSON definition (endpoint 0).
+    """
+    n_bytes = 0
+    start = time.perf_counter()
+    while time.perf_counter() - start < duration:
+        n_bytes += len(channel.remote_endpoint_read_buffer(0))
+    return n_bytes / (time.perf_counter() - start)
+
+def run_benchmark(obj, prop=None, n=1000, bulk_duration=2.0, printfunc=print):
+    """
+    Runs all measurements on the channel of obj. Returns the results as a dict.
+    prop: the property to read, see find_property()
+    """
+    channel = obj.__channel__
+    prop = prop if isinstance(prop, RemoteProperty) else find_property(obj, prop)
+    results = {'channel': channel._name, 'property': prop._name, 'packet_size': channel._max_packet_size}
+
+    rtts = measure_latency(channel, prop, n)
+    results['latency_us'] = {p: percentile(rtts, p) * 1e6 for p in [50, 90, 99]}
+    results['latency_us']['max'] = rtts[-1] * 1e6
+    results['reads_per_s'] = {'sequential': n / sum(rtts)}
+    window = 1
+    while window <= fibre.protocol.PIPELINE_WINDOW:
+        results['reads_per_s']['pipelined_{}'.format(window)] = measure_pipelined(channel, prop, n, window)
+        window *= 2
+    results['reads_per_s']['batched'] = measure_batched(channel, prop, n)
+    results['supports_batch'] = channel._supports_batch
+    results['bulk_bytes_per_s'] = measure_bulk(channel, bulk_duration)
+
+    printfunc("{} reading {} ({} byte packets)".format(results['channel'], results['property'], results['packet_size']))
+    printfunc("  latency    " + "  ".join("p{} {:.0f}us".format(k, v) if k != 'max' else "max {:.0f}us".format(v)
+                                          for k, v in results['latency_us'].items()))
+    for k, v in results['reads_per_s'].items():
+        printfunc("  {:14s} {:8.0f} reads/s".format(k, v))
+    if not results['supports_batch']:
+        printfunc("  (the device doesn't support batch requests, batched is pipelined)")
+    printfunc("  bulk       {:8.0f} bytes/s".format(results['bulk_bytes_per_s']))
+    return results
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Measures the latency and throughput of a Fibre channel.')
+    parser.add_argument('-p', '--path', default='usb', help='The path of the device, e.g. usb, serial:/dev/ttyACM0 or tcp:localhost:9910')
+    parser.add_argument('-s', '--serial-number', default=None, help='The serial number of the device')
+    parser.add_argument('--property', default=None, help='The property to read, e.g. vbus_voltage. Defaults to the first small readable property.')
+    parser.add_argument('-n', type=int, default=1000, help='Number of reads per measurement')
+    parser.add_argument('--bulk-duration', type=float, default=2.0, help='Duration of the bulk read measurement [s]')
+    parser.add_argument('--json', default=None, help='Also write the results to this JSON file')
+    args = parser.parse_args()
+
+    obj = fibre.find_any(path=args.path, serial_number=args.serial_number, timeout=10)
+    if obj is None:
+        print("no device found on " + args.path)
+        sys.exit(1)
+    results = run_benchmark(obj, args.property, args.n, args.bulk_duration)
+    if args.json:
+        with open(args.json, 'w') as fp:
+            json.dump(results, fp, indent=2)
+    sys.exit(0)
@@ -8,6 +8,7 @@ import time
 import threading
 import traceback
 import struct
+import zlib
 import fibre.protocol
 import fibre.utils
 import fibre.remote_object
@@ -16,6 +17,32 @@ from fibre.protocol import ChannelBrokenException, TimeoutError
 import appdirs
 import os
 
+def decode_json_definition(json_bytes):
+    """
+    Returns the JSON string that was read from endpoint 0. Newer firmware
+    stores it zlib compressed, older firmware as plain text.
+    """
+    if json_bytes[:1] == b'\x78':
+        json_bytes = zlib.decompress(json_bytes)
+    return json_bytes.decode("ascii")
+
+def load_json_pages(channel, paths):
+    """
+    Fetches only the given objects of the JSON definition, e.g.
+    ["axis0.controller", "axis1"], which is much faster than the whole
+    definition on slow links. Each path must be an object on the first or
+    second level. Returns a dict of path -> JSON object, or None if the
+    device doesn't support this.
+    """
+    objects = {}
+    for path in paths:
+        page = channel.remote_json_page(path)
+        if page is None:
+            return None
+        # The pages are raw deflate data cut out of the zlib stream at full flushes
+        objects[path] = json.loads(zlib.decompressobj(-zlib.MAX_WBITS).decompress(bytes(page)).decode("ascii"))
+    return objects
+
 # Load all installed transport layers
 
 channel_types = {}
@@ -47,6 +74,61 @@ except ImportError:
 def noprint(text):
     pass
 
+# JSON definitions that were loaded in this process, by JSON version ID. The
+# lock of each version makes devices with the same firmware that connect at
+# the same time wait for the first one to load the definition instead of all
+# downloading it.
+json_cache = {}
+json_cache_locks = {}
+json_cache_lock = threading.Lock()
+
+def load_json_definition(channel, json_version_tag, logger):
+    """
+    Returns the JSON definition of the device as read from endpoint 0. It is
+    taken from the cache of this process or the cache file if the device
+    reports a JSON version ID that was seen before.
+    """
+    cache_dir = appdirs.user_cache_dir("odrivetool")
+    cache_path = None
+    if json_version_tag is not None:
+        cache_path = os.path.join(cache_dir, 'fibre_schema_cache_{:08d}'.format(json_version_tag))
+        json_bytes = json_cache.get(json_version_tag, None)
+        if json_bytes is not None:
+            return json_bytes
+
+        # Check cache
+        try:
+            with open(cache_path, 'rb') as fp:
+                json_bytes = fp.read()
+            decode_json_definition(json_bytes)
+            json_cache[json_version_tag] = json_bytes
+            return json_bytes
+        except:
+            logger.debug("Failed load JSON cache file {}".format(cache_path))
+
+    # Fallback to loading JSON from device
+    logger.info("Downloading json data from ODrive... (this might take a while)")
+    json_bytes = channel.remote_endpoint_read_buffer(0)
+    try:
+        decode_json_definition(json_bytes)
+    except (UnicodeDecodeError, zlib.error):
+        logger.debug("Device responded on endpoint 0 with something that is not JSON")
+        raise
+
+    # Save JSON to cache
+    if not cache_path is None:
+        json_cache[json_version_tag] = json_bytes
+        logger.debug("Creating new JSON cache file {}".format(cache_path))
+        try:
+            os.makedirs(cache_dir, exist_ok=True)
+            # Stored as received, so that the CRC can be checked
+            with open(cache_path, 'wb') as json_cache_file:
+                json_cache_file.write(json_bytes)
+            logger.debug("Saved JSON to cache file {}".format(cache_path))
+        except Exception as ex:
+            logger.warn("Failed to cache JSON: {}".format(ex))
+    return json_bytes
+
 def find_all(path, serial_number,
          discovered_object_callback,
          search_cancellation_token,
@@ -56,6 +138,8 @@ def find_all(path, serial_number,
     Starts scanning for Fibre nodes that match the specified path spec and calls
     the callback for each Fibre node that is found.
     This function is non-blocking.
+    Devices are connected in parallel, so the callback can be called from
+    several threads at the same time.
     """
 
     def discovered_channel(channel):
@@ -68,55 +152,34 @@ def find_all(path, serial_number,
         try:
             logger.debug("Connecting to device on " + channel._name)
 
-            cache_dir = appdirs.user_cache_dir("odrivetool")
-            cache_path = None
-
             # Fetch the json version tag to check cache (only supported on firmware v0.5 or later)
+            json_version_tag = None
             try:
                 json_version_tag = channel.remote_endpoint_operation(0, struct.pack("<I", 0xffffffff), True, 4)
                 json_version_tag = struct.unpack("<I", json_version_tag)[0]
-
                 logger.debug("Device reported JSON version ID: {:08d}".format(json_version_tag))
-                cache_path = os.path.join(cache_dir, 'fibre_schema_cache_{:08d}'.format(json_version_tag))
             except:
+                json_version_tag = None
                 logger.debug("Failed to get JSON checksum")
 
-            # Check cache
-            json_data = None
+            # Use larger packets if the device supports them (not supported by older firmware)
             try:
-                if not cache_path is None:
-                    with open(cache_path, 'rb') as fp:
-                        json_crc16 = fibre.protocol.calc_crc16(fibre.protocol.PROTOCOL_VERSION, fp.read())
-                        fp.seek(0)
-                        json_data = json.load(fp)
+                channel.negotiate_packet_size()
+                logger.debug("Max packet size: {}".format(channel._max_packet_size))
             except:
-                logger.debug("Failed load JSON cache file {}".format(cache_path))
-
-            # Fallback to loading JSON from device
-            if json_data is None:
-                # Downloading json data
-                logger.info("Downloading json data from ODrive... (this might take a while)")
-                json_bytes = channel.remote_endpoint_read_buffer(0)
-                try:
-                    json_string = json_bytes.decode("ascii")
-                except UnicodeDecodeError:
-                    logger.debug("Device responded on endpoint 0 with something that is not ASCII")
-                    raise UnicodeDecodeError
-
-                json_crc16 = fibre.protocol.calc_crc16(fibre.protocol.PROTOCOL_VERSION, json_bytes)
-                json_data = json.loads(json_string)
-
-                # Save JSON to cache
-                if not cache_path is None:
-                    logger.debug("Creating new JSON cache file {}".format(cache_path))
-                    try:
-                        os.makedirs(cache_dir, exist_ok=True)
-                        with open(cache_path, 'w+') as json_cache:
-                            json_cache.write(json_string)
-                        logger.debug("Saved JSON to cache file {}".format(cache_path))
-                    except Exception as ex:
-                        logger.warn("Failed to cache JSON: {}".format(ex))
-
+                logger.debug("Failed to negotiate packet size")
+
+            if json_version_tag is None:
+                json_bytes = load_json_definition(channel, None, logger)
+            else:
+                with json_cache_lock:
+                    lock = json_cache_locks.setdefault(json_version_tag, threading.Lock())
+                with lock:
+                    json_bytes = load_json_definition(channel, json_version_tag, logger)
+
+            # Parsed for each device since users of _json_data may modify it
+            json_crc16 = fibre.protocol.calc_crc16(fibre.protocol.PROTOCOL_VERSION, json_bytes)
+            json_data = json.loads(decode_json_definition(json_bytes))
             channel._interface_definition_crc = json_crc16
 
             logger.debug("JSON: " + str(json_data).replace("{'name'", "\n{'name'"))
@@ -138,13 +201,20 @@ def find_all(path, serial_number,
         except Exception:
             logger.debug("Unexpected exception after discovering channel: " + traceback.format_exc())
 
+    def discovered_channel_async(channel):
+        # Connects in the background so that the transport can go on with
+        # the next device right away
+        t = threading.Thread(target=discovered_channel, args=(channel,))
+        t.daemon = True
+        t.start()
+
     # For each connection type, kick off an appropriate discovery loop
     for search_spec in path.split(','):
         prefix = search_spec.split(':')[0]
         the_rest = ':'.join(search_spec.split(':')[1:])
         if prefix in channel_types:
             t = threading.Thread(target=channel_types[prefix],
-                             args=(the_rest, serial_number, discovered_channel, search_cancellation_token, channel_termination_token, logger))
+                             args=(the_rest, serial_number, discovered_channel_async, search_cancellation_token, channel_termination_token, logger))
             t.daemon = True
             t.start()
         else:
@@ -27,6 +27,25 @@ CRC8_DEFAULT = 0x37 # this must match the polynomial in the C++ implementation
 CRC16_DEFAULT = 0x3d65 # this must match the polynomial in the C++ implementation
 
 MAX_PACKET_SIZE = 128
+MAX_LARGE_PACKET_SIZE = 0x7fff # with the 4 byte header on stream based channels
+
+# Reserved endpoint ID of a request that carries a list of endpoint operations
+BATCH_ENDPOINT_ID = 0x7fff
+BATCH_REQUEST_SIZE = 56 # so that the request still fits into one USB packet
+BATCH_RESPONSE_SIZE = 30 # TX_BUF_SIZE of the device minus the sequence number
+
+# Number of requests that are sent before the response to the first one has
+# arrived, see Channel.remote_endpoint_operations()
+PIPELINE_WINDOW = 8
+# UART devices receive into a 64 byte ring buffer that is not drained while
+# they send a response, so this limits the bytes in flight on stream channels
+STREAM_PIPELINE_BYTES = 48
+
+SUBSCRIBE_ENDPOINT_ID = 0x7ffe
+SUBSCRIBE_ON_CHANGE = 0x8000
+UNSUBSCRIBE = 0xffff
+SUBSCRIBE_REQUEST_ENTRIES = 12 # so that the request still fits into one USB packet
+NOTIFICATION_MARKER = 0x734E
 
 # For more information on the CRC algorithm refer to protocol.md
 
@@ -102,6 +121,27 @@ class PacketSink(ABC):
         pass
 
 
+def make_packet_header(length):
+    """
+    Returns the header of a packet on a stream based channel. Packets of 128
+    bytes and more get a 4 byte header with a 15 bit length.
+    """
+    header = bytearray()
+    header.append(SYNC_BYTE)
+    if length < 128:
+        header.append(length)
+    else:
+        header.append(0x80 | (length >> 8))
+        header.append(length & 0xff)
+    header.append(calc_crc8(CRC8_INIT, header))
+    return header
+
+def get_packet_length(header):
+    if len(header) == 4:
+        return ((header[1] & 0x7f) << 8) | header[2]
+    return header[1]
+
+
 class StreamToPacketSegmenter(StreamSink):
     def __init__(self, output):
         self._header = []
@@ -117,23 +157,23 @@ class StreamToPacketSegmenter(StreamSink):
         """
 
         for byte in bytes:
-            if (len(self._header) < 3):
+            header_length = 4 if len(self._header) >= 2 and (self._header[1] & 0x80) else 3
+            if (len(self._header) < header_length):
                 # Process header byte
                 self._header.append(byte)
+                header_length = 4 if len(self._header) >= 2 and (self._header[1] & 0x80) else 3
                 if (len(self._header) == 1) and (self._header[0] != SYNC_BYTE):
                     self._header = []
-                elif (len(self._header) == 2) and (self._header[1] & 0x80):
-                    self._header = [] # TODO: support packets larger than 128 bytes
-                elif (len(self._header) == 3) and calc_crc8(CRC8_INIT, self._header):
+                elif (len(self._header) == header_length) and calc_crc8(CRC8_INIT, self._header):
                     self._header = []
-                elif (len(self._header) == 3):
-                    self._packet_length = self._header[1] + 2
+                elif (len(self._header) == header_length):
+                    self._packet_length = get_packet_length(self._header) + 2
             else:
                 # Process payload byte
                 self._packet.append(byte)
 
             # If both header and packet are fully received, hand it on to the packet processor
-            if (len(self._header) == 3) and (len(self._packet) == self._packet_length):
+            if (len(self._header) == header_length) and (len(self._packet) == self._packet_length):
                 if calc_crc16(CRC16_INIT, self._packet) == 0:
                     self._output.process_packet(self._packet[:-2])
                 self._header = []
@@ -146,15 +186,10 @@ class StreamBasedPacketSink(PacketSink):
         self._output = output
 
     def process_packet(self, packet):
-        if (len(packet) >= MAX_PACKET_SIZE):
-            raise NotImplementedError("packet larger than 127 currently not supported")
+        if (len(packet) > MAX_LARGE_PACKET_SIZE):
+            raise NotImplementedError("packet larger than {} not supported".format(MAX_LARGE_PACKET_SIZE))
 
-        header = bytearray()
-        header.append(SYNC_BYTE)
-        header.append(len(packet))
-        header.append(calc_crc8(CRC8_INIT, header))
-
-        self._output.process_bytes(header)
+        self._output.process_bytes(make_packet_header(len(packet)))
         self._output.process_bytes(packet)
 
         # append CRC in big endian
@@ -164,35 +199,45 @@ class StreamBasedPacketSink(PacketSink):
 class PacketFromStreamConverter(PacketSource):
     def __init__(self, input):
         self._input = input
+        # Header and payload of the packet that is being received. They are
+        # kept if the deadline is reached in the middle of a packet, otherwise
+        # the rest of the packet would be discarded as garbage on the next call.
+        self._buffer = bytearray()
+
+    def _receive_until(self, n_bytes, deadline):
+        if len(self._buffer) < n_bytes:
+            self._buffer += self._input.get_bytes(n_bytes - len(self._buffer), deadline)
+        if len(self._buffer) < n_bytes:
+            raise TimeoutError("expected {} bytes but got only {}".format(n_bytes, len(self._buffer)))
     
     def get_packet(self, deadline):
         """
         Requests bytes from the underlying input stream until a full packet is
-        received or the deadline is reached, in which case None is returned. A
-        deadline before the current time corresponds to non-blocking mode.
+        received or the deadline is reached, in which case TimeoutError is
+        raised. A deadline before the current time corresponds to non-blocking
+        mode.
         """
         while True:
-            header = bytes()
-
-            # TODO: sometimes this call hangs, even though the device apparently sent something
-            header = header + self._input.get_bytes_or_fail(1, deadline)
-            if (header[0] != SYNC_BYTE):
+            self._receive_until(1, deadline)
+            if (self._buffer[0] != SYNC_BYTE):
                 #print("sync byte mismatch")
+                self._buffer.clear()
                 continue
 
-            header = header + self._input.get_bytes_or_fail(1, deadline)
-            if (header[1] & 0x80):
-                #print("packet too large")
-                continue # TODO: support packets larger than 128 bytes
-
-            header = header + self._input.get_bytes_or_fail(1, deadline)
+            self._receive_until(2, deadline)
+            header_length = 4 if (self._buffer[1] & 0x80) else 3
+            self._receive_until(header_length, deadline)
+            header = bytes(self._buffer[:header_length])
             if calc_crc8(CRC8_INIT, header) != 0:
                 #print("crc8 mismatch")
+                del self._buffer[0] # the real header may start within this one
                 continue
 
-            packet_length = header[1] + 2
+            packet_length = get_packet_length(header) + 2
             #print("wait for {} bytes".format(packet_length))
-            packet = self._input.get_bytes_or_fail(packet_length, deadline)
+            self._receive_until(header_length + packet_length, deadline)
+            packet = bytes(self._buffer[header_length:])
+            self._buffer.clear()
             if calc_crc16(CRC16_INIT, packet) != 0:
                 #print("crc16 mismatch")
                 continue
@@ -220,6 +265,11 @@ class Channel(PacketSink):
         self._interface_definition_crc = 0
         self._expected_acks = {}
         self._responses = {}
+        self._unsolicited_packet_handlers = {NOTIFICATION_MARKER: self._process_notification}
+        self._subscription_callbacks = {}
+        self._supports_batch = True
+        self._max_packet_size = MAX_PACKET_SIZE - 1
+        self._large_packets = False
         self._my_lock = threading.Lock()
         self._channel_broken = Event(cancellation_token)
         self.start_receiver_thread(Event(self._channel_broken))
@@ -258,14 +308,19 @@ class Channel(PacketSink):
         t.daemon = True
         t.start()
 
-    def remote_endpoint_operation(self, endpoint_id, input, expect_ack, output_length):
+    def _make_request(self, endpoint_id, input, expect_ack, output_length):
+        """
+        Returns the sequence number and the packet of a request
+        """
         if input is None:
             input = bytearray(0)
-        if (len(input) >= 128):
-            raise Exception("packet larger than 127 currently not supported")
+        if (len(input) + 8 > self._max_packet_size):
+            raise Exception("packet larger than {} not supported".format(self._max_packet_size))
 
         if (expect_ack):
             endpoint_id |= 0x8000
+        if (self._large_packets):
+            output_length |= 0x8000 # we accept responses of 128 bytes and more
 
         self._my_lock.acquire()
         try:
@@ -284,6 +339,10 @@ class Channel(PacketSink):
             trailer = self._interface_definition_crc
         #print("append trailer " + trailer)
         packet = packet + struct.pack('<H', trailer)
+        return seq_no, packet
+
+    def remote_endpoint_operation(self, endpoint_id, input, expect_ack, output_length):
+        seq_no, packet = self._make_request(endpoint_id, input, expect_ack, output_length)
 
         if (expect_ack):
             ack_event = Event()
@@ -319,21 +378,240 @@ class Channel(PacketSink):
             # fire and forget
             self._output.process_packet(packet)
             return None
+
+    def _send_request(self, packet):
+        """
+        Sends a packet and returns False if it should be resent
+        """
+        self._my_lock.acquire()
+        try:
+            self._output.process_packet(packet)
+            return True
+        except (ChannelDamagedException, TimeoutError):
+            return False
+        finally:
+            self._my_lock.release()
+
+    def remote_endpoint_operations(self, operations, window=PIPELINE_WINDOW):
+        """
+        Carries out a list of endpoint operations without waiting for the
+        response to one request before sending the next. Up to `window`
+        requests are outstanding at a time and the responses are matched by
+        their sequence number.
+        operations: list of (endpoint_id, input, output_length) tuples
+        Returns the list of outputs.
+        """
+        window_bytes = STREAM_PIPELINE_BYTES if isinstance(self._output, StreamBasedPacketSink) else None
+        results = [None] * len(operations)
+        pending = [] # [index, seq_no, packet, ack_event, attempts, deadline] in the order they were sent
+        next_index = 0
+        try:
+            while next_index < len(operations) or pending:
+                # Fill the window
+                while next_index < len(operations) and len(pending) < window:
+                    endpoint_id, input, output_length = operations[next_index]
+                    if pending and window_bytes and sum(len(p[2]) + 6 for p in pending) + len(input or b'') + 14 > window_bytes:
+                        break # 8 bytes of request header and trailer plus 6 bytes of stream framing
+                    seq_no, packet = self._make_request(endpoint_id, input, True, output_length)
+                    ack_event = Event()
+                    self._expected_acks[seq_no] = ack_event
+                    attempts = 1 if self._send_request(packet) else 0
+                    pending.append([next_index, seq_no, packet, ack_event, attempts, time.monotonic() + self._resend_timeout])
+                    next_index += 1
+
+                # Wait for the oldest request
+                entry = pending[0]
+                index, seq_no, packet, ack_event, attempts, deadline = entry
+                try:
+                    if wait_any(max(deadline - time.monotonic(), 0), ack_event, self._channel_broken) != 0:
+                        raise ChannelBrokenException()
+                except TimeoutError:
+                    if attempts >= self._send_attempts:
+                        raise ChannelBrokenException() # Too many resend attempts
+                    if self._send_request(packet):
+                        entry[4] += 1
+                    entry[5] = time.monotonic() + self._resend_timeout
+                    continue
+                results[index] = self._responses.pop(seq_no)
+                self._expected_acks.pop(seq_no)
+                pending.pop(0)
+        finally:
+            for index, seq_no, packet, ack_event, attempts, deadline in pending:
+                self._expected_acks.pop(seq_no, None)
+                self._responses.pop(seq_no, None)
+        return results
     
+    def remote_endpoint_batch(self, operations):
+        """
+        Carries out a list of endpoint operations with as few round trips as
+        possible by sending several operations per request. The requests are
+        pipelined, see remote_endpoint_operations().
+        operations: list of (endpoint_id, input, output_length) tuples
+        Returns the list of outputs. Devices that don't support batch requests
+        get one request per operation.
+        """
+        if not self._supports_batch:
+            return self.remote_endpoint_operations(operations)
+
+        requests = [] # (pos, end, request, response_length)
+        pos = 0
+        while pos < len(operations):
+            request = bytes()
+            response_length = 1
+            end = pos
+            while end < len(operations):
+                endpoint_id, input, output_length = operations[end]
+                input = input or bytes()
+                if end > pos and (len(request) + 4 + len(input) > BATCH_REQUEST_SIZE or
+                                  response_length + output_length > BATCH_RESPONSE_SIZE):
+                    break
+                request += struct.pack('<HBB', endpoint_id, len(input), output_length) + input
+                response_length += output_length
+                end += 1
+            requests.append((pos, end, request, response_length))
+            pos = end
+
+        responses = self.remote_endpoint_operations([(BATCH_ENDPOINT_ID, request, response_length)
+                                                     for pos, end, request, response_length in requests])
+        results = []
+        for (pos, end, request, response_length), response in zip(requests, responses):
+            if len(response) == 0:
+                self._supports_batch = False # older firmware
+                return results + self.remote_endpoint_operations(operations[pos:])
+            count = response[0]
+            if count == 0:
+                raise Exception("endpoint operation on endpoint {} failed".format(operations[pos][0]))
+            offset = 1
+            for endpoint_id, input, output_length in operations[pos:pos + count]:
+                results.append(response[offset:offset + output_length])
+                offset += output_length
+            if pos + count < end:
+                # The server stopped early, carry out the rest of this request
+                results += self.remote_endpoint_batch(operations[pos + count:end])
+        return results
+
+    def remote_endpoint_subscribe(self, subscriptions):
+        """
+        Asks the device to send the values of properties on its own.
+        subscriptions: list of (endpoint_id, period_ms, on_change, callback)
+        tuples. The value is sent every period_ms milliseconds, with
+        on_change only if it changed. callback is called with the serialized
+        value on the receiver thread of this channel. A callback of None
+        removes the subscription.
+        """
+        for pos in range(0, len(subscriptions), SUBSCRIBE_REQUEST_ENTRIES):
+            chunk = subscriptions[pos:pos + SUBSCRIBE_REQUEST_ENTRIES]
+            request = bytes()
+            for endpoint_id, period_ms, on_change, callback in chunk:
+                if callback is None:
+                    period = UNSUBSCRIBE
+                elif period_ms < 0 or period_ms >= SUBSCRIBE_ON_CHANGE:
+                    raise ValueError("period must be between 0 and {} ms".format(SUBSCRIBE_ON_CHANGE - 1))
+                else:
+                    period = int(period_ms) | (SUBSCRIBE_ON_CHANGE if on_change else 0)
+                request += struct.pack('<HH', endpoint_id, period)
+                # Set up before the request, notifications can arrive before the response
+                if callback is None:
+                    self._subscription_callbacks.pop(endpoint_id, None)
+                else:
+                    self._subscription_callbacks[endpoint_id] = callback
+
+            response = self.remote_endpoint_operation(SUBSCRIBE_ENDPOINT_ID, request, True, 1)
+            count = response[0] if len(response) else 0
+            for endpoint_id, period_ms, on_change, callback in chunk[count:]:
+                self._subscription_callbacks.pop(endpoint_id, None)
+            if len(response) == 0:
+                raise NotImplementedError("the device doesn't support subscriptions (older firmware)")
+            if count < len(chunk):
+                raise Exception("subscription of endpoint {} failed".format(chunk[count][0]))
+
+    def remote_endpoint_unsubscribe_all(self):
+        self.remote_endpoint_operation(SUBSCRIBE_ENDPOINT_ID, struct.pack('<HH', 0, UNSUBSCRIBE), True, 1)
+        self._subscription_callbacks = {}
+
+    def _process_notification(self, payload):
+        pos = 0
+        while pos + 3 <= len(payload):
+            endpoint_id, length = struct.unpack('<HB', payload[pos:pos + 3])
+            value = payload[pos + 3:pos + 3 + length]
+            pos += 3 + length
+            callback = self._subscription_callbacks.get(endpoint_id, None)
+            if callback:
+                try:
+                    callback(value)
+                except Exception:
+                    self._logger.debug("subscription callback failed: " + traceback.format_exc())
+
     def remote_endpoint_read_buffer(self, endpoint_id):
         """
-        Handles reads from long endpoints
+        Handles reads from long endpoints. Returns a bytearray, which
+        numpy.frombuffer() and memoryview() can use without a copy.
         """
         # TODO: handle device that could (maliciously) send infinite stream
-        buffer = bytes()
-        while True:
-            chunk_length = 512
-            chunk = self.remote_endpoint_operation(endpoint_id, struct.pack("<I", len(buffer)), True, chunk_length)
-            if (len(chunk) == 0):
-                break
-            buffer += chunk
+        chunk_length = self._max_packet_size - 2 if self._large_packets else 512
+        buffer = bytearray(self.remote_endpoint_operation(endpoint_id, struct.pack("<I", 0), True, chunk_length))
+        step = len(buffer) # the server's limit of the response size
+        while step:
+            # The following chunks are requested in advance assuming that
+            # all of them come back full until the end of the buffer
+            offsets = [len(buffer) + i * step for i in range(PIPELINE_WINDOW)]
+            chunks = self.remote_endpoint_operations([(endpoint_id, struct.pack("<I", offset), chunk_length) for offset in offsets])
+            for chunk in chunks:
+                if len(chunk) == 0:
+                    return buffer
+                buffer += chunk
+                if len(chunk) != step:
+                    break # the offsets of the following chunks are off
         return buffer
 
+    def remote_json_page(self, path):
+        """
+        Reads the compressed bytes of one object of the JSON definition, e.g.
+        "axis0.controller", without the rest of it. Returns None if the device
+        has no page for path, e.g. because its firmware predates paging.
+        See fibre.discovery.load_json_pages().
+        """
+        response = self.remote_endpoint_operation(0, struct.pack('<I', 0xfffffffd) + path.encode('ascii'), True, 8)
+        if len(response) != 8:
+            return None
+        offset, length = struct.unpack('<II', response)
+        chunk_length = self._max_packet_size - 2 if self._large_packets else 512
+        buffer = bytearray(self.remote_endpoint_operation(0, struct.pack('<I', offset), True, min(chunk_length, length)))
+        step = len(buffer) # the server's limit of the response size
+        if step and len(buffer) < length:
+            offsets = range(offset + step, offset + length, step)
+            chunks = self.remote_endpoint_operations([(0, struct.pack('<I', o), min(step, offset + length - o)) for o in offsets])
+            buffer += b''.join(chunks)
+        return buffer if len(buffer) == length else None
+
+    def negotiate_packet_size(self):
+        """
+        Enables packets of 128 bytes and more if both this channel and the
+        device support them. Only stream based channels (UART, TCP and the
+        USB CDC interface) use the 4 byte packet header, so this does nothing
+        on other channels and on older firmware.
+        """
+        if not isinstance(self._output, StreamBasedPacketSink):
+            return
+        response = self.remote_endpoint_operation(0, struct.pack('<I', 0xfffffffe), True, 4)
+        if len(response) != 4:
+            return
+        max_packet_size = struct.unpack('<I', response)[0]
+        if max_packet_size >= MAX_PACKET_SIZE:
+            self._max_packet_size = min(max_packet_size, MAX_LARGE_PACKET_SIZE)
+            self._large_packets = True
+
+    def set_unsolicited_packet_handler(self, header, handler):
+        """
+        Registers a function that is called with the payload of every packet
+        that the device sends on its own initiative with the specified 16-bit
+        header (instead of a sequence number). Pass None to unregister.
+        """
+        if handler is None:
+            self._unsolicited_packet_handlers.pop(header, None)
+        else:
+            self._unsolicited_packet_handlers[header] = handler
+
     def process_packet(self, packet):
         #print("process packet")
         packet = bytes(packet)
@@ -355,5 +633,9 @@ class Channel(PacketSink):
         else:
             #if (calc_crc16(CRC16_INIT, struct.pack('<HBB', PROTOCOL_VERSION, packet[-2], packet[-1]))):
             #     raise Exception("CRC16 mismatch")
-            print("endpoint requested")
-            # TODO: handle local endpoint operation
+            handler = self._unsolicited_packet_handlers.get(seq_no, None)
+            if handler:
+                handler(packet[2:])
+            else:
+                print("endpoint requested")
+                # TODO: handle local endpoint operation
@@ -6,6 +6,7 @@ import sys
 import json
 import struct
 import threading
+import collections.abc
 import fibre.protocol
 
 class ObjectDefinitionError(Exception):
@@ -17,16 +18,17 @@ class StructCodec():
     """
     Generic serializer/deserializer based on struct pack
     """
+    __slots__ = ('_struct', '_length', '_target_type')
     def __init__(self, struct_format, target_type):
-        self._struct_format = struct_format
+        self._struct = struct.Struct(struct_format)
+        self._length = self._struct.size
         self._target_type = target_type
     def get_length(self):
-        return struct.calcsize(self._struct_format)
+        return self._length
     def serialize(self, value):
-        value = self._target_type(value)
-        return struct.pack(self._struct_format, value)
+        return self._struct.pack(self._target_type(value))
     def deserialize(self, buffer):
-        value = struct.unpack(self._struct_format, buffer)
+        value = self._struct.unpack(buffer)
         value = value[0] if len(value) == 1 else value
         return self._target_type(value)
 
@@ -36,6 +38,8 @@ class RemoteProperty():
     property assignments and fetches into endpoint operations on the
     object's associated channel
     """
+    __slots__ = ('_parent', '__channel__', '_id', '_name', '_property_type', '_codec', '_can_read', '_can_write')
+
     def __init__(self, json_data, parent):
         self._parent = parent
         self.__channel__ = parent.__channel__
@@ -52,30 +56,28 @@ class RemoteProperty():
         if type_str is None:
             raise ObjectDefinitionError("unspecified type")
 
-        # Find all codecs that match the type_str and build a dictionary
-        # of the form {type1: codec1, type2: codec2}
-        eligible_types = {k: v[type_str] for (k,v) in codecs.items() if type_str in v}
-        
-        if not eligible_types:
-            raise ObjectDefinitionError("unsupported codec {}".format(type_str))
-
+        # Use the first codec that matches the type_str
         # TODO: better heuristics to select a matching type (i.e. prefer non lossless)
-        eligible_types = list(eligible_types.items())
-        self._property_type = eligible_types[0][0]
-        self._codec = eligible_types[0][1]
+        for property_type, type_codecs in codecs.items():
+            if type_str in type_codecs:
+                self._property_type = property_type
+                self._codec = type_codecs[type_str]
+                break
+        else:
+            raise ObjectDefinitionError("unsupported codec {}".format(type_str))
 
         access_mode = json_data.get("access", "r")
         self._can_read = 'r' in access_mode
         self._can_write = 'w' in access_mode
 
     def get_value(self):
-        buffer = self._parent.__channel__.remote_endpoint_operation(self._id, None, True, self._codec.get_length())
+        buffer = self.__channel__.remote_endpoint_operation(self._id, None, True, self._codec.get_length())
         return self._codec.deserialize(buffer)
 
     def set_value(self, value):
         buffer = self._codec.serialize(value)
         # TODO: Currenly we wait for an ack here. Settle on the default guarantee.
-        self._parent.__channel__.remote_endpoint_operation(self._id, buffer, True, 0)
+        self.__channel__.remote_endpoint_operation(self._id, buffer, True, 0)
 
     def _dump(self):
         if self._name == "serial_number":
@@ -92,8 +94,9 @@ class EndpointRefCodec():
     """
     Serializer/deserializer for an endpoint reference
     """
+    __slots__ = ()
     def get_length(self):
-        return struct.calcsize("<HH")
+        return 4
     def serialize(self, value):
         if value is None:
             (ep_id, ep_crc) = (0, 0)
@@ -129,10 +132,55 @@ codecs[RemoteProperty] = {
 }
 
 
+def read_properties(properties):
+    """
+    Reads several properties of the same device with as few round trips as
+    possible. Returns the list of values.
+    """
+    if not properties:
+        return []
+    channel = properties[0].__channel__
+    buffers = channel.remote_endpoint_batch([(p._id, None, p._codec.get_length()) for p in properties])
+    return [p._codec.deserialize(buffer) for p, buffer in zip(properties, buffers)]
+
+def write_properties(properties, values):
+    """
+    Writes several properties of the same device with as few round trips as
+    possible.
+    """
+    if not properties:
+        return
+    channel = properties[0].__channel__
+    channel.remote_endpoint_batch([(p._id, p._codec.serialize(v), 0) for p, v in zip(properties, values)])
+
+def subscribe_properties(properties, callback, period_ms=0, on_change=True):
+    """
+    Makes the device send the values of several properties on its own instead
+    of being polled. callback(property, value) is called on the receiver
+    thread of the channel every period_ms milliseconds, or with on_change
+    only if the value changed since it was last sent. Only properties of up to
+    8 bytes can be subscribed, up to 16 per channel.
+    """
+    if not properties:
+        return
+    channel = properties[0].__channel__
+    def make_callback(prop):
+        return lambda buffer: callback(prop, prop._codec.deserialize(buffer))
+    channel.remote_endpoint_subscribe([(p._id, period_ms, on_change, make_callback(p)) for p in properties])
+
+def unsubscribe_properties(properties):
+    if not properties:
+        return
+    channel = properties[0].__channel__
+    channel.remote_endpoint_subscribe([(p._id, 0, False, None) for p in properties])
+
+
 class RemoteFunction(object):
     """
     Represents a callable function that maps to a function call on a remote object
     """
+    __slots__ = ('_parent', '_trigger_id', '_name', '_inputs', '_outputs')
+
     def __init__(self, json_data, parent):
         self._parent = parent
         id_str = json_data.get("id", None)
@@ -166,6 +214,69 @@ class RemoteFunction(object):
     def _dump(self):
         return "{}({})".format(self._name, ", ".join("{}: {}".format(x._name, x._property_type.__name__) for x in self._inputs))
 
+class RemoteAttributes(collections.abc.Mapping):
+    """
+    The members of a RemoteObject by name. Each member is created from its
+    JSON when it is first accessed, so only the parts of the tree that are
+    used cost time and memory. Iterating creates all direct members.
+    """
+    __slots__ = ('_members_json', '_attributes', '_parent', '_logger')
+
+    def __init__(self, members_json, parent, logger):
+        self._members_json = {}
+        for member_json in members_json:
+            member_name = member_json.get("name", None)
+            if member_name is None:
+                logger.debug("ignoring unnamed attribute")
+            else:
+                self._members_json[member_name] = member_json
+        self._attributes = {}
+        self._parent = parent
+        self._logger = logger
+
+    def __getitem__(self, name):
+        attribute = self._attributes.get(name, None)
+        if attribute is not None:
+            return attribute
+        member_json = self._members_json[name]
+        try:
+            type_str = member_json.get("type", None)
+            if type_str == "object":
+                attribute = RemoteObject(member_json, self._parent, self._parent.__channel__, self._logger)
+            elif type_str == "function":
+                attribute = RemoteFunction(member_json, self._parent)
+            elif type_str != None:
+                attribute = RemoteProperty(member_json, self._parent)
+            else:
+                raise ObjectDefinitionError("no type information")
+        except ObjectDefinitionError as ex:
+            self._logger.debug("malformed member {}: {}".format(name, str(ex)))
+            self._members_json.pop(name, None)
+            raise KeyError(name)
+        # Another thread may have created it in the meantime
+        return self._attributes.setdefault(name, attribute)
+
+    def get(self, name, default=None):
+        # Called on every attribute access of the RemoteObject
+        attribute = self._attributes.get(name, None)
+        if attribute is not None:
+            return attribute
+        if name not in self._members_json:
+            return default
+        try:
+            return self[name]
+        except KeyError:
+            return default
+
+    def __contains__(self, name):
+        return self.get(name) is not None
+
+    def __iter__(self):
+        return iter([name for name in list(self._members_json) if name in self])
+
+    def __len__(self):
+        return len(self._members_json)
+
 class RemoteObject(object):
     """
     Object with functions and properties that map to remote endpoints
@@ -185,35 +296,18 @@ class RemoteObject(object):
         self.__channel__ = channel
         self.__parent__ = parent
 
-        # Build attribute list from JSON
-        for member_json in json_data.get("members", []):
-            member_name = member_json.get("name", None)
-            if member_name is None:
-                logger.debug("ignoring unnamed attribute")
-                continue
-
-            try:
-                type_str = member_json.get("type", None)
-                if type_str == "object":
-                    attribute = RemoteObject(member_json, self, channel, logger)
-                elif type_str == "function":
-                    attribute = RemoteFunction(member_json, self)
-                elif type_str != None:
-                    attribute = RemoteProperty(member_json, self)
-                else:
-                    raise ObjectDefinitionError("no type information")
-            except ObjectDefinitionError as ex:
-                logger.debug("malformed member {}: {}".format(member_name, str(ex)))
-                continue
-
-            self._remote_attributes[member_name] = attribute
-            self.__dict__[member_name] = attribute
+        # The members are created on first access
+        self._remote_attributes = RemoteAttributes(json_data.get("members", []), self, logger)
 
         # Ensure that from here on out assignments to undefined attributes
         # raise an exception
         self.__sealed__ = True
         channel._channel_broken.subscribe(self._tear_down)
 
+    def __dir__(self):
+        # For tab completion
+        return list(object.__dir__(self)) + list(getattr(self._remote_attributes, '_members_json', {}))
+
     def _dump(self, indent, depth):
         if depth <= 0:
             return "..."
@@ -259,6 +353,4 @@ class RemoteObject(object):
 
     def _tear_down(self):
         # Clear all remote members
-        for k in self._remote_attributes.keys():
-            self.__dict__.pop(k)
         self._remote_attributes = {}
@@ -4,6 +4,8 @@ import platform
 import threading
 import fibre
 
+discovered_devices_lock = threading.Lock()
+
 def discovered_device(device,
                         interactive_variables, discovered_devices,
                         branding_short, branding_long,
@@ -14,13 +16,14 @@ def discovered_device(device,
     console
     """
     serial_number = '{:012X}'.format(device.serial_number) if hasattr(device, 'serial_number') else "[unknown serial number]"
-    if serial_number in discovered_devices:
-        verb = "Reconnected"
-        index = discovered_devices.index(serial_number)
-    else:
-        verb = "Connected"
-        discovered_devices.append(serial_number)
-        index = len(discovered_devices) - 1
+    with discovered_devices_lock: # devices connect in parallel
+        if serial_number in discovered_devices:
+            verb = "Reconnected"
+            index = discovered_devices.index(serial_number)
+        else:
+            verb = "Connected"
+            discovered_devices.append(serial_number)
+            index = len(discovered_devices) - 1
     interactive_name = branding_short + str(index)
 
     # Publish new device to interactive console
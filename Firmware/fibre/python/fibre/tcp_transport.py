@@ -21,6 +21,9 @@ class TCPTransport(fibre.protocol.StreamSource, fibre.protocol.StreamSink):
     self.target = socket.getaddrinfo(dest_addr, dest_port, family)[0][4]
     # TODO: this blocks until a connection is established, or the system cancels it
     self.sock.connect(self.target)
+    # Requests are small and sent in several parts (header, payload), so
+    # Nagle's algorithm would hold them back until a delayed ACK.
+    self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
 
   def process_bytes(self, buffer):
     self.sock.send(buffer)
@@ -13,6 +13,16 @@ unit_tests = define_package{
     sources={'run_tests.cpp'}
 }
 
+dispatch_benchmark = define_package{
+    packages={fibre_package},
+    sources={'dispatch_benchmark.cpp'}
+}
+
+stream_fuzz = define_package{
+    packages={fibre_package},
+    sources={'stream_fuzz.cpp'}
+}
+
 
 toolchain=GCCToolchain('', 'build', {'-O3', '-fvisibility=hidden', '-frename-registers', '-funroll-loops'}, {})
 toolchain=GCCToolchain('', 'build', {'-O3', '-g', '-Wall'}, {})
@@ -23,5 +33,7 @@ toolchain=GCCToolchain('', 'build', {'-O3', '-g', '-Wall'}, {})
 
 if tup.getconfig("BUILD_FIBRE_TESTS") == "true" then
 	build_executable('test_server', test_server, toolchain)
+	build_executable('dispatch_benchmark', dispatch_benchmark, toolchain)
+	build_executable('stream_fuzz', stream_fuzz, toolchain)
 	--build_executable('run_tests', unit_tests, toolchain)
 end
@@ -0,0 +1,108 @@
+/*
+ * Measures the time that the device side spends on one request, from
+ * process_packet() of the channel through the batch handler and the endpoint
+ * table to the response, for a growing number of operations per request.
+ *
+ * The endpoint table has the same shape as the one in the generated
+ * endpoints.hpp (see endpoints_template.j2).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <array>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include <fibre/protocol.hpp>
+
+#define N_ENDPOINTS     512
+#define N_REPETITIONS   200000
+
+static float values[N_ENDPOINTS];
+
+namespace fibre {
+
+const unsigned char embedded_json[] = "[]";
+const size_t embedded_json_length = sizeof(embedded_json) - 1;
+const JsonPage embedded_json_pages[] = {{"", 0, 0}};
+const size_t embedded_json_page_count = 0;
+const uint16_t json_crc_ = 0x1234;
+const uint32_t json_version_id_ = 0;
+
+struct EndpointEntry {
+    bool (*handler)(cbufptr_t* input_buffer, bufptr_t* output_buffer);
+};
+
+template<size_t I>
+static bool handle_endpoint(cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    std::optional<float> value = Codec<float>::decode(input_buffer);
+    if (value.has_value()) {
+        values[I] = *value;
+    }
+    return Codec<float>::encode(values[I], output_buffer);
+}
+
+template<size_t ... Is>
+static constexpr std::array<EndpointEntry, sizeof...(Is)> make_endpoint_table(std::index_sequence<Is...>) {
+    return {{{&handle_endpoint<Is>}...}};
+}
+
+static constexpr auto endpoint_table = make_endpoint_table(std::make_index_sequence<N_ENDPOINTS>());
+
+bool endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    if (idx < 0 || (size_t)idx >= endpoint_table.size()) {
+        return false;
+    }
+    return endpoint_table[idx].handler(input_buffer, output_buffer);
+}
+
+bool get_endpoint_property(endpoint_ref_t, Introspectable*) {
+    return false;
+}
+
+}
+
+class NullSink : public PacketSink {
+public:
+    int process_packet(const uint8_t* buffer, size_t length) override {
+        bytes_ += length;
+        return 0;
+    }
+    size_t bytes_ = 0;
+};
+
+// Builds a request that reads n_ops scattered endpoints, in a batch if
+// there is more than one
+static std::vector<uint8_t> make_request(size_t n_ops) {
+    std::vector<uint8_t> request = {0x81, 0x00};
+    uint16_t endpoint_id = n_ops > 1 ? BATCH_ENDPOINT_ID : 1;
+    request.push_back(endpoint_id & 0xff);
+    request.push_back(0x80 | (endpoint_id >> 8)); // expect a response
+    request.push_back(n_ops > 1 ? 1 + 4 * n_ops : 4);
+    request.push_back(0);
+    for (size_t i = 0; n_ops > 1 && i < n_ops; ++i) {
+        uint16_t id = 1 + (i * 97) % (N_ENDPOINTS - 1);
+        request.insert(request.end(), {(uint8_t)(id & 0xff), (uint8_t)(id >> 8), 0, 4});
+    }
+    request.push_back(fibre::json_crc_ & 0xff);
+    request.push_back(fibre::json_crc_ >> 8);
+    return request;
+}
+
+int main() {
+    NullSink sink;
+    BidirectionalPacketBasedChannel channel(sink);
+
+    printf("operations/request   ns/request   ns/operation\n");
+    for (size_t n_ops: {1, 2, 4, 7}) { // 7 reads fill the response of one batch
+        std::vector<uint8_t> request = make_request(n_ops);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < N_REPETITIONS; ++i) {
+            channel.process_packet(request.data(), request.size());
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N_REPETITIONS;
+        printf("%18zu %12.1f %14.1f\n", n_ops, ns, ns / n_ops);
+    }
+    return sink.bytes_ ? 0 : 1;
+}
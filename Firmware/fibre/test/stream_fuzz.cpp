@@ -0,0 +1,367 @@
+/*
+ * Feeds clean, random and corrupted byte streams through
+ * StreamToPacketSegmenter and the decoders in fibre/decoders.hpp. Reports the
+ * throughput in bytes/s and, for each kind of corruption, how many packets
+ * are lost and how many bytes it takes until the next packet is received
+ * again, also converted to a time at a few UART baud rates.
+ *
+ * The same file is a libFuzzer target when built with clang and FIBRE_FUZZING:
+ *
+ *   clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -DFIBRE_FUZZING \
+ *       -Icpp/include test/stream_fuzz.cpp cpp/protocol.cpp -o stream_fuzz
+ *
+ * Without FIBRE_FUZZING, main() also runs the fuzz target on random inputs,
+ * so that the invariants are checked by a plain build too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <fibre/protocol.hpp>
+#include <fibre/decoders.hpp>
+
+#define N_PACKETS           20000
+#define N_GARBAGE_BYTES     (16 * 1024 * 1024)
+#define N_FUZZ_INPUTS       200000
+#define EVENT_SPACING       4096 // bytes between two corruptions, more than one maximum size packet
+#define RX_CHUNK_SIZE       64 // bytes per process_bytes() call, like a UART DMA half buffer
+
+#define FUZZ_ASSERT(expr) do { if (!(expr)) { fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #expr); abort(); } } while (0)
+
+namespace fibre {
+
+const unsigned char embedded_json[] = "[]";
+const size_t embedded_json_length = sizeof(embedded_json) - 1;
+const JsonPage embedded_json_pages[] = {{"", 0, 0}};
+const size_t embedded_json_page_count = 0;
+const uint16_t json_crc_ = 0x1234;
+const uint32_t json_version_id_ = 0;
+
+bool endpoint_handler(int, cbufptr_t*, bufptr_t*) {
+    return false;
+}
+
+bool get_endpoint_property(endpoint_ref_t, Introspectable*) {
+    return false;
+}
+
+}
+
+class VectorStreamSink : public StreamSink {
+public:
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) override {
+        bytes_.insert(bytes_.end(), buffer, buffer + length);
+        if (processed_bytes)
+            *processed_bytes += length;
+        return 0;
+    }
+    size_t get_free_space() override { return SIZE_MAX; }
+    std::vector<uint8_t> bytes_;
+};
+
+// The first four bytes of every generated packet are its index, the rest is
+// derived from the index, so that the sink can tell which packet arrived and
+// whether it arrived intact.
+static uint8_t payload_byte(uint32_t index, size_t pos) {
+    return (uint8_t)((index * 2654435761u) >> (8 * (pos & 3))) ^ (uint8_t)pos;
+}
+
+class RecordingSink : public PacketSink {
+public:
+    int process_packet(const uint8_t* buffer, size_t length) override {
+        n_packets_++;
+        n_bytes_ += length;
+        uint32_t index;
+        if (length < sizeof(index)) {
+            n_bogus_++;
+            return 0;
+        }
+        memcpy(&index, buffer, sizeof(index));
+        for (size_t i = sizeof(index); i < length; ++i) {
+            if (buffer[i] != payload_byte(index, i)) {
+                n_bogus_++;
+                return 0;
+            }
+        }
+        indices_.push_back(index);
+        return 0;
+    }
+    size_t n_packets_ = 0;
+    size_t n_bytes_ = 0;
+    size_t n_bogus_ = 0; // packets that passed both CRCs but were never sent
+    std::vector<uint32_t> indices_;
+};
+
+struct Stream {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> offsets; // start of each packet
+};
+
+static Stream make_stream(std::mt19937& rng, size_t n_packets, size_t min_length, size_t max_length) {
+    VectorStreamSink bytes;
+    StreamBasedPacketSink packet2stream(bytes);
+    std::uniform_int_distribution<size_t> length_dist(min_length, max_length);
+    std::vector<size_t> offsets;
+    std::vector<uint8_t> payload;
+    for (uint32_t index = 0; index < n_packets; ++index) {
+        payload.resize(length_dist(rng));
+        memcpy(payload.data(), &index, sizeof(index));
+        for (size_t i = sizeof(index); i < payload.size(); ++i) {
+            payload[i] = payload_byte(index, i);
+        }
+        offsets.push_back(bytes.bytes_.size());
+        packet2stream.process_packet(payload.data(), payload.size());
+    }
+    return {std::move(bytes.bytes_), std::move(offsets)};
+}
+
+static double feed(StreamToPacketSegmenter& segmenter, const std::vector<uint8_t>& bytes) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < bytes.size(); pos += RX_CHUNK_SIZE) {
+        segmenter.process_bytes(bytes.data() + pos, std::min((size_t)RX_CHUNK_SIZE, bytes.size() - pos), nullptr);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run_throughput(std::mt19937& rng, const char* name, size_t min_length, size_t max_length) {
+    Stream stream = make_stream(rng, N_PACKETS, min_length, max_length);
+    RecordingSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+    double seconds = 0.0;
+    size_t n_rounds = 0;
+    while (seconds < 0.5) {
+        seconds += feed(segmenter, stream.bytes);
+        n_rounds++;
+    }
+    FUZZ_ASSERT(sink.indices_.size() == n_rounds * N_PACKETS && !sink.n_bogus_);
+    printf("%-28s %10.1f MB/s %12.0f packets/s\n", name,
+           n_rounds * stream.bytes.size() / seconds / 1e6, n_rounds * N_PACKETS / seconds);
+}
+
+static void run_garbage(std::mt19937& rng) {
+    std::vector<uint8_t> garbage(N_GARBAGE_BYTES);
+    for (uint8_t& byte: garbage) {
+        byte = (uint8_t)rng();
+    }
+    RecordingSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+    double seconds = feed(segmenter, garbage);
+    printf("%-28s %10.1f MB/s %12zu packets accepted\n", "random bytes",
+           garbage.size() / seconds / 1e6, sink.n_packets_);
+
+    // The same with every byte a prefix, the worst case for the resync logic
+    std::vector<uint8_t> prefixes(N_GARBAGE_BYTES, CANONICAL_PREFIX);
+    seconds = feed(segmenter, prefixes);
+    printf("%-28s %10.1f MB/s\n", "prefix bytes", prefixes.size() / seconds / 1e6);
+}
+
+enum Corruption {
+    kBitFlip,
+    kDroppedByte,
+    kInsertedByte,
+    kBurst, // 16 random bytes overwritten
+    kInsertedPrefix, // a stray prefix byte between two packets
+};
+
+static const char* corruption_names[] = {"bit flip", "dropped byte", "inserted byte", "16 byte burst", "stray prefix"};
+
+// Applies one corruption every EVENT_SPACING bytes and reports the packets
+// lost per event and the bytes from the corruption to the start of the first
+// packet that is received again.
+static void run_corruption(std::mt19937& rng, Corruption kind, size_t min_length, size_t max_length) {
+    Stream stream = make_stream(rng, N_PACKETS, min_length, max_length);
+    std::vector<uint8_t> corrupted;
+    std::vector<size_t> events; // offsets in the original stream
+    corrupted.reserve(stream.bytes.size() + stream.bytes.size() / EVENT_SPACING + 1);
+
+    size_t next_packet = 0;
+    bool pending = false;
+    for (size_t pos = 0; pos < stream.bytes.size(); ++pos) {
+        pending = pending || pos % EVENT_SPACING == EVENT_SPACING / 2;
+        bool is_event = pending;
+        if (kind == kInsertedPrefix) {
+            // Delay the event to the next packet boundary
+            while (next_packet < stream.offsets.size() && stream.offsets[next_packet] < pos)
+                next_packet++;
+            is_event = pending && next_packet < stream.offsets.size() && stream.offsets[next_packet] == pos;
+        }
+        if (!is_event) {
+            corrupted.push_back(stream.bytes[pos]);
+            continue;
+        }
+        events.push_back(pos);
+        pending = false;
+        switch (kind) {
+            case kBitFlip: corrupted.push_back(stream.bytes[pos] ^ (1 << (rng() % 8))); break;
+            case kDroppedByte: break;
+            case kInsertedByte: corrupted.push_back((uint8_t)rng()); corrupted.push_back(stream.bytes[pos]); break;
+            case kBurst:
+                for (size_t i = 0; i < 16 && pos < stream.bytes.size(); ++i, ++pos)
+                    corrupted.push_back((uint8_t)rng());
+                pos--;
+                break;
+            case kInsertedPrefix: corrupted.push_back(CANONICAL_PREFIX); corrupted.push_back(stream.bytes[pos]); break;
+        }
+    }
+
+    RecordingSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+    feed(segmenter, corrupted);
+    FUZZ_ASSERT(std::is_sorted(sink.indices_.begin(), sink.indices_.end()));
+
+    size_t lost_total = 0, lost_max = 0, recovery_max = 0;
+    double recovery_sum = 0.0;
+    size_t n_events = 0;
+    auto received = sink.indices_.begin();
+    for (size_t event: events) {
+        // The packet that contains the event and the first one after it that arrived
+        size_t hit = std::upper_bound(stream.offsets.begin(), stream.offsets.end(), event) - stream.offsets.begin() - 1;
+        received = std::lower_bound(received, sink.indices_.end(), (uint32_t)hit);
+        if (received == sink.indices_.end())
+            break;
+        size_t lost = *received - hit;
+        size_t recovery = stream.offsets[*received] - event;
+        if (*received == hit) {
+            // A stray prefix in front of the packet, which was received anyway
+            recovery = 0;
+        }
+        lost_total += lost;
+        lost_max = std::max(lost_max, lost);
+        recovery_sum += recovery;
+        recovery_max = std::max(recovery_max, recovery);
+        n_events++;
+    }
+    FUZZ_ASSERT(n_events);
+    // No packet may be lost other than right after a corruption
+    FUZZ_ASSERT(sink.indices_.size() + lost_total >= stream.offsets.size() - 1);
+
+    double recovery_mean = recovery_sum / n_events;
+    printf("%-16s %6zu events  lost %.2f (max %zu)  recovery %7.1f (max %4zu) bytes"
+           "  = %6.1f us at 115200, %5.1f us at 921600, %5.1f us at 2M baud (max)  %zu bogus\n",
+           corruption_names[kind], n_events, (double)lost_total / n_events, lost_max, recovery_mean, recovery_max,
+           recovery_max * 10 / 115200e-6, recovery_max * 10 / 921600e-6, recovery_max * 10 / 2000000e-6, sink.n_bogus_);
+}
+
+static void run_varint_throughput(std::mt19937& rng) {
+    // Varints of random bit widths, back to back
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < 1000000; ++i) {
+        uint32_t value = (uint32_t)rng() >> (rng() % 32);
+        do {
+            bytes.push_back((value & 0x7f) | (value > 0x7f ? 0x80 : 0));
+            value >>= 7;
+        } while (value);
+    }
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        uint32_t value;
+        VarintStreamDecoder<uint32_t> decoder = make_varint_decoder(value);
+        size_t processed_bytes = 0;
+        FUZZ_ASSERT(decoder.process_bytes(bytes.data() + pos, bytes.size() - pos, &processed_bytes) == 0);
+        pos += processed_bytes;
+        sum += value;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-28s %10.1f MB/s (checksum %08x)\n", "varint decoder", bytes.size() / seconds / 1e6, sum);
+}
+
+// Checks the invariants of a stream decoder on arbitrary input
+template<typename TDecoder>
+static void fuzz_decoder(TDecoder&& decoder, const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size && !decoder.get_status() && decoder.get_expected_bytes()) {
+        size_t chunk = std::min((size_t)(data[pos] % 7) + 1, size - pos);
+        size_t processed_bytes = 0;
+        int status = decoder.process_bytes(data + pos, chunk, &processed_bytes);
+        FUZZ_ASSERT(processed_bytes <= chunk);
+        FUZZ_ASSERT(status == decoder.get_status());
+        // All bytes are consumed unless the decoder is done or failed
+        FUZZ_ASSERT(processed_bytes == chunk || status || !decoder.get_expected_bytes());
+        pos += processed_bytes;
+    }
+    if (!decoder.get_status() && !decoder.get_expected_bytes() && pos < size) {
+        size_t processed_bytes = 0;
+        decoder.process_bytes(data + pos, size - pos, &processed_bytes);
+        FUZZ_ASSERT(processed_bytes == 0);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // The segmenter must survive any input and must be back in sync after at
+    // most one maximum size packet worth of non-prefix bytes
+    RecordingSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+    for (size_t pos = 0; pos < size; ) {
+        size_t chunk = std::min((size_t)(data[pos] % RX_CHUNK_SIZE) + 1, size - pos);
+        segmenter.process_bytes(data + pos, chunk, nullptr);
+        pos += chunk;
+    }
+    static const std::vector<uint8_t> filler(STREAM_MAX_PACKET_SIZE + 2, 0);
+    segmenter.process_bytes(filler.data(), filler.size(), nullptr);
+    uint8_t payload[8];
+    uint32_t index = 0x12345678;
+    memcpy(payload, &index, sizeof(index));
+    for (size_t i = sizeof(index); i < sizeof(payload); ++i) {
+        payload[i] = payload_byte(index, i);
+    }
+    VectorStreamSink packet;
+    StreamBasedPacketSink packet2stream(packet);
+    packet2stream.process_packet(payload, sizeof(payload));
+    segmenter.process_bytes(packet.bytes_.data(), packet.bytes_.size(), nullptr);
+    FUZZ_ASSERT(!sink.indices_.empty() && sink.indices_.back() == index);
+
+    uint32_t value32;
+    fuzz_decoder(make_varint_decoder(value32), data, size);
+    uint64_t value64;
+    fuzz_decoder(make_varint_decoder(value64), data, size);
+    ReceiverState state;
+    fuzz_decoder(make_crc8_decoder<CANONICAL_CRC8_INIT, CANONICAL_CRC8_POLYNOMIAL>(
+        make_decoder_chain(make_endpoint_id_decoder(state), make_length_decoder(state))), data, size);
+    return 0;
+}
+
+#ifndef FIBRE_FUZZING
+int main() {
+    std::mt19937 rng(12345);
+
+    printf("throughput, %d byte chunks:\n", RX_CHUNK_SIZE);
+    run_throughput(rng, "requests (8-16 bytes)", 8, 16);
+    run_throughput(rng, "mixed (8-1024 bytes)", 8, STREAM_MAX_PACKET_SIZE);
+    run_throughput(rng, "maximum size (1024 bytes)", STREAM_MAX_PACKET_SIZE, STREAM_MAX_PACKET_SIZE);
+    run_garbage(rng);
+    run_varint_throughput(rng);
+
+    printf("\nrecovery, 8-64 byte packets:\n");
+    for (Corruption kind: {kBitFlip, kDroppedByte, kInsertedByte, kBurst, kInsertedPrefix}) {
+        run_corruption(rng, kind, 8, 64);
+    }
+    printf("\nrecovery, 8-1024 byte packets:\n");
+    for (Corruption kind: {kBitFlip, kDroppedByte, kInsertedByte, kBurst, kInsertedPrefix}) {
+        run_corruption(rng, kind, 8, STREAM_MAX_PACKET_SIZE);
+    }
+
+    printf("\nfuzzing with %d random inputs... ", N_FUZZ_INPUTS);
+    fflush(stdout);
+    std::vector<uint8_t> input;
+    for (size_t i = 0; i < N_FUZZ_INPUTS; ++i) {
+        input.resize(rng() % 256);
+        for (uint8_t& byte: input) {
+            // Mostly prefixes and small numbers, which get further into the parsers
+            uint32_t r = rng();
+            byte = (r & 3) == 0 ? CANONICAL_PREFIX : (r & 3) == 1 ? (uint8_t)(r >> 8) % 16 : (uint8_t)(r >> 8);
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("ok\n");
+    return 0;
+}
+#endif
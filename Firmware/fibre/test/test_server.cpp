@@ -1,50 +1,97 @@
+/*
+ * Serves a small Fibre object on TCP and UDP port 9910, for testing and
+ * benchmarking the host side of the protocol without a device:
+ *
+ *   python3 -m fibre.benchmark --path tcp:localhost:9910
+ *
+ * The endpoint table and the JSON have the same shape as the ones that are
+ * generated for the firmware (see endpoints_template.j2).
+ */
 
 #include <stdio.h>
 #include <unistd.h>
 #include <thread>
-#include <signal.h>
 
 #include <fibre/protocol.hpp>
 #include <fibre/posix_tcp.hpp>
 #include <fibre/posix_udp.hpp>
 
+static const uint64_t serial_number = 0x1234567890ab;
+static float property1 = 0.0f;
+static float property2 = 0.0f;
+static uint32_t counter = 0; // incremented by every read
+static float set_both_in_arg1 = 0.0f;
+static float set_both_in_arg2 = 0.0f;
+static float set_both_out_sum = 0.0f;
 
-class TestClass {
-public:
-    float property1;
-    float property2;
+namespace fibre {
 
-    float set_both(float arg1, float arg2) {
-        property1 = arg1;
-        property2 = arg2;
-        return property1 + property2;
+const unsigned char embedded_json[] =
+    "[{\"name\":\"\",\"id\":0,\"type\":\"json\",\"access\":\"r\"},"
+    "{\"name\":\"serial_number\",\"id\":1,\"type\":\"uint64\",\"access\":\"r\"},"
+    "{\"name\":\"property1\",\"id\":2,\"type\":\"float\",\"access\":\"rw\"},"
+    "{\"name\":\"property2\",\"id\":3,\"type\":\"float\",\"access\":\"rw\"},"
+    "{\"name\":\"counter\",\"id\":4,\"type\":\"uint32\",\"access\":\"r\"},"
+    "{\"name\":\"set_both\",\"id\":5,\"type\":\"function\","
+        "\"inputs\":[{\"name\":\"arg1\",\"id\":6,\"type\":\"float\",\"access\":\"rw\"},"
+                    "{\"name\":\"arg2\",\"id\":7,\"type\":\"float\",\"access\":\"rw\"}],"
+        "\"outputs\":[{\"name\":\"sum\",\"id\":8,\"type\":\"float\",\"access\":\"r\"}]}]";
+const size_t embedded_json_length = sizeof(embedded_json) - 1;
+const JsonPage embedded_json_pages[] = {{"", 0, 0}};
+const size_t embedded_json_page_count = 0;
+const uint16_t json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, embedded_json, embedded_json_length);
+const uint32_t json_version_id_ = (json_crc_ << 16) | calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(json_crc_, embedded_json, embedded_json_length);
+
+template<typename T>
+static bool exchange(T* value, cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    std::optional<T> new_value = Codec<T>::decode(input_buffer);
+    if (new_value.has_value()) {
+        *value = *new_value;
     }
+    return Codec<T>::encode(*value, output_buffer);
+}
 
-    FIBRE_EXPORTS(TestClass,
-        make_protocol_property("property1", &property1),
-        make_protocol_property("property2", &property2),
-        make_protocol_function("set_both", *obj, &TestClass::set_both, "arg1", "arg2")
-    );
-};
+template<typename T>
+static bool read(T value, bufptr_t* output_buffer) {
+    return Codec<T>::encode(value, output_buffer);
+}
 
+bool endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    switch (idx) {
+        case 0: return endpoint0_handler(input_buffer, output_buffer);
+        case 1: return read(serial_number, output_buffer);
+        case 2: return exchange(&property1, input_buffer, output_buffer);
+        case 3: return exchange(&property2, input_buffer, output_buffer);
+        case 4: return read(counter++, output_buffer);
+        case 5:
+            property1 = set_both_in_arg1;
+            property2 = set_both_in_arg2;
+            set_both_out_sum = property1 + property2;
+            return true;
+        case 6: return exchange(&set_both_in_arg1, input_buffer, output_buffer);
+        case 7: return exchange(&set_both_in_arg2, input_buffer, output_buffer);
+        case 8: return read(set_both_out_sum, output_buffer);
+        default: return false;
+    }
+}
 
-int main() {
-    printf("Starting Fibre server...\n");
+bool get_endpoint_property(endpoint_ref_t endpoint_ref, Introspectable* property) {
+    return false; // no subscriptions
+}
 
-    TestClass test_object = TestClass();
+}
 
-    // publish the object on Fibre
-    auto definitions = test_object.fibre_definitions;
-    fibre_publish(definitions);
+int main() {
+    printf("Starting Fibre server...\n");
 
-    // Expose Fibre objects on TCP and UDP
+    // Expose the object on TCP and UDP
     std::thread server_thread_tcp(serve_on_tcp, 9910);
     std::thread server_thread_udp(serve_on_udp, 9910);
     printf("Fibre server started.\n");
 
     // Dump property1 value
     while (1) {
-        printf("test_object.property1: %f\n", test_object.property1);
+        printf("property1: %f\n", property1);
         usleep(1000000 / 5); // 5 Hz
     }
 
@@ -0,0 +1,14 @@
+
+tup.include('../tupfiles/build.lua')
+tup.include('../cpp/package.lua')
+
+fibre_gateway = define_package{
+    packages={fibre_gateway_package},
+    sources={'fibre_gateway.cpp'}
+}
+
+toolchain=GCCToolchain('', 'build', {'-O3', '-g', '-Wall'}, {})
+
+if tup.getconfig("BUILD_FIBRE_GATEWAY") == "true" then
+	build_executable('fibre-gateway', fibre_gateway, toolchain)
+end
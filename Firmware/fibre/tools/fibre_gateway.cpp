@@ -0,0 +1,126 @@
+/*
+ * Owns the connections to several Fibre devices and serves each of them to
+ * many network clients, see fibre::Gateway.
+ *
+ *   fibre-gateway [--port 9910] usb:2061377C3548 usb:3352316E3137 ...
+ *
+ * Device i is served on TCP and UDP port 9910 + i. A device is given as
+ * usb (the first ODrive), usb:<serial number>, tcp:<host>:<port> or
+ * udp:<host>:<port>, the latter two mostly for testing against
+ * fibre/test/test_server.
+ */
+
+#include <fibre/client_transports.hpp>
+#include <fibre/gateway.hpp>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The gateway doesn't serve objects of its own, but the protocol code that it
+// shares with the servers needs these
+namespace fibre {
+
+const unsigned char embedded_json[] = "[]";
+const size_t embedded_json_length = sizeof(embedded_json) - 1;
+const JsonPage embedded_json_pages[] = {{"", 0, 0}};
+const size_t embedded_json_page_count = 0;
+const uint16_t json_crc_ = 0;
+const uint32_t json_version_id_ = 0;
+
+bool endpoint_handler(int, cbufptr_t*, bufptr_t*) {
+    return false;
+}
+
+bool get_endpoint_property(endpoint_ref_t, Introspectable*) {
+    return false;
+}
+
+}
+
+static fibre::Gateway* gateway = nullptr;
+
+static void on_signal(int) {
+    if (gateway)
+        gateway->stop();
+}
+
+// Splits "host:port" at the last colon. Returns false if there is no port.
+static bool split_host_port(const std::string& address, std::string* host, unsigned int* port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    *host = address.substr(0, colon);
+    *port = atoi(address.c_str() + colon + 1);
+    return *port != 0;
+}
+
+// Returns an open transport or nullptr
+static std::unique_ptr<fibre::ClientTransport> open_device(const std::string& spec) {
+    std::string host;
+    unsigned int port;
+    if (spec == "usb" || spec.compare(0, 4, "usb:") == 0) {
+        auto transport = std::make_unique<fibre::LibusbClientTransport>();
+        if (transport->open(spec.size() > 4 ? spec.c_str() + 4 : nullptr))
+            return transport;
+    } else if (spec.compare(0, 4, "tcp:") == 0 && split_host_port(spec.substr(4), &host, &port)) {
+        auto transport = std::make_unique<fibre::TcpClientTransport>();
+        if (transport->open(host.c_str(), port))
+            return transport;
+    } else if (spec.compare(0, 4, "udp:") == 0 && split_host_port(spec.substr(4), &host, &port)) {
+        auto transport = std::make_unique<fibre::UdpClientTransport>();
+        if (transport->open(host.c_str(), port))
+            return transport;
+    }
+    return nullptr;
+}
+
+int main(int argc, const char** argv) {
+    unsigned int base_port = 9910;
+    std::vector<std::string> specs;
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    for (int i = 1; i < argc; ++i) {
+        if ((!strcmp(argv[i], "-p") || !strcmp(argv[i], "--port")) && i + 1 < argc) {
+            base_port = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--port base_port] device...\n", argv[0]);
+            return 1;
+        } else {
+            specs.push_back(argv[i]);
+        }
+    }
+    if (specs.empty())
+        specs.push_back("usb");
+
+    std::vector<std::unique_ptr<fibre::ClientTransport>> transports;
+    fibre::Gateway the_gateway;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        std::unique_ptr<fibre::ClientTransport> transport = open_device(specs[i]);
+        if (!transport || !the_gateway.add_device(*transport, specs[i])) {
+            fprintf(stderr, "can't connect to %s\n", specs[i].c_str());
+            return 1;
+        }
+        printf("%s on port %u\n", specs[i].c_str(), base_port + (unsigned int)i);
+        transports.push_back(std::move(transport));
+    }
+
+    gateway = &the_gateway;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if (!the_gateway.run(base_port)) {
+        fprintf(stderr, "can't open the sockets on port %u and up\n", base_port);
+        return 1;
+    }
+
+    const fibre::Gateway::Stats& stats = the_gateway.stats();
+    printf("%llu requests, %llu forwarded, %llu coalesced, %llu responses, %llu timeouts\n",
+           (unsigned long long)stats.requests, (unsigned long long)stats.forwarded,
+           (unsigned long long)stats.coalesced, (unsigned long long)stats.responses,
+           (unsigned long long)stats.timeouts);
+    return 0;
+}
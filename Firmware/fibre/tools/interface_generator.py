@@ -7,6 +7,7 @@ import jsonschema
 import re
 import argparse
 import sys
+import zlib
 from collections import OrderedDict
 
 # This schema describes what we expect interface definition files to look like
@@ -76,6 +77,7 @@ definitions:
         properties:
           in: {type: object}
           out: {type: object}
+          raw: {type: boolean}
           brief: {type: string}
           doc: {type: string}
           __line__: {type: object}
@@ -207,6 +209,8 @@ def regularize_arg(path, name, elem):
 def regularize_func(path, name, elem, prepend_args):
     if elem is None:
         elem = {}
+    if elem.get('raw', False) and (elem.get('in') or elem.get('out')):
+        raise Exception("raw function {} can't have arguments".format(join_name(path, name)))
     elem['name'] = name
     elem['fullname'] = path = join_name(path, name)
     elem['in'] = OrderedDict((n, regularize_arg(path, n, arg))
@@ -462,6 +466,51 @@ def generate_endpoint_for_property(prop, attr_bindto, idx):
     }
     return endpoint, endpoint_definition
 
+JSON_PAGE_DEPTH = 2 # objects down to this depth (e.g. axis0.controller) can be fetched on their own
+
+def compress_json_pages(definitions, page_depth=JSON_PAGE_DEPTH):
+    """
+    Compresses the endpoint definitions into one zlib stream. The compressor
+    is flushed with Z_FULL_FLUSH before and after each object down to
+    page_depth, so the compressed bytes of such an object (a page) inflate
+    on their own as raw deflate data to the JSON of the object.
+    Returns the compressed bytes and a list of (path, offset, length) of the
+    pages in the compressed bytes.
+    """
+    compressor = zlib.compressobj(9)
+    data = bytearray()
+    pages = []
+
+    def write(text):
+        data.extend(compressor.compress(text.encode('ascii')))
+
+    def write_members(members, prefix, depth):
+        for i, member in enumerate(members):
+            if i:
+                write(',')
+            if member.get('type', None) == 'object' and depth <= page_depth:
+                data.extend(compressor.flush(zlib.Z_FULL_FLUSH))
+                start = len(data)
+                write_object(member, prefix + member['name'], depth)
+                data.extend(compressor.flush(zlib.Z_FULL_FLUSH))
+                pages.append((prefix + member['name'], start, len(data) - start))
+            elif member.get('type', None) == 'object':
+                write_object(member, prefix + member['name'], depth)
+            else:
+                write(json.dumps(member, separators=(',', ':')))
+
+    def write_object(obj, path, depth):
+        header = {k: v for k, v in obj.items() if k != 'members'}
+        write(json.dumps(header, separators=(',', ':'))[:-1] + ',"members":[')
+        write_members(obj['members'], path + '.', depth + 1)
+        write(']}')
+
+    write('[')
+    write_members(definitions, '', 1)
+    write(']')
+    data.extend(compressor.flush())
+    return bytes(data), pages
+
 def generate_endpoint_table(intf, bindto, idx):
     """
     Generates a Fibre v0.1 endpoint table for a given interface.
@@ -634,9 +683,14 @@ if args.generate_endpoints:
     endpoints, embedded_endpoint_definitions, _ = generate_endpoint_table(interfaces[args.generate_endpoints], '&ep_root', 1) # TODO: make user-configurable
     embedded_endpoint_definitions = [{'name': '', 'id': 0, 'type': 'json', 'access': 'r'}] + embedded_endpoint_definitions
     endpoints = [{'id': 0, 'function': {'fullname': 'endpoint0_handler', 'in': {}, 'out': {}}, 'bindings': {}}] + endpoints
+    # The generated code dispatches through a table that is indexed by the ID
+    endpoints = sorted(endpoints, key=lambda endpoint: endpoint['id'])
+    assert [endpoint['id'] for endpoint in endpoints] == list(range(len(endpoints))), "endpoint IDs are not contiguous"
+    embedded_json, embedded_json_pages = compress_json_pages(embedded_endpoint_definitions)
 else:
     embedded_endpoint_definitions = None
     endpoints = None
+    embedded_json, embedded_json_pages = None, None
 
 
 # Render template
@@ -699,6 +753,12 @@ env.filters['to_kebab_case'] = to_kebab_case
 env.filters['first'] = lambda x: next(iter(x))
 env.filters['skip_first'] = lambda x: list(x)[1:]
 env.filters['to_c_string'] = lambda x: '\n'.join(('"' + line.replace('"', '\\"') + '"') for line in json.dumps(x, separators=(',', ':')).replace('{"name"', '\n{"name"').split('\n'))
+
+def to_c_array(data):
+    lines = (', '.join('0x{:02x}'.format(b) for b in data[i:i+16]) for i in range(0, len(data), 16))
+    return '{\n    ' + ',\n    '.join(lines) + '\n}'
+
+env.filters['to_c_array'] = to_c_array
 env.filters['tokenize'] = tokenize
 env.filters['diagonalize'] = lambda lst: [lst[:i + 1] for i in range(len(lst))]
 env.filters['debug'] = lambda x: print(x)
@@ -711,7 +771,9 @@ template_args = {
     'toplevel_interfaces': toplevel_interfaces,
     'userdata': userdata,
     'endpoints': endpoints,
-    'embedded_endpoint_definitions': embedded_endpoint_definitions
+    'embedded_endpoint_definitions': embedded_endpoint_definitions,
+    'embedded_json': embedded_json,
+    'embedded_json_pages': embedded_json_pages
 }
 
 if not args.output is None:
@@ -8,7 +8,8 @@
 extern osSemaphoreId sem_usb_irq;
 extern osSemaphoreId sem_uart_dma;
 extern osSemaphoreId sem_usb_rx;
-extern osSemaphoreId sem_usb_tx;
+extern osSemaphoreId sem_usb_tx_cdc; // counts the free TX buffers of the endpoint
+extern osSemaphoreId sem_usb_tx_native;
 extern osSemaphoreId sem_can;
 
 extern osThreadId defaultTaskHandle;
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+Reports the flash and RAM usage of each subsystem of the firmware, optionally
+compared to a baseline that was saved earlier:
+
+    python3 memory_report.py build/ODriveFirmware.elf --save baseline.json
+    ... enable a feature and build ...
+    python3 memory_report.py build/ODriveFirmware.elf --baseline baseline.json
+
+The symbols of the ELF file are attributed to a subsystem by the source file
+that the debug info names for them, which also works with USE_LTO=true. The
+sizes of the memory regions and the total usage come from the linker map file
+next to the ELF file. The rest, in the "other" row, is the C library, fill
+and alignment, and the heap and stack that the linker script reserves.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+# The first directory that is found in the source path wins
+SUBSYSTEMS = [
+    ('MotorControl', '/MotorControl/'),
+    ('communication', '/communication/'),
+    ('fibre', '/fibre/'),
+    ('HAL', '/Board/v3/Drivers/'),
+    ('FreeRTOS', '/Middlewares/Third_Party/FreeRTOS/'),
+    ('USB', '/Middlewares/ST/'),
+    ('Board', '/Board/'),
+    ('Drivers', '/Drivers/'),
+    ('autogen', '/autogen/'),
+]
+
+# Memory regions of the linker script that are RAM
+RAM_REGIONS = ['RAM', 'CCMRAM']
+
+
+def classify(path):
+    path = '/' + path.replace('\\', '/')
+    for subsystem, directory in SUBSYSTEMS:
+        if directory in path:
+            return subsystem
+    return 'other'
+
+
+def region_of(regions, address):
+    for name, (origin, length) in regions.items():
+        if origin <= address < origin + length:
+            return name
+    return None
+
+
+def parse_map(lines):
+    """
+    Returns the memory regions {name: (origin, length)} and the bytes that the
+    output sections take in each region {name: bytes}.
+    """
+    regions = {}
+    used = {}
+    state = None
+    pending = False # output section name on a line of its own
+
+    def add_output(address, size, rest):
+        region = region_of(regions, address)
+        if region is None:
+            return # debug info
+        used[region] = used.get(region, 0) + size
+        if 'load address' in rest:
+            used['FLASH'] = used.get('FLASH', 0) + size # copied at startup
+
+    for line in lines:
+        line = line.rstrip('\n')
+        if line.startswith('Memory Configuration'):
+            state = 'memory'
+        elif line.startswith('Linker script and memory map'):
+            state = 'map'
+        elif state == 'memory':
+            m = re.match(r'^(\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)', line)
+            if m and m.group(1) != '*default*':
+                regions[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+        elif state == 'map':
+            # e.g. ".data  0x20000000  0x1a0 load address 0x080a1234"
+            m = re.match(r'^\.\S+(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+))?(.*)$', line)
+            if m:
+                pending = not m.group(1)
+                if m.group(1):
+                    add_output(int(m.group(1), 16), int(m.group(2), 16), m.group(3))
+                continue
+            m = re.match(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(.*)$', line)
+            if m and pending:
+                add_output(int(m.group(1), 16), int(m.group(2), 16), m.group(3))
+            pending = False
+
+    return regions, used
+
+
+def parse_symbols(lines, regions):
+    """
+    Takes the output of `nm --print-size --line-numbers` and returns the bytes
+    of each subsystem in each region {subsystem: {region: bytes}}.
+    """
+    usage = {}
+
+    def add(subsystem, region, size):
+        sizes = usage.setdefault(subsystem, {})
+        sizes[region] = sizes.get(region, 0) + size
+
+    for line in lines:
+        # address size type name [tab path:line]
+        m = re.match(r'^([0-9a-f]+) ([0-9a-f]+) (\w) [^\t]*(?:\t(.*):\d+)?$', line.rstrip('\n'))
+        if not m or not m.group(4):
+            continue # symbols without debug info are left to "other"
+        region = region_of(regions, int(m.group(1), 16))
+        if region is None:
+            continue
+        subsystem = classify(m.group(4))
+        size = int(m.group(2), 16)
+        add(subsystem, region, size)
+        if m.group(3) in 'dD' and region == 'RAM':
+            add(subsystem, 'FLASH', size) # .data is copied from flash at startup
+
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Reports the flash and RAM usage of each subsystem of the firmware.')
+    parser.add_argument('elf', help='firmware ELF file, usually build/ODriveFirmware.elf')
+    parser.add_argument('--map', help='linker map file, by default the one next to the ELF file')
+    parser.add_argument('--nm', default='arm-none-eabi-nm', help='nm of the toolchain')
+    parser.add_argument('--baseline', help='JSON file saved by --save to compare against')
+    parser.add_argument('--save', help='save the usage as JSON to this file')
+    args = parser.parse_args()
+
+    with open(args.map or os.path.splitext(args.elf)[0] + '.map') as f:
+        regions, used = parse_map(f)
+    nm_output = subprocess.run([args.nm, '--print-size', '--line-numbers', args.elf],
+                               stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    usage = parse_symbols(nm_output.splitlines(), regions)
+
+    # Whatever the symbols with debug info don't explain
+    other = usage.setdefault('other', {})
+    for region, size in used.items():
+        attributed = sum(sizes.get(region, 0) for sizes in usage.values())
+        other[region] = other.get(region, 0) + max(size - attributed, 0)
+
+    report = {'regions': {name: length for name, (origin, length) in regions.items()}, 'usage': usage}
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)['usage']
+
+    # Only the regions with something in them, flash first
+    columns = [r for r in ['FLASH'] + RAM_REGIONS if used.get(r, 0)]
+    subsystems = sorted((s for s in usage if s != 'other'), key=lambda s: -sum(usage[s].values()))
+    if baseline:
+        subsystems += sorted(s for s in baseline if s not in usage)
+    subsystems.append('other')
+
+    def total(usage):
+        return {r: sum(sizes.get(r, 0) for sizes in usage.values()) for r in columns}
+
+    def row(name, sizes, old_sizes):
+        cells = []
+        for region in columns:
+            size = sizes.get(region, 0)
+            text = '{:8}'.format(size)
+            if old_sizes is not None:
+                diff = size - old_sizes.get(region, 0)
+                text += ' {:>+8}'.format(diff) if diff else ' ' * 9
+            cells.append(text)
+        print('{:14} '.format(name) + ' '.join(cells))
+
+    width = 17 if baseline is not None else 8
+    print('{:14} '.format('[bytes]') + ' '.join('{:>{}}'.format(r, width) for r in columns))
+    for subsystem in subsystems:
+        row(subsystem, usage.get(subsystem, {}), None if baseline is None else baseline.get(subsystem, {}))
+    row('total', total(usage), None if baseline is None else total(baseline))
+    print('{:14} '.format('available') + ' '.join('{:8}'.format(report['regions'].get(r, 0)).ljust(width) for r in columns))
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -9,6 +9,7 @@ import json
 import time
 import argparse
 import logging
+import threading
 
 # interface for odrive GUI to get data from odrivetool
 
@@ -79,6 +80,240 @@ def handle_disconnect(odrive_name):
     # in the GUI, mark and use status as ODrive state.
     socketio.emit('odrives-status', json.dumps(globals()['odrives_status']))
 
+class PlotStream():
+    """
+    The samples of one client's plots. They are kept at the full sampling
+    rate for the plot's time range and sent reduced to a min/max envelope of
+    as many points as the plot can show (see DecimatingRingBuffer), so fast
+    transients stay visible without sending every sample to the browser.
+    The samples can also be written to a capture file at the full rate.
+    """
+    def __init__(self, paths, time_range, max_points, sample_rate):
+        self.paths = list(paths)
+        self.time_range = time_range
+        self.max_points = max_points
+        self.start = time.monotonic()
+        self.ring = odrive.utils.DecimatingRingBuffer(len(self.paths), int(time_range * sample_rate * 1.2) + 1)
+        self.capture = None
+        self.capture_filename = None
+        self.capture_timestamps = []
+        self.capture_rows = []
+
+    def append(self, t, values):
+        row = [values.get(path, 0) for path in self.paths]
+        self.ring.append(t - self.start, row)
+        if self.capture:
+            self.capture_timestamps.append(int((t - self.start) * 1e9))
+            self.capture_rows.append(row)
+
+    def get_plot_data(self):
+        t, values = self.ring.get(self.time_range, self.max_points)
+        return {"time": t.tolist(), "values": {path: values[:, i].tolist() for i, path in enumerate(self.paths)}}
+
+    def start_capture(self, filename, sample_rate):
+        self.stop_capture()
+        self.capture_filename = filename
+        self.capture = odrive.capture.CaptureWriter(filename, self.paths, sample_rate=sample_rate,
+                                                    info={'source': 'gui'})
+
+    def flush_capture(self):
+        if self.capture and self.capture_timestamps:
+            self.capture.write_block(self.capture_timestamps, self.capture_rows)
+            self.capture_timestamps, self.capture_rows = [], []
+
+    def stop_capture(self):
+        """
+        Returns (filename, number of samples) of the capture or None
+        """
+        if not self.capture:
+            return None
+        self.flush_capture()
+        self.capture.close()
+        result = (self.capture_filename, self.capture.num_samples)
+        self.capture = None
+        return result
+
+class SampleHub():
+    """
+    Reads the properties that the clients sample for plots or watch, once per
+    tick for all clients together and with one batched read per ODrive, and
+    pushes them to the clients. Plot samples are sent decimated at
+    send_period ('plotData', see PlotStream), watched properties only when
+    they changed ('ODriveProperties'), so many open panels cost one request
+    per ODrive and tick instead of one per value and panel.
+    """
+    def __init__(self, period=0.02, send_period=0.05, watch_period=0.1):
+        self._period = period
+        self._send_period = send_period
+        self._watch_period = watch_period
+        self._lock = threading.Lock()
+        self._plots = {} # sid -> PlotStream
+        self._plot_settings = {} # sid -> (time range [s], max points)
+        self._watched = {} # sid -> {path: last sent value}
+        self._thread = None
+
+    def set_sample_rate(self, sample_rate):
+        self._period = 1.0 / sample_rate
+
+    def set_sampled(self, sid, paths):
+        with self._lock:
+            old = self._plots.pop(sid, None)
+            capture = old.stop_capture() if old else None
+            if paths:
+                time_range, max_points = self._plot_settings.get(sid, (10.0, 500))
+                self._plots[sid] = PlotStream(paths, time_range, max_points, 1.0 / self._period)
+        if capture:
+            socketio.emit('captureStopped', json.dumps({"filename": capture[0], "samples": capture[1]}), room=sid)
+        self._start()
+
+    def set_plot_settings(self, sid, time_range, max_points):
+        with self._lock:
+            self._plot_settings[sid] = (time_range, max_points)
+            paths = self._plots[sid].paths if sid in self._plots else None
+        if paths:
+            self.set_sampled(sid, paths) # the ring buffer size depends on the range
+
+    def start_capture(self, sid, filename):
+        with self._lock:
+            if sid not in self._plots:
+                return False
+            self._plots[sid].start_capture(filename, 1.0 / self._period)
+            return True
+
+    def stop_capture(self, sid):
+        with self._lock:
+            return self._plots[sid].stop_capture() if sid in self._plots else None
+
+    def watch(self, sid, paths):
+        with self._lock:
+            watched = self._watched.setdefault(sid, {})
+            for path in paths:
+                watched.setdefault(path, None) # sent on the next tick
+        self._start()
+
+    def unwatch(self, sid, paths):
+        with self._lock:
+            watched = self._watched.get(sid, {})
+            for path in paths:
+                watched.pop(path, None)
+
+    def remove_client(self, sid):
+        self.set_sampled(sid, None)
+        with self._lock:
+            self._plot_settings.pop(sid, None)
+            self._watched.pop(sid, None)
+
+    def _start(self):
+        with self._lock:
+            if self._thread is None:
+                self._thread = threading.Thread(target=self._run, daemon=True)
+                self._thread.start()
+
+    def _read(self, paths):
+        """
+        Returns {path: value} for the paths, with one batched read per ODrive.
+        Paths of disconnected ODrives and paths that are not a readable
+        property are left out.
+        """
+        by_odrive = {}
+        for path in paths:
+            keys = path.split('.')
+            by_odrive.setdefault(keys[0], []).append((path, keys[1:]))
+
+        values = {}
+        for odrv, odrive_paths in by_odrive.items():
+            if not globals()['odrives_status'].get(odrv, False):
+                continue
+            props = []
+            for path, keys in odrive_paths:
+                RO = globals()['odrives'][odrv]
+                for key in keys:
+                    RO = RO._remote_attributes.get(key, None) if isinstance(RO, fibre.remote_object.RemoteObject) else None
+                if isinstance(RO, fibre.remote_object.RemoteProperty) and RO._can_read:
+                    props.append((path, RO))
+            try:
+                for (path, _), val in zip(props, fibre.remote_object.read_properties([prop for _, prop in props])):
+                    values[path] = val
+            except fibre.protocol.ChannelBrokenException:
+                handle_disconnect(odrv)
+            except Exception as ex:
+                print("exception in SampleHub: " + str(ex))
+        return values
+
+    def _run(self):
+        next_watch = 0
+        next_send = 0
+        while True:
+            start = time.monotonic()
+            with self._lock:
+                plots = dict(self._plots)
+                watched = {sid: dict(paths) for sid, paths in self._watched.items()}
+            read_watched = start >= next_watch
+            if read_watched:
+                next_watch = start + self._watch_period
+            send = start >= next_send
+            if send:
+                next_send = start + self._send_period
+
+            paths = set(path for plot in plots.values() for path in plot.paths)
+            if read_watched:
+                paths.update(path for sid_paths in watched.values() for path in sid_paths)
+            values = self._read(paths) if paths else {}
+
+            for sid, plot in plots.items():
+                with self._lock:
+                    plot.append(start, values)
+                    if send:
+                        plot.flush_capture()
+                if send:
+                    socketio.emit('plotData', json.dumps(plot.get_plot_data()), room=sid)
+            if read_watched:
+                for sid, sid_paths in watched.items():
+                    delta = {path: values[path] for path, last in sid_paths.items() if path in values and values[path] != last}
+                    if delta:
+                        with self._lock:
+                            self._watched.get(sid, {}).update(delta)
+                        socketio.emit('ODriveProperties', json.dumps(delta), room=sid)
+
+            time.sleep(max(self._period - (time.monotonic() - start), 0))
+
+sample_hub = SampleHub()
+
+@socketio.on('disconnect')
+def client_disconnect():
+    sample_hub.remove_client(request.sid)
+
+@socketio.on('watchProperties')
+def watch_properties(message):
+    # message is {"paths": ["odriveX.axisY.blah.blah", ...]}
+    sample_hub.watch(request.sid, message["paths"])
+
+@socketio.on('plotSettings')
+def plot_settings(message):
+    # message is {"range": seconds, "points": max number of points per plotted property}
+    # and optionally "rate", the sampling rate [Hz] of all clients
+    if "rate" in message:
+        sample_hub.set_sample_rate(float(message["rate"]))
+    sample_hub.set_plot_settings(request.sid, float(message["range"]), int(message["points"]))
+
+@socketio.on('startCapture')
+def start_capture(message):
+    # records the sampled properties at the full rate into a capture file (see odrive.capture)
+    filename = (message or {}).get("filename") or time.strftime("odrive-gui-%Y%m%d-%H%M%S.odcap")
+    if sample_hub.start_capture(request.sid, filename):
+        print("capturing to " + filename)
+        emit('captureStarted', json.dumps({"filename": filename}))
+
+@socketio.on('stopCapture')
+def stop_capture(message):
+    result = sample_hub.stop_capture(request.sid)
+    if result:
+        emit('captureStopped', json.dumps({"filename": result[0], "samples": result[1]}))
+
+@socketio.on('unwatchProperties')
+def unwatch_properties(message):
+    sample_hub.unwatch(request.sid, message["paths"])
+
 @socketio.on('findODrives')
 def getODrives(message):
     print("looking for odrive")
@@ -93,19 +328,22 @@ def enableSampling(message):
 @socketio.on('stopSampling')
 def stopSampling(message):
     session['samplingEnabled'] = False
+    sample_hub.set_sampled(request.sid, None)
     emit('samplingDisabled')
 
 @socketio.on('sampledVarNames')
 def sampledVarNames(message):
     session['sampledVars'] = message
     print(session['sampledVars'])
+    if session.get('samplingEnabled', False):
+        sample_hub.set_sampled(request.sid, message["paths"])
     
 @socketio.on('startSampling')
 def sendSamples(message):
+    # the samples are sent by sample_hub
     print(session['samplingEnabled'])
-    while session['samplingEnabled']:
-        emit('sampledData', json.dumps(getSampledData(session['sampledVars'])))
-        time.sleep(0.02)
+    if session['samplingEnabled']:
+        sample_hub.set_sampled(request.sid, session['sampledVars']["paths"])
 
 @socketio.on('message')
 def handle_message(message):
@@ -224,16 +462,6 @@ def getVal(odrives, keyList):
         print("exception in getVal")
         return 0
 
-def getSampledData(vars):
-    #use getVal to populate a dict
-    #return a dict {path:value}
-    samples = {}
-    for path in vars["paths"]:
-        keys = path.split('.')
-        samples[path] = getVal(globals()['odrives'], keys)
-
-    return samples
-
 def callFunc(odrives, keyList):
     try:
         #index = int(''.join([char for char in keyList.pop(0) if char.isnumeric()]))
@@ -258,7 +486,8 @@ if __name__ == "__main__":
         sys.path.insert(0,optPath.rstrip())
 
     import odrive
-    import odrive.utils # for dump_errors()
+    import odrive.utils # for dump_errors() and DecimatingRingBuffer
+    import odrive.capture
     import fibre
 
     # global for holding references to all connected odrives
@@ -40,6 +40,25 @@ export function fetchParam(path) {
     }
 }
 
+// the server pushes the values of watched parameters when they change
+export function watchParams(paths) {
+    if (store.state.serverConnected){
+        socketio.sendEvent({
+            type: "watchProperties",
+            data: {paths: paths},
+        });
+    }
+}
+
+export function unwatchParams(paths) {
+    if (store.state.serverConnected){
+        socketio.sendEvent({
+            type: "unwatchProperties",
+            data: {paths: paths},
+        });
+    }
+}
+
 export function parseMath(inString) {
     // given an input string that is valid arithmetic, use eval() to evaluate it
     let allowedChars = "0123456789eE/*-+.()";
@@ -34,6 +34,9 @@ export default new Vuex.Store({
         propSamples: { time: [] }, // {time: [time values], ...path: [path var values]}
         newData: false,
         sampling: false,
+        plotRange: 10, // [s] time range of the plots, the server decimates the samples to plotPoints per property
+        plotPoints: 500,
+        capturing: false, // the server records the sampled properties at the full rate into a capture file
         currentDash: "Start",
         firstConn: false,
         wizardMotor: "odrive0",
@@ -159,6 +162,11 @@ export default new Vuex.Store({
             }
             state.newData = true;
         },
+        setPlotData(state, payload) {
+            // payload is {time: [time values], values: {path: [path var values]}}, decimated by the server
+            state.propSamples = Object.assign({ time: payload.time }, payload.values);
+            state.newData = true;
+        },
         logServerMessage(state, payload) {
             // payload is string
             state.serverOutput.push(payload);
@@ -347,6 +355,20 @@ export default new Vuex.Store({
                     context.commit("updateSampledProperty", JSON.parse(message));
                 }
             });
+            socketio.addEventListener({
+                type: "plotData",
+                callback: message => {
+                    context.commit("setPlotData", JSON.parse(message));
+                }
+            });
+            socketio.addEventListener({
+                type: "captureStopped",
+                callback: message => {
+                    // message is {filename, samples}
+                    console.log("capture stopped: " + message);
+                    context.state.capturing = false;
+                }
+            });
             socketio.addEventListener({
                 type: "samplingEnabled",
                 callback: () => {
@@ -371,6 +393,17 @@ export default new Vuex.Store({
                     context.commit('updateOdriveProp', JSON.parse(retmsg));
                 }
             });
+            // watchProperties events make the server emit ODriveProperties events with the changed values
+            socketio.addEventListener({
+                type: "ODriveProperties",
+                callback: retmsg => {
+                    // retmsg is {path: val}
+                    const props = JSON.parse(retmsg);
+                    for (const path of Object.keys(props)) {
+                        context.commit('updateOdriveProp', {path: path, val: props[path]});
+                    }
+                }
+            });
             socketio.addEventListener({
                 type: "odrive-disconnected",
                 callback: (odrive_name) => {
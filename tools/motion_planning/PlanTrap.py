@@ -23,11 +23,19 @@
 # FIR filter-based online jerk-constrained trajectory generation
 # https://www.researchgate.net/profile/Richard_Bearee/publication/304358769_FIR_filter-based_online_jerk-controlled_trajectory_generation/links/5770ccdd08ae10de639c0ff7/FIR-filter-based-online-jerk-controlled-trajectory-generation.pdf
 
+# The planner itself is the one of the firmware, see odrive/planning.py for
+# how to build it.
+
+import os
+import sys
 import numpy as np
 import math
 import matplotlib.pyplot as plt
 import random
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), '..'))
+from odrive import planning
+
 # Symbol                     Description
 # Ta, Tv and Td              Duration of the stages of the AL profile
 # Xi and Vi                  Adapted initial conditions for the AL profile
@@ -44,89 +52,23 @@ plot_range = 10000.0
 
 
 def PlanTrap(Xf, Xi, Vi, Vmax, Amax, Dmax):
-    dX = Xf - Xi    # Distance to travel
-    stop_dist = Vi**2 / (2*Dmax)  # Minimum stopping distance
-    dXstop = np.sign(Vi)*stop_dist # Minimum stopping displacement
-    s = np.sign(dX - dXstop)   # Sign of coast velocity (if any)
-    Ar = s*Amax     # Maximum Acceleration (signed)
-    Dr = -s*Dmax    # Maximum Deceleration (signed)
-    Vr = s*Vmax     # Maximum Velocity (signed)
-
-    # If we start with a speed faster than cruising, then we need to decel instead of accel
-    # aka "double deceleration move" in the paper
-    if s*Vi > s*Vr:
-        print("Handbrake!")
-        Ar = -s*Amax
-
-    # Time to accel/decel to/from Vr (cruise speed)
-    Ta = (Vr-Vi)/Ar
-    Td = -Vr/Dr
-
-    # Integral of velocity ramps over the full accel and decel times to get
-    # minimum displacement required to reach cuising speed
-    dXmin = Ta*(Vr+Vi)/2.0 + Td*(Vr)/2.0
-
-    # Are we displacing enough to reach cruising speed?
-    if s*dX < s*dXmin:
-        print("Short Move:")
-        # From paper:
-        # Vr = s*math.sqrt((-(Vi**2/Ar)-2*dX)/(1/Dr-1/Ar))
-        # Simplified for less divisions:
-        Vr = s*math.sqrt((Dr*Vi**2 + 2*Ar*Dr*dX) / (Dr-Ar))
-        Ta = max(0, (Vr - Vi)/Ar)
-        Td = max(0, -Vr/Dr)
-        Tv = 0
-    else:
-        print("Long move:")
-        Tv = (dX - dXmin)/Vr # Coasting time
-
-    Tf = Ta+Tv+Td
+    plan = planning.plan_trap(Xf, Xi, Vi, Vmax, Amax, Dmax)
 
     print("Xi: {:.2f}\tXf: {:.2f}\tVi: {:.2f}".format(Xi, Xf, Vi))
     print("Amax: {:.2f}\tVmax: {:.2f}\tDmax: {:.2f}".format(Amax, Vmax, Dmax))
-    print("dX: {:.2f}\tdXst: {:.2f}\tdXmin: {:.2f}".format(dX, dXstop, dXmin))
-    print("Ar: {:.2f}\tVr: {:.2f}\tDr: {:.2f}".format(Ar, Vr, Dr))
-    print("Ta: {:.2f}\tTv: {:.2f}\tTd: {:.2f}".format(Ta, Tv, Td))
-
-    return (Ar, Vr, Dr, Ta, Tv, Td, Tf)
-
-def EvalTrap(Xf, Xi, Vi, Ar, Vr, Dr, Ta, Tv, Td, Tf):
-    # Create the time series and preallocate the position, velocity, and acceleration arrays
-    t_traj = np.arange(0, Tf+0.1, 1/10000)
-    y = [None]*len(t_traj)
-    yd = [None]*len(t_traj)
-    ydd = [None]*len(t_traj)
-
-    # We only know acceleration (Ar and Dr), so we integrate to create
-    # the velocity and position curves
-    y_Accel = Xi + Vi*Ta + 0.5*Ar*Ta**2
-
-    for i in range(len(t_traj)):
-        t = t_traj[i]
-        if t < 0: # Initial conditions
-            y[i]   = Xi
-            yd[i]  = Vi
-            ydd[i] = 0
-        elif t < Ta: # Acceleration
-            y[i]   = Xi + Vi*t + 0.5*Ar*t**2
-            yd[i]  = Vi + Ar*t
-            ydd[i] = Ar
-        elif t < Ta+Tv: # Coasting
-            y[i]   = y_Accel + Vr*(t-Ta)
-            yd[i]  = Vr
-            ydd[i] = 0
-        elif t < Tf: # Deceleration
-            td     = t-Tf
-            y[i]   = Xf + 0*td + 0.5*Dr*td**2
-            yd[i]  = 0 + Dr*td
-            ydd[i] = Dr
-        elif t >= Tf: # Final condition
-            y[i]   = Xf
-            yd[i]  = 0
-            ydd[i] = 0
-        else:
-            raise ValueError("t = {} is outside of considered range".format(t))
-        
+    print("Ar: {:.2f}\tVr: {:.2f}\tDr: {:.2f}".format(plan.Ar, plan.Vr, plan.Dr))
+    print("Ta: {:.2f}\tTv: {:.2f}\tTd: {:.2f}".format(plan.Ta, plan.Tv, plan.Td))
+
+    return plan
+
+def EvalTrap(plan):
+    # Create the time series and evaluate the firmware planner at each point
+    t_traj = np.arange(0, plan.Tf+0.1, 1/10000)
+    (y, yd, ydd) = plan.eval(t_traj)
+    y = np.array(y, dtype=np.float64)
+    yd = np.array(yd, dtype=np.float64)
+    Xf, Xi, Vi = plan.Xf, plan.Xi, plan.Vi
+
     dy = np.diff(y)
     dy_max = np.max(np.abs(dy))
     dyd = np.diff(yd)
@@ -178,8 +120,8 @@ def graphical_test():
         else:
             Vi = 0
 
-        (Ar, Vr, Dr, Ta, Tv, Td, Tf) = PlanTrap(Xf, Xi, Vi, Vmax, Amax, Dmax)
-        (Y, Yd, Ydd, t) = EvalTrap(Xf, Xi, Vi, Ar, Vr, Dr, Ta, Tv, Td, Tf)
+        plan = PlanTrap(Xf, Xi, Vi, Vmax, Amax, Dmax)
+        (Y, Yd, Ydd, t) = EvalTrap(plan)
 
         # Plotting
         ax1 = axes[rownow, colnow]
@@ -215,8 +157,8 @@ def large_test():
         else:
             Vi = 0
 
-        (Ar, Vr, Dr, Ta, Tv, Td, Tf) = PlanTrap(Xf, Xi, Vi, Vmax, Amax, Dmax)
-        (Y, Yd, Ydd, t) = EvalTrap(Xf, Xi, Vi, Ar, Vr, Dr, Ta, Tv, Td, Tf)
+        plan = PlanTrap(Xf, Xi, Vi, Vmax, Amax, Dmax)
+        (Y, Yd, Ydd, t) = EvalTrap(plan)
 
         print()
 
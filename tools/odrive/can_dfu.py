@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+"""
+Tool for flashing .hex files to many ODrives at once over CAN.
+See docs/can-protocol.md for the protocol.
+"""
+
+import struct
+import sys
+import time
+import zlib
+
+try:
+    import can
+except ImportError:
+    print("You need python-can for this (pip install python-can)", file=sys.stderr)
+    sys.exit(1)
+
+from intelhex import IntelHex
+from odrive.dfu import populate_sectors
+
+CAN_UPDATE_MAGIC = 0x44505543
+CMD_ID_BASE = 0x7E0
+DATA_ID_BASE = 0x1FFE0000
+CMD_SECTOR, CMD_CHUNK_CRC, CMD_SECTOR_END, CMD_RESET = range(4)
+STATUS_READY, STATUS_SKIPPED, STATUS_ERASED, STATUS_COMPLETE, STATUS_MISSING, STATUS_FAILED, STATUS_INVALID = range(7)
+STATUS_NAMES = ['ready', 'skipped', 'erased', 'complete', 'missing', 'failed', 'invalid']
+MSG_RESET_ODRIVE = 0x016
+CHUNK_SIZE = 1024
+BLOCK_SIZE = 8
+
+# The firmware sectors of the STM32F405. Sectors 10 and 11 hold the
+# configuration and are never written.
+SECTORS = ([{'addr': 0x08000000 + i * 0x4000, 'len': 0x4000} for i in range(4)] +
+           [{'addr': 0x08010000, 'len': 0x10000}] +
+           [{'addr': 0x08020000 + i * 0x20000, 'len': 0x20000} for i in range(5)])
+
+class CanUpdateError(Exception):
+    pass
+
+class CanUpdater():
+    def __init__(self, bus, node_ids, logger, timeout=5.0, max_retries=5, chunk_pause=0.002):
+        self._bus = bus
+        self._status_ids = {(node_id << 5) | MSG_RESET_ODRIVE: node_id for node_id in node_ids}
+        self._nodes = set(node_ids)
+        self._logger = logger
+        self._timeout = timeout
+        self._max_retries = max_retries
+        self._chunk_pause = chunk_pause # gives the devices time to check the chunk CRC
+
+    def _send(self, arbitration_id, data, extended=False):
+        msg = can.Message(arbitration_id=arbitration_id, is_extended_id=extended, data=data)
+        while True:
+            try:
+                self._bus.send(msg)
+                return
+            except can.CanError:
+                time.sleep(0.001) # TX queue full
+
+    def _command(self, cmd, data=b''):
+        self._send(CMD_ID_BASE + cmd, data)
+
+    def _collect(self, nodes, sector=None):
+        """
+        Waits for one status frame from each of the nodes. Returns a dict of
+        node ID -> (status, first missing chunk, missing chunk bitmap).
+        """
+        replies = {}
+        deadline = time.monotonic() + self._timeout
+        while len(replies) < len(nodes) and time.monotonic() < deadline:
+            msg = self._bus.recv(timeout=max(deadline - time.monotonic(), 0.0))
+            if msg is None or msg.is_remote_frame or len(msg.data) < 8:
+                continue
+            node_id = self._status_ids.get(msg.arbitration_id)
+            if node_id not in nodes:
+                continue
+            status, msg_sector, first, missing = struct.unpack('<BBHI', bytes(msg.data[:8]))
+            if sector is not None and status != STATUS_READY and msg_sector != sector:
+                continue
+            replies[node_id] = (status, first, missing)
+        for node_id in nodes - set(replies):
+            self._logger.warn("node {} doesn't respond, it is left out".format(node_id))
+            self._nodes.discard(node_id)
+        return replies
+
+    def enter_update_mode(self):
+        for node_id in sorted(self._nodes):
+            self._send((node_id << 5) | MSG_RESET_ODRIVE, struct.pack('<I', CAN_UPDATE_MAGIC))
+        replies = self._collect(set(self._nodes))
+        if not replies:
+            raise CanUpdateError("no node entered the update mode")
+        self._logger.info("{} node(s) in update mode".format(len(replies)))
+
+    def _send_chunk(self, data, chunk):
+        offset = chunk * CHUNK_SIZE
+        end = min(offset + CHUNK_SIZE, len(data))
+        for block in range(offset // BLOCK_SIZE, end // BLOCK_SIZE):
+            self._send(DATA_ID_BASE + block, data[block * BLOCK_SIZE:(block + 1) * BLOCK_SIZE], extended=True)
+        self._command(CMD_CHUNK_CRC, struct.pack('<HHI', chunk, 0, zlib.crc32(data[offset:end])))
+        time.sleep(self._chunk_pause)
+
+    def write_sector(self, index, sector_data):
+        """
+        Writes one sector to all nodes that don't already hold it. Returns the
+        number of nodes that needed it.
+        """
+        # The erased end of the sector doesn't need to be sent
+        length = len(sector_data.rstrip(b'\xff'))
+        length += -length % BLOCK_SIZE
+        data = sector_data[:length]
+        sector_crc = zlib.crc32(sector_data)
+
+        written = set()
+        for attempt in range(self._max_retries):
+            self._command(CMD_SECTOR, struct.pack('<BHBI', index, length & 0xffff, length >> 16, sector_crc))
+            replies = self._collect(set(self._nodes), index)
+            pending = {node_id for node_id, (status, _, _) in replies.items() if status == STATUS_ERASED}
+            for node_id, (status, _, _) in replies.items():
+                if status in (STATUS_FAILED, STATUS_INVALID):
+                    raise CanUpdateError("node {} can't write sector {}: {}".format(node_id, index, STATUS_NAMES[status]))
+            if not pending:
+                return len(written)
+            written |= pending
+
+            chunks = set(range((length + CHUNK_SIZE - 1) // CHUNK_SIZE))
+            failed = set()
+            while chunks and pending:
+                for chunk in sorted(chunks):
+                    self._send_chunk(data, chunk)
+                self._command(CMD_SECTOR_END)
+                replies = self._collect(pending, index)
+                chunks = set()
+                for node_id, (status, first, missing) in replies.items():
+                    if status == STATUS_COMPLETE:
+                        pending.discard(node_id)
+                    elif status == STATUS_MISSING:
+                        chunks |= {first + i for i in range(32) if missing & (1 << i)}
+                    else:
+                        pending.discard(node_id)
+                        failed.add(node_id)
+                pending &= self._nodes
+            if not failed:
+                return len(written)
+            # Starting over erases the sector again where it failed
+            self._logger.warn("sector {} failed on node(s) {}, retrying".format(index, sorted(failed)))
+        raise CanUpdateError("sector {} failed {} times".format(index, self._max_retries))
+
+    def reset(self):
+        self._command(CMD_RESET)
+
+
+def update_over_can(bus, node_ids, hexfile, logger):
+    touched = list(populate_sectors(SECTORS, hexfile))
+    if not touched:
+        raise CanUpdateError("the hex file doesn't contain any firmware sector")
+
+    updater = CanUpdater(bus, node_ids, logger)
+    updater.enter_update_mode()
+    start = time.monotonic()
+    for i, (sector, data) in enumerate(touched):
+        index = SECTORS.index(sector)
+        print("Flashing... (sector {}/{})  \r".format(i, len(touched)), end='', flush=True)
+        n = updater.write_sector(index, bytes(data))
+        logger.debug("sector {}: {}".format(index, "written to {} node(s)".format(n) if n else "unchanged"))
+    print('Flashing... done            ', flush=True)
+    updater.reset()
+    logger.success("Updated {} node(s) in {:.1f} s".format(len(updater._nodes), time.monotonic() - start))
+
+
+def launch_can_dfu(args, logger, cancellation_token):
+    node_ids = [int(n, 0) for n in args.node_ids.split(',')]
+    hexfile = IntelHex(args.file)
+    bus = can.interface.Bus(bustype=args.interface, channel=args.channel, bitrate=args.bitrate)
+    try:
+        update_over_can(bus, node_ids, hexfile, logger)
+    finally:
+        bus.shutdown()
@@ -0,0 +1,306 @@
+#!/usr/bin/env python
+"""
+Load test of a CAN bus with ODrives on it, see docs/can-protocol.md.
+
+Simulates the traffic of other nodes, streams setpoints to the ODrives under
+test and measures the round trip latency and the drop rate of remote frame
+requests to them. If the device under test is also connected over USB, its
+CAN counters and control loop timing are compared before and after the test.
+"""
+
+import collections
+import heapq
+import struct
+import sys
+import threading
+import time
+
+try:
+    import can
+except ImportError:
+    print("You need python-can for this (pip install python-can)", file=sys.stderr)
+    sys.exit(1)
+
+MSG_HEARTBEAT = 0x001
+MSG_GET_ENCODER_ESTIMATES = 0x009
+MSG_SET_INPUT_POS = 0x00c
+MSG_SET_INPUT_VEL = 0x00d
+MSG_SET_INPUT_TORQUE = 0x00e
+MSG_GET_IQ = 0x014
+
+SETPOINT_COMMANDS = {
+    'pos': (MSG_SET_INPUT_POS, lambda value: struct.pack('<fhh', value, 0, 0)),
+    'vel': (MSG_SET_INPUT_VEL, lambda value: struct.pack('<ff', value, 0.0)),
+    'torque': (MSG_SET_INPUT_TORQUE, lambda value: struct.pack('<f', value)),
+}
+
+DEVICE_COUNTERS = ['n_rx_frames', 'n_tx_frames', 'n_rx_overruns', 'n_tx_dropped',
+                   'n_bus_errors', 'n_bus_off', 'n_arbitration_lost']
+
+def frame_bits(dlc, extended=False):
+    """
+    Length of a data frame on the bus in bits, including the interframe space
+    but not the stuff bits, which add up to 20% more.
+    """
+    return (67 if extended else 47) + 8 * dlc
+
+def percentile(sorted_values, p):
+    return sorted_values[min(int(p / 100.0 * len(sorted_values)), len(sorted_values) - 1)]
+
+class Stream():
+    """A frame that is sent periodically"""
+    def __init__(self, kind, node_id, arbitration_id, data, rate, remote=False):
+        self.kind = kind
+        self.node_id = node_id
+        self.msg = can.Message(arbitration_id=arbitration_id, is_extended_id=False,
+                               is_remote_frame=remote, data=data,
+                               dlc=(8 if remote else len(data)))
+        self.period = 1.0 / rate
+        self.n_sent = 0
+        self.n_send_errors = 0 # rejected by the host interface, e.g. TX buffer full
+        self.n_skipped = 0 # not sent in time because the host fell behind
+
+class NodeResult():
+    def __init__(self):
+        self.n_setpoints = 0
+        self.n_requests = 0
+        self.n_dropped = 0
+        self.latencies = [] # [s] from sending the request to receiving the response
+
+class CanLoadTest():
+    """
+    Sends setpoints and remote frame requests to the node IDs under test and
+    the traffic of simulated nodes, each as an independent periodic stream.
+
+    The simulated nodes send a heartbeat at 10 Hz and feedback frames at
+    sim_rate, and receive setpoint frames at sim_rate, like an ODrive that
+    is controlled by this host. Their node IDs must not be used on the bus.
+
+    The responses are matched to the last request of their node, so the
+    request period must be longer than the latency.
+
+    The setpoints carry setpoint_value. They are only applied by axes in
+    closed loop control, so run the test with the axes idle or in a state in
+    which the setpoint is safe.
+    """
+    def __init__(self, bus, node_ids, sim_node_ids=(), setpoint_cmd='vel', setpoint_value=0.0,
+                 setpoint_rate=1000.0, request_cmd=MSG_GET_IQ, request_rate=100.0,
+                 sim_rate=1000.0, timeout=0.1):
+        self._bus = bus
+        self._timeout = timeout
+        self._streams = []
+        self._results = {node_id: NodeResult() for node_id in node_ids}
+        self._pending = {} # arbitration ID -> send times of the unanswered requests
+        self._lock = threading.Lock()
+
+        setpoint_id, pack_setpoint = SETPOINT_COMMANDS[setpoint_cmd]
+        self.setpoint_cmd_id = setpoint_id
+        self.request_cmd_id = request_cmd
+        for node_id in node_ids:
+            if setpoint_rate:
+                self._streams.append(Stream('setpoint', node_id, (node_id << 5) | setpoint_id,
+                                            pack_setpoint(setpoint_value), setpoint_rate))
+            if request_rate:
+                self._streams.append(Stream('request', node_id, (node_id << 5) | request_cmd,
+                                            b'', request_rate, remote=True))
+                self._pending[(node_id << 5) | request_cmd] = collections.deque()
+        for node_id in sim_node_ids:
+            if node_id in node_ids:
+                raise ValueError("node {} is both simulated and under test".format(node_id))
+            self._streams.append(Stream('sim heartbeat', node_id, (node_id << 5) | MSG_HEARTBEAT,
+                                        struct.pack('<II', 0, 1), 10.0))
+            if sim_rate:
+                self._streams.append(Stream('sim setpoint', node_id, (node_id << 5) | MSG_SET_INPUT_VEL,
+                                            struct.pack('<ff', 0.0, 0.0), sim_rate))
+                self._streams.append(Stream('sim feedback', node_id, (node_id << 5) | MSG_GET_ENCODER_ESTIMATES,
+                                            struct.pack('<ff', 0.0, 0.0), sim_rate))
+
+    def offered_load(self, bitrate):
+        """
+        Returns the fraction of the bus bandwidth that the streams of this
+        test take without stuff bits, plus the responses to the requests.
+        """
+        bits = 0.0
+        for stream in self._streams:
+            if stream.msg.is_remote_frame:
+                bits += (frame_bits(0) + frame_bits(stream.msg.dlc)) / stream.period
+            else:
+                bits += frame_bits(stream.msg.dlc) / stream.period
+        return bits / bitrate
+
+    def _expire(self, now):
+        for node_id, result in self._results.items():
+            pending = self._pending.get((node_id << 5) | self.request_cmd_id)
+            while pending and now - pending[0] > self._timeout:
+                pending.popleft()
+                result.n_dropped += 1
+
+    def _on_message(self, msg):
+        now = time.monotonic()
+        if msg.is_remote_frame or msg.is_extended_id or msg.is_error_frame:
+            return
+        with self._lock:
+            pending = self._pending.get(msg.arbitration_id)
+            if pending:
+                # The frames don't carry a sequence number. The response
+                # belongs to the last request, the ones before it were lost.
+                result = self._results[msg.arbitration_id >> 5]
+                result.latencies.append(now - pending.pop())
+                result.n_dropped += len(pending)
+                pending.clear()
+
+    def _send(self, stream):
+        with self._lock:
+            now = time.monotonic()
+            if stream.kind == 'request':
+                self._expire(now)
+            try:
+                self._bus.send(stream.msg, timeout=0)
+            except can.CanError:
+                stream.n_send_errors += 1
+                return
+            stream.n_sent += 1
+            if stream.kind == 'request':
+                self._pending[stream.msg.arbitration_id].append(now)
+                self._results[stream.node_id].n_requests += 1
+            elif stream.kind == 'setpoint':
+                self._results[stream.node_id].n_setpoints += 1
+
+    def run(self, duration, cancellation_token=None):
+        """
+        Sends the streams for duration seconds. Returns the results of each
+        node under test as a dict.
+        """
+        notifier = can.Notifier(self._bus, [self._on_message])
+        try:
+            start = time.monotonic()
+            # Spread the first frames of the streams over one period so that
+            # they don't all come in bursts
+            queue = [(start + stream.period * i / len(self._streams), i) for i, stream in enumerate(self._streams)]
+            heapq.heapify(queue)
+            while queue:
+                due, i = queue[0]
+                if due > start + duration or (cancellation_token and cancellation_token.is_set()):
+                    break
+                wait = due - time.monotonic()
+                if wait > 0:
+                    time.sleep(wait)
+                stream = self._streams[i]
+                self._send(stream)
+                due += stream.period
+                # Keep the rate instead of sending a burst after a stall
+                late = int((time.monotonic() - due) / stream.period)
+                if late > 0:
+                    stream.n_skipped += late
+                    due += late * stream.period
+                heapq.heapreplace(queue, (due, i))
+            self.duration = time.monotonic() - start
+            time.sleep(self._timeout)
+        finally:
+            notifier.stop()
+        with self._lock:
+            self._expire(float('inf'))
+        return self._results
+
+    def print_results(self, logger, bitrate):
+        # The streams of the simulated nodes are summed up by kind
+        rows = collections.OrderedDict()
+        for stream in self._streams:
+            name = stream.kind if stream.kind.startswith('sim') else "{} {}".format(stream.kind, stream.node_id)
+            row = rows.setdefault(name, [0, 0, 0])
+            row[0] += stream.n_sent
+            row[1] += stream.n_send_errors
+            row[2] += stream.n_skipped
+        print("{:16s} {:>8s} {:>8s} {:>8s} {:>8s}".format('stream', 'rate', 'sent', 'rejected', 'skipped'))
+        for name, (n_sent, n_send_errors, n_skipped) in rows.items():
+            print("{:16s} {:8.1f} {:8d} {:8d} {:8d}".format(
+                name, n_sent / self.duration, n_sent, n_send_errors, n_skipped))
+        print("offered bus load {:.1f}% of {} bit/s (without stuff bits)".format(
+            100.0 * self.offered_load(bitrate), bitrate))
+
+        print("{:>4s} {:>8s} {:>8s} {:>8s} {:>8s} {:>8s} {:>8s}".format(
+            'node', 'requests', 'dropped', 'min', 'median', '99%', 'max'))
+        for node_id, result in sorted(self._results.items()):
+            latencies = sorted(result.latencies)
+            columns = ["{:6.0f}us".format(1e6 * percentile(latencies, p)) if latencies else "{:>8s}".format('-')
+                       for p in (0, 50, 99, 100)]
+            print("{:4d} {:8d} {:7.2f}% {}".format(
+                node_id, result.n_requests, 100.0 * result.n_dropped / max(result.n_requests, 1), ' '.join(columns)))
+            if result.n_dropped:
+                logger.warn("node {}: {} of {} requests were not answered".format(
+                    node_id, result.n_dropped, result.n_requests))
+
+
+def _read_device_stats(odrv, cmd_ids):
+    stats = {name: getattr(odrv.can, name) for name in DEVICE_COUNTERS}
+    stats['n_evt_control_loop'] = odrv.n_evt_control_loop
+    stats['deadline_miss_count'] = odrv.axis0.motor.deadline_miss_count + odrv.axis1.motor.deadline_miss_count
+    for cmd_id in cmd_ids:
+        stats[cmd_id] = odrv.can.get_command_count(cmd_id)
+    return stats
+
+def _reset_device_maxima(odrv):
+    odrv.can.max_rx_latency = 0
+    odrv.can.tx_queue_high_water = 0
+    odrv.task_times.control_loop.reset()
+
+def print_device_stats(odrv, test, before, after, logger):
+    """
+    Prints what the device under test saw during the test, from the stats
+    before and after it.
+    """
+    from odrive.utils import control_loop_frequency
+    delta = {key: (after[key] - before[key]) & 0xffffffff for key in before}
+    for name in DEVICE_COUNTERS:
+        print("{:20s} {:10d}".format(name, delta[name]))
+    print("{:20s} {:10.0f} us".format('max_rx_latency', odrv.can.max_rx_latency))
+    print("{:20s} {:10d}".format('tx_queue_high_water', odrv.can.tx_queue_high_water))
+
+    # The device counts the commands of both axes, so only its node IDs count
+    node_ids = {odrv.axis0.config.can.node_id, odrv.axis1.config.can.node_id}
+    sent = {cmd_id: sum(result.n_setpoints if cmd_id == test.setpoint_cmd_id else result.n_requests
+                        for node_id, result in test._results.items() if node_id in node_ids)
+            for cmd_id in (test.setpoint_cmd_id, test.request_cmd_id)}
+    for cmd_id, n_sent in sent.items():
+        if n_sent:
+            print("command 0x{:03x}: {} sent, {} received".format(cmd_id, n_sent, delta[cmd_id]))
+            if delta[cmd_id] < n_sent:
+                logger.warn("the device lost {} frames of command 0x{:03x}".format(n_sent - delta[cmd_id], cmd_id))
+
+    period_us = 1e6 / control_loop_frequency(odrv)
+    max_us = odrv.task_times.control_loop.max_length / 168.0 # HCLK ticks to us
+    print("control loop: {} iterations, longest {:.1f} us of {:.1f} us, {} deadline misses".format(
+        delta['n_evt_control_loop'], max_us, period_us, delta['deadline_miss_count']))
+    if delta['deadline_miss_count'] or delta['n_rx_overruns'] or delta['n_tx_dropped']:
+        logger.error("the device didn't keep up with this bus load")
+
+
+def launch_can_load_test(args, logger, cancellation_token):
+    node_ids = [int(n, 0) for n in args.node_ids.split(',')]
+    sim_node_ids = [n for n in range(0x3f) if n not in node_ids][-args.sim_nodes:] if args.sim_nodes else []
+    bus = can.interface.Bus(bustype=args.interface, channel=args.channel, bitrate=args.bitrate)
+    try:
+        test = CanLoadTest(bus, node_ids, sim_node_ids,
+                           setpoint_cmd=args.setpoint_cmd, setpoint_value=args.setpoint_value,
+                           setpoint_rate=args.setpoint_rate, request_rate=args.request_rate,
+                           sim_rate=args.sim_rate, timeout=args.timeout)
+
+        odrv = None
+        if not args.no_usb:
+            import odrive
+            print("Waiting for ODrive...")
+            odrv = odrive.find_any(path=args.path, serial_number=args.serial_number,
+                                   search_cancellation_token=cancellation_token,
+                                   channel_termination_token=cancellation_token)
+            cmd_ids = (test.setpoint_cmd_id, test.request_cmd_id)
+            _reset_device_maxima(odrv)
+            before = _read_device_stats(odrv, cmd_ids)
+
+        print("Running for {:.0f} s with {} simulated node(s)...".format(args.duration, len(sim_node_ids)))
+        test.run(args.duration, cancellation_token)
+        test.print_results(logger, args.bitrate)
+
+        if odrv is not None:
+            print_device_stats(odrv, test, before, _read_device_stats(odrv, cmd_ids), logger)
+    finally:
+        bus.shutdown()
@@ -0,0 +1,340 @@
+"""
+Binary capture files (.odcap) of sampled ODrive properties.
+
+All fields are little endian and every section starts at a multiple of 8
+bytes, so the file can be memory mapped and the blocks used in place.
+
+    file header    char magic[6] = "ODCAP\\0", uint16 version,
+                   uint16 num_channels, uint16 reserved, uint32 info_length,
+                   float64 sample_rate [Hz] (0 if the samples are not regular)
+    channel table  num_channels times char name[40], char unit[8] (NUL padded)
+    info           info_length bytes of UTF-8 JSON (source, serial number, ...)
+                   padded to a multiple of 8 bytes
+    blocks         until the end of the file:
+                   char marker[4] = "BLK\\0", uint32 num_samples,
+                   int64 timestamps[num_samples] [ns],
+                   float32 values[num_samples][num_channels],
+                   padded to a multiple of 8 bytes
+
+Firmware/Simulation/capture_file.hpp reads the same format on the host side
+of the firmware, to replay captures into simulations.
+"""
+
+import array
+import json
+import mmap
+import struct
+import sys
+import time
+
+CAPTURE_MAGIC = b'ODCAP\0'
+CAPTURE_VERSION = 1
+BLOCK_MARKER = b'BLK\0'
+CHANNEL_NAME_LENGTH = 40
+CHANNEL_UNIT_LENGTH = 8
+
+_file_header = struct.Struct('<6sHHHId')
+_channel_entry = struct.Struct('<{}s{}s'.format(CHANNEL_NAME_LENGTH, CHANNEL_UNIT_LENGTH))
+_block_header = struct.Struct('<4sI')
+
+def _padding(length):
+    return b'\0' * (-length % 8)
+
+def _to_bytes(typecode, values):
+    data = array.array(typecode, values)
+    if sys.byteorder != 'little':
+        data.byteswap()
+    return data.tobytes()
+
+class CaptureWriter():
+    """
+    Writes a capture file block by block.
+
+    Example Usage:
+        with CaptureWriter('capture.odcap', ['pos', 'vel'], ['turn', 'turn/s'], sample_rate=8000) as f:
+            f.write_block(timestamps_ns, values) # values has one row per sample
+    """
+
+    def __init__(self, path, channels, units=None, sample_rate=0.0, info=None):
+        units = units or [''] * len(channels)
+        for name, unit in zip(channels, units):
+            if len(name.encode()) >= CHANNEL_NAME_LENGTH or len(unit.encode()) >= CHANNEL_UNIT_LENGTH:
+                raise Exception("channel name or unit too long: {} [{}]".format(name, unit))
+        self.num_channels = len(channels)
+        self.num_samples = 0
+        info = json.dumps(info or {}).encode()
+        self._file = open(path, 'wb')
+        self._file.write(_file_header.pack(CAPTURE_MAGIC, CAPTURE_VERSION, len(channels), 0, len(info), sample_rate))
+        for name, unit in zip(channels, units):
+            self._file.write(_channel_entry.pack(name.encode(), unit.encode()))
+        self._file.write(info + _padding(len(info)))
+
+    def write_block(self, timestamps, values):
+        """
+        timestamps: list of int, one per sample [ns]
+        values: one sequence of num_channels values per sample
+        numpy arrays of the shapes (n,) and (n, num_channels) are written
+        without going through Python objects.
+        """
+        if not len(timestamps):
+            return
+        if hasattr(values, 'dtype'):
+            if values.shape != (len(timestamps), self.num_channels):
+                raise Exception("expected {} rows of {} values".format(len(timestamps), self.num_channels))
+            data = values.astype('<f4', copy=False).tobytes()
+        else:
+            rows = list(values)
+            if len(rows) != len(timestamps) or any(len(row) != self.num_channels for row in rows):
+                raise Exception("expected {} rows of {} values".format(len(timestamps), self.num_channels))
+            data = _to_bytes('f', (float(x) for row in rows for x in row))
+        self._file.write(_block_header.pack(BLOCK_MARKER, len(timestamps)))
+        if hasattr(timestamps, 'dtype'):
+            self._file.write(timestamps.astype('<i8', copy=False).tobytes())
+        else:
+            self._file.write(_to_bytes('q', (int(t) for t in timestamps)))
+        self._file.write(data + _padding(len(data)))
+        self.num_samples += len(timestamps)
+
+    def close(self):
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+class CaptureReader():
+    """
+    Memory maps a capture file. `blocks` is a list of (timestamps, values)
+    memoryviews that point into the file, with the shapes (num_samples,) and
+    (num_samples, num_channels). numpy.asarray() turns them into arrays
+    without a copy (on little endian hosts).
+
+    Example Usage:
+        capture = CaptureReader('capture.odcap')
+        pos = capture['axis0.encoder.pos_estimate']
+        t = [t * 1e-9 for t in capture.timestamps]
+    """
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self._mmap = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        buffer = memoryview(self._mmap)
+        if len(buffer) < _file_header.size:
+            raise Exception("{} is not a capture file".format(path))
+        magic, version, num_channels, _, info_length, self.sample_rate = _file_header.unpack_from(buffer, 0)
+        if magic != CAPTURE_MAGIC:
+            raise Exception("{} is not a capture file".format(path))
+        if version != CAPTURE_VERSION:
+            raise Exception("{} has the unsupported version {}".format(path, version))
+        if sys.byteorder != 'little':
+            raise Exception("capture files can only be read on little endian hosts")
+
+        pos = _file_header.size
+        self.channels = []
+        self.units = []
+        for i in range(num_channels):
+            name, unit = _channel_entry.unpack_from(buffer, pos)
+            self.channels.append(name.rstrip(b'\0').decode())
+            self.units.append(unit.rstrip(b'\0').decode())
+            pos += _channel_entry.size
+        self.info = json.loads(bytes(buffer[pos:pos + info_length]).decode() or '{}')
+        pos += info_length + (-info_length % 8)
+
+        self.blocks = []
+        while pos + _block_header.size <= len(buffer):
+            marker, num_samples = _block_header.unpack_from(buffer, pos)
+            values_length = num_samples * num_channels * 4
+            end = pos + _block_header.size + num_samples * 8 + values_length
+            if marker != BLOCK_MARKER or end > len(buffer):
+                break # truncated, e.g. by a recording that was interrupted
+            pos += _block_header.size
+            timestamps = buffer[pos:pos + num_samples * 8].cast('q')
+            pos += num_samples * 8
+            values = buffer[pos:pos + values_length].cast('f', [num_samples, num_channels])
+            pos = end + (-values_length % 8)
+            self.blocks.append((timestamps, values))
+
+    @property
+    def timestamps(self):
+        """All timestamps [ns] as a list"""
+        return [t for timestamps, values in self.blocks for t in timestamps.tolist()]
+
+    def __getitem__(self, channel):
+        """All values of a channel (name or index) as a list"""
+        index = self.channels.index(channel) if isinstance(channel, str) else channel
+        return [row[index] for timestamps, values in self.blocks for row in values.tolist()]
+
+    def __len__(self):
+        return sum(len(timestamps) for timestamps, values in self.blocks)
+
+    def samples(self):
+        """Yields (timestamp [ns], values) for every sample in the order they were recorded."""
+        for timestamps, values in self.blocks:
+            yield from zip(timestamps.tolist(), values.tolist())
+
+    def to_csv(self, path):
+        with open(path, 'w') as f:
+            f.write(','.join(['t'] + self.channels) + '\n')
+            for t, row in self.samples():
+                f.write(','.join([repr(t * 1e-9)] + [repr(x) for x in row]) + '\n')
+
+    def close(self):
+        for timestamps, values in self.blocks:
+            timestamps.release()
+            values.release()
+        self.blocks = []
+        try:
+            self._mmap.close()
+        except BufferError:
+            pass # views of the file are still in use, they keep it mapped
+
+def property_paths(odrv):
+    """
+    Returns a dict of endpoint ID to the dotted path of every property of
+    the ODrive, e.g. {123: 'axis0.encoder.pos_estimate'}.
+    """
+    import fibre.remote_object
+    paths = {}
+    def walk(obj, prefix):
+        for name, attr in obj._remote_attributes.items():
+            if isinstance(attr, fibre.remote_object.RemoteProperty):
+                paths[attr._id] = prefix + name
+            elif isinstance(attr, fibre.remote_object.RemoteObject):
+                walk(attr, prefix + name + '.')
+    walk(odrv, '')
+    return paths
+
+def _device_info(odrv, source):
+    return {
+        'source': source,
+        'serial_number': '{:012X}'.format(odrv.serial_number),
+        'fw_version': '{}.{}.{}'.format(odrv.fw_version_major, odrv.fw_version_minor, odrv.fw_version_revision),
+        'created': time.strftime('%Y-%m-%dT%H:%M:%S'),
+    }
+
+def record_oscilloscope(odrv, path):
+    """
+    Saves the last capture of the oscilloscope. Sample 0 is the oldest one,
+    the info contains the index of the trigger sample.
+    """
+    import numpy as np
+    from odrive.utils import oscilloscope_read_array, control_loop_frequency
+    config = odrv.oscilloscope.config
+    paths = property_paths(odrv)
+    channels = [paths.get(getattr(config, 'channel' + str(i))[0], 'channel' + str(i)) for i in range(config.num_channels)]
+    sample_rate = control_loop_frequency(odrv) / max(config.decimation, 1)
+    values = oscilloscope_read_array(odrv)[:, :config.num_channels]
+    info = _device_info(odrv, 'oscilloscope')
+    info['trigger_sample'] = odrv.oscilloscope.trigger_sample
+    with CaptureWriter(path, channels, sample_rate=sample_rate, info=info) as f:
+        f.write_block((np.arange(len(values)) * (1e9 / sample_rate)).astype(np.int64), values)
+        return f.num_samples
+
+def record_telemetry(odrv, path, properties, duration, decimation=1, printfunc=print):
+    """
+    Streams up to eight properties with odrv.telemetry for duration seconds
+    and writes them to the capture file as they arrive. The timestamps are
+    derived from the loop count of the frames. Needs the native USB protocol.
+    properties: list of dotted paths, e.g. ['axis0.encoder.pos_estimate']
+    """
+    import numpy as np
+    from odrive.utils import TelemetryReader, configure_telemetry, control_loop_frequency
+    configure_telemetry(odrv, properties, decimation)
+    config = odrv.telemetry.config
+    period_ns = 1e9 / control_loop_frequency(odrv)
+
+    reader = TelemetryReader(odrv)
+    first_loop_count = None
+    last_loop_count = 0 # unwrapped
+    with CaptureWriter(path, properties, sample_rate=1e9 / period_ns / decimation, info=_device_info(odrv, 'telemetry')) as f:
+        config.enabled = True
+        try:
+            end = time.monotonic() + duration
+            while True:
+                done = time.monotonic() >= end
+                if done:
+                    config.enabled = False
+                time.sleep(0.1)
+                loop_counts, values = reader.read_array()
+                if len(loop_counts):
+                    # Unwrap the 32 bit loop count
+                    if first_loop_count is None:
+                        first_loop_count = int(loop_counts[0])
+                        last_loop_count = first_loop_count
+                    steps = (np.diff(loop_counts.astype(np.int64), prepend=last_loop_count) & 0xffffffff)
+                    unwrapped = last_loop_count + np.cumsum(steps)
+                    last_loop_count = int(unwrapped[-1])
+                    f.write_block(((unwrapped - first_loop_count) * period_ns).astype(np.int64), values)
+                if done:
+                    break
+        finally:
+            config.enabled = False
+            reader.close()
+        printfunc("recorded {} samples, {} lost".format(f.num_samples, reader.lost_frames))
+        return f.num_samples
+
+def record_polled(odrv, path, properties, duration, rate=200.0, printfunc=print):
+    """
+    Reads the properties at up to rate Hz for duration seconds with batch
+    requests. Works on any interface, the timestamps are host time.
+    """
+    from fibre.benchmark import find_property
+    from fibre.remote_object import read_properties
+    props = [find_property(odrv, prop) for prop in properties]
+    timestamps = []
+    values = []
+    with CaptureWriter(path, properties, info=_device_info(odrv, 'poll')) as f:
+        start = time.monotonic()
+        while time.monotonic() - start < duration:
+            t = time.monotonic()
+            values.append(read_properties(props))
+            timestamps.append(int((t - start) * 1e9))
+            if len(timestamps) >= 1000:
+                f.write_block(timestamps, values)
+                timestamps, values = [], []
+            time.sleep(max(1.0 / rate - (time.monotonic() - t), 0))
+        f.write_block(timestamps, values)
+        printfunc("recorded {} samples".format(f.num_samples))
+        return f.num_samples
+
+def replay(path, callback, realtime=False):
+    """
+    Calls callback(timestamp [s], {channel: value}) for every sample of the
+    capture, optionally paced to the recorded timestamps.
+    """
+    capture = CaptureReader(path)
+    start = time.monotonic()
+    t0 = None
+    for t, values in capture.samples():
+        t0 = t if t0 is None else t0
+        if realtime:
+            time.sleep(max((t - t0) * 1e-9 - (time.monotonic() - start), 0))
+        callback((t - t0) * 1e-9, dict(zip(capture.channels, values)))
+    capture.close()
+
+def print_capture(path, printfunc=print):
+    capture = CaptureReader(path)
+    timestamps = capture.timestamps
+    duration = (timestamps[-1] - timestamps[0]) * 1e-9 if len(timestamps) else 0.0
+    printfunc("{}: {} samples in {} blocks over {:.3f}s".format(path, len(timestamps), len(capture.blocks), duration))
+    if capture.sample_rate:
+        printfunc("  sample rate {:.1f}Hz".format(capture.sample_rate))
+    for k, v in capture.info.items():
+        printfunc("  {}: {}".format(k, v))
+    for i, (name, unit) in enumerate(zip(capture.channels, capture.units)):
+        column = capture[i]
+        if column:
+            printfunc("  {:40s} min {:12.6g}  mean {:12.6g}  max {:12.6g} {}".format(name, min(column), sum(column) / len(column), max(column), unit))
+    capture.close()
+
+def plot_capture(path):
+    import matplotlib.pyplot as plt
+    capture = CaptureReader(path)
+    t = [t * 1e-9 for t in capture.timestamps]
+    for i, name in enumerate(capture.channels):
+        plt.plot(t, capture[i], label=name)
+    plt.xlabel("Time (seconds)")
+    plt.legend()
+    plt.show()
@@ -1,23 +1,46 @@
 
+import base64
 import json
 import os
+import struct
 import tempfile
+import threading
 import fibre.remote_object
 from odrive.utils import OperationAbortedException, yes_no_prompt
 
-def get_dict(obj, is_config_object):
+def get_dict(obj, is_config_object, reads=None):
+    """
+    Returns the config properties below obj as nested dict. The properties
+    are read in batches after the whole tree was visited.
+    """
     result = {}
+    outermost = reads is None
+    if outermost:
+        reads = []
     for (k,v) in obj._remote_attributes.items():
         if isinstance(v, fibre.remote_object.RemoteProperty) and is_config_object:
-            result[k] = v.get_value()
+            result[k] = None
+            reads.append((result, k, v))
         elif isinstance(v, fibre.remote_object.RemoteObject):
-            sub_dict = get_dict(v, k == 'config')
+            sub_dict = get_dict(v, k == 'config', reads)
             if sub_dict != {}:
                 result[k] = sub_dict
+    if outermost:
+        values = fibre.remote_object.read_properties([prop for _, _, prop in reads])
+        for (d, k, _), value in zip(reads, values):
+            d[k] = value
     return result
 
-def set_dict(obj, path, config_dict):
+def set_dict(obj, path, config_dict, writes=None):
+    """
+    Writes the nested dict of config properties to obj. The properties are
+    written in batches. If a batch fails its properties are written one by
+    one to find out which one failed.
+    """
     errors = []
+    outermost = writes is None
+    if outermost:
+        writes = []
     for (k,v) in config_dict.items():
         name = path + ("." if path != "" else "") + k
         if not k in obj._remote_attributes:
@@ -25,14 +48,58 @@ def set_dict(obj, path, config_dict):
             continue
         remote_attribute = obj._remote_attributes[k]
         if isinstance(remote_attribute, fibre.remote_object.RemoteObject):
-            errors += set_dict(remote_attribute, name, v)
+            errors += set_dict(remote_attribute, name, v, writes)
         else:
-            try:
-                remote_attribute.set_value(v)
-            except Exception as ex:
-                errors.append("Could not restore {}: {}".format(name, str(ex)))
+            writes.append((name, remote_attribute, v))
+    if outermost:
+        try:
+            fibre.remote_object.write_properties([prop for _, prop, _ in writes], [v for _, _, v in writes])
+        except Exception:
+            for name, prop, v in writes:
+                try:
+                    prop.set_value(v)
+                except Exception as ex:
+                    errors.append("Could not restore {}: {}".format(name, str(ex)))
     return errors
 
+# Shape of the header of the config blob, see ODrive::read_config_raw()
+CONFIG_BLOB_HEADER = '<IHHI' # json_version_id, config_version, crc16, length
+
+def read_config_blob(device):
+    """
+    Reads the whole configuration as one binary blob. This is much faster
+    than get_dict(), but the blob can only be restored on the same firmware.
+    Returns None if the device doesn't support it or is saving its
+    configuration.
+    """
+    func = device._remote_attributes.get('read_config_raw', None)
+    if func is None:
+        return None
+    blob = bytes(device.__channel__.remote_endpoint_read_buffer(func._trigger_id))
+    header_length = struct.calcsize(CONFIG_BLOB_HEADER)
+    if len(blob) < header_length or struct.unpack(CONFIG_BLOB_HEADER, blob[:header_length])[3] != len(blob) - header_length:
+        return None
+    return blob
+
+def write_config_blob(device, blob):
+    """
+    Writes a blob from read_config_blob() to the device and takes it over.
+    Returns False if the device doesn't support it or rejected the blob, for
+    example because it runs another firmware version.
+    """
+    func = device._remote_attributes.get('write_config_raw', None)
+    if func is None:
+        return False
+    channel = device.__channel__
+    chunk_length = channel._max_packet_size - 12 # 8 bytes of request header and trailer, 4 bytes offset
+    offsets = range(0, len(blob), chunk_length)
+    results = channel.remote_endpoint_operations(
+        [(func._trigger_id, struct.pack('<I', offset) + blob[offset:offset + chunk_length], 4) for offset in offsets])
+    for offset, result in zip(offsets, results):
+        if len(result) != 4 or struct.unpack('<I', result)[0] != len(blob[offset:offset + chunk_length]):
+            return False
+    return device.apply_config_raw()
+
 def get_temp_config_filename(device):
     serial_number = fibre.utils.get_serial_number_str(device)
     safe_serial_number = ''.join(filter(str.isalnum, serial_number))
@@ -55,6 +122,10 @@ def backup_config(device, filename, logger):
             raise OperationAbortedException()
 
     data = get_dict(device, False)
+    blob = read_config_blob(device)
+    if blob is not None:
+        # Restores in one go on the same firmware, the dict is the fallback
+        data['config_blob'] = base64.b64encode(blob).decode('ascii')
     with open(filename, 'w') as file:
         json.dump(data, file)
     logger.info("Configuration saved.")
@@ -71,7 +142,11 @@ def restore_config(device, filename, logger):
         data = json.load(file)
 
     logger.info("Restoring configuration from {}...".format(filename))
-    errors = set_dict(device, "", data)
+    blob = data.pop('config_blob', None)
+    if blob is not None and write_config_blob(device, base64.b64decode(blob)):
+        errors = []
+    else:
+        errors = set_dict(device, "", data)
 
     for error in errors:
         logger.info(error)
@@ -80,3 +155,25 @@ def restore_config(device, filename, logger):
     
     device.save_configuration()
     logger.info("Configuration restored.")
+
+def restore_configs(devices, filenames, logger):
+    """
+    Restores the configuration of several ODrives at the same time, for
+    example of all the ODrives of a machine. Each device gets the file at the
+    same position in filenames. Raises the first exception that occurred
+    after all devices were done.
+    """
+    exceptions = []
+    def restore(device, filename):
+        try:
+            restore_config(device, filename, logger)
+        except Exception as ex:
+            exceptions.append(ex)
+    threads = [threading.Thread(target=restore, args=(device, filename), daemon=True)
+               for device, filename in zip(devices, filenames)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    if exceptions:
+        raise exceptions[0]
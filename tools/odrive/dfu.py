@@ -78,11 +78,24 @@ def get_first_mismatch_index(array1, array2):
     """
     if len(array1) != len(array2):
         raise Exception("arrays must be same size")
+    if bytes(array1) == bytes(array2):
+        return None
     for pos in range(len(array1)):
         if (array1[pos] != array2[pos]):
             return pos
     return None
 
+def get_changed_sectors(dfudev, touched_sectors):
+    """
+    Reads back the touched sectors and returns the ones whose content differs
+    from the data that is to be flashed. Reading a sector takes much less
+    time than erasing and writing it and doesn't wear the flash.
+    """
+    for i, (sector, data) in enumerate(touched_sectors):
+        print("Comparing... (sector {}/{})  \r".format(i, len(touched_sectors)), end='', flush=True)
+        if get_first_mismatch_index(dfudev.read_sector(sector), data) is not None:
+            yield (sector, data)
+
 def dump_otp(dfudev):
     """
     Dumps the contents of the one-time-programmable
@@ -373,6 +386,16 @@ def update_device(device, firmware, logger, cancellation_token):
     # fill sectors with data
     touched_sectors = list(populate_sectors(dfudev.sectors, hexfile))
 
+    # skip the sectors that already hold the new firmware, e.g. the ones
+    # that didn't change since the last release
+    try:
+        changed_sectors = list(get_changed_sectors(dfudev, touched_sectors))
+        print('Comparing... done            \r', end='', flush=True)
+    finally:
+        print('', flush=True)
+    print("{} of {} sectors changed".format(len(changed_sectors), len(touched_sectors)))
+    touched_sectors = changed_sectors
+
     logger.debug("The following sectors will be flashed: ")
     for sector,_ in touched_sectors:
         logger.debug(" {:08X} to {:08X}".format(sector['addr'], sector['addr'] + sector['len'] - 1))
@@ -186,6 +186,10 @@ class DfuDevice:
             raise RuntimeError("An error occured. Device Status: {!r}".format(status))
 
     def write_sector(self, sector, data):
+        """
+        Writes data to the specified sector, which must be erased. Blocks
+        that are erased in data (all 0xff) are skipped.
+        """
         self.set_alternate_safe(sector['alt'])
         self.set_address_safe(sector['addr'])
 
@@ -193,6 +197,8 @@ class DfuDevice:
         
         blocks = [data[i:i + transfer_size] for i in range(0, len(data), transfer_size)]
         for blocknum, block in enumerate(blocks):
+            if all(b == 0xff for b in block):
+                continue # the block numbers are relative to the sector address
             #print('write to {:08X} ({} bytes)'.format(
             #        sector['addr'] + blocknum * TRANSFER_SIZE, len(block)))
             self.write(blocknum, block)
@@ -3,6 +3,10 @@
 # To regenerate this file, nagivate to the top level of the ODrive repository and run:
 #   python Firmware/interface_generator_stub.py --definitions Firmware/odrive-interface.yaml --template tools/enums_template.j2 --output tools/odrive/enums.py
 
+# ODrive.IrqPriorityProfile
+IRQ_PRIORITY_PROFILE_CONTROL_LATENCY     = 0
+IRQ_PRIORITY_PROFILE_COMMS_THROUGHPUT    = 1
+
 # ODrive.GpioMode
 GPIO_MODE_DIGITAL                        = 0
 GPIO_MODE_DIGITAL_PULL_UP                = 1
@@ -20,9 +24,18 @@ GPIO_MODE_ENC1                           = 12
 GPIO_MODE_ENC2                           = 13
 GPIO_MODE_MECH_BRAKE                     = 14
 GPIO_MODE_STATUS                         = 15
+GPIO_MODE_STEP_COUNTER                   = 16
+GPIO_MODE_SYNC_IN                        = 17
+GPIO_MODE_SYNC_OUT                       = 18
 
 # ODrive.Can.Protocol
 PROTOCOL_SIMPLE                          = 0
+PROTOCOL_CAN_OPEN                        = 1
+
+# ODrive.TimeSync.Mode
+MODE_DISABLED                            = 0
+MODE_MASTER                              = 1
+MODE_SLAVE                               = 2
 
 # ODrive.Axis.AxisState
 AXIS_STATE_UNDEFINED                     = 0
@@ -36,6 +49,15 @@ AXIS_STATE_CLOSED_LOOP_CONTROL           = 8
 AXIS_STATE_LOCKIN_SPIN                   = 9
 AXIS_STATE_ENCODER_DIR_FIND              = 10
 AXIS_STATE_HOMING                        = 11
+AXIS_STATE_ENCODER_ECCENTRICITY_CALIBRATION = 12
+AXIS_STATE_FREQUENCY_RESPONSE            = 13
+AXIS_STATE_ENCODER_INDEX_AND_OFFSET_CALIBRATION = 14
+AXIS_STATE_ENCODER_HALL_EDGE_CALIBRATION = 15
+AXIS_STATE_VF_CONTROL                    = 16
+
+# ODrive.FrequencyResponse.ExcitationTarget
+EXCITATION_TARGET_TORQUE                 = 0
+EXCITATION_TARGET_VELOCITY               = 1
 
 # ODrive.Encoder.Mode
 ENCODER_MODE_INCREMENTAL                 = 0
@@ -45,6 +67,8 @@ ENCODER_MODE_SPI_ABS_CUI                 = 256
 ENCODER_MODE_SPI_ABS_AMS                 = 257
 ENCODER_MODE_SPI_ABS_AEAT                = 258
 ENCODER_MODE_SPI_ABS_RLS                 = 259
+ENCODER_MODE_SPI_ABS_SSI                 = 260
+ENCODER_MODE_SPI_ABS_BISSC               = 261
 
 # ODrive.Controller.ControlMode
 CONTROL_MODE_VOLTAGE_CONTROL             = 0
@@ -61,12 +85,99 @@ INPUT_MODE_MIX_CHANNELS                  = 4
 INPUT_MODE_TRAP_TRAJ                     = 5
 INPUT_MODE_TORQUE_RAMP                   = 6
 INPUT_MODE_MIRROR                        = 7
+INPUT_MODE_SCURVE_TRAJ                   = 8
+INPUT_MODE_PVT                           = 9
+INPUT_MODE_CAM                           = 10
+
+# ODrive.Controller.InputShaperType
+INPUT_SHAPER_TYPE_NONE                   = 0
+INPUT_SHAPER_TYPE_ZV                     = 1
+INPUT_SHAPER_TYPE_ZVD                    = 2
+
+# ODrive.Controller.GainScheduleInput
+GAIN_SCHEDULE_INPUT_NONE                 = 0
+GAIN_SCHEDULE_INPUT_VELOCITY             = 1
+GAIN_SCHEDULE_INPUT_POSITION             = 2
+GAIN_SCHEDULE_INPUT_POSITION_ERROR       = 3
+
+# ODrive.Controller.LearningPhaseSource
+LEARNING_PHASE_SOURCE_TIME               = 0
+LEARNING_PHASE_SOURCE_MASTER_POSITION    = 1
+
+# ODrive.Oscilloscope.TriggerMode
+TRIGGER_MODE_RISING                      = 0
+TRIGGER_MODE_FALLING                     = 1
+TRIGGER_MODE_LEVEL                       = 2
+TRIGGER_MODE_SOFTWARE                    = 3
+
+# ODrive.Oscilloscope.CaptureState
+CAPTURE_STATE_IDLE                       = 0
+CAPTURE_STATE_ARMED                      = 1
+CAPTURE_STATE_CAPTURING                  = 2
+CAPTURE_STATE_DONE                       = 3
+
+# ODrive.EventLog.Source
+SOURCE_SYSTEM                            = 0
+SOURCE_MOTOR                             = 1
+SOURCE_ENCODER                           = 2
+SOURCE_CONTROLLER                        = 3
+
+# ODrive.KernelBenchmark.Kernel
+KERNEL_FOC                               = 0
+KERNEL_SVM                               = 1
+KERNEL_SINCOS                            = 2
+KERNEL_ATAN2                             = 3
+KERNEL_CRC16                             = 4
+KERNEL_ATAN2_LUT                         = 5
+KERNEL_ATAN2_PRECISE                     = 6
+KERNEL_RSQRT                             = 7
+
+# ODrive.Operations.OperationState
+OPERATION_STATE_UNKNOWN                  = 0
+OPERATION_STATE_RUNNING                  = 1
+OPERATION_STATE_SUCCEEDED                = 2
+OPERATION_STATE_FAILED                   = 3
+
+# ODrive.Telemetry.Encoding
+ENCODING_RAW                             = 0
+ENCODING_DELTA                           = 1
+
+# ODrive.SensorlessEstimator.HfiState
+HFI_STATE_IDLE                           = 0
+HFI_STATE_SCAN                           = 1
+HFI_STATE_POLARITY                       = 2
+HFI_STATE_TRACK                          = 3
+HFI_STATE_FAILED                         = 4
+
+# ODrive.Controller.AnticoggingMode
+ANTICOGGING_MODE_LUT                     = 0
+ANTICOGGING_MODE_HARMONICS               = 1
+
+# ODrive.FilterBank.FilterType
+FILTER_TYPE_NONE                         = 0
+FILTER_TYPE_LOW_PASS                     = 1
+FILTER_TYPE_NOTCH                        = 2
+FILTER_TYPE_LEAD_LAG                     = 3
 
 # ODrive.Motor.MotorType
 MOTOR_TYPE_HIGH_CURRENT                  = 0
 MOTOR_TYPE_GIMBAL                        = 2
 MOTOR_TYPE_ACIM                          = 3
 
+# ODrive.Motor.DeadlineMissPolicy
+DEADLINE_MISS_POLICY_IGNORE              = 0
+DEADLINE_MISS_POLICY_WARN                = 1
+DEADLINE_MISS_POLICY_DISARM              = 2
+
+# ODrive.Motor.CurrentControllerType
+CURRENT_CONTROLLER_TYPE_PI               = 0
+CURRENT_CONTROLLER_TYPE_DEADBEAT         = 1
+
+# ODrive.Motor.ModulationMode
+MODULATION_MODE_LINEAR                   = 0
+MODULATION_MODE_HEXAGON                  = 1
+MODULATION_MODE_SIX_STEP                 = 2
+
 # ODrive.Error
 ODRIVE_ERROR_NONE                        = 0x00000000
 ODRIVE_ERROR_CONTROL_ITERATION_MISSED    = 0x00000001
@@ -91,6 +202,7 @@ AXIS_ERROR_MAX_ENDSTOP_PRESSED           = 0x00002000
 AXIS_ERROR_ESTOP_REQUESTED               = 0x00004000
 AXIS_ERROR_HOMING_WITHOUT_ENDSTOP        = 0x00020000
 AXIS_ERROR_OVER_TEMP                     = 0x00040000
+AXIS_ERROR_HOMING_FAILED                 = 0x00080000
 
 # ODrive.Motor.Error
 MOTOR_ERROR_NONE                         = 0x00000000
@@ -146,3 +258,5 @@ ENCODER_ERROR_ABS_SPI_NOT_READY          = 0x00000100
 SENSORLESS_ESTIMATOR_ERROR_NONE          = 0x00000000
 SENSORLESS_ESTIMATOR_ERROR_UNSTABLE_GAIN = 0x00000001
 SENSORLESS_ESTIMATOR_ERROR_UNKNOWN_CURRENT_MEASUREMENT = 0x00000002
+SENSORLESS_ESTIMATOR_ERROR_HFI_NO_SALIENCY = 0x00000004
+SENSORLESS_ESTIMATOR_ERROR_HANDOFF_TIMEOUT = 0x00000008
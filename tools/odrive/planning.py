@@ -0,0 +1,174 @@
+"""
+Trajectory planning with the planners of the firmware.
+
+This wraps the host build of TrapezoidalTrajectory and SCurveTrajectory
+(Firmware/Simulation/planning_lib.h), so planned moves, previews and
+cycle time estimates match what the ODrive does. Build the library with
+
+    cd Firmware && echo CONFIG_PLANNING_LIB=true >> tup.config && tup
+
+or point the environment variable ODRIVE_PLANNING_LIB to it.
+
+All functions take and return plain sequences of floats. Batches are passed
+to the library in one call, which is much faster than planning move by move.
+"""
+
+import array
+import ctypes
+import ctypes.util
+import os
+import sys
+
+PLANNING_LIB_VERSION = 1
+TRAP_MOVE_SIZE = 6
+SCURVE_MOVE_SIZE = 7
+
+class TrapPlan(ctypes.Structure):
+    """
+    State of TrapezoidalTrajectory after planning. Tf is the duration of the
+    move in seconds.
+    """
+    _fields_ = [(name, ctypes.c_float) for name in
+                ('Xi', 'Xf', 'Vi', 'Ar', 'Vr', 'Dr', 'Ta', 'Tv', 'Td', 'Tf', 'yAccel')]
+
+    def eval(self, times):
+        return eval_trap(self, times)
+
+_lib = None
+
+def _lib_names():
+    if sys.platform == 'win32':
+        return ['odrive_planning.dll']
+    elif sys.platform == 'darwin':
+        return ['libodrive_planning.dylib', 'libodrive_planning.so']
+    else:
+        return ['libodrive_planning.so']
+
+def _find_lib():
+    if os.environ.get('ODRIVE_PLANNING_LIB'):
+        return os.environ['ODRIVE_PLANNING_LIB']
+    firmware_dir = os.path.join(os.path.dirname(os.path.dirname(os.path.dirname(
+                        os.path.realpath(__file__)))), 'Firmware', 'Simulation', 'bin')
+    for name in _lib_names():
+        path = os.path.join(firmware_dir, name)
+        if os.path.isfile(path):
+            return path
+    path = ctypes.util.find_library('odrive_planning')
+    if path is None:
+        raise ImportError("the planning library wasn't found. Build it with "
+                          "CONFIG_PLANNING_LIB=true (see Firmware/Tupfile.lua) "
+                          "or set ODRIVE_PLANNING_LIB.")
+    return path
+
+def _get_lib():
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    lib = ctypes.CDLL(_find_lib())
+    if lib.odrive_planning_version() != PLANNING_LIB_VERSION:
+        raise ImportError("the planning library has version {}, expected {}".format(
+                          lib.odrive_planning_version(), PLANNING_LIB_VERSION))
+
+    c_float_p = ctypes.POINTER(ctypes.c_float)
+    lib.odrive_plan_trap.argtypes = [ctypes.c_float] * 6 + [ctypes.POINTER(TrapPlan)]
+    lib.odrive_plan_trap.restype = ctypes.c_int
+    lib.odrive_eval_trap.argtypes = [ctypes.POINTER(TrapPlan), c_float_p, ctypes.c_size_t,
+                                     c_float_p, c_float_p, c_float_p]
+    lib.odrive_eval_trap.restype = None
+    lib.odrive_plan_trap_batch.argtypes = [c_float_p, ctypes.c_size_t, c_float_p]
+    lib.odrive_plan_trap_batch.restype = ctypes.c_size_t
+    lib.odrive_eval_scurve.argtypes = [ctypes.c_float] * 7 + [c_float_p, ctypes.c_size_t,
+                                      c_float_p, c_float_p, c_float_p, c_float_p]
+    lib.odrive_eval_scurve.restype = ctypes.c_int
+    lib.odrive_plan_scurve_batch.argtypes = [c_float_p, ctypes.c_size_t, c_float_p]
+    lib.odrive_plan_scurve_batch.restype = ctypes.c_size_t
+    _lib = lib
+    return lib
+
+def _floats(values):
+    buf = array.array('f', values)
+    ptr = ctypes.cast(buf.buffer_info()[0], ctypes.POINTER(ctypes.c_float)) if len(buf) else None
+    return buf, ptr
+
+def _flatten(moves, size):
+    flat = array.array('f')
+    for move in moves:
+        if len(move) != size:
+            raise ValueError("a move needs {} values, got {}".format(size, len(move)))
+        flat.extend(move)
+    return flat
+
+def plan_trap(Xf, Xi, Vi, vel_limit, accel_limit, decel_limit):
+    """
+    Plans a move like INPUT_MODE_TRAP_TRAJ does. Raises a ValueError if the
+    planner rejects the move.
+    """
+    plan = TrapPlan()
+    if not _get_lib().odrive_plan_trap(Xf, Xi, Vi, vel_limit, accel_limit, decel_limit, ctypes.byref(plan)):
+        raise ValueError("the move can't be planned with these limits")
+    return plan
+
+def eval_trap(plan, times):
+    """
+    Evaluates a plan of plan_trap() at the given times [s] since the start of
+    the move. Returns the position, velocity and acceleration arrays.
+    """
+    t, t_ptr = _floats(times)
+    outputs = [_floats([0.0] * len(t)) for _ in range(3)]
+    _get_lib().odrive_eval_trap(ctypes.byref(plan), t_ptr, len(t), *[ptr for _, ptr in outputs])
+    return tuple(buf for buf, _ in outputs)
+
+def eval_scurve(Xf, Xi, Vi, vel_limit, accel_limit, decel_limit, jerk_limit, times):
+    """
+    Plans a move like INPUT_MODE_SCURVE_TRAJ does and evaluates it at the given
+    times [s]. Returns the duration and the position, velocity and acceleration
+    arrays.
+    """
+    t, t_ptr = _floats(times)
+    outputs = [_floats([0.0] * len(t)) for _ in range(3)]
+    Tf = ctypes.c_float()
+    if not _get_lib().odrive_eval_scurve(Xf, Xi, Vi, vel_limit, accel_limit, decel_limit, jerk_limit,
+                                         t_ptr, len(t), *[ptr for _, ptr in outputs], ctypes.byref(Tf)):
+        raise ValueError("the move can't be planned with these limits")
+    return (Tf.value,) + tuple(buf for buf, _ in outputs)
+
+def trap_durations(moves):
+    """
+    Returns the durations [s] of a batch of trapezoidal moves. Each move is
+    (Xf, Xi, Vi, vel_limit, accel_limit, decel_limit). Rejected moves have a
+    duration of NaN.
+    """
+    flat, flat_ptr = _floats(_flatten(moves, TRAP_MOVE_SIZE))
+    n = len(flat) // TRAP_MOVE_SIZE
+    durations, durations_ptr = _floats([0.0] * n)
+    if n:
+        _get_lib().odrive_plan_trap_batch(flat_ptr, n, durations_ptr)
+    return durations
+
+def scurve_durations(moves):
+    """
+    Like trap_durations() for S-curve moves, which are
+    (Xf, Xi, Vi, vel_limit, accel_limit, decel_limit, jerk_limit).
+    """
+    flat, flat_ptr = _floats(_flatten(moves, SCURVE_MOVE_SIZE))
+    n = len(flat) // SCURVE_MOVE_SIZE
+    durations, durations_ptr = _floats([0.0] * n)
+    if n:
+        _get_lib().odrive_plan_scurve_batch(flat_ptr, n, durations_ptr)
+    return durations
+
+def cycle_time(targets, start, vel_limit, accel_limit, decel_limit, jerk_limit=None, dwell=0.0):
+    """
+    Estimates the time [s] to go through the positions in targets one after the
+    other, each move from standstill, with dwell seconds at each target. Uses
+    the S-curve planner if jerk_limit is given.
+    """
+    positions = [start] + list(targets)
+    if jerk_limit is None:
+        durations = trap_durations([(positions[i + 1], positions[i], 0.0, vel_limit, accel_limit, decel_limit)
+                                    for i in range(len(positions) - 1)])
+    else:
+        durations = scurve_durations([(positions[i + 1], positions[i], 0.0, vel_limit, accel_limit, decel_limit, jerk_limit)
+                                      for i in range(len(positions) - 1)])
+    return sum(durations) + dwell * len(durations)
@@ -83,13 +83,21 @@ def launch_shell(args, logger, app_shutdown_token):
 
     interactive_variables = {
         'start_liveplotter': start_liveplotter,
+        'start_telemetry_liveplotter': start_telemetry_liveplotter,
         'dump_errors': dump_errors,
+        'dump_event_log': dump_event_log,
+        'dump_protocol_stats': dump_protocol_stats,
+        'dump_arena': dump_arena,
+        'oscilloscope_read': oscilloscope_read,
+        'oscilloscope_read_array': oscilloscope_read_array,
         'oscilloscope_dump': oscilloscope_dump,
+        'show_oscilloscope': show_oscilloscope,
         'dump_interrupts': dump_interrupts,
         'dump_threads': dump_threads,
         'dump_dma': dump_dma,
         'dump_timing': dump_timing,
         'BulkCapture': BulkCapture,
+        'TelemetryReader': TelemetryReader,
         'step_and_plot': step_and_plot,
         'calculate_thermistor_coeffs': calculate_thermistor_coeffs,
         'set_motor_thermistor_coeffs': set_motor_thermistor_coeffs
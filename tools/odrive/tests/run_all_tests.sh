@@ -11,6 +11,7 @@ declare -a tests=('analog_input_test.py'
                   'nvm_test.py'
                   'pwm_input_test.py'
                   'step_dir_test.py'
+                  'timing_test.py'
                   'uart_ascii_test.py'
                   )
 summary=""
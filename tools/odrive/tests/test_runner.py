@@ -243,10 +243,10 @@ class ODriveComponent(Component):
         #for axis_idx, axis_ctx in enumerate(self.axes):
         #    axis_ctx.handle = self.handle.__dict__['axis{}'.format(axis_idx)]
         for encoder_idx, encoder_ctx in enumerate(self.encoders):
-            encoder_ctx.handle = self.handle.__dict__['axis{}'.format(encoder_idx)].encoder
+            encoder_ctx.handle = self.handle._remote_attributes['axis{}'.format(encoder_idx)].encoder
         # TODO: distinguish between axis and motor context
         for axis_idx, axis_ctx in enumerate(self.axes):
-            axis_ctx.handle = self.handle.__dict__['axis{}'.format(axis_idx)]
+            axis_ctx.handle = self.handle._remote_attributes['axis{}'.format(axis_idx)]
 
     def disable_mappings(self):
         self.handle.config.gpio1_pwm_mapping.endpoint = None # here
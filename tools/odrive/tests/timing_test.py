@@ -0,0 +1,166 @@
+
+import test_runner
+
+import time
+import re
+
+from fibre.utils import Logger
+from test_runner import *
+from odrive.enums import *
+from closed_loop_test import TestClosedLoopControlBase
+
+
+# HCLK of the ODrive v3 (STM32F405 at 168MHz). All TaskTimer values are in
+# HCLK ticks.
+HCLK_HZ = 168e6
+
+# Share of the control period that the control loop interrupt may take on
+# the boards that don't specify `control-loop-budget` in the test rig yaml.
+# The interrupt busy-waits for the second ADC conversion (dc_calib_wait) so
+# a good part of the budget goes to waiting.
+DEFAULT_BUDGET_SHARE = 0.8
+
+def get_task_timers(odrv):
+    """
+    Returns (name, TaskTimer) for all task timers of the ODrive and its axes.
+    """
+    timers = [('task_times.' + k, getattr(odrv.task_times, k)) for k in dir(odrv.task_times) if not k.startswith('_')]
+    for axis_name in dir(odrv):
+        if re.match(r'axis[0-9]+$', axis_name):
+            task_times = getattr(odrv, axis_name).task_times
+            timers += [(axis_name + '.task_times.' + k, getattr(task_times, k)) for k in dir(task_times) if not k.startswith('_')]
+    return timers
+
+def get_histogram(timer):
+    return [timer.get_histogram(i) for i in range(16)]
+
+class TestControlLoopTiming(TestClosedLoopControlBase):
+    """
+    Runs closed loop scenarios with the oscilloscope, telemetry and tracing
+    active and checks that the control loop interrupt stays within the
+    budget of the board and never misses a deadline.
+
+    The worst case is taken from `task_times.control_loop.max_length`. The
+    histograms are logged if the firmware was built with
+    CONFIG_DWT_TASK_TIMERS=true.
+    """
+
+    def enable_diagnostics(self, axis_ctx: ODriveAxisComponent):
+        odrv = axis_ctx.parent.handle
+        axis = axis_ctx.handle
+
+        channels = [
+            axis.encoder._remote_attributes['pos_estimate'],
+            axis.encoder._remote_attributes['vel_estimate'],
+            axis.motor.current_control._remote_attributes['Iq_measured'],
+            axis.motor.current_control._remote_attributes['Id_measured'],
+            axis.controller._remote_attributes['pos_setpoint'],
+            axis.controller._remote_attributes['vel_setpoint'],
+            axis.controller._remote_attributes['torque_setpoint'],
+            odrv._remote_attributes['ibus'],
+        ]
+
+        odrv.oscilloscope.config.num_channels = 4
+        for i in range(4):
+            setattr(odrv.oscilloscope.config, 'channel' + str(i), channels[i])
+        odrv.oscilloscope.config.decimation = 1
+        odrv.oscilloscope.config.trigger_mode = TRIGGER_MODE_SOFTWARE
+        odrv.oscilloscope.config.trigger_on_error = True
+        odrv.oscilloscope.arm()
+
+        # Nobody reads the frames here. The ODrive drops what doesn't fit,
+        # which costs more than sending.
+        odrv.telemetry.config.num_channels = 8
+        for i in range(8):
+            setattr(odrv.telemetry.config, 'channel' + str(i), channels[i])
+        odrv.telemetry.config.decimation = 1
+        odrv.telemetry.config.encoding = ENCODING_RAW
+        odrv.telemetry.config.enabled = True
+
+        odrv.trace.enabled = True # no-op unless built with CONFIG_TRACE=true
+
+    def disable_diagnostics(self, axis_ctx: ODriveAxisComponent):
+        odrv = axis_ctx.parent.handle
+        odrv.telemetry.config.enabled = False
+        odrv.trace.enabled = False
+
+    def run_test(self, axis_ctx: ODriveAxisComponent, motor_ctx: MotorComponent, enc_ctx: EncoderComponent, logger: Logger):
+        with self.prepare(axis_ctx, motor_ctx, enc_ctx, logger):
+            odrv = axis_ctx.parent.handle
+            axis = axis_ctx.handle
+
+            control_period = 3.0 / odrv.config.pwm_frequency # [s]
+            budget = float(axis_ctx.parent.yaml.get('control-loop-budget', DEFAULT_BUDGET_SHARE * control_period * 1e6)) # [us]
+            logger.debug(f'control loop budget is {budget:.1f}us of a {control_period * 1e6:.1f}us period')
+
+            self.enable_diagnostics(axis_ctx)
+            axis.controller.config.vel_limit = 10.0
+            axis.trap_traj.config.vel_limit = 5.0
+            axis.trap_traj.config.accel_limit = 20.0
+            axis.trap_traj.config.decel_limit = 20.0
+
+            timers = get_task_timers(odrv)
+            for name, timer in timers:
+                timer.reset()
+            deadline_misses = [a.handle.motor.deadline_miss_count for a in axis_ctx.parent.axes]
+
+            logger.debug('velocity control...')
+            axis.controller.config.control_mode = CONTROL_MODE_VELOCITY_CONTROL
+            axis.controller.config.input_mode = INPUT_MODE_VEL_RAMP
+            axis.controller.config.vel_ramp_rate = 20.0
+            axis.controller.input_vel = 0
+            request_state(axis_ctx, AXIS_STATE_CLOSED_LOOP_CONTROL)
+            for vel in [5.0, -5.0, 0.0]:
+                axis.controller.input_vel = vel
+                time.sleep(1.0)
+            test_assert_no_error(axis_ctx)
+            request_state(axis_ctx, AXIS_STATE_IDLE)
+
+            logger.debug('position control with trapezoidal trajectories...')
+            axis.controller.config.control_mode = CONTROL_MODE_POSITION_CONTROL
+            axis.controller.config.input_mode = INPUT_MODE_TRAP_TRAJ
+            axis.encoder.set_linear_count(0)
+            axis.controller.input_pos = 0
+            request_state(axis_ctx, AXIS_STATE_CLOSED_LOOP_CONTROL)
+            for pos in [3.0, -3.0, 0.0]:
+                axis.controller.input_pos = pos
+                time.sleep(1.5)
+            test_assert_no_error(axis_ctx)
+            request_state(axis_ctx, AXIS_STATE_IDLE)
+
+            logger.debug('torque control...')
+            axis.controller.config.control_mode = CONTROL_MODE_TORQUE_CONTROL
+            axis.controller.config.input_mode = INPUT_MODE_PASSTHROUGH
+            axis.controller.input_torque = 0
+            request_state(axis_ctx, AXIS_STATE_CLOSED_LOOP_CONTROL)
+            for torque in [0.05, -0.05, 0.0]:
+                axis.controller.input_torque = torque
+                time.sleep(0.5)
+            test_assert_no_error(axis_ctx)
+            request_state(axis_ctx, AXIS_STATE_IDLE)
+
+            self.disable_diagnostics(axis_ctx)
+
+            for name, timer in timers:
+                logger.debug(f'{name}: max {timer.max_length / HCLK_HZ * 1e6:.1f}us, mean {timer.mean / HCLK_HZ * 1e6:.1f}us, histogram {get_histogram(timer)}')
+
+            test_assert_eq(odrv.error & ODRIVE_ERROR_CONTROL_ITERATION_MISSED, 0)
+            for a, misses in zip(axis_ctx.parent.axes, deadline_misses):
+                test_assert_eq(a.handle.motor.deadline_miss_count, misses)
+
+            control_loop = odrv.task_times.control_loop
+            worst_case = control_loop.max_length / HCLK_HZ * 1e6 # [us]
+            logger.debug(f'worst case control loop time: {worst_case:.1f}us')
+            test_assert_within(worst_case, 0.0, budget)
+
+            if control_loop.count:
+                # Every iteration of the scenarios must have been measured
+                test_assert_within(control_loop.count, 9.0 / control_period, 2**32)
+            else:
+                logger.debug('built without CONFIG_DWT_TASK_TIMERS, no statistics available')
+
+
+if __name__ == '__main__':
+    test_runner.run([
+        TestControlLoopTiming(),
+    ])
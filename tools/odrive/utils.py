@@ -6,8 +6,10 @@ import threading
 import platform
 import subprocess
 import os
+import struct
 import numpy as np
 from fibre.utils import Event
+import fibre.remote_object
 import odrive.enums
 from odrive.enums import *
 
@@ -73,29 +75,22 @@ def dump_errors(odrv, clear=False, printfunc = print):
     axes = [(name, axis) for name, axis in odrv._remote_attributes.items() if 'axis' in name]
     axes.sort()
 
+    # All error properties are collected first and then read in as few
+    # requests as possible.
+    modules = []
     def dump_errors_for_module(indent, name, obj, path, errorcodes):
-        prefix = indent + name.strip('0123456789') + ": "
         for elem in path.split('.'):
-            if not hasattr(obj, elem):
-                printfunc(prefix + _VT100Colors['yellow'] + "not found" + _VT100Colors['default'])
+            if not elem in obj._remote_attributes:
+                modules.append((indent, name, None, errorcodes))
                 return
-            parent = obj
-            obj = getattr(obj, elem)
-        if obj != 0:
-            printfunc(indent + name + ": " + _VT100Colors['red'] + "Error(s):" + _VT100Colors['default'])
-            for bit in range(64):
-                if obj & (1 << bit) != 0:
-                    printfunc(indent + "  " + errorcodes.get((1 << bit), 'UNKNOWN ERROR: 0x{:08X}'.format(1 << bit)))
-            if clear:
-                setattr(parent, elem, 0)
-        else:
-            printfunc(indent + name + ": " + _VT100Colors['green'] + "no error" + _VT100Colors['default'])
+            obj = obj._remote_attributes[elem]
+        modules.append((indent, name, obj, errorcodes))
 
     system_error_codes = {v: k for k, v in odrive.enums.__dict__ .items() if k.startswith("ODRIVE_ERROR_")}
     dump_errors_for_module("", "system", odrv, 'error', system_error_codes)
 
     for name, axis in axes:
-        printfunc(name)
+        modules.append((None, name, None, None))
 
         # Flatten axis and submodules
         # (name, obj, path, errorcode)
@@ -110,10 +105,239 @@ def dump_errors(odrv, clear=False, printfunc = print):
         for name, obj, path, errorcodes in module_decode_map:
             dump_errors_for_module("  ", name, obj, path, errorcodes)
 
-def oscilloscope_dump(odrv, num_vals, filename='oscilloscope.csv'):
+    properties = [prop for _, _, prop, _ in modules if prop is not None]
+    values = dict(zip(properties, fibre.remote_object.read_properties(properties)))
+
+    for indent, name, prop, errorcodes in modules:
+        if indent is None:
+            printfunc(name)
+        elif prop is None:
+            printfunc(indent + name.strip('0123456789') + ": " + _VT100Colors['yellow'] + "not found" + _VT100Colors['default'])
+        elif values[prop] != 0:
+            printfunc(indent + name + ": " + _VT100Colors['red'] + "Error(s):" + _VT100Colors['default'])
+            for bit in range(64):
+                if values[prop] & (1 << bit) != 0:
+                    printfunc(indent + "  " + errorcodes.get((1 << bit), 'UNKNOWN ERROR: 0x{:08X}'.format(1 << bit)))
+        else:
+            printfunc(indent + name + ": " + _VT100Colors['green'] + "no error" + _VT100Colors['default'])
+
+    if clear:
+        failed = [prop for prop in properties if values[prop] != 0]
+        fibre.remote_object.write_properties(failed, [0] * len(failed))
+
+def read_errors(odrv, last_change_count=None):
+    """
+    Reads the error words of the ODrive, of CAN and of every axis, motor,
+    encoder, controller and sensorless estimator and the axis states, usually
+    in one request.
+
+    Returns (change_count, errors). change_count increments whenever the
+    errors or axis states differ from the ones the previous call (of any host)
+    got. If it equals last_change_count, errors is None and nothing is
+    decoded. Otherwise errors is a dict like
+    {'error': 0, 'can': 0, 'axis0': {'error': 0, 'motor': 0, ..., 'current_state': 1}, ...}.
+    """
+    num_axes = len([name for name in odrv._remote_attributes if name.startswith('axis')])
+    endpoint_id = odrv._remote_attributes['read_errors_raw']._trigger_id
+    size = 12 + 25 * num_axes
+    buffer = odrv.__channel__.remote_endpoint_operation(endpoint_id, struct.pack('<I', 0), True, size)
+    change_count, = struct.unpack('<I', buffer[:4])
+    if change_count == last_change_count:
+        return change_count, None
+    while len(buffer) < size:
+        # Only on channels with small packets (e.g. I2C). The rest is taken
+        # from a later snapshot.
+        chunk = odrv.__channel__.remote_endpoint_operation(endpoint_id, struct.pack('<I', len(buffer)), True, size - len(buffer))
+        if not chunk:
+            raise Exception("incomplete error snapshot")
+        buffer += chunk
+
+    system_error, can_error = struct.unpack('<II', buffer[4:12])
+    errors = {'error': system_error, 'can': can_error}
+    for i in range(num_axes):
+        motor, axis, encoder, controller, sensorless_estimator, current_state = struct.unpack('<QIIIIB', buffer[12 + 25 * i:37 + 25 * i])
+        errors['axis{}'.format(i)] = {
+            'error': axis, 'motor': motor, 'encoder': encoder, 'controller': controller,
+            'sensorless_estimator': sensorless_estimator, 'current_state': current_state
+        }
+    return change_count, errors
+
+def wait_operations(odrv, handles, timeout=None):
+    """
+    Waits until the operations that the `*_async` functions of the ODrive
+    returned are done. The ODrive pushes `operations.last_completed` when one
+    completes, so this doesn't poll. Operations on several ODrives run at the
+    same time, e.g. start a calibration on each of them and then wait for
+    each one in turn.
+    Returns a list of (succeeded, result) in the order of the handles.
+    """
+    operations = odrv.operations
+    completed = threading.Event()
+    last_completed = operations._remote_attributes['last_completed']
+    fibre.remote_object.subscribe_properties([last_completed], lambda prop, value: completed.set(), on_change=True)
+    try:
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            completed.clear()
+            states = [operations.get_state(handle) for handle in handles]
+            if not OPERATION_STATE_RUNNING in states:
+                break
+            remaining = None if deadline is None else deadline - time.monotonic()
+            if remaining is not None and remaining <= 0:
+                raise TimeoutError("operations still running: {}".format(
+                    [h for h, state in zip(handles, states) if state == OPERATION_STATE_RUNNING]))
+            completed.wait(remaining)
+    finally:
+        fibre.remote_object.unsubscribe_properties([last_completed])
+    return [(state == OPERATION_STATE_SUCCEEDED, operations.get_result(handle)) for handle, state in zip(handles, states)]
+
+def dump_event_log(odrv, printfunc=print):
+    """
+    Prints the errors in the event log of the ODrive in the order in which
+    they occurred, with the bus voltage, bus current, Iq and velocity at that
+    moment. Returns the entries as a list of dicts.
+    """
+    endpoint_id = odrv.event_log._remote_attributes['read_raw']._trigger_id
+    buffer = odrv.__channel__.remote_endpoint_read_buffer(endpoint_id)
+    loop_frequency = odrv.config.pwm_frequency / 3
+
+    error_codes = {
+        SOURCE_SYSTEM: ('system', "ODRIVE_ERROR_"),
+        SOURCE_MOTOR: ('motor', "MOTOR_ERROR_"),
+        SOURCE_ENCODER: ('encoder', "ENCODER_ERROR_"),
+        SOURCE_CONTROLLER: ('controller', "CONTROLLER_ERROR_"),
+    }
+
+    entries = []
+    for offset in range(0, len(buffer) // 32 * 32, 32):
+        error, loop_count, boot_count, source, axis, vbus_voltage, ibus, Iq_measured, vel_estimate = struct.unpack('<QIHBBffff', buffer[offset:offset + 32])
+        name, prefix = error_codes.get(source, ('unknown', None))
+        codes = {v: k for k, v in odrive.enums.__dict__.items() if prefix and k.startswith(prefix)}
+        errors = [codes.get(1 << bit, 'UNKNOWN ERROR: 0x{:08X}'.format(1 << bit)) for bit in range(64) if error & (1 << bit)]
+        entry = {
+            'boot_count': boot_count, 'time': loop_count / loop_frequency, 'source': name,
+            'axis': None if axis == 0xff else axis, 'errors': errors,
+            'vbus_voltage': vbus_voltage, 'ibus': ibus, 'Iq_measured': Iq_measured, 'vel_estimate': vel_estimate
+        }
+        entries.append(entry)
+        printfunc("boot {} {:10.4f}s {}{}: {}".format(boot_count, entry['time'],
+            '' if entry['axis'] is None else 'axis{}.'.format(axis), name,
+            _VT100Colors['red'] + ', '.join(errors) + _VT100Colors['default']))
+        printfunc("    vbus {:.2f}V, ibus {:.2f}A, Iq {:.2f}A, vel {:.3f}turn/s".format(vbus_voltage, ibus, Iq_measured, vel_estimate))
+    if not entries:
+        printfunc("the event log is empty")
+    return entries
+
+def _endpoint_paths(obj, prefix=''):
+    """
+    Returns a dict of endpoint ID to the dotted path of every property and
+    function of the object, including the arguments of the functions.
+    """
+    paths = {}
+    for name, attr in obj._remote_attributes.items():
+        if isinstance(attr, fibre.remote_object.RemoteProperty):
+            paths[attr._id] = prefix + name
+        elif isinstance(attr, fibre.remote_object.RemoteFunction):
+            paths[attr._trigger_id] = prefix + name + '()'
+            for arg in attr._inputs + attr._outputs:
+                paths[arg._id] = prefix + name + '.' + arg._name
+        elif isinstance(attr, fibre.remote_object.RemoteObject):
+            paths.update(_endpoint_paths(attr, prefix + name + '.'))
+    return paths
+
+def dump_protocol_stats(odrv, top=20, printfunc=print):
+    """
+    Prints the native protocol request rates of each channel and the most
+    accessed endpoints since the last `odrv.protocol_stats.reset()`.
+    The endpoint counters need firmware built with CONFIG_ENDPOINT_STATS=true.
+    Returns a list of (path, reads, writes) sorted by the number of accesses.
+    """
+    stats = odrv.protocol_stats
+    seconds = stats.time_since_reset / 1000
+    printfunc("{:.1f}s since the last reset".format(seconds))
+    for name, count, rate, unit in [
+            ('USB', stats.usb_requests, stats.usb_rate, 'requests'),
+            ('UART', stats.uart_requests, stats.uart_rate, 'requests'),
+            ('I2C', stats.i2c_requests, stats.i2c_rate, 'requests'),
+            ('CAN', stats.can_frames, stats.can_rate, 'frames')]:
+        printfunc("  {:4} {:10} {}, {:8.1f}/s now".format(name, count, unit, rate))
+
+    endpoint_id = stats._remote_attributes['read_raw']._trigger_id
+    buffer = odrv.__channel__.remote_endpoint_read_buffer(endpoint_id)
+    if not buffer:
+        printfunc("the endpoint counters are not compiled in (CONFIG_ENDPOINT_STATS)")
+        return []
+
+    paths = _endpoint_paths(odrv)
+    counts = [(paths.get(i, 'endpoint {}'.format(i)),) + struct.unpack('<HH', buffer[i * 4:i * 4 + 4])
+              for i in range(len(buffer) // 4)]
+    counts = sorted((c for c in counts if c[1] or c[2]), key=lambda c: c[1] + c[2], reverse=True)
+    printfunc("  {:50} {:>8} {:>8}".format('endpoint', 'reads', 'writes'))
+    for path, reads, writes in counts[:top]:
+        printfunc("  {:50} {:8} {:8}".format(path, reads, writes))
+    return counts
+
+def dump_arena(odrv, printfunc=print):
+    """
+    Prints how the arena is shared by the optional buffers, in the order in
+    which they were taken on startup. The configured sizes only take effect
+    after a reboot.
+    """
+    arena = odrv.arena
+    printfunc("{} of {} bytes used, {} buffers didn't fit".format(
+        arena.used, arena.size, arena.failed_allocations))
+    size = odrv.oscilloscope.size
+    buffers = [('oscilloscope', size, odrv.config.oscilloscope_size, 'samples', size * 4)]
+    for i, axis in enumerate([odrv.axis0, odrv.axis1]):
+        capacity = axis.controller.pvt_buffer_capacity
+        buffers.append(('axis{} PVT buffer'.format(i), capacity, axis.controller.config.pvt_buffer_size,
+                        'points', (capacity + 1) * 16 if capacity else 0)) # one slot stays empty
+    for name, allocated, configured, unit, nbytes in buffers:
+        printfunc("  {:18} {:6} of {:6} {:8} {:6} bytes".format(name, allocated, configured, unit, nbytes))
+
+def read_buffer_array(odrv, endpoint_id, dtype):
+    """
+    Reads a long endpoint and returns its content as a numpy array of dtype,
+    which is a view of the received data. A partial element at the end is
+    dropped.
+    """
+    dtype = np.dtype(dtype)
+    buffer = odrv.__channel__.remote_endpoint_read_buffer(endpoint_id)
+    if len(buffer) < dtype.itemsize:
+        return np.zeros(0, dtype=dtype)
+    return np.frombuffer(buffer, dtype=dtype, count=len(buffer) // dtype.itemsize)
+
+def oscilloscope_read_array(odrv):
+    """
+    Reads the samples of the last capture as a float32 array with one row per
+    sample and one column per channel. The samples are transferred as blocks
+    of raw floats, which takes one round trip per block instead of three per
+    sample with get_val().
+    """
+    num_channels = max(odrv.oscilloscope.config.num_channels, 1)
+    endpoint_id = odrv.oscilloscope._remote_attributes['read_raw']._trigger_id
+    values = read_buffer_array(odrv, endpoint_id, '<f4')
+    return values[:len(values) // num_channels * num_channels].reshape(-1, num_channels)
+
+def oscilloscope_read(odrv):
+    """
+    Reads the samples of the last capture as one array per channel, see
+    oscilloscope_read_array().
+    """
+    samples = oscilloscope_read_array(odrv)
+    return [samples[:, c] for c in range(odrv.oscilloscope.config.num_channels)]
+
+def oscilloscope_dump(odrv, num_vals=None, filename='oscilloscope.csv'):
+    """
+    Writes the samples of the last capture to a CSV file with one column per
+    channel. By default all samples in the buffer are written.
+    """
+    channels = oscilloscope_read(odrv)
+    if num_vals is not None:
+        channels = [channel[:num_vals] for channel in channels]
     with open(filename, 'w') as f:
-        for x in range(num_vals):
-            f.write(str(odrv.oscilloscope.get_val(x)))
+        for row in zip(*channels):
+            f.write(','.join(str(val) for val in row))
             f.write('\n')
 
 data_rate = 200
@@ -241,6 +465,370 @@ class BulkCapture:
         plt.legend(range(self.data.shape[1]-1))
         plt.show()
 
+TELEMETRY_FRAME_MARKER = 0x7454
+TELEMETRY_KEY_FRAME_MARKER = 0x744B
+TELEMETRY_DELTA_FRAME_MARKER = 0x7444
+
+def _get_varint(buffer, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = buffer[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not (byte & 0x80):
+            return value, pos
+
+def _unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+class TelemetryReader:
+    '''
+    Receives the telemetry frames that the ODrive streams on USB while
+    odrv.telemetry.config.enabled is True.
+
+    callback: called with (loop_count, values) for every frame. If None, the
+        frames are kept in a queue of up to maxlen frames that is drained by
+        read() or read_array(). Raw frames are queued as received and
+        decoded in bulk by read_array(), which keeps up with the full
+        control loop rate.
+
+    With ENCODING_DELTA the values are decoded with the scales that are
+    configured when the reader is created. Call update_scales() after
+    changing them.
+
+    Example Usage:
+        odrv0.telemetry.config.num_channels = 2
+        odrv0.telemetry.config.channel0 = odrv0.axis0.encoder._remote_attributes['pos_estimate']
+        odrv0.telemetry.config.channel1 = odrv0.axis0.motor.current_control._remote_attributes['Iq_measured']
+        reader = TelemetryReader(odrv0)
+        odrv0.telemetry.config.enabled = True
+        # ...
+        frames = reader.read()
+        loop_counts, values = reader.read_array() # or as numpy arrays
+        reader.close()
+    '''
+
+    def __init__(self, odrv, callback=None, maxlen=100000):
+        from collections import deque
+        self.lost_frames = 0
+        self._odrv = odrv
+        self._channel = odrv.__channel__
+        self._callback = callback
+        self._frames = deque(maxlen=maxlen)
+        self._counter = None
+        self._loop_count = None
+        self._quantized = None
+        self.update_scales()
+        self._channel.set_unsolicited_packet_handler(TELEMETRY_FRAME_MARKER, self._process_frame)
+        self._channel.set_unsolicited_packet_handler(TELEMETRY_KEY_FRAME_MARKER, self._process_key_frame)
+        self._channel.set_unsolicited_packet_handler(TELEMETRY_DELTA_FRAME_MARKER, self._process_delta_frame)
+
+    def update_scales(self):
+        config = self._odrv.telemetry.config
+        self._scales = [getattr(config, 'scale' + str(i)) for i in range(8)]
+        self._num_channels = config.num_channels
+
+    def _count(self, counter):
+        if self._counter is not None:
+            self.lost_frames += (counter - self._counter - 1) & 0xffff
+        self._counter = counter
+
+    def _output(self, loop_count, values):
+        if self._callback:
+            self._callback(loop_count, values)
+        else:
+            self._frames.append((loop_count, values))
+
+    def _process_frame(self, payload):
+        if len(payload) < 6:
+            return
+        if not self._callback:
+            # Decoded later, together with the other queued frames
+            self._frames.append(payload)
+            return
+        counter, loop_count = struct.unpack('<HI', payload[:6])
+        values = struct.unpack('<{}f'.format((len(payload) - 6) // 4), payload[6:6 + (len(payload) - 6) // 4 * 4])
+        self._count(counter)
+        self._output(loop_count, values)
+
+    def _decode_raw_frames(self, payloads):
+        """
+        Decodes raw frames of the same length at once. Returns the loop counts
+        and the values with one row per frame.
+        """
+        num_channels = (len(payloads[0]) - 6) // 4
+        self._num_channels = num_channels
+        dtype = np.dtype([('counter', '<u2'), ('loop_count', '<u4'), ('values', '<f4', (num_channels,))])
+        frames = np.frombuffer(b''.join(payloads), dtype=dtype)
+        counters = frames['counter'].astype(np.int64)
+        if self._counter is not None:
+            self.lost_frames += int((counters[0] - self._counter - 1) & 0xffff)
+        self.lost_frames += int(np.sum((np.diff(counters) - 1) & 0xffff))
+        self._counter = int(counters[-1])
+        return frames['loop_count'], frames['values']
+
+    def _drain(self):
+        """
+        Removes all queued frames and returns them as a list of runs, either
+        a list of raw payloads of the same length or a list of decoded frames.
+        """
+        runs = []
+        while self._frames:
+            frame = self._frames.popleft()
+            is_raw = not isinstance(frame, tuple)
+            if runs and runs[-1][0] == is_raw and (not is_raw or len(runs[-1][1][0]) == len(frame)):
+                runs[-1][1].append(frame)
+            else:
+                runs.append((is_raw, [frame]))
+        return runs
+
+    def _decode_values(self, payload, pos, reference):
+        quantized = []
+        while pos < len(payload):
+            value, pos = _get_varint(payload, pos)
+            quantized.append(_unzigzag(value) + (reference[len(quantized)] if reference else 0))
+        return quantized
+
+    def _process_key_frame(self, payload):
+        if len(payload) < 6:
+            return
+        counter, loop_count = struct.unpack('<HI', payload[:6])
+        self._quantized = self._decode_values(payload, 6, None)
+        self._loop_count = loop_count
+        self._count(counter)
+        self._output(loop_count, tuple(q * s for q, s in zip(self._quantized, self._scales)))
+
+    def _process_delta_frame(self, payload):
+        if len(payload) < 2 or self._quantized is None:
+            return
+        counter = struct.unpack('<H', payload[:2])[0]
+        if counter != (self._counter + 1) & 0xffff:
+            self._quantized = None # wait for the next key frame
+            return
+        loop_count_delta, pos = _get_varint(payload, 2)
+        self._quantized = self._decode_values(payload, pos, self._quantized)
+        self._loop_count = (self._loop_count + loop_count_delta) & 0xffffffff
+        self._count(counter)
+        self._output(self._loop_count, tuple(q * s for q, s in zip(self._quantized, self._scales)))
+
+    def read(self):
+        """Returns and removes all frames received so far as (loop_count, values) tuples."""
+        frames = []
+        for is_raw, run in self._drain():
+            if is_raw:
+                loop_counts, values = self._decode_raw_frames(run)
+                frames += zip(loop_counts.tolist(), map(tuple, values.tolist()))
+            else:
+                frames += run
+        return frames
+
+    def read_array(self):
+        """
+        Returns and removes all frames received so far as a uint32 array of
+        loop counts and a float32 array with one row per frame and one column
+        per channel. The channel count must not change between two calls.
+        """
+        loop_counts = []
+        values = []
+        for is_raw, run in self._drain():
+            if is_raw:
+                l, v = self._decode_raw_frames(run)
+            else:
+                l = np.array([loop_count for loop_count, _ in run], dtype=np.uint32)
+                v = np.array([frame_values for _, frame_values in run], dtype=np.float32)
+            loop_counts.append(l)
+            values.append(v)
+        if not loop_counts:
+            return np.zeros(0, dtype=np.uint32), np.zeros((0, self._num_channels), dtype=np.float32)
+        elif len(loop_counts) == 1:
+            return loop_counts[0], values[0] # views of the received frames
+        return np.concatenate(loop_counts), np.concatenate(values)
+
+    def close(self):
+        for marker in [TELEMETRY_FRAME_MARKER, TELEMETRY_KEY_FRAME_MARKER, TELEMETRY_DELTA_FRAME_MARKER]:
+            self._channel.set_unsolicited_packet_handler(marker, None)
+
+def control_loop_frequency(odrv):
+    """Returns the rate [Hz] of the control loop, of which the telemetry and oscilloscope decimation are fractions."""
+    return odrv.config.pwm_frequency / 3.0
+
+def configure_telemetry(odrv, properties, decimation=1, encoding=ENCODING_RAW):
+    """
+    Selects up to eight properties for telemetry streaming, given as dotted
+    paths (e.g. 'axis0.encoder.pos_estimate') or RemoteProperty objects.
+    Streaming is stopped, set odrv.telemetry.config.enabled to start it.
+    """
+    from fibre.benchmark import find_property
+    if not 1 <= len(properties) <= 8:
+        raise Exception("telemetry streams 1 to 8 properties")
+    config = odrv.telemetry.config
+    config.enabled = False
+    config.num_channels = len(properties)
+    for i, prop in enumerate(properties):
+        setattr(config, 'channel' + str(i), prop if isinstance(prop, fibre.remote_object.RemoteProperty) else find_property(odrv, prop))
+    config.decimation = decimation
+    config.encoding = encoding
+
+class DecimatingRingBuffer:
+    '''
+    Keeps the last `capacity` samples of a number of channels at full rate.
+    get() returns the most recent part reduced to a min/max envelope of at
+    most max_points points, so that drawing costs the same at any sample rate
+    and short spikes stay visible. append() and get() may be called from
+    different threads.
+    '''
+
+    def __init__(self, num_channels, capacity):
+        self.num_channels = num_channels
+        self._capacity = capacity
+        self._t = np.zeros(capacity)
+        self._values = np.zeros((capacity, num_channels), dtype=np.float32)
+        self._count = 0 # samples appended in total
+        self._lock = threading.Lock()
+
+    def append(self, t, values):
+        with self._lock:
+            i = self._count % self._capacity
+            self._t[i] = t
+            self._values[i] = values
+            self._count += 1
+
+    def get(self, duration, max_points):
+        """
+        Returns (t, values) of the samples of the last duration seconds, with
+        the shapes (n,) and (n, num_channels) and n <= max_points.
+        """
+        with self._lock:
+            n = min(self._count, self._capacity)
+            if not n:
+                return np.zeros(0), np.zeros((0, self.num_channels), dtype=np.float32)
+            indices = np.arange(self._count - n, self._count) % self._capacity
+            t = self._t[indices]
+            values = self._values[indices]
+        first = np.searchsorted(t, t[-1] - duration)
+        t, values = t[first:], values[first:]
+
+        # Reduce each bucket of samples to its first sample time with the
+        # minimum and its last sample time with the maximum
+        bucket = -(-len(t) // max(max_points // 2, 1))
+        if bucket > 1:
+            n_buckets = len(t) // bucket
+            start = len(t) - n_buckets * bucket # drop the oldest partial bucket
+            t = t[start:].reshape(n_buckets, bucket)
+            values = values[start:].reshape(n_buckets, bucket, self.num_channels)
+            t = np.stack([t[:, 0], t[:, -1]], axis=1).reshape(-1)
+            values = np.stack([values.min(axis=1), values.max(axis=1)], axis=1).reshape(-1, self.num_channels)
+        return t, values
+
+def start_telemetry_liveplotter(odrv, properties, decimation=1, duration=2.0, plot_rate=30.0, max_points=2000, backend=None):
+    """
+    Plots up to eight properties in real time from the telemetry stream,
+    at up to the full control loop rate. Only the last duration seconds are
+    drawn, reduced to max_points per channel (see DecimatingRingBuffer).
+    properties: dotted paths such as 'axis0.encoder.pos_estimate'
+    backend: 'pyqtgraph' or 'matplotlib'. By default pyqtgraph is used if it
+        is installed. It needs a running Qt event loop (`%gui qt` in IPython,
+        or odrivetool liveplotter). The matplotlib plot runs on its own thread
+        and redraws only the lines (blitting) unless the y axis rescales.
+
+    Returns a cancellation token. The plot stops and the streaming is
+    disabled when the window is closed or the token is set.
+    """
+    if backend is None:
+        try:
+            import pyqtgraph
+            backend = 'pyqtgraph'
+        except ImportError:
+            backend = 'matplotlib'
+
+    names = [p if isinstance(p, str) else p._name for p in properties]
+    sample_rate = control_loop_frequency(odrv) / decimation
+    ring = DecimatingRingBuffer(len(properties), int(duration * sample_rate * 1.2) + 1)
+    configure_telemetry(odrv, properties, decimation)
+    period = 1.0 / control_loop_frequency(odrv) # [s]
+    first_loop_count = []
+    def on_frame(loop_count, values):
+        if not first_loop_count:
+            first_loop_count.append(loop_count)
+        ring.append(((loop_count - first_loop_count[0]) & 0xffffffff) * period, values)
+    reader = TelemetryReader(odrv, callback=on_frame)
+
+    cancellation_token = Event()
+    stopped = []
+    def stop():
+        cancellation_token.set()
+        if stopped:
+            return
+        stopped.append(True)
+        try:
+            odrv.telemetry.config.enabled = False
+        finally:
+            reader.close()
+    odrv.telemetry.config.enabled = True
+
+    if backend == 'pyqtgraph':
+        import pyqtgraph as pg
+        app = pg.mkQApp()
+        win = pg.GraphicsLayoutWidget(title="ODrive telemetry")
+        plot = win.addPlot()
+        plot.addLegend()
+        plot.setXRange(-duration, 0)
+        plot.setClipToView(True)
+        curves = [plot.plot(pen=pg.intColor(i, len(names)), name=name) for i, name in enumerate(names)]
+        def update():
+            if cancellation_token.is_set() or not win.isVisible():
+                timer.stop()
+                stop()
+                return
+            t, values = ring.get(duration, max_points)
+            for i, curve in enumerate(curves):
+                curve.setData(t - t[-1] if len(t) else t, values[:, i])
+        timer = pg.QtCore.QTimer()
+        timer.timeout.connect(update)
+        timer.start(int(1000 / plot_rate))
+        app.aboutToQuit.connect(stop)
+        win.show()
+        win._timer = timer # keep a reference
+        return cancellation_token
+
+    import matplotlib.pyplot as plt
+    def plot_data():
+        plt.ion()
+        fig = plt.figure()
+        fig.canvas.mpl_connect('close_event', lambda evt: cancellation_token.set())
+        ax = fig.add_subplot(111)
+        lines = [ax.plot([], [], label=name, animated=True)[0] for name in names]
+        ax.set_xlim(-duration, 0)
+        ax.legend(loc='upper left')
+        background = None
+        try:
+            while not cancellation_token.is_set():
+                t, values = ring.get(duration, max_points)
+                if len(t):
+                    for i, line in enumerate(lines):
+                        line.set_data(t - t[-1], values[:, i])
+                    low, high = ax.get_ylim()
+                    if background is None or values.min() < low or values.max() > high:
+                        # Rescale and redraw everything, only the lines otherwise
+                        margin = 0.1 * (values.max() - values.min()) or 1.0
+                        ax.set_ylim(values.min() - margin, values.max() + margin)
+                        fig.canvas.draw()
+                        background = fig.canvas.copy_from_bbox(ax.bbox)
+                    fig.canvas.restore_region(background)
+                    for line in lines:
+                        ax.draw_artist(line)
+                    fig.canvas.blit(ax.bbox)
+                fig.canvas.start_event_loop(1 / plot_rate)
+        finally:
+            stop()
+
+    plot_t = threading.Thread(target=plot_data)
+    plot_t.daemon = True
+    plot_t.start()
+    return cancellation_token
+
 
 def step_and_plot(  axis,
                     step_size=100.0,
@@ -283,6 +871,53 @@ def step_and_plot(  axis,
     capture.plot()
 
 
+def measure_frequency_response(axis, plot=True):
+    """
+    Runs AXIS_STATE_FREQUENCY_RESPONSE with the settings in
+    axis.frequency_response.config and returns the arrays
+    (freq [Hz], gain, phase [rad]). Optionally shows a Bode plot.
+    """
+    axis.requested_state = AXIS_STATE_FREQUENCY_RESPONSE
+    time.sleep(0.1)
+    while axis.current_state == AXIS_STATE_FREQUENCY_RESPONSE:
+        time.sleep(0.1)
+
+    fr = axis.frequency_response
+    n = fr.num_results
+    freq = np.array([fr.get_freq(i) for i in range(n)])
+    gain = np.array([fr.get_gain(i) for i in range(n)])
+    phase = np.array([fr.get_phase(i) for i in range(n)])
+
+    if plot:
+        import matplotlib.pyplot as plt
+        fig, (ax_gain, ax_phase) = plt.subplots(2, 1, sharex=True)
+        ax_gain.semilogx(freq, 20 * np.log10(gain))
+        ax_gain.set_ylabel("gain [dB]")
+        ax_phase.semilogx(freq, np.degrees(np.unwrap(phase)))
+        ax_phase.set_ylabel("phase [deg]")
+        ax_phase.set_xlabel("frequency [Hz]")
+        plt.show()
+
+    return freq, gain, phase
+
+def autotune(axis, bandwidth, phase_margin=50.0):
+    """
+    Measures the response of the mechanics with a torque excitation and
+    tunes the controller for the given velocity loop bandwidth [Hz] and
+    phase margin [deg]. The axis must be in a state where closed loop
+    control with the current gains is stable.
+    """
+    axis.frequency_response.config.target = EXCITATION_TARGET_TORQUE
+    measure_frequency_response(axis, plot=False)
+    if not axis.controller.autotune(bandwidth, phase_margin):
+        print("Autotune failed. Try a lower bandwidth or phase margin or check the frequency response.")
+        return False
+    c = axis.controller.config
+    print("pos_gain = {:.4g}, vel_gain = {:.4g}, vel_integrator_gain = {:.4g}, inertia = {:.4g}".format(
+        c.pos_gain, c.vel_gain, c.vel_integrator_gain, c.inertia))
+    return True
+
+
 def print_drv_regs(name, motor):
     """
     Dumps the current gate driver regisers for the specified motor
@@ -300,13 +935,9 @@ def print_drv_regs(name, motor):
     print("Control Reg 2: " + str(ctrl_reg_2) + " (" + format(ctrl_reg_2, '#09b') + ")")
 
 def show_oscilloscope(odrv):
-    size = 18000
-    values = []
-    for i in range(size):
-        values.append(odrv.oscilloscope.get_val(i))
-
     import matplotlib.pyplot as plt
-    plt.plot(values)
+    for channel in oscilloscope_read(odrv):
+        plt.plot(channel)
     plt.show()
 
 def rate_test(device):
@@ -331,6 +962,15 @@ def rate_test(device):
     # plt.plot(vals)
     # plt.show(block=True)
 
+def benchmark_channel(odrv, prop='vbus_voltage', n=1000, bulk_duration=2.0, printfunc=print):
+    """
+    Measures the latency and the throughput of the connection to the ODrive
+    (USB, USB CDC, UART or TCP, depending on how it was found). See
+    fibre.benchmark.run_benchmark() for the results.
+    """
+    import fibre.benchmark
+    return fibre.benchmark.run_benchmark(odrv, prop, n, bulk_duration, printfunc)
+
 def usb_burn_in_test(get_var_callback, cancellation_token):
     """
     Starts background threads that read a values form the USB device in a spin-loop
@@ -475,36 +1115,60 @@ def dump_interrupts(odrv):
         (103, "SDMMC2_IRQn")
     ]
 
-    print("|   # | Name                    | Prio | En |   Count |")
-    print("|-----|-------------------------|------|----|---------|")
+    # Firmware built with CONFIG_IRQ_CYCLES also reports the cycles of each
+    # interrupt. They are sampled twice to show the CPU load of each one.
+    has_cycles = hasattr(odrv, 'get_interrupt_cycles') and any(
+        odrv.get_interrupt_cycles(irqn) for irqn, irq_name in interrupts)
+    if has_cycles:
+        cycles_before = {irqn: odrv.get_interrupt_cycles(irqn) for irqn, irq_name in interrupts}
+        time_before = time.monotonic()
+        time.sleep(1.0)
+        cycles_after = {irqn: odrv.get_interrupt_cycles(irqn) for irqn, irq_name in interrupts}
+        elapsed = time.monotonic() - time_before
+        cpu_freq = 168e6
+        print("|   # | Name                    | Prio | En |   Count |     Cycles |    Max | CPU [%] |")
+        print("|-----|-------------------------|------|----|---------|------------|--------|---------|")
+    else:
+        print("|   # | Name                    | Prio | En |   Count |")
+        print("|-----|-------------------------|------|----|---------|")
     for irqn, irq_name in interrupts:
         status = odrv.get_interrupt_status(irqn)
         if (status != 0):
-            print("| {} | {} | {} | {} | {} |".format(
+            line = "| {} | {} | {} | {} | {} |".format(
                     str(irqn).rjust(3),
                     irq_name.ljust(23),
                     str(status & 0xff).rjust(4),
                     " *" if (status & 0x80000000) else "  ",
-                    str((status >> 8) & 0x7fffff).rjust(7)))
+                    str((status >> 8) & 0x7fffff).rjust(7))
+            if has_cycles:
+                delta = (cycles_after[irqn] - cycles_before[irqn]) & 0xffffffff
+                line += " {} | {} | {} |".format(
+                    str(cycles_after[irqn]).rjust(10),
+                    str(odrv.get_interrupt_max_cycles(irqn)).rjust(6),
+                    "{:.2f}".format(100.0 * delta / (cpu_freq * elapsed)).rjust(7))
+            print(line)
 
 def dump_threads(odrv):
-    prefixes = ["max_stack_usage_", "stack_size_", "prio_"]
+    prefixes = ["max_stack_usage_", "stack_size_", "prio_", "cpu_usage_"]
     keys = [k[len(prefix):] for k in dir(odrv.system_stats) for prefix in prefixes if k.startswith(prefix)]
     good_keys = set([k for k in set(keys) if keys.count(k) == len(prefixes)])
     if len(good_keys) > len(set(keys)):
         print("Warning: incomplete thread information for threads {}".format(set(keys) - good_keys))
 
-    print("| Name    | Stack Size [B] | Max Ever Stack Usage [B] | Prio |")
-    print("|---------|----------------|--------------------------|------|")
+    print("| Name    | Stack Size [B] | Max Ever Stack Usage [B] | Prio | CPU [%] |")
+    print("|---------|----------------|--------------------------|------|---------|")
     for k in sorted(good_keys):
         sz = getattr(odrv.system_stats, "stack_size_" + k)
         use = getattr(odrv.system_stats, "max_stack_usage_" + k)
-        print("| {} | {} | {} | {} |".format(
+        print("| {} | {} | {} | {} | {} |".format(
             k.ljust(7),
             str(sz).rjust(14),
             "{} ({:.1f}%)".format(use, use / sz * 100).rjust(24),
-            str(getattr(odrv.system_stats, "prio_" + k)).rjust(4)
+            str(getattr(odrv.system_stats, "prio_" + k)).rjust(4),
+            "{:.1f}".format(getattr(odrv.system_stats, "cpu_usage_" + k) * 100).rjust(7)
         ))
+    print("CPU load: {:.1f}%, control loop interrupts: {:.1f}%".format(
+        odrv.system_stats.cpu_load * 100, odrv.system_stats.isr_load * 100))
 
 
 def dump_dma(odrv):
@@ -588,3 +1252,101 @@ def dump_timing(odrv, n_samples=100, path='/tmp/timings.png'):
         tick_label = [name for name, obj, start_times, lengths in timings], # labels
     )
     plt.savefig(path, bbox_inches='tight')
+
+def benchmark_kernels(odrv, iterations=10000, printfunc=print):
+    """
+    Measures the execution time of the hot kernels on the ODrive. All axes
+    must be idle. Returns a dict of kernel name to (min, mean, max) in
+    HCLK ticks.
+    """
+    kernels = {k[len('KERNEL_'):].lower(): v for k, v in odrive.enums.__dict__.items() if k.startswith('KERNEL_')}
+    results = {}
+    for name, kernel in sorted(kernels.items(), key=lambda x: x[1]):
+        if not odrv.kernel_benchmark.run(kernel, iterations):
+            raise Exception("benchmark failed, are all axes idle?")
+        bench = odrv.kernel_benchmark
+        results[name] = (bench.min_cycles, bench.mean_cycles, bench.max_cycles)
+        printfunc("{:8s} min {:6d}  mean {:8.1f}  max {:6d} cycles".format(name, *results[name]))
+    return results
+
+def dump_trace(odrv, duration=0.1, path='/tmp/trace.json'):
+    """
+    Records the interrupt and task timer events of the ODrive for the given
+    duration (in seconds) and saves them as a Chrome trace file which can be
+    opened in chrome://tracing or https://ui.perfetto.dev.
+
+    The firmware must be built with CONFIG_TRACE=true.
+    """
+    import json
+    import re
+
+    if odrv.trace.size <= 1:
+        print("The firmware was not built with CONFIG_TRACE=true")
+        return
+
+    # Map the trace IDs of all task timers to their names
+    names = {}
+    def add_timers(prefix, task_times):
+        for attr in dir(task_times):
+            if not attr.startswith('_'):
+                names[getattr(task_times, attr).trace_id] = prefix + attr
+    add_timers('', odrv.task_times)
+    for k in dir(odrv):
+        if re.match(r'axis[0-9]+', k):
+            add_timers(k + '.', getattr(odrv, k).task_times)
+
+    irq_names = {
+        31: 'I2C1_EV', 32: 'I2C1_ER', 44: 'TIM8_UP_TIM13 (sampling)', 50: 'TIM5',
+        67: 'OTG_FS (USB)', 74: 'housekeeping', 77: 'control loop'
+    }
+
+    odrv.trace.enabled = True
+    time.sleep(duration)
+    odrv.trace.enabled = False
+
+    write_index = odrv.trace.write_index
+    start_index = max(0, write_index - odrv.trace.size)
+    events = [odrv.trace.get_event(i & 0xffffffff) for i in range(start_index, write_index)]
+
+    # Interrupts get a track of their own. Task timers are shown on the track
+    # of the interrupt that they run in.
+    trace = []
+    irq_stack = []
+    t0 = None
+    last_ts = 0
+    wraps = 0
+    for event in events:
+        event_id = event >> 32
+        ts = event & 0xffffffff
+        if ts + (1 << 31) < last_ts:
+            wraps += 1 # DWT counter overflow (small reorderings are due to preemption)
+        last_ts = ts
+        ts += wraps << 32
+        t0 = ts if t0 is None else t0
+        is_exit = event_id & 1
+        event_id &= ~1
+
+        if (event_id & 0xff000000) == 0xff000000:
+            irqn = ((event_id & 0xffffff) >> 2) - 16
+            name = irq_names.get(irqn, 'IRQ {}'.format(irqn))
+            tid = name
+            if is_exit:
+                if irqn in irq_stack:
+                    irq_stack.remove(irqn)
+            else:
+                irq_stack.append(irqn)
+        else:
+            name = names.get(event_id, hex(event_id))
+            tid = irq_names.get(irq_stack[-1], 'IRQ {}'.format(irq_stack[-1])) if irq_stack else 'threads'
+
+        trace.append({
+            'name': name,
+            'ph': 'E' if is_exit else 'B',
+            'ts': (ts - t0) / 168.0, # HCLK ticks to us
+            'pid': 0,
+            'tid': tid
+        })
+
+    with open(path, 'w') as fp:
+        json.dump({'traceEvents': trace}, fp)
+    print("saved {} events to {}".format(len(trace), path))